@@ -0,0 +1,258 @@
+#include "dev_image_viewer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "band_load.h"
+#include "gdiplus_loader.h"
+#include "pixel_kernels.h"
+#include "trace.h"
+
+// the least time between messages for new rows
+#define BAND_LOAD_POST_MS 30
+
+// rows copied at a time from a whole GDI+ decode
+#define BAND_LOAD_COPY_ROWS 256
+
+struct band_load_t {
+	roi_source_t* source;
+	WCHAR* path;
+	uint32_t* bits[BAND_LOAD_NUM_LEVELS];
+	int widths[BAND_LOAD_NUM_LEVELS];
+	int heights[BAND_LOAD_NUM_LEVELS];
+	uint32_t bg_color;
+	HWND hwnd;
+	UINT message;
+	uint64_t start;
+
+	// rows of each level written from level 0, by the one thread
+	// minifying at a time
+	int written[BAND_LOAD_NUM_LEVELS];
+
+	TP_CALLBACK_ENVIRON callback_environ;
+	PTP_CLEANUP_GROUP cleanup_group;
+
+	// guards the rest, shared by the threads decoding and the window's
+	SRWLOCK lock;
+	band_load_state_t state;
+	bool closing;
+	// which rows of level 0 are decoded and baked, as bands finish out of
+	// order, and whether a thread is minifying those above the first gap
+	uint8_t* done;
+	bool minifying;
+	ULONGLONG posted;
+};
+
+static double _elapsed(band_load_t* load)
+{
+	return trace_seconds(trace_begin() - load->start);
+}
+
+// with the lock held, or from the one thread there is
+static void _post(band_load_t* load, bool force)
+{
+	ULONGLONG now = GetTickCount64();
+	if (!force && now - load->posted < BAND_LOAD_POST_MS)
+		return;
+	load->posted = now;
+	PostMessageW(load->hwnd, load->message, 0, 0);
+}
+
+static bool _closing(band_load_t* load)
+{
+	AcquireSRWLockShared(&load->lock);
+	bool closing = load->closing;
+	ReleaseSRWLockShared(&load->lock);
+	return closing;
+}
+
+// reads the preview into its level, and minifies it into the ones below
+static bool _read_preview(band_load_t* load)
+{
+	int level = ROI_SOURCE_PREVIEW_SHIFT;
+	if (!roi_source_read_preview(load->source, load->bits[level], load->widths[level]))
+		return false;
+	pixel_bake_sse2(load->bits[level], load->bits[level],
+		(uint64_t)load->widths[level] * load->heights[level], load->bg_color);
+	for (int i = level + 1; i < BAND_LOAD_NUM_LEVELS; i++) {
+		pixel_downsize_sse2(load->bits[i - 1], load->widths[i - 1], load->heights[i - 1],
+			load->bits[i], load->widths[i], load->heights[i], load->bg_color);
+	}
+
+	AcquireSRWLockExclusive(&load->lock);
+	load->state.preview_level = level;
+	load->state.times.preview_seconds = _elapsed(load);
+	ReleaseSRWLockExclusive(&load->lock);
+	_post(load, true);
+	return true;
+}
+
+// minifies the rows of each level that the rows of level 0 down to y1
+// complete
+static void _minify(band_load_t* load, int y1)
+{
+	// a row of a level needs both rows above it, but the last takes
+	// the odd one alone
+	uint64_t num_pixels = (uint64_t)load->widths[0] * (y1 - load->written[0]);
+	uint64_t start = trace_begin();
+	bool last = y1 == load->heights[0];
+	load->written[0] = y1;
+	for (int i = 1; i < BAND_LOAD_NUM_LEVELS; i++) {
+		int ready = last ? load->heights[i] : load->written[i - 1] / 2;
+		if (ready <= load->written[i])
+			break;
+		pixel_downsize_sse2_rect(load->bits[i - 1], load->widths[i - 1], load->heights[i - 1],
+			load->bits[i], load->widths[i], load->heights[i], load->bg_color,
+			0, load->written[i], load->widths[i], ready);
+		load->written[i] = ready;
+	}
+	trace_end(TRACE_DOWNSIZE, start, num_pixels * 4 * 5 / 3, num_pixels / 3);
+}
+
+// told that rows [y0, y1) of level 0 are decoded, on any thread, in any
+// order. bakes them, and when they extend the rows done from the top,
+// minifies those into the levels below.
+static bool _rows(void* ctx, int y0, int y1)
+{
+	band_load_t* load = (band_load_t*)ctx;
+	if (_closing(load))
+		return false;
+
+	uint64_t num_pixels = (uint64_t)load->widths[0] * (y1 - y0);
+	uint64_t start = trace_begin();
+	uint32_t* rows = load->bits[0] + (size_t)y0 * load->widths[0];
+	pixel_bake_sse2(rows, rows, num_pixels, load->bg_color);
+	trace_end(TRACE_BAKE, start, num_pixels * 4 * 2, num_pixels);
+
+	// one thread minifies at a time, taking on the rows others finish
+	// meanwhile, so the rest go back to decoding
+	AcquireSRWLockExclusive(&load->lock);
+	memset(load->done + y0, 1, y1 - y0);
+	if (!load->minifying) {
+		load->minifying = true;
+		for (;;) {
+			int frontier = load->written[0];
+			while (frontier < load->heights[0] && load->done[frontier])
+				frontier++;
+			if (frontier == load->written[0])
+				break;
+			ReleaseSRWLockExclusive(&load->lock);
+			_minify(load, frontier);
+			AcquireSRWLockExclusive(&load->lock);
+			CopyMemory(load->state.ready, load->written, sizeof(load->written));
+			if (!load->state.times.first_rows_seconds)
+				load->state.times.first_rows_seconds = _elapsed(load);
+			_post(load, false);
+		}
+		load->minifying = false;
+	}
+	ReleaseSRWLockExclusive(&load->lock);
+	return true;
+}
+
+// has GDI+ decode the whole image, and copies it in as if read in rows
+static bool _read_whole(band_load_t* load)
+{
+	HBITMAP hbitmap = NULL;
+	void* bits = NULL;
+	int width = 0;
+	int height = 0;
+	if (!canvas_read_image(load->path, &hbitmap, &bits, &width, &height))
+		return false;
+	bool ok = width == load->widths[0] && height == load->heights[0];
+	for (int y = 0; ok && y < height; y += BAND_LOAD_COPY_ROWS) {
+		int y1 = min(y + BAND_LOAD_COPY_ROWS, height);
+		size_t offset = (size_t)y * width;
+		CopyMemory(load->bits[0] + offset, (uint32_t*)bits + offset,
+			(size_t)(y1 - y) * width * sizeof(uint32_t));
+		ok = _rows(load, y, y1);
+	}
+	DeleteObject(hbitmap);
+	return ok;
+}
+
+static VOID CALLBACK _load(PTP_CALLBACK_INSTANCE instance, PVOID param)
+{
+	band_load_t* load = (band_load_t*)param;
+
+	_read_preview(load);
+	bool ok = roi_source_read_rows(load->source, load->bits[0], load->widths[0],
+		_rows, load);
+	// what the source can't read in rows, or failed on before any
+	if (!ok && !load->written[0] && !_closing(load))
+		ok = _read_whole(load);
+
+	AcquireSRWLockExclusive(&load->lock);
+	load->state.finished = true;
+	load->state.ok = ok;
+	load->state.times.total_seconds = _elapsed(load);
+	ReleaseSRWLockExclusive(&load->lock);
+	_post(load, true);
+}
+
+band_load_t* band_load_start(roi_source_t* source, const WCHAR* path,
+	void* const* bits, const int* widths, const int* heights,
+	uint32_t bg_color, HWND hwnd, UINT message)
+{
+	band_load_t* load = (band_load_t*)calloc(1, sizeof(band_load_t));
+	if (load) {
+		load->path = _wcsdup(path);
+		load->done = (uint8_t*)calloc(heights[0], 1);
+	}
+	if (load && load->path && load->done)
+		load->cleanup_group = CreateThreadpoolCleanupGroup();
+	if (!load || !load->cleanup_group) {
+		if (load) {
+			free(load->path);
+			free(load->done);
+		}
+		free(load);
+		roi_source_close(source);
+		return NULL;
+	}
+	load->source = source;
+	for (int i = 0; i < BAND_LOAD_NUM_LEVELS; i++) {
+		load->bits[i] = (uint32_t*)bits[i];
+		load->widths[i] = widths[i];
+		load->heights[i] = heights[i];
+	}
+	load->bg_color = bg_color;
+	load->hwnd = hwnd;
+	load->message = message;
+	load->state.preview_level = -1;
+	InitializeThreadpoolEnvironment(&load->callback_environ);
+	SetThreadpoolCallbackCleanupGroup(&load->callback_environ,
+		load->cleanup_group, NULL);
+	InitializeSRWLock(&load->lock);
+
+	load->start = trace_begin();
+	if (!TrySubmitThreadpoolCallback(_load, load, &load->callback_environ)) {
+		band_load_close(load);
+		return NULL;
+	}
+	return load;
+}
+
+void band_load_close(band_load_t* load)
+{
+	if (!load)
+		return;
+	// the worker stops at its next band
+	AcquireSRWLockExclusive(&load->lock);
+	load->closing = true;
+	ReleaseSRWLockExclusive(&load->lock);
+	CloseThreadpoolCleanupGroupMembers(load->cleanup_group, TRUE, NULL);
+	CloseThreadpoolCleanupGroup(load->cleanup_group);
+	DestroyThreadpoolEnvironment(&load->callback_environ);
+	roi_source_close(load->source);
+	free(load->path);
+	free(load->done);
+	free(load);
+}
+
+void band_load_get_state(band_load_t* load, band_load_state_t* out_state)
+{
+	AcquireSRWLockShared(&load->lock);
+	*out_state = load->state;
+	ReleaseSRWLockShared(&load->lock);
+}
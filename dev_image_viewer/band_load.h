@@ -0,0 +1,63 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "render.h"
+#include "roi_source.h"
+
+// Loads a large image into the canvas's levels on the system thread pool,
+// so they can show while it loads: a coarse preview first where the format
+// has one cheap (see roi_source_read_preview()), then level 0 a band of
+// rows at a time, on as many threads as the format allows.  Each band is
+// baked by the thread that decoded it, and the rows done from the top are
+// minified into the levels below as they grow.  Rows replace the preview
+// in place, so a level shows the preview until its rows are ready.
+//
+// What can't be read in rows, like a progressive JPEG, is decoded whole by
+// GDI+ after its preview, and then copied in the same way.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BAND_LOAD_NUM_LEVELS (RENDER_NUM_MINIFY_LEVELS + 1)
+
+typedef struct band_load_t band_load_t;
+
+// in seconds from band_load_start(), or 0 for what hasn't happened yet
+typedef struct {
+	double preview_seconds;
+	double first_rows_seconds;
+	double total_seconds;
+} band_load_times_t;
+
+typedef struct {
+	// rows of each level ready, from the top
+	int ready[BAND_LOAD_NUM_LEVELS];
+	// the level holding the preview, which with the levels below it shows
+	// the whole image. -1 until there is one.
+	int preview_level;
+	bool finished;
+	bool ok;			// once finished
+	band_load_times_t times;
+} band_load_state_t;
+
+// takes the source, which is closed with the load.  bits are the levels,
+// as the canvas makes them, each half the one above rounded up, and must
+// outlive the load; they're written only by it until it's closed.  path is
+// for GDI+ to decode, where the source can't be read in rows.  posts
+// message to hwnd as rows are ready, at most every 30 ms, and once when
+// finished.
+band_load_t* band_load_start(roi_source_t* source, const WCHAR* path,
+	void* const* bits, const int* widths, const int* heights,
+	uint32_t bg_color, HWND hwnd, UINT message);
+// stops the load and waits for it.  NULL is ignored.
+void band_load_close(band_load_t* load);
+
+void band_load_get_state(band_load_t* load, band_load_state_t* out_state);
+
+#ifdef __cplusplus
+}
+#endif
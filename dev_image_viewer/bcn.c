@@ -0,0 +1,1024 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#include "bcn.h"
+
+// blocks are read as a little endian bit stream, from the lowest bit of
+// the first byte
+typedef struct {
+	uint64_t lo;
+	uint64_t hi;
+	int pos;
+} bcn_bits_t;
+
+static void _bits_init(bcn_bits_t* bits, const uint8_t* block)
+{
+	memcpy(&bits->lo, block, 8);
+	memcpy(&bits->hi, block + 8, 8);
+	bits->pos = 0;
+}
+
+static uint32_t _bits(bcn_bits_t* bits, int count)
+{
+	if (!count)
+		return 0;
+	int pos = bits->pos;
+	uint64_t value;
+	if (pos >= 64)
+		value = bits->hi >> (pos - 64);
+	else if (pos + count <= 64)
+		value = bits->lo >> pos;
+	else
+		value = (bits->lo >> pos) | (bits->hi << (64 - pos));
+	bits->pos += count;
+	return (uint32_t)value & ((1u << count) - 1);
+}
+
+// a field stored most significant bit first, as some in BC6H are
+static uint32_t _bits_reversed(bcn_bits_t* bits, int count)
+{
+	uint32_t value = 0;
+	for (int i = 0; i < count; i++)
+		value = (value << 1) | _bits(bits, 1);
+	return value;
+}
+
+//
+// BC7 and BC6H partition tables
+//
+
+// which of 2 subsets each pixel is in, one bit per pixel. BC6H uses the
+// first 32.
+static const uint16_t bcn_partitions2[64] = {
+	0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+	0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+	0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+	0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+	0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+	0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+	0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+	0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22,
+};
+
+static const uint8_t bcn_partitions3[64][16] = {
+	{ 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 1, 2, 2, 2, 2 },
+	{ 0, 0, 0, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 2, 1 },
+	{ 0, 0, 0, 0, 2, 0, 0, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+	{ 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 0, 1, 1, 1 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2 },
+	{ 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 2, 2 },
+	{ 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1 },
+	{ 0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2 },
+	{ 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2 },
+	{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+	{ 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2 },
+	{ 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2 },
+	{ 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2 },
+	{ 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2, 1, 2, 2, 2 },
+	{ 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0, 2, 2, 2, 0 },
+	{ 0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2 },
+	{ 0, 1, 1, 1, 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0 },
+	{ 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2 },
+	{ 0, 0, 2, 2, 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1 },
+	{ 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2, 0, 2, 2, 2 },
+	{ 0, 0, 0, 1, 0, 0, 0, 1, 2, 2, 2, 1, 2, 2, 2, 1 },
+	{ 0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2 },
+	{ 0, 0, 0, 0, 1, 1, 0, 0, 2, 2, 1, 0, 2, 2, 1, 0 },
+	{ 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1, 0, 0, 0, 0 },
+	{ 0, 0, 1, 2, 0, 0, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2 },
+	{ 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1, 0, 1, 1, 0 },
+	{ 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1 },
+	{ 0, 0, 2, 2, 1, 1, 0, 2, 1, 1, 0, 2, 0, 0, 2, 2 },
+	{ 0, 1, 1, 0, 0, 1, 1, 0, 2, 0, 0, 2, 2, 2, 2, 2 },
+	{ 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1 },
+	{ 0, 0, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 2, 2, 2, 1 },
+	{ 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 2, 2, 2 },
+	{ 0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 2, 0, 0, 1, 1 },
+	{ 0, 0, 1, 1, 0, 0, 1, 2, 0, 0, 2, 2, 0, 2, 2, 2 },
+	{ 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0 },
+	{ 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0 },
+	{ 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0 },
+	{ 0, 1, 2, 0, 2, 0, 1, 2, 1, 2, 0, 1, 0, 1, 2, 0 },
+	{ 0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1 },
+	{ 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0, 1, 1 },
+	{ 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1 },
+	{ 0, 0, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2, 1, 1, 2, 2 },
+	{ 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 1, 1 },
+	{ 0, 2, 2, 0, 1, 2, 2, 1, 0, 2, 2, 0, 1, 2, 2, 1 },
+	{ 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 0, 1 },
+	{ 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1 },
+	{ 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2 },
+	{ 0, 2, 2, 2, 0, 1, 1, 1, 0, 2, 2, 2, 0, 1, 1, 1 },
+	{ 0, 0, 0, 2, 1, 1, 1, 2, 0, 0, 0, 2, 1, 1, 1, 2 },
+	{ 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2 },
+	{ 0, 2, 2, 2, 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2 },
+	{ 0, 0, 0, 2, 1, 1, 1, 2, 1, 1, 1, 2, 0, 0, 0, 2 },
+	{ 0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2 },
+	{ 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2 },
+	{ 0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2 },
+	{ 0, 0, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2 },
+	{ 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2 },
+	{ 0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 1 },
+	{ 0, 2, 2, 2, 1, 2, 2, 2, 0, 2, 2, 2, 1, 2, 2, 2 },
+	{ 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2 },
+	{ 0, 1, 1, 1, 2, 0, 1, 1, 2, 2, 0, 1, 2, 2, 2, 0 },
+};
+
+// the pixel whose index is stored with its top bit left out, known to be
+// 0, for the second subset of 2, and the second and third of 3. the first
+// subset's is always pixel 0.
+static const uint8_t bcn_anchors2[64] = {
+	15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+	15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+	15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+	 6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15,
+};
+
+static const uint8_t bcn_anchors3_2[64] = {
+	 3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+	 3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+	 8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+	 3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3,
+};
+
+static const uint8_t bcn_anchors3_3[64] = {
+	15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+	15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+	15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+	15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8,
+};
+
+// interpolation weights out of 64, by index bits
+static const uint8_t bcn_weights2[4] = { 0, 21, 43, 64 };
+static const uint8_t bcn_weights3[8] = { 0, 9, 18, 27, 37, 46, 55, 64 };
+static const uint8_t bcn_weights4[16] = {
+	0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64
+};
+
+static const uint8_t* _weights(int index_bits)
+{
+	return index_bits == 2 ? bcn_weights2 : index_bits == 3 ? bcn_weights3 : bcn_weights4;
+}
+
+static int _subset(int num_subsets, int partition, int pixel)
+{
+	if (num_subsets == 2)
+		return (bcn_partitions2[partition] >> pixel) & 1;
+	if (num_subsets == 3)
+		return bcn_partitions3[partition][pixel];
+	return 0;
+}
+
+static bool _is_anchor(int num_subsets, int partition, int pixel)
+{
+	if (!pixel)
+		return true;
+	if (num_subsets == 2)
+		return pixel == bcn_anchors2[partition];
+	if (num_subsets == 3)
+		return pixel == bcn_anchors3_2[partition] || pixel == bcn_anchors3_3[partition];
+	return false;
+}
+
+//
+// BC1 to BC5. decoded blocks are 16 straight alpha pixels, R in the low
+// byte, in rows of 4.
+//
+
+static uint32_t _rgb565(uint32_t color)
+{
+	uint32_t r = (color >> 11) & 0x1F;
+	uint32_t g = (color >> 5) & 0x3F;
+	uint32_t b = color & 0x1F;
+	r = (r << 3) | (r >> 2);
+	g = (g << 2) | (g >> 4);
+	b = (b << 3) | (b >> 2);
+	return 0xFF000000 | (b << 16) | (g << 8) | r;
+}
+
+// two thirds of a plus one third of b, or half of each, per channel
+static uint32_t _mix_third(uint32_t a, uint32_t b)
+{
+	uint32_t result = 0xFF000000;
+	for (int shift = 0; shift < 24; shift += 8)
+		result |= ((2 * ((a >> shift) & 0xFF) + ((b >> shift) & 0xFF)) / 3) << shift;
+	return result;
+}
+
+static uint32_t _mix_half(uint32_t a, uint32_t b)
+{
+	uint32_t result = 0xFF000000;
+	for (int shift = 0; shift < 24; shift += 8)
+		result |= ((((a >> shift) & 0xFF) + ((b >> shift) & 0xFF)) / 2) << shift;
+	return result;
+}
+
+// BC1 has a mode with 3 colors and transparent black, when the first
+// endpoint isn't greater. BC2 and BC3 always have 4 colors.
+static void _bc1_palette(const uint8_t* block, bool allow_3_color, uint32_t palette[4])
+{
+	uint32_t c0 = block[0] | (block[1] << 8);
+	uint32_t c1 = block[2] | (block[3] << 8);
+	palette[0] = _rgb565(c0);
+	palette[1] = _rgb565(c1);
+	if (c0 > c1 || !allow_3_color) {
+		palette[2] = _mix_third(palette[0], palette[1]);
+		palette[3] = _mix_third(palette[1], palette[0]);
+	}
+	else {
+		palette[2] = _mix_half(palette[0], palette[1]);
+		palette[3] = 0;
+	}
+}
+
+static void _bc1_select_naive(const uint8_t* block, const uint32_t palette[4],
+	uint32_t* pixels)
+{
+	uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+	for (int i = 0; i < 16; i++)
+		pixels[i] = palette[(indices >> (2 * i)) & 3];
+}
+
+// a row at a time: each pixel's 2-bit index, compared against 1, 2 and 3,
+// masks in its palette entry
+static void _bc1_select_sse2(const uint8_t* block, const uint32_t palette[4],
+	uint32_t* pixels)
+{
+	const __m128i one = _mm_set1_epi32(1);
+	const __m128i two = _mm_set1_epi32(2);
+	const __m128i three = _mm_set1_epi32(3);
+	const __m128i shifts_mask = _mm_set1_epi32(3);
+	__m128i p0 = _mm_set1_epi32((int)palette[0]);
+	__m128i p1 = _mm_set1_epi32((int)palette[1]);
+	__m128i p2 = _mm_set1_epi32((int)palette[2]);
+	__m128i p3 = _mm_set1_epi32((int)palette[3]);
+	for (int y = 0; y < 4; y++) {
+		uint32_t row = block[4 + y];
+		__m128i index = _mm_and_si128(
+			_mm_set_epi32(row >> 6, row >> 4, row >> 2, row), shifts_mask);
+		__m128i is1 = _mm_cmpeq_epi32(index, one);
+		__m128i is2 = _mm_cmpeq_epi32(index, two);
+		__m128i is3 = _mm_cmpeq_epi32(index, three);
+		__m128i is0 = _mm_andnot_si128(_mm_or_si128(_mm_or_si128(is1, is2), is3),
+			_mm_set1_epi32(-1));
+		__m128i result = _mm_or_si128(
+			_mm_or_si128(_mm_and_si128(is0, p0), _mm_and_si128(is1, p1)),
+			_mm_or_si128(_mm_and_si128(is2, p2), _mm_and_si128(is3, p3)));
+		_mm_storeu_si128((__m128i*)(pixels + 4 * y), result);
+	}
+}
+
+// 8 values between two endpoints, or 6 and 0 and 255
+static void _bc4_palette(const uint8_t* block, uint8_t palette[8])
+{
+	int a = block[0];
+	int b = block[1];
+	palette[0] = (uint8_t)a;
+	palette[1] = (uint8_t)b;
+	if (a > b) {
+		for (int i = 1; i < 7; i++)
+			palette[1 + i] = (uint8_t)(((7 - i) * a + i * b) / 7);
+	}
+	else {
+		for (int i = 1; i < 5; i++)
+			palette[1 + i] = (uint8_t)(((5 - i) * a + i * b) / 5);
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+static void _bc4_values(const uint8_t* block, uint8_t values[16])
+{
+	uint8_t palette[8];
+	_bc4_palette(block, palette);
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; i++)
+		indices |= (uint64_t)block[2 + i] << (8 * i);
+	for (int i = 0; i < 16; i++)
+		values[i] = palette[(indices >> (3 * i)) & 7];
+}
+
+// explicit 4-bit alpha
+static void _bc2_alpha(const uint8_t* block, uint8_t values[16])
+{
+	for (int i = 0; i < 8; i++) {
+		values[2 * i] = (uint8_t)((block[i] & 0x0F) * 17);
+		values[2 * i + 1] = (uint8_t)((block[i] >> 4) * 17);
+	}
+}
+
+static void _set_alpha_naive(uint32_t* pixels, const uint8_t alpha[16])
+{
+	for (int i = 0; i < 16; i++)
+		pixels[i] = (pixels[i] & 0x00FFFFFF) | ((uint32_t)alpha[i] << 24);
+}
+
+static void _set_alpha_sse2(uint32_t* pixels, const uint8_t alpha[16])
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i rgb_mask = _mm_set1_epi32(0x00FFFFFF);
+	__m128i values = _mm_loadu_si128((const __m128i*)alpha);
+	__m128i lo = _mm_unpacklo_epi8(zero, values);
+	__m128i hi = _mm_unpackhi_epi8(zero, values);
+	// each alpha into the top byte of its pixel's lane
+	__m128i alphas[4] = {
+		_mm_unpacklo_epi16(zero, lo), _mm_unpackhi_epi16(zero, lo),
+		_mm_unpacklo_epi16(zero, hi), _mm_unpackhi_epi16(zero, hi),
+	};
+	for (int i = 0; i < 4; i++) {
+		__m128i* ptr = (__m128i*)(pixels + 4 * i);
+		__m128i rgb = _mm_and_si128(_mm_loadu_si128(ptr), rgb_mask);
+		_mm_storeu_si128(ptr, _mm_or_si128(rgb, _mm_and_si128(alphas[i],
+			_mm_set1_epi32((int)0xFF000000))));
+	}
+}
+
+// BC4 as grey, or BC5 as red and green
+static void _bc45_pixels_naive(const uint8_t* red, const uint8_t* green, uint32_t* pixels)
+{
+	for (int i = 0; i < 16; i++) {
+		uint32_t r = red[i];
+		uint32_t g = green ? green[i] : r;
+		uint32_t b = green ? 0 : r;
+		pixels[i] = 0xFF000000 | (b << 16) | (g << 8) | r;
+	}
+}
+
+static void _bc45_pixels_sse2(const uint8_t* red, const uint8_t* green, uint32_t* pixels)
+{
+	__m128i r = _mm_loadu_si128((const __m128i*)red);
+	__m128i g = green ? _mm_loadu_si128((const __m128i*)green) : r;
+	__m128i b = green ? _mm_setzero_si128() : r;
+	__m128i a = _mm_set1_epi8((char)0xFF);
+	__m128i rg_lo = _mm_unpacklo_epi8(r, g);
+	__m128i rg_hi = _mm_unpackhi_epi8(r, g);
+	__m128i ba_lo = _mm_unpacklo_epi8(b, a);
+	__m128i ba_hi = _mm_unpackhi_epi8(b, a);
+	_mm_storeu_si128((__m128i*)pixels, _mm_unpacklo_epi16(rg_lo, ba_lo));
+	_mm_storeu_si128((__m128i*)(pixels + 4), _mm_unpackhi_epi16(rg_lo, ba_lo));
+	_mm_storeu_si128((__m128i*)(pixels + 8), _mm_unpacklo_epi16(rg_hi, ba_hi));
+	_mm_storeu_si128((__m128i*)(pixels + 12), _mm_unpackhi_epi16(rg_hi, ba_hi));
+}
+
+//
+// BC7
+//
+
+typedef struct {
+	uint8_t num_subsets;
+	uint8_t partition_bits;
+	uint8_t rotation_bits;
+	uint8_t index_selection_bits;
+	uint8_t color_bits;
+	uint8_t alpha_bits;
+	uint8_t endpoint_pbits;		// one p-bit per endpoint
+	uint8_t shared_pbits;		// one per subset, shared by its endpoints
+	uint8_t index_bits;
+	uint8_t index2_bits;		// separate alpha indices
+} bc7_mode_t;
+
+static const bc7_mode_t bc7_modes[8] = {
+	{ 3, 4, 0, 0, 4, 0, 1, 0, 3, 0 },
+	{ 2, 6, 0, 0, 6, 0, 0, 1, 3, 0 },
+	{ 3, 6, 0, 0, 5, 0, 0, 0, 2, 0 },
+	{ 2, 6, 0, 0, 7, 0, 1, 0, 2, 0 },
+	{ 1, 0, 2, 1, 5, 6, 0, 0, 2, 3 },
+	{ 1, 0, 2, 0, 7, 8, 0, 0, 2, 2 },
+	{ 1, 0, 0, 0, 7, 7, 1, 0, 4, 0 },
+	{ 2, 6, 0, 0, 5, 5, 1, 0, 2, 0 },
+};
+
+// a BC7 block unpacked to what interpolating it needs
+typedef struct {
+	// [subset][endpoint], RGBA, R in the low byte
+	uint32_t endpoints[3][2];
+	uint8_t subsets[16];
+	uint8_t color_weights[16];
+	uint8_t alpha_weights[16];
+	int rotation;
+} bc7_block_t;
+
+static uint32_t _expand_bits(uint32_t value, int bits)
+{
+	value <<= 8 - bits;
+	return value | (value >> bits);
+}
+
+// false for the reserved mode, which decodes as transparent black
+static bool _bc7_unpack(const uint8_t* block, bc7_block_t* out)
+{
+	bcn_bits_t bits;
+	_bits_init(&bits, block);
+	int mode_index = 0;
+	while (mode_index < 8 && !_bits(&bits, 1))
+		mode_index++;
+	if (mode_index == 8)
+		return false;
+
+	const bc7_mode_t* mode = &bc7_modes[mode_index];
+	int num_subsets = mode->num_subsets;
+	int partition = _bits(&bits, mode->partition_bits);
+	out->rotation = _bits(&bits, mode->rotation_bits);
+	int index_selection = _bits(&bits, mode->index_selection_bits);
+
+	// all of red, then green, blue and alpha, each endpoint of each subset
+	uint32_t channels[3][2][4];
+	for (int c = 0; c < 3; c++) {
+		for (int s = 0; s < num_subsets; s++) {
+			channels[s][0][c] = _bits(&bits, mode->color_bits);
+			channels[s][1][c] = _bits(&bits, mode->color_bits);
+		}
+	}
+	for (int s = 0; s < num_subsets; s++) {
+		channels[s][0][3] = _bits(&bits, mode->alpha_bits);
+		channels[s][1][3] = _bits(&bits, mode->alpha_bits);
+	}
+
+	int color_bits = mode->color_bits;
+	int alpha_bits = mode->alpha_bits;
+	if (mode->endpoint_pbits || mode->shared_pbits) {
+		for (int s = 0; s < num_subsets; s++) {
+			uint32_t shared = mode->shared_pbits ? _bits(&bits, 1) : 0;
+			for (int e = 0; e < 2; e++) {
+				uint32_t pbit = mode->endpoint_pbits ? _bits(&bits, 1) : shared;
+				for (int c = 0; c < 4; c++)
+					channels[s][e][c] = (channels[s][e][c] << 1) | pbit;
+			}
+		}
+		color_bits++;
+		if (alpha_bits)
+			alpha_bits++;
+	}
+
+	for (int s = 0; s < num_subsets; s++) {
+		for (int e = 0; e < 2; e++) {
+			uint32_t r = _expand_bits(channels[s][e][0], color_bits);
+			uint32_t g = _expand_bits(channels[s][e][1], color_bits);
+			uint32_t b = _expand_bits(channels[s][e][2], color_bits);
+			uint32_t a = alpha_bits ? _expand_bits(channels[s][e][3], alpha_bits) : 255;
+			out->endpoints[s][e] = (a << 24) | (b << 16) | (g << 8) | r;
+		}
+	}
+
+	uint8_t indices[16];
+	for (int i = 0; i < 16; i++) {
+		out->subsets[i] = (uint8_t)_subset(num_subsets, partition, i);
+		indices[i] = (uint8_t)_bits(&bits,
+			mode->index_bits - _is_anchor(num_subsets, partition, i));
+	}
+	const uint8_t* weights = _weights(mode->index_bits);
+	if (!mode->index2_bits) {
+		for (int i = 0; i < 16; i++)
+			out->color_weights[i] = out->alpha_weights[i] = weights[indices[i]];
+		return true;
+	}
+
+	// modes 4 and 5 index alpha separately, and 4 can swap which of the
+	// two index sets is for color
+	const uint8_t* weights2 = _weights(mode->index2_bits);
+	for (int i = 0; i < 16; i++) {
+		uint8_t index2 = (uint8_t)_bits(&bits, mode->index2_bits - !i);
+		if (index_selection) {
+			out->color_weights[i] = weights2[index2];
+			out->alpha_weights[i] = weights[indices[i]];
+		}
+		else {
+			out->color_weights[i] = weights[indices[i]];
+			out->alpha_weights[i] = weights2[index2];
+		}
+	}
+	return true;
+}
+
+// swaps alpha with red, green or blue after interpolation
+static uint32_t _bc7_rotate(uint32_t pixel, int rotation)
+{
+	if (!rotation)
+		return pixel;
+	int shift = 8 * (rotation - 1);
+	uint32_t a = pixel >> 24;
+	uint32_t c = (pixel >> shift) & 0xFF;
+	pixel &= ~(0xFFu << shift) & 0x00FFFFFF;
+	return pixel | (a << shift) | (c << 24);
+}
+
+static void _bc7_decode_naive(const uint8_t* block, uint32_t* pixels)
+{
+	bc7_block_t unpacked;
+	if (!_bc7_unpack(block, &unpacked)) {
+		memset(pixels, 0, 16 * sizeof(uint32_t));
+		return;
+	}
+	for (int i = 0; i < 16; i++) {
+		uint32_t e0 = unpacked.endpoints[unpacked.subsets[i]][0];
+		uint32_t e1 = unpacked.endpoints[unpacked.subsets[i]][1];
+		uint32_t pixel = 0;
+		for (int c = 0; c < 4; c++) {
+			uint32_t w = c == 3 ? unpacked.alpha_weights[i] : unpacked.color_weights[i];
+			uint32_t v0 = (e0 >> (8 * c)) & 0xFF;
+			uint32_t v1 = (e1 >> (8 * c)) & 0xFF;
+			pixel |= (((64 - w) * v0 + w * v1 + 32) >> 6) << (8 * c);
+		}
+		pixels[i] = _bc7_rotate(pixel, unpacked.rotation);
+	}
+}
+
+// two pixels at a time, one in each half, in 16-bit lanes
+static void _bc7_decode_sse2(const uint8_t* block, uint32_t* pixels)
+{
+	bc7_block_t unpacked;
+	if (!_bc7_unpack(block, &unpacked)) {
+		memset(pixels, 0, 16 * sizeof(uint32_t));
+		return;
+	}
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i sixty_four = _mm_set1_epi16(64);
+	const __m128i round = _mm_set1_epi16(32);
+	for (int i = 0; i < 16; i += 2) {
+		const uint32_t* pair0 = unpacked.endpoints[unpacked.subsets[i]];
+		const uint32_t* pair1 = unpacked.endpoints[unpacked.subsets[i + 1]];
+		__m128i e0 = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, (int)pair1[0], (int)pair0[0]), zero);
+		__m128i e1 = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, (int)pair1[1], (int)pair0[1]), zero);
+		__m128i w = _mm_set_epi16(
+			unpacked.alpha_weights[i + 1], unpacked.color_weights[i + 1],
+			unpacked.color_weights[i + 1], unpacked.color_weights[i + 1],
+			unpacked.alpha_weights[i], unpacked.color_weights[i],
+			unpacked.color_weights[i], unpacked.color_weights[i]);
+		__m128i sum = _mm_add_epi16(
+			_mm_mullo_epi16(e0, _mm_sub_epi16(sixty_four, w)),
+			_mm_mullo_epi16(e1, w));
+		sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 6);
+		_mm_storel_epi64((__m128i*)(pixels + i), _mm_packus_epi16(sum, zero));
+	}
+	if (unpacked.rotation) {
+		for (int i = 0; i < 16; i++)
+			pixels[i] = _bc7_rotate(pixels[i], unpacked.rotation);
+	}
+}
+
+//
+// BC6H. decoded blocks are half floats, RGB, before conversion to 8 bits.
+//
+
+typedef struct {
+	uint8_t transformed;	// endpoints after the first are deltas from it
+	uint8_t num_subsets;
+	uint8_t endpoint_bits;
+	uint8_t delta_bits[3];	// per channel
+} bc6h_mode_t;
+
+// by the mode field: 2 bits for modes 1 and 2, and 5 bits for the rest.
+// the gaps are reserved.
+static const bc6h_mode_t bc6h_modes[32] = {
+	[0x00] = { 1, 2, 10, { 5, 5, 5 } },
+	[0x01] = { 1, 2, 7, { 6, 6, 6 } },
+	[0x02] = { 1, 2, 11, { 5, 4, 4 } },
+	[0x06] = { 1, 2, 11, { 4, 5, 4 } },
+	[0x0A] = { 1, 2, 11, { 4, 4, 5 } },
+	[0x0E] = { 1, 2, 9, { 5, 5, 5 } },
+	[0x12] = { 1, 2, 8, { 6, 5, 5 } },
+	[0x16] = { 1, 2, 8, { 5, 6, 5 } },
+	[0x1A] = { 1, 2, 8, { 5, 5, 6 } },
+	[0x1E] = { 0, 2, 6, { 6, 6, 6 } },
+	[0x03] = { 0, 1, 10, { 10, 10, 10 } },
+	[0x07] = { 1, 1, 11, { 9, 9, 9 } },
+	[0x0B] = { 1, 1, 12, { 8, 8, 8 } },
+	[0x0F] = { 1, 1, 16, { 4, 4, 4 } },
+};
+
+// adds a field's bits, read at the current position, at shift
+#define BC6H_FIELD(target, count, shift) ((target) |= _bits(&bits, (count)) << (shift))
+
+static int _sign_extend(int value, int bits)
+{
+	int shift = 32 - bits;
+	return (int)((uint32_t)value << shift) >> shift;
+}
+
+static int _bc6h_unquantize(int value, int bits, bool is_signed)
+{
+	if (!is_signed) {
+		if (bits >= 15 || !value)
+			return value;
+		if (value == (1 << bits) - 1)
+			return 0xFFFF;
+		return ((value << 16) + 0x8000) >> bits;
+	}
+	if (bits >= 16)
+		return value;
+	bool negative = value < 0;
+	if (negative)
+		value = -value;
+	int result;
+	if (!value)
+		result = 0;
+	else if (value >= (1 << (bits - 1)) - 1)
+		result = 0x7FFF;
+	else
+		result = ((value << 15) + 0x4000) >> (bits - 1);
+	return negative ? -result : result;
+}
+
+// the interpolated value, scaled to the bits of a half float
+static uint16_t _bc6h_finish(int value, bool is_signed)
+{
+	if (!is_signed)
+		return (uint16_t)((value * 31) >> 6);
+	if (value < 0)
+		return (uint16_t)(0x8000 | ((-value * 31) >> 5));
+	return (uint16_t)((value * 31) >> 5);
+}
+
+// false for reserved modes, which decode as black
+static bool _bc6h_unpack(const uint8_t* block, bool is_signed, uint16_t halves[16][3])
+{
+	bcn_bits_t bits;
+	_bits_init(&bits, block);
+	int mode_bits = _bits(&bits, 2);
+	if (mode_bits & 2)
+		mode_bits |= _bits(&bits, 3) << 2;
+	const bc6h_mode_t* mode = &bc6h_modes[mode_bits];
+	if (!mode->endpoint_bits)
+		return false;
+
+	// w, x are the endpoints of the first subset, and y, z of the second,
+	// laid out field by field as the mode has them
+	int r[4] = { 0 }, g[4] = { 0 }, b[4] = { 0 };
+	int partition = 0;
+	switch (mode_bits) {
+	case 0x00:
+		BC6H_FIELD(g[2], 1, 4); BC6H_FIELD(b[2], 1, 4); BC6H_FIELD(b[3], 1, 4);
+		BC6H_FIELD(r[0], 10, 0); BC6H_FIELD(g[0], 10, 0); BC6H_FIELD(b[0], 10, 0);
+		BC6H_FIELD(r[1], 5, 0); BC6H_FIELD(g[3], 1, 4); BC6H_FIELD(g[2], 4, 0);
+		BC6H_FIELD(g[1], 5, 0); BC6H_FIELD(b[3], 1, 0); BC6H_FIELD(g[3], 4, 0);
+		BC6H_FIELD(b[1], 5, 0); BC6H_FIELD(b[3], 1, 1); BC6H_FIELD(b[2], 4, 0);
+		BC6H_FIELD(r[2], 5, 0); BC6H_FIELD(b[3], 1, 2);
+		BC6H_FIELD(r[3], 5, 0); BC6H_FIELD(b[3], 1, 3);
+		break;
+	case 0x01:
+		BC6H_FIELD(g[2], 1, 5); BC6H_FIELD(g[3], 1, 4); BC6H_FIELD(g[3], 1, 5);
+		BC6H_FIELD(r[0], 7, 0); BC6H_FIELD(b[3], 1, 0); BC6H_FIELD(b[3], 1, 1); BC6H_FIELD(b[2], 1, 4);
+		BC6H_FIELD(g[0], 7, 0); BC6H_FIELD(b[2], 1, 5); BC6H_FIELD(b[3], 1, 2); BC6H_FIELD(g[2], 1, 4);
+		BC6H_FIELD(b[0], 7, 0); BC6H_FIELD(b[3], 1, 3); BC6H_FIELD(b[3], 1, 5); BC6H_FIELD(b[3], 1, 4);
+		BC6H_FIELD(r[1], 6, 0); BC6H_FIELD(g[2], 4, 0);
+		BC6H_FIELD(g[1], 6, 0); BC6H_FIELD(g[3], 4, 0);
+		BC6H_FIELD(b[1], 6, 0); BC6H_FIELD(b[2], 4, 0);
+		BC6H_FIELD(r[2], 6, 0);
+		BC6H_FIELD(r[3], 6, 0);
+		break;
+	case 0x02:
+		BC6H_FIELD(r[0], 10, 0); BC6H_FIELD(g[0], 10, 0); BC6H_FIELD(b[0], 10, 0);
+		BC6H_FIELD(r[1], 5, 0); BC6H_FIELD(r[0], 1, 10); BC6H_FIELD(g[2], 4, 0);
+		BC6H_FIELD(g[1], 4, 0); BC6H_FIELD(g[0], 1, 10); BC6H_FIELD(b[3], 1, 0); BC6H_FIELD(g[3], 4, 0);
+		BC6H_FIELD(b[1], 4, 0); BC6H_FIELD(b[0], 1, 10); BC6H_FIELD(b[3], 1, 1); BC6H_FIELD(b[2], 4, 0);
+		BC6H_FIELD(r[2], 5, 0); BC6H_FIELD(b[3], 1, 2);
+		BC6H_FIELD(r[3], 5, 0); BC6H_FIELD(b[3], 1, 3);
+		break;
+	case 0x06:
+		BC6H_FIELD(r[0], 10, 0); BC6H_FIELD(g[0], 10, 0); BC6H_FIELD(b[0], 10, 0);
+		BC6H_FIELD(r[1], 4, 0); BC6H_FIELD(r[0], 1, 10); BC6H_FIELD(g[3], 1, 4); BC6H_FIELD(g[2], 4, 0);
+		BC6H_FIELD(g[1], 5, 0); BC6H_FIELD(g[0], 1, 10); BC6H_FIELD(g[3], 4, 0);
+		BC6H_FIELD(b[1], 4, 0); BC6H_FIELD(b[0], 1, 10); BC6H_FIELD(b[3], 1, 1); BC6H_FIELD(b[2], 4, 0);
+		BC6H_FIELD(r[2], 4, 0); BC6H_FIELD(b[3], 1, 0); BC6H_FIELD(b[3], 1, 2);
+		BC6H_FIELD(r[3], 4, 0); BC6H_FIELD(g[2], 1, 4); BC6H_FIELD(b[3], 1, 3);
+		break;
+	case 0x0A:
+		BC6H_FIELD(r[0], 10, 0); BC6H_FIELD(g[0], 10, 0); BC6H_FIELD(b[0], 10, 0);
+		BC6H_FIELD(r[1], 4, 0); BC6H_FIELD(r[0], 1, 10); BC6H_FIELD(b[2], 1, 4); BC6H_FIELD(g[2], 4, 0);
+		BC6H_FIELD(g[1], 4, 0); BC6H_FIELD(g[0], 1, 10); BC6H_FIELD(b[3], 1, 0); BC6H_FIELD(g[3], 4, 0);
+		BC6H_FIELD(b[1], 5, 0); BC6H_FIELD(b[0], 1, 10); BC6H_FIELD(b[2], 4, 0);
+		BC6H_FIELD(r[2], 4, 0); BC6H_FIELD(b[3], 1, 1); BC6H_FIELD(b[3], 1, 2);
+		BC6H_FIELD(r[3], 4, 0); BC6H_FIELD(b[3], 1, 4); BC6H_FIELD(b[3], 1, 3);
+		break;
+	case 0x0E:
+		BC6H_FIELD(r[0], 9, 0); BC6H_FIELD(b[2], 1, 4);
+		BC6H_FIELD(g[0], 9, 0); BC6H_FIELD(g[2], 1, 4);
+		BC6H_FIELD(b[0], 9, 0); BC6H_FIELD(b[3], 1, 4);
+		BC6H_FIELD(r[1], 5, 0); BC6H_FIELD(g[3], 1, 4); BC6H_FIELD(g[2], 4, 0);
+		BC6H_FIELD(g[1], 5, 0); BC6H_FIELD(b[3], 1, 0); BC6H_FIELD(g[3], 4, 0);
+		BC6H_FIELD(b[1], 5, 0); BC6H_FIELD(b[3], 1, 1); BC6H_FIELD(b[2], 4, 0);
+		BC6H_FIELD(r[2], 5, 0); BC6H_FIELD(b[3], 1, 2);
+		BC6H_FIELD(r[3], 5, 0); BC6H_FIELD(b[3], 1, 3);
+		break;
+	case 0x12:
+		BC6H_FIELD(r[0], 8, 0); BC6H_FIELD(g[3], 1, 4); BC6H_FIELD(b[2], 1, 4);
+		BC6H_FIELD(g[0], 8, 0); BC6H_FIELD(b[3], 1, 2); BC6H_FIELD(g[2], 1, 4);
+		BC6H_FIELD(b[0], 8, 0); BC6H_FIELD(b[3], 1, 3); BC6H_FIELD(b[3], 1, 4);
+		BC6H_FIELD(r[1], 6, 0); BC6H_FIELD(g[2], 4, 0);
+		BC6H_FIELD(g[1], 5, 0); BC6H_FIELD(b[3], 1, 0); BC6H_FIELD(g[3], 4, 0);
+		BC6H_FIELD(b[1], 5, 0); BC6H_FIELD(b[3], 1, 1); BC6H_FIELD(b[2], 4, 0);
+		BC6H_FIELD(r[2], 6, 0);
+		BC6H_FIELD(r[3], 6, 0);
+		break;
+	case 0x16:
+		BC6H_FIELD(r[0], 8, 0); BC6H_FIELD(b[3], 1, 0); BC6H_FIELD(b[2], 1, 4);
+		BC6H_FIELD(g[0], 8, 0); BC6H_FIELD(g[2], 1, 5); BC6H_FIELD(g[2], 1, 4);
+		BC6H_FIELD(b[0], 8, 0); BC6H_FIELD(g[3], 1, 5); BC6H_FIELD(b[3], 1, 4);
+		BC6H_FIELD(r[1], 5, 0); BC6H_FIELD(g[3], 1, 4); BC6H_FIELD(g[2], 4, 0);
+		BC6H_FIELD(g[1], 6, 0); BC6H_FIELD(g[3], 4, 0);
+		BC6H_FIELD(b[1], 5, 0); BC6H_FIELD(b[3], 1, 1); BC6H_FIELD(b[2], 4, 0);
+		BC6H_FIELD(r[2], 5, 0); BC6H_FIELD(b[3], 1, 2);
+		BC6H_FIELD(r[3], 5, 0); BC6H_FIELD(b[3], 1, 3);
+		break;
+	case 0x1A:
+		BC6H_FIELD(r[0], 8, 0); BC6H_FIELD(b[3], 1, 1); BC6H_FIELD(b[2], 1, 4);
+		BC6H_FIELD(g[0], 8, 0); BC6H_FIELD(b[2], 1, 5); BC6H_FIELD(g[2], 1, 4);
+		BC6H_FIELD(b[0], 8, 0); BC6H_FIELD(b[3], 1, 5); BC6H_FIELD(b[3], 1, 4);
+		BC6H_FIELD(r[1], 5, 0); BC6H_FIELD(g[3], 1, 4); BC6H_FIELD(g[2], 4, 0);
+		BC6H_FIELD(g[1], 5, 0); BC6H_FIELD(b[3], 1, 0); BC6H_FIELD(g[3], 4, 0);
+		BC6H_FIELD(b[1], 6, 0); BC6H_FIELD(b[2], 4, 0);
+		BC6H_FIELD(r[2], 5, 0); BC6H_FIELD(b[3], 1, 2);
+		BC6H_FIELD(r[3], 5, 0); BC6H_FIELD(b[3], 1, 3);
+		break;
+	case 0x1E:
+		BC6H_FIELD(r[0], 6, 0); BC6H_FIELD(g[3], 1, 4); BC6H_FIELD(b[3], 1, 0); BC6H_FIELD(b[3], 1, 1); BC6H_FIELD(b[2], 1, 4);
+		BC6H_FIELD(g[0], 6, 0); BC6H_FIELD(g[2], 1, 5); BC6H_FIELD(b[2], 1, 5); BC6H_FIELD(b[3], 1, 2); BC6H_FIELD(g[2], 1, 4);
+		BC6H_FIELD(b[0], 6, 0); BC6H_FIELD(g[3], 1, 5); BC6H_FIELD(b[3], 1, 3); BC6H_FIELD(b[3], 1, 5); BC6H_FIELD(b[3], 1, 4);
+		BC6H_FIELD(r[1], 6, 0); BC6H_FIELD(g[2], 4, 0);
+		BC6H_FIELD(g[1], 6, 0); BC6H_FIELD(g[3], 4, 0);
+		BC6H_FIELD(b[1], 6, 0); BC6H_FIELD(b[2], 4, 0);
+		BC6H_FIELD(r[2], 6, 0);
+		BC6H_FIELD(r[3], 6, 0);
+		break;
+	case 0x03:
+		BC6H_FIELD(r[0], 10, 0); BC6H_FIELD(g[0], 10, 0); BC6H_FIELD(b[0], 10, 0);
+		BC6H_FIELD(r[1], 10, 0); BC6H_FIELD(g[1], 10, 0); BC6H_FIELD(b[1], 10, 0);
+		break;
+	case 0x07:
+		BC6H_FIELD(r[0], 10, 0); BC6H_FIELD(g[0], 10, 0); BC6H_FIELD(b[0], 10, 0);
+		BC6H_FIELD(r[1], 9, 0); BC6H_FIELD(r[0], 1, 10);
+		BC6H_FIELD(g[1], 9, 0); BC6H_FIELD(g[0], 1, 10);
+		BC6H_FIELD(b[1], 9, 0); BC6H_FIELD(b[0], 1, 10);
+		break;
+	case 0x0B:
+		BC6H_FIELD(r[0], 10, 0); BC6H_FIELD(g[0], 10, 0); BC6H_FIELD(b[0], 10, 0);
+		BC6H_FIELD(r[1], 8, 0); r[0] |= _bits_reversed(&bits, 2) << 10;
+		BC6H_FIELD(g[1], 8, 0); g[0] |= _bits_reversed(&bits, 2) << 10;
+		BC6H_FIELD(b[1], 8, 0); b[0] |= _bits_reversed(&bits, 2) << 10;
+		break;
+	case 0x0F:
+		BC6H_FIELD(r[0], 10, 0); BC6H_FIELD(g[0], 10, 0); BC6H_FIELD(b[0], 10, 0);
+		BC6H_FIELD(r[1], 4, 0); r[0] |= _bits_reversed(&bits, 6) << 10;
+		BC6H_FIELD(g[1], 4, 0); g[0] |= _bits_reversed(&bits, 6) << 10;
+		BC6H_FIELD(b[1], 4, 0); b[0] |= _bits_reversed(&bits, 6) << 10;
+		break;
+	}
+	int num_subsets = mode->num_subsets;
+	if (num_subsets == 2)
+		partition = _bits(&bits, 5);
+
+	int num_endpoints = 2 * num_subsets;
+	int endpoint_bits = mode->endpoint_bits;
+	int mask = (1 << endpoint_bits) - 1;
+	int* channels[3] = { r, g, b };
+	for (int c = 0; c < 3; c++) {
+		int* e = channels[c];
+		if (is_signed)
+			e[0] = _sign_extend(e[0], endpoint_bits);
+		for (int i = 1; i < num_endpoints; i++) {
+			if (mode->transformed) {
+				e[i] = (e[0] + _sign_extend(e[i], mode->delta_bits[c])) & mask;
+				if (is_signed)
+					e[i] = _sign_extend(e[i], endpoint_bits);
+			}
+			else if (is_signed) {
+				e[i] = _sign_extend(e[i], endpoint_bits);
+			}
+		}
+		for (int i = 0; i < num_endpoints; i++)
+			e[i] = _bc6h_unquantize(e[i], endpoint_bits, is_signed);
+	}
+
+	int index_bits = num_subsets == 2 ? 3 : 4;
+	const uint8_t* weights = _weights(index_bits);
+	for (int i = 0; i < 16; i++) {
+		int s = _subset(num_subsets, partition, i);
+		int w = weights[_bits(&bits, index_bits - _is_anchor(num_subsets, partition, i))];
+		for (int c = 0; c < 3; c++) {
+			int* e = channels[c];
+			int value = ((64 - w) * e[2 * s] + w * e[2 * s + 1] + 32) >> 6;
+			halves[i][c] = _bc6h_finish(value, is_signed);
+		}
+	}
+	return true;
+}
+
+#undef BC6H_FIELD
+
+// as a float, clamped to [0, 1], to 8 bits
+static uint32_t _half_to_unorm8(uint16_t half)
+{
+	// negatives clamp to 0, and anything from 1 up, including infinity
+	// and NaN, to 1
+	if (half & 0x8000)
+		return 0;
+	if (half >= 0x3C00)
+		return 255;
+	// shifted into a float's exponent and mantissa, and rebiased by
+	// multiplying, which also handles denormals
+	union { uint32_t u; float f; } bits;
+	bits.u = (uint32_t)half << 13;
+	float value = bits.f * 5.192297e33f;	// 2^112
+	return (uint32_t)(value * 255.0f + 0.5f);
+}
+
+static void _bc6h_decode_naive(const uint8_t* block, bool is_signed, uint32_t* pixels)
+{
+	uint16_t halves[16][3];
+	if (!_bc6h_unpack(block, is_signed, halves)) {
+		for (int i = 0; i < 16; i++)
+			pixels[i] = 0xFF000000;
+		return;
+	}
+	for (int i = 0; i < 16; i++) {
+		pixels[i] = 0xFF000000 |
+			(_half_to_unorm8(halves[i][2]) << 16) |
+			(_half_to_unorm8(halves[i][1]) << 8) |
+			_half_to_unorm8(halves[i][0]);
+	}
+}
+
+// the same conversion as _half_to_unorm8(), a pixel at a time
+static void _bc6h_decode_sse2(const uint8_t* block, bool is_signed, uint32_t* pixels)
+{
+	uint16_t halves[16][3];
+	if (!_bc6h_unpack(block, is_signed, halves)) {
+		for (int i = 0; i < 16; i++)
+			pixels[i] = 0xFF000000;
+		return;
+	}
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi32(0x3C00);
+	const __m128 scale = _mm_set1_ps(5.192297e33f);
+	const __m128 to_unorm = _mm_set1_ps(255.0f);
+	const __m128 half_unit = _mm_set1_ps(0.5f);
+	const __m128i opaque = _mm_set1_epi32((int)0xFF000000);
+	for (int i = 0; i < 16; i += 2) {
+		// R, G, B and a dummy for alpha, for two pixels
+		__m128i values = _mm_set_epi16(0, (short)halves[i + 1][2], (short)halves[i + 1][1],
+			(short)halves[i + 1][0], 0, (short)halves[i][2], (short)halves[i][1],
+			(short)halves[i][0]);
+		// negatives to 0, as signed 16 bit they're below everything else
+		values = _mm_max_epi16(values, zero);
+		__m128i lo = _mm_unpacklo_epi16(values, zero);
+		__m128i hi = _mm_unpackhi_epi16(values, zero);
+		__m128i results[2];
+		__m128i halves32[2] = { lo, hi };
+		for (int j = 0; j < 2; j++) {
+			__m128i clamped = halves32[j];
+			__m128i is_one = _mm_cmpgt_epi32(clamped, _mm_sub_epi32(one, _mm_set1_epi32(1)));
+			clamped = _mm_or_si128(_mm_andnot_si128(is_one, clamped), _mm_and_si128(is_one, one));
+			__m128 value = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(clamped, 13)), scale);
+			results[j] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, to_unorm), half_unit));
+		}
+		__m128i packed = _mm_packs_epi32(results[0], results[1]);
+		packed = _mm_packus_epi16(packed, zero);
+		packed = _mm_or_si128(packed, opaque);
+		_mm_storel_epi64((__m128i*)(pixels + i), packed);
+	}
+}
+
+//
+// output
+//
+
+// premultiplies straight RGBA and swaps it to BGRA, rounding c * a / 255
+// to nearest
+static uint32_t _premultiply(uint32_t pixel)
+{
+	uint32_t a = pixel >> 24;
+	uint32_t result = a << 24;
+	for (int c = 0; c < 3; c++) {
+		uint32_t t = ((pixel >> (8 * c)) & 0xFF) * a + 128;
+		result |= ((t + (t >> 8)) >> 8) << (16 - 8 * c);
+	}
+	return result;
+}
+
+static void _write_naive(const uint32_t* pixels, uint32_t* dest, int stride,
+	int width, int height)
+{
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++)
+			dest[(size_t)y * stride + x] = _premultiply(pixels[4 * y + x]);
+	}
+}
+
+static void _write_sse2(const uint32_t* pixels, uint32_t* dest, int stride,
+	int width, int height)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(128);
+	// the alpha lane is multiplied by 255, which leaves it as is
+	const __m128i alpha_lane = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+	const __m128i alpha_unit = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+	for (int y = 0; y < height; y++) {
+		__m128i row = _mm_loadu_si128((const __m128i*)(pixels + 4 * y));
+		__m128i halves[2] = { _mm_unpacklo_epi8(row, zero), _mm_unpackhi_epi8(row, zero) };
+		for (int j = 0; j < 2; j++) {
+			__m128i c = halves[j];
+			__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(c, 0xFF), 0xFF);
+			a = _mm_or_si128(_mm_andnot_si128(alpha_lane, a), alpha_unit);
+			__m128i t = _mm_add_epi16(_mm_mullo_epi16(c, a), round);
+			t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+			// RGBA to BGRA
+			halves[j] = _mm_shufflehi_epi16(_mm_shufflelo_epi16(t, 0xC6), 0xC6);
+		}
+		__m128i result = _mm_packus_epi16(halves[0], halves[1]);
+		uint32_t* dest_row = dest + (size_t)y * stride;
+		if (width == 4) {
+			_mm_storeu_si128((__m128i*)dest_row, result);
+		}
+		else {
+			uint32_t out[4];
+			_mm_storeu_si128((__m128i*)out, result);
+			memcpy(dest_row, out, width * sizeof(uint32_t));
+		}
+	}
+}
+
+int bcn_block_bytes(bcn_format_t format)
+{
+	return format == BCN_BC1 || format == BCN_BC4 ? 8 : 16;
+}
+
+static void _decode_block(bcn_format_t format, const uint8_t* block, bool simd,
+	uint32_t* pixels)
+{
+	uint32_t palette[4];
+	uint8_t alpha[16];
+	uint8_t green[16];
+	switch (format) {
+	case BCN_BC1:
+	case BCN_BC2:
+	case BCN_BC3:
+	{
+		const uint8_t* color = format == BCN_BC1 ? block : block + 8;
+		_bc1_palette(color, format == BCN_BC1, palette);
+		(simd ? _bc1_select_sse2 : _bc1_select_naive)(color, palette, pixels);
+		if (format == BCN_BC1)
+			break;
+		if (format == BCN_BC2)
+			_bc2_alpha(block, alpha);
+		else
+			_bc4_values(block, alpha);
+		(simd ? _set_alpha_sse2 : _set_alpha_naive)(pixels, alpha);
+		break;
+	}
+	case BCN_BC4:
+	case BCN_BC5:
+		_bc4_values(block, alpha);
+		if (format == BCN_BC5)
+			_bc4_values(block + 8, green);
+		(simd ? _bc45_pixels_sse2 : _bc45_pixels_naive)(alpha,
+			format == BCN_BC5 ? green : NULL, pixels);
+		break;
+	case BCN_BC6H:
+	case BCN_BC6H_SIGNED:
+		(simd ? _bc6h_decode_sse2 : _bc6h_decode_naive)(block,
+			format == BCN_BC6H_SIGNED, pixels);
+		break;
+	case BCN_BC7:
+		(simd ? _bc7_decode_sse2 : _bc7_decode_naive)(block, pixels);
+		break;
+	default:
+		memset(pixels, 0, 16 * sizeof(uint32_t));
+		break;
+	}
+}
+
+static void _decode(bcn_format_t format, const uint8_t* blocks, int width,
+	int height, int block_y0, int block_y1, uint32_t* dest, int stride, bool simd)
+{
+	int block_bytes = bcn_block_bytes(format);
+	int blocks_x = (width + 3) / 4;
+	uint32_t pixels[16];
+	for (int by = block_y0; by < block_y1; by++) {
+		const uint8_t* block = blocks + (size_t)by * blocks_x * block_bytes;
+		int rows = height - 4 * by < 4 ? height - 4 * by : 4;
+		for (int bx = 0; bx < blocks_x; bx++, block += block_bytes) {
+			_decode_block(format, block, simd, pixels);
+			int columns = width - 4 * bx < 4 ? width - 4 * bx : 4;
+			uint32_t* out = dest + (size_t)4 * by * stride + 4 * bx;
+			(simd ? _write_sse2 : _write_naive)(pixels, out, stride, columns, rows);
+		}
+	}
+}
+
+void bcn_decode_naive(bcn_format_t format, const uint8_t* blocks, int width,
+	int height, int block_y0, int block_y1, uint32_t* dest, int stride)
+{
+	_decode(format, blocks, width, height, block_y0, block_y1, dest, stride, false);
+}
+
+void bcn_decode_sse2(bcn_format_t format, const uint8_t* blocks, int width,
+	int height, int block_y0, int block_y1, uint32_t* dest, int stride)
+{
+	_decode(format, blocks, width, height, block_y0, block_y1, dest, stride, true);
+}
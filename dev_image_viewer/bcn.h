@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Decoders for the BC1 to BC7 block compressed texture formats, into the
+// 32bpp premultiplied BGRA the canvas shows.  Each 4x4 block is unpacked
+// with scalar code, since that is all bit fields and mode tables; the
+// SIMD versions interpolate the palettes, select from them, and
+// premultiply and swizzle the results four pixels at a time.  The naive
+// versions are the reference they're checked against in pixel_bench.c.
+//
+// BC4 shows as grey, and BC5 as red and green.  BC6H is clamped to [0, 1]
+// without tone mapping.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	BCN_BC1 = 1,
+	BCN_BC2,
+	BCN_BC3,
+	BCN_BC4,
+	BCN_BC5,
+	BCN_BC6H,
+	BCN_BC6H_SIGNED,
+	BCN_BC7,
+} bcn_format_t;
+
+// 8 or 16
+int bcn_block_bytes(bcn_format_t format);
+// blocks is the whole image, width x height pixels, in rows of
+// (width + 3) / 4 blocks.  decodes block rows [block_y0, block_y1) into
+// dest, stride pixels apart, clipping the blocks at the image's edges.
+void bcn_decode_naive(bcn_format_t format, const uint8_t* blocks, int width,
+	int height, int block_y0, int block_y1, uint32_t* dest, int stride);
+void bcn_decode_sse2(bcn_format_t format, const uint8_t* blocks, int width,
+	int height, int block_y0, int block_y1, uint32_t* dest, int stride);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,102 @@
+#include "dev_image_viewer.h"
+
+#include <stdlib.h>
+#include <strsafe.h>
+
+#include "cache_dir.h"
+#include "content_hash.h"
+
+typedef struct {
+	WCHAR name[32];
+	FILETIME last_used;
+	uint64_t size;
+} cache_dir_file_t;
+
+static bool _create_dir(const WCHAR* dir)
+{
+	return CreateDirectoryW(dir, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+}
+
+bool cache_dir_create(const WCHAR* dir, const WCHAR* name, WCHAR* out)
+{
+	if (dir)
+		return SUCCEEDED(StringCchCopyW(out, MAX_PATH, dir)) && _create_dir(out);
+
+	WCHAR app_data[MAX_PATH];
+	DWORD length = GetEnvironmentVariableW(L"LOCALAPPDATA", app_data, MAX_PATH);
+	if (!length || length >= MAX_PATH)
+		return false;
+	return SUCCEEDED(StringCchPrintfW(out, MAX_PATH, L"%s\\dev_image_viewer", app_data)) &&
+		_create_dir(out) &&
+		SUCCEEDED(StringCchCatW(out, MAX_PATH, L"\\")) &&
+		SUCCEEDED(StringCchCatW(out, MAX_PATH, name)) &&
+		_create_dir(out);
+}
+
+uint64_t cache_dir_path_hash(const WCHAR* path, uint64_t seed)
+{
+	size_t length = wcslen(path);
+	WCHAR* lower = (WCHAR*)malloc((length + 1) * sizeof(WCHAR));
+	if (!lower)
+		return 0;
+	CopyMemory(lower, path, (length + 1) * sizeof(WCHAR));
+	CharLowerBuffW(lower, (DWORD)length);
+	uint64_t hash = hash64(lower, length * sizeof(WCHAR), seed);
+	free(lower);
+	return hash;
+}
+
+static int _compare_last_used(const void* a, const void* b)
+{
+	return CompareFileTime(&((const cache_dir_file_t*)a)->last_used,
+		&((const cache_dir_file_t*)b)->last_used);
+}
+
+void cache_dir_trim(const WCHAR* dir, const WCHAR* extension, uint64_t max_bytes)
+{
+	WCHAR pattern[MAX_PATH];
+	if (FAILED(StringCchPrintfW(pattern, MAX_PATH, L"%s\\*.%s", dir, extension)))
+		return;
+
+	cache_dir_file_t* files = NULL;
+	int count = 0;
+	int capacity = 0;
+	uint64_t total = 0;
+
+	WIN32_FIND_DATAW find_data;
+	HANDLE find = FindFirstFileW(pattern, &find_data);
+	if (find == INVALID_HANDLE_VALUE)
+		return;
+	do {
+		if (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		if (count == capacity) {
+			int new_capacity = capacity ? capacity * 2 : 64;
+			cache_dir_file_t* new_files = (cache_dir_file_t*)realloc(files,
+				new_capacity * sizeof(cache_dir_file_t));
+			if (!new_files)
+				break;
+			files = new_files;
+			capacity = new_capacity;
+		}
+		cache_dir_file_t* file = &files[count];
+		if (FAILED(StringCchCopyW(file->name, ARRAYSIZE(file->name), find_data.cFileName)))
+			continue;
+		file->last_used = find_data.ftLastWriteTime;
+		file->size = ((uint64_t)find_data.nFileSizeHigh << 32) | find_data.nFileSizeLow;
+		total += file->size;
+		count++;
+	} while (FindNextFileW(find, &find_data));
+	FindClose(find);
+
+	if (total > max_bytes) {
+		qsort(files, count, sizeof(cache_dir_file_t), _compare_last_used);
+		for (int i = 0; i < count && total > max_bytes; i++) {
+			WCHAR file_path[MAX_PATH];
+			if (SUCCEEDED(StringCchPrintfW(file_path, MAX_PATH, L"%s\\%s",
+				dir, files[i].name)) && DeleteFileW(file_path))
+				total -= files[i].size;
+		}
+	}
+	free(files);
+}
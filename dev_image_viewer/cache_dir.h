@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The pieces shared by the caches that keep files in a directory of their
+// own (disk_cache.h, thumb_cache.h): where the directory is, how files in
+// it are named, and how it's kept within a size.
+
+// creates dir, or %LOCALAPPDATA%\dev_image_viewer\<name> if dir is NULL,
+// and writes its path to out, which holds MAX_PATH characters.
+bool cache_dir_create(const WCHAR* dir, const WCHAR* name, WCHAR* out);
+
+// hash of a path, the same for paths differing only in case
+uint64_t cache_dir_path_hash(const WCHAR* path, uint64_t seed);
+
+// deletes the least recently written files in dir with the extension, such
+// as L"pyr", until the rest fit in max_bytes.  files that are open without
+// delete sharing can't be deleted, and are skipped.
+void cache_dir_trim(const WCHAR* dir, const WCHAR* extension, uint64_t max_bytes);
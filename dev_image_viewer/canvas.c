@@ -5,15 +5,65 @@
 #include <strsafe.h>
 #include <stdbool.h>
 #include <stdint.h>
-#include <immintrin.h>
-#include <emmintrin.h>
 
+#include "band_load.h"
 #include "canvas.h"
+#include "content_hash.h"
+#include "disk_cache.h"
 #include "gdiplus_loader.h"
+#include "image_cache.h"
+#include "image_probe_file.h"
+#include "jpeg_file.h"
+#include "pixel_kernels.h"
+#include "region_stats.h"
+#include "reload_history.h"
+#include "render.h"
+#include "roi_view.h"
+#include "texture_file.h"
+#include "trace.h"
+#include "yuv_file.h"
 
 #define CANVAS_WNDLONG_PRIVATE 0
 
-#define CANVAS_NUM_MINIFY_LEVELS 5
+#define CANVAS_NUM_MINIFY_LEVELS RENDER_NUM_MINIFY_LEVELS
+
+// baked in under transparent pixels, and around the image
+#define CANVAS_BG_COLOR 0xFF404040
+
+// reloads compare and update the image in square tiles of this size.
+// must be a multiple of (1 << CANVAS_NUM_MINIFY_LEVELS) so that each tile
+// maps to a whole number of pixels in every level.
+#define CANVAS_TILE_SIZE 64
+
+// limits of the history kept of auto-reloaded versions
+#define CANVAS_HISTORY_MAX_ENTRIES 64
+#define CANVAS_HISTORY_MAX_BYTES (256 * 1024 * 1024)
+
+// the most the selection's summed-area tables may take. past it they are
+// made of the largest minified level that fits.
+#define CANVAS_REGION_STATS_MAX_BYTES (512 * 1024 * 1024)
+
+// how long the changed area is outlined after an incremental reload
+#define CANVAS_TIMER_FLASH 1
+#define CANVAS_FLASH_MS 300
+
+// images of this many pixels or more are decoded by region, a tile at a
+// time as they show, where the format allows (see roi_source.h)
+#define CANVAS_ROI_MIN_PIXELS ((uint64_t)16384 * 16384)
+
+// baseline JPEGs of this many pixels or more open decoded reduced, at the
+// level that fits the window (see jpeg_file.h), and in full only once
+// zoomed in past it
+#define CANVAS_REDUCED_MIN_PIXELS ((uint64_t)8192 * 8192)
+
+// images of this many pixels or more load in bands on a worker, showing
+// as they load, where the format allows (see band_load.h)
+#define CANVAS_BAND_MIN_PIXELS ((uint64_t)4096 * 4096)
+
+// posted by the region decoder as each tile is ready
+#define CANVAS_WM_TILE (WM_APP + 1)
+// posted by a load in bands as rows are ready, and when it finishes
+#define CANVAS_WM_BAND (WM_APP + 2)
 
 typedef struct {
 	HBITMAP hbitmap;
@@ -22,7 +72,28 @@ typedef struct {
 	int height;
 } canvas_level_t;
 
+// levels shared with work on the thread pool, which may hold them past
+// their replacement.  freed by whichever lets go last.
+typedef struct {
+	canvas_level_t levels[CANVAS_NUM_MINIFY_LEVELS + 1];
+	volatile LONG refs;
+} canvas_shared_levels_t;
+
+// levels being written to the disk cache on the thread pool, shared by
+// the canvas that started it and the worker
+typedef struct {
+	canvas_shared_levels_t* shared;
+	WCHAR* path;
+	file_stamp_t stamp;
+	// set to give up, before the levels change in place
+	volatile LONG cancel;
+	// signaled once the worker has let go of the levels
+	HANDLE done;
+	volatile LONG refs;
+} canvas_store_t;
+
 typedef struct {
+	HWND hwnd;
 	WCHAR* path;
 
 	int tx;
@@ -38,8 +109,77 @@ typedef struct {
 
 	DWORD bg_color;
 	HFONT hfont;
+
+	// level 0 bounds of the tiles changed by the last incremental reload
+	bool dirty_valid;
+	RECT dirty_rect;
+	bool flashing;
+
+	// changes between auto-reloaded versions, and how many steps back from
+	// the newest level 0 currently shows.
+	reload_history_t* history;
+	int history_pos;
+
+	// the file version levels came from, for the inactive image cache
+	file_stamp_t stamp;
+	canvas_cache_info_t cache_info;
+	canvas_load_times_t load_times;
+
+	// when levels are mapped from the disk cache. levels are never written
+	// while mapped, since that would write through to the cache file.
+	disk_cache_t* disk;
+	// while work on the thread pool holds the levels, and the write of them
+	// to the disk cache, if it's still running
+	canvas_shared_levels_t* shared;
+	canvas_store_t* store;
+
+	// showing frames from a live feed, rather than a file. the levels are
+	// reused while the frame size stays the same.
+	bool live;
+	uint32_t live_frame;
+
+	// comparing against a second image, B, while compare is set. see
+	// canvas.h. split_x is in client coords, or -1 for the middle.
+	compare_t* compare;
+	canvas_level_t compare_levels[CANVAS_NUM_MINIFY_LEVELS + 1];
+	canvas_compare_view_t compare_view;
+	int split_x;
+	bool splitting;
+
+	// of level 0, from before baking where the load had it
+	image_stats_t stats;
+	bool have_stats;
+
+	// the selection, in level 0 pixels, dragged out with Shift held. the
+	// tables for its statistics are made on the first query.
+	bool selecting;
+	bool have_selection;
+	POINT select_start;
+	RECT selection;
+	region_stats_table_t* region_stats;
+
+	// showing an image decoded by region instead of levels. there are no
+	// statistics, selection or compare for it.
+	roi_view_t* roi;
+
+	// when the image was decoded reduced, the finest level there is, and
+	// the image's full size. the levels above it, and with them the
+	// statistics, selection and compare, wait for the full decode.
+	int reduced_level;
+	int full_width;
+	int full_height;
+
+	// while the levels are still loading in bands. until it finishes
+	// there are no statistics, selection or compare, and nothing is cached.
+	band_load_t* load;
 } canvas_data_t;
 
+struct canvas_frame_t {
+	canvas_level_t levels[CANVAS_NUM_MINIFY_LEVELS + 1];
+	image_stats_t stats;
+	bool have_stats;
+};
+
 static canvas_data_t* _canvas_new_private()
 {
 	canvas_data_t* priv = (canvas_data_t*)malloc(sizeof(canvas_data_t));
@@ -47,7 +187,7 @@ static canvas_data_t* _canvas_new_private()
 		return NULL;
 	ZeroMemory(priv, sizeof(canvas_data_t));
 
-	priv->bg_color = 0xFF404040;
+	priv->bg_color = CANVAS_BG_COLOR;
 
 	return priv;
 }
@@ -65,9 +205,138 @@ static void _canvas_free_levels(canvas_level_t* levels)
 	}
 }
 
+// a reference to the current levels, for work on the thread pool
+static canvas_shared_levels_t* _canvas_share_levels(canvas_data_t* priv)
+{
+	if (!priv->shared) {
+		priv->shared = (canvas_shared_levels_t*)calloc(1, sizeof(canvas_shared_levels_t));
+		if (!priv->shared)
+			return NULL;
+		CopyMemory(priv->shared->levels, priv->levels, sizeof(priv->levels));
+		priv->shared->refs = 1;
+	}
+	InterlockedIncrement(&priv->shared->refs);
+	return priv->shared;
+}
+
+static void _canvas_release_shared(canvas_shared_levels_t* shared)
+{
+	if (shared && !InterlockedDecrement(&shared->refs)) {
+		_canvas_free_levels(shared->levels);
+		free(shared);
+	}
+}
+
+static void _canvas_release_shared_ctx(void* ctx)
+{
+	_canvas_release_shared((canvas_shared_levels_t*)ctx);
+}
+
+static void _canvas_release_store(canvas_store_t* store)
+{
+	if (store && !InterlockedDecrement(&store->refs)) {
+		CloseHandle(store->done);
+		free(store->path);
+		free(store);
+	}
+}
+
+// gives up writing the levels to the disk cache, and waits for the worker
+// to let go of them, before they change in place.  the write stops at its
+// next chunk.
+static void _canvas_cancel_store(canvas_data_t* priv)
+{
+	if (!priv->store)
+		return;
+	InterlockedExchange(&priv->store->cancel, 1);
+	WaitForSingleObject(priv->store->done, INFINITE);
+	_canvas_release_store(priv->store);
+	priv->store = NULL;
+}
+
+// lets go of the current levels.  a write to the disk cache carries on
+// with them, and frees them when it's done.
+static void _canvas_drop_levels(canvas_data_t* priv)
+{
+	_canvas_release_store(priv->store);
+	priv->store = NULL;
+	if (priv->shared) {
+		_canvas_release_shared(priv->shared);
+		priv->shared = NULL;
+		ZeroMemory(priv->levels, sizeof(priv->levels));
+	}
+	else {
+		_canvas_free_levels(priv->levels);
+	}
+}
+
+static void _canvas_clear_history(canvas_data_t* priv)
+{
+	reload_history_free(priv->history);
+	priv->history = NULL;
+	priv->history_pos = 0;
+}
+
+// the level the summed-area tables are made of
+static int _canvas_region_stats_level(canvas_data_t* priv)
+{
+	int level = 0;
+	while (level < CANVAS_NUM_MINIFY_LEVELS &&
+		region_stats_table_bytes(priv->levels[level].width, priv->levels[level].height) >
+			CANVAS_REGION_STATS_MAX_BYTES)
+		level++;
+	return level;
+}
+
+// changed is in level 0 pixels, or NULL for all of them
+static void _canvas_region_stats_changed(canvas_data_t* priv, const RECT* changed)
+{
+	if (!priv->region_stats)
+		return;
+	if (!changed) {
+		region_stats_invalidate(priv->region_stats, NULL);
+		return;
+	}
+	int level = _canvas_region_stats_level(priv);
+	RECT level_rect = *changed;
+	level_rect.left >>= level;
+	level_rect.top >>= level;
+	region_stats_invalidate(priv->region_stats, &level_rect);
+}
+
+// replaces the current levels, and the history of them.  disk is the cache
+// new_levels are mapped from, if any.
+static void _canvas_replace_levels(canvas_data_t* priv,
+	canvas_level_t* new_levels, disk_cache_t* disk)
+{
+	_canvas_clear_history(priv);
+	band_load_close(priv->load);
+	priv->load = NULL;
+	_canvas_drop_levels(priv);
+	disk_cache_close(priv->disk);
+	roi_view_close(priv->roi);
+	priv->roi = NULL;
+	priv->reduced_level = 0;
+	CopyMemory(priv->levels, new_levels,
+		sizeof(canvas_level_t) * (CANVAS_NUM_MINIFY_LEVELS + 1));
+	priv->disk = disk;
+	_canvas_region_stats_changed(priv, NULL);
+	priv->cache_info.from_disk_cache = disk != NULL;
+}
+
 static void _canvas_destroy_private(canvas_data_t* priv)
 {
-	_canvas_free_levels(priv->levels);
+	_canvas_clear_history(priv);
+	band_load_close(priv->load);
+	// stopped rather than left to finish, or the process exiting would
+	// leave its temporary file in the cache
+	_canvas_cancel_store(priv);
+	_canvas_drop_levels(priv);
+	disk_cache_close(priv->disk);
+	roi_view_close(priv->roi);
+	_canvas_free_levels(priv->compare_levels);
+	compare_free(priv->compare);
+	region_stats_free(priv->region_stats);
 	if (priv->path)
 		free(priv->path);
 	if (priv->hfont)
@@ -80,145 +349,55 @@ static canvas_data_t* _canvas_get_private(HWND hwnd)
 	return (canvas_data_t*)GetWindowLongPtr(hwnd, CANVAS_WNDLONG_PRIVATE);
 }
 
-static void _downsize_naive(
-	DWORD* src_pixels, int src_width, int src_height,
-	DWORD* dest_pixels, int dest_width, int dest_height,
-	DWORD bg_color)
-{
-	// this code has vestigial support for non-2X downsizing
-	int scale = 2;
-
-	int back_r = (bg_color >> 16) & 0xFF;
-	int back_g = (bg_color >> 8) & 0xFF;
-	int back_b = bg_color & 0xFF;
-
-	int r, g, b, a;
-	DWORD src_pixel;
-	int scale_sqr = scale * scale;
-	for (int desty = 0; desty < dest_height; desty++) {
-		for (int destx = 0; destx < dest_width; destx++) {
-			r = g = b = a = 0;
-			for (int srcy = desty * scale; srcy < desty * scale + scale; srcy++) {
-				for (int srcx = destx * scale; srcx < destx * scale + scale; srcx++) {
-					if (srcx < src_width && srcy < src_height) {
-						src_pixel = ((DWORD*)src_pixels)[srcy * src_width + srcx];
-						r += (src_pixel >> 16) & 0xFF;
-						g += (src_pixel >> 8) & 0xFF;
-						b += src_pixel & 0xFF;
-						a += src_pixel >> 24;
-					}
-				}
-			}
-
-			r /= scale_sqr;
-			g /= scale_sqr;
-			b /= scale_sqr;
-			a /= scale_sqr;
-
-			// bake the background color in. because original bitmap was
-			// already baked, this only happens to right/bottom edges.
-			r += back_r * (255 - a) / 255;
-			g += back_g * (255 - a) / 255;
-			b += back_b * (255 - a) / 255;
-			a = 255;
+// as levels, from level 0 or only the reduced ones, or decoded by region
+static bool _canvas_has_image(canvas_data_t* priv)
+{
+	return priv->levels[CANVAS_NUM_MINIFY_LEVELS].hbitmap || priv->roi;
+}
 
-			((DWORD*)dest_pixels)[desty * dest_width + destx] =
-				(a << 24) | (r << 16) | (g << 8) | b;
-		}
+static void _canvas_image_size(canvas_data_t* priv, int* width, int* height)
+{
+	if (priv->roi) {
+		roi_view_get_size(priv->roi, width, height);
+		return;
 	}
+	if (priv->reduced_level) {
+		*width = priv->full_width;
+		*height = priv->full_height;
+		return;
+	}
+	*width = priv->levels[0].width;
+	*height = priv->levels[0].height;
 }
 
-static void _downsize_sse2(
-	DWORD* src_pixels, int src_width, int src_height,
-	DWORD* dest_pixels, int dest_width, int dest_height,
-	DWORD bg_color
-)
-{
-	const __m128i zero = _mm_setzero_si128();
-	__m128i temp = zero;
-
-	// get 1x and 2x the background color, expanded to 16-bit components
-	__m128i bg = _mm_unpacklo_epi8(_mm_loadu_si32(&bg_color), zero);
-	__m128i bg_x2 = _mm_slli_epi16(bg, 1);
-
-	// Main quadrant: 2x2 pixel groups
-	int quad_area_width = src_width / 2;
-	int quad_area_height = src_height / 2;
-	for (int dest_y = 0; dest_y < quad_area_height; dest_y++) {
-		DWORD* src_ptr = &src_pixels[dest_y * 2 * src_width];
-		for (int dest_x = 0; dest_x < quad_area_width; dest_x++, src_ptr += 2) {
-			// load top 2 and bottom 2 pixels, extend to 16-bit components
-			__m128i top = _mm_unpacklo_epi8(_mm_loadu_si64(src_ptr), zero);
-			__m128i bottom = _mm_unpacklo_epi8(_mm_loadu_si64(src_ptr + src_width), zero);
-			// add all 4 together
-			__m128i accum = _mm_add_epi16(top, bottom);
-			temp = _mm_castps_si128(
-				_mm_movehl_ps(_mm_castsi128_ps(temp), _mm_castsi128_ps(accum)));
-			accum = _mm_add_epi16(accum, temp);
-			// divide by 4
-			accum = _mm_srli_epi16(accum, 2);
-			// convert back to 8-bit and write destination pixel
-			__m128i result = _mm_packus_epi16(accum, zero);
-			_mm_storeu_si32(&dest_pixels[dest_y * dest_width + dest_x], result);
-		}
-	}
+// the diffs of A and B are stale once A changes
+static void _canvas_compare_changed(canvas_data_t* priv)
+{
+	if (priv->compare)
+		compare_invalidate(priv->compare);
+}
 
-	// Bottom edge, if odd height
-	if (src_height & 1) {
-		int dest_y = src_height / 2;
-		DWORD* src_ptr = &src_pixels[dest_y * 2 * src_width];
-		for (int dest_x = 0; dest_x < quad_area_width; dest_x++, src_ptr += 2) {
-			// load 2 horiz pixels, extend to 16-bit
-			__m128i accum = _mm_unpacklo_epi8(_mm_loadu_si64(src_ptr), zero);
-			// add together
-			temp = _mm_castps_si128(
-				_mm_movehl_ps(_mm_castsi128_ps(temp), _mm_castsi128_ps(accum)));
-			accum = _mm_add_epi16(accum, temp);
-			// add 2x the background color
-			accum = _mm_add_epi16(accum, bg_x2);
-			// divide by 4
-			accum = _mm_srli_epi16(accum, 2);
-			// convert back to 8-bit and write destination pixel
-			__m128i result = _mm_packus_epi16(accum, zero);
-			_mm_storeu_si32(&dest_pixels[dest_y * dest_width + dest_x], result);
-		}
-	}
+// section and offset are as for CreateDIBSection(); NULL and 0 to allocate
+static bool _canvas_create_dib(int width, int height, HANDLE section,
+	DWORD offset, HBITMAP* out_hbitmap, void** out_bits)
+{
+	BITMAPV5HEADER bmi;
+	init_bitmap_header(&bmi, width, height);
 
-	// Right edge, if odd width
-	if (src_width & 1) {
-		int dest_x = src_width / 2;
-		DWORD* src_ptr = &src_pixels[src_width - 1];
-		for (int dest_y = 0; dest_y < quad_area_height; dest_y++, src_ptr += src_width) {
-			// load upper and lower pixels, extend
-			__m128i top = _mm_unpacklo_epi8(_mm_loadu_si32(src_ptr), zero);
-			__m128i bottom = _mm_unpacklo_epi8(_mm_loadu_si32(src_ptr + src_width), zero);
-			// add together
-			__m128i accum = _mm_add_epi16(top, bottom);
-			// add 2x the background color
-			accum = _mm_add_epi16(accum, bg_x2);
-			// divide by 4
-			accum = _mm_srli_epi16(accum, 2);
-			// convert back to 8-bit and write destination pixel
-			__m128i result = _mm_packus_epi16(accum, zero);
-			_mm_storeu_si32(&dest_pixels[dest_y * dest_width + dest_x], result);
-		}
+	HDC hdc = GetDC(NULL);
+	void* bits = NULL;
+	HBITMAP hbitmap = CreateDIBSection(hdc, (BITMAPINFO*)&bmi, DIB_RGB_COLORS,
+		&bits, section, offset);
+	ReleaseDC(NULL, hdc);
+	if (!hbitmap || !bits) {
+		if (hbitmap)
+			DeleteObject(hbitmap);
+		return false;
 	}
 
-	// Bottom right corner pixel, if odd width and height
-	if ((src_width & 1) && (src_height & 1)) {
-		int dest_x = src_width / 2;
-		int dest_y = src_height / 2;
-		DWORD* src_ptr = &src_pixels[dest_y * 2 * src_width + dest_x * 2];
-		// load the bottom right corner pixel
-		__m128i accum = _mm_unpacklo_epi8(_mm_loadu_si32(src_ptr), zero);
-		// add 3x the background color
-		accum = _mm_add_epi16(accum, _mm_add_epi16(bg, bg_x2));
-		// divide by 4
-		accum = _mm_srli_epi16(accum, 2);
-		// convert back to 8-bit and write destination pixel
-		__m128i result = _mm_packus_epi16(accum, zero);
-		_mm_storeu_si32(&dest_pixels[dest_y * dest_width + dest_x], result);
-	}
+	*out_hbitmap = hbitmap;
+	*out_bits = bits;
+	return true;
 }
 
 static bool _canvas_create_level(canvas_level_t* src_level, 
@@ -227,25 +406,19 @@ static bool _canvas_create_level(canvas_level_t* src_level,
 	int downsized_width = (src_level->width + 1) / 2;
 	int downsized_height = (src_level->height + 1) / 2;
 
-	BITMAPV5HEADER bmi;
-	init_bitmap_header(&bmi, downsized_width, downsized_height);
-
-	HDC hdc = GetDC(NULL);
+	HBITMAP hbitmap = NULL;
 	void* bits = NULL;
-	HBITMAP hbitmap = CreateDIBSection(hdc, (BITMAPINFO*)&bmi, DIB_RGB_COLORS,
-		&bits, NULL, 0);
-	ReleaseDC(NULL, hdc);
-	if (!hbitmap || !bits) {
+	if (!_canvas_create_dib(downsized_width, downsized_height, NULL, 0,
+		&hbitmap, &bits))
 		return false;
-	}
 
 #if 0
-	_downsize_naive(
+	pixel_downsize_naive(
 #else
-	_downsize_sse2(
+	pixel_downsize_sse2(
 #endif
-		(DWORD*)src_level->bits, src_level->width, src_level->height,
-		(DWORD*)bits, downsized_width, downsized_height,
+		(uint32_t*)src_level->bits, src_level->width, src_level->height,
+		(uint32_t*)bits, downsized_width, downsized_height,
 		bg_color
 	);
 
@@ -256,186 +429,961 @@ static bool _canvas_create_level(canvas_level_t* src_level,
 	return true;
 }
 
+// makes the levels that aren't there yet, each from the one above it, below
+// the first there is
 static bool _canvas_downsize(canvas_level_t* levels, DWORD bg_color)
 {
 	for (int i = 1; i <= CANVAS_NUM_MINIFY_LEVELS; i++) {
+		if (levels[i].hbitmap || !levels[i - 1].hbitmap)
+			continue;
 		if (!_canvas_create_level(&levels[i - 1], &levels[i], bg_color))
 			return false;
 	}
 	return true;
 }
 
-static void _bake_bg_dwords(DWORD* array, uint64_t count, DWORD color)
+static void _bake_bg_naive(canvas_level_t* level, DWORD color)
 {
-	int back_r = (color >> 16) & 0xFF;
-	int back_g = (color >> 8) & 0xFF;
-	int back_b = color & 0xFF;
-	int r, g, b, a;
-	DWORD* pixel;
-	for (uint64_t i = 0; i < count; i++) {
-		pixel = &array[i];
-		r = (*pixel >> 16) & 0xFF;
-		g = (*pixel >> 8) & 0xFF;
-		b = *pixel & 0xFF;
-		a = (*pixel >> 24);
-		r += back_r * (255 - a) / 255;
-		g += back_g * (255 - a) / 255;
-		b += back_b * (255 - a) / 255;
-		a = 255;
-		*pixel = (a << 24) | (r << 16) | (g << 8) | b;
-	}
+	uint64_t num_pixels = (uint64_t)level->width * (uint64_t)level->height;
+	pixel_bake_naive((uint32_t*)level->bits, (uint32_t*)level->bits, num_pixels, color);
 }
 
-static void _bake_bg_naive(canvas_level_t* level, DWORD color)
+static void _bake_bg_sse2(canvas_level_t* level, DWORD color)
 {
 	uint64_t num_pixels = (uint64_t)level->width * (uint64_t)level->height;
-	_bake_bg_dwords((DWORD*)level->bits, num_pixels, color);
+	pixel_bake_sse2((uint32_t*)level->bits, (uint32_t*)level->bits, num_pixels, color);
 }
 
-static void _bake_bg_sse2(canvas_level_t* level, DWORD color)
+// reads the levels after 0 from a texture's own mips, baked, for as long
+// as they're the sizes _canvas_downsize() would make
+static void _canvas_read_mips(const texture_t* texture, int layer,
+	canvas_level_t* levels, DWORD bg_color)
+{
+	int num_levels = min(texture_get_info(texture)->num_levels, CANVAS_NUM_MINIFY_LEVELS + 1);
+	for (int i = 1; i < num_levels; i++) {
+		int width, height;
+		texture_level_size(texture, i, &width, &height);
+		if (width != (levels[i - 1].width + 1) / 2 ||
+			height != (levels[i - 1].height + 1) / 2)
+			return;
+		if (!texture_file_read(texture, layer, i, &levels[i].hbitmap,
+			&levels[i].bits, &levels[i].width, &levels[i].height))
+			return;
+		_bake_bg_sse2(&levels[i], bg_color);
+	}
+}
+
+// a set of level 0 tiles that need their minified footprints rebuilt
+typedef struct {
+	bool* tiles;
+	int tiles_x;
+	int tiles_y;
+	// bounds, in tiles
+	int x0, y0, x1, y1;
+} canvas_dirty_t;
+
+static bool _canvas_dirty_init(canvas_dirty_t* dirty, canvas_level_t* level)
+{
+	dirty->tiles_x = (level->width + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE;
+	dirty->tiles_y = (level->height + CANVAS_TILE_SIZE - 1) / CANVAS_TILE_SIZE;
+	dirty->tiles = (bool*)calloc((size_t)dirty->tiles_x * dirty->tiles_y, sizeof(bool));
+	dirty->x0 = dirty->tiles_x;
+	dirty->y0 = dirty->tiles_y;
+	dirty->x1 = 0;
+	dirty->y1 = 0;
+	return dirty->tiles != NULL;
+}
+
+static void _canvas_dirty_mark(canvas_dirty_t* dirty, int tx, int ty)
 {
-	const __m128i zero = _mm_setzero_si128();
-	const __m128i twofiftyfive = _mm_set1_epi16(255);
-	const __m128i ones = _mm_set1_epi16(1);
+	dirty->tiles[ty * dirty->tiles_x + tx] = true;
+	dirty->x0 = min(dirty->x0, tx);
+	dirty->y0 = min(dirty->y0, ty);
+	dirty->x1 = max(dirty->x1, tx + 1);
+	dirty->y1 = max(dirty->y1, ty + 1);
+}
 
-	__m128i bg = _mm_loadu_si32(&color);
-	bg = _mm_unpacklo_epi8(bg, zero);
-	// duplicate bg into top 64 bits for processing two pixels at once
-	bg = _mm_or_si128(bg, _mm_slli_si128(bg, 8));
+// gets the level 0 pixel bounds of a tile
+static RECT _canvas_tile_rect(canvas_level_t* level, int tx, int ty)
+{
+	RECT rect;
+	rect.left = tx * CANVAS_TILE_SIZE;
+	rect.top = ty * CANVAS_TILE_SIZE;
+	rect.right = min(rect.left + CANVAS_TILE_SIZE, level->width);
+	rect.bottom = min(rect.top + CANVAS_TILE_SIZE, level->height);
+	return rect;
+}
 
-	uint64_t num_pixels = (uint64_t)level->width * (uint64_t)level->height;
-	uint64_t num_pair_pixels = num_pixels & ~1;
+// rebuilds the footprint of each dirty tile in the minified levels, and
+// frees the dirty set.
+static void _canvas_dirty_finish(canvas_data_t* priv, canvas_dirty_t* dirty)
+{
+	// one level at a time, since each level is made from the one above it.
+	for (int i = 1; i <= CANVAS_NUM_MINIFY_LEVELS; i++) {
+		canvas_level_t* src_level = &priv->levels[i - 1];
+		canvas_level_t* dest_level = &priv->levels[i];
+		int round = (1 << i) - 1;
+		for (int ty = dirty->y0; ty < dirty->y1; ty++) {
+			for (int tx = dirty->x0; tx < dirty->x1; tx++) {
+				if (!dirty->tiles[ty * dirty->tiles_x + tx])
+					continue;
+				RECT rect = _canvas_tile_rect(&priv->levels[0], tx, ty);
+				pixel_downsize_sse2_rect(
+					(uint32_t*)src_level->bits, src_level->width, src_level->height,
+					(uint32_t*)dest_level->bits, dest_level->width, dest_level->height,
+					priv->bg_color,
+					rect.left >> i, rect.top >> i,
+					(rect.right + round) >> i, (rect.bottom + round) >> i);
+			}
+		}
+	}
+
+	priv->dirty_valid = dirty->x1 > dirty->x0;
+	if (priv->dirty_valid) {
+		RECT top_left = _canvas_tile_rect(&priv->levels[0], dirty->x0, dirty->y0);
+		RECT bottom_right = _canvas_tile_rect(&priv->levels[0], dirty->x1 - 1, dirty->y1 - 1);
+		priv->dirty_rect.left = top_left.left;
+		priv->dirty_rect.top = top_left.top;
+		priv->dirty_rect.right = bottom_right.right;
+		priv->dirty_rect.bottom = bottom_right.bottom;
+		_canvas_region_stats_changed(priv, &priv->dirty_rect);
+	}
 
-	DWORD* pixel;
-	for (uint64_t i = 0; i < num_pair_pixels; i += 2) {
-		pixel = &((DWORD*)level->bits)[i];
+	free(dirty->tiles);
+	dirty->tiles = NULL;
+}
 
-		// load 2 pixels, extend to 16-bit components
-		__m128i orig_pixels = _mm_unpacklo_epi8(_mm_loadu_si64(pixel), zero);
-		// duplicate the both alphas into all channels
-		__m128i alphas = _mm_shufflelo_epi16(orig_pixels, 255);
-		alphas = _mm_shufflehi_epi16(alphas, 255);
-		__m128i inv_alphas = _mm_sub_epi16(twofiftyfive, alphas);
-		__m128i bg_times_inv_alpha = _mm_mullo_epi16(inv_alphas, bg);
-		// one way to approximate div by 255.
-		__m128i blend = _mm_srli_epi16(
-			_mm_add_epi16(
-				_mm_add_epi16(bg_times_inv_alpha, ones),
-				_mm_srli_epi16(bg_times_inv_alpha, 8)
-			),
-			8
-		);
-		__m128i result_16 = _mm_add_epi16(orig_pixels, blend);
-		__m128i result_8 = _mm_packus_epi16(result_16, zero);
+// moves level 0 through the reload history, so it shows the version
+// position steps before the newest, and rebuilds the changed footprints.
+static bool _canvas_history_seek(canvas_data_t* priv, int position)
+{
+	if (!priv->history || position == priv->history_pos)
+		return true;
 
-		_mm_storeu_si64(pixel, result_8);
+	_canvas_cancel_store(priv);
+	canvas_dirty_t dirty;
+	if (!_canvas_dirty_init(&dirty, &priv->levels[0]))
+		return false;
+	uint32_t* delta = (uint32_t*)malloc(CANVAS_TILE_SIZE * CANVAS_TILE_SIZE * sizeof(uint32_t));
+	if (!delta) {
+		free(dirty.tiles);
+		return false;
 	}
 
-	// handle last pixel if odd
-	if (num_pixels & 1) {
-		_bake_bg_dwords(&((DWORD*)level->bits)[num_pixels - 1], 1, color);
+	// each entry is the XOR between two versions, so applying it steps
+	// either way.
+	int count = reload_history_count(priv->history);
+	bool ok = true;
+	while (ok && priv->history_pos != position) {
+		int entry;
+		if (priv->history_pos < position) {
+			entry = count - 1 - priv->history_pos;
+			priv->history_pos++;
+		}
+		else {
+			priv->history_pos--;
+			entry = count - 1 - priv->history_pos;
+		}
+
+		int num_tiles = reload_history_tile_count(priv->history, entry);
+		for (int i = 0; i < num_tiles; i++) {
+			int tile_index = reload_history_tile_index(priv->history, entry, i);
+			if (tile_index < 0 || tile_index >= dirty.tiles_x * dirty.tiles_y) {
+				ok = false;
+				break;
+			}
+			int tx = tile_index % dirty.tiles_x;
+			int ty = tile_index / dirty.tiles_x;
+			RECT rect = _canvas_tile_rect(&priv->levels[0], tx, ty);
+			int tile_width = rect.right - rect.left;
+			int tile_height = rect.bottom - rect.top;
+			if (!reload_history_get_tile(priv->history, entry, i, delta, (size_t)tile_width * tile_height * sizeof(DWORD))) {
+				// corrupt, which shouldn't happen. the levels are now a mix
+				// of versions, so drop the history and stay as is.
+				ok = false;
+				break;
+			}
+			pixel_xor_tile_sse2((uint32_t*)priv->levels[0].bits +
+				(size_t)rect.top * priv->levels[0].width + rect.left,
+				priv->levels[0].width, delta, tile_width, tile_width, tile_height);
+			_canvas_dirty_mark(&dirty, tx, ty);
+		}
+	}
+
+	free(delta);
+	_canvas_dirty_finish(priv, &dirty);
+	if (!ok)
+		_canvas_clear_history(priv);
+	return ok;
+}
+
+// updates the current levels in place from a newly decoded level 0 of the
+// same size. only tiles that differ are baked, and only their footprints
+// in the minified levels are downsized again.  the changes are recorded
+// in the reload history.
+static bool _canvas_update_dirty(canvas_data_t* priv, canvas_level_t* new_level)
+{
+	// new versions are always recorded against the newest
+	if (!_canvas_history_seek(priv, 0))
+		_canvas_clear_history(priv);
+	// the version being written to the disk cache is gone from the file
+	_canvas_cancel_store(priv);
+
+	canvas_dirty_t dirty;
+	if (!_canvas_dirty_init(&dirty, &priv->levels[0]))
+		return false;
+	uint32_t* tile = (uint32_t*)malloc(CANVAS_TILE_SIZE * CANVAS_TILE_SIZE * sizeof(uint32_t) * 2);
+	if (!tile) {
+		free(dirty.tiles);
+		return false;
+	}
+	uint32_t* delta = tile + CANVAS_TILE_SIZE * CANVAS_TILE_SIZE;
+
+	if (!priv->history)
+		priv->history = reload_history_new(CANVAS_HISTORY_MAX_ENTRIES, CANVAS_HISTORY_MAX_BYTES);
+	if (priv->history)
+		reload_history_begin(priv->history);
+
+	int width = priv->levels[0].width;
+	uint32_t* src = (uint32_t*)new_level->bits;
+	uint32_t* dest = (uint32_t*)priv->levels[0].bits;
+
+	for (int ty = 0; ty < dirty.tiles_y; ty++) {
+		for (int tx = 0; tx < dirty.tiles_x; tx++) {
+			RECT rect = _canvas_tile_rect(&priv->levels[0], tx, ty);
+			int tile_width = rect.right - rect.left;
+			int tile_height = rect.bottom - rect.top;
+			size_t offset = (size_t)rect.top * width + rect.left;
+			if (!pixel_tile_differs_sse2(src + offset, dest + offset, width,
+				tile_width, tile_height, priv->bg_color))
+				continue;
+
+			// bake into a packed tile, and record what changed
+			for (int row = 0; row < tile_height; row++) {
+				pixel_bake_sse2(tile + row * tile_width,
+					src + offset + (size_t)row * width, tile_width,
+					priv->bg_color);
+			}
+			if (priv->history) {
+				size_t tile_size = (size_t)tile_width * tile_height * sizeof(DWORD);
+				memcpy(delta, tile, tile_size);
+				pixel_xor_tile_sse2(delta, tile_width, dest + offset, width,
+					tile_width, tile_height);
+				if (!reload_history_add_tile(priv->history,
+					ty * dirty.tiles_x + tx, delta, tile_size)) {
+					// out of memory. forget the history rather than keep
+					// a partial entry.
+					_canvas_clear_history(priv);
+				}
+			}
+
+			for (int row = 0; row < tile_height; row++) {
+				memcpy(dest + offset + (size_t)row * width,
+					tile + row * tile_width, tile_width * sizeof(DWORD));
+			}
+			_canvas_dirty_mark(&dirty, tx, ty);
+		}
+	}
+
+	if (priv->history)
+		reload_history_commit(priv->history);
+
+	free(tile);
+	_canvas_dirty_finish(priv, &dirty);
+	return true;
+}
+
+static VOID CALLBACK _canvas_store_work(PTP_CALLBACK_INSTANCE instance, PVOID param)
+{
+	canvas_store_t* store = (canvas_store_t*)param;
+	const canvas_level_t* levels = store->shared->levels;
+
+	// the stamp was taken before the decode. if the file has changed
+	// since, the hash wouldn't be of the pixels held.  the hash is most
+	// likely remembered from the file watch's (see content_hash.h).
+	uint64_t hash = 0;
+	file_stamp_t stamp;
+	if (!store->cancel && hash_file(store->path, &hash, NULL) &&
+		get_file_stamp(store->path, &stamp) && file_stamps_equal(&stamp, &store->stamp)) {
+		const void* bits[CANVAS_NUM_MINIFY_LEVELS + 1];
+		int widths[CANVAS_NUM_MINIFY_LEVELS + 1];
+		int heights[CANVAS_NUM_MINIFY_LEVELS + 1];
+		for (int i = 0; i <= CANVAS_NUM_MINIFY_LEVELS; i++) {
+			bits[i] = levels[i].bits;
+			widths[i] = levels[i].width;
+			heights[i] = levels[i].height;
+		}
+		uint64_t start = trace_begin();
+		disk_cache_store(store->path, &store->stamp, hash,
+			CANVAS_NUM_MINIFY_LEVELS + 1, bits, widths, heights, &store->cancel);
+		trace_end(TRACE_DISK_STORE, start, 0, 0);
+	}
+
+	_canvas_release_shared(store->shared);
+	store->shared = NULL;
+	SetEvent(store->done);
+	_canvas_release_store(store);
+}
+
+// writes the levels of a huge image to the disk cache on the thread pool,
+// if it's on.  the window carries on meanwhile, and may replace the levels,
+// which the write holds on to till it's done.
+static void _canvas_store_disk(canvas_data_t* priv)
+{
+	// a YUV file's pixels depend on the matrix, range and view chosen, which
+	// the cache isn't keyed by.
+	if (!disk_cache_enabled() ||
+		(uint64_t)priv->levels[0].width * priv->levels[0].height < DISK_CACHE_MIN_PIXELS ||
+		yuv_file_is_yuv(priv->path))
+		return;
+
+	canvas_store_t* store = (canvas_store_t*)calloc(1, sizeof(canvas_store_t));
+	if (!store)
+		return;
+	store->path = _wcsdup(priv->path);
+	store->stamp = priv->stamp;
+	store->done = CreateEventW(NULL, TRUE, FALSE, NULL);
+	store->refs = 2;
+	if (store->path && store->done)
+		store->shared = _canvas_share_levels(priv);
+	if (!store->shared ||
+		!TrySubmitThreadpoolCallback(_canvas_store_work, store, NULL)) {
+		_canvas_release_shared(store->shared);
+		if (store->done)
+			CloseHandle(store->done);
+		free(store->path);
+		free(store);
+		return;
+	}
+	// the levels were just replaced, which let go of any earlier store
+	priv->store = store;
+}
+
+// shows priv->path decoded by region, if its format allows
+static bool _canvas_open_roi(canvas_data_t* priv, const file_stamp_t* stamp)
+{
+	uint64_t start = trace_begin();
+	roi_source_t* source = roi_source_open(priv->path);
+	if (!source)
+		return false;
+	roi_view_t* roi = roi_view_open(source, priv->bg_color, priv->hwnd, CANVAS_WM_TILE);
+	if (!roi)
+		return false;
+
+	canvas_level_t no_levels[CANVAS_NUM_MINIFY_LEVELS + 1];
+	ZeroMemory(no_levels, sizeof(no_levels));
+	_canvas_replace_levels(priv, no_levels, NULL);
+	priv->roi = roi;
+	priv->stamp = *stamp;
+	priv->have_stats = false;
+	// the tiles decode as they show, so this is only the headers
+	priv->load_times.decode_seconds = trace_seconds(trace_begin() - start);
+	return true;
+}
+
+// the least minified level at which the whole image fits the window
+static int _canvas_fit_level(canvas_data_t* priv, int width, int height)
+{
+	RECT client_rect;
+	GetClientRect(priv->hwnd, &client_rect);
+	int level = 0;
+	while (level < CANVAS_NUM_MINIFY_LEVELS &&
+		((((width - 1) >> level) + 1) > client_rect.right ||
+		(((height - 1) >> level) + 1) > client_rect.bottom))
+		level++;
+	return level;
+}
+
+// shows priv->path, a baseline JPEG, from level down only: decoded reduced
+// as near to it as the IDCT goes, and minified from there
+static bool _canvas_open_reduced(canvas_data_t* priv, const file_stamp_t* stamp,
+	const image_probe_t* probe, int level)
+{
+	canvas_level_t new_levels[CANVAS_NUM_MINIFY_LEVELS + 1];
+	ZeroMemory(new_levels, sizeof(new_levels));
+	canvas_load_times_t* times = &priv->load_times;
+	int shift = min(level, 3);
+	canvas_level_t* first = &new_levels[shift];
+
+	uint64_t start = trace_begin();
+	if (!jpeg_file_read_reduced(priv->path, shift, &first->hbitmap, &first->bits,
+		&first->width, &first->height))
+		return false;
+	uint64_t num_pixels = (uint64_t)first->width * first->height;
+	times->decode_seconds = trace_seconds(trace_begin() - start);
+
+	// JPEG is opaque, so there's no background to bake in
+	start = trace_begin();
+	if (!_canvas_downsize(new_levels, priv->bg_color)) {
+		_canvas_free_levels(new_levels);
+		return false;
 	}
+	times->downsize_seconds = trace_seconds(
+		trace_end(TRACE_DOWNSIZE, start, num_pixels * 4 * 5 / 3, num_pixels * 4 / 3));
+
+	_canvas_replace_levels(priv, new_levels, NULL);
+	priv->reduced_level = shift;
+	priv->full_width = probe->width;
+	priv->full_height = probe->height;
+	priv->stamp = *stamp;
+	priv->have_stats = false;
+	return true;
 }
 
-static bool _canvas_reload(canvas_data_t* priv)
+// shows priv->path loading in bands, if its format allows.  the levels are
+// made here, and filled in by the load.
+static bool _canvas_open_bands(canvas_data_t* priv, const file_stamp_t* stamp)
 {
+	roi_source_t* source = roi_source_open_whole(priv->path);
+	if (!source)
+		return false;
+
 	canvas_level_t new_levels[CANVAS_NUM_MINIFY_LEVELS + 1];
 	ZeroMemory(new_levels, sizeof(new_levels));
+	void* bits[CANVAS_NUM_MINIFY_LEVELS + 1];
+	int widths[CANVAS_NUM_MINIFY_LEVELS + 1];
+	int heights[CANVAS_NUM_MINIFY_LEVELS + 1];
+	roi_source_get_size(source, &widths[0], &heights[0]);
+	for (int i = 0; i <= CANVAS_NUM_MINIFY_LEVELS; i++) {
+		canvas_level_t* level = &new_levels[i];
+		if (i > 0) {
+			widths[i] = (widths[i - 1] + 1) / 2;
+			heights[i] = (heights[i - 1] + 1) / 2;
+		}
+		level->width = widths[i];
+		level->height = heights[i];
+		if (!_canvas_create_dib(level->width, level->height, NULL, 0,
+			&level->hbitmap, &level->bits)) {
+			_canvas_free_levels(new_levels);
+			roi_source_close(source);
+			return false;
+		}
+		bits[i] = level->bits;
+	}
+
+	band_load_t* load = band_load_start(source, priv->path, bits, widths, heights,
+		priv->bg_color, priv->hwnd, CANVAS_WM_BAND);
+	if (!load) {
+		_canvas_free_levels(new_levels);
+		return false;
+	}
+	_canvas_replace_levels(priv, new_levels, NULL);
+	priv->load = load;
+	priv->stamp = *stamp;
+	priv->have_stats = false;
+	return true;
+}
 
-	if (!canvas_read_image(priv->path,
-		&new_levels[0].hbitmap, &new_levels[0].bits,
-		&new_levels[0].width, &new_levels[0].height)) {
+// takes the levels of a load in bands once it has finished, or drops them
+// if it failed.  true if it has finished.
+static bool _canvas_finish_bands(canvas_data_t* priv)
+{
+	band_load_state_t state;
+	band_load_get_state(priv->load, &state);
+	if (!state.finished)
 		return false;
+	band_load_close(priv->load);
+	priv->load = NULL;
+	if (!state.ok) {
+		_canvas_drop_levels(priv);
+		return true;
+	}
+
+	canvas_load_times_t* times = &priv->load_times;
+	times->decode_seconds = state.times.total_seconds;
+	times->preview_seconds = state.times.preview_seconds;
+	times->first_rows_seconds = state.times.first_rows_seconds;
+	// the statistics are made from the baked level 0 when asked for
+	_canvas_store_disk(priv);
+	return true;
+}
+
+static bool _canvas_ignore_rows(void* ctx, int y0, int y1)
+{
+	return true;
+}
+
+// decodes level 0 built in, for the formats split into parts that decode
+// in parallel (see roi_source.h), where GDI+ would decode on one thread.
+// raw YUV is read in parallel by canvas_read_image() already.
+static bool _canvas_read_parallel(const WCHAR* path, const image_probe_t* probe,
+	canvas_level_t* level)
+{
+	if (probe->format != IMAGE_PROBE_TIFF && probe->format != IMAGE_PROBE_PNM &&
+		(probe->format != IMAGE_PROBE_JPEG || probe->interlaced))
+		return false;
+	uint64_t start = trace_begin();
+	roi_source_t* source = roi_source_open_whole(path);
+	if (!source)
+		return false;
+	bool ok = roi_source_reads_in_parallel(source);
+	if (ok) {
+		roi_source_get_size(source, &level->width, &level->height);
+		ok = _canvas_create_dib(level->width, level->height, NULL, 0,
+			&level->hbitmap, &level->bits);
+	}
+	if (ok && !roi_source_read_rows(source, (uint32_t*)level->bits, level->width,
+		_canvas_ignore_rows, NULL)) {
+		DeleteObject(level->hbitmap);
+		level->hbitmap = NULL;
+		level->bits = NULL;
+		ok = false;
+	}
+	roi_source_close(source);
+	if (ok) {
+		uint64_t num_pixels = (uint64_t)level->width * level->height;
+		trace_end(TRACE_DECODE, start, num_pixels * 4, num_pixels);
+	}
+	return ok;
+}
+
+// incremental is true if the current levels may be updated in place, when
+// the new image is the same size.  on return, priv->dirty_valid tells
+// whether that happened and changed anything.  may_reduce lets a large
+// JPEG be decoded reduced, when it shows minified.
+static bool _canvas_reload(canvas_data_t* priv, bool incremental, bool may_reduce)
+{
+	canvas_level_t new_levels[CANVAS_NUM_MINIFY_LEVELS + 1];
+	ZeroMemory(new_levels, sizeof(new_levels));
+	priv->dirty_valid = false;
+
+	// stamp before decoding, so a change during the decode shows up as a
+	// mismatch later, rather than being missed.
+	file_stamp_t stamp;
+	get_file_stamp(priv->path, &stamp);
+
+	canvas_load_times_t* times = &priv->load_times;
+	ZeroMemory(times, sizeof(*times));
+
+	// levels still loading have nothing to compare against
+	if (priv->load)
+		incremental = false;
+
+	// too large to hold whole, by the header
+	image_probe_t probe;
+	bool probed = image_probe_file(priv->path, &probe);
+	uint64_t probe_pixels = probed ? (uint64_t)probe.width * probe.height : 0;
+	if (probe_pixels >= CANVAS_ROI_MIN_PIXELS && _canvas_open_roi(priv, &stamp))
+		return true;
+
+	// too large to wait for in full. a new image opens at the level that
+	// fits, and a reload stays at the level that shows.
+	if (may_reduce && probe_pixels >= CANVAS_REDUCED_MIN_PIXELS &&
+		probe.format == IMAGE_PROBE_JPEG && !probe.interlaced) {
+		int level = !_canvas_has_image(priv) ?
+			_canvas_fit_level(priv, probe.width, probe.height) :
+			priv->reduced_level ? -priv->zoom : 0;
+		if (level > 0 && _canvas_open_reduced(priv, &stamp, &probe, level))
+			return true;
+	}
+
+	// too large to wait for before showing anything. a reload that may
+	// update in place waits, as it's compared with the levels showing.
+	if (!incremental && probe_pixels >= CANVAS_BAND_MIN_PIXELS &&
+		_canvas_open_bands(priv, &stamp))
+		return true;
+
+	uint64_t start = trace_begin();
+
+	// textures are read here rather than by canvas_read_image(), to get
+	// their mips too
+	texture_t* texture = NULL;
+	bool read = probed && _canvas_read_parallel(priv->path, &probe, &new_levels[0]);
+	if (!read) {
+		texture = texture_file_open(priv->path);
+		read = texture ?
+			texture_file_read(texture, 0, 0,
+				&new_levels[0].hbitmap, &new_levels[0].bits,
+				&new_levels[0].width, &new_levels[0].height) :
+			canvas_read_image(priv->path,
+				&new_levels[0].hbitmap, &new_levels[0].bits,
+				&new_levels[0].width, &new_levels[0].height);
+	}
+	if (!read) {
+		// out of memory, or a file only the region decoder reads
+		texture_free(texture);
+		return _canvas_open_roi(priv, &stamp);
+	}
+	uint64_t num_pixels = (uint64_t)new_levels[0].width * new_levels[0].height;
+	times->decode_seconds = trace_seconds(trace_begin() - start);
+
+	// the statistics are of the image as decoded, before baking
+	start = trace_begin();
+	image_stats_t stats;
+	bool have_stats = image_stats_compute((const uint32_t*)new_levels[0].bits,
+		new_levels[0].width, new_levels[0].height, false, &stats);
+	times->stats_seconds = trace_seconds(trace_begin() - start);
+
+	// the minified levels of a texture come from its mips, not from
+	// level 0, so updating level 0 in place would leave them stale
+	if (incremental && !texture && priv->levels[0].hbitmap && !priv->disk &&
+		priv->levels[0].width == new_levels[0].width &&
+		priv->levels[0].height == new_levels[0].height) {
+		start = trace_begin();
+		if (_canvas_update_dirty(priv, &new_levels[0])) {
+			_canvas_free_levels(new_levels);
+			priv->stamp = stamp;
+			priv->stats = stats;
+			priv->have_stats = have_stats;
+			times->incremental = true;
+			times->update_seconds = trace_seconds(
+				trace_end(TRACE_UPDATE, start, num_pixels * 4 * 2, num_pixels));
+			return true;
+		}
+		// couldn't allocate the dirty map. replace everything instead.
 	}
 
 	// Bake the background color in, making the image opaque.
+	start = trace_begin();
 	_bake_bg_sse2(&new_levels[0], priv->bg_color);
+	times->bake_seconds = trace_seconds(
+		trace_end(TRACE_BAKE, start, num_pixels * 4 * 2, num_pixels));
 
+	start = trace_begin();
+	if (texture) {
+		_canvas_read_mips(texture, 0, new_levels, priv->bg_color);
+		texture_free(texture);
+	}
 	if (!_canvas_downsize(new_levels, priv->bg_color)) {
 		_canvas_free_levels(new_levels);
 		return false;
 	}
+	// each level reads 4 bytes per pixel of the one above, and writes a
+	// quarter of that. about 5/3 of level 0, all told.
+	times->downsize_seconds = trace_seconds(
+		trace_end(TRACE_DOWNSIZE, start, num_pixels * 4 * 5 / 3, num_pixels * 4 / 3));
+
+	// success. replace old levels, and the history of them
+	_canvas_replace_levels(priv, new_levels, NULL);
+	priv->stamp = stamp;
+	priv->stats = stats;
+	priv->have_stats = have_stats;
+
+	_canvas_store_disk(priv);
+	return true;
+}
+
+// keeps the current image in the inactive image cache, before it is
+// replaced by another.
+static void _canvas_demote(canvas_data_t* priv)
+{
+	// an older version from the history doesn't match the file. levels
+	// mapped from the disk cache are cached already.
+	if (!priv->path || !priv->levels[0].hbitmap || priv->history_pos || priv->disk ||
+		priv->load)
+		return;
+	if (image_cache_has(priv->path, &priv->stamp))
+		return;
+
+	// compressed on the thread pool, which keeps the levels alive till
+	// then, so the next image starts loading straight away
+	canvas_shared_levels_t* shared = _canvas_share_levels(priv);
+	if (!shared)
+		return;
+	const uint32_t* pixels[CANVAS_NUM_MINIFY_LEVELS + 1];
+	int widths[CANVAS_NUM_MINIFY_LEVELS + 1];
+	int heights[CANVAS_NUM_MINIFY_LEVELS + 1];
+	for (int i = 0; i <= CANVAS_NUM_MINIFY_LEVELS; i++) {
+		pixels[i] = (const uint32_t*)shared->levels[i].bits;
+		widths[i] = shared->levels[i].width;
+		heights[i] = shared->levels[i].height;
+	}
+	if (!image_cache_put_async(priv->path, &priv->stamp, CANVAS_NUM_MINIFY_LEVELS + 1,
+		pixels, widths, heights, _canvas_release_shared_ctx, shared))
+		_canvas_release_shared(shared);
+}
+
+// loads the levels of priv->path from the inactive image cache, if it holds
+// the current version of the file.
+static bool _canvas_promote(canvas_data_t* priv)
+{
+	file_stamp_t stamp;
+	if (!get_file_stamp(priv->path, &stamp))
+		return false;
+	const image_cache_entry_t* entry = image_cache_get(priv->path, &stamp);
+	if (!entry || image_cache_entry_num_levels(entry) != CANVAS_NUM_MINIFY_LEVELS + 1)
+		return false;
 
-	// success. replace old levels
-	_canvas_free_levels(priv->levels);
-	CopyMemory(priv->levels, new_levels, sizeof(new_levels));
+	uint64_t start = trace_begin();
 
+	canvas_level_t new_levels[CANVAS_NUM_MINIFY_LEVELS + 1];
+	ZeroMemory(new_levels, sizeof(new_levels));
+	for (int i = 0; i <= CANVAS_NUM_MINIFY_LEVELS; i++) {
+		canvas_level_t* level = &new_levels[i];
+		image_cache_entry_level_size(entry, i, &level->width, &level->height);
+		if (!_canvas_create_dib(level->width, level->height, NULL, 0,
+				&level->hbitmap, &level->bits) ||
+			!image_cache_entry_decompress(entry, i, (uint32_t*)level->bits)) {
+			_canvas_free_levels(new_levels);
+			return false;
+		}
+	}
+
+	canvas_cache_info_t* info = &priv->cache_info;
+	image_cache_entry_sizes(entry, &info->raw_bytes, &info->compressed_bytes);
+	info->decompress_seconds = trace_seconds(trace_end(TRACE_CACHE_DECOMPRESS,
+		start, info->raw_bytes, info->raw_bytes / 4));
+	info->from_cache = true;
+
+	_canvas_replace_levels(priv, new_levels, NULL);
+	priv->stamp = stamp;
 	return true;
 }
 
-static void _canvas_paint(HWND hwnd, HDC hdc, PAINTSTRUCT* ps)
+// maps the levels of priv->path from the disk cache, if it holds the
+// current version of the file.  pixels are read as they are painted.
+static bool _canvas_map_disk(canvas_data_t* priv)
 {
-	canvas_data_t* priv = _canvas_get_private(hwnd);
+	file_stamp_t stamp;
+	if (!disk_cache_enabled() || !get_file_stamp(priv->path, &stamp))
+		return false;
+	uint64_t start = trace_begin();
+	disk_cache_t* disk = disk_cache_open(priv->path, &stamp);
+	if (!disk)
+		return false;
 
-	RECT client_rect;
-	GetClientRect(hwnd, &client_rect);
+	canvas_level_t new_levels[CANVAS_NUM_MINIFY_LEVELS + 1];
+	ZeroMemory(new_levels, sizeof(new_levels));
+	bool ok = disk_cache_num_levels(disk) == CANVAS_NUM_MINIFY_LEVELS + 1;
+	for (int i = 0; ok && i <= CANVAS_NUM_MINIFY_LEVELS; i++) {
+		canvas_level_t* level = &new_levels[i];
+		disk_cache_level_size(disk, i, &level->width, &level->height);
+		ok = _canvas_create_dib(level->width, level->height,
+			disk_cache_section(disk), disk_cache_level_offset(disk, i),
+			&level->hbitmap, &level->bits);
+	}
+	if (!ok) {
+		_canvas_free_levels(new_levels);
+		disk_cache_close(disk);
+		return false;
+	}
 
-	// Draw image
-	if (priv->levels[0].hbitmap) {
-		int scaled_width;
-		int scaled_height;
-		int src_width;
-		int src_height;
-		int src_x;
-		int src_y;
-		int src_x2;
-		int src_y2;
-		int dest_x;
-		int dest_y;
-		int dest_x2;
-		int dest_y2;
-
-		HDC bitmap_hdc = CreateCompatibleDC(hdc);
-
-		if (priv->zoom < 0) {
-			SelectObject(bitmap_hdc, priv->levels[-priv->zoom].hbitmap);
-			src_width = scaled_width = priv->levels[-priv->zoom].width;
-			src_height = scaled_height = priv->levels[-priv->zoom].height;
-		}
-		else {
-			SelectObject(bitmap_hdc, priv->levels[0].hbitmap);
-			src_width = priv->levels[0].width;
-			src_height = priv->levels[0].height;
-			scaled_width = priv->levels[0].width << priv->zoom;
-			scaled_height = priv->levels[0].height << priv->zoom;
-		}
+	_canvas_replace_levels(priv, new_levels, disk);
+	priv->stamp = stamp;
+	trace_end(TRACE_DISK_MAP, start, 0, 0);
+	return true;
+}
 
-		// Calculate new source and dest mapping for when the image is
-		// very large and/or zoomed very far in, so extremely large coordinates
-		// are avoided.
-		// Certain checking isn't needed because of the xform clamp.
-		int real_zoom = priv->zoom < 0 ? 0 : priv->zoom;
-		if (priv->tx >= 0)
-			src_x = 0;
-		else
-			src_x = (-priv->tx) >> real_zoom;
-		dest_x = (src_x << real_zoom) + priv->tx;
+// maps a rect of level 0 pixels to client coords, at the current xform
+static RECT _canvas_image_to_client_rect(canvas_data_t* priv, const RECT* rect)
+{
+	RECT result;
+	if (priv->zoom >= 0) {
+		result.left = (rect->left << priv->zoom) + priv->tx;
+		result.top = (rect->top << priv->zoom) + priv->ty;
+		result.right = (rect->right << priv->zoom) + priv->tx;
+		result.bottom = (rect->bottom << priv->zoom) + priv->ty;
+	}
+	else {
+		int round = (1 << -priv->zoom) - 1;
+		result.left = (rect->left >> -priv->zoom) + priv->tx;
+		result.top = (rect->top >> -priv->zoom) + priv->ty;
+		result.right = ((rect->right + round) >> -priv->zoom) + priv->tx;
+		result.bottom = ((rect->bottom + round) >> -priv->zoom) + priv->ty;
+	}
+	return result;
+}
 
-		src_x2 = ((client_rect.right - priv->tx) >> real_zoom) + 1;
-		if (src_x2 > src_width)
-			src_x2 = src_width;
-		dest_x2 = (src_x2 << real_zoom) + priv->tx;
+// the pixels of a level that show in the client area, with each pixel
+// 2^scale client pixels across
+static RECT _canvas_visible_rect_at(canvas_data_t* priv, int width, int height,
+	int scale, const RECT* client_rect)
+{
+	// Calculate new source and dest mapping for when the image is
+	// very large and/or zoomed very far in, so extremely large coordinates
+	// are avoided.
+	// Certain checking isn't needed because of the xform clamp.
+	int real_zoom = scale;
+	RECT src;
+	if (priv->tx >= 0)
+		src.left = 0;
+	else
+		src.left = (-priv->tx) >> real_zoom;
+	src.right = ((client_rect->right - priv->tx) >> real_zoom) + 1;
+	if (src.right > width)
+		src.right = width;
+
+	if (priv->ty >= 0)
+		src.top = 0;
+	else
+		src.top = (-priv->ty) >> real_zoom;
+	src.bottom = ((client_rect->bottom - priv->ty) >> real_zoom) + 1;
+	if (src.bottom > height)
+		src.bottom = height;
+	return src;
+}
 
-		if (priv->ty >= 0)
-			src_y = 0;
-		else
-			src_y = (-priv->ty) >> real_zoom;
-		dest_y = (src_y << real_zoom) + priv->ty;
+// the pixels of a level that show in the client area, at the zoom the
+// level is chosen for: level 0 when magnifying, or level -zoom.
+static RECT _canvas_visible_rect(canvas_data_t* priv, int width, int height,
+	const RECT* client_rect)
+{
+	return _canvas_visible_rect_at(priv, width, height, max(priv->zoom, 0), client_rect);
+}
 
-		src_y2 = ((client_rect.bottom - priv->ty) >> real_zoom) + 1;
-		if (src_y2 > src_height)
-			src_y2 = src_height;
-		dest_y2 = (src_y2 << real_zoom) + priv->ty;
+// draws a level into the columns [x0, x1) of the client area, with each
+// pixel 2^scale client pixels across, and excludes what it covers from the
+// clip, for the background to draw everywhere else.  returns the pixels
+// drawn.
+static uint64_t _canvas_draw_level_at(canvas_data_t* priv, HDC hdc, HBITMAP hbitmap,
+	int width, int height, int scale, const RECT* client_rect, int x0, int x1)
+{
+	int real_zoom = scale;
+	RECT src = _canvas_visible_rect_at(priv, width, height, scale, client_rect);
+	int dest_x = (src.left << real_zoom) + priv->tx;
+	int dest_x2 = (src.right << real_zoom) + priv->tx;
+	int dest_y = (src.top << real_zoom) + priv->ty;
+	int dest_y2 = (src.bottom << real_zoom) + priv->ty;
+	int scaled_x2 = priv->tx + (width << real_zoom);
+	int scaled_y2 = priv->ty + (height << real_zoom);
+	if (x0 >= x1)
+		return 0;
 
-		StretchBlt(hdc, dest_x, dest_y, dest_x2 - dest_x, dest_y2 - dest_y,
-			bitmap_hdc, src_x, src_y, src_x2 - src_x, src_y2 - src_y, SRCCOPY);
+	HDC bitmap_hdc = CreateCompatibleDC(hdc);
+	SelectObject(bitmap_hdc, hbitmap);
+	int saved = SaveDC(hdc);
+	IntersectClipRect(hdc, x0, 0, x1, client_rect->bottom);
+	StretchBlt(hdc, dest_x, dest_y, dest_x2 - dest_x, dest_y2 - dest_y,
+		bitmap_hdc, src.left, src.top, src.right - src.left, src.bottom - src.top, SRCCOPY);
+	RestoreDC(hdc, saved);
+	DeleteDC(bitmap_hdc);
+
+	ExcludeClipRect(hdc, max(priv->tx, x0), priv->ty, min(scaled_x2, x1), scaled_y2);
+	int drawn_width = min(dest_x2, x1) - max(dest_x, x0);
+	return drawn_width > 0 ? (uint64_t)drawn_width * (dest_y2 - dest_y) : 0;
+}
 
-		DeleteDC(bitmap_hdc);
+// draws a level chosen for the zoom, as _canvas_draw_level_at() does
+static uint64_t _canvas_draw_level(canvas_data_t* priv, HDC hdc, HBITMAP hbitmap,
+	int width, int height, const RECT* client_rect, int x0, int x1)
+{
+	return _canvas_draw_level_at(priv, hdc, hbitmap, width, height,
+		max(priv->zoom, 0), client_rect, x0, x1);
+}
 
-		// exclude the scaled bitmap rect from the clip, for the background
-		// to draw everywhere else.
-		ExcludeClipRect(hdc, priv->tx, priv->ty,
-			priv->tx + scaled_width, priv->ty + scaled_height);
+// draws the level chosen for the zoom while it loads in bands: the rows of
+// it that are ready, and below them the preview scaled up, where there is
+// one.  excludes what they cover from the clip.  returns the pixels drawn.
+static uint64_t _canvas_draw_loading(canvas_data_t* priv, HDC hdc,
+	const RECT* client_rect)
+{
+	band_load_state_t state;
+	band_load_get_state(priv->load, &state);
+	int index = priv->zoom < 0 ? -priv->zoom : 0;
+	int real_zoom = priv->zoom < 0 ? 0 : priv->zoom;
+	canvas_level_t* level = &priv->levels[index];
+	int preview = state.preview_level;
+
+	// the preview's level and those below it show whole from the start
+	int ready = preview >= 0 && index >= preview ? level->height : state.ready[index];
+	int split = (int)max(min(priv->ty + ((int64_t)ready << real_zoom),
+		(int64_t)client_rect->bottom), 0);
+	int scaled_x2 = priv->tx + (level->width << real_zoom);
+	int scaled_y2 = priv->ty + (level->height << real_zoom);
+
+	int saved = SaveDC(hdc);
+	IntersectClipRect(hdc, 0, 0, client_rect->right, split);
+	uint64_t num_pixels = _canvas_draw_level(priv, hdc, level->hbitmap,
+		level->width, level->height, client_rect, 0, client_rect->right);
+	RestoreDC(hdc, saved);
+
+	// the preview's pixels past the image's edge, as it rounds up, are
+	// clipped off
+	int covered_y2 = split;
+	if (preview > index) {
+		canvas_level_t* coarse = &priv->levels[preview];
+		saved = SaveDC(hdc);
+		IntersectClipRect(hdc, priv->tx, split, scaled_x2, scaled_y2);
+		num_pixels += _canvas_draw_level_at(priv, hdc, coarse->hbitmap,
+			coarse->width, coarse->height, real_zoom + preview - index, client_rect,
+			0, client_rect->right);
+		RestoreDC(hdc, saved);
+		covered_y2 = scaled_y2;
+	}
+	ExcludeClipRect(hdc, priv->tx, priv->ty, scaled_x2, covered_y2);
+	return num_pixels;
+}
+
+// draws A and B as the compare view has them. returns the pixels drawn,
+// and sets message when the view can't show.
+static uint64_t _canvas_draw_compare(canvas_data_t* priv, HDC hdc,
+	const RECT* client_rect, const WCHAR** message)
+{
+	int index = priv->zoom < 0 ? -priv->zoom : 0;
+	canvas_level_t* a = &priv->levels[index];
+	canvas_level_t* b = &priv->compare_levels[index];
+	int right = client_rect->right;
+	switch (priv->compare_view) {
+		case CANVAS_COMPARE_SPLIT:
+		{
+			int split = priv->split_x < 0 ? right / 2 : min(priv->split_x, right);
+			return _canvas_draw_level(priv, hdc, a->hbitmap, a->width, a->height,
+				client_rect, 0, split) +
+				_canvas_draw_level(priv, hdc, b->hbitmap, b->width, b->height,
+				client_rect, split, right);
+		}
+
+		case CANVAS_COMPARE_A:
+			return _canvas_draw_level(priv, hdc, a->hbitmap, a->width, a->height,
+				client_rect, 0, right);
+
+		case CANVAS_COMPARE_B:
+			return _canvas_draw_level(priv, hdc, b->hbitmap, b->width, b->height,
+				client_rect, 0, right);
+
+		default:
+		{
+			render_level_t level_a = { (uint32_t*)a->bits, a->width, a->height };
+			render_level_t level_b = { (uint32_t*)b->bits, b->width, b->height };
+			RECT src = _canvas_visible_rect(priv, a->width, a->height, client_rect);
+			HBITMAP diff = compare_get_level(priv->compare,
+				priv->compare_view == CANVAS_COMPARE_HEATMAP ? COMPARE_HEATMAP : COMPARE_ABSDIFF,
+				index, &level_a, &level_b, &src);
+			if (!diff) {
+				*message = a->width != b->width || a->height != b->height ?
+					L"A and B differ in size" : L"Error comparing images";
+				return 0;
+			}
+			return _canvas_draw_level(priv, hdc, diff, a->width, a->height,
+				client_rect, 0, right);
+		}
+	}
+}
+
+static void _canvas_paint(HWND hwnd, HDC hdc, PAINTSTRUCT* ps)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	uint64_t start = trace_begin();
+	uint64_t num_pixels = 0;
+
+	RECT client_rect;
+	GetClientRect(hwnd, &client_rect);
+
+	// Draw image
+	const WCHAR* message = NULL;
+	if (priv->load) {
+		num_pixels = _canvas_draw_loading(priv, hdc, &client_rect);
+	}
+	else if (priv->levels[0].hbitmap && priv->compare) {
+		num_pixels = _canvas_draw_compare(priv, hdc, &client_rect, &message);
+	}
+	else if (priv->levels[CANVAS_NUM_MINIFY_LEVELS].hbitmap) {
+		int index = priv->zoom < 0 ? -priv->zoom : 0;
+		num_pixels = _canvas_draw_level(priv, hdc, priv->levels[index].hbitmap,
+			priv->levels[index].width, priv->levels[index].height, &client_rect,
+			0, client_rect.right);
+	}
+	else if (priv->roi) {
+		render_view_t view;
+		view.width = client_rect.right;
+		view.height = client_rect.bottom;
+		view.zoom = priv->zoom;
+		view.tx = priv->tx;
+		view.ty = priv->ty;
+		num_pixels = roi_view_draw(priv->roi, hdc, &view);
+	}
+	else {
+		message = priv->path ? L"Error loading image" : L"No image loaded";
 	}
 
 	// Draw the background inside the requested dirty rect and outside
@@ -446,8 +1394,41 @@ static void _canvas_paint(HWND hwnd, HDC hdc, PAINTSTRUCT* ps)
 	SelectObject(hdc, old_brush);
 	DeleteObject(bg_brush);
 
+	// Mark the split between A and B
+	if (priv->compare && priv->compare_view == CANVAS_COMPARE_SPLIT &&
+		priv->levels[0].hbitmap) {
+		SelectClipRgn(hdc, NULL);
+		int split = priv->split_x < 0 ? client_rect.right / 2 :
+			min(priv->split_x, client_rect.right);
+		RECT line = { split, client_rect.top, split + 1, client_rect.bottom };
+		HBRUSH split_brush = CreateSolidBrush(RGB(255, 255, 255));
+		FillRect(hdc, &line, split_brush);
+		DeleteObject(split_brush);
+	}
+
+	// Outline the area changed by the last reload
+	if (priv->flashing && priv->dirty_valid && priv->levels[0].hbitmap) {
+		SelectClipRgn(hdc, NULL);
+		RECT outline = _canvas_image_to_client_rect(priv, &priv->dirty_rect);
+		InflateRect(&outline, 1, 1);
+		HBRUSH flash_brush = CreateSolidBrush(RGB(255, 0, 255));
+		FrameRect(hdc, &outline, flash_brush);
+		DeleteObject(flash_brush);
+	}
+
+	// the selection, in black and white so it shows on anything
+	if (priv->have_selection && priv->levels[0].hbitmap && !priv->load) {
+		SelectClipRgn(hdc, NULL);
+		RECT outline = _canvas_image_to_client_rect(priv, &priv->selection);
+		InflateRect(&outline, 1, 1);
+		FrameRect(hdc, &outline, (HBRUSH)GetStockObject(BLACK_BRUSH));
+		InflateRect(&outline, -1, -1);
+		FrameRect(hdc, &outline, (HBRUSH)GetStockObject(WHITE_BRUSH));
+	}
+
 	// Draw message text if appropriate.
-	if (!priv->levels[0].hbitmap) {
+	if (message) {
+		SelectClipRgn(hdc, NULL);
 		SetBkMode(hdc, TRANSPARENT);
 		COLORREF old_fg = SetTextColor(hdc, priv->path ? 0x0000FF : 0xFFFFFF);
 		UINT old_ta = SetTextAlign(hdc, TA_CENTER | TA_BASELINE);
@@ -455,8 +1436,7 @@ static void _canvas_paint(HWND hwnd, HDC hdc, PAINTSTRUCT* ps)
 		if (priv->hfont)
 			old_font = SelectObject(hdc, priv->hfont);
 
-		const WCHAR* text = priv->path ? L"Error loading image" : L"No image loaded";
-		TextOutW(hdc, client_rect.right / 2, client_rect.bottom / 2, text, (int)wcslen(text));
+		TextOutW(hdc, client_rect.right / 2, client_rect.bottom / 2, message, (int)wcslen(message));
 
 		// restore
 		SetTextColor(hdc, old_fg);
@@ -464,43 +1444,44 @@ static void _canvas_paint(HWND hwnd, HDC hdc, PAINTSTRUCT* ps)
 		if (old_font)
 			SelectObject(hdc, old_font);
 	}
+
+	// GDI batches calls. flush, so the time is of the actual drawing.
+	GdiFlush();
+	trace_end(TRACE_PAINT, start, num_pixels * 4, num_pixels);
+}
+
+// the view math is shared with the headless renderer, so both show the same
+static render_view_t _canvas_get_view(HWND hwnd)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	RECT client_rect;
+	GetClientRect(hwnd, &client_rect);
+
+	render_view_t view;
+	view.width = client_rect.right;
+	view.height = client_rect.bottom;
+	view.zoom = priv->zoom;
+	view.tx = priv->tx;
+	view.ty = priv->ty;
+	return view;
+}
+
+static void _canvas_set_view(HWND hwnd, const render_view_t* view)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	priv->zoom = view->zoom;
+	priv->tx = view->tx;
+	priv->ty = view->ty;
 }
 
 static void _canvas_clamp_xform(HWND hwnd)
 {
 	canvas_data_t* priv = _canvas_get_private(hwnd);
-	RECT client_rect;
-	GetClientRect(hwnd, &client_rect);
-
-	int scaled_width, scaled_height;
-	if (priv->zoom < 0) {
-		scaled_width = priv->levels[-priv->zoom].width;
-		scaled_height = priv->levels[-priv->zoom].height;
-	}
-	else {
-		scaled_width = priv->levels[0].width << priv->zoom;
-		scaled_height = priv->levels[0].height << priv->zoom;
-	}
-
-	if (scaled_width <= client_rect.right) {
-		priv->tx = (client_rect.right - scaled_width) / 2;
-	}
-	else {
-		if (priv->tx > 0)
-			priv->tx = 0;
-		if (priv->tx + scaled_width < client_rect.right)
-			priv->tx = client_rect.right - scaled_width;
-	}
-
-	if (scaled_height <= client_rect.bottom) {
-		priv->ty = (client_rect.bottom - scaled_height) / 2;
-	}
-	else {
-		if (priv->ty > 0)
-			priv->ty = 0;
-		if (priv->ty + scaled_height < client_rect.bottom)
-			priv->ty = client_rect.bottom - scaled_height;
-	}
+	render_view_t view = _canvas_get_view(hwnd);
+	int width, height;
+	_canvas_image_size(priv, &width, &height);
+	render_view_clamp(&view, width, height);
+	_canvas_set_view(hwnd, &view);
 }
 
 static void _canvas_send_notify(HWND hwnd, UINT code)
@@ -529,6 +1510,38 @@ static void _canvas_send_notify_mousemove(HWND hwnd, int x, int y)
 	}
 }
 
+// the selection from select_start to the pixel at image_pos, both in it
+static void _canvas_select_to(HWND hwnd, const POINT* image_pos)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	RECT selection;
+	selection.left = max(min(priv->select_start.x, image_pos->x), 0);
+	selection.top = max(min(priv->select_start.y, image_pos->y), 0);
+	selection.right = min(max(priv->select_start.x, image_pos->x) + 1, priv->levels[0].width);
+	selection.bottom = min(max(priv->select_start.y, image_pos->y) + 1, priv->levels[0].height);
+	bool have_selection = selection.right > selection.left && selection.bottom > selection.top;
+	if (have_selection == priv->have_selection &&
+		(!have_selection || EqualRect(&selection, &priv->selection)))
+		return;
+	priv->have_selection = have_selection;
+	priv->selection = selection;
+	InvalidateRect(hwnd, NULL, FALSE);
+	_canvas_send_notify(hwnd, CANVAS_NM_SELECTION);
+}
+
+// decodes in full an image decoded reduced, once zoomed in past it
+static bool _canvas_load_full(HWND hwnd)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	HCURSOR old_cursor = SetCursor(LoadCursor(NULL, IDC_WAIT));
+	uint64_t start = trace_begin();
+	bool loaded = _canvas_reload(priv, false, false);
+	trace_end(TRACE_LOAD, start, 0, 0);
+	SetCursor(old_cursor);
+	_canvas_compare_changed(priv);
+	return loaded;
+}
+
 static LRESULT CALLBACK _canvas_wndproc(HWND hwnd, UINT message,
 	WPARAM wParam, LPARAM lParam)
 {
@@ -539,6 +1552,7 @@ static LRESULT CALLBACK _canvas_wndproc(HWND hwnd, UINT message,
 			if (!priv)
 				return FALSE;
 			SetWindowLongPtrW(hwnd, CANVAS_WNDLONG_PRIVATE, (LONG_PTR)priv);
+			priv->hwnd = hwnd;
 
 			// get the default font
 			NONCLIENTMETRICSW metrics;
@@ -570,6 +1584,19 @@ static LRESULT CALLBACK _canvas_wndproc(HWND hwnd, UINT message,
 			HDC hdc = BeginPaint(hwnd, &ps);
 			_canvas_paint(hwnd, hdc, &ps);
 			EndPaint(hwnd, &ps);
+			if (trace_is_enabled())
+				_canvas_send_notify(hwnd, CANVAS_NM_PAINTED);
+		}
+		return 0;
+
+		case WM_PRINTCLIENT:
+		{
+			// the whole client area, into the given DC
+			PAINTSTRUCT ps;
+			ZeroMemory(&ps, sizeof(ps));
+			ps.hdc = (HDC)wParam;
+			GetClientRect(hwnd, &ps.rcPaint);
+			_canvas_paint(hwnd, ps.hdc, &ps);
 		}
 		return 0;
 
@@ -580,17 +1607,52 @@ static LRESULT CALLBACK _canvas_wndproc(HWND hwnd, UINT message,
 			return 0;
 		}
 
+		case CANVAS_WM_TILE:
+			InvalidateRect(hwnd, NULL, FALSE);
+			return 0;
+
+		case CANVAS_WM_BAND:
+		{
+			canvas_data_t* priv = _canvas_get_private(hwnd);
+			InvalidateRect(hwnd, NULL, FALSE);
+			if (priv->load && _canvas_finish_bands(priv)) {
+				_canvas_compare_changed(priv);
+				_canvas_send_notify(hwnd, CANVAS_NM_LOADED);
+			}
+			return 0;
+		}
+
+		case WM_TIMER:
+		{
+			canvas_data_t* priv = _canvas_get_private(hwnd);
+			if (wParam == CANVAS_TIMER_FLASH) {
+				KillTimer(hwnd, CANVAS_TIMER_FLASH);
+				priv->flashing = false;
+				InvalidateRect(hwnd, NULL, FALSE);
+			}
+			return 0;
+		}
+
 		case WM_CAPTURECHANGED:
 		{
 			canvas_data_t* priv = _canvas_get_private(hwnd);
 			priv->panning = false;
+			priv->splitting = false;
+			priv->selecting = false;
 			return 0;
 		}
 
 		case WM_LBUTTONDOWN:
 		{
 			canvas_data_t* priv = _canvas_get_private(hwnd);
-			if (priv->levels[0].hbitmap) {
+			if (priv->levels[0].hbitmap && !priv->load && (wParam & MK_SHIFT)) {
+				POINT pos = { (SHORT)LOWORD(lParam), (SHORT)HIWORD(lParam) };
+				priv->select_start = canvas_client_to_image(hwnd, &pos);
+				priv->selecting = true;
+				_canvas_select_to(hwnd, &priv->select_start);
+				SetCapture(hwnd);
+			}
+			else if (_canvas_has_image(priv)) {
 				priv->panning = true;
 				priv->prev_mousex = (SHORT)LOWORD(lParam);
 				priv->prev_mousey = (SHORT)HIWORD(lParam);
@@ -603,10 +1665,34 @@ static LRESULT CALLBACK _canvas_wndproc(HWND hwnd, UINT message,
 		{
 			canvas_data_t* priv = _canvas_get_private(hwnd);
 			priv->panning = false;
+			priv->selecting = false;
 			ReleaseCapture();
 			return 0;
 		}
 
+		// drags the split between A and B
+		case WM_RBUTTONDOWN:
+		{
+			canvas_data_t* priv = _canvas_get_private(hwnd);
+			if (priv->compare && priv->compare_view == CANVAS_COMPARE_SPLIT) {
+				priv->splitting = true;
+				priv->split_x = max((SHORT)LOWORD(lParam), 0);
+				SetCapture(hwnd);
+				InvalidateRect(hwnd, NULL, FALSE);
+			}
+			return 0;
+		}
+
+		case WM_RBUTTONUP:
+		{
+			canvas_data_t* priv = _canvas_get_private(hwnd);
+			if (priv->splitting) {
+				priv->splitting = false;
+				ReleaseCapture();
+			}
+			return 0;
+		}
+
 		case WM_XBUTTONDOWN:
 		{
 			switch (HIWORD(wParam)) {
@@ -636,6 +1722,15 @@ static LRESULT CALLBACK _canvas_wndproc(HWND hwnd, UINT message,
 				_canvas_clamp_xform(hwnd);
 				InvalidateRect(hwnd, NULL, FALSE);
 			}
+			if (priv->splitting) {
+				priv->split_x = max(mx, 0);
+				InvalidateRect(hwnd, NULL, FALSE);
+			}
+			if (priv->selecting) {
+				POINT pos = { mx, my };
+				POINT image_pos = canvas_client_to_image(hwnd, &pos);
+				_canvas_select_to(hwnd, &image_pos);
+			}
 
 			_canvas_send_notify_mousemove(hwnd, mx, my);
 			return 0;
@@ -644,39 +1739,38 @@ static LRESULT CALLBACK _canvas_wndproc(HWND hwnd, UINT message,
 		case WM_MOUSEWHEEL:
 		{
 			canvas_data_t* priv = _canvas_get_private(hwnd);
-			if (!priv->levels[0].hbitmap)
+			if (!_canvas_has_image(priv))
 				return 0;
 			priv->wheel_accum += (SHORT)HIWORD(wParam);
 			int old_zoom = priv->zoom;
 			if (abs(priv->wheel_accum) >= WHEEL_DELTA) {
+				int zoom = old_zoom;
 				while (priv->wheel_accum >= WHEEL_DELTA) {
 					priv->wheel_accum -= WHEEL_DELTA;
-					priv->zoom++;
+					zoom++;
 				}
 				while (priv->wheel_accum <= -WHEEL_DELTA) {
 					priv->wheel_accum += WHEEL_DELTA;
-					priv->zoom--;
+					zoom--;
 				}
-				if (priv->zoom > 5)
-					priv->zoom = 5;
-				if (priv->zoom < -CANVAS_NUM_MINIFY_LEVELS)
-					priv->zoom = -CANVAS_NUM_MINIFY_LEVELS;
+				// past what the reduced decode has. decode the rest, or
+				// stay at the finest there is.
+				if (priv->reduced_level && -zoom < priv->reduced_level &&
+					!_canvas_load_full(hwnd))
+					zoom = -priv->reduced_level;
+
+				POINT pos;
+				pos.x = (SHORT)LOWORD(lParam);
+				pos.y = (SHORT)HIWORD(lParam);
+				// mouse wheel coords are supplied in screen space for some reason
+				ScreenToClient(hwnd, &pos);
+
+				render_view_t view = _canvas_get_view(hwnd);
+				int width, height;
+				_canvas_image_size(priv, &width, &height);
+				render_view_zoom(&view, zoom, pos.x, pos.y, width, height);
+				_canvas_set_view(hwnd, &view);
 				if (priv->zoom != old_zoom) {
-					POINT pos;
-					pos.x = (SHORT)LOWORD(lParam);
-					pos.y = (SHORT)HIWORD(lParam);
-					// mouse wheel coords are supplied in screen space for some reason
-					ScreenToClient(hwnd, &pos);
-					int mx = pos.x;
-					int my = pos.y;
-
-					double old_scale = pow(2, old_zoom);
-					double new_scale = pow(2, priv->zoom);
-					priv->tx = (int)(mx - ((double)mx - priv->tx) / old_scale * new_scale);
-					priv->ty = (int)(my - ((double)my - priv->ty) / old_scale * new_scale);
-
-					_canvas_clamp_xform(hwnd);
-
 					InvalidateRect(hwnd, NULL, FALSE);
 					_canvas_send_notify(hwnd, CANVAS_NM_ZOOM);
 				}
@@ -704,10 +1798,12 @@ bool canvas_get_image_size(HWND hwnd, UINT* width, UINT* height)
 	if (!hwnd || !width || !height)
 		return false;
 	canvas_data_t* priv = _canvas_get_private(hwnd);
-	if (!priv || !priv->levels[0].hbitmap)
+	if (!priv || !_canvas_has_image(priv))
 		return false;
-	*width = priv->levels[0].width;
-	*height = priv->levels[0].height;
+	int image_width, image_height;
+	_canvas_image_size(priv, &image_width, &image_height);
+	*width = image_width;
+	*height = image_height;
 	return true;
 }
 
@@ -723,18 +1819,53 @@ POINT canvas_client_to_image(HWND hwnd, const POINT* client_pos)
 	return image_pos;
 }
 
-bool canvas_set_image(HWND hwnd, const WCHAR* path)
+// drops the image shown, keeping it in the cache if it came from a file
+static void _canvas_release_image(HWND hwnd)
 {
 	canvas_data_t* priv = _canvas_get_private(hwnd);
-	if (!priv)
-		return false;
-
-	_canvas_free_levels(priv->levels);
+	_canvas_demote(priv);
+	priv->cache_info.from_cache = false;
+	priv->cache_info.from_disk_cache = false;
+	_canvas_clear_history(priv);
+	band_load_close(priv->load);
+	priv->load = NULL;
+	_canvas_drop_levels(priv);
+	disk_cache_close(priv->disk);
+	priv->disk = NULL;
+	roi_view_close(priv->roi);
+	priv->roi = NULL;
+	priv->reduced_level = 0;
 	if (priv->path) {
 		free(priv->path);
 		priv->path = NULL;
 	}
+	priv->dirty_valid = false;
+	priv->flashing = false;
+	KillTimer(hwnd, CANVAS_TIMER_FLASH);
+	priv->live = false;
+	priv->live_frame = 0;
+	priv->have_stats = false;
+	_canvas_region_stats_changed(priv, NULL);
+}
+
+// statistics of the baked level 0, for images the caches or the history
+// gave, which never were unbaked here.  made when first asked for, so a
+// mapped disk cache file isn't read through just for them.
+static void _canvas_baked_stats(canvas_data_t* priv)
+{
+	if (!priv->have_stats && priv->levels[0].bits && !priv->load) {
+		priv->have_stats = image_stats_compute((const uint32_t*)priv->levels[0].bits,
+			priv->levels[0].width, priv->levels[0].height, true, &priv->stats);
+	}
+}
+
+bool canvas_set_image(HWND hwnd, const WCHAR* path)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv)
+		return false;
 
+	_canvas_release_image(hwnd);
 	priv->path = _wcsdup(path);
 	if (!priv->path)
 		return false;
@@ -745,26 +1876,460 @@ bool canvas_set_image(HWND hwnd, const WCHAR* path)
 	priv->tx = 0;
 	priv->ty = 0;
 
-	if (!_canvas_reload(priv))
+	uint64_t start = trace_begin();
+	bool loaded = _canvas_promote(priv) || _canvas_map_disk(priv) ||
+		_canvas_reload(priv, false, true);
+	trace_end(TRACE_LOAD, start, 0, 0);
+	_canvas_compare_changed(priv);
+	if (!loaded)
+		return false;
+	if (priv->reduced_level)
+		priv->zoom = -_canvas_fit_level(priv, priv->full_width, priv->full_height);
+	_canvas_clamp_xform(hwnd);
+	return true;
+}
+
+// bakes a frame read into levels[0], and minifies it into the levels not
+// read from a texture's mips
+static canvas_frame_t* _canvas_frame_finish(canvas_frame_t* frame)
+{
+	canvas_level_t* levels = frame->levels;
+	frame->have_stats = image_stats_compute((const uint32_t*)levels[0].bits,
+		levels[0].width, levels[0].height, false, &frame->stats);
+	_bake_bg_sse2(&levels[0], CANVAS_BG_COLOR);
+	if (!_canvas_downsize(levels, CANVAS_BG_COLOR)) {
+		canvas_frame_free(frame);
+		return NULL;
+	}
+	return frame;
+}
+
+canvas_frame_t* canvas_frame_load(const WCHAR* path)
+{
+	canvas_frame_t* frame = (canvas_frame_t*)calloc(1, sizeof(canvas_frame_t));
+	if (!frame)
+		return NULL;
+
+	canvas_level_t* levels = frame->levels;
+	texture_t* texture = texture_file_open(path);
+	bool read = texture ?
+		texture_file_read(texture, 0, 0, &levels[0].hbitmap, &levels[0].bits,
+			&levels[0].width, &levels[0].height) :
+		canvas_read_image(path, &levels[0].hbitmap, &levels[0].bits,
+			&levels[0].width, &levels[0].height);
+	if (read && texture)
+		_canvas_read_mips(texture, 0, levels, CANVAS_BG_COLOR);
+	texture_free(texture);
+	if (!read) {
+		free(frame);
+		return NULL;
+	}
+	return _canvas_frame_finish(frame);
+}
+
+canvas_frame_t* canvas_frame_load_index(image_frames_t* frames, int index)
+{
+	canvas_frame_t* frame = (canvas_frame_t*)calloc(1, sizeof(canvas_frame_t));
+	if (!frame)
+		return NULL;
+
+	canvas_level_t* levels = frame->levels;
+	if (!image_frames_read(frames, index, &levels[0].hbitmap, &levels[0].bits,
+		&levels[0].width, &levels[0].height)) {
+		free(frame);
+		return NULL;
+	}
+	const texture_t* texture = image_frames_texture(frames);
+	if (texture)
+		_canvas_read_mips(texture, index, levels, CANVAS_BG_COLOR);
+	return _canvas_frame_finish(frame);
+}
+
+void canvas_frame_free(canvas_frame_t* frame)
+{
+	if (!frame)
+		return;
+	_canvas_free_levels(frame->levels);
+	free(frame);
+}
+
+bool canvas_show_frame(HWND hwnd, canvas_frame_t* frame)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv || !frame)
 		return false;
+
+	// the view stays put through a sequence of the same size
+	bool same_size = priv->levels[0].hbitmap &&
+		priv->levels[0].width == frame->levels[0].width &&
+		priv->levels[0].height == frame->levels[0].height;
+	_canvas_release_image(hwnd);
+	memcpy(priv->levels, frame->levels, sizeof(priv->levels));
+	priv->stats = frame->stats;
+	priv->have_stats = frame->have_stats;
+	free(frame);
+	_canvas_compare_changed(priv);
+
+	if (!same_size) {
+		priv->zoom = 0;
+		priv->tx = 0;
+		priv->ty = 0;
+	}
 	_canvas_clamp_xform(hwnd);
+	InvalidateRect(hwnd, NULL, FALSE);
+	return true;
+}
+
+// levels of the given size, for a live frame to be converted into
+static bool _canvas_create_live_levels(canvas_data_t* priv, int width, int height)
+{
+	for (int i = 0; i <= CANVAS_NUM_MINIFY_LEVELS; i++) {
+		canvas_level_t* level = &priv->levels[i];
+		if (!_canvas_create_dib(width, height, NULL, 0, &level->hbitmap, &level->bits)) {
+			_canvas_free_levels(priv->levels);
+			return false;
+		}
+		level->width = width;
+		level->height = height;
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	}
+	return true;
+}
+
+bool canvas_show_live_frame(HWND hwnd, live_feed_t* feed, live_feed_frame_t* out_frame)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv || !feed)
+		return false;
+
+	uint64_t start = trace_begin();
+	live_feed_frame_t frame;
+	bool resized = false;
+	for (int attempt = 0; ; attempt++) {
+		// the producer lapping every read means it's far faster than this
+		// can convert. wait for the next signal.
+		if (attempt == 4 || !live_feed_latest(feed, &frame))
+			return false;
+		if (priv->live && frame.frame == priv->live_frame)
+			return false;
+
+		if (!priv->live || priv->levels[0].width != frame.width ||
+			priv->levels[0].height != frame.height) {
+			_canvas_release_image(hwnd);
+			if (!_canvas_create_live_levels(priv, frame.width, frame.height))
+				return false;
+			priv->live = true;
+			resized = true;
+		}
+		if (live_feed_read_bgra(feed, &frame, (uint32_t*)priv->levels[0].bits))
+			break;
+	}
+	uint64_t num_pixels = (uint64_t)frame.width * frame.height;
+	trace_end(TRACE_COPY, start, num_pixels * 4 * 2, num_pixels);
+	priv->have_stats = image_stats_compute((const uint32_t*)priv->levels[0].bits,
+		frame.width, frame.height, false, &priv->stats);
+
+	// the same as a reload, but into the levels already there
+	start = trace_begin();
+	_bake_bg_sse2(&priv->levels[0], priv->bg_color);
+	trace_end(TRACE_BAKE, start, num_pixels * 4 * 2, num_pixels);
+	start = trace_begin();
+	for (int i = 1; i <= CANVAS_NUM_MINIFY_LEVELS; i++) {
+		canvas_level_t* src = &priv->levels[i - 1];
+		canvas_level_t* dest = &priv->levels[i];
+		pixel_downsize_sse2((uint32_t*)src->bits, src->width, src->height,
+			(uint32_t*)dest->bits, dest->width, dest->height, priv->bg_color);
+	}
+	trace_end(TRACE_DOWNSIZE, start, num_pixels * 4 * 5 / 3, num_pixels * 4 / 3);
+	priv->live_frame = frame.frame;
+	_canvas_compare_changed(priv);
+	_canvas_region_stats_changed(priv, NULL);
+
+	if (resized) {
+		priv->zoom = 0;
+		priv->tx = 0;
+		priv->ty = 0;
+		_canvas_clamp_xform(hwnd);
+	}
+	InvalidateRect(hwnd, NULL, FALSE);
+	if (out_frame)
+		*out_frame = frame;
 	return true;
 }
 
+// repaints the area changed in place by a reload or history step, and
+// outlines it for a moment.
+static void _canvas_invalidate_dirty(HWND hwnd)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+
+	// only the changed area needs paint, plus the old outline if one is
+	// still showing.
+	RECT client_rect = _canvas_image_to_client_rect(priv, &priv->dirty_rect);
+	InflateRect(&client_rect, 1, 1);	// for the outline
+	InvalidateRect(hwnd, &client_rect, FALSE);
+	if (priv->flashing)
+		InvalidateRect(hwnd, NULL, FALSE);
+	priv->flashing = true;
+	SetTimer(hwnd, CANVAS_TIMER_FLASH, CANVAS_FLASH_MS, NULL);
+}
+
 bool canvas_reload_image(HWND hwnd)
 {
 	canvas_data_t* priv = _canvas_get_private(hwnd);
 	if (!priv)
 		return false;
 
+	uint64_t start = trace_begin();
+	bool loaded = _canvas_reload(priv, true, true);
+	trace_end(TRACE_LOAD, start, 0, 0);
+	_canvas_compare_changed(priv);
+	if (!loaded) {
+		InvalidateRect(hwnd, NULL, FALSE);
+		return false;
+	}
+
+	if (priv->dirty_valid)
+		_canvas_invalidate_dirty(hwnd);
+	else
+		InvalidateRect(hwnd, NULL, FALSE);
+	_canvas_clamp_xform(hwnd);
+	return true;
+}
+
+bool canvas_history_step(HWND hwnd, int steps)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv || !priv->history)
+		return false;
+
+	int position = priv->history_pos + steps;
+	int count = reload_history_count(priv->history);
+	if (position < 0)
+		position = 0;
+	if (position > count)
+		position = count;
+	if (position == priv->history_pos)
+		return false;
+
+	bool seeked = _canvas_history_seek(priv, position);
+	_canvas_compare_changed(priv);
+	if (!seeked) {
+		InvalidateRect(hwnd, NULL, FALSE);
+		return false;
+	}
+	priv->have_stats = false;
+	if (priv->dirty_valid)
+		_canvas_invalidate_dirty(hwnd);
+	return true;
+}
+
+bool canvas_get_stats(HWND hwnd, image_stats_t* out_stats)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv || !out_stats)
+		return false;
+	_canvas_baked_stats(priv);
+	if (!priv->have_stats)
+		return false;
+	*out_stats = priv->stats;
+	return true;
+}
+
+bool canvas_get_selection(HWND hwnd, RECT* out_rect)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv || !priv->have_selection)
+		return false;
+	*out_rect = priv->selection;
+	return true;
+}
+
+void canvas_clear_selection(HWND hwnd)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv || !priv->have_selection)
+		return;
+	priv->have_selection = false;
 	InvalidateRect(hwnd, NULL, FALSE);
+	_canvas_send_notify(hwnd, CANVAS_NM_SELECTION);
+}
 
-	if (!_canvas_reload(priv))
+bool canvas_get_selection_stats(HWND hwnd, canvas_selection_stats_t* out_stats)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv || !priv->have_selection || !priv->levels[0].bits || priv->load)
 		return false;
-	_canvas_clamp_xform(hwnd);
+	if (!priv->region_stats) {
+		priv->region_stats = region_stats_new();
+		if (!priv->region_stats)
+			return false;
+	}
+
+	int level_index = _canvas_region_stats_level(priv);
+	canvas_level_t* level = &priv->levels[level_index];
+	int round = (1 << level_index) - 1;
+	RECT rect;
+	rect.left = priv->selection.left >> level_index;
+	rect.top = priv->selection.top >> level_index;
+	rect.right = (priv->selection.right + round) >> level_index;
+	rect.bottom = (priv->selection.bottom + round) >> level_index;
+	out_stats->level = level_index;
+	return region_stats_get(priv->region_stats, (const uint32_t*)level->bits,
+		level->width, level->height, &rect, &out_stats->stats);
+}
+
+bool canvas_get_cache_info(HWND hwnd, canvas_cache_info_t* info)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv || !info)
+		return false;
+	*info = priv->cache_info;
+	uint64_t raw_bytes = 0, compressed_bytes = 0;
+	image_cache_get_totals(&info->cached_images, &raw_bytes, &compressed_bytes);
+	info->cached_raw_bytes = raw_bytes;
+	info->cached_compressed_bytes = compressed_bytes;
+	return true;
+}
+
+ULONGLONG canvas_get_resident_bytes(HWND hwnd)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv)
+		return 0;
+
+	ULONGLONG bytes = 0;
+	// mapped levels are paged in and out by the system
+	if (!priv->disk) {
+		for (int i = 0; i <= CANVAS_NUM_MINIFY_LEVELS; i++)
+			bytes += (ULONGLONG)priv->levels[i].width * priv->levels[i].height * 4;
+	}
+	if (priv->history)
+		bytes += reload_history_bytes(priv->history);
+	if (priv->compare) {
+		for (int i = 0; i <= CANVAS_NUM_MINIFY_LEVELS; i++)
+			bytes += (ULONGLONG)priv->compare_levels[i].width * priv->compare_levels[i].height * 4;
+		bytes += compare_get_resident_bytes(priv->compare);
+	}
+	if (priv->region_stats)
+		bytes += region_stats_get_resident_bytes(priv->region_stats);
+	if (priv->roi)
+		bytes += roi_view_resident_bytes(priv->roi);
+
+	int num_cached = 0;
+	uint64_t cached_raw = 0, cached_compressed = 0;
+	image_cache_get_totals(&num_cached, &cached_raw, &cached_compressed);
+	return bytes + cached_compressed;
+}
+
+bool canvas_get_load_times(HWND hwnd, canvas_load_times_t* times)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv || !times)
+		return false;
+	*times = priv->load_times;
+	return true;
+}
+
+bool canvas_is_loading(HWND hwnd)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	return priv && priv->load;
+}
+
+bool canvas_get_history(HWND hwnd, int* position, int* count)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv || !priv->history || !position || !count)
+		return false;
+	*position = priv->history_pos;
+	*count = reload_history_count(priv->history);
+	return *count > 0;
+}
+
+bool canvas_set_compare(HWND hwnd, const WCHAR* path)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv)
+		return false;
+
+	canvas_frame_t* frame = NULL;
+	if (path) {
+		frame = canvas_frame_load(path);
+		if (!frame)
+			return false;
+		if (!priv->compare && !(priv->compare = compare_new())) {
+			canvas_frame_free(frame);
+			return false;
+		}
+	}
+	_canvas_free_levels(priv->compare_levels);
+	if (frame) {
+		memcpy(priv->compare_levels, frame->levels, sizeof(priv->compare_levels));
+		free(frame);
+		compare_invalidate(priv->compare);
+		priv->compare_view = CANVAS_COMPARE_SPLIT;
+		priv->split_x = -1;
+	}
+	else {
+		compare_free(priv->compare);
+		priv->compare = NULL;
+	}
+	InvalidateRect(hwnd, NULL, FALSE);
+	return true;
+}
+
+bool canvas_is_comparing(HWND hwnd)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	return priv && priv->compare;
+}
+
+void canvas_set_compare_view(HWND hwnd, canvas_compare_view_t view)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv || !priv->compare || view < 0 || view >= CANVAS_COMPARE_NUM_VIEWS)
+		return;
+	priv->compare_view = view;
+	InvalidateRect(hwnd, NULL, FALSE);
+}
+
+canvas_compare_view_t canvas_get_compare_view(HWND hwnd)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	return priv ? priv->compare_view : CANVAS_COMPARE_SPLIT;
+}
+
+bool canvas_get_compare_pixel(HWND hwnd, const POINT* image_pos, DWORD* out_a,
+	DWORD* out_b)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv || !priv->compare || !priv->levels[0].bits || priv->load)
+		return false;
+	canvas_level_t* a = &priv->levels[0];
+	canvas_level_t* b = &priv->compare_levels[0];
+	int x = image_pos->x;
+	int y = image_pos->y;
+	if (x < 0 || y < 0 || x >= a->width || y >= a->height || x >= b->width || y >= b->height)
+		return false;
+	*out_a = ((const DWORD*)a->bits)[(size_t)y * a->width + x];
+	*out_b = ((const DWORD*)b->bits)[(size_t)y * b->width + x];
 	return true;
 }
 
+bool canvas_get_compare_stats(HWND hwnd, compare_stats_t* out_stats)
+{
+	canvas_data_t* priv = _canvas_get_private(hwnd);
+	if (!priv || !priv->compare || !priv->levels[0].bits || priv->load)
+		return false;
+	canvas_level_t* a = &priv->levels[0];
+	canvas_level_t* b = &priv->compare_levels[0];
+	render_level_t level_a = { (uint32_t*)a->bits, a->width, a->height };
+	render_level_t level_b = { (uint32_t*)b->bits, b->width, b->height };
+	return compare_get_stats(priv->compare, &level_a, &level_b, out_stats);
+}
+
 ATOM canvas_init_class(HINSTANCE hinstance)
 {
 	WNDCLASSW wndclass;
@@ -1,5 +1,11 @@
 #pragma once
 
+#include "compare.h"
+#include "image_frames.h"
+#include "image_stats.h"
+#include "live_feed.h"
+#include "region_stats.h"
+
 #define CANVAS_CLASS_NAME L"canvas"
 
 // WM_NOTIFY message codes
@@ -7,6 +13,9 @@
 #define CANVAS_NM_MOUSEMOVE		2
 #define CANVAS_NM_PREV			3
 #define CANVAS_NM_NEXT			4
+#define CANVAS_NM_PAINTED		5	// only while tracing, see trace.h
+#define CANVAS_NM_SELECTION		6	// made, changed or cleared
+#define CANVAS_NM_LOADED		7	// a load in bands finished, see canvas_is_loading()
 
 // parameter for CANVAS_NM_MOUSEMOVE
 typedef struct {
@@ -14,10 +23,111 @@ typedef struct {
 	POINT pos;	// client coords
 } canvas_nm_mousemove_t;
 
+// how the current image was loaded, and the state of the inactive image
+// cache. see image_cache.h.
+typedef struct {
+	bool from_cache;
+	ULONGLONG raw_bytes;
+	ULONGLONG compressed_bytes;
+	double decompress_seconds;
+
+	// levels are mapped from the disk cache. see disk_cache.h.
+	bool from_disk_cache;
+
+	int cached_images;
+	ULONGLONG cached_raw_bytes;
+	ULONGLONG cached_compressed_bytes;
+} canvas_cache_info_t;
+
+// how long each stage of the last load or reload took
+typedef struct {
+	bool incremental;	// updated in place, rather than rebuilt
+	double decode_seconds;
+	double bake_seconds;		// full loads only
+	double downsize_seconds;	// full loads only
+	double update_seconds;		// incremental only: compare, bake, downsize
+	double stats_seconds;		// see image_stats.h
+	// loads in bands only, from the start of the decode. 0 if there
+	// was no preview.
+	double preview_seconds;
+	double first_rows_seconds;
+} canvas_load_times_t;
+
 ATOM canvas_init_class(HINSTANCE inst);
 
 bool canvas_set_image(HWND hwnd, const WCHAR* path);
 bool canvas_reload_image(HWND hwnd);
+// a decoded, baked and minified image, ready to show. loading is safe on
+// any thread, so frames can be decoded ahead for playback.
+typedef struct canvas_frame_t canvas_frame_t;
+canvas_frame_t* canvas_frame_load(const WCHAR* path);
+// one frame of an animation or page of a multi-page image
+canvas_frame_t* canvas_frame_load_index(image_frames_t* frames, int index);
+void canvas_frame_free(canvas_frame_t* frame);
+// shows frame in place of the image, and frees it. the image shown is not
+// reloaded on changes; set an image again for that.
+bool canvas_show_frame(HWND hwnd, canvas_frame_t* frame);
+
+// shows the newest frame of a live feed in place of the image, if it is
+// newer than the one showing. the levels are reused while the size holds.
+bool canvas_show_live_frame(HWND hwnd, live_feed_t* feed, live_feed_frame_t* out_frame);
 int canvas_get_zoom(HWND hwnd);
 bool canvas_get_image_size(HWND hwnd, UINT* width, UINT* height);
 POINT canvas_client_to_image(HWND hwnd, const POINT* client_pos);
+
+// steps through the history of auto-reloaded versions. positive steps go
+// back to older versions.
+bool canvas_history_step(HWND hwnd, int steps);
+// position is how many versions back from the newest is showing, and count
+// is how many older versions are kept.
+bool canvas_get_history(HWND hwnd, int* position, int* count);
+bool canvas_get_cache_info(HWND hwnd, canvas_cache_info_t* info);
+bool canvas_get_load_times(HWND hwnd, canvas_load_times_t* times);
+// large images show while they load in bands, coarse or partly, on a
+// worker.  canvas_set_image() returns once it's started, and
+// CANVAS_NM_LOADED tells when it's done, for the statistics and the rest
+// that wait for it.  the load times are of the last finished load.
+bool canvas_is_loading(HWND hwnd);
+// the histograms and statistics of the image showing, made as it loads
+bool canvas_get_stats(HWND hwnd, image_stats_t* out_stats);
+// The selection: a rectangle of the image, dragged out with Shift and the
+// left mouse button, kept as images change.  Its statistics come from
+// summed-area tables, see region_stats.h, which take constant time
+// however large it is.
+typedef struct {
+	region_stats_t stats;
+	// the level they were taken from. past 0 the image was too large for
+	// the tables, and they are of the minified pixels.
+	int level;
+} canvas_selection_stats_t;
+
+// in level 0 pixels
+bool canvas_get_selection(HWND hwnd, RECT* out_rect);
+void canvas_clear_selection(HWND hwnd);
+bool canvas_get_selection_stats(HWND hwnd, canvas_selection_stats_t* out_stats);
+// pixel memory held: levels, history, compare, selection tables and the
+// inactive image cache
+ULONGLONG canvas_get_resident_bytes(HWND hwnd);
+
+// Compare mode: a second image, B, shown with the same zoom and pan as
+// the image, A, which keeps loading, reloading and playing as usual.  B
+// is loaded once and not reloaded.  The right mouse button drags the split.
+typedef enum {
+	CANVAS_COMPARE_SPLIT,		// A left of the split, B right of it
+	CANVAS_COMPARE_A,
+	CANVAS_COMPARE_B,
+	CANVAS_COMPARE_DIFF,		// see compare.h
+	CANVAS_COMPARE_HEATMAP,
+	CANVAS_COMPARE_NUM_VIEWS,
+} canvas_compare_view_t;
+
+// starts comparing against path, in the split view. NULL stops.
+bool canvas_set_compare(HWND hwnd, const WCHAR* path);
+bool canvas_is_comparing(HWND hwnd);
+void canvas_set_compare_view(HWND hwnd, canvas_compare_view_t view);
+canvas_compare_view_t canvas_get_compare_view(HWND hwnd);
+// the pixels of A and B at a level 0 position. false outside either.
+bool canvas_get_compare_pixel(HWND hwnd, const POINT* image_pos, DWORD* out_a,
+	DWORD* out_b);
+// of level 0. false unless A and B are the same size.
+bool canvas_get_compare_stats(HWND hwnd, compare_stats_t* out_stats);
@@ -0,0 +1,242 @@
+#include "dev_image_viewer.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compare.h"
+#include "parallel.h"
+#include "pixel_kernels.h"
+#include "trace.h"
+
+#define COMPARE_NUM_LEVELS (RENDER_NUM_MINIFY_LEVELS + 1)
+
+// rows per parallel_for() item of the statistics
+#define COMPARE_STATS_ROWS_PER_ITEM 64
+
+typedef struct {
+	HBITMAP hbitmap;
+	uint32_t* bits;		// owned by hbitmap
+	int width;
+	int height;
+	int tiles_x;
+	int tiles_y;
+	bool* done;			// per tile
+} compare_level_t;
+
+struct compare_t {
+	compare_level_t levels[COMPARE_NUM_LEVELS];
+	compare_kind_t kind;
+	bool have_stats;
+	compare_stats_t stats;
+};
+
+typedef struct {
+	compare_kind_t kind;
+	compare_level_t* level;
+	const render_level_t* a;
+	const render_level_t* b;
+	const int* tiles;
+} compare_tile_job_t;
+
+typedef struct {
+	const render_level_t* a;
+	const render_level_t* b;
+	pixel_diff_stats_t* items;
+} compare_stats_job_t;
+
+compare_t* compare_new()
+{
+	return (compare_t*)calloc(1, sizeof(compare_t));
+}
+
+static void _free_level(compare_level_t* level)
+{
+	if (level->hbitmap)
+		DeleteObject(level->hbitmap);
+	free(level->done);
+	ZeroMemory(level, sizeof(*level));
+}
+
+void compare_free(compare_t* compare)
+{
+	if (!compare)
+		return;
+	for (int i = 0; i < COMPARE_NUM_LEVELS; i++)
+		_free_level(&compare->levels[i]);
+	free(compare);
+}
+
+// the DIB sections are kept for the next diff, if the size holds
+static void _clear_tiles(compare_t* compare)
+{
+	for (int i = 0; i < COMPARE_NUM_LEVELS; i++) {
+		compare_level_t* level = &compare->levels[i];
+		if (level->done)
+			ZeroMemory(level->done, (size_t)level->tiles_x * level->tiles_y * sizeof(bool));
+	}
+}
+
+void compare_invalidate(compare_t* compare)
+{
+	_clear_tiles(compare);
+	compare->have_stats = false;
+}
+
+static bool _create_level(compare_level_t* level, int width, int height)
+{
+	_free_level(level);
+	BITMAPV5HEADER bmi;
+	init_bitmap_header(&bmi, width, height);
+	HDC hdc = GetDC(NULL);
+	void* bits = NULL;
+	HBITMAP hbitmap = CreateDIBSection(hdc, (BITMAPINFO*)&bmi, DIB_RGB_COLORS,
+		&bits, NULL, 0);
+	ReleaseDC(NULL, hdc);
+	if (!hbitmap)
+		return false;
+
+	level->tiles_x = (width + COMPARE_TILE_SIZE - 1) / COMPARE_TILE_SIZE;
+	level->tiles_y = (height + COMPARE_TILE_SIZE - 1) / COMPARE_TILE_SIZE;
+	level->done = (bool*)calloc((size_t)level->tiles_x * level->tiles_y, sizeof(bool));
+	if (!level->done) {
+		DeleteObject(hbitmap);
+		return false;
+	}
+	level->hbitmap = hbitmap;
+	level->bits = (uint32_t*)bits;
+	level->width = width;
+	level->height = height;
+	return true;
+}
+
+static void _diff_tile(void* ctx, int index)
+{
+	compare_tile_job_t* job = (compare_tile_job_t*)ctx;
+	compare_level_t* level = job->level;
+	int tile = job->tiles[index];
+	int x0 = tile % level->tiles_x * COMPARE_TILE_SIZE;
+	int y0 = tile / level->tiles_x * COMPARE_TILE_SIZE;
+	int width = min(COMPARE_TILE_SIZE, level->width - x0);
+	int y1 = min(y0 + COMPARE_TILE_SIZE, level->height);
+	for (int y = y0; y < y1; y++) {
+		size_t offset = (size_t)y * level->width + x0;
+		(job->kind == COMPARE_HEATMAP ? pixel_heatmap_sse2 : pixel_absdiff_sse2)(
+			level->bits + offset, job->a->pixels + offset, job->b->pixels + offset, width);
+	}
+}
+
+HBITMAP compare_get_level(compare_t* compare, compare_kind_t kind, int level_index,
+	const render_level_t* a, const render_level_t* b, const RECT* rect)
+{
+	if (level_index < 0 || level_index >= COMPARE_NUM_LEVELS ||
+		a->width != b->width || a->height != b->height)
+		return NULL;
+	if (kind != compare->kind) {
+		compare->kind = kind;
+		_clear_tiles(compare);
+	}
+	compare_level_t* level = &compare->levels[level_index];
+	if ((level->width != a->width || level->height != a->height || !level->hbitmap) &&
+		!_create_level(level, a->width, a->height))
+		return NULL;
+
+	int tx0 = max(rect->left, 0) / COMPARE_TILE_SIZE;
+	int ty0 = max(rect->top, 0) / COMPARE_TILE_SIZE;
+	int tx1 = min((rect->right + COMPARE_TILE_SIZE - 1) / COMPARE_TILE_SIZE, level->tiles_x);
+	int ty1 = min((rect->bottom + COMPARE_TILE_SIZE - 1) / COMPARE_TILE_SIZE, level->tiles_y);
+	if (tx1 <= tx0 || ty1 <= ty0)
+		return level->hbitmap;
+	int* tiles = (int*)malloc((size_t)(tx1 - tx0) * (ty1 - ty0) * sizeof(int));
+	if (!tiles)
+		return NULL;
+	int num_tiles = 0;
+	for (int ty = ty0; ty < ty1; ty++) {
+		for (int tx = tx0; tx < tx1; tx++) {
+			int tile = ty * level->tiles_x + tx;
+			if (!level->done[tile])
+				tiles[num_tiles++] = tile;
+		}
+	}
+
+	if (num_tiles) {
+		uint64_t start = trace_begin();
+		compare_tile_job_t job;
+		job.kind = kind;
+		job.level = level;
+		job.a = a;
+		job.b = b;
+		job.tiles = tiles;
+		parallel_for(num_tiles, _diff_tile, &job);
+		for (int i = 0; i < num_tiles; i++)
+			level->done[tiles[i]] = true;
+		uint64_t num_pixels = (uint64_t)num_tiles * COMPARE_TILE_SIZE * COMPARE_TILE_SIZE;
+		trace_end(TRACE_DIFF, start, num_pixels * 12, num_pixels);
+	}
+	free(tiles);
+	return level->hbitmap;
+}
+
+static void _stats_item(void* ctx, int index)
+{
+	compare_stats_job_t* job = (compare_stats_job_t*)ctx;
+	int y0 = index * COMPARE_STATS_ROWS_PER_ITEM;
+	int y1 = min(y0 + COMPARE_STATS_ROWS_PER_ITEM, job->a->height);
+	// rows at a time, so no count passed to the kernel overflows an int
+	for (int y = y0; y < y1; y++) {
+		size_t offset = (size_t)y * job->a->width;
+		pixel_diff_stats_sse2(job->a->pixels + offset, job->b->pixels + offset,
+			job->a->width, &job->items[index]);
+	}
+}
+
+bool compare_get_stats(compare_t* compare, const render_level_t* a,
+	const render_level_t* b, compare_stats_t* out_stats)
+{
+	if (a->width != b->width || a->height != b->height)
+		return false;
+	if (compare->have_stats) {
+		*out_stats = compare->stats;
+		return true;
+	}
+
+	int num_items = (a->height + COMPARE_STATS_ROWS_PER_ITEM - 1) / COMPARE_STATS_ROWS_PER_ITEM;
+	compare_stats_job_t job;
+	job.a = a;
+	job.b = b;
+	job.items = (pixel_diff_stats_t*)calloc(num_items ? num_items : 1, sizeof(pixel_diff_stats_t));
+	if (!job.items)
+		return false;
+	uint64_t start = trace_begin();
+	parallel_for(num_items, _stats_item, &job);
+	pixel_diff_stats_t total;
+	ZeroMemory(&total, sizeof(total));
+	for (int i = 0; i < num_items; i++) {
+		total.sum_squares += job.items[i].sum_squares;
+		total.num_differing += job.items[i].num_differing;
+		total.max_diff = max(total.max_diff, job.items[i].max_diff);
+	}
+	free(job.items);
+	uint64_t num_pixels = (uint64_t)a->width * a->height;
+	trace_end(TRACE_DIFF, start, num_pixels * 8, num_pixels);
+
+	compare_stats_t* stats = &compare->stats;
+	stats->num_differing = total.num_differing;
+	stats->max_error = total.max_diff;
+	stats->psnr = 0;
+	if (total.sum_squares) {
+		double mse = (double)total.sum_squares / ((double)num_pixels * 3);
+		stats->psnr = 10.0 * log10(255.0 * 255.0 / mse);
+	}
+	compare->have_stats = true;
+	*out_stats = *stats;
+	return true;
+}
+
+uint64_t compare_get_resident_bytes(const compare_t* compare)
+{
+	uint64_t bytes = 0;
+	for (int i = 0; i < COMPARE_NUM_LEVELS; i++)
+		bytes += (uint64_t)compare->levels[i].width * compare->levels[i].height * 4;
+	return bytes;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "render.h"
+
+// The difference between the two images the canvas compares, A and B, at
+// each of their minified levels.  A level's diff is made a tile at a time
+// as tiles come into view, with the SIMD kernels in pixel_kernels.h, and
+// kept until either image changes, so panning around only diffs what
+// hasn't been seen yet.  The statistics are of all of level 0, spread over
+// parallel_for().  Both images must be the same size.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// diff tiles are square, in the level's own pixels
+#define COMPARE_TILE_SIZE 128
+
+typedef enum {
+	COMPARE_ABSDIFF,	// |A - B| per channel
+	COMPARE_HEATMAP,	// the largest channel difference, amplified
+} compare_kind_t;
+
+typedef struct {
+	uint64_t num_differing;	// pixels
+	int max_error;			// in any channel
+	double psnr;			// in dB over RGB. only when pixels differ.
+} compare_stats_t;
+
+typedef struct compare_t compare_t;
+
+compare_t* compare_new();
+void compare_free(compare_t* compare);
+// forgets the diffs and statistics, after A or B changed
+void compare_invalidate(compare_t* compare);
+
+// the diff of one level, of which a and b are the pixels, with at least
+// the tiles touching rect made.  the DIB section stays owned by compare.
+// NULL on failure.
+HBITMAP compare_get_level(compare_t* compare, compare_kind_t kind, int level,
+	const render_level_t* a, const render_level_t* b, const RECT* rect);
+// made on the first call after a change
+bool compare_get_stats(compare_t* compare, const render_level_t* a,
+	const render_level_t* b, compare_stats_t* out_stats);
+// pixel memory of the diffs made
+uint64_t compare_get_resident_bytes(const compare_t* compare);
+
+#ifdef __cplusplus
+}
+#endif
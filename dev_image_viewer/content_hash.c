@@ -0,0 +1,265 @@
+#include "dev_image_viewer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "content_hash.h"
+
+#define HASH_FILE_CHUNK_SIZE (1024 * 1024)
+// files whose hashes are remembered
+#define HASH_FILE_MEMO_SIZE 4
+
+// a file's hash, by path and stamp. while hashing is set, the file is
+// being read for it, and others asking wait for that rather than read it
+// again.
+typedef struct {
+	WCHAR* path;
+	file_stamp_t stamp;
+	uint64_t hash;
+	uint64_t size;
+	bool hashing;
+	uint64_t last_used;
+} hash_memo_t;
+
+static hash_memo_t hash_memo[HASH_FILE_MEMO_SIZE];
+static uint64_t hash_memo_uses = 0;
+static SRWLOCK hash_memo_lock = SRWLOCK_INIT;
+static CONDITION_VARIABLE hash_memo_done = CONDITION_VARIABLE_INIT;
+
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static uint64_t _rotate_left64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t _read64(const uint8_t* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t _read32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint64_t _round(uint64_t acc, uint64_t input)
+{
+	acc += input * PRIME64_2;
+	acc = _rotate_left64(acc, 31);
+	return acc * PRIME64_1;
+}
+
+static uint64_t _merge_round(uint64_t acc, uint64_t val)
+{
+	acc ^= _round(0, val);
+	return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t hash64(const void* data, size_t size, uint64_t seed)
+{
+	const uint8_t* p = (const uint8_t*)data;
+	const uint8_t* end = p + size;
+	uint64_t h;
+
+	if (size >= 32) {
+		// four independent lanes, so the multiplies can overlap
+		uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+		uint64_t v2 = seed + PRIME64_2;
+		uint64_t v3 = seed;
+		uint64_t v4 = seed - PRIME64_1;
+		const uint8_t* limit = end - 32;
+		do {
+			v1 = _round(v1, _read64(p));
+			v2 = _round(v2, _read64(p + 8));
+			v3 = _round(v3, _read64(p + 16));
+			v4 = _round(v4, _read64(p + 24));
+			p += 32;
+		} while (p <= limit);
+
+		h = _rotate_left64(v1, 1) + _rotate_left64(v2, 7) + _rotate_left64(v3, 12) + _rotate_left64(v4, 18);
+		h = _merge_round(h, v1);
+		h = _merge_round(h, v2);
+		h = _merge_round(h, v3);
+		h = _merge_round(h, v4);
+	}
+	else {
+		h = seed + PRIME64_5;
+	}
+
+	h += (uint64_t)size;
+
+	// tail
+	while (p + 8 <= end) {
+		h ^= _round(0, _read64(p));
+		h = _rotate_left64(h, 27) * PRIME64_1 + PRIME64_4;
+		p += 8;
+	}
+	if (p + 4 <= end) {
+		h ^= (uint64_t)_read32(p) * PRIME64_1;
+		h = _rotate_left64(h, 23) * PRIME64_2 + PRIME64_3;
+		p += 4;
+	}
+	while (p < end) {
+		h ^= (*p) * PRIME64_5;
+		h = _rotate_left64(h, 11) * PRIME64_1;
+		p++;
+	}
+
+	// avalanche
+	h ^= h >> 33;
+	h *= PRIME64_2;
+	h ^= h >> 29;
+	h *= PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+bool get_file_stamp(const WCHAR* path, file_stamp_t* stamp)
+{
+	WIN32_FILE_ATTRIBUTE_DATA info = { 0 };
+	bool ok = GetFileAttributesExW(path, GetFileExInfoStandard, &info) != 0;
+	stamp->write_time = info.ftLastWriteTime;
+	stamp->size = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	return ok;
+}
+
+bool file_stamps_equal(const file_stamp_t* a, const file_stamp_t* b)
+{
+	return a->write_time.dwHighDateTime == b->write_time.dwHighDateTime &&
+		a->write_time.dwLowDateTime == b->write_time.dwLowDateTime &&
+		a->size == b->size;
+}
+
+static bool _hash_file(const WCHAR* path, uint64_t* out_hash, uint64_t* out_size)
+{
+	HANDLE file = CreateFileW(path, GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	uint8_t* buffer = (uint8_t*)malloc(HASH_FILE_CHUNK_SIZE);
+	if (!buffer) {
+		CloseHandle(file);
+		return false;
+	}
+
+	// each chunk is hashed with the previous chunk's hash as the seed.
+	// not the same value as a one-shot XXH64, but just as good for
+	// detecting changes.
+	uint64_t hash = 0;
+	uint64_t size = 0;
+	bool ok = true;
+	for (;;) {
+		DWORD bytes_read = 0;
+		if (!ReadFile(file, buffer, HASH_FILE_CHUNK_SIZE, &bytes_read, NULL)) {
+			ok = false;
+			break;
+		}
+		if (!bytes_read)
+			break;
+		hash = hash64(buffer, bytes_read, hash);
+		size += bytes_read;
+	}
+
+	free(buffer);
+	CloseHandle(file);
+
+	if (!ok)
+		return false;
+	*out_hash = hash;
+	if (out_size)
+		*out_size = size;
+	return true;
+}
+
+// paths differing only in case are the same file
+static hash_memo_t* _memo_find(const WCHAR* path, const file_stamp_t* stamp)
+{
+	for (int i = 0; i < HASH_FILE_MEMO_SIZE; i++) {
+		hash_memo_t* memo = &hash_memo[i];
+		if (memo->path && !_wcsicmp(memo->path, path) &&
+			file_stamps_equal(&memo->stamp, stamp))
+			return memo;
+	}
+	return NULL;
+}
+
+// the least recently used entry not being hashed, emptied for path, or NULL
+static hash_memo_t* _memo_claim(const WCHAR* path, const file_stamp_t* stamp)
+{
+	hash_memo_t* oldest = NULL;
+	for (int i = 0; i < HASH_FILE_MEMO_SIZE; i++) {
+		hash_memo_t* memo = &hash_memo[i];
+		if (!memo->hashing && (!oldest || memo->last_used < oldest->last_used))
+			oldest = memo;
+	}
+	WCHAR* copy = oldest ? _wcsdup(path) : NULL;
+	if (!copy)
+		return NULL;
+	free(oldest->path);
+	oldest->path = copy;
+	oldest->stamp = *stamp;
+	oldest->hashing = true;
+	return oldest;
+}
+
+bool hash_file(const WCHAR* path, uint64_t* out_hash, uint64_t* out_size)
+{
+	file_stamp_t stamp;
+	if (!get_file_stamp(path, &stamp))
+		return _hash_file(path, out_hash, out_size);
+
+	AcquireSRWLockExclusive(&hash_memo_lock);
+	hash_memo_t* memo;
+	while ((memo = _memo_find(path, &stamp)) && memo->hashing)
+		SleepConditionVariableSRW(&hash_memo_done, &hash_memo_lock, INFINITE, 0);
+	if (memo) {
+		memo->last_used = ++hash_memo_uses;
+		*out_hash = memo->hash;
+		if (out_size)
+			*out_size = memo->size;
+		ReleaseSRWLockExclusive(&hash_memo_lock);
+		return true;
+	}
+	memo = _memo_claim(path, &stamp);
+	ReleaseSRWLockExclusive(&hash_memo_lock);
+
+	uint64_t hash = 0;
+	uint64_t size = 0;
+	bool ok = _hash_file(path, &hash, &size);
+	if (memo) {
+		// a file changed while it was read has no one version to remember
+		file_stamp_t after;
+		bool same = ok && get_file_stamp(path, &after) && file_stamps_equal(&after, &stamp);
+		AcquireSRWLockExclusive(&hash_memo_lock);
+		memo->hashing = false;
+		if (same) {
+			memo->hash = hash;
+			memo->size = size;
+			memo->last_used = ++hash_memo_uses;
+		}
+		else {
+			free(memo->path);
+			memo->path = NULL;
+		}
+		WakeAllConditionVariable(&hash_memo_done);
+		ReleaseSRWLockExclusive(&hash_memo_lock);
+	}
+	if (!ok)
+		return false;
+	*out_hash = hash;
+	if (out_size)
+		*out_size = size;
+	return true;
+}
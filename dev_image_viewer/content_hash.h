@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// identifies a version of a file, without reading it
+typedef struct {
+	FILETIME write_time;
+	uint64_t size;
+} file_stamp_t;
+
+// on failure, the stamp is zeroed and false is returned.
+bool get_file_stamp(const WCHAR* path, file_stamp_t* stamp);
+bool file_stamps_equal(const file_stamp_t* a, const file_stamp_t* b);
+
+// 64-bit non-cryptographic hash (XXH64) of a block of memory.
+uint64_t hash64(const void* data, size_t size, uint64_t seed);
+
+// hashes the entire contents of a file, reading it in large chunks.
+// the file is opened with full sharing, so writers are never blocked.
+// the last few files' hashes are remembered by path and stamp, so a file
+// opened, watched and written to the disk cache is read once for all of
+// them, and a file already being hashed on another thread is waited for.
+// safe to call from several threads at once.
+bool hash_file(const WCHAR* path, uint64_t* out_hash, uint64_t* out_size);
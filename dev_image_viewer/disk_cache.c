@@ -0,0 +1,275 @@
+#include "dev_image_viewer.h"
+
+#include <stdlib.h>
+#include <strsafe.h>
+
+#include "cache_dir.h"
+#include "disk_cache.h"
+
+#define DISK_CACHE_MAGIC 0x43505644	// "DVPC"
+#define DISK_CACHE_VERSION 1
+
+// levels start on allocation granularity boundaries, so each maps on its
+// own.  the header sits in the first block.
+#define DISK_CACHE_ALIGN (64 * 1024)
+
+// the largest single WriteFile()
+#define DISK_CACHE_WRITE_CHUNK (64 * 1024 * 1024)
+
+typedef struct {
+	int32_t width;
+	int32_t height;
+	uint64_t offset;
+} disk_cache_level_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t path_hash;
+
+	// the version of the file the levels came from
+	uint64_t file_size;
+	FILETIME write_time;
+	uint64_t content_hash;
+
+	uint32_t num_levels;
+	uint32_t reserved;
+	disk_cache_level_t levels[DISK_CACHE_MAX_LEVELS];
+} disk_cache_header_t;
+
+struct disk_cache_t {
+	HANDLE file;
+	HANDLE section;
+	disk_cache_header_t header;
+};
+
+// empty while the cache is off
+static WCHAR cache_dir[MAX_PATH] = L"";
+
+static uint64_t _align_up(uint64_t value)
+{
+	return (value + DISK_CACHE_ALIGN - 1) & ~(uint64_t)(DISK_CACHE_ALIGN - 1);
+}
+
+static bool _cache_file_path(const WCHAR* path, WCHAR* out, size_t out_size)
+{
+	return SUCCEEDED(StringCchPrintfW(out, out_size, L"%s\\%016llx.pyr",
+		cache_dir, (unsigned long long)cache_dir_path_hash(path, 0)));
+}
+
+// stops with false once *cancel is set, if cancel isn't NULL
+static bool _write_at(HANDLE file, uint64_t offset, const void* data, uint64_t size,
+	const volatile LONG* cancel)
+{
+	LARGE_INTEGER position;
+	position.QuadPart = (LONGLONG)offset;
+	if (!SetFilePointerEx(file, position, NULL, FILE_BEGIN))
+		return false;
+	const BYTE* p = (const BYTE*)data;
+	while (size) {
+		if (cancel && *cancel)
+			return false;
+		DWORD chunk = (DWORD)min(size, DISK_CACHE_WRITE_CHUNK);
+		DWORD written = 0;
+		if (!WriteFile(file, p, chunk, &written, NULL) || written != chunk)
+			return false;
+		p += chunk;
+		size -= chunk;
+	}
+	return true;
+}
+
+bool disk_cache_enable(const WCHAR* dir)
+{
+	WCHAR path[MAX_PATH];
+	if (!cache_dir_create(dir, L"cache", path))
+		return false;
+	StringCchCopyW(cache_dir, MAX_PATH, path);
+	return true;
+}
+
+bool disk_cache_enabled()
+{
+	return cache_dir[0] != 0;
+}
+
+bool disk_cache_store(const WCHAR* path, const file_stamp_t* stamp,
+	uint64_t content_hash, int num_levels, const void* const* bits,
+	const int* widths, const int* heights, const volatile LONG* cancel)
+{
+	if (!disk_cache_enabled() || num_levels < 1 || num_levels > DISK_CACHE_MAX_LEVELS)
+		return false;
+
+	disk_cache_header_t header;
+	ZeroMemory(&header, sizeof(header));
+	header.magic = DISK_CACHE_MAGIC;
+	header.version = DISK_CACHE_VERSION;
+	header.path_hash = cache_dir_path_hash(path, 1);
+	header.file_size = stamp->size;
+	header.write_time = stamp->write_time;
+	header.content_hash = content_hash;
+	header.num_levels = num_levels;
+
+	// smallest level first, so level 0's offset stays within the DWORD
+	// that CreateDIBSection() takes.
+	uint64_t offset = DISK_CACHE_ALIGN;
+	for (int i = num_levels - 1; i >= 0; i--) {
+		header.levels[i].width = widths[i];
+		header.levels[i].height = heights[i];
+		header.levels[i].offset = offset;
+		offset += _align_up((uint64_t)widths[i] * heights[i] * 4);
+	}
+	if (header.levels[0].offset > MAXDWORD)
+		return false;
+
+	WCHAR final_path[MAX_PATH];
+	WCHAR temp_path[MAX_PATH];
+	if (!_cache_file_path(path, final_path, MAX_PATH) ||
+		!GetTempFileNameW(cache_dir, L"pyr", 0, temp_path))
+		return false;
+
+	// written aside and renamed, so a crash never leaves a half file
+	// under the real name.
+	HANDLE file = CreateFileW(temp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		DeleteFileW(temp_path);
+		return false;
+	}
+	bool ok = _write_at(file, 0, &header, sizeof(header), cancel);
+	for (int i = 0; ok && i < num_levels; i++) {
+		ok = _write_at(file, header.levels[i].offset, bits[i],
+			(uint64_t)widths[i] * heights[i] * 4, cancel);
+	}
+	CloseHandle(file);
+
+	if (ok)
+		ok = MoveFileExW(temp_path, final_path, MOVEFILE_REPLACE_EXISTING) != 0;
+	if (!ok) {
+		DeleteFileW(temp_path);
+		return false;
+	}
+
+	cache_dir_trim(cache_dir, L"pyr", DISK_CACHE_MAX_BYTES);
+	return true;
+}
+
+static bool _header_valid(const disk_cache_header_t* header, const WCHAR* path,
+	uint64_t file_size)
+{
+	if (header->magic != DISK_CACHE_MAGIC ||
+		header->version != DISK_CACHE_VERSION ||
+		header->path_hash != cache_dir_path_hash(path, 1) ||
+		header->num_levels < 1 || header->num_levels > DISK_CACHE_MAX_LEVELS ||
+		header->levels[0].offset > MAXDWORD)
+		return false;
+	for (uint32_t i = 0; i < header->num_levels; i++) {
+		const disk_cache_level_t* level = &header->levels[i];
+		if (level->width <= 0 || level->height <= 0 ||
+			level->offset % DISK_CACHE_ALIGN ||
+			level->offset + (uint64_t)level->width * level->height * 4 > file_size)
+			return false;
+	}
+	return true;
+}
+
+// true if the cache holds the levels of this version of the file.
+// a cache that only differs by write time is updated to match.
+static bool _header_current(HANDLE file, disk_cache_header_t* header,
+	const WCHAR* path, const file_stamp_t* stamp)
+{
+	if (header->file_size != stamp->size)
+		return false;
+	if (!CompareFileTime(&header->write_time, &stamp->write_time))
+		return true;
+
+	// touched, or saved again without changes
+	uint64_t hash = 0;
+	uint64_t size = 0;
+	if (!hash_file(path, &hash, &size) || size != header->file_size ||
+		hash != header->content_hash)
+		return false;
+	header->write_time = stamp->write_time;
+	_write_at(file, 0, header, sizeof(*header), NULL);
+	return true;
+}
+
+disk_cache_t* disk_cache_open(const WCHAR* path, const file_stamp_t* stamp)
+{
+	WCHAR cache_path[MAX_PATH];
+	if (!disk_cache_enabled() || !_cache_file_path(path, cache_path, MAX_PATH))
+		return NULL;
+
+	HANDLE file = CreateFileW(cache_path, GENERIC_READ | GENERIC_WRITE,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	disk_cache_header_t header;
+	DWORD bytes_read = 0;
+	LARGE_INTEGER file_size;
+	if (!ReadFile(file, &header, sizeof(header), &bytes_read, NULL) ||
+		bytes_read != sizeof(header) ||
+		!GetFileSizeEx(file, &file_size) ||
+		!_header_valid(&header, path, (uint64_t)file_size.QuadPart) ||
+		!_header_current(file, &header, path, stamp)) {
+		// stale or damaged
+		CloseHandle(file);
+		DeleteFileW(cache_path);
+		return NULL;
+	}
+
+	// the write time orders the files for cache_dir_trim()
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	SetFileTime(file, NULL, NULL, &now);
+
+	HANDLE section = CreateFileMappingW(file, NULL, PAGE_READWRITE, 0, 0, NULL);
+	if (!section) {
+		CloseHandle(file);
+		return NULL;
+	}
+
+	disk_cache_t* cache = (disk_cache_t*)malloc(sizeof(disk_cache_t));
+	if (!cache) {
+		CloseHandle(section);
+		CloseHandle(file);
+		return NULL;
+	}
+	cache->file = file;
+	cache->section = section;
+	cache->header = header;
+	return cache;
+}
+
+void disk_cache_close(disk_cache_t* cache)
+{
+	if (!cache)
+		return;
+	CloseHandle(cache->section);
+	CloseHandle(cache->file);
+	free(cache);
+}
+
+int disk_cache_num_levels(const disk_cache_t* cache)
+{
+	return (int)cache->header.num_levels;
+}
+
+void disk_cache_level_size(const disk_cache_t* cache, int level,
+	int* width, int* height)
+{
+	*width = cache->header.levels[level].width;
+	*height = cache->header.levels[level].height;
+}
+
+HANDLE disk_cache_section(const disk_cache_t* cache)
+{
+	return cache->section;
+}
+
+DWORD disk_cache_level_offset(const disk_cache_t* cache, int level)
+{
+	return (DWORD)cache->header.levels[level].offset;
+}
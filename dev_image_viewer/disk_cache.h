@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "content_hash.h"
+
+// A persistent cache of image pyramids, for huge images whose decode and
+// pyramid build take seconds.  Each image gets one file in the cache
+// directory, named after a hash of its path, and keyed inside by the file
+// size, write time and content hash.  Levels are stored as top-down 32bpp
+// rows at aligned offsets, so they can be mapped straight into DIB
+// sections and only the pages that get painted are read from disk.
+// The least recently used files are deleted to stay within
+// DISK_CACHE_MAX_BYTES.
+
+#define DISK_CACHE_MAX_LEVELS 8
+// images smaller than this decode quickly enough not to bother
+#define DISK_CACHE_MIN_PIXELS (4096 * 4096)
+#define DISK_CACHE_MAX_BYTES (8ULL * 1024 * 1024 * 1024)
+
+typedef struct disk_cache_t disk_cache_t;
+
+// turns the cache on, in dir, or in %LOCALAPPDATA%\dev_image_viewer\cache
+// if dir is NULL.  the cache is off until this succeeds.
+bool disk_cache_enable(const WCHAR* dir);
+bool disk_cache_enabled();
+
+// writes the cache file for this version of the file, replacing any older
+// one, then trims the cache.  levels go from largest to smallest.  cancel,
+// if not NULL, is watched between writes, and once it's set the store is
+// given up, leaving the cache as it was.  safe to call from several
+// threads at once.
+bool disk_cache_store(const WCHAR* path, const file_stamp_t* stamp,
+	uint64_t content_hash, int num_levels, const void* const* bits,
+	const int* widths, const int* heights, const volatile LONG* cancel);
+
+// opens the cache file holding this version of the file, or returns NULL.
+// when only the write time differs, the file contents are hashed to see
+// whether the cache still applies.
+disk_cache_t* disk_cache_open(const WCHAR* path, const file_stamp_t* stamp);
+// the mapping must stay open as long as DIB sections made from it exist.
+void disk_cache_close(disk_cache_t* cache);
+
+int disk_cache_num_levels(const disk_cache_t* cache);
+void disk_cache_level_size(const disk_cache_t* cache, int level,
+	int* width, int* height);
+// for CreateDIBSection()
+HANDLE disk_cache_section(const disk_cache_t* cache);
+DWORD disk_cache_level_offset(const disk_cache_t* cache, int level);
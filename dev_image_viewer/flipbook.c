@@ -0,0 +1,615 @@
+#include "dev_image_viewer.h"
+
+#include <PathCch.h>
+#include <math.h>
+#include <stdlib.h>
+#include <strsafe.h>
+#include <wctype.h>
+
+#include "flipbook.h"
+#include "parallel.h"
+
+// frames decoded ahead of the one due, at most
+#define FLIPBOOK_AHEAD 8
+
+typedef enum {
+	FLIPBOOK_SLOT_EMPTY,
+	FLIPBOOK_SLOT_DECODING,
+	FLIPBOOK_SLOT_READY,
+} flipbook_slot_state_t;
+
+typedef struct {
+	flipbook_t* flipbook;
+	// position in playback, counting frames shown or dropped
+	LONGLONG position;
+	int index;
+	flipbook_slot_state_t state;
+	bool started;
+	// no longer wanted while decoding. the worker frees the frame, or
+	// skips the decode if it hasn't started, and empties the slot.
+	bool abandoned;
+	canvas_frame_t* frame;	// NULL if the decode failed
+} flipbook_slot_t;
+
+typedef struct {
+	LONGLONG number;
+	WCHAR* path;	// LocalFree()
+} flipbook_file_t;
+
+struct flipbook_t {
+	// a numbered sequence of files, or the frames of one file
+	flipbook_file_t* files;
+	image_frames_t* frames;
+	WCHAR* frames_path;
+	int num_frames;
+
+	TP_CALLBACK_ENVIRON callback_environ;
+	PTP_CLEANUP_GROUP cleanup_group;
+
+	// guards the slots, shared with the workers
+	SRWLOCK lock;
+	flipbook_slot_t slots[FLIPBOOK_AHEAD];
+	bool closing;
+
+	// the clock. position base is due at start_counter, and shows
+	// start_index.
+	LARGE_INTEGER freq;
+	LARGE_INTEGER start_counter;
+	LONGLONG base;
+	int start_index;
+	double fps;
+	flipbook_mode_t mode;
+	// with the file's timing, when each position in a period of the mode
+	// is due, from the start of the period. the last is the period's length.
+	int* times_ms;
+	int period;
+	LONGLONG max_position;
+	LONGLONG shown_position;
+	int dropped;
+
+	// for deciding how far ahead to decode, and whether to skip frames
+	double decode_seconds;
+	int num_workers;
+
+	LARGE_INTEGER window_start;
+	int window_frames;
+	double achieved_fps;
+};
+
+static void _free_files(flipbook_file_t* files, int count)
+{
+	for (int i = 0; i < count; i++)
+		LocalFree(files[i].path);
+	free(files);
+}
+
+static int _compare_files(const void* a, const void* b)
+{
+	const flipbook_file_t* file_a = (const flipbook_file_t*)a;
+	const flipbook_file_t* file_b = (const flipbook_file_t*)b;
+	if (file_a->number != file_b->number)
+		return file_a->number < file_b->number ? -1 : 1;
+	return _wcsicmp(file_a->path, file_b->path);
+}
+
+// finds the last run of digits before the extension
+static bool _find_number(const WCHAR* name, size_t* out_start, size_t* out_end)
+{
+	const WCHAR* ext = wcsrchr(name, L'.');
+	size_t end = ext ? (size_t)(ext - name) : wcslen(name);
+	while (end > 0 && !iswdigit(name[end - 1]))
+		end--;
+	if (!end)
+		return false;
+	size_t start = end;
+	while (start > 0 && iswdigit(name[start - 1]))
+		start--;
+	*out_start = start;
+	*out_end = end;
+	return true;
+}
+
+// lists prefix<digits>suffix in dir
+static bool _list_sequence(flipbook_t* flipbook, const WCHAR* dir,
+	const WCHAR* prefix, const WCHAR* suffix)
+{
+	WCHAR pattern[MAX_PATH];
+	if (FAILED(StringCchPrintfW(pattern, MAX_PATH, L"%s*%s", prefix, suffix)))
+		return false;
+	WCHAR* glob = NULL;
+	if (FAILED(PathAllocCombine(dir, pattern, PATHCCH_ALLOW_LONG_PATHS, &glob)))
+		return false;
+
+	WIN32_FIND_DATAW ffd;
+	HANDLE hfind = FindFirstFileW(glob, &ffd);
+	LocalFree(glob);
+	if (hfind == INVALID_HANDLE_VALUE)
+		return false;
+
+	size_t prefix_length = wcslen(prefix);
+	size_t suffix_length = wcslen(suffix);
+	int capacity = 0;
+	bool ok = true;
+	do {
+		if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+			continue;
+		size_t length = wcslen(ffd.cFileName);
+		if (length <= prefix_length + suffix_length)
+			continue;
+		// the glob also matches names with more than digits in between
+		size_t digits = length - prefix_length - suffix_length;
+		bool numbered = true;
+		for (size_t i = 0; i < digits; i++)
+			numbered = numbered && iswdigit(ffd.cFileName[prefix_length + i]);
+		if (!numbered || _wcsicmp(ffd.cFileName + length - suffix_length, suffix))
+			continue;
+
+		if (flipbook->num_frames == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			flipbook_file_t* files = (flipbook_file_t*)realloc(flipbook->files,
+				capacity * sizeof(flipbook_file_t));
+			if (!files) {
+				ok = false;
+				break;
+			}
+			flipbook->files = files;
+		}
+		flipbook_file_t* file = &flipbook->files[flipbook->num_frames];
+		file->number = _wtoi64(ffd.cFileName + prefix_length);
+		if (FAILED(PathAllocCombine(dir, ffd.cFileName, PATHCCH_ALLOW_LONG_PATHS,
+			&file->path))) {
+			ok = false;
+			break;
+		}
+		flipbook->num_frames++;
+	} while (FindNextFileW(hfind, &ffd));
+	FindClose(hfind);
+
+	if (ok && flipbook->num_frames)
+		qsort(flipbook->files, flipbook->num_frames, sizeof(flipbook_file_t), _compare_files);
+	return ok && flipbook->num_frames;
+}
+
+static bool _open_sequence(flipbook_t* flipbook, const WCHAR* path)
+{
+	const WCHAR* name = path;
+	for (const WCHAR* ptr = path; *ptr; ptr++) {
+		if ((*ptr == L'\\' || *ptr == L'/') && ptr[1])
+			name = ptr + 1;
+	}
+	size_t start, end;
+	if (!_find_number(name, &start, &end))
+		return false;
+
+	WCHAR prefix[MAX_PATH];
+	WCHAR* dir = _wcsdup(path);
+	bool ok = dir &&
+		SUCCEEDED(StringCchCopyNW(prefix, MAX_PATH, name, start)) &&
+		SUCCEEDED(PathCchRemoveFileSpec(dir, wcslen(dir))) &&
+		_list_sequence(flipbook, dir, prefix, name + end);
+	free(dir);
+	return ok;
+}
+
+static void _free_flipbook(flipbook_t* flipbook)
+{
+	_free_files(flipbook->files, flipbook->num_frames);
+	image_frames_close(flipbook->frames);
+	free(flipbook->frames_path);
+	free(flipbook->times_ms);
+	free(flipbook);
+}
+
+flipbook_t* flipbook_open(const WCHAR* path)
+{
+	flipbook_t* flipbook = (flipbook_t*)calloc(1, sizeof(flipbook_t));
+	if (!flipbook)
+		return NULL;
+
+	// the frames of an animation or multi-page file come before the
+	// sequence it may be numbered as part of
+	flipbook->frames = image_frames_open(path);
+	bool ok;
+	if (flipbook->frames) {
+		flipbook->frames_path = _wcsdup(path);
+		flipbook->num_frames = image_frames_count(flipbook->frames);
+		ok = flipbook->frames_path != NULL;
+	}
+	else {
+		ok = _open_sequence(flipbook, path);
+	}
+	if (ok) {
+		flipbook->cleanup_group = CreateThreadpoolCleanupGroup();
+		ok = flipbook->cleanup_group != NULL;
+	}
+	if (!ok) {
+		_free_flipbook(flipbook);
+		return NULL;
+	}
+
+	InitializeThreadpoolEnvironment(&flipbook->callback_environ);
+	SetThreadpoolCallbackCleanupGroup(&flipbook->callback_environ,
+		flipbook->cleanup_group, NULL);
+	InitializeSRWLock(&flipbook->lock);
+	for (int i = 0; i < FLIPBOOK_AHEAD; i++)
+		flipbook->slots[i].flipbook = flipbook;
+	QueryPerformanceFrequency(&flipbook->freq);
+	// the GDI+ frames of one file decode one at a time. a texture's layers
+	// and a YUV file's frames don't share anything.
+	flipbook->num_workers = flipbook->frames && !image_frames_parallel(flipbook->frames) ?
+		1 : parallel_get_num_threads();
+	if (flipbook->num_workers > FLIPBOOK_AHEAD)
+		flipbook->num_workers = FLIPBOOK_AHEAD;
+	flipbook->shown_position = -1;
+	flipbook->max_position = -1;
+	return flipbook;
+}
+
+void flipbook_close(flipbook_t* flipbook)
+{
+	if (!flipbook)
+		return;
+	// cancels decodes not started, and waits for the rest, which queue
+	// no more
+	AcquireSRWLockExclusive(&flipbook->lock);
+	flipbook->closing = true;
+	ReleaseSRWLockExclusive(&flipbook->lock);
+	CloseThreadpoolCleanupGroupMembers(flipbook->cleanup_group, TRUE, NULL);
+	CloseThreadpoolCleanupGroup(flipbook->cleanup_group);
+	DestroyThreadpoolEnvironment(&flipbook->callback_environ);
+	for (int i = 0; i < FLIPBOOK_AHEAD; i++)
+		canvas_frame_free(flipbook->slots[i].frame);
+	_free_flipbook(flipbook);
+}
+
+int flipbook_num_frames(const flipbook_t* flipbook)
+{
+	return flipbook->num_frames;
+}
+
+const WCHAR* flipbook_get_path(const flipbook_t* flipbook, int index)
+{
+	if (index < 0 || index >= flipbook->num_frames)
+		return NULL;
+	if (flipbook->frames)
+		return flipbook->frames_path;
+	return flipbook->files[index].path;
+}
+
+int flipbook_find(const flipbook_t* flipbook, const WCHAR* path)
+{
+	if (flipbook->frames)
+		return _wcsicmp(flipbook->frames_path, path) ? -1 : 0;
+	for (int i = 0; i < flipbook->num_frames; i++) {
+		if (!_wcsicmp(flipbook->files[i].path, path))
+			return i;
+	}
+	return -1;
+}
+
+// the sequence index shown at a position
+static int _index_at(const flipbook_t* flipbook, LONGLONG position)
+{
+	int n = flipbook->num_frames;
+	LONGLONG step = position - flipbook->base + flipbook->start_index;
+	if (n == 1)
+		return 0;
+	if (flipbook->mode == FLIPBOOK_LOOP)
+		return (int)(step % n);
+	// there and back, without showing the ends twice
+	LONGLONG period = 2 * (LONGLONG)n - 2;
+	LONGLONG m = step % period;
+	return (int)(m < n ? m : period - m);
+}
+
+bool flipbook_is_animation(const flipbook_t* flipbook)
+{
+	return flipbook->frames != NULL;
+}
+
+int flipbook_delay_ms(const flipbook_t* flipbook, int index)
+{
+	return flipbook->frames ? image_frames_delay_ms(flipbook->frames, index) : 0;
+}
+
+bool flipbook_describe(const flipbook_t* flipbook, int index, WCHAR* text,
+	size_t text_count)
+{
+	return flipbook->frames &&
+		image_frames_describe(flipbook->frames, index, text, text_count);
+}
+
+canvas_frame_t* flipbook_load(flipbook_t* flipbook, int index)
+{
+	if (index < 0 || index >= flipbook->num_frames)
+		return NULL;
+	if (flipbook->frames)
+		return canvas_frame_load_index(flipbook->frames, index);
+	return canvas_frame_load(flipbook->files[index].path);
+}
+
+static LONGLONG _due_position(const flipbook_t* flipbook, const LARGE_INTEGER* now)
+{
+	double seconds = (double)(now->QuadPart - flipbook->start_counter.QuadPart) /
+		flipbook->freq.QuadPart;
+	if (!flipbook->times_ms)
+		return flipbook->base + (LONGLONG)(seconds * flipbook->fps);
+
+	// the last position due in the period, after whole periods
+	LONGLONG ms = (LONGLONG)(seconds * 1000.0);
+	LONGLONG period_ms = flipbook->times_ms[flipbook->period];
+	LONGLONG periods = ms / period_ms;
+	int rem = (int)(ms - periods * period_ms);
+	int low = 0;
+	int high = flipbook->period - 1;
+	while (low < high) {
+		int mid = (low + high + 1) / 2;
+		if (flipbook->times_ms[mid] <= rem)
+			low = mid;
+		else
+			high = mid - 1;
+	}
+	return flipbook->base + periods * flipbook->period + low;
+}
+
+// when each position is due with the file's timing. false if it has none.
+static bool _build_times(flipbook_t* flipbook)
+{
+	free(flipbook->times_ms);
+	flipbook->times_ms = NULL;
+	int n = flipbook->num_frames;
+	int period = flipbook->mode == FLIPBOOK_LOOP || n == 1 ? n : 2 * n - 2;
+	int* times_ms = (int*)malloc((period + 1) * sizeof(int));
+	if (!times_ms)
+		return false;
+	times_ms[0] = 0;
+	for (int i = 0; i < period; i++) {
+		int delay_ms = flipbook_delay_ms(flipbook, _index_at(flipbook, flipbook->base + i));
+		if (delay_ms <= 0) {
+			free(times_ms);
+			return false;
+		}
+		times_ms[i + 1] = times_ms[i] + delay_ms;
+	}
+	flipbook->times_ms = times_ms;
+	flipbook->period = period;
+	// on average, for how far ahead to decode
+	flipbook->fps = period * 1000.0 / times_ms[period];
+	return true;
+}
+
+void flipbook_play(flipbook_t* flipbook, int index, double fps,
+	flipbook_mode_t mode)
+{
+	canvas_frame_t* discard[FLIPBOOK_AHEAD];
+	int num_discard = 0;
+
+	AcquireSRWLockExclusive(&flipbook->lock);
+	// everything decoded so far was for the old clock
+	for (int i = 0; i < FLIPBOOK_AHEAD; i++) {
+		flipbook_slot_t* slot = &flipbook->slots[i];
+		if (slot->state == FLIPBOOK_SLOT_DECODING) {
+			slot->abandoned = true;
+		}
+		else if (slot->state == FLIPBOOK_SLOT_READY) {
+			discard[num_discard++] = slot->frame;
+			slot->frame = NULL;
+			slot->state = FLIPBOOK_SLOT_EMPTY;
+		}
+	}
+	flipbook->base = flipbook->max_position + 1;
+	flipbook->start_index = index < 0 || index >= flipbook->num_frames ? 0 : index;
+	flipbook->mode = mode;
+	if (fps > 0 || !_build_times(flipbook)) {
+		free(flipbook->times_ms);
+		flipbook->times_ms = NULL;
+		flipbook->fps = fps > 0 ? fps : 1;
+	}
+	flipbook->shown_position = flipbook->base - 1;
+	flipbook->dropped = 0;
+	QueryPerformanceCounter(&flipbook->start_counter);
+	flipbook->window_start = flipbook->start_counter;
+	flipbook->window_frames = 0;
+	flipbook->achieved_fps = 0;
+	ReleaseSRWLockExclusive(&flipbook->lock);
+
+	for (int i = 0; i < num_discard; i++)
+		canvas_frame_free(discard[i]);
+}
+
+static void _flipbook_top_up(flipbook_t* flipbook, LONGLONG due);
+
+// each decode finishing queues the next, so decoding keeps going between
+// ticks
+static VOID CALLBACK _flipbook_decode(PTP_CALLBACK_INSTANCE instance, PVOID param)
+{
+	flipbook_slot_t* slot = (flipbook_slot_t*)param;
+	flipbook_t* flipbook = slot->flipbook;
+	LARGE_INTEGER start, end;
+
+	AcquireSRWLockExclusive(&flipbook->lock);
+	bool skip = slot->abandoned;
+	if (skip)
+		slot->state = FLIPBOOK_SLOT_EMPTY;
+	else
+		slot->started = true;
+	ReleaseSRWLockExclusive(&flipbook->lock);
+
+	// the slot's index doesn't change while it's decoding
+	canvas_frame_t* frame = NULL;
+	if (!skip) {
+		QueryPerformanceCounter(&start);
+		frame = flipbook_load(flipbook, slot->index);
+	}
+	QueryPerformanceCounter(&end);
+
+	AcquireSRWLockExclusive(&flipbook->lock);
+	if (!skip) {
+		double seconds = (double)(end.QuadPart - start.QuadPart) / flipbook->freq.QuadPart;
+		flipbook->decode_seconds = flipbook->decode_seconds ?
+			flipbook->decode_seconds * 0.75 + seconds * 0.25 : seconds;
+		if (slot->abandoned) {
+			slot->state = FLIPBOOK_SLOT_EMPTY;
+		}
+		else {
+			slot->frame = frame;
+			slot->state = FLIPBOOK_SLOT_READY;
+			frame = NULL;
+		}
+	}
+	_flipbook_top_up(flipbook, _due_position(flipbook, &end));
+	ReleaseSRWLockExclusive(&flipbook->lock);
+	canvas_frame_free(frame);
+}
+
+static flipbook_slot_t* _find_slot(flipbook_t* flipbook, LONGLONG position)
+{
+	for (int i = 0; i < FLIPBOOK_AHEAD; i++) {
+		flipbook_slot_t* slot = &flipbook->slots[i];
+		if (slot->state != FLIPBOOK_SLOT_EMPTY && !slot->abandoned &&
+			slot->position == position)
+			return slot;
+	}
+	return NULL;
+}
+
+static flipbook_slot_t* _find_empty_slot(flipbook_t* flipbook)
+{
+	for (int i = 0; i < FLIPBOOK_AHEAD; i++) {
+		if (flipbook->slots[i].state == FLIPBOOK_SLOT_EMPTY)
+			return &flipbook->slots[i];
+	}
+	return NULL;
+}
+
+// queues decodes of frames that can be ready by the time they're due.
+// when decoding is slower than playback, only every stride'th frame is
+// decoded, rather than all of them arriving late.
+static void _flipbook_top_up(flipbook_t* flipbook, LONGLONG due)
+{
+	// no more decodes in flight than workers, so none waits its turn while
+	// the frame it's for goes by
+	int decoding = 0;
+	for (int i = 0; i < FLIPBOOK_AHEAD; i++) {
+		if (flipbook->slots[i].state == FLIPBOOK_SLOT_DECODING)
+			decoding++;
+	}
+	if (flipbook->closing || decoding >= flipbook->num_workers)
+		return;
+
+	double frames_per_decode = flipbook->decode_seconds * flipbook->fps;
+	LONGLONG lead = (LONGLONG)frames_per_decode;
+	LONGLONG stride = (LONGLONG)ceil(frames_per_decode / flipbook->num_workers);
+	if (stride < 1)
+		stride = 1;
+
+	LONGLONG first = due + lead;
+	if (first <= flipbook->shown_position)
+		first = flipbook->shown_position + 1;
+	for (int i = 0; i < FLIPBOOK_AHEAD; i++) {
+		LONGLONG position = first + i * stride;
+		if (_find_slot(flipbook, position))
+			continue;
+		flipbook_slot_t* slot = _find_empty_slot(flipbook);
+		if (!slot || decoding == flipbook->num_workers)
+			break;
+		slot->position = position;
+		slot->index = _index_at(flipbook, position);
+		slot->state = FLIPBOOK_SLOT_DECODING;
+		slot->started = false;
+		slot->abandoned = false;
+		if (!TrySubmitThreadpoolCallback(_flipbook_decode, slot,
+			&flipbook->callback_environ)) {
+			slot->state = FLIPBOOK_SLOT_EMPTY;
+			break;
+		}
+		decoding++;
+		if (position > flipbook->max_position)
+			flipbook->max_position = position;
+	}
+}
+
+canvas_frame_t* flipbook_tick(flipbook_t* flipbook, int* out_index)
+{
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	LONGLONG due = _due_position(flipbook, &now);
+
+	canvas_frame_t* result = NULL;
+	canvas_frame_t* discard[FLIPBOOK_AHEAD];
+	int num_discard = 0;
+
+	AcquireSRWLockExclusive(&flipbook->lock);
+
+	// the newest frame decoded that is due. one that came in a little late
+	// is still shown, if nothing newer is ready.
+	flipbook_slot_t* show = NULL;
+	for (int i = 0; i < FLIPBOOK_AHEAD; i++) {
+		flipbook_slot_t* slot = &flipbook->slots[i];
+		if (slot->state == FLIPBOOK_SLOT_READY && slot->position <= due &&
+			slot->position > flipbook->shown_position &&
+			(!show || slot->position > show->position))
+			show = slot;
+	}
+	if (show) {
+		// a failed decode keeps the previous frame up
+		result = show->frame;
+		show->frame = NULL;
+		show->state = FLIPBOOK_SLOT_EMPTY;
+		flipbook->dropped += (int)(show->position - flipbook->shown_position - 1);
+		flipbook->shown_position = show->position;
+		if (result) {
+			*out_index = show->index;
+			flipbook->window_frames++;
+		}
+	}
+
+	// the frames passed by are dropped. a decode already running for a
+	// frame past due may still be the next shown; one not started won't.
+	for (int i = 0; i < FLIPBOOK_AHEAD; i++) {
+		flipbook_slot_t* slot = &flipbook->slots[i];
+		if (slot->state == FLIPBOOK_SLOT_READY &&
+			slot->position <= flipbook->shown_position) {
+			discard[num_discard++] = slot->frame;
+			slot->frame = NULL;
+			slot->state = FLIPBOOK_SLOT_EMPTY;
+		}
+		else if (slot->state == FLIPBOOK_SLOT_DECODING &&
+			(slot->position <= flipbook->shown_position ||
+			(slot->position < due && !slot->started))) {
+			slot->abandoned = true;
+		}
+	}
+
+	_flipbook_top_up(flipbook, due);
+
+	ReleaseSRWLockExclusive(&flipbook->lock);
+
+	for (int i = 0; i < num_discard; i++)
+		canvas_frame_free(discard[i]);
+
+	double window_seconds = (double)(now.QuadPart - flipbook->window_start.QuadPart) /
+		flipbook->freq.QuadPart;
+	if (window_seconds >= 1.0) {
+		flipbook->achieved_fps = flipbook->window_frames / window_seconds;
+		flipbook->window_start = now;
+		flipbook->window_frames = 0;
+	}
+	return result;
+}
+
+void flipbook_get_stats(flipbook_t* flipbook, flipbook_stats_t* stats)
+{
+	ZeroMemory(stats, sizeof(*stats));
+	AcquireSRWLockShared(&flipbook->lock);
+	for (int i = 0; i < FLIPBOOK_AHEAD; i++) {
+		const flipbook_slot_t* slot = &flipbook->slots[i];
+		if (slot->state == FLIPBOOK_SLOT_READY)
+			stats->ready++;
+		else if (slot->state == FLIPBOOK_SLOT_DECODING && !slot->abandoned)
+			stats->decoding++;
+	}
+	stats->achieved_fps = flipbook->achieved_fps;
+	stats->dropped = flipbook->dropped;
+	ReleaseSRWLockShared(&flipbook->lock);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "canvas.h"
+
+// Plays a numbered image sequence (frame_0001.png, frame_0002.png, ...) at
+// a target frame rate, or the frames of an animated or multi-page image,
+// or the layers of a texture (see image_frames.h), at that rate or with
+// their own timing.  Frames are decoded, baked and minified ahead of time
+// on the system thread pool, into a small ring of slots.  Which frame
+// is due comes from the clock, not from how many have been shown, so when
+// decoding can't keep up, frames are dropped and playback stays in time.
+
+typedef enum {
+	FLIPBOOK_LOOP,
+	FLIPBOOK_PINGPONG,
+} flipbook_mode_t;
+
+typedef struct {
+	double achieved_fps;	// frames shown over about the last second
+	int ready;				// decoded ahead, waiting to be shown
+	int decoding;
+	int dropped;			// since play started
+} flipbook_stats_t;
+
+typedef struct flipbook_t flipbook_t;
+
+// the frames of path if it has more than one, or else the sequence it is
+// part of, in numeric order. NULL on error, or if the file name has no
+// number.
+flipbook_t* flipbook_open(const WCHAR* path);
+// waits for decodes in flight
+void flipbook_close(flipbook_t* flipbook);
+
+int flipbook_num_frames(const flipbook_t* flipbook);
+const WCHAR* flipbook_get_path(const flipbook_t* flipbook, int index);
+// the index of path in the sequence, or -1
+int flipbook_find(const flipbook_t* flipbook, const WCHAR* path);
+// true for the frames of one file, for which every path is the same
+bool flipbook_is_animation(const flipbook_t* flipbook);
+// how long the file says the frame shows, or 0 if it doesn't
+int flipbook_delay_ms(const flipbook_t* flipbook, int index);
+// which slice and cube face of a texture the frame is, or how a YUV file
+// shows. false otherwise.
+bool flipbook_describe(const flipbook_t* flipbook, int index, WCHAR* text,
+	size_t text_count);
+// decodes a frame now, for stepping through while not playing
+canvas_frame_t* flipbook_load(flipbook_t* flipbook, int index);
+
+// (re)starts the clock, with index due now. with fps 0, frames show for
+// their delays, if the file has them.
+void flipbook_play(flipbook_t* flipbook, int index, double fps,
+	flipbook_mode_t mode);
+// call often, from the thread that shows frames. returns the frame due
+// now, to be shown and freed by the caller, or NULL if it was shown
+// already or isn't decoded yet.  keeps the decodes ahead topped up.
+canvas_frame_t* flipbook_tick(flipbook_t* flipbook, int* out_index);
+void flipbook_get_stats(flipbook_t* flipbook, flipbook_stats_t* stats);
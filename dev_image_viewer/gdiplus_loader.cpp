@@ -1,8 +1,15 @@
 #include "dev_image_viewer.h"
 
 #include <gdiplus.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <wincodec.h>
 
 #include "gdiplus_loader.h"
+#include "png_file.h"
+#include "texture_file.h"
+#include "trace.h"
+#include "yuv_file.h"
 
 static ULONG_PTR gdiplusToken = 0;
 
@@ -27,6 +34,32 @@ void init_bitmap_header(BITMAPV5HEADER* bmi, int width, int height)
 bool canvas_read_image(const WCHAR* path, HBITMAP* out_hbitmap,
 	void** out_bits, int* out_width, int* out_height)
 {
+	// GDI+ doesn't read raw YUV or textures. show their first frame or
+	// image.
+	yuv_file_t* yuv = yuv_file_open(path);
+	if (yuv) {
+		bool ok = yuv_file_read(yuv, 0, out_hbitmap, out_bits, out_width, out_height);
+		yuv_file_close(yuv);
+		return ok;
+	}
+	texture_t* texture = texture_file_open(path);
+	if (texture) {
+		bool ok = texture_file_read(texture, 0, 0, out_hbitmap, out_bits,
+			out_width, out_height);
+		texture_free(texture);
+		return ok;
+	}
+	// PNGs decode straight into the DIB, not through a locked GDI+ bitmap
+	if (png_file_read(path, out_hbitmap, out_bits, out_width, out_height))
+		return true;
+	return canvas_read_image_gdiplus(path, out_hbitmap, out_bits, out_width,
+		out_height);
+}
+
+bool canvas_read_image_gdiplus(const WCHAR* path, HBITMAP* out_hbitmap,
+	void** out_bits, int* out_width, int* out_height)
+{
+	uint64_t start = trace_begin();
 	Gdiplus::Bitmap bitmap(path);
 	if (bitmap.GetLastStatus() != Gdiplus::Ok)
 		return false;
@@ -38,6 +71,8 @@ bool canvas_read_image(const WCHAR* path, HBITMAP* out_hbitmap,
 		Gdiplus::ImageLockModeRead, PixelFormat32bppPARGB,
 		&lockedBitmapData) != Gdiplus::Ok)
 		return false;
+	uint64_t num_pixels = (uint64_t)width * height;
+	trace_end(TRACE_DECODE, start, num_pixels * 4, num_pixels);
 
 	BITMAPV5HEADER bmi;
 	init_bitmap_header(&bmi, width, height);
@@ -53,11 +88,13 @@ bool canvas_read_image(const WCHAR* path, HBITMAP* out_hbitmap,
 		return false;
 	}
 
+	start = trace_begin();
 	for (int y = 0; y < height; y++) {
 		memcpy((char*)bits + (size_t)y * width * 4,
 			(char*)lockedBitmapData.Scan0 + (size_t)y * lockedBitmapData.Stride,
 			(size_t)width * 4);
 	}
+	trace_end(TRACE_COPY, start, num_pixels * 4 * 2, num_pixels);
 
 	bitmap.UnlockBits(&lockedBitmapData);
 
@@ -68,6 +105,134 @@ bool canvas_read_image(const WCHAR* path, HBITMAP* out_hbitmap,
 	return true;
 }
 
+static bool _get_encoder_clsid(const WCHAR* mime_type, CLSID* clsid)
+{
+	UINT num_encoders = 0;
+	UINT size = 0;
+	if (Gdiplus::GetImageEncodersSize(&num_encoders, &size) != Gdiplus::Ok || !size)
+		return false;
+	Gdiplus::ImageCodecInfo* encoders = (Gdiplus::ImageCodecInfo*)malloc(size);
+	if (!encoders)
+		return false;
+
+	bool found = false;
+	if (Gdiplus::GetImageEncoders(num_encoders, size, encoders) == Gdiplus::Ok) {
+		for (UINT i = 0; i < num_encoders; i++) {
+			if (!wcscmp(encoders[i].MimeType, mime_type)) {
+				*clsid = encoders[i].Clsid;
+				found = true;
+				break;
+			}
+		}
+	}
+	free(encoders);
+	return found;
+}
+
+bool canvas_write_png(const WCHAR* path, const void* bits, int width,
+	int height, bool has_alpha)
+{
+	CLSID clsid;
+	if (!_get_encoder_clsid(L"image/png", &clsid))
+		return false;
+
+	Gdiplus::Bitmap bitmap(width, height, width * 4,
+		has_alpha ? PixelFormat32bppPARGB : PixelFormat32bppRGB, (BYTE*)bits);
+	if (bitmap.GetLastStatus() != Gdiplus::Ok)
+		return false;
+	return bitmap.Save(path, &clsid, NULL) == Gdiplus::Ok;
+}
+
+bool canvas_write_jpeg(const WCHAR* path, const void* bits, int width,
+	int height, int quality)
+{
+	CLSID clsid;
+	if (!_get_encoder_clsid(L"image/jpeg", &clsid))
+		return false;
+
+	Gdiplus::Bitmap bitmap(width, height, width * 4, PixelFormat32bppRGB, (BYTE*)bits);
+	if (bitmap.GetLastStatus() != Gdiplus::Ok)
+		return false;
+	ULONG value = (ULONG)quality;
+	Gdiplus::EncoderParameters params;
+	params.Count = 1;
+	params.Parameter[0].Guid = Gdiplus::EncoderQuality;
+	params.Parameter[0].Type = Gdiplus::EncoderParameterValueTypeLong;
+	params.Parameter[0].NumberOfValues = 1;
+	params.Parameter[0].Value = &value;
+	return bitmap.Save(path, &clsid, &params) == Gdiplus::Ok;
+}
+
+bool canvas_write_jpeg_422(const WCHAR* path, const void* bits, int width,
+	int height, int quality)
+{
+	// GDI+ always halves chroma both ways, so this goes through WIC
+	HRESULT init = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
+	IWICImagingFactory* factory = NULL;
+	IWICStream* stream = NULL;
+	IWICBitmapEncoder* encoder = NULL;
+	IWICBitmapFrameEncode* frame = NULL;
+	IPropertyBag2* options = NULL;
+	HRESULT hr = CoCreateInstance(CLSID_WICImagingFactory, NULL, CLSCTX_INPROC_SERVER,
+		IID_PPV_ARGS(&factory));
+	if (SUCCEEDED(hr))
+		hr = factory->CreateStream(&stream);
+	if (SUCCEEDED(hr))
+		hr = stream->InitializeFromFilename(path, GENERIC_WRITE);
+	if (SUCCEEDED(hr))
+		hr = factory->CreateEncoder(GUID_ContainerFormatJpeg, NULL, &encoder);
+	if (SUCCEEDED(hr))
+		hr = encoder->Initialize(stream, WICBitmapEncoderNoCache);
+	if (SUCCEEDED(hr))
+		hr = encoder->CreateNewFrame(&frame, &options);
+	if (SUCCEEDED(hr)) {
+		PROPBAG2 option;
+		ZeroMemory(&option, sizeof(option));
+		VARIANT value;
+		VariantInit(&value);
+		option.pstrName = (LPOLESTR)L"ImageQuality";
+		value.vt = VT_R4;
+		value.fltVal = quality / 100.0f;
+		hr = options->Write(1, &option, &value);
+		if (SUCCEEDED(hr)) {
+			option.pstrName = (LPOLESTR)L"JpegYCrCbSubsampling";
+			value.vt = VT_UI1;
+			value.bVal = WICJpegYCrCbSubsampling422;
+			hr = options->Write(1, &option, &value);
+		}
+	}
+	if (SUCCEEDED(hr))
+		hr = frame->Initialize(options);
+	if (SUCCEEDED(hr))
+		hr = frame->SetSize(width, height);
+	WICPixelFormatGUID format = GUID_WICPixelFormat32bppBGR;
+	if (SUCCEEDED(hr))
+		hr = frame->SetPixelFormat(&format);
+	if (SUCCEEDED(hr) && !IsEqualGUID(format, GUID_WICPixelFormat32bppBGR))
+		hr = E_FAIL;
+	if (SUCCEEDED(hr)) {
+		hr = frame->WritePixels(height, width * 4, (UINT)((size_t)width * height * 4),
+			(BYTE*)bits);
+	}
+	if (SUCCEEDED(hr))
+		hr = frame->Commit();
+	if (SUCCEEDED(hr))
+		hr = encoder->Commit();
+	if (options)
+		options->Release();
+	if (frame)
+		frame->Release();
+	if (encoder)
+		encoder->Release();
+	if (stream)
+		stream->Release();
+	if (factory)
+		factory->Release();
+	if (SUCCEEDED(init))
+		CoUninitialize();
+	return SUCCEEDED(hr);
+}
+
 void init_gdiplus_loader()
 {
 	Gdiplus::GdiplusStartupInput gdiplusStartupInput;
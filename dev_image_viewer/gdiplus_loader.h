@@ -12,6 +12,20 @@ void destroy_gdiplus_loader();
 void init_bitmap_header(BITMAPV5HEADER* bmi, int width, int height);
 bool canvas_read_image(const WCHAR* path, HBITMAP* out_hbitmap,
 	void** out_bits, int* out_width, int* out_height);
+// the image as GDI+ decodes it, even where canvas_read_image() wouldn't
+// use GDI+
+bool canvas_read_image_gdiplus(const WCHAR* path, HBITMAP* out_hbitmap,
+	void** out_bits, int* out_width, int* out_height);
+// bits are top-down 32bpp, premultiplied if has_alpha
+bool canvas_write_png(const WCHAR* path, const void* bits, int width,
+	int height, bool has_alpha);
+// baseline, opaque, quality 0 to 100
+bool canvas_write_jpeg(const WCHAR* path, const void* bits, int width,
+	int height, int quality);
+// as canvas_write_jpeg(), with chroma halved across but not down (4:2:2),
+// where that writes it halved both ways (4:2:0)
+bool canvas_write_jpeg_422(const WCHAR* path, const void* bits, int width,
+	int height, int quality);
 
 #ifdef __cplusplus
 }
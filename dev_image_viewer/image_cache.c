@@ -0,0 +1,315 @@
+#include "dev_image_viewer.h"
+
+#include <stdlib.h>
+
+#include "image_cache.h"
+#include "pixel_codec.h"
+#include "trace.h"
+
+struct image_cache_entry_t {
+	struct image_cache_entry_t* next;
+	WCHAR* path;
+	file_stamp_t stamp;
+	uint64_t last_used;
+
+	int num_levels;
+	int widths[IMAGE_CACHE_MAX_LEVELS];
+	int heights[IMAGE_CACHE_MAX_LEVELS];
+	pixel_blob_t* levels[IMAGE_CACHE_MAX_LEVELS];
+
+	uint64_t raw_bytes;
+	uint64_t compressed_bytes;
+};
+
+// levels being compressed on the thread pool.  the worker only builds the
+// entry, and signals done, and the UI thread adds it to the cache.
+typedef struct image_cache_job_t {
+	struct image_cache_job_t* next;
+	WCHAR* path;
+	file_stamp_t stamp;
+	int num_levels;
+	const uint32_t* pixels[IMAGE_CACHE_MAX_LEVELS];
+	int widths[IMAGE_CACHE_MAX_LEVELS];
+	int heights[IMAGE_CACHE_MAX_LEVELS];
+	image_cache_release_fn release;
+	void* ctx;
+	// NULL if it couldn't be compressed. read only once done is signaled.
+	image_cache_entry_t* entry;
+	HANDLE done;
+} image_cache_job_t;
+
+// only used from the UI thread, so no locking
+static image_cache_entry_t* cache_entries = NULL;
+static image_cache_job_t* cache_jobs = NULL;
+static uint64_t cache_use_counter = 0;
+static uint64_t cache_raw_bytes = 0;
+static uint64_t cache_compressed_bytes = 0;
+
+static void _free_entry(image_cache_entry_t* entry)
+{
+	for (int i = 0; i < entry->num_levels; i++)
+		pixel_blob_free(entry->levels[i]);
+	free(entry->path);
+	free(entry);
+}
+
+// unlinks and frees
+static void _remove_entry(image_cache_entry_t* entry)
+{
+	for (image_cache_entry_t** link = &cache_entries; *link; link = &(*link)->next) {
+		if (*link == entry) {
+			*link = entry->next;
+			cache_raw_bytes -= entry->raw_bytes;
+			cache_compressed_bytes -= entry->compressed_bytes;
+			_free_entry(entry);
+			return;
+		}
+	}
+}
+
+static image_cache_entry_t* _find_path(const WCHAR* path)
+{
+	for (image_cache_entry_t* entry = cache_entries; entry; entry = entry->next) {
+		if (!_wcsicmp(entry->path, path))
+			return entry;
+	}
+	return NULL;
+}
+
+static image_cache_entry_t* _find(const WCHAR* path, const file_stamp_t* stamp)
+{
+	image_cache_entry_t* entry = _find_path(path);
+	if (!entry || !file_stamps_equal(&entry->stamp, stamp))
+		return NULL;
+	entry->last_used = ++cache_use_counter;
+	return entry;
+}
+
+static void _evict(uint64_t max_bytes)
+{
+	while (cache_entries && cache_compressed_bytes > max_bytes) {
+		image_cache_entry_t* oldest = cache_entries;
+		for (image_cache_entry_t* entry = cache_entries; entry; entry = entry->next) {
+			if (entry->last_used < oldest->last_used)
+				oldest = entry;
+		}
+		_remove_entry(oldest);
+	}
+}
+
+// a new entry of the levels, compressed, not yet in the cache. NULL if
+// out of memory, or too large to keep.  touches nothing shared, so it can
+// run on any thread.
+static image_cache_entry_t* _compress(const WCHAR* path, const file_stamp_t* stamp,
+	int num_levels, const uint32_t* const* pixels, const int* widths,
+	const int* heights)
+{
+	image_cache_entry_t* entry = (image_cache_entry_t*)calloc(1, sizeof(image_cache_entry_t));
+	if (!entry)
+		return NULL;
+	entry->path = _wcsdup(path);
+	if (!entry->path) {
+		free(entry);
+		return NULL;
+	}
+	entry->stamp = *stamp;
+	entry->compressed_bytes = sizeof(image_cache_entry_t);
+
+	uint64_t start = trace_begin();
+	for (int i = 0; i < num_levels; i++) {
+		entry->levels[i] = pixel_blob_compress(pixels[i], widths[i], heights[i]);
+		if (!entry->levels[i]) {
+			_free_entry(entry);
+			return NULL;
+		}
+		entry->num_levels++;
+		entry->widths[i] = widths[i];
+		entry->heights[i] = heights[i];
+		entry->raw_bytes += (uint64_t)widths[i] * heights[i] * sizeof(uint32_t);
+		entry->compressed_bytes += pixel_blob_size(entry->levels[i]);
+	}
+	trace_end(TRACE_CACHE_COMPRESS, start, entry->raw_bytes, entry->raw_bytes / 4);
+
+	if (entry->compressed_bytes > IMAGE_CACHE_MAX_BYTES) {
+		// would push everything else out, and then itself
+		_free_entry(entry);
+		return NULL;
+	}
+	return entry;
+}
+
+// adds an entry made by _compress(), replacing any for its path
+static void _insert(image_cache_entry_t* entry)
+{
+	image_cache_entry_t* old = _find_path(entry->path);
+	if (old)
+		_remove_entry(old);
+
+	// make room first, so the new entry isn't the one evicted
+	_evict(IMAGE_CACHE_MAX_BYTES - entry->compressed_bytes);
+
+	entry->last_used = ++cache_use_counter;
+	entry->next = cache_entries;
+	cache_entries = entry;
+	cache_raw_bytes += entry->raw_bytes;
+	cache_compressed_bytes += entry->compressed_bytes;
+}
+
+static VOID CALLBACK _compress_work(PTP_CALLBACK_INSTANCE instance, PVOID param)
+{
+	image_cache_job_t* job = (image_cache_job_t*)param;
+	job->entry = _compress(job->path, &job->stamp, job->num_levels, job->pixels,
+		job->widths, job->heights);
+	job->release(job->ctx);
+	SetEvent(job->done);
+}
+
+// adds the entries of the jobs that are done.  if wait is true, waits for
+// all of them first.
+static void _collect(bool wait)
+{
+	image_cache_job_t** link = &cache_jobs;
+	while (*link) {
+		image_cache_job_t* job = *link;
+		if (WaitForSingleObject(job->done, wait ? INFINITE : 0) != WAIT_OBJECT_0) {
+			link = &job->next;
+			continue;
+		}
+		*link = job->next;
+		// the list is oldest first, so a later put of the path wins
+		if (job->entry)
+			_insert(job->entry);
+		CloseHandle(job->done);
+		free(job->path);
+		free(job);
+	}
+}
+
+static image_cache_job_t* _find_job(const WCHAR* path, const file_stamp_t* stamp)
+{
+	for (image_cache_job_t* job = cache_jobs; job; job = job->next) {
+		if (!_wcsicmp(job->path, path) && file_stamps_equal(&job->stamp, stamp))
+			return job;
+	}
+	return NULL;
+}
+
+bool image_cache_has(const WCHAR* path, const file_stamp_t* stamp)
+{
+	_collect(false);
+	return _find_job(path, stamp) || _find(path, stamp) != NULL;
+}
+
+bool image_cache_put(const WCHAR* path, const file_stamp_t* stamp,
+	int num_levels, const uint32_t* const* pixels, const int* widths,
+	const int* heights)
+{
+	if (num_levels > IMAGE_CACHE_MAX_LEVELS)
+		return false;
+	// so none still compressing lands on top of this one
+	_collect(true);
+	image_cache_entry_t* entry = _compress(path, stamp, num_levels, pixels, widths,
+		heights);
+	if (!entry) {
+		image_cache_entry_t* old = _find_path(path);
+		if (old)
+			_remove_entry(old);
+		return false;
+	}
+	_insert(entry);
+	return true;
+}
+
+bool image_cache_put_async(const WCHAR* path, const file_stamp_t* stamp,
+	int num_levels, const uint32_t* const* pixels, const int* widths,
+	const int* heights, image_cache_release_fn release, void* ctx)
+{
+	if (num_levels > IMAGE_CACHE_MAX_LEVELS)
+		return false;
+	_collect(false);
+	image_cache_job_t* job = (image_cache_job_t*)calloc(1, sizeof(image_cache_job_t));
+	if (!job)
+		return false;
+	job->path = _wcsdup(path);
+	job->stamp = *stamp;
+	job->num_levels = num_levels;
+	for (int i = 0; i < num_levels; i++) {
+		job->pixels[i] = pixels[i];
+		job->widths[i] = widths[i];
+		job->heights[i] = heights[i];
+	}
+	job->release = release;
+	job->ctx = ctx;
+	job->done = CreateEventW(NULL, TRUE, FALSE, NULL);
+	if (!job->path || !job->done ||
+		!TrySubmitThreadpoolCallback(_compress_work, job, NULL)) {
+		if (job->done)
+			CloseHandle(job->done);
+		free(job->path);
+		free(job);
+		return false;
+	}
+	image_cache_job_t** link = &cache_jobs;
+	while (*link)
+		link = &(*link)->next;
+	*link = job;
+	return true;
+}
+
+const image_cache_entry_t* image_cache_get(const WCHAR* path,
+	const file_stamp_t* stamp)
+{
+	_collect(false);
+	image_cache_job_t* job = _find_job(path, stamp);
+	if (job) {
+		WaitForSingleObject(job->done, INFINITE);
+		_collect(false);
+	}
+	return _find(path, stamp);
+}
+
+int image_cache_entry_num_levels(const image_cache_entry_t* entry)
+{
+	return entry->num_levels;
+}
+
+void image_cache_entry_level_size(const image_cache_entry_t* entry, int level,
+	int* width, int* height)
+{
+	*width = entry->widths[level];
+	*height = entry->heights[level];
+}
+
+bool image_cache_entry_decompress(const image_cache_entry_t* entry,
+	int level, uint32_t* pixels)
+{
+	if (level < 0 || level >= entry->num_levels)
+		return false;
+	return pixel_blob_decompress(entry->levels[level], pixels);
+}
+
+void image_cache_entry_sizes(const image_cache_entry_t* entry,
+	uint64_t* raw_bytes, uint64_t* compressed_bytes)
+{
+	*raw_bytes = entry->raw_bytes;
+	*compressed_bytes = entry->compressed_bytes;
+}
+
+void image_cache_get_totals(int* num_entries, uint64_t* raw_bytes,
+	uint64_t* compressed_bytes)
+{
+	_collect(false);
+	int count = 0;
+	for (image_cache_entry_t* entry = cache_entries; entry; entry = entry->next)
+		count++;
+	*num_entries = count;
+	*raw_bytes = cache_raw_bytes;
+	*compressed_bytes = cache_compressed_bytes;
+}
+
+void image_cache_clear()
+{
+	_collect(true);
+	while (cache_entries)
+		_remove_entry(cache_entries);
+}
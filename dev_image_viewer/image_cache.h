@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "content_hash.h"
+
+// A cache of inactive images, kept compressed in memory (see
+// pixel_codec.h) so that navigating back to one skips the decode and the
+// pyramid build.  Entries are keyed by path and file stamp.  The least
+// recently used are dropped to stay within IMAGE_CACHE_MAX_BYTES.
+
+#define IMAGE_CACHE_MAX_BYTES (512 * 1024 * 1024)
+#define IMAGE_CACHE_MAX_LEVELS 8
+
+typedef struct image_cache_entry_t image_cache_entry_t;
+
+// true if an entry for this version of the file is held, or is still being
+// compressed by image_cache_put_async(). counts as a use.
+bool image_cache_has(const WCHAR* path, const file_stamp_t* stamp);
+
+// compresses the levels and adds them, replacing any entry for the path.
+bool image_cache_put(const WCHAR* path, const file_stamp_t* stamp,
+	int num_levels, const uint32_t* const* pixels, const int* widths,
+	const int* heights);
+
+typedef void (*image_cache_release_fn)(void* ctx);
+
+// like image_cache_put(), but compresses on the thread pool and returns
+// straight away.  the pixels must stay valid until release(ctx) is called,
+// from the worker, once they're compressed.  if this returns false,
+// release is never called.  the entry is added on a later call from the
+// UI thread.
+bool image_cache_put_async(const WCHAR* path, const file_stamp_t* stamp,
+	int num_levels, const uint32_t* const* pixels, const int* widths,
+	const int* heights, image_cache_release_fn release, void* ctx);
+
+// finds the entry for this version of the file, or NULL, waiting for it if
+// it's still being compressed.  counts as a use.  the entry stays owned by
+// the cache, and is valid until the next call to any other image_cache_
+// function.
+const image_cache_entry_t* image_cache_get(const WCHAR* path,
+	const file_stamp_t* stamp);
+
+int image_cache_entry_num_levels(const image_cache_entry_t* entry);
+void image_cache_entry_level_size(const image_cache_entry_t* entry, int level,
+	int* width, int* height);
+// pixels must have room for the level, tightly packed.
+bool image_cache_entry_decompress(const image_cache_entry_t* entry,
+	int level, uint32_t* pixels);
+// uncompressed and compressed sizes of all levels
+void image_cache_entry_sizes(const image_cache_entry_t* entry,
+	uint64_t* raw_bytes, uint64_t* compressed_bytes);
+
+void image_cache_get_totals(int* num_entries, uint64_t* raw_bytes,
+	uint64_t* compressed_bytes);
+void image_cache_clear();
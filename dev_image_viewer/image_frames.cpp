@@ -0,0 +1,340 @@
+#include "dev_image_viewer.h"
+
+#include <gdiplus.h>
+#include <stdlib.h>
+#include <strsafe.h>
+
+#include "gdiplus_loader.h"
+#include "image_frames.h"
+#include "pixel_codec.h"
+#include "texture_file.h"
+#include "yuv_file.h"
+#include "trace.h"
+
+// GIF delays under this are shown at the default, as browsers do
+#define IMAGE_FRAMES_MIN_DELAY_MS 20
+#define IMAGE_FRAMES_DEFAULT_DELAY_MS 100
+
+typedef struct {
+	pixel_blob_t* blob;
+	int width;
+	int height;
+} image_frames_cached_t;
+
+struct image_frames_t {
+	// the layers of a texture, or the frames of a raw YUV file, instead of
+	// GDI+ frames
+	texture_t* texture;
+	yuv_file_t* yuv;
+
+	IStream* stream;
+	Gdiplus::Bitmap* bitmap;
+	GUID dimension;
+	int count;
+	int* delays_ms;
+
+	// guards everything below, and the bitmap, which GDI+ doesn't allow
+	// using from more than one thread at a time
+	SRWLOCK lock;
+	image_frames_cached_t* cached;
+	size_t cached_bytes;
+};
+
+// the whole file in a stream, so GDI+ doesn't keep it locked while it
+// decodes frames on demand
+static IStream* _read_stream(const WCHAR* path)
+{
+	HANDLE file = CreateFileW(path, GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	LARGE_INTEGER size;
+	HGLOBAL hglobal = NULL;
+	void* data = NULL;
+	DWORD bytes_read = 0;
+	bool ok = GetFileSizeEx(file, &size) && size.QuadPart > 0 &&
+		size.QuadPart < MAXDWORD &&
+		(hglobal = GlobalAlloc(GMEM_MOVEABLE, (SIZE_T)size.QuadPart)) != NULL &&
+		(data = GlobalLock(hglobal)) != NULL &&
+		ReadFile(file, data, (DWORD)size.QuadPart, &bytes_read, NULL) &&
+		bytes_read == size.QuadPart;
+	if (data)
+		GlobalUnlock(hglobal);
+	CloseHandle(file);
+
+	IStream* stream = NULL;
+	if (!ok || FAILED(CreateStreamOnHGlobal(hglobal, TRUE, &stream))) {
+		if (hglobal)
+			GlobalFree(hglobal);
+		return NULL;
+	}
+	return stream;
+}
+
+static void _read_delays(image_frames_t* frames)
+{
+	bool timed = IsEqualGUID(frames->dimension, Gdiplus::FrameDimensionTime);
+	UINT size = timed ? frames->bitmap->GetPropertyItemSize(PropertyTagFrameDelay) : 0;
+	Gdiplus::PropertyItem* item = size ? (Gdiplus::PropertyItem*)malloc(size) : NULL;
+	bool have = item &&
+		frames->bitmap->GetPropertyItem(PropertyTagFrameDelay, size, item) == Gdiplus::Ok;
+
+	// in hundredths of a second, one per frame
+	int num_delays = have ? (int)(item->length / sizeof(LONG)) : 0;
+	for (int i = 0; i < frames->count; i++) {
+		int delay_ms = i < num_delays ? ((const LONG*)item->value)[i] * 10 : 0;
+		if (timed && delay_ms < IMAGE_FRAMES_MIN_DELAY_MS)
+			delay_ms = IMAGE_FRAMES_DEFAULT_DELAY_MS;
+		frames->delays_ms[i] = delay_ms;
+	}
+	free(item);
+}
+
+// a texture array or cubemap, whose layers decode independently, so need
+// neither the lock nor the cache
+static image_frames_t* _open_texture(texture_t* texture)
+{
+	int count = texture_get_info(texture)->num_layers;
+	image_frames_t* frames = count > 1 ?
+		(image_frames_t*)calloc(1, sizeof(image_frames_t)) : NULL;
+	if (frames)
+		frames->delays_ms = (int*)calloc(count, sizeof(int));
+	if (!frames || !frames->delays_ms) {
+		free(frames);
+		texture_free(texture);
+		return NULL;
+	}
+	frames->texture = texture;
+	frames->count = count;
+	return frames;
+}
+
+// frames read at their offsets in the file, which also needn't be cached
+static image_frames_t* _open_yuv(yuv_file_t* yuv)
+{
+	int count = yuv_file_num_frames(yuv);
+	image_frames_t* frames = count > 1 ?
+		(image_frames_t*)calloc(1, sizeof(image_frames_t)) : NULL;
+	if (frames)
+		frames->delays_ms = (int*)calloc(count, sizeof(int));
+	if (!frames || !frames->delays_ms) {
+		free(frames);
+		yuv_file_close(yuv);
+		return NULL;
+	}
+	frames->yuv = yuv;
+	frames->count = count;
+	return frames;
+}
+
+image_frames_t* image_frames_open(const WCHAR* path)
+{
+	yuv_file_t* yuv = yuv_file_open(path);
+	if (yuv)
+		return _open_yuv(yuv);
+	texture_t* texture = texture_file_open(path);
+	if (texture)
+		return _open_texture(texture);
+
+	IStream* stream = _read_stream(path);
+	if (!stream)
+		return NULL;
+
+	Gdiplus::Bitmap* bitmap = new Gdiplus::Bitmap(stream);
+	GUID dimension;
+	UINT count = 0;
+	if (bitmap->GetLastStatus() == Gdiplus::Ok &&
+		bitmap->GetFrameDimensionsCount() >= 1 &&
+		bitmap->GetFrameDimensionsList(&dimension, 1) == Gdiplus::Ok)
+		count = bitmap->GetFrameCount(&dimension);
+
+	image_frames_t* frames = count > 1 ?
+		(image_frames_t*)calloc(1, sizeof(image_frames_t)) : NULL;
+	if (frames) {
+		frames->delays_ms = (int*)calloc(count, sizeof(int));
+		frames->cached = (image_frames_cached_t*)calloc(count,
+			sizeof(image_frames_cached_t));
+	}
+	if (!frames || !frames->delays_ms || !frames->cached) {
+		if (frames) {
+			free(frames->delays_ms);
+			free(frames->cached);
+			free(frames);
+		}
+		delete bitmap;
+		stream->Release();
+		return NULL;
+	}
+
+	frames->stream = stream;
+	frames->bitmap = bitmap;
+	frames->dimension = dimension;
+	frames->count = (int)count;
+	InitializeSRWLock(&frames->lock);
+	_read_delays(frames);
+	return frames;
+}
+
+void image_frames_close(image_frames_t* frames)
+{
+	if (!frames)
+		return;
+	if (frames->texture || frames->yuv) {
+		texture_free(frames->texture);
+		yuv_file_close(frames->yuv);
+		free(frames->delays_ms);
+		free(frames);
+		return;
+	}
+	for (int i = 0; i < frames->count; i++)
+		pixel_blob_free(frames->cached[i].blob);
+	free(frames->cached);
+	free(frames->delays_ms);
+	delete frames->bitmap;
+	frames->stream->Release();
+	free(frames);
+}
+
+int image_frames_count(const image_frames_t* frames)
+{
+	return frames->count;
+}
+
+int image_frames_delay_ms(const image_frames_t* frames, int index)
+{
+	if (index < 0 || index >= frames->count)
+		return 0;
+	return frames->delays_ms[index];
+}
+
+const texture_t* image_frames_texture(const image_frames_t* frames)
+{
+	return frames->texture;
+}
+
+bool image_frames_parallel(const image_frames_t* frames)
+{
+	return frames->texture || frames->yuv;
+}
+
+bool image_frames_describe(const image_frames_t* frames, int index, WCHAR* text,
+	size_t text_count)
+{
+	static const WCHAR* face_names[6] = { L"+X", L"-X", L"+Y", L"-Y", L"+Z", L"-Z" };
+	if (index < 0 || index >= frames->count)
+		return false;
+	if (frames->yuv) {
+		yuv_file_describe(frames->yuv, text, text_count);
+		return true;
+	}
+	if (!frames->texture)
+		return false;
+
+	const texture_info_t* info = texture_get_info(frames->texture);
+	int num_slices = info->num_layers / info->num_faces;
+	int slice = index / info->num_faces;
+	const WCHAR* face = face_names[index % info->num_faces];
+	if (info->num_faces == 1)
+		StringCchPrintfW(text, text_count, L"Slice %d/%d", slice + 1, num_slices);
+	else if (num_slices == 1)
+		StringCchPrintfW(text, text_count, L"Face %s", face);
+	else
+		StringCchPrintfW(text, text_count, L"Slice %d/%d, face %s", slice + 1, num_slices, face);
+	return true;
+}
+
+static bool _create_dib(int width, int height, HBITMAP* out_hbitmap, void** out_bits)
+{
+	BITMAPV5HEADER bmi;
+	init_bitmap_header(&bmi, width, height);
+
+	HDC hdc = GetDC(NULL);
+	HBITMAP hbitmap = CreateDIBSection(hdc, (BITMAPINFO*)&bmi, DIB_RGB_COLORS,
+		out_bits, NULL, 0);
+	ReleaseDC(NULL, hdc);
+	*out_hbitmap = hbitmap;
+	return hbitmap != NULL;
+}
+
+// decodes the frame into a new DIB section. the lock must be held.
+static bool _decode_frame(image_frames_t* frames, int index, HBITMAP* out_hbitmap,
+	void** out_bits, int* out_width, int* out_height)
+{
+	uint64_t start = trace_begin();
+	if (frames->bitmap->SelectActiveFrame(&frames->dimension, index) != Gdiplus::Ok)
+		return false;
+
+	int width = frames->bitmap->GetWidth();
+	int height = frames->bitmap->GetHeight();
+	Gdiplus::BitmapData lockedBitmapData;
+	if (frames->bitmap->LockBits(&Gdiplus::Rect(0, 0, width, height),
+		Gdiplus::ImageLockModeRead, PixelFormat32bppPARGB,
+		&lockedBitmapData) != Gdiplus::Ok)
+		return false;
+	uint64_t num_pixels = (uint64_t)width * height;
+	trace_end(TRACE_DECODE, start, num_pixels * 4, num_pixels);
+
+	HBITMAP hbitmap;
+	void* bits;
+	if (!_create_dib(width, height, &hbitmap, &bits)) {
+		frames->bitmap->UnlockBits(&lockedBitmapData);
+		return false;
+	}
+	for (int y = 0; y < height; y++) {
+		memcpy((char*)bits + (size_t)y * width * 4,
+			(char*)lockedBitmapData.Scan0 + (size_t)y * lockedBitmapData.Stride,
+			(size_t)width * 4);
+	}
+	frames->bitmap->UnlockBits(&lockedBitmapData);
+
+	*out_hbitmap = hbitmap;
+	*out_bits = bits;
+	*out_width = width;
+	*out_height = height;
+	return true;
+}
+
+bool image_frames_read(image_frames_t* frames, int index, HBITMAP* out_hbitmap,
+	void** out_bits, int* out_width, int* out_height)
+{
+	if (index < 0 || index >= frames->count)
+		return false;
+	if (frames->texture) {
+		return texture_file_read(frames->texture, index, 0, out_hbitmap, out_bits,
+			out_width, out_height);
+	}
+	if (frames->yuv)
+		return yuv_file_read(frames->yuv, index, out_hbitmap, out_bits, out_width, out_height);
+
+	AcquireSRWLockExclusive(&frames->lock);
+	image_frames_cached_t* cached = &frames->cached[index];
+	bool ok;
+	if (cached->blob) {
+		ok = _create_dib(cached->width, cached->height, out_hbitmap, out_bits);
+		if (ok && !pixel_blob_decompress(cached->blob, (uint32_t*)*out_bits)) {
+			DeleteObject(*out_hbitmap);
+			ok = false;
+		}
+		if (ok) {
+			*out_width = cached->width;
+			*out_height = cached->height;
+		}
+	}
+	else {
+		ok = _decode_frame(frames, index, out_hbitmap, out_bits, out_width,
+			out_height);
+		if (ok && frames->cached_bytes < IMAGE_FRAMES_MAX_BYTES) {
+			cached->blob = pixel_blob_compress((const uint32_t*)*out_bits,
+				*out_width, *out_height);
+			if (cached->blob) {
+				cached->width = *out_width;
+				cached->height = *out_height;
+				frames->cached_bytes += pixel_blob_size(cached->blob);
+			}
+		}
+	}
+	ReleaseSRWLockExclusive(&frames->lock);
+	return ok;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+
+#include "texture.h"
+
+// The frames of an animated GIF, or the pages of a multi-page TIFF, which
+// canvas_read_image() only ever gives the first of.  GDI+ composites each
+// GIF frame over the ones before it, and can only get there by decoding
+// forward, so going back means decoding from the start again.  Frames read
+// are kept compressed (see pixel_codec.h), so a loop or a step back after
+// the first pass costs a decompress instead.  The first frames are kept
+// until IMAGE_FRAMES_MAX_BYTES is used; later ones aren't, so a long
+// animation can't take all memory, and playing it in a loop still hits the
+// cache for the same share of each pass.
+//
+// The layers of a texture array or cubemap (see texture.h), and the frames
+// of a raw YUV file (see yuv_file.h), are frames too, without timing.
+// They decode fast enough not to need the cache.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMAGE_FRAMES_MAX_BYTES (128 * 1024 * 1024)
+
+typedef struct image_frames_t image_frames_t;
+
+// NULL unless the file has more than one frame. the file is read into
+// memory, so it isn't held open, except a YUV file, which can be large.
+image_frames_t* image_frames_open(const WCHAR* path);
+void image_frames_close(image_frames_t* frames);
+
+int image_frames_count(const image_frames_t* frames);
+// how long the frame shows, as browsers time it. 0 for pages, which have
+// no timing.
+int image_frames_delay_ms(const image_frames_t* frames, int index);
+// the texture the frames are the layers of, or NULL
+const texture_t* image_frames_texture(const image_frames_t* frames);
+// whether reads can run on several threads at once, as a texture's or a
+// YUV file's frames can. GDI+ frames decode one at a time.
+bool image_frames_parallel(const image_frames_t* frames);
+// which slice and cube face a texture's frame is, or how a YUV file's
+// frames show. false for other files.
+bool image_frames_describe(const image_frames_t* frames, int index, WCHAR* text,
+	size_t text_count);
+
+// the frame as canvas_read_image() returns an image: a new top-down 32bpp
+// premultiplied DIB section.  pages can differ in size.  safe on any
+// thread; reads of GDI+ frames are serialized.
+bool image_frames_read(image_frames_t* frames, int index, HBITMAP* out_hbitmap,
+	void** out_bits, int* out_width, int* out_height);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,651 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "image_probe.h"
+#include "texture.h"
+
+// the most windows one probe reads, so a corrupt file can't make it walk
+// the whole file
+#define IMAGE_PROBE_MAX_READS 16
+// sanity limit, as texture.c has
+#define IMAGE_PROBE_MAX_SIZE 1000000
+
+// the bytes of the file read so far, one window at a time
+typedef struct {
+	image_probe_read_t read;
+	void* ctx;
+	uint64_t start;
+	size_t length;
+	int reads;
+	uint8_t window[IMAGE_PROBE_WINDOW];
+} _reader_t;
+
+// size bytes at offset, reading the window there if they aren't in the
+// current one. NULL past the end of the file.
+static const uint8_t* _bytes(_reader_t* reader, uint64_t offset, size_t size)
+{
+	if (size > IMAGE_PROBE_WINDOW)
+		return NULL;
+	if (offset >= reader->start && offset - reader->start <= reader->length &&
+		size <= reader->length - (offset - reader->start))
+		return reader->window + (offset - reader->start);
+	if (reader->reads >= IMAGE_PROBE_MAX_READS)
+		return NULL;
+	reader->reads++;
+	reader->start = offset;
+	reader->length = 0;
+	if (!reader->read(reader->ctx, offset, reader->window, sizeof(reader->window),
+		&reader->length) || reader->length < size)
+		return NULL;
+	return reader->window;
+}
+
+static uint16_t _le16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static uint16_t _be16(const uint8_t* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+static uint32_t _le32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) |
+		((uint32_t)p[3] << 24);
+}
+static uint32_t _be32(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) |
+		(uint32_t)p[3];
+}
+
+static bool _set_size(image_probe_t* probe, int64_t width, int64_t height)
+{
+	if (width <= 0 || height <= 0 ||
+		width > IMAGE_PROBE_MAX_SIZE || height > IMAGE_PROBE_MAX_SIZE)
+		return false;
+	probe->width = (int)width;
+	probe->height = (int)height;
+	return true;
+}
+
+//
+// PNG
+//
+
+static bool _probe_png(_reader_t* reader, image_probe_t* probe)
+{
+	const uint8_t* p = _bytes(reader, 0, 33);
+	if (!p || _be32(p + 8) != 13 || memcmp(p + 12, "IHDR", 4))
+		return false;
+	if (!_set_size(probe, _be32(p + 16), _be32(p + 20)))
+		return false;
+	int depth = p[24];
+	int color_type = p[25];
+	probe->bits = depth;
+	probe->interlaced = p[28] == 1;
+	switch (color_type) {
+	case 0: probe->channels = 1; break;
+	case 2: probe->channels = 3; break;
+	case 3: probe->channels = 3; probe->palette = true; break;
+	case 4: probe->channels = 2; probe->has_alpha = true; break;
+	case 6: probe->channels = 4; probe->has_alpha = true; break;
+	default: return false;
+	}
+	if (probe->has_alpha)
+		return true;
+
+	// a tRNS chunk before the data makes a colour, or palette entries,
+	// transparent
+	uint64_t offset = 33;
+	for (;;) {
+		p = _bytes(reader, offset, 8);
+		if (!p || !memcmp(p + 4, "IDAT", 4) || !memcmp(p + 4, "IEND", 4))
+			break;
+		if (!memcmp(p + 4, "tRNS", 4)) {
+			probe->has_alpha = true;
+			probe->channels++;
+			break;
+		}
+		offset += 12 + (uint64_t)_be32(p);
+	}
+	return true;
+}
+
+//
+// JPEG
+//
+
+static bool _probe_jpeg(_reader_t* reader, image_probe_t* probe)
+{
+	// segments up to the frame header, which has the size
+	uint64_t offset = 2;
+	for (;;) {
+		const uint8_t* p = _bytes(reader, offset, 2);
+		if (!p || p[0] != 0xFF)
+			return false;
+		int marker = p[1];
+		if (marker == 0xFF) {
+			// fill byte
+			offset++;
+			continue;
+		}
+		if (marker == 0x01 || (marker >= 0xD0 && marker <= 0xD7)) {
+			offset += 2;
+			continue;
+		}
+		// no frame before the scan or the end
+		if (marker == 0xDA || marker == 0xD9)
+			return false;
+		p = _bytes(reader, offset, 10);
+		if (!p)
+			return false;
+		// SOF0 to SOF15, except DHT, JPG and DAC
+		if (marker >= 0xC0 && marker <= 0xCF &&
+			marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+			probe->bits = p[4];
+			probe->channels = p[9];
+			probe->interlaced = (marker & 3) == 2;
+			if (probe->channels != 1 && probe->channels != 3 && probe->channels != 4)
+				return false;
+			return _set_size(probe, _be16(p + 7), _be16(p + 5));
+		}
+		offset += 2 + (uint64_t)_be16(p + 2);
+	}
+}
+
+//
+// BMP
+//
+
+#define BMP_BI_ALPHABITFIELDS 6
+
+static bool _probe_bmp(_reader_t* reader, image_probe_t* probe)
+{
+	const uint8_t* p = _bytes(reader, 0, 70);
+	if (!p)
+		p = _bytes(reader, 0, 26);
+	if (!p)
+		return false;
+	uint32_t header_size = _le32(p + 14);
+	int64_t width, height;
+	int bpp;
+	uint32_t compression = 0;
+	if (header_size == 12) {
+		width = _le16(p + 18);
+		height = _le16(p + 20);
+		bpp = _le16(p + 24);
+	} else if (header_size >= 40 && reader->length >= 54) {
+		width = (int32_t)_le32(p + 18);
+		height = (int32_t)_le32(p + 22);
+		// top-down bitmaps have a negative height
+		if (height < 0)
+			height = -height;
+		bpp = _le16(p + 28);
+		compression = _le32(p + 30);
+	} else {
+		return false;
+	}
+	if (!_set_size(probe, width, height))
+		return false;
+	if (bpp <= 8) {
+		probe->palette = true;
+		probe->bits = bpp;
+		probe->channels = 3;
+		return true;
+	}
+	probe->bits = bpp == 16 ? 5 : 8;
+	probe->channels = 3;
+	// the alpha mask, in a V3 or later header or after an info header,
+	// is at the same place. GDI+ ignores the 4th byte without one.
+	if (bpp == 32 && (header_size >= 56 || compression == BMP_BI_ALPHABITFIELDS) &&
+		reader->length >= 70 && _le32(p + 66)) {
+		probe->has_alpha = true;
+		probe->channels = 4;
+	}
+	return true;
+}
+
+//
+// TIFF
+//
+
+#define TIFF_IMAGE_WIDTH 256
+#define TIFF_IMAGE_LENGTH 257
+#define TIFF_BITS_PER_SAMPLE 258
+#define TIFF_PHOTOMETRIC 262
+#define TIFF_SAMPLES_PER_PIXEL 277
+#define TIFF_EXTRA_SAMPLES 338
+#define TIFF_PHOTOMETRIC_PALETTE 3
+// the most IFD entries read, which are in tag order
+#define TIFF_MAX_ENTRIES 1024
+
+typedef struct {
+	bool big_endian;
+	bool big_tiff;
+} _tiff_t;
+
+static uint64_t _tiff_uint(const _tiff_t* tiff, const uint8_t* p, int bytes)
+{
+	switch (bytes) {
+	case 1: return p[0];
+	case 2: return tiff->big_endian ? _be16(p) : _le16(p);
+	case 4: return tiff->big_endian ? _be32(p) : _le32(p);
+	}
+	uint64_t a = tiff->big_endian ? _be32(p) : _le32(p);
+	uint64_t b = tiff->big_endian ? _be32(p + 4) : _le32(p + 4);
+	return tiff->big_endian ? (a << 32) | b : (b << 32) | a;
+}
+
+// the first value of an entry, which is inline if all its values fit
+static bool _tiff_value(const _tiff_t* tiff, _reader_t* reader, const uint8_t* entry,
+	uint64_t* out_value)
+{
+	int type = (int)_tiff_uint(tiff, entry + 2, 2);
+	int bytes;
+	switch (type) {
+	case 1: bytes = 1; break;	// BYTE
+	case 3: bytes = 2; break;	// SHORT
+	case 4: bytes = 4; break;	// LONG
+	case 16: bytes = 8; break;	// LONG8
+	default: return false;
+	}
+	int inline_size = tiff->big_tiff ? 8 : 4;
+	uint64_t count = _tiff_uint(tiff, entry + 4, inline_size);
+	const uint8_t* value = entry + 4 + inline_size;
+	if (count == 0)
+		return false;
+	if (count > (uint64_t)inline_size / bytes) {
+		value = _bytes(reader, _tiff_uint(tiff, value, inline_size), bytes);
+		if (!value)
+			return false;
+	}
+	*out_value = _tiff_uint(tiff, value, bytes);
+	return true;
+}
+
+static bool _probe_tiff(_reader_t* reader, image_probe_t* probe)
+{
+	const uint8_t* p = _bytes(reader, 0, 16);
+	if (!p)
+		return false;
+	_tiff_t tiff;
+	tiff.big_endian = p[0] == 'M';
+	tiff.big_tiff = _tiff_uint(&tiff, p + 2, 2) == 43;
+	uint64_t ifd_offset;
+	if (tiff.big_tiff) {
+		if (_tiff_uint(&tiff, p + 4, 2) != 8)
+			return false;
+		ifd_offset = _tiff_uint(&tiff, p + 8, 8);
+	} else {
+		ifd_offset = _tiff_uint(&tiff, p + 4, 4);
+	}
+	int count_size = tiff.big_tiff ? 8 : 2;
+	int entry_size = tiff.big_tiff ? 20 : 12;
+	p = _bytes(reader, ifd_offset, count_size);
+	if (!p)
+		return false;
+	uint64_t num_entries = _tiff_uint(&tiff, p, count_size);
+	if (num_entries > TIFF_MAX_ENTRIES)
+		num_entries = TIFF_MAX_ENTRIES;
+
+	uint64_t width = 0, height = 0, bits = 1, samples = 1, photometric = 0, extra = 0;
+	for (uint64_t i = 0; i < num_entries; i++) {
+		uint64_t entry_offset = ifd_offset + count_size + i * entry_size;
+		const uint8_t* entry = _bytes(reader, entry_offset, entry_size);
+		if (!entry)
+			return false;
+		uint64_t* field;
+		switch (_tiff_uint(&tiff, entry, 2)) {
+		case TIFF_IMAGE_WIDTH: field = &width; break;
+		case TIFF_IMAGE_LENGTH: field = &height; break;
+		case TIFF_BITS_PER_SAMPLE: field = &bits; break;
+		case TIFF_PHOTOMETRIC: field = &photometric; break;
+		case TIFF_SAMPLES_PER_PIXEL: field = &samples; break;
+		case TIFF_EXTRA_SAMPLES: field = &extra; break;
+		default: continue;
+		}
+		// a value read from elsewhere moves the window, so the entry is
+		// copied first
+		uint8_t copy[20];
+		memcpy(copy, entry, entry_size);
+		if (!_tiff_value(&tiff, reader, copy, field))
+			return false;
+	}
+	if (!_set_size(probe, (int64_t)width, (int64_t)height) || bits == 0 || bits > 64 ||
+		samples == 0 || samples > 16)
+		return false;
+	probe->bits = (int)bits;
+	probe->channels = (int)samples;
+	if (photometric == TIFF_PHOTOMETRIC_PALETTE) {
+		probe->palette = true;
+		probe->channels = 3;
+	}
+	// associated or unassociated alpha
+	if (extra == 1 || extra == 2) {
+		probe->has_alpha = true;
+		if (probe->palette)
+			probe->channels++;
+	}
+	return true;
+}
+
+//
+// GIF
+//
+
+static bool _probe_gif(_reader_t* reader, image_probe_t* probe)
+{
+	const uint8_t* p = _bytes(reader, 0, 13);
+	if (!p || !_set_size(probe, _le16(p + 6), _le16(p + 8)))
+		return false;
+	probe->palette = true;
+	probe->channels = 3;
+	probe->bits = (p[10] & 7) + 1;
+	uint64_t offset = 13;
+	if (p[10] & 0x80)
+		offset += 3 << ((p[10] & 7) + 1);
+
+	// extensions up to the first image, for its transparency and
+	// interlacing. the size is known whatever is found.
+	for (;;) {
+		p = _bytes(reader, offset, 2);
+		if (!p)
+			return true;
+		if (p[0] == 0x2C) {
+			p = _bytes(reader, offset, 10);
+			if (p)
+				probe->interlaced = (p[9] & 0x40) != 0;
+			return true;
+		}
+		if (p[0] != 0x21)
+			return true;
+		int label = p[1];
+		offset += 2;
+		// sub-blocks, to an empty one
+		for (;;) {
+			p = _bytes(reader, offset, 1);
+			if (!p)
+				return true;
+			int size = p[0];
+			if (size == 0)
+				break;
+			if (label == 0xF9 && size >= 4) {
+				p = _bytes(reader, offset, 2);
+				if (p && (p[1] & 1) && !probe->has_alpha) {
+					probe->has_alpha = true;
+					probe->channels++;
+				}
+			}
+			offset += 1 + size;
+		}
+		offset++;
+	}
+}
+
+//
+// PNM
+//
+
+// the next number in a PNM header, past whitespace and comments
+static bool _pnm_number(const uint8_t* p, size_t length, size_t* pos, int64_t* out_value)
+{
+	for (;;) {
+		if (*pos >= length)
+			return false;
+		if (p[*pos] == '#') {
+			while (*pos < length && p[*pos] != '\n')
+				(*pos)++;
+		} else if (p[*pos] == ' ' || (p[*pos] >= '\t' && p[*pos] <= '\r')) {
+			(*pos)++;
+		} else {
+			break;
+		}
+	}
+	int64_t value = 0;
+	size_t start = *pos;
+	while (*pos < length && p[*pos] >= '0' && p[*pos] <= '9' && value <= IMAGE_PROBE_MAX_SIZE)
+		value = value * 10 + (p[(*pos)++] - '0');
+	*out_value = value;
+	return *pos > start;
+}
+
+// PAM's header is lines of a name and a value, to ENDHDR
+static bool _probe_pam(const uint8_t* p, size_t length, image_probe_t* probe)
+{
+	int64_t width = 0, height = 0, depth = 0, maxval = 0;
+	bool alpha = false;
+	size_t pos = 3;
+	while (pos < length) {
+		size_t end = pos;
+		while (end < length && p[end] != '\n')
+			end++;
+		const char* line = (const char*)p + pos;
+		size_t line_length = end - pos;
+		if (line_length && line[line_length - 1] == '\r')
+			line_length--;
+		size_t value_pos = pos;
+		while (value_pos < end && p[value_pos] != ' ' && p[value_pos] != '\t')
+			value_pos++;
+		int64_t* field = NULL;
+		if (line_length >= 6 && !memcmp(line, "ENDHDR", 6)) {
+			probe->bits = maxval > 255 ? 16 : 8;
+			probe->channels = (int)depth;
+			probe->has_alpha = alpha;
+			return depth >= 1 && depth <= 4 && maxval >= 1 && maxval <= 65535 &&
+				_set_size(probe, width, height);
+		} else if (line_length > 5 && !memcmp(line, "WIDTH", 5)) {
+			field = &width;
+		} else if (line_length > 6 && !memcmp(line, "HEIGHT", 6)) {
+			field = &height;
+		} else if (line_length > 5 && !memcmp(line, "DEPTH", 5)) {
+			field = &depth;
+		} else if (line_length > 6 && !memcmp(line, "MAXVAL", 6)) {
+			field = &maxval;
+		} else if (line_length > 8 && !memcmp(line, "TUPLTYPE", 8)) {
+			// GRAYSCALE_ALPHA or RGB_ALPHA
+			alpha = line_length >= 15 && !memcmp(line + line_length - 6, "_ALPHA", 6);
+		}
+		if (field && !_pnm_number(p, end, &value_pos, field))
+			return false;
+		pos = end + 1;
+	}
+	return false;
+}
+
+static bool _probe_pnm(_reader_t* reader, image_probe_t* probe)
+{
+	// the header is text, which fits in the first window
+	const uint8_t* p = _bytes(reader, 0, 3);
+	if (!p)
+		return false;
+	size_t length = reader->length;
+	int kind = p[1];
+	if (kind == '7')
+		return _probe_pam(p, length, probe);
+
+	size_t pos = 2;
+	int64_t width, height, maxval = 1;
+	if (!_pnm_number(p, length, &pos, &width) || !_pnm_number(p, length, &pos, &height))
+		return false;
+	switch (kind) {
+	case '1': case '4':
+		probe->channels = 1;
+		probe->bits = 1;
+		break;
+	case '2': case '5':
+	case '3': case '6':
+		if (!_pnm_number(p, length, &pos, &maxval) || maxval < 1 || maxval > 65535)
+			return false;
+		probe->channels = kind == '3' || kind == '6' ? 3 : 1;
+		probe->bits = maxval > 255 ? 16 : 8;
+		break;
+	case 'F': case 'f':
+		// the scale, whose sign is the byte order, follows
+		probe->channels = kind == 'F' ? 3 : 1;
+		probe->bits = 32;
+		break;
+	default:
+		return false;
+	}
+	return _set_size(probe, width, height);
+}
+
+//
+// textures
+//
+
+static bool _probe_texture(_reader_t* reader, image_probe_t* probe)
+{
+	const uint8_t* p = _bytes(reader, 0, 12);
+	texture_info_t info;
+	if (!p || !texture_probe(p, reader->length, &info) ||
+		!_set_size(probe, info.width, info.height))
+		return false;
+	if (p[0] == 'D')
+		probe->format = IMAGE_PROBE_DDS;
+	else
+		probe->format = p[5] == '1' ? IMAGE_PROBE_KTX : IMAGE_PROBE_KTX2;
+	snprintf(probe->pixel_format, sizeof(probe->pixel_format), "%s",
+		texture_format_name(info.format));
+	probe->bits = 8;
+	switch (info.format) {
+	case TEXTURE_BC4:
+		probe->channels = 1;
+		break;
+	case TEXTURE_BC5:
+		probe->channels = 2;
+		break;
+	case TEXTURE_BC6H:
+	case TEXTURE_BC6H_SIGNED:
+		probe->channels = 3;
+		probe->bits = 16;
+		break;
+	case TEXTURE_RGBX8:
+	case TEXTURE_BGRX8:
+		probe->channels = 3;
+		break;
+	default:
+		// BC1 may have punch-through alpha
+		probe->channels = 4;
+		probe->has_alpha = true;
+		break;
+	}
+	return true;
+}
+
+//
+// probing
+//
+
+static const uint8_t png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+bool image_probe(image_probe_read_t read, void* ctx, image_probe_t* out_probe)
+{
+	_reader_t reader;
+	reader.read = read;
+	reader.ctx = ctx;
+	reader.start = 0;
+	reader.length = 0;
+	reader.reads = 0;
+	memset(out_probe, 0, sizeof(*out_probe));
+
+	const uint8_t* p = _bytes(&reader, 0, 2);
+	if (!p)
+		return false;
+	size_t length = reader.length;
+	image_probe_format_t format = IMAGE_PROBE_UNKNOWN;
+	bool ok = false;
+	if (length >= 8 && !memcmp(p, png_signature, 8)) {
+		format = IMAGE_PROBE_PNG;
+		ok = _probe_png(&reader, out_probe);
+	} else if (length >= 3 && p[0] == 0xFF && p[1] == 0xD8 && p[2] == 0xFF) {
+		format = IMAGE_PROBE_JPEG;
+		ok = _probe_jpeg(&reader, out_probe);
+	} else if (p[0] == 'B' && p[1] == 'M') {
+		format = IMAGE_PROBE_BMP;
+		ok = _probe_bmp(&reader, out_probe);
+	} else if (length >= 4 && (!memcmp(p, "II*\0", 4) || !memcmp(p, "MM\0*", 4) ||
+		!memcmp(p, "II+\0", 4) || !memcmp(p, "MM\0+", 4))) {
+		format = IMAGE_PROBE_TIFF;
+		ok = _probe_tiff(&reader, out_probe);
+	} else if (length >= 6 && (!memcmp(p, "GIF87a", 6) || !memcmp(p, "GIF89a", 6))) {
+		format = IMAGE_PROBE_GIF;
+		ok = _probe_gif(&reader, out_probe);
+	} else if (texture_is_texture(p, length)) {
+		// sets the format, which the header tells apart
+		ok = _probe_texture(&reader, out_probe);
+		format = out_probe->format;
+	} else if (p[0] == 'P' && ((p[1] >= '1' && p[1] <= '7') || p[1] == 'F' || p[1] == 'f')) {
+		format = IMAGE_PROBE_PNM;
+		ok = _probe_pnm(&reader, out_probe);
+	}
+	if (!ok) {
+		memset(out_probe, 0, sizeof(*out_probe));
+		return false;
+	}
+	out_probe->format = format;
+	return true;
+}
+
+typedef struct {
+	const uint8_t* data;
+	size_t size;
+} _memory_t;
+
+static bool _read_memory(void* ctx, uint64_t offset, void* buffer, size_t size,
+	size_t* out_read)
+{
+	const _memory_t* memory = (const _memory_t*)ctx;
+	*out_read = 0;
+	if (offset >= memory->size)
+		return true;
+	if (size > memory->size - offset)
+		size = memory->size - (size_t)offset;
+	memcpy(buffer, memory->data + offset, size);
+	*out_read = size;
+	return true;
+}
+
+bool image_probe_memory(const void* data, size_t size, image_probe_t* out_probe)
+{
+	_memory_t memory = { (const uint8_t*)data, size };
+	return image_probe(_read_memory, &memory, out_probe);
+}
+
+const char* image_probe_format_name(image_probe_format_t format)
+{
+	switch (format) {
+	case IMAGE_PROBE_UNKNOWN: return "unknown";
+	case IMAGE_PROBE_PNG: return "PNG";
+	case IMAGE_PROBE_JPEG: return "JPEG";
+	case IMAGE_PROBE_BMP: return "BMP";
+	case IMAGE_PROBE_TIFF: return "TIFF";
+	case IMAGE_PROBE_GIF: return "GIF";
+	case IMAGE_PROBE_DDS: return "DDS";
+	case IMAGE_PROBE_KTX: return "KTX";
+	case IMAGE_PROBE_KTX2: return "KTX2";
+	case IMAGE_PROBE_PNM: return "PNM";
+	case IMAGE_PROBE_YUV: return "YUV";
+	}
+	return "unknown";
+}
+
+void image_probe_describe(const image_probe_t* probe, char* text, size_t text_count)
+{
+	const char* name = image_probe_format_name(probe->format);
+	if (probe->pixel_format[0]) {
+		snprintf(text, text_count, "%s %s", name, probe->pixel_format);
+		return;
+	}
+	const char* layout;
+	if (probe->palette)
+		layout = probe->has_alpha ? "indexed, transparent" : "indexed";
+	else if (probe->format == IMAGE_PROBE_JPEG)
+		layout = probe->channels == 1 ? "grey" : probe->channels == 3 ? "YCbCr" : "CMYK";
+	else if (probe->channels == 1)
+		layout = "grey";
+	else if (probe->channels == 2)
+		layout = probe->has_alpha ? "grey+alpha" : "2-channel";
+	else if (probe->channels == 3)
+		layout = "RGB";
+	else
+		layout = probe->has_alpha ? "RGBA" : "CMYK";
+	const char* interlaced = !probe->interlaced ? "" :
+		probe->format == IMAGE_PROBE_JPEG ? " progressive" : " interlaced";
+	snprintf(text, text_count, "%s %d-bit %s%s", name, probe->bits, layout, interlaced);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The size and pixel format of an image from its container header alone:
+// PNG, JPEG, BMP, TIFF and BigTIFF, GIF, DDS, KTX, KTX2 and the PNM family
+// (PBM, PGM, PPM, PAM and PFM).  Nothing is decoded, and the bytes come
+// through a reader in windows of IMAGE_PROBE_WINDOW, usually just one, a
+// few more where the header can be anywhere in the file, as with TIFF, or
+// behind metadata, as with JPEG, so a folder of thousands of files probes
+// in the time one of them would take to decode.  A probe holds no state
+// between calls, so any number of threads can probe at once.  Files are
+// read through image_probe_file.h.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define IMAGE_PROBE_WINDOW 4096
+
+typedef enum {
+	IMAGE_PROBE_UNKNOWN,
+	IMAGE_PROBE_PNG,
+	IMAGE_PROBE_JPEG,
+	IMAGE_PROBE_BMP,
+	IMAGE_PROBE_TIFF,
+	IMAGE_PROBE_GIF,
+	IMAGE_PROBE_DDS,
+	IMAGE_PROBE_KTX,
+	IMAGE_PROBE_KTX2,
+	IMAGE_PROBE_PNM,
+	IMAGE_PROBE_YUV,	// from the name, see yuv_file.h
+} image_probe_format_t;
+
+typedef struct {
+	image_probe_format_t format;
+	int width;
+	int height;
+	// colour channels, plus one if there's alpha. palette images count
+	// their palette's.
+	int channels;
+	// per channel, or per index for palette images, or per block texel
+	int bits;
+	bool has_alpha;
+	bool palette;
+	// progressive JPEG, Adam7 PNG or interlaced GIF
+	bool interlaced;
+	// for textures and YUV, e.g. "BC7" or "NV12", otherwise empty
+	char pixel_format[16];
+} image_probe_t;
+
+// reads up to size bytes at offset into buffer, fewer only at the end of
+// the file.  false on an error.
+typedef bool (*image_probe_read_t)(void* ctx, uint64_t offset, void* buffer,
+	size_t size, size_t* out_read);
+
+// false if the header isn't one of the formats, or is corrupt
+bool image_probe(image_probe_read_t read, void* ctx, image_probe_t* out_probe);
+// the same, of a file or its start in memory
+bool image_probe_memory(const void* data, size_t size, image_probe_t* out_probe);
+
+// "PNG" and so on
+const char* image_probe_format_name(image_probe_format_t format);
+// e.g. "PNG 8-bit RGBA", "JPEG 8-bit YCbCr progressive" or "DDS BC7"
+void image_probe_describe(const image_probe_t* probe, char* text, size_t text_count);
+
+#ifdef __cplusplus
+}
+#endif
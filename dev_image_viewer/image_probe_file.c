@@ -0,0 +1,49 @@
+#include "dev_image_viewer.h"
+
+#include <stdio.h>
+
+#include "image_probe_file.h"
+#include "yuv_file.h"
+
+// positioned reads, so the handle's file pointer is never shared state
+static bool _read_file(void* ctx, uint64_t offset, void* buffer, size_t size,
+	size_t* out_read)
+{
+	OVERLAPPED overlapped;
+	ZeroMemory(&overlapped, sizeof(overlapped));
+	overlapped.Offset = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD bytes_read = 0;
+	*out_read = 0;
+	if (!ReadFile((HANDLE)ctx, buffer, (DWORD)size, &bytes_read, &overlapped))
+		return GetLastError() == ERROR_HANDLE_EOF;
+	*out_read = bytes_read;
+	return true;
+}
+
+bool image_probe_file(const WCHAR* path, image_probe_t* out_probe)
+{
+	yuv_layout_t layout;
+	if (yuv_file_get_layout(path, &layout)) {
+		ZeroMemory(out_probe, sizeof(*out_probe));
+		out_probe->format = IMAGE_PROBE_YUV;
+		out_probe->width = layout.width;
+		out_probe->height = layout.height;
+		out_probe->channels = 3;
+		out_probe->bits = layout.format == YUV_P010 ? 10 : 8;
+		snprintf(out_probe->pixel_format, sizeof(out_probe->pixel_format), "%s",
+			yuv_format_name(layout.format));
+		return true;
+	}
+
+	HANDLE file = CreateFileW(path, GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		ZeroMemory(out_probe, sizeof(*out_probe));
+		return false;
+	}
+	bool ok = image_probe(_read_file, file, out_probe);
+	CloseHandle(file);
+	return ok;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+
+#include "image_probe.h"
+
+// Probes files on disk (see image_probe.h), and raw YUV files by their
+// names, which is all they have.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// false if the file can't be opened or isn't an image probe knows. safe on
+// any thread.
+bool image_probe_file(const WCHAR* path, image_probe_t* out_probe);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,95 @@
+#include "dev_image_viewer.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_stats.h"
+#include "parallel.h"
+#include "pixel_kernels.h"
+#include "trace.h"
+
+// partial histograms per thread. more than one, so the items balance.
+#define IMAGE_STATS_ITEMS_PER_THREAD 4
+
+typedef struct {
+	const uint32_t* pixels;
+	int width;
+	int height;
+	int num_items;
+	pixel_histogram_t* partials;
+} image_stats_job_t;
+
+static void _count_item(void* ctx, int index)
+{
+	image_stats_job_t* job = (image_stats_job_t*)ctx;
+	int y0 = (int)((int64_t)job->height * index / job->num_items);
+	int y1 = (int)((int64_t)job->height * (index + 1) / job->num_items);
+	// rows at a time, so no count passed to the kernel overflows an int
+	for (int y = y0; y < y1; y++) {
+		pixel_histogram_sse2(job->pixels + (size_t)y * job->width, job->width,
+			&job->partials[index]);
+	}
+}
+
+bool image_stats_compute(const uint32_t* pixels, int width, int height, bool baked,
+	image_stats_t* out_stats)
+{
+	// enough items that no partial's 32-bit counter can wrap
+	int num_items = parallel_get_num_threads() * IMAGE_STATS_ITEMS_PER_THREAD;
+	int min_items = (int)((uint64_t)width * height / UINT32_MAX) + 1;
+	num_items = max(num_items, min_items);
+	num_items = min(num_items, max(height, 1));
+
+	image_stats_job_t job;
+	job.pixels = pixels;
+	job.width = width;
+	job.height = height;
+	job.num_items = num_items;
+	job.partials = (pixel_histogram_t*)calloc(num_items, sizeof(pixel_histogram_t));
+	if (!job.partials)
+		return false;
+
+	uint64_t start = trace_begin();
+	parallel_for(num_items, _count_item, &job);
+
+	// the partials are in memory order, B, G, R, A
+	static const int channels[IMAGE_STATS_NUM_CHANNELS] = { 2, 1, 0, 3 };
+	ZeroMemory(out_stats, sizeof(*out_stats));
+	for (int i = 0; i < num_items; i++) {
+		for (int c = 0; c < IMAGE_STATS_NUM_CHANNELS; c++) {
+			const uint32_t* counts = job.partials[i].counts[channels[c]];
+			for (int v = 0; v < 256; v++)
+				out_stats->histogram[c][v] += counts[v];
+		}
+	}
+	free(job.partials);
+
+	out_stats->num_pixels = (uint64_t)width * height;
+	out_stats->baked = baked;
+	for (int c = 0; c < IMAGE_STATS_NUM_CHANNELS; c++) {
+		const uint64_t* histogram = out_stats->histogram[c];
+		double sum = 0, sum_squares = 0;
+		out_stats->min[c] = -1;
+		for (int v = 0; v < 256; v++) {
+			if (!histogram[v])
+				continue;
+			if (out_stats->min[c] < 0)
+				out_stats->min[c] = v;
+			out_stats->max[c] = v;
+			sum += (double)histogram[v] * v;
+			sum_squares += (double)histogram[v] * v * v;
+		}
+		if (out_stats->num_pixels) {
+			double mean = sum / out_stats->num_pixels;
+			double variance = sum_squares / out_stats->num_pixels - mean * mean;
+			out_stats->mean[c] = mean;
+			out_stats->stddev[c] = variance > 0 ? sqrt(variance) : 0;
+		}
+		else {
+			out_stats->min[c] = 0;
+		}
+	}
+	trace_end(TRACE_STATS, start, out_stats->num_pixels * 4, out_stats->num_pixels);
+	return true;
+}
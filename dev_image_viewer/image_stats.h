@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Per channel histograms and statistics of an image, for checking exposure
+// and quantization.  Rows are spread over parallel_for(), each item
+// counting into its own partial histogram with pixel_histogram_sse2(), and
+// the partials are merged at the end.  Min, max, mean and deviation come
+// from the merged histogram, so they cost nothing more.  Pixels are 8 bits
+// per channel by the time any decoder hands them over, so there are never
+// NaN or Inf values to count.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+	IMAGE_STATS_R,
+	IMAGE_STATS_G,
+	IMAGE_STATS_B,
+	IMAGE_STATS_A,
+	IMAGE_STATS_NUM_CHANNELS,
+};
+
+typedef struct {
+	uint64_t histogram[IMAGE_STATS_NUM_CHANNELS][256];
+	uint64_t num_pixels;
+	int min[IMAGE_STATS_NUM_CHANNELS];
+	int max[IMAGE_STATS_NUM_CHANNELS];
+	double mean[IMAGE_STATS_NUM_CHANNELS];
+	double stddev[IMAGE_STATS_NUM_CHANNELS];
+	// of the image as shown, over the background, rather than as decoded.
+	// images from the caches and the reload history are only kept baked.
+	bool baked;
+} image_stats_t;
+
+// pixels are top-down 32bpp premultiplied BGRA, tightly packed
+bool image_stats_compute(const uint32_t* pixels, int width, int height, bool baked,
+	image_stats_t* out_stats);
+
+#ifdef __cplusplus
+}
+#endif
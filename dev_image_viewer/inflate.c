@@ -0,0 +1,505 @@
+#include <string.h>
+
+#include "inflate.h"
+
+// bits of a code looked up at once. longer codes go on through a second
+// table, of as many more bits as the longest code there needs.
+#define INFLATE_LITLEN_BITS 11
+#define INFLATE_DIST_BITS 8
+#define INFLATE_CODELEN_BITS 7
+
+// a table entry is the code's length in bits 0-3, its extra bits, or those
+// of its second table, in 4-7, its kind in 8-10, and its value in 16-31:
+// a literal, the base of a length or distance, or where the second table
+// starts
+#define INFLATE_LITERAL 0x000
+#define INFLATE_MATCH 0x100
+#define INFLATE_END 0x200
+#define INFLATE_SUB 0x300
+#define INFLATE_INVALID 0x400
+#define INFLATE_KIND_MASK 0x700
+
+typedef enum {
+	_BLOCK,		// at a block header
+	_STORED,	// inside a stored block, with stored bytes left
+	_HUFFMAN,	// inside a compressed block, with its tables built
+	_DONE,
+} _state_t;
+
+// the codes being built
+typedef enum {
+	_LITLEN,
+	_DIST,
+	_CODELEN,
+} _alphabet_t;
+
+static const uint16_t length_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+};
+static const uint8_t length_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+};
+static const uint16_t dist_base[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+};
+static const uint8_t dist_extra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13,
+};
+
+// the order code length code lengths come in
+static const uint8_t codelen_order[19] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15,
+};
+
+// what decoding the symbol gives, but for the code's length
+static uint32_t _symbol_entry(_alphabet_t alphabet, int symbol)
+{
+	switch (alphabet) {
+	case _LITLEN:
+		if (symbol < 256)
+			return ((uint32_t)symbol << 16) | INFLATE_LITERAL;
+		if (symbol == 256)
+			return INFLATE_END;
+		if (symbol < 286) {
+			return ((uint32_t)length_base[symbol - 257] << 16) | INFLATE_MATCH |
+				(length_extra[symbol - 257] << 4);
+		}
+		return INFLATE_INVALID;
+	case _DIST:
+		if (symbol < 30)
+			return ((uint32_t)dist_base[symbol] << 16) | INFLATE_MATCH | (dist_extra[symbol] << 4);
+		return INFLATE_INVALID;
+	default:
+		return ((uint32_t)symbol << 16) | INFLATE_LITERAL;
+	}
+}
+
+static uint32_t _reverse(uint32_t code, int length)
+{
+	uint32_t result = 0;
+	for (int i = 0; i < length; i++, code >>= 1)
+		result = (result << 1) | (code & 1);
+	return result;
+}
+
+// the table of the canonical code with these lengths, as zlib's
+// inflate_table() lays it out.  codes left unused decode as invalid, so an
+// incomplete code is fine, but not one with too many codes of a length.
+static bool _build(uint32_t* table, size_t table_size, int root, _alphabet_t alphabet,
+	const uint8_t* lengths, int num_symbols)
+{
+	int counts[16] = { 0 };
+	for (int i = 0; i < num_symbols; i++)
+		counts[lengths[i]]++;
+	counts[0] = 0;
+	int left = 1;
+	int max_length = 0;
+	for (int length = 1; length <= 15; length++) {
+		left = (left << 1) - counts[length];
+		if (left < 0)
+			return false;
+		if (counts[length])
+			max_length = length;
+	}
+
+	// symbols by length, then by value, which is the codes' order
+	int offsets[16];
+	uint16_t sorted[288];
+	offsets[1] = 0;
+	for (int length = 1; length < 15; length++)
+		offsets[length + 1] = offsets[length] + counts[length];
+	for (int i = 0; i < num_symbols; i++) {
+		if (lengths[i])
+			sorted[offsets[lengths[i]]++] = (uint16_t)i;
+	}
+
+	size_t root_size = (size_t)1 << root;
+	for (size_t i = 0; i < root_size; i++)
+		table[i] = INFLATE_INVALID;
+	size_t used = root_size;
+	uint32_t sub_prefix = (uint32_t)-1;
+	size_t sub_start = 0;
+	int sub_bits = 0;
+	int remaining[16];
+	memcpy(remaining, counts, sizeof(remaining));
+	uint32_t code = 0;
+	int index = 0;
+	for (int length = 1; length <= max_length; length++, code <<= 1) {
+		for (int i = 0; i < counts[length]; i++, code++) {
+			uint32_t entry = _symbol_entry(alphabet, sorted[index++]) | (uint32_t)length;
+			// codes are stored from their first bit, which reads lowest
+			uint32_t reversed = _reverse(code, length);
+			if (length <= root) {
+				for (size_t j = reversed; j < root_size; j += (size_t)1 << length)
+					table[j] = entry;
+				remaining[length]--;
+				continue;
+			}
+			uint32_t prefix = reversed & (uint32_t)(root_size - 1);
+			if (prefix != sub_prefix) {
+				// as large as the longest code sharing the prefix needs
+				int bits = length - root;
+				int free = 1 << bits;
+				while (bits + root < max_length) {
+					free -= remaining[bits + root];
+					if (free <= 0)
+						break;
+					bits++;
+					free <<= 1;
+				}
+				if (used + ((size_t)1 << bits) > table_size)
+					return false;
+				sub_prefix = prefix;
+				sub_start = used;
+				sub_bits = bits;
+				used += (size_t)1 << bits;
+				for (size_t j = sub_start; j < used; j++)
+					table[j] = INFLATE_INVALID;
+				table[prefix] = ((uint32_t)sub_start << 16) | INFLATE_SUB |
+					((uint32_t)bits << 4) | (uint32_t)root;
+			}
+			for (size_t j = reversed >> root; j < ((size_t)1 << sub_bits);
+				j += (size_t)1 << (length - root))
+				table[sub_start + j] = entry;
+			remaining[length]--;
+		}
+	}
+	return true;
+}
+
+//
+// reading bits
+//
+
+// at least 56 bits. past the end of the input, zeros, though p moves on
+// as if read, so _byte_position() shows the overrun.
+static void _refill(inflate_t* inflate)
+{
+	if (inflate->p <= inflate->end) {
+		uint64_t word;
+		memcpy(&word, inflate->p, 8);
+		inflate->bits |= word << inflate->count;
+	}
+	inflate->p += (63 - inflate->count) >> 3;
+	inflate->count |= 56;
+}
+
+static uint32_t _take(inflate_t* inflate, int count)
+{
+	uint32_t value = (uint32_t)(inflate->bits & (((uint64_t)1 << count) - 1));
+	inflate->bits >>= count;
+	inflate->count -= count;
+	return value;
+}
+
+// the first byte not yet read, past any bits left of the current one
+static const uint8_t* _byte_position(inflate_t* inflate)
+{
+	return inflate->p - (inflate->count >> 3);
+}
+
+// the entry for the code at the bottom of bits, through its second table
+// if it has one
+static uint32_t _lookup(const uint32_t* table, int root, uint64_t bits)
+{
+	uint32_t entry = table[bits & ((1u << root) - 1)];
+	if ((entry & INFLATE_KIND_MASK) == INFLATE_SUB)
+		entry = table[(entry >> 16) + ((bits >> root) & ((1u << ((entry >> 4) & 0xF)) - 1))];
+	return entry;
+}
+
+static uint32_t _decode(inflate_t* inflate, const uint32_t* table, int root)
+{
+	uint32_t entry = _lookup(table, root, inflate->bits);
+	_take(inflate, entry & 0xF);
+	return entry;
+}
+
+//
+// block headers
+//
+
+static bool _read_fixed(inflate_t* inflate)
+{
+	uint8_t lengths[288];
+	memset(lengths, 8, 144);
+	memset(lengths + 144, 9, 112);
+	memset(lengths + 256, 7, 24);
+	memset(lengths + 280, 8, 8);
+	if (!_build(inflate->litlen, INFLATE_LITLEN_ENTRIES, INFLATE_LITLEN_BITS, _LITLEN,
+			lengths, 288))
+		return false;
+	memset(lengths, 5, 32);
+	return _build(inflate->dist, INFLATE_DIST_ENTRIES, INFLATE_DIST_BITS, _DIST,
+		lengths, 32);
+}
+
+static bool _read_dynamic(inflate_t* inflate)
+{
+	_refill(inflate);
+	int num_litlen = (int)_take(inflate, 5) + 257;
+	int num_dist = (int)_take(inflate, 5) + 1;
+	int num_codelen = (int)_take(inflate, 4) + 4;
+	if (num_litlen > 286 || num_dist > 30)
+		return false;
+
+	uint8_t codelen_lengths[19] = { 0 };
+	for (int i = 0; i < num_codelen; i++) {
+		_refill(inflate);
+		codelen_lengths[codelen_order[i]] = (uint8_t)_take(inflate, 3);
+	}
+	uint32_t codelen[1 << INFLATE_CODELEN_BITS];
+	if (!_build(codelen, 1 << INFLATE_CODELEN_BITS, INFLATE_CODELEN_BITS, _CODELEN,
+			codelen_lengths, 19))
+		return false;
+
+	// both codes' lengths run on as one list
+	uint8_t lengths[286 + 30];
+	int count = num_litlen + num_dist;
+	for (int i = 0; i < count;) {
+		_refill(inflate);
+		uint32_t entry = _decode(inflate, codelen, INFLATE_CODELEN_BITS);
+		if ((entry & INFLATE_KIND_MASK) != INFLATE_LITERAL)
+			return false;
+		int symbol = (int)(entry >> 16);
+		if (symbol < 16) {
+			lengths[i++] = (uint8_t)symbol;
+			continue;
+		}
+		int repeat;
+		uint8_t value = 0;
+		if (symbol == 16) {
+			if (i == 0)
+				return false;
+			value = lengths[i - 1];
+			repeat = 3 + (int)_take(inflate, 2);
+		}
+		else if (symbol == 17) {
+			repeat = 3 + (int)_take(inflate, 3);
+		}
+		else {
+			repeat = 11 + (int)_take(inflate, 7);
+		}
+		if (repeat > count - i)
+			return false;
+		memset(lengths + i, value, repeat);
+		i += repeat;
+	}
+	// a block must be able to end
+	if (!lengths[256])
+		return false;
+	return _build(inflate->litlen, INFLATE_LITLEN_ENTRIES, INFLATE_LITLEN_BITS, _LITLEN,
+			lengths, num_litlen) &&
+		_build(inflate->dist, INFLATE_DIST_ENTRIES, INFLATE_DIST_BITS, _DIST,
+			lengths + num_litlen, num_dist);
+}
+
+static bool _read_header(inflate_t* inflate)
+{
+	_refill(inflate);
+	inflate->last = _take(inflate, 1) != 0;
+	switch (_take(inflate, 2)) {
+	case 0: {
+		// from the next byte: the length and its complement
+		_take(inflate, inflate->count & 7);
+		const uint8_t* p = _byte_position(inflate);
+		inflate->bits = 0;
+		inflate->count = 0;
+		if (p + 4 > inflate->end)
+			return false;
+		uint32_t length = p[0] | ((uint32_t)p[1] << 8);
+		uint32_t complement = p[2] | ((uint32_t)p[3] << 8);
+		if ((length ^ 0xFFFF) != complement)
+			return false;
+		inflate->p = p + 4;
+		inflate->stored = length;
+		inflate->state = _STORED;
+		return true;
+	}
+	case 1:
+		inflate->state = _HUFFMAN;
+		return _read_fixed(inflate);
+	case 2:
+		inflate->state = _HUFFMAN;
+		return _read_dynamic(inflate);
+	default:
+		return false;
+	}
+}
+
+//
+// blocks
+//
+
+static inflate_result_t _copy_stored(inflate_t* inflate, uint8_t* out, size_t* out_pos,
+	size_t out_size)
+{
+	size_t count = inflate->stored;
+	if (count > out_size - *out_pos)
+		count = out_size - *out_pos;
+	if (count > (size_t)(inflate->end - inflate->p))
+		return INFLATE_ERROR;
+	memcpy(out + *out_pos, inflate->p, count);
+	inflate->p += count;
+	*out_pos += count;
+	inflate->stored -= (uint32_t)count;
+	if (inflate->stored)
+		return INFLATE_FULL;
+	inflate->state = _BLOCK;
+	return INFLATE_DONE;
+}
+
+// INFLATE_DONE at the end of the block
+static inflate_result_t _inflate_huffman(inflate_t* inflate, uint8_t* out,
+	size_t* out_pos, size_t out_size)
+{
+	// in locals, which writes to out can't alias
+	const uint8_t* p = inflate->p;
+	const uint8_t* end = inflate->end;
+	uint64_t bits = inflate->bits;
+	int count = inflate->count;
+	size_t pos = *out_pos;
+	const uint32_t* litlen = inflate->litlen;
+	const uint32_t* dist = inflate->dist;
+	inflate_result_t result = INFLATE_FULL;
+
+	while (out_size - pos >= INFLATE_MAX_SYMBOL) {
+		// the longest symbol and distance with their extra bits take 48
+		if (p <= end) {
+			uint64_t word;
+			memcpy(&word, p, 8);
+			bits |= word << count;
+		}
+		p += (63 - count) >> 3;
+		count |= 56;
+
+		// up to 3 literals take 45 bits, so they go without refilling in
+		// between. what follows them starts over, with a full buffer.
+		uint32_t entry = _lookup(litlen, INFLATE_LITLEN_BITS, bits);
+		if ((entry & INFLATE_KIND_MASK) == INFLATE_LITERAL) {
+			for (int i = 0; i < 3 && (entry & INFLATE_KIND_MASK) == INFLATE_LITERAL; i++) {
+				out[pos++] = (uint8_t)(entry >> 16);
+				bits >>= entry & 0xF;
+				count -= entry & 0xF;
+				entry = _lookup(litlen, INFLATE_LITLEN_BITS, bits);
+			}
+			continue;
+		}
+		bits >>= entry & 0xF;
+		count -= entry & 0xF;
+		uint32_t kind = entry & INFLATE_KIND_MASK;
+		if (kind != INFLATE_MATCH) {
+			result = kind == INFLATE_END ? INFLATE_DONE : INFLATE_ERROR;
+			break;
+		}
+		int extra = (entry >> 4) & 0xF;
+		uint32_t length = (entry >> 16) + (uint32_t)(bits & ((1u << extra) - 1));
+		bits >>= extra;
+		count -= extra;
+
+		entry = _lookup(dist, INFLATE_DIST_BITS, bits);
+		bits >>= entry & 0xF;
+		count -= entry & 0xF;
+		if ((entry & INFLATE_KIND_MASK) != INFLATE_MATCH) {
+			result = INFLATE_ERROR;
+			break;
+		}
+		extra = (entry >> 4) & 0xF;
+		uint32_t distance = (entry >> 16) + (uint32_t)(bits & ((1u << extra) - 1));
+		bits >>= extra;
+		count -= extra;
+		if (distance > pos) {
+			result = INFLATE_ERROR;
+			break;
+		}
+
+		uint8_t* dest = out + pos;
+		uint8_t* stop = dest + length;
+		const uint8_t* src = dest - distance;
+		pos += length;
+		if (distance == 1) {
+			memset(dest, src[0], length);
+			continue;
+		}
+		if (distance < 8) {
+			// a repeat shorter than a word, like a run of one pixel: its
+			// bytes one at a time, until a multiple of it a word or more
+			// long is written, which words are then copied from
+			uint32_t period = distance * ((distance + 7) / distance);
+			uint32_t prelude = period - distance < length ? period - distance : length;
+			for (uint32_t i = 0; i < prelude; i++)
+				dest[i] = src[i];
+			dest += prelude;
+			src = dest - period;
+		}
+		// each word is written before the next one reads it, so
+		// overlapping is fine. up to 7 bytes past the match are written,
+		// which the next symbols overwrite.
+		while (dest < stop) {
+			uint64_t word;
+			memcpy(&word, src, 8);
+			memcpy(dest, &word, 8);
+			src += 8;
+			dest += 8;
+		}
+	}
+
+	inflate->p = p;
+	inflate->bits = bits;
+	inflate->count = count;
+	*out_pos = pos;
+	if (result == INFLATE_DONE)
+		inflate->state = _BLOCK;
+	return result;
+}
+
+bool inflate_init(inflate_t* inflate, const uint8_t* src, size_t size)
+{
+	// deflate, a window of at most 32K, and no preset dictionary
+	if (size < 2 || (src[0] & 0x0F) != 8 || (src[0] >> 4) > 7 ||
+		((src[0] << 8) | src[1]) % 31 != 0 || (src[1] & 0x20))
+		return false;
+	inflate->p = src + 2;
+	inflate->end = src + size;
+	inflate->bits = 0;
+	inflate->count = 0;
+	inflate->state = _BLOCK;
+	inflate->last = false;
+	inflate->stored = 0;
+	return true;
+}
+
+inflate_result_t inflate_run(inflate_t* inflate, uint8_t* out, size_t* out_pos,
+	size_t out_size)
+{
+	for (;;) {
+		inflate_result_t result;
+		switch (inflate->state) {
+		case _BLOCK:
+			if (inflate->last) {
+				inflate->state = _DONE;
+				continue;
+			}
+			if (!_read_header(inflate))
+				return INFLATE_ERROR;
+			continue;
+		case _STORED:
+			result = _copy_stored(inflate, out, out_pos, out_size);
+			break;
+		case _HUFFMAN:
+			result = _inflate_huffman(inflate, out, out_pos, out_size);
+			break;
+		default:
+			return INFLATE_DONE;
+		}
+		// a truncated stream reads as zeros, caught here
+		if (result == INFLATE_ERROR || _byte_position(inflate) > inflate->end)
+			return INFLATE_ERROR;
+		if (result == INFLATE_FULL)
+			return INFLATE_FULL;
+	}
+}
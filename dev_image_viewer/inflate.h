@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// zlib streams (RFC 1950 and 1951) inflated a piece at a time into the
+// caller's buffer, for png_decoder.c.  Huffman codes are looked up through
+// two-level tables, 11 bits at a time for literals and lengths and 8 for
+// distances, from a 64-bit bit buffer refilled once per symbol, and matches
+// are copied 8 bytes at a time.  The Adler-32 isn't checked.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// bytes past the end of the input that must be readable, of any value
+#define INFLATE_PADDING 8
+// writable bytes the output must have past out_size, for whole-word copies
+#define INFLATE_SLACK 16
+// the most one symbol writes. inflate_run() stops for space when less than
+// this is left.
+#define INFLATE_MAX_SYMBOL 258
+// how far back a match reaches, at most
+#define INFLATE_WINDOW 32768
+
+// sizes of the tables, enough for any complete code (see zlib's enough.c)
+#define INFLATE_LITLEN_ENTRIES 2342
+#define INFLATE_DIST_ENTRIES 402
+
+typedef enum {
+	INFLATE_ERROR,
+	// stopped for space. call again once the output has more.
+	INFLATE_FULL,
+	INFLATE_DONE,
+} inflate_result_t;
+
+typedef struct {
+	const uint8_t* p;
+	const uint8_t* end;
+	uint64_t bits;
+	int count;
+	// what the stream is in the middle of
+	int state;
+	bool last;
+	uint32_t stored;
+	uint32_t litlen[INFLATE_LITLEN_ENTRIES];
+	uint32_t dist[INFLATE_DIST_ENTRIES];
+} inflate_t;
+
+// src is the whole zlib stream, with INFLATE_PADDING bytes after it, and
+// must outlive the inflate. false if its header isn't zlib's deflate.
+bool inflate_init(inflate_t* inflate, const uint8_t* src, size_t size);
+
+// inflates into out from *out_pos, up to out_size, and moves *out_pos past
+// what it wrote.  matches reach back into out as far as out[0], so the
+// caller keeps the last INFLATE_WINDOW bytes written there, or all of them,
+// when it makes room.
+inflate_result_t inflate_run(inflate_t* inflate, uint8_t* out, size_t* out_pos,
+	size_t out_size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,927 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "jpeg_decoder.h"
+
+#define JPEG_MAX_COMPONENTS 3
+#define JPEG_MAX_SAMPLING 4
+// bits of a Huffman code looked up at once; longer codes are searched
+#define JPEG_FAST_BITS 9
+
+// the integer IDCT's fixed point, as in libjpeg's jidctint.c
+#define JPEG_CONST_BITS 13
+#define JPEG_PASS1_BITS 2
+#define FIX(x) ((int)((x) * (1 << JPEG_CONST_BITS) + 0.5))
+// the largest dequantized coefficient that 8-bit samples give.  corrupt
+// ones are clamped to it, which keeps the IDCT's products within an int.
+#define JPEG_MAX_COEF 1024
+
+// natural order of the coefficients, by their order in the file
+static const uint8_t zigzag[64] = {
+	0, 1, 8, 16, 9, 2, 3, 10,
+	17, 24, 32, 25, 18, 11, 4, 5,
+	12, 19, 26, 33, 40, 48, 41, 34,
+	27, 20, 13, 6, 7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36,
+	29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46,
+	53, 60, 61, 54, 47, 55, 62, 63,
+};
+
+typedef struct {
+	// (length << 8) | symbol, by the next JPEG_FAST_BITS bits, for codes
+	// that short. 0 for longer ones.
+	uint16_t fast[1 << JPEG_FAST_BITS];
+	// the largest code of each length. symbols[code + delta[length]] is
+	// the code's symbol.
+	int maxcode[17];
+	int delta[17];
+	uint8_t symbols[256];
+	bool defined;
+} _huffman_t;
+
+typedef struct {
+	int id;
+	int h;
+	int v;
+	int quant;
+	int dc_table;
+	int ac_table;
+} _component_t;
+
+struct jpeg_decoder_t {
+	// of the file
+	size_t size;
+	int width;
+	int height;
+	int num_components;
+	_component_t components[JPEG_MAX_COMPONENTS];
+	bool rgb;	// not YCbCr
+	// in natural order
+	uint16_t quant[4][64];
+	bool quant_defined[4];
+	_huffman_t dc[4];
+	_huffman_t ac[4];
+
+	int max_h;
+	int max_v;
+	int mcu_width;
+	int mcu_height;
+	int mcus_x;
+	int mcus_y;
+	// in MCUs, 0 without restart markers
+	int restart_interval;
+	// only the first scan, of DC scaled down by dc_shift, is decoded
+	bool progressive;
+	int dc_shift;
+	// where the entropy-coded data starts
+	size_t scan;
+	// where each restart interval's data starts, or NULL if they aren't
+	// all there
+	size_t* restarts;
+};
+
+static int _be16(const uint8_t* p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+//
+// headers
+//
+
+static bool _build_huffman(_huffman_t* huffman, const uint8_t* counts,
+	const uint8_t* symbols, int num_symbols)
+{
+	memset(huffman->fast, 0, sizeof(huffman->fast));
+	memcpy(huffman->symbols, symbols, num_symbols);
+	int code = 0;
+	int k = 0;
+	for (int length = 1; length <= 16; length++) {
+		huffman->delta[length] = k - code;
+		for (int i = 0; i < counts[length - 1]; i++, k++, code++) {
+			if (length > JPEG_FAST_BITS)
+				continue;
+			int first = code << (JPEG_FAST_BITS - length);
+			int count = 1 << (JPEG_FAST_BITS - length);
+			for (int j = 0; j < count; j++)
+				huffman->fast[first + j] = (uint16_t)((length << 8) | symbols[k]);
+		}
+		if (code > (1 << length))
+			return false;
+		huffman->maxcode[length] = code - 1;
+		code <<= 1;
+	}
+	huffman->defined = true;
+	return true;
+}
+
+static bool _parse_dqt(jpeg_decoder_t* decoder, const uint8_t* p, size_t length)
+{
+	while (length > 0) {
+		int precision = p[0] >> 4;
+		int table = p[0] & 15;
+		size_t bytes = 1 + 64 * (precision ? 2 : 1);
+		if (table > 3 || precision > 1 || length < bytes)
+			return false;
+		for (int i = 0; i < 64; i++) {
+			decoder->quant[table][zigzag[i]] = (uint16_t)(precision ?
+				_be16(p + 1 + i * 2) : p[1 + i]);
+		}
+		decoder->quant_defined[table] = true;
+		p += bytes;
+		length -= bytes;
+	}
+	return true;
+}
+
+static bool _parse_dht(jpeg_decoder_t* decoder, const uint8_t* p, size_t length)
+{
+	while (length > 0) {
+		if (length < 17)
+			return false;
+		int table_class = p[0] >> 4;
+		int table = p[0] & 15;
+		int num_symbols = 0;
+		for (int i = 0; i < 16; i++)
+			num_symbols += p[1 + i];
+		if (table_class > 1 || table > 3 || num_symbols > 256 ||
+			length < 17 + (size_t)num_symbols)
+			return false;
+		_huffman_t* huffman = table_class ? &decoder->ac[table] : &decoder->dc[table];
+		if (!_build_huffman(huffman, p + 1, p + 17, num_symbols))
+			return false;
+		p += 17 + num_symbols;
+		length -= 17 + num_symbols;
+	}
+	return true;
+}
+
+static bool _parse_sof(jpeg_decoder_t* decoder, const uint8_t* p, size_t length)
+{
+	if (length < 6 || p[0] != 8)
+		return false;
+	decoder->height = _be16(p + 1);
+	decoder->width = _be16(p + 3);
+	decoder->num_components = p[5];
+	if (decoder->width == 0 || decoder->height == 0 ||
+		(decoder->num_components != 1 && decoder->num_components != 3) ||
+		length < 6 + 3 * (size_t)decoder->num_components)
+		return false;
+	for (int i = 0; i < decoder->num_components; i++) {
+		_component_t* component = &decoder->components[i];
+		component->id = p[6 + i * 3];
+		component->h = p[7 + i * 3] >> 4;
+		component->v = p[7 + i * 3] & 15;
+		component->quant = p[8 + i * 3];
+		if (component->h < 1 || component->h > JPEG_MAX_SAMPLING ||
+			component->v < 1 || component->v > JPEG_MAX_SAMPLING || component->quant > 3)
+			return false;
+	}
+	return true;
+}
+
+static bool _parse_sos(jpeg_decoder_t* decoder, const uint8_t* p, size_t length)
+{
+	// one scan of every component
+	int n = decoder->num_components;
+	if (length < 1 || p[0] != n || length < 4 + 2 * (size_t)n)
+		return false;
+	for (int i = 0; i < n; i++) {
+		_component_t* component = &decoder->components[i];
+		if (p[1 + i * 2] != component->id)
+			return false;
+		component->dc_table = p[2 + i * 2] >> 4;
+		component->ac_table = p[2 + i * 2] & 15;
+		if (component->dc_table > 3 || component->ac_table > 3 ||
+			!decoder->dc[component->dc_table].defined ||
+			(!decoder->progressive && !decoder->ac[component->ac_table].defined) ||
+			!decoder->quant_defined[component->quant])
+			return false;
+	}
+	// a progressive file's first scan must be the first pass of DC
+	if (decoder->progressive) {
+		if (p[1 + n * 2] != 0 || p[2 + n * 2] != 0 || (p[3 + n * 2] >> 4) != 0)
+			return false;
+		decoder->dc_shift = p[3 + n * 2] & 15;
+	}
+	return true;
+}
+
+// the start of each restart interval, found by the markers before them
+static void _index_restarts(jpeg_decoder_t* decoder, const uint8_t* data)
+{
+	int num_mcus = decoder->mcus_x * decoder->mcus_y;
+	int count = (num_mcus + decoder->restart_interval - 1) / decoder->restart_interval;
+	size_t* restarts = (size_t*)malloc(count * sizeof(size_t));
+	if (!restarts)
+		return;
+	restarts[0] = decoder->scan;
+	int found = 1;
+	size_t pos = decoder->scan;
+	while (found < count && pos + 1 < decoder->size) {
+		const uint8_t* ff = (const uint8_t*)memchr(data + pos, 0xFF,
+			decoder->size - pos - 1);
+		if (!ff)
+			break;
+		pos = ff - data;
+		int marker = data[pos + 1];
+		if (marker >= 0xD0 && marker <= 0xD7) {
+			restarts[found++] = pos + 2;
+			pos += 2;
+		}
+		else if (marker == 0xD9) {
+			break;
+		}
+		else {
+			// stuffed zero, or fill before a marker
+			pos++;
+		}
+	}
+	if (found < count) {
+		free(restarts);
+		return;
+	}
+	decoder->restarts = restarts;
+}
+
+jpeg_decoder_t* jpeg_decoder_open(const uint8_t* data, size_t size)
+{
+	if (size < 4 || data[0] != 0xFF || data[1] != 0xD8)
+		return NULL;
+	jpeg_decoder_t* decoder = (jpeg_decoder_t*)calloc(1, sizeof(jpeg_decoder_t));
+	if (!decoder)
+		return NULL;
+	decoder->size = size;
+
+	bool have_frame = false;
+	int adobe_transform = -1;
+	size_t pos = 2;
+	bool ok = true;
+	while (ok && !decoder->scan) {
+		if (pos + 4 > size || data[pos] != 0xFF) {
+			ok = false;
+			break;
+		}
+		int marker = data[pos + 1];
+		if (marker == 0xFF) {
+			pos++;
+			continue;
+		}
+		size_t length = (size_t)_be16(data + pos + 2);
+		if (length < 2 || pos + 2 + length > size) {
+			ok = false;
+			break;
+		}
+		const uint8_t* p = data + pos + 4;
+		length -= 2;
+		switch (marker) {
+		case 0xDB:
+			ok = _parse_dqt(decoder, p, length);
+			break;
+		case 0xC4:
+			ok = _parse_dht(decoder, p, length);
+			break;
+		case 0xC0:	// baseline
+		case 0xC1:	// extended, which is the same at 8 bits
+		case 0xC2:	// progressive, of which only the first scan
+			ok = !have_frame && _parse_sof(decoder, p, length);
+			have_frame = true;
+			decoder->progressive = marker == 0xC2;
+			break;
+		case 0xDD:
+			ok = length >= 2;
+			if (ok)
+				decoder->restart_interval = _be16(p);
+			break;
+		case 0xEE:
+			if (length >= 12 && !memcmp(p, "Adobe", 5))
+				adobe_transform = p[11];
+			break;
+		case 0xDA:
+			ok = have_frame && _parse_sos(decoder, p, length);
+			decoder->scan = pos + 4 + length;
+			break;
+		default:
+			// other frame types, arithmetic coding, and the end
+			ok = !(marker >= 0xC2 && marker <= 0xCF) && marker != 0xD9;
+			break;
+		}
+		pos += 4 + length;
+	}
+	if (!ok) {
+		free(decoder);
+		return NULL;
+	}
+
+	// a single component is coded a block at a time, whatever its sampling
+	if (decoder->num_components == 1) {
+		decoder->components[0].h = 1;
+		decoder->components[0].v = 1;
+	}
+	decoder->max_h = 1;
+	decoder->max_v = 1;
+	for (int i = 0; i < decoder->num_components; i++) {
+		if (decoder->components[i].h > decoder->max_h)
+			decoder->max_h = decoder->components[i].h;
+		if (decoder->components[i].v > decoder->max_v)
+			decoder->max_v = decoder->components[i].v;
+	}
+	decoder->mcu_width = decoder->max_h * 8;
+	decoder->mcu_height = decoder->max_v * 8;
+	decoder->mcus_x = (decoder->width + decoder->mcu_width - 1) / decoder->mcu_width;
+	decoder->mcus_y = (decoder->height + decoder->mcu_height - 1) / decoder->mcu_height;
+	decoder->rgb = decoder->num_components == 3 && (adobe_transform == 0 ||
+		(decoder->components[0].id == 'R' && decoder->components[1].id == 'G' &&
+		decoder->components[2].id == 'B'));
+	if (decoder->restart_interval)
+		_index_restarts(decoder, data);
+	return decoder;
+}
+
+void jpeg_decoder_free(jpeg_decoder_t* decoder)
+{
+	if (!decoder)
+		return;
+	free(decoder->restarts);
+	free(decoder);
+}
+
+void jpeg_decoder_get_size(const jpeg_decoder_t* decoder, int* out_width,
+	int* out_height)
+{
+	*out_width = decoder->width;
+	*out_height = decoder->height;
+}
+
+bool jpeg_decoder_has_restarts(const jpeg_decoder_t* decoder)
+{
+	return decoder->restarts != NULL;
+}
+
+int jpeg_decoder_get_band_height(const jpeg_decoder_t* decoder)
+{
+	if (!decoder->restart_interval)
+		return decoder->mcu_height;
+	// intervals end at the end of a row of MCUs every
+	// lcm(interval, mcus_x) / mcus_x rows
+	int a = decoder->restart_interval;
+	int b = decoder->mcus_x;
+	while (b) {
+		int r = a % b;
+		a = b;
+		b = r;
+	}
+	return decoder->restart_interval / a * decoder->mcu_height;
+}
+
+bool jpeg_decoder_is_progressive(const jpeg_decoder_t* decoder)
+{
+	return decoder->progressive;
+}
+
+//
+// entropy decoding
+//
+
+typedef struct {
+	const uint8_t* p;
+	const uint8_t* end;
+	// left aligned
+	uint32_t buffer;
+	int count;
+} _bits_t;
+
+static void _bits_init(_bits_t* bits, const uint8_t* data, size_t size, size_t offset)
+{
+	bits->p = data + offset;
+	bits->end = data + size;
+	bits->buffer = 0;
+	bits->count = 0;
+}
+
+// at least 25 bits. a marker ends the data, and zeros follow.
+static void _fill(_bits_t* bits)
+{
+	while (bits->count <= 24) {
+		uint32_t byte = 0;
+		if (bits->p < bits->end) {
+			byte = bits->p[0];
+			if (byte != 0xFF)
+				bits->p++;
+			else if (bits->p + 1 < bits->end && bits->p[1] == 0)
+				bits->p += 2;
+			else
+				byte = 0;
+		}
+		bits->buffer |= byte << (24 - bits->count);
+		bits->count += 8;
+	}
+}
+
+static void _consume(_bits_t* bits, int count)
+{
+	bits->buffer <<= count;
+	bits->count -= count;
+}
+
+// past the restart marker the reader stopped at
+static void _restart(_bits_t* bits)
+{
+	const uint8_t* p = bits->p;
+	while (p + 1 < bits->end && !(p[0] == 0xFF && p[1] >= 0xD0 && p[1] <= 0xD7))
+		p++;
+	bits->p = p + 1 < bits->end ? p + 2 : bits->end;
+	bits->buffer = 0;
+	bits->count = 0;
+}
+
+static int _decode_huffman(_bits_t* bits, const _huffman_t* huffman)
+{
+	_fill(bits);
+	int entry = huffman->fast[bits->buffer >> (32 - JPEG_FAST_BITS)];
+	if (entry) {
+		_consume(bits, entry >> 8);
+		return entry & 0xFF;
+	}
+	for (int length = JPEG_FAST_BITS + 1; length <= 16; length++) {
+		int code = (int)(bits->buffer >> (32 - length));
+		if (code <= huffman->maxcode[length]) {
+			_consume(bits, length);
+			return huffman->symbols[code + huffman->delta[length]];
+		}
+	}
+	return -1;
+}
+
+// a size-bit value, with its sign as JPEG codes it
+static int _receive_extend(_bits_t* bits, int size)
+{
+	if (size == 0)
+		return 0;
+	_fill(bits);
+	int value = (int)(bits->buffer >> (32 - size));
+	_consume(bits, size);
+	if (value < (1 << (size - 1)))
+		value -= (1 << size) - 1;
+	return value;
+}
+
+// ac is NULL for a progressive DC scan
+static bool _decode_block(_bits_t* bits, const _huffman_t* dc, const _huffman_t* ac,
+	int* pred, int16_t* coefs)
+{
+	memset(coefs, 0, 64 * sizeof(int16_t));
+	int size = _decode_huffman(bits, dc);
+	if (size < 0 || size > 15)
+		return false;
+	*pred += _receive_extend(bits, size);
+	coefs[0] = (int16_t)*pred;
+	for (int k = 1; ac && k < 64;) {
+		int symbol = _decode_huffman(bits, ac);
+		if (symbol < 0)
+			return false;
+		int run = symbol >> 4;
+		size = symbol & 15;
+		if (size == 0) {
+			// end of block, or 16 zeros
+			if (run != 15)
+				break;
+			k += 16;
+			continue;
+		}
+		k += run;
+		if (k > 63)
+			return false;
+		coefs[zigzag[k]] = (int16_t)_receive_extend(bits, size);
+		k++;
+	}
+	return true;
+}
+
+//
+// IDCT
+//
+
+// one dimension of the IDCT, from in[0], in[step], ... to out, descaled
+// by shift
+#define IDCT_1D(in0, in1, in2, in3, in4, in5, in6, in7, OUT, shift, bias) \
+	do { \
+		int z2 = (in2), z3 = (in6); \
+		int z1 = (z2 + z3) * FIX(0.541196100); \
+		int tmp2 = z1 - z3 * FIX(1.847759065); \
+		int tmp3 = z1 + z2 * FIX(0.765366865); \
+		z2 = (in0); \
+		z3 = (in4); \
+		int tmp0 = (z2 + z3) * (1 << JPEG_CONST_BITS) + (bias); \
+		int tmp1 = (z2 - z3) * (1 << JPEG_CONST_BITS) + (bias); \
+		int tmp10 = tmp0 + tmp3; \
+		int tmp13 = tmp0 - tmp3; \
+		int tmp11 = tmp1 + tmp2; \
+		int tmp12 = tmp1 - tmp2; \
+		tmp0 = (in7); \
+		tmp1 = (in5); \
+		tmp2 = (in3); \
+		tmp3 = (in1); \
+		z1 = tmp0 + tmp3; \
+		z2 = tmp1 + tmp2; \
+		z3 = tmp0 + tmp2; \
+		int z4 = tmp1 + tmp3; \
+		int z5 = (z3 + z4) * FIX(1.175875602); \
+		tmp0 *= FIX(0.298631336); \
+		tmp1 *= FIX(2.053119869); \
+		tmp2 *= FIX(3.072711026); \
+		tmp3 *= FIX(1.501321110); \
+		z1 *= -FIX(0.899976223); \
+		z2 *= -FIX(2.562915447); \
+		z3 = z3 * -FIX(1.961570560) + z5; \
+		z4 = z4 * -FIX(0.390180644) + z5; \
+		tmp0 += z1 + z3; \
+		tmp1 += z2 + z4; \
+		tmp2 += z2 + z3; \
+		tmp3 += z1 + z4; \
+		OUT(0, (tmp10 + tmp3) >> (shift)); \
+		OUT(7, (tmp10 - tmp3) >> (shift)); \
+		OUT(1, (tmp11 + tmp2) >> (shift)); \
+		OUT(6, (tmp11 - tmp2) >> (shift)); \
+		OUT(2, (tmp12 + tmp1) >> (shift)); \
+		OUT(5, (tmp12 - tmp1) >> (shift)); \
+		OUT(3, (tmp13 + tmp0) >> (shift)); \
+		OUT(4, (tmp13 - tmp0) >> (shift)); \
+	} while (0)
+
+static uint8_t _clamp(int value)
+{
+	return value < 0 ? 0 : value > 255 ? 255 : (uint8_t)value;
+}
+
+static int _dequantize(int coef, int quant)
+{
+	int value = coef * quant;
+	return value < -JPEG_MAX_COEF ? -JPEG_MAX_COEF :
+		value > JPEG_MAX_COEF ? JPEG_MAX_COEF : value;
+}
+
+// dequantizes and transforms a block into 8x8 samples of out
+static void _idct(const int16_t* coefs, const uint16_t* quant, uint8_t* out, int stride)
+{
+	int work[64];
+	for (int x = 0; x < 8; x++) {
+		const int16_t* c = coefs + x;
+		const uint16_t* q = quant + x;
+		int* w = work + x;
+		// columns of only DC are common
+		if (!c[8] && !c[16] && !c[24] && !c[32] && !c[40] && !c[48] && !c[56]) {
+			int dc = _dequantize(c[0], q[0]) * (1 << JPEG_PASS1_BITS);
+			for (int k = 0; k < 8; k++)
+				w[k * 8] = dc;
+			continue;
+		}
+#define COLUMN_OUT(k, value) w[(k) * 8] = (value)
+		IDCT_1D(_dequantize(c[0], q[0]), _dequantize(c[8], q[8]),
+			_dequantize(c[16], q[16]), _dequantize(c[24], q[24]),
+			_dequantize(c[32], q[32]), _dequantize(c[40], q[40]),
+			_dequantize(c[48], q[48]), _dequantize(c[56], q[56]),
+			COLUMN_OUT, JPEG_CONST_BITS - JPEG_PASS1_BITS,
+			1 << (JPEG_CONST_BITS - JPEG_PASS1_BITS - 1));
+#undef COLUMN_OUT
+	}
+	// rows, with the rounding and the level shift of 128 folded into the
+	// bias
+	const int shift = JPEG_CONST_BITS + JPEG_PASS1_BITS + 3;
+	const int bias = (1 << (shift - 1)) + (128 << shift);
+	for (int y = 0; y < 8; y++) {
+		const int* w = work + y * 8;
+		uint8_t* o = out + (size_t)y * stride;
+#define ROW_OUT(k, value) o[k] = _clamp(value)
+		IDCT_1D(w[0], w[1], w[2], w[3], w[4], w[5], w[6], w[7], ROW_OUT, shift, bias);
+#undef ROW_OUT
+	}
+}
+
+// the low size x size coefficients of a block, 4 or 2, transformed into that
+// many samples each way, which are close to the averages of the full
+// block's 8 / size samples.  the cosines of a size point IDCT, scaled as the
+// 8 point one is.
+static const int _reduced_cos4[4][4] = {
+	{ FIX(0.353553391), FIX(0.461939766), FIX(0.353553391), FIX(0.191341716) },
+	{ FIX(0.353553391), FIX(0.191341716), -FIX(0.353553391), -FIX(0.461939766) },
+	{ FIX(0.353553391), -FIX(0.191341716), -FIX(0.353553391), FIX(0.461939766) },
+	{ FIX(0.353553391), -FIX(0.461939766), FIX(0.353553391), -FIX(0.191341716) },
+};
+static const int _reduced_cos2[2][2] = {
+	{ FIX(0.353553391), FIX(0.353553391) },
+	{ FIX(0.353553391), -FIX(0.353553391) },
+};
+
+static void _idct_reduced(const int16_t* coefs, const uint16_t* quant, int size,
+	uint8_t* out, int stride)
+{
+	if (size == 1) {
+		// only DC, which is 8 times the average
+		int dc = _dequantize(coefs[0], quant[0]);
+		out[0] = _clamp(((dc + 4) >> 3) + 128);
+		return;
+	}
+	const int* cos = size == 4 ? &_reduced_cos4[0][0] : &_reduced_cos2[0][0];
+	int work[16];
+	for (int x = 0; x < size; x++) {
+		int in[4];
+		for (int u = 0; u < size; u++)
+			in[u] = _dequantize(coefs[u * 8 + x], quant[u * 8 + x]);
+		for (int i = 0; i < size; i++) {
+			int sum = 1 << (JPEG_CONST_BITS - JPEG_PASS1_BITS - 1);
+			for (int u = 0; u < size; u++)
+				sum += cos[i * size + u] * in[u];
+			work[i * size + x] = sum >> (JPEG_CONST_BITS - JPEG_PASS1_BITS);
+		}
+	}
+	const int shift = JPEG_CONST_BITS + JPEG_PASS1_BITS;
+	const int bias = (1 << (shift - 1)) + (128 << shift);
+	for (int y = 0; y < size; y++) {
+		const int* w = work + y * size;
+		uint8_t* o = out + (size_t)y * stride;
+		for (int i = 0; i < size; i++) {
+			int sum = bias;
+			for (int u = 0; u < size; u++)
+				sum += cos[i * size + u] * w[u];
+			o[i] = _clamp(sum >> shift);
+		}
+	}
+}
+
+//
+// rectangles
+//
+
+// the samples of a row of MCUs, from MCU column x0 on, of the image scaled
+// by 1 / 2^shift.  each component's blocks are transformed into
+// 8 >> shifts[i] samples each way, which for subsampled chroma is less
+// reduced, so it isn't coarser than it has to be.
+typedef struct {
+	uint8_t* planes[JPEG_MAX_COMPONENTS];
+	int strides[JPEG_MAX_COMPONENTS];
+	int x0;
+	int shift;
+	int shifts[JPEG_MAX_COMPONENTS];
+} _band_t;
+
+// where the entropy decoding is, between MCUs
+typedef struct {
+	const jpeg_decoder_t* decoder;
+	const uint8_t* data;
+	_bits_t bits;
+	int preds[JPEG_MAX_COMPONENTS];
+	// the next MCU, or -1 before the first
+	int mcu;
+	// at the start of an interval, with the reader already past its marker
+	bool fresh;
+	int16_t coefs[64];
+} _cursor_t;
+
+static void _cursor_jump(_cursor_t* cursor, int interval)
+{
+	const jpeg_decoder_t* decoder = cursor->decoder;
+	_bits_init(&cursor->bits, cursor->data, decoder->size,
+		interval ? decoder->restarts[interval] : decoder->scan);
+	memset(cursor->preds, 0, sizeof(cursor->preds));
+	cursor->mcu = interval * decoder->restart_interval;
+	cursor->fresh = true;
+}
+
+// decodes the next MCU, into band at MCU column x if band isn't NULL
+static bool _decode_mcu(_cursor_t* cursor, const _band_t* band, int x)
+{
+	const jpeg_decoder_t* decoder = cursor->decoder;
+	if (decoder->restart_interval && !cursor->fresh &&
+		cursor->mcu % decoder->restart_interval == 0) {
+		_restart(&cursor->bits);
+		memset(cursor->preds, 0, sizeof(cursor->preds));
+	}
+	cursor->fresh = false;
+	for (int i = 0; i < decoder->num_components; i++) {
+		const _component_t* component = &decoder->components[i];
+		for (int v = 0; v < component->v; v++) {
+			for (int h = 0; h < component->h; h++) {
+				if (!_decode_block(&cursor->bits, &decoder->dc[component->dc_table],
+					decoder->progressive ? NULL : &decoder->ac[component->ac_table],
+					&cursor->preds[i], cursor->coefs))
+					return false;
+				if (!band)
+					continue;
+				cursor->coefs[0] = (int16_t)(cursor->coefs[0] * (1 << decoder->dc_shift));
+				int size = 8 >> band->shifts[i];
+				uint8_t* out = band->planes[i] + (size_t)v * size * band->strides[i] +
+					((size_t)(x - band->x0) * component->h + h) * size;
+				if (band->shifts[i]) {
+					_idct_reduced(cursor->coefs, decoder->quant[component->quant], size,
+						out, band->strides[i]);
+				}
+				else {
+					_idct(cursor->coefs, decoder->quant[component->quant], out,
+						band->strides[i]);
+				}
+			}
+		}
+	}
+	cursor->mcu++;
+	return true;
+}
+
+// gets the cursor to mcu, from the restart interval it's in if it can
+static bool _seek(_cursor_t* cursor, int mcu)
+{
+	const jpeg_decoder_t* decoder = cursor->decoder;
+	if (decoder->restarts) {
+		int interval = mcu / decoder->restart_interval;
+		if (cursor->mcu < 0 || cursor->mcu > mcu ||
+			interval > cursor->mcu / decoder->restart_interval)
+			_cursor_jump(cursor, interval);
+	}
+	else if (cursor->mcu < 0 || cursor->mcu > mcu) {
+		_cursor_jump(cursor, 0);
+	}
+	while (cursor->mcu < mcu) {
+		if (!_decode_mcu(cursor, NULL, 0))
+			return false;
+	}
+	return true;
+}
+
+// the first of x0 + i * step at or past from
+static int _first_sample(int from, int x0, int step)
+{
+	return from <= x0 ? x0 : x0 + (from - x0 + step - 1) / step * step;
+}
+
+static uint32_t _ycc_to_bgra(int y, int cb, int cr)
+{
+	cb -= 128;
+	cr -= 128;
+	int r = y + ((91881 * cr + 32768) >> 16);
+	int g = y + ((-22554 * cb - 46802 * cr + 32768) >> 16);
+	int b = y + ((116130 * cb + 32768) >> 16);
+	return 0xFF000000 | ((uint32_t)_clamp(r) << 16) | ((uint32_t)_clamp(g) << 8) |
+		_clamp(b);
+}
+
+// the average of the rx x ry samples from x in row, which are more than
+// one where a component is sampled finer than the reduced luma
+static int _average(const uint8_t* row, int stride, int x, int rx, int ry)
+{
+	if (rx == 1 && ry == 1)
+		return row[x];
+	int sum = 0;
+	for (int j = 0; j < ry; j++) {
+		for (int i = 0; i < rx; i++)
+			sum += row[(size_t)j * stride + x + i];
+	}
+	int count = rx * ry;
+	return (sum + count / 2) / count;
+}
+
+// samples from row y of the band, which is in its MCU row
+static void _convert_row(const jpeg_decoder_t* decoder, const _band_t* band, int y,
+	int x0, int step, int count, uint32_t* dest)
+{
+	const uint8_t* rows[JPEG_MAX_COMPONENTS];
+	int h[JPEG_MAX_COMPONENTS];
+	int rx[JPEG_MAX_COMPONENTS];
+	int ry[JPEG_MAX_COMPONENTS];
+	for (int i = 0; i < decoder->num_components; i++) {
+		const _component_t* component = &decoder->components[i];
+		// samples per MCU, relative to the band's
+		int scale = band->shift - band->shifts[i];
+		h[i] = component->h << scale;
+		rx[i] = h[i] > decoder->max_h ? h[i] / decoder->max_h : 1;
+		ry[i] = (component->v << scale) > decoder->max_v ?
+			(component->v << scale) / decoder->max_v : 1;
+		rows[i] = band->planes[i] +
+			(size_t)(y * (component->v << scale) / decoder->max_v) * band->strides[i];
+	}
+	int band_x = band->x0 * (decoder->mcu_width >> band->shift);
+	if (decoder->num_components == 1) {
+		for (int i = 0; i < count; i++) {
+			uint32_t grey = rows[0][x0 + i * step - band_x];
+			dest[i] = 0xFF000000 | (grey * 0x010101);
+		}
+		return;
+	}
+	for (int i = 0; i < count; i++) {
+		int x = x0 + i * step - band_x;
+		int a = _average(rows[0], band->strides[0], x * h[0] / decoder->max_h, rx[0],
+			ry[0]);
+		int b = _average(rows[1], band->strides[1], x * h[1] / decoder->max_h, rx[1],
+			ry[1]);
+		int c = _average(rows[2], band->strides[2], x * h[2] / decoder->max_h, rx[2],
+			ry[2]);
+		dest[i] = decoder->rgb ?
+			0xFF000000 | ((uint32_t)a << 16) | ((uint32_t)b << 8) | (uint32_t)c :
+			_ycc_to_bgra(a, b, c);
+	}
+}
+
+void jpeg_decoder_get_reduced_size(const jpeg_decoder_t* decoder, int shift,
+	int* out_width, int* out_height)
+{
+	*out_width = (decoder->width + (1 << shift) - 1) >> shift;
+	*out_height = (decoder->height + (1 << shift) - 1) >> shift;
+}
+
+// rows_fn, if not NULL, is called after each row of MCUs
+static bool _read(const jpeg_decoder_t* decoder, const uint8_t* data, int shift,
+	int x0, int y0, int x1, int y1, int step, uint32_t* dest, int stride,
+	jpeg_decoder_rows_fn rows_fn, void* ctx)
+{
+	int width, height;
+	// a progressive file's DC is all there is
+	if (shift < 0 || shift > 3 || (decoder->progressive && shift != 3))
+		return false;
+	jpeg_decoder_get_reduced_size(decoder, shift, &width, &height);
+	if (x0 < 0 || y0 < 0 || x1 > width || y1 > height || x0 >= x1 || y0 >= y1 ||
+		step < 1)
+		return false;
+	// an MCU's size in the reduced image
+	int mcu_width = decoder->mcu_width >> shift;
+	int mcu_height = decoder->mcu_height >> shift;
+	int mcu_x0 = x0 / mcu_width;
+	int mcu_x1 = (x1 - 1) / mcu_width + 1;
+	int mcu_y0 = y0 / mcu_height;
+	int mcu_y1 = (y1 - 1) / mcu_height + 1;
+	int count = (x1 - x0 + step - 1) / step;
+
+	_band_t band;
+	memset(&band, 0, sizeof(band));
+	band.x0 = mcu_x0;
+	band.shift = shift;
+	bool ok = true;
+	for (int i = 0; ok && i < decoder->num_components; i++) {
+		const _component_t* component = &decoder->components[i];
+		// reduced less till it's no coarser than the luma either way, so
+		// 4:2:2 chroma keeps its rows too
+		int reduce = shift;
+		while (reduce > 0 && ((component->h << (shift - reduce)) < decoder->max_h ||
+			(component->v << (shift - reduce)) < decoder->max_v))
+			reduce--;
+		band.shifts[i] = reduce;
+		int block = 8 >> reduce;
+		band.strides[i] = (mcu_x1 - mcu_x0) * component->h * block;
+		band.planes[i] = (uint8_t*)malloc((size_t)band.strides[i] * component->v * block);
+		ok = band.planes[i] != NULL;
+	}
+	_cursor_t* cursor = (_cursor_t*)malloc(sizeof(_cursor_t));
+	ok = ok && cursor;
+	if (cursor) {
+		cursor->decoder = decoder;
+		cursor->data = data;
+		cursor->mcu = -1;
+	}
+
+	for (int mcu_y = mcu_y0; ok && mcu_y < mcu_y1; mcu_y++) {
+		// rows of MCUs without a sample row are skipped
+		int top = mcu_y * mcu_height;
+		int bottom = top + mcu_height < y1 ? top + mcu_height : y1;
+		int y = _first_sample(top, y0, step);
+		if (y >= bottom)
+			continue;
+		ok = _seek(cursor, mcu_y * decoder->mcus_x + mcu_x0);
+		for (int mcu_x = mcu_x0; ok && mcu_x < mcu_x1; mcu_x++) {
+			// as are the IDCTs of MCUs without a sample column
+			int left = mcu_x * mcu_width;
+			bool sampled = _first_sample(left, x0, step) < left + mcu_width;
+			ok = _decode_mcu(cursor, sampled ? &band : NULL, mcu_x);
+		}
+		int row0 = (y - y0) / step;
+		for (; ok && y < bottom; y += step) {
+			_convert_row(decoder, &band, y - top, x0, step, count,
+				dest + (size_t)((y - y0) / step) * stride);
+		}
+		if (ok && rows_fn)
+			ok = rows_fn(ctx, row0, (y - y0) / step);
+	}
+
+	free(cursor);
+	for (int i = 0; i < decoder->num_components; i++)
+		free(band.planes[i]);
+	return ok;
+}
+
+bool jpeg_decoder_read(const jpeg_decoder_t* decoder, const uint8_t* data,
+	int x0, int y0, int x1, int y1, int step, uint32_t* dest, int stride)
+{
+	return _read(decoder, data, 0, x0, y0, x1, y1, step, dest, stride, NULL, NULL);
+}
+
+bool jpeg_decoder_read_reduced(const jpeg_decoder_t* decoder, const uint8_t* data,
+	int shift, int x0, int y0, int x1, int y1, int step, uint32_t* dest, int stride)
+{
+	return _read(decoder, data, shift, x0, y0, x1, y1, step, dest, stride, NULL,
+		NULL);
+}
+
+bool jpeg_decoder_read_rows(const jpeg_decoder_t* decoder, const uint8_t* data,
+	uint32_t* dest, int stride, jpeg_decoder_rows_fn rows_fn, void* ctx)
+{
+	return _read(decoder, data, 0, 0, 0, decoder->width, decoder->height, 1, dest,
+		stride, rows_fn, ctx);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Baseline JPEG, decoded a rectangle at a time, for images too large to
+// decode whole.  With restart markers, each interval of MCUs decodes on
+// its own, so a rectangle costs only the intervals it crosses; the markers
+// are indexed when the file is opened.  Without them, everything before a
+// rectangle is entropy decoded to reach it, which is only sensible for
+// reading the whole image.  Sequential Huffman 8-bit files with one
+// interleaved scan, in greyscale, YCbCr or RGB, are supported; arithmetic
+// and CMYK files aren't.  Of a progressive file, only the first scan, of
+// DC, is read, for a preview at 1/8 scale.  The IDCT is the usual 13-bit integer
+// one, and chroma is upsampled by repeating it.
+//
+// Minified, each 8x8 block can be transformed straight into 4x4, 2x2 or
+// 1x1 samples from its lowest frequencies, which costs a fraction of the
+// full IDCT and of the memory, and gives about what averaging the full
+// samples would.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct jpeg_decoder_t jpeg_decoder_t;
+
+// data is the whole file. NULL if it isn't a JPEG that can be decoded.
+// the tables are copied out, and the restart intervals indexed by offset.
+jpeg_decoder_t* jpeg_decoder_open(const uint8_t* data, size_t size);
+void jpeg_decoder_free(jpeg_decoder_t* decoder);
+
+void jpeg_decoder_get_size(const jpeg_decoder_t* decoder, int* out_width,
+	int* out_height);
+// whether a rectangle can be decoded without what comes before it
+bool jpeg_decoder_has_restarts(const jpeg_decoder_t* decoder);
+// if so, only jpeg_decoder_read_reduced() at shift 3 reads it
+bool jpeg_decoder_is_progressive(const jpeg_decoder_t* decoder);
+
+// the fewest rows that read together decode nothing twice: those whole
+// restart intervals cover, else a row of MCUs
+int jpeg_decoder_get_band_height(const jpeg_decoder_t* decoder);
+
+// the pixels at x0 + i * step, y0 + j * step inside [x0, x1) x [y0, y1),
+// into rows of dest stride pixels apart, as opaque BGRA.  data is the same
+// bytes the decoder was opened with, at any address.  safe to call from
+// several threads at once.
+bool jpeg_decoder_read(const jpeg_decoder_t* decoder, const uint8_t* data,
+	int x0, int y0, int x1, int y1, int step, uint32_t* dest, int stride);
+
+// the size of the image scaled by 1 / 2^shift, rounded up as the canvas's
+// levels are
+void jpeg_decoder_get_reduced_size(const jpeg_decoder_t* decoder, int shift,
+	int* out_width, int* out_height);
+// as jpeg_decoder_read(), of the image scaled by 1 / 2^shift, for shift 0
+// to 3, and with the coordinates in it
+bool jpeg_decoder_read_reduced(const jpeg_decoder_t* decoder, const uint8_t* data,
+	int shift, int x0, int y0, int x1, int y1, int step, uint32_t* dest, int stride);
+
+// told that rows [y0, y1) of dest are done. false stops the read, which
+// then fails.
+typedef bool (*jpeg_decoder_rows_fn)(void* ctx, int y0, int y1);
+// the whole image, top to bottom, as jpeg_decoder_read(), telling rows_fn
+// after each row of MCUs, so what's done can show while the rest decodes.
+// without restart markers, this is the only way to read the whole image
+// without decoding its start over and over.
+bool jpeg_decoder_read_rows(const jpeg_decoder_t* decoder, const uint8_t* data,
+	uint32_t* dest, int stride, jpeg_decoder_rows_fn rows_fn, void* ctx);
+
+#ifdef __cplusplus
+}
+#endif
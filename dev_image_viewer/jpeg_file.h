@@ -0,0 +1,23 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+
+// Baseline JPEG files decoded with jpeg_decoder.h straight into a DIB
+// section, scaled by 1/2, 1/4 or 1/8 in the IDCT.  The canvas opens very
+// large photos this way at the level it first shows, which takes a
+// fraction of the full decode's time and memory, and decodes them in full
+// only once zoomed in past that level.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the image scaled by 1 / 2^shift, shift 0 to 3, as opaque BGRA.  false if
+// the file isn't a JPEG jpeg_decoder.h reads.
+bool jpeg_file_read_reduced(const WCHAR* path, int shift, HBITMAP* out_hbitmap,
+	void** out_bits, int* out_width, int* out_height);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,562 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "live_feed.h"
+
+#define LIVE_FEED_MAGIC 0x464C5644	// "DVLF"
+#define LIVE_FEED_VERSION 1
+// the newest frame, the one before it for a reader that is still busy with
+// it, and one being written
+#define LIVE_FEED_NUM_SLOTS 3
+// the header is the first page, and each slot starts on a page
+#define LIVE_FEED_PAGE 4096
+
+typedef struct {
+	// 2 * frame while the slot holds that frame, odd while being written
+	volatile uint32_t sequence;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;
+	uint32_t format;
+	uint32_t reserved;
+	uint64_t publish_ns;
+} live_feed_slot_t;
+
+// the shared layout. only ever grows at the end, with a new version.
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_slots;
+	uint32_t reserved;
+	uint64_t slot_size;
+	// the newest complete frame, 0 before the first. the futex word on
+	// Linux.
+	volatile uint32_t frame;
+	uint32_t reserved2;
+	live_feed_slot_t slots[LIVE_FEED_NUM_SLOTS];
+} live_feed_header_t;
+
+struct live_feed_t {
+	bool producer;
+	live_feed_header_t* header;
+	uint64_t size;
+	// producer: the frame between live_feed_begin_frame() and publish
+	uint32_t writing;
+#ifdef _WIN32
+	HANDLE mapping;
+	HANDLE event;
+#else
+	int fd;
+	char shm_name[LIVE_FEED_MAX_NAME + 32];
+#endif
+};
+
+static uint64_t _now_ns()
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, counter;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)((double)counter.QuadPart * 1e9 / freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// orders the slot contents against the sequence numbers
+static void _fence()
+{
+#ifdef _WIN32
+	MemoryBarrier();
+#else
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+#endif
+}
+
+static bool _valid_name(const char* name)
+{
+	size_t length = name ? strlen(name) : 0;
+	if (!length || length > LIVE_FEED_MAX_NAME)
+		return false;
+	for (size_t i = 0; i < length; i++) {
+		char c = name[i];
+		if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+			(c >= '0' && c <= '9') || c == '_' || c == '-'))
+			return false;
+	}
+	return true;
+}
+
+static int _bytes_per_pixel(uint32_t format)
+{
+	switch (format) {
+	case LIVE_FEED_BGRA8_PREMULTIPLIED:
+	case LIVE_FEED_RGBA8:
+		return 4;
+	case LIVE_FEED_RGBA32F:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+// the consumer doesn't trust the producer's numbers
+static bool _valid_frame(const live_feed_header_t* header, uint32_t width,
+	uint32_t height, uint32_t stride, uint32_t format)
+{
+	int bpp = _bytes_per_pixel(format);
+	return bpp && width && height && width <= 65536 && height <= 65536 &&
+		stride >= (uint64_t)width * bpp &&
+		(uint64_t)stride * height <= header->slot_size;
+}
+
+static uint8_t* _slot_pixels(live_feed_t* feed, uint32_t frame)
+{
+	return (uint8_t*)feed->header + LIVE_FEED_PAGE +
+		feed->header->slot_size * (frame % LIVE_FEED_NUM_SLOTS);
+}
+
+static void _signal(live_feed_t* feed)
+{
+#ifdef _WIN32
+	SetEvent(feed->event);
+#else
+	syscall(SYS_futex, &feed->header->frame, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
+
+#ifdef _WIN32
+static void _object_name(const char* name, const char* suffix, char* out,
+	size_t out_size)
+{
+	snprintf(out, out_size, "Local\\dev_image_viewer_live_%s%s", name, suffix);
+}
+
+static bool _map(live_feed_t* feed, const char* name)
+{
+	char mapping_name[LIVE_FEED_MAX_NAME + 64];
+	char event_name[LIVE_FEED_MAX_NAME + 64];
+	_object_name(name, "", mapping_name, sizeof(mapping_name));
+	_object_name(name, "_frame", event_name, sizeof(event_name));
+
+	if (feed->producer) {
+		feed->mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL,
+			PAGE_READWRITE, (DWORD)(feed->size >> 32), (DWORD)feed->size,
+			mapping_name);
+		if (feed->mapping && GetLastError() == ERROR_ALREADY_EXISTS) {
+			// another producer has the name
+			CloseHandle(feed->mapping);
+			feed->mapping = NULL;
+		}
+		if (feed->mapping)
+			feed->event = CreateEventA(NULL, FALSE, FALSE, event_name);
+	}
+	else {
+		feed->mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, mapping_name);
+		if (feed->mapping)
+			feed->event = OpenEventA(SYNCHRONIZE, FALSE, event_name);
+	}
+	if (!feed->mapping || !feed->event)
+		return false;
+
+	feed->header = (live_feed_header_t*)MapViewOfFile(feed->mapping,
+		feed->producer ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+	if (!feed->header)
+		return false;
+	if (!feed->producer) {
+		MEMORY_BASIC_INFORMATION info;
+		if (!VirtualQuery(feed->header, &info, sizeof(info)))
+			return false;
+		feed->size = info.RegionSize;
+	}
+	return true;
+}
+
+static void _unmap(live_feed_t* feed)
+{
+	if (feed->header)
+		UnmapViewOfFile(feed->header);
+	if (feed->mapping)
+		CloseHandle(feed->mapping);
+	if (feed->event)
+		CloseHandle(feed->event);
+}
+#else
+static bool _map(live_feed_t* feed, const char* name)
+{
+	snprintf(feed->shm_name, sizeof(feed->shm_name),
+		"/dev_image_viewer_live_%s", name);
+
+	if (feed->producer) {
+		// a name left behind by a producer that crashed is replaced
+		shm_unlink(feed->shm_name);
+		feed->fd = shm_open(feed->shm_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+		if (feed->fd < 0)
+			return false;
+		if (ftruncate(feed->fd, (off_t)feed->size)) {
+			shm_unlink(feed->shm_name);
+			return false;
+		}
+	}
+	else {
+		feed->fd = shm_open(feed->shm_name, O_RDONLY, 0);
+		struct stat st;
+		if (feed->fd < 0 || fstat(feed->fd, &st))
+			return false;
+		feed->size = (uint64_t)st.st_size;
+		if (feed->size < LIVE_FEED_PAGE)
+			return false;
+	}
+
+	void* memory = mmap(NULL, (size_t)feed->size,
+		feed->producer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+		feed->fd, 0);
+	if (memory == MAP_FAILED) {
+		if (feed->producer)
+			shm_unlink(feed->shm_name);
+		return false;
+	}
+	feed->header = (live_feed_header_t*)memory;
+	return true;
+}
+
+static void _unmap(live_feed_t* feed)
+{
+	if (feed->header)
+		munmap(feed->header, (size_t)feed->size);
+	if (feed->fd >= 0) {
+		close(feed->fd);
+		if (feed->producer)
+			shm_unlink(feed->shm_name);
+	}
+}
+#endif
+
+static live_feed_t* _new_feed(bool producer)
+{
+	live_feed_t* feed = (live_feed_t*)calloc(1, sizeof(live_feed_t));
+	if (!feed)
+		return NULL;
+	feed->producer = producer;
+#ifndef _WIN32
+	feed->fd = -1;
+#endif
+	return feed;
+}
+
+live_feed_t* live_feed_create(const char* name, uint64_t max_frame_bytes)
+{
+	if (!_valid_name(name) || !max_frame_bytes)
+		return NULL;
+	live_feed_t* feed = _new_feed(true);
+	if (!feed)
+		return NULL;
+
+	uint64_t slot_size = (max_frame_bytes + LIVE_FEED_PAGE - 1) &
+		~(uint64_t)(LIVE_FEED_PAGE - 1);
+	feed->size = LIVE_FEED_PAGE + slot_size * LIVE_FEED_NUM_SLOTS;
+	if (!_map(feed, name)) {
+		live_feed_close(feed);
+		return NULL;
+	}
+
+	live_feed_header_t* header = feed->header;
+	header->version = LIVE_FEED_VERSION;
+	header->num_slots = LIVE_FEED_NUM_SLOTS;
+	header->slot_size = slot_size;
+	header->frame = 0;
+	_fence();
+	// last, so a consumer never sees a half written header as valid
+	header->magic = LIVE_FEED_MAGIC;
+	return feed;
+}
+
+void* live_feed_begin_frame(live_feed_t* feed)
+{
+	if (!feed || !feed->producer)
+		return NULL;
+	uint32_t frame = feed->header->frame + 1;
+	feed->header->slots[frame % LIVE_FEED_NUM_SLOTS].sequence = frame * 2 - 1;
+	_fence();
+	feed->writing = frame;
+	return _slot_pixels(feed, frame);
+}
+
+bool live_feed_publish(live_feed_t* feed, int width, int height, int stride,
+	live_feed_format_t format)
+{
+	if (!feed || !feed->producer || !feed->writing || width <= 0 ||
+		height <= 0 || stride <= 0 ||
+		!_valid_frame(feed->header, width, height, stride, format))
+		return false;
+
+	uint32_t frame = feed->writing;
+	live_feed_slot_t* slot = &feed->header->slots[frame % LIVE_FEED_NUM_SLOTS];
+	slot->width = width;
+	slot->height = height;
+	slot->stride = stride;
+	slot->format = format;
+	slot->publish_ns = _now_ns();
+	_fence();
+	slot->sequence = frame * 2;
+	_fence();
+	feed->header->frame = frame;
+	_fence();
+	feed->writing = 0;
+	_signal(feed);
+	return true;
+}
+
+live_feed_t* live_feed_open(const char* name)
+{
+	if (!_valid_name(name))
+		return NULL;
+	live_feed_t* feed = _new_feed(false);
+	if (!feed)
+		return NULL;
+	if (!_map(feed, name)) {
+		live_feed_close(feed);
+		return NULL;
+	}
+
+	const live_feed_header_t* header = feed->header;
+	bool valid = header->magic == LIVE_FEED_MAGIC;
+	_fence();
+	valid = valid && header->version == LIVE_FEED_VERSION &&
+		header->num_slots == LIVE_FEED_NUM_SLOTS &&
+		header->slot_size <= (feed->size - LIVE_FEED_PAGE) / LIVE_FEED_NUM_SLOTS;
+	if (!valid) {
+		live_feed_close(feed);
+		return NULL;
+	}
+	return feed;
+}
+
+void* live_feed_event(live_feed_t* feed)
+{
+#ifdef _WIN32
+	return feed ? feed->event : NULL;
+#else
+	(void)feed;
+	return NULL;
+#endif
+}
+
+bool live_feed_wait(live_feed_t* feed, uint32_t last_frame, int timeout_ms)
+{
+#ifdef _WIN32
+	uint64_t deadline = GetTickCount64() + timeout_ms;
+	while (feed->header->frame == last_frame) {
+		uint64_t now = GetTickCount64();
+		if (now >= deadline ||
+			WaitForSingleObject(feed->event, (DWORD)(deadline - now)) != WAIT_OBJECT_0)
+			return feed->header->frame != last_frame;
+	}
+	return true;
+#else
+	struct timespec timeout;
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_nsec = (long)(timeout_ms % 1000) * 1000000;
+	while (feed->header->frame == last_frame) {
+		// returns at once if the frame moved on since the check
+		if (syscall(SYS_futex, &feed->header->frame, FUTEX_WAIT, last_frame,
+			&timeout, NULL, 0) && errno == ETIMEDOUT)
+			return feed->header->frame != last_frame;
+	}
+	return true;
+#endif
+}
+
+bool live_feed_latest(live_feed_t* feed, live_feed_frame_t* out)
+{
+	// a few tries, in case the producer laps the slot while it's read
+	for (int attempt = 0; attempt < 4; attempt++) {
+		uint32_t frame = feed->header->frame;
+		_fence();
+		if (!frame)
+			return false;
+		const live_feed_slot_t* slot = &feed->header->slots[frame % LIVE_FEED_NUM_SLOTS];
+		uint32_t sequence = slot->sequence;
+		_fence();
+		uint32_t width = slot->width;
+		uint32_t height = slot->height;
+		uint32_t stride = slot->stride;
+		uint32_t format = slot->format;
+		uint64_t publish_ns = slot->publish_ns;
+		_fence();
+		if (sequence != frame * 2 || slot->sequence != sequence)
+			continue;
+		if (!_valid_frame(feed->header, width, height, stride, format))
+			return false;
+
+		out->frame = frame;
+		out->width = width;
+		out->height = height;
+		out->stride = stride;
+		out->format = (live_feed_format_t)format;
+		out->latency_seconds = (_now_ns() - publish_ns) * 1e-9;
+		return true;
+	}
+	return false;
+}
+
+static uint32_t _premultiply(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+{
+	return (a << 24) | ((r * a / 255) << 16) | ((g * a / 255) << 8) | (b * a / 255);
+}
+
+static uint32_t _unit_to_byte(float value)
+{
+	if (!(value > 0))	// and NaN
+		return 0;
+	if (value >= 1)
+		return 255;
+	return (uint32_t)(value * 255 + 0.5f);
+}
+
+bool live_feed_read_bgra(live_feed_t* feed, const live_feed_frame_t* frame,
+	uint32_t* dest)
+{
+	const uint8_t* src = _slot_pixels(feed, frame->frame);
+	for (int y = 0; y < frame->height; y++) {
+		const uint8_t* row = src + (size_t)y * frame->stride;
+		uint32_t* out = dest + (size_t)y * frame->width;
+		switch (frame->format) {
+		case LIVE_FEED_BGRA8_PREMULTIPLIED:
+			memcpy(out, row, (size_t)frame->width * 4);
+			break;
+		case LIVE_FEED_RGBA8:
+			for (int x = 0; x < frame->width; x++) {
+				const uint8_t* p = row + x * 4;
+				out[x] = _premultiply(p[0], p[1], p[2], p[3]);
+			}
+			break;
+		case LIVE_FEED_RGBA32F:
+			for (int x = 0; x < frame->width; x++) {
+				const float* p = (const float*)(row + (size_t)x * 16);
+				out[x] = _premultiply(_unit_to_byte(p[0]), _unit_to_byte(p[1]),
+					_unit_to_byte(p[2]), _unit_to_byte(p[3]));
+			}
+			break;
+		}
+	}
+	_fence();
+	return feed->header->slots[frame->frame % LIVE_FEED_NUM_SLOTS].sequence ==
+		frame->frame * 2;
+}
+
+void live_feed_close(live_feed_t* feed)
+{
+	if (!feed)
+		return;
+	_unmap(feed);
+	free(feed);
+}
+
+#ifdef LIVE_FEED_MAIN
+static void _sleep_ms(int ms)
+{
+#ifdef _WIN32
+	Sleep(ms);
+#else
+	struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000 };
+	nanosleep(&ts, NULL);
+#endif
+}
+
+// publishes a scrolling pattern at about 60 frames per second
+static int _produce(const char* name, int num_frames)
+{
+	const int width = 640, height = 480;
+	live_feed_t* feed = live_feed_create(name, (uint64_t)width * height * 4);
+	if (!feed) {
+		fprintf(stderr, "can't create feed %s\n", name);
+		return 1;
+	}
+	for (int i = 0; i < num_frames; i++) {
+		uint8_t* pixels = (uint8_t*)live_feed_begin_frame(feed);
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				uint8_t* p = pixels + ((size_t)y * width + x) * 4;
+				p[0] = (uint8_t)(x + i);
+				p[1] = (uint8_t)(y + i * 2);
+				p[2] = (uint8_t)((x ^ y) + i);
+				p[3] = 255;
+			}
+		}
+		live_feed_publish(feed, width, height, width * 4, LIVE_FEED_RGBA8);
+		_sleep_ms(16);
+	}
+	live_feed_close(feed);
+	return 0;
+}
+
+// shows each frame seen, and its latency
+static int _watch(const char* name, int num_frames)
+{
+	live_feed_t* feed = live_feed_open(name);
+	if (!feed) {
+		fprintf(stderr, "no feed %s\n", name);
+		return 1;
+	}
+	uint32_t* pixels = NULL;
+	uint32_t last_frame = 0;
+	int seen = 0, torn = 0;
+	double max_latency = 0;
+	while (seen < num_frames && live_feed_wait(feed, last_frame, 2000)) {
+		live_feed_frame_t frame;
+		if (!live_feed_latest(feed, &frame))
+			continue;
+		uint32_t* resized = (uint32_t*)realloc(pixels, (size_t)frame.width * frame.height * 4);
+		if (!resized)
+			break;
+		pixels = resized;
+		if (!live_feed_read_bgra(feed, &frame, pixels)) {
+			torn++;
+			continue;
+		}
+		if (frame.latency_seconds > max_latency)
+			max_latency = frame.latency_seconds;
+		printf("frame %u %dx%d latency %.3f ms skipped %u\n", frame.frame,
+			frame.width, frame.height, frame.latency_seconds * 1000,
+			frame.frame - last_frame - 1);
+		last_frame = frame.frame;
+		seen++;
+	}
+	printf("%d frames, %d torn reads retried, max latency %.3f ms\n", seen,
+		torn, max_latency * 1000);
+	free(pixels);
+	live_feed_close(feed);
+	return seen ? 0 : 1;
+}
+
+int main(int argc, char** argv)
+{
+	int num_frames = argc > 3 ? atoi(argv[3]) : 600;
+	if (argc > 2 && !strcmp(argv[1], "produce"))
+		return _produce(argv[2], num_frames);
+	if (argc > 2 && !strcmp(argv[1], "watch"))
+		return _watch(argv[2], num_frames);
+	fprintf(stderr, "usage: live_feed produce|watch <name> [frames]\n");
+	return 2;
+}
+#endif
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// A feed of frames from another process through shared memory, so a
+// renderer can show its output without writing image files.  The producer
+// creates the feed by name and publishes frames into a ring of slots; the
+// viewer, started with --live <name>, maps the same memory and shows the
+// newest frame whenever it is signaled.  Publishing never waits for the
+// viewer: a slow viewer skips frames, rather than holding the producer up.
+//
+// Producer side, which only needs this header and live_feed.c:
+//
+//   live_feed_t* feed = live_feed_create("sim", 1920 * 1080 * 4);
+//   for (;;) {
+//       uint8_t* pixels = live_feed_begin_frame(feed);
+//       ... write 1920x1080 RGBA8 into pixels ...
+//       live_feed_publish(feed, 1920, 1080, 1920 * 4, LIVE_FEED_RGBA8);
+//   }
+//   live_feed_close(feed);
+//
+// On Windows the feed is a named file mapping and an auto-reset event; on
+// Linux it is a POSIX shm object, signaled with a futex on the frame count
+// in it.  The frame count and each slot are published seqlock style, so
+// the consumer can tell if a slot was overwritten while it was reading.
+// A test producer and watcher build with
+//   cc -O2 -DLIVE_FEED_MAIN live_feed.c -o live_feed
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define LIVE_FEED_MAX_NAME 64
+
+typedef enum {
+	LIVE_FEED_BGRA8_PREMULTIPLIED = 1,	// what the canvas shows, copied as is
+	LIVE_FEED_RGBA8 = 2,				// straight alpha
+	LIVE_FEED_RGBA32F = 3,				// straight alpha, clamped to [0, 1]
+} live_feed_format_t;
+
+typedef struct live_feed_t live_feed_t;
+
+typedef struct {
+	uint32_t frame;		// counts up from 1
+	int width;
+	int height;
+	int stride;			// bytes
+	live_feed_format_t format;
+	double latency_seconds;	// from publish until live_feed_latest()
+} live_feed_frame_t;
+
+// producer. each frame may be up to max_frame_bytes. NULL on error.
+live_feed_t* live_feed_create(const char* name, uint64_t max_frame_bytes);
+// where the next frame is written. the previous frames stay readable.
+void* live_feed_begin_frame(live_feed_t* feed);
+bool live_feed_publish(live_feed_t* feed, int width, int height, int stride,
+	live_feed_format_t format);
+
+// consumer. NULL if there is no producer of that name.
+live_feed_t* live_feed_open(const char* name);
+// the Windows event signaled on each publish, for waiting along with
+// other handles. NULL elsewhere.
+void* live_feed_event(live_feed_t* feed);
+// waits until a frame after last_frame is published. false on timeout.
+bool live_feed_wait(live_feed_t* feed, uint32_t last_frame, int timeout_ms);
+// the newest frame. false if none has been published.
+bool live_feed_latest(live_feed_t* feed, live_feed_frame_t* frame);
+// converts the frame to premultiplied BGRA, frame->width pixels per row.
+// false if the producer overwrote it during the read; get the latest and
+// try again.
+bool live_feed_read_bgra(live_feed_t* feed, const live_feed_frame_t* frame,
+	uint32_t* dest);
+
+// either side. the producer's close removes the name.
+void live_feed_close(live_feed_t* feed);
+
+#ifdef __cplusplus
+}
+#endif
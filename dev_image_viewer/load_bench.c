@@ -0,0 +1,843 @@
+#include "dev_image_viewer.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <strsafe.h>
+
+#include "canvas.h"
+#include "gdiplus_loader.h"
+#include "image_probe_file.h"
+#include "jpeg_file.h"
+#include "load_bench.h"
+#include "parallel.h"
+#include "pixel_kernels.h"
+#include "png_file.h"
+#include "roi_source.h"
+
+// the client area painted after each load
+#define LOAD_BENCH_VIEW_WIDTH 1920
+#define LOAD_BENCH_VIEW_HEIGHT 1080
+// times over the corpus the headers are probed, warm
+#define LOAD_BENCH_PROBE_ROUNDS 2000
+// of the JPEGs decoded reduced
+#define LOAD_BENCH_JPEG_QUALITY 90
+// as the canvas bakes in
+#define LOAD_BENCH_BG_COLOR 0xFF404040
+
+typedef struct {
+	int width;
+	int height;
+	bool alpha;
+} load_bench_image_t;
+
+static const load_bench_image_t load_bench_images[] = {
+	{ 256, 256, false },
+	{ 256, 256, true },
+	{ 1023, 769, false },
+	{ 1023, 769, true },
+	{ 4096, 4096, false },
+	{ 4097, 4095, true },
+	{ 16384, 16384, false },
+	{ 16383, 16385, true },
+	{ 32768, 32768, false },
+};
+
+// JPEGs, decoded reduced against the full decode's box filtered levels,
+// with chroma halved both ways as GDI+ writes them, and halved across only
+// as most cameras do
+static const load_bench_image_t load_bench_jpegs[] = {
+	{ 4096, 4096, false },
+	{ 16384, 16384, false },
+	{ 32768, 32768, false },
+};
+static const load_bench_image_t load_bench_jpegs_422[] = {
+	{ 4096, 4096, false },
+	{ 16384, 16384, false },
+};
+
+// loaded in bands: a raw PPM of about 500 MB, and a large JPEG
+static const load_bench_image_t load_bench_ppm = { 16384, 10240, false };
+static const load_bench_image_t load_bench_band_jpeg = { 8192, 6144, false };
+
+// decoded whole at each thread count, in strips and in PackBits tiles
+static const load_bench_image_t load_bench_tiff = { 16384, 10240, false };
+static const int load_bench_thread_counts[] = { 1, 2, 4, 8, 16, 32 };
+// of the corpus's PNGs, those decoded built in and by GDI+ to compare. GDI+
+// is left out of the largest.
+#define LOAD_BENCH_PNG_MAX_PIXELS (16384ull * 16385)
+#define LOAD_BENCH_TIFF_ROWS_PER_STRIP 16
+#define LOAD_BENCH_TIFF_TILE_SIZE 256
+
+typedef enum {
+	LOAD_BENCH_PNG,
+	LOAD_BENCH_JPEG,
+	LOAD_BENCH_JPEG_422,
+} load_bench_format_t;
+
+typedef struct {
+	bool ok;
+	double total_seconds;
+	double paint_seconds;
+	canvas_load_times_t stages;
+} load_bench_result_t;
+
+static double _now()
+{
+	LARGE_INTEGER freq, counter;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&counter);
+	return (double)counter.QuadPart / freq.QuadPart;
+}
+
+// gradients with some noise, so the PNG doesn't compress to nothing.
+// with alpha, a checker of opaque and translucent blocks, premultiplied.
+static void _fill_pattern(uint32_t* pixels, int width, int height, bool alpha)
+{
+	uint32_t noise = 2463534242u;
+	for (int y = 0; y < height; y++) {
+		uint32_t g = (uint32_t)((uint64_t)y * 255 / height);
+		uint32_t* row = pixels + (size_t)y * width;
+		for (int x = 0; x < width; x++) {
+			noise ^= noise << 13;
+			noise ^= noise >> 17;
+			noise ^= noise << 5;
+			uint32_t r = (uint32_t)((uint64_t)x * 255 / width);
+			uint32_t b = (x ^ y) & 0xFF;
+			uint32_t color = ((r << 16) | (g << 8) | b) ^ (noise & 0x070707);
+			if (alpha && ((x >> 6) + (y >> 6)) & 1) {
+				uint32_t a = (x + y) & 0xFF;
+				color = (a << 24) |
+					((((color >> 16) & 0xFF) * a / 255) << 16) |
+					((((color >> 8) & 0xFF) * a / 255) << 8) |
+					((color & 0xFF) * a / 255);
+			}
+			else {
+				color |= 0xFF000000;
+			}
+			row[x] = color;
+		}
+	}
+}
+
+static bool _image_path(const WCHAR* dir, const load_bench_image_t* image,
+	const WCHAR* extension, WCHAR* out, size_t out_size)
+{
+	return SUCCEEDED(StringCchPrintfW(out, out_size, L"%s\\%dx%d%s.%s", dir,
+		image->width, image->height, image->alpha ? L"_alpha" : L"", extension));
+}
+
+static bool _ensure_image(const WCHAR* path, const load_bench_image_t* image,
+	load_bench_format_t format)
+{
+	if (GetFileAttributesW(path) != INVALID_FILE_ATTRIBUTES)
+		return true;
+
+	uint32_t* pixels = (uint32_t*)malloc((size_t)image->width * image->height * 4);
+	if (!pixels)
+		return false;
+	_fill_pattern(pixels, image->width, image->height, image->alpha);
+	bool ok = false;
+	switch (format) {
+	case LOAD_BENCH_PNG:
+		ok = canvas_write_png(path, pixels, image->width, image->height, image->alpha);
+		break;
+	case LOAD_BENCH_JPEG:
+		ok = canvas_write_jpeg(path, pixels, image->width, image->height,
+			LOAD_BENCH_JPEG_QUALITY);
+		break;
+	case LOAD_BENCH_JPEG_422:
+		ok = canvas_write_jpeg_422(path, pixels, image->width, image->height,
+			LOAD_BENCH_JPEG_QUALITY);
+		break;
+	}
+	free(pixels);
+	if (!ok)
+		DeleteFileW(path);
+	return ok;
+}
+
+// row y of the gradients, as 8-bit RGB
+static void _gradient_row(uint8_t* row, int width, int height, int y)
+{
+	for (int x = 0; x < width; x++) {
+		row[x * 3] = (uint8_t)((uint64_t)x * 255 / width);
+		row[x * 3 + 1] = (uint8_t)((uint64_t)y * 255 / height);
+		row[x * 3 + 2] = (uint8_t)(x ^ y);
+	}
+}
+
+// PackBits, into dest of at least size + size / 128 + 1 bytes. returns the
+// bytes written.
+static size_t _packbits(const uint8_t* src, size_t size, uint8_t* dest)
+{
+	size_t out = 0;
+	size_t i = 0;
+	while (i < size) {
+		size_t run = 1;
+		while (i + run < size && run < 128 && src[i + run] == src[i])
+			run++;
+		if (run >= 3) {
+			dest[out++] = (uint8_t)(257 - run);
+			dest[out++] = src[i];
+			i += run;
+			continue;
+		}
+		// literal bytes, up to the next run worth repeating
+		size_t start = i;
+		while (i < size && i - start < 128 &&
+			!(i + 2 < size && src[i] == src[i + 1] && src[i] == src[i + 2]))
+			i++;
+		dest[out++] = (uint8_t)(i - start - 1);
+		memcpy(dest + out, src + start, i - start);
+		out += i - start;
+	}
+	return out;
+}
+
+static bool _write_le(FILE* file, uint32_t value, int bytes)
+{
+	uint8_t data[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16),
+		(uint8_t)(value >> 24) };
+	return fwrite(data, 1, bytes, file) == (size_t)bytes;
+}
+
+static bool _write_ifd_entry(FILE* file, int tag, int type, uint32_t count,
+	uint32_t value)
+{
+	return _write_le(file, tag, 2) && _write_le(file, type, 2) &&
+		_write_le(file, count, 4) && _write_le(file, value, 4);
+}
+
+// a baseline RGB TIFF of the gradients, uncompressed in strips, or tiled
+// and PackBits compressed.  the pixels come first and the IFD last, so the
+// chunks can be written as they're made.
+static bool _ensure_tiff(const WCHAR* path, const load_bench_image_t* image, bool tiled)
+{
+	if (GetFileAttributesW(path) != INVALID_FILE_ATTRIBUTES)
+		return true;
+	FILE* file = NULL;
+	if (_wfopen_s(&file, path, L"wb") || !file)
+		return false;
+
+	int width = image->width;
+	int height = image->height;
+	int chunk_width = tiled ? LOAD_BENCH_TIFF_TILE_SIZE : width;
+	int chunk_height = tiled ? LOAD_BENCH_TIFF_TILE_SIZE : LOAD_BENCH_TIFF_ROWS_PER_STRIP;
+	int across = (width + chunk_width - 1) / chunk_width;
+	int down = (height + chunk_height - 1) / chunk_height;
+	int num_chunks = across * down;
+	size_t chunk_bytes = (size_t)chunk_width * chunk_height * 3;
+	uint32_t* offsets = (uint32_t*)malloc((size_t)num_chunks * 2 * sizeof(uint32_t));
+	uint8_t* band = (uint8_t*)malloc((size_t)(across * chunk_width) * chunk_height * 3);
+	uint8_t* chunk = (uint8_t*)malloc(chunk_bytes * 2 + chunk_height + 1);
+	uint32_t* counts = offsets + num_chunks;
+	uint8_t* packed = chunk + chunk_bytes;
+
+	// the IFD's offset is filled in at the end
+	bool ok = offsets && band && chunk && fwrite("II", 1, 2, file) == 2 &&
+		_write_le(file, 42, 2) && _write_le(file, 0, 4);
+	uint32_t pos = 8;
+	for (int cy = 0; ok && cy < down; cy++) {
+		// tiles past the edges are padded with black
+		size_t band_stride = (size_t)across * chunk_width * 3;
+		int rows = min(chunk_height, height - cy * chunk_height);
+		memset(band, 0, band_stride * chunk_height);
+		for (int row = 0; row < rows; row++)
+			_gradient_row(band + row * band_stride, width, height, cy * chunk_height + row);
+		for (int cx = 0; ok && cx < across; cx++) {
+			int index = cy * across + cx;
+			size_t row_bytes = (size_t)chunk_width * 3;
+			const uint8_t* data = band + cx * row_bytes;
+			size_t size = 0;
+			if (tiled) {
+				for (int row = 0; row < chunk_height; row++)
+					size += _packbits(data + row * band_stride, row_bytes, packed + size);
+				data = packed;
+			}
+			else {
+				size = row_bytes * rows;
+			}
+			offsets[index] = pos;
+			counts[index] = (uint32_t)size;
+			ok = fwrite(data, 1, size, file) == size;
+			pos += (uint32_t)size;
+		}
+	}
+
+	// the arrays the IFD points to, then the IFD, word aligned
+	if (ok && (pos & 1)) {
+		ok = _write_le(file, 0, 1);
+		pos++;
+	}
+	uint32_t bits_pos = pos;
+	uint32_t offsets_pos = bits_pos + 6;
+	uint32_t counts_pos = offsets_pos + num_chunks * 4;
+	uint32_t ifd_pos = counts_pos + num_chunks * 4;
+	for (int i = 0; ok && i < 3; i++)
+		ok = _write_le(file, 8, 2);
+	for (int i = 0; ok && i < num_chunks * 2; i++)
+		ok = _write_le(file, offsets[i], 4);
+	uint32_t offsets_value = num_chunks > 1 ? offsets_pos : offsets[0];
+	uint32_t counts_value = num_chunks > 1 ? counts_pos : counts[0];
+	ok = ok && _write_le(file, tiled ? 11 : 10, 2) &&
+		_write_ifd_entry(file, 256, 4, 1, width) &&
+		_write_ifd_entry(file, 257, 4, 1, height) &&
+		_write_ifd_entry(file, 258, 3, 3, bits_pos) &&
+		_write_ifd_entry(file, 259, 3, 1, tiled ? 32773 : 1) &&
+		_write_ifd_entry(file, 262, 3, 1, 2);
+	if (tiled) {
+		ok = ok && _write_ifd_entry(file, 277, 3, 1, 3) &&
+			_write_ifd_entry(file, 284, 3, 1, 1) &&
+			_write_ifd_entry(file, 322, 4, 1, chunk_width) &&
+			_write_ifd_entry(file, 323, 4, 1, chunk_height) &&
+			_write_ifd_entry(file, 324, 4, num_chunks, offsets_value) &&
+			_write_ifd_entry(file, 325, 4, num_chunks, counts_value);
+	}
+	else {
+		ok = ok && _write_ifd_entry(file, 273, 4, num_chunks, offsets_value) &&
+			_write_ifd_entry(file, 277, 3, 1, 3) &&
+			_write_ifd_entry(file, 278, 4, 1, chunk_height) &&
+			_write_ifd_entry(file, 279, 4, num_chunks, counts_value) &&
+			_write_ifd_entry(file, 284, 3, 1, 1);
+	}
+	ok = ok && _write_le(file, 0, 4) && fseek(file, 4, SEEK_SET) == 0 &&
+		_write_le(file, ifd_pos, 4);
+
+	free(offsets);
+	free(band);
+	free(chunk);
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+		DeleteFileW(path);
+	return ok;
+}
+
+// a binary PPM of the same kind of gradients, written a row at a time, so
+// it needn't fit in memory twice
+static bool _ensure_ppm(const WCHAR* path, const load_bench_image_t* image)
+{
+	if (GetFileAttributesW(path) != INVALID_FILE_ATTRIBUTES)
+		return true;
+	FILE* file = NULL;
+	if (_wfopen_s(&file, path, L"wb") || !file)
+		return false;
+	uint8_t* row = (uint8_t*)malloc((size_t)image->width * 3);
+	bool ok = row && fprintf(file, "P6\n%d %d\n255\n", image->width, image->height) > 0;
+	for (int y = 0; ok && y < image->height; y++) {
+		_gradient_row(row, image->width, image->height, y);
+		ok = fwrite(row, 3, image->width, file) == (size_t)image->width;
+	}
+	free(row);
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+		DeleteFileW(path);
+	return ok;
+}
+
+// dispatches messages until a load in bands has finished, as the window's
+// loop would
+static void _wait_loaded(HWND canvas)
+{
+	MSG msg;
+	while (canvas_is_loading(canvas) && GetMessageW(&msg, NULL, 0, 0) > 0) {
+		TranslateMessage(&msg);
+		DispatchMessageW(&msg);
+	}
+}
+
+static void _paint(HWND canvas, HDC hdc, load_bench_result_t* result)
+{
+	double start = _now();
+	SendMessageW(canvas, WM_PRINTCLIENT, (WPARAM)hdc, PRF_CLIENT);
+	GdiFlush();
+	result->paint_seconds = _now() - start;
+}
+
+// a cold load into a new canvas, then a reload of the unchanged file
+static void _bench_image(HINSTANCE instance, const WCHAR* path, HDC hdc,
+	load_bench_result_t* load, load_bench_result_t* reload)
+{
+	ZeroMemory(load, sizeof(*load));
+	ZeroMemory(reload, sizeof(*reload));
+
+	HWND canvas = CreateWindowW(CANVAS_CLASS_NAME, L"", WS_POPUP, 0, 0,
+		LOAD_BENCH_VIEW_WIDTH, LOAD_BENCH_VIEW_HEIGHT, NULL, NULL, instance, NULL);
+	if (!canvas)
+		return;
+
+	double start = _now();
+	load->ok = canvas_set_image(canvas, path);
+	_wait_loaded(canvas);
+	load->total_seconds = _now() - start;
+	canvas_get_load_times(canvas, &load->stages);
+	if (load->ok)
+		_paint(canvas, hdc, load);
+
+	if (load->ok) {
+		start = _now();
+		reload->ok = canvas_reload_image(canvas);
+		reload->total_seconds = _now() - start;
+		canvas_get_load_times(canvas, &reload->stages);
+		if (reload->ok)
+			_paint(canvas, hdc, reload);
+	}
+
+	DestroyWindow(canvas);
+}
+
+static void _write_result(FILE* out, const char* name,
+	const load_bench_result_t* result)
+{
+	const canvas_load_times_t* stages = &result->stages;
+	fprintf(out, "\"%s\": {\"ok\": %s, \"incremental\": %s, \"total\": %.6f, "
+		"\"decode\": %.6f, \"bake\": %.6f, \"downsize\": %.6f, \"update\": %.6f, "
+		"\"stats\": %.6f, \"paint\": %.6f}",
+		name, result->ok ? "true" : "false",
+		stages->incremental ? "true" : "false", result->total_seconds,
+		stages->decode_seconds, stages->bake_seconds, stages->downsize_seconds,
+		stages->update_seconds, stages->stats_seconds, result->paint_seconds);
+}
+
+// probes the corpus over and over, checking the sizes it was made at.
+// the files are in the cache by now, so this is the rate a folder
+// listing would see.
+static bool _bench_probe(const WCHAR* dir, FILE* out)
+{
+	WCHAR paths[ARRAYSIZE(load_bench_images)][MAX_PATH];
+	bool ok = true;
+	for (size_t i = 0; i < ARRAYSIZE(load_bench_images); i++) {
+		if (!_image_path(dir, &load_bench_images[i], L"png", paths[i], MAX_PATH))
+			return false;
+	}
+
+	int num_probes = 0;
+	double start = _now();
+	for (int round = 0; round < LOAD_BENCH_PROBE_ROUNDS; round++) {
+		for (size_t i = 0; i < ARRAYSIZE(load_bench_images); i++) {
+			image_probe_t probe;
+			if (!image_probe_file(paths[i], &probe) ||
+				probe.format != IMAGE_PROBE_PNG ||
+				probe.width != load_bench_images[i].width ||
+				probe.height != load_bench_images[i].height)
+				ok = false;
+			num_probes++;
+		}
+	}
+	double seconds = _now() - start;
+
+	fprintf(out, "  \"probe\": {\"ok\": %s, \"files\": %d, \"seconds\": %.6f, "
+		"\"files_per_second\": %.0f},\n", ok ? "true" : "false", num_probes, seconds,
+		seconds > 0 ? num_probes / seconds : 0.0);
+	return ok;
+}
+
+// halves pixels, width x height, level times, as the canvas makes its
+// levels. pixels is freed, and the result is NULL if out of memory.
+static uint32_t* _downsize(uint32_t* pixels, int* width, int* height, int levels)
+{
+	for (int i = 0; pixels && i < levels; i++) {
+		int dest_width = (*width + 1) / 2;
+		int dest_height = (*height + 1) / 2;
+		uint32_t* dest = (uint32_t*)malloc((size_t)dest_width * dest_height * 4);
+		if (dest) {
+			pixel_downsize_sse2(pixels, *width, *height, dest, dest_width, dest_height,
+				LOAD_BENCH_BG_COLOR);
+		}
+		free(pixels);
+		pixels = dest;
+		*width = dest_width;
+		*height = dest_height;
+	}
+	return pixels;
+}
+
+// over RGB, or 0 where the pixels are the same
+static double _psnr(const uint32_t* a, const uint32_t* b, uint64_t count)
+{
+	double squared = 0;
+	for (uint64_t i = 0; i < count; i++) {
+		for (int shift = 0; shift < 24; shift += 8) {
+			int error = (int)((a[i] >> shift) & 0xFF) - (int)((b[i] >> shift) & 0xFF);
+			squared += (double)error * error;
+		}
+	}
+	return squared > 0 ? 10 * log10(255.0 * 255.0 * count * 3 / squared) : 0;
+}
+
+// the time a JPEG takes to show, opened in a canvas, and each reduced
+// level's time and quality against decoding in full and box filtering
+// down to it, as the canvas did before
+static bool _bench_jpeg(HINSTANCE instance, const WCHAR* path, HDC hdc,
+	const load_bench_image_t* image, const char* chroma, bool first_entry, FILE* out)
+{
+	bool ok = true;
+	load_bench_result_t first;
+	ZeroMemory(&first, sizeof(first));
+	int zoom = 0;
+	HWND canvas = CreateWindowW(CANVAS_CLASS_NAME, L"", WS_POPUP, 0, 0,
+		LOAD_BENCH_VIEW_WIDTH, LOAD_BENCH_VIEW_HEIGHT, NULL, NULL, instance, NULL);
+	if (canvas) {
+		// till it's whole, to compare with the decodes below
+		double start = _now();
+		first.ok = canvas_set_image(canvas, path);
+		_wait_loaded(canvas);
+		first.total_seconds = _now() - start;
+		if (first.ok)
+			_paint(canvas, hdc, &first);
+		canvas_get_load_times(canvas, &first.stages);
+		zoom = canvas_get_zoom(canvas);
+		DestroyWindow(canvas);
+	}
+	ok = ok && first.ok;
+
+	fprintf(out, "%s\n    {\"width\": %d, \"height\": %d, \"chroma\": \"%s\", "
+		"\"zoom\": %d,\n      ", first_entry ? "" : ",", image->width, image->height,
+		chroma, zoom);
+	_write_result(out, "first_image", &first);
+
+	// the full decode, with the bake it'd need, and each level from it
+	double start = _now();
+	HBITMAP hbitmap = NULL;
+	void* bits = NULL;
+	int width = 0, height = 0;
+	uint32_t* full = NULL;
+	if (canvas_read_image(path, &hbitmap, &bits, &width, &height)) {
+		full = (uint32_t*)malloc((size_t)width * height * 4);
+		if (full) {
+			pixel_bake_sse2(full, (const uint32_t*)bits, (uint64_t)width * height,
+				LOAD_BENCH_BG_COLOR);
+		}
+		DeleteObject(hbitmap);
+	}
+	double full_seconds = _now() - start;
+	fprintf(out, ",\n      \"full\": {\"ok\": %s, \"decode\": %.6f}, \"reduced\": [",
+		full ? "true" : "false", full_seconds);
+	ok = ok && full;
+
+	for (int shift = 1; full && shift <= 3; shift++) {
+		start = _now();
+		full = _downsize(full, &width, &height, 1);
+		double pyramid_seconds = full_seconds + _now() - start;
+		full_seconds = pyramid_seconds;
+
+		start = _now();
+		int reduced_width = 0, reduced_height = 0;
+		bool read = jpeg_file_read_reduced(path, shift, &hbitmap, &bits,
+			&reduced_width, &reduced_height);
+		double reduced_seconds = _now() - start;
+		bool same = read && full && reduced_width == width && reduced_height == height;
+		double psnr = same ?
+			_psnr(full, (const uint32_t*)bits, (uint64_t)width * height) : 0;
+		if (read)
+			DeleteObject(hbitmap);
+		ok = ok && same;
+
+		fprintf(out, "%s\n        {\"level\": %d, \"ok\": %s, \"pyramid\": %.6f, "
+			"\"reduced\": %.6f, \"psnr\": %.2f}", shift == 1 ? "" : ",", shift,
+			same ? "true" : "false", pyramid_seconds, reduced_seconds, psnr);
+	}
+	free(full);
+	fprintf(out, "]}");
+	fflush(out);
+	return ok;
+}
+
+static bool _ignore_rows(void* ctx, int y0, int y1)
+{
+	return true;
+}
+
+// what the canvas would wait for without loading in bands: GDI+'s decode,
+// or for what GDI+ doesn't read, the source's own read of the whole
+static bool _read_whole(const WCHAR* path)
+{
+	HBITMAP hbitmap = NULL;
+	void* bits = NULL;
+	int width = 0, height = 0;
+	if (canvas_read_image(path, &hbitmap, &bits, &width, &height)) {
+		DeleteObject(hbitmap);
+		return true;
+	}
+	roi_source_t* source = roi_source_open_whole(path);
+	if (!source)
+		return false;
+	roi_source_get_size(source, &width, &height);
+	uint32_t* pixels = (uint32_t*)malloc((size_t)width * height * 4);
+	bool ok = pixels && roi_source_read_rows(source, pixels, width, _ignore_rows, NULL);
+	free(pixels);
+	roi_source_close(source);
+	return ok;
+}
+
+// how soon an image loading in bands shows, against the decode the canvas
+// would otherwise wait for: when canvas_set_image() returns, with the paint
+// then, when the preview and the first rows are ready, and when it's whole
+static bool _bench_bands(HINSTANCE instance, const WCHAR* path, const char* format,
+	HDC hdc, const load_bench_image_t* image, bool first_entry, FILE* out)
+{
+	load_bench_result_t first;
+	ZeroMemory(&first, sizeof(first));
+	bool loading = false;
+	double total_seconds = 0;
+	HWND canvas = CreateWindowW(CANVAS_CLASS_NAME, L"", WS_POPUP, 0, 0,
+		LOAD_BENCH_VIEW_WIDTH, LOAD_BENCH_VIEW_HEIGHT, NULL, NULL, instance, NULL);
+	if (canvas) {
+		double start = _now();
+		first.ok = canvas_set_image(canvas, path);
+		first.total_seconds = _now() - start;
+		loading = canvas_is_loading(canvas);
+		if (first.ok)
+			_paint(canvas, hdc, &first);
+		_wait_loaded(canvas);
+		total_seconds = _now() - start;
+		canvas_get_load_times(canvas, &first.stages);
+		// a load that failed leaves no image
+		UINT loaded_width, loaded_height;
+		first.ok = first.ok && canvas_get_image_size(canvas, &loaded_width, &loaded_height);
+		DestroyWindow(canvas);
+	}
+
+	double start = _now();
+	bool read = _read_whole(path);
+	double read_seconds = _now() - start;
+
+	const canvas_load_times_t* stages = &first.stages;
+	fprintf(out, "%s\n    {\"format\": \"%s\", \"width\": %d, \"height\": %d, "
+		"\"ok\": %s, \"in_bands\": %s,\n      \"returned\": %.6f, \"paint\": %.6f, "
+		"\"preview\": %.6f, \"first_rows\": %.6f, \"total\": %.6f, "
+		"\"blocking_decode\": %.6f}",
+		first_entry ? "" : ",", format, image->width, image->height,
+		first.ok && read ? "true" : "false", loading ? "true" : "false",
+		first.total_seconds, first.paint_seconds, stages->preview_seconds,
+		stages->first_rows_seconds, total_seconds, read_seconds);
+	fflush(out);
+	return first.ok && read && loading;
+}
+
+// a PNG decoded into a DIB built in, as canvas_read_image() now does, and
+// by GDI+ with the copy out of its bitmap, as it did, and how far apart
+// their pixels are
+static bool _bench_png(const WCHAR* path, const load_bench_image_t* image,
+	bool first_entry, FILE* out)
+{
+	HBITMAP builtin = NULL, gdiplus = NULL;
+	void* builtin_bits = NULL;
+	void* gdiplus_bits = NULL;
+	int width = 0, height = 0, gdiplus_width = 0, gdiplus_height = 0;
+	double start = _now();
+	bool builtin_ok = png_file_read(path, &builtin, &builtin_bits, &width, &height);
+	double builtin_seconds = _now() - start;
+	start = _now();
+	bool gdiplus_ok = canvas_read_image_gdiplus(path, &gdiplus, &gdiplus_bits,
+		&gdiplus_width, &gdiplus_height);
+	double gdiplus_seconds = _now() - start;
+
+	bool ok = builtin_ok && gdiplus_ok && width == gdiplus_width &&
+		height == gdiplus_height;
+	int max_diff = 0;
+	uint64_t num_pixels = (uint64_t)width * height;
+	for (uint64_t i = 0; ok && i < num_pixels; i++) {
+		uint32_t a = ((const uint32_t*)builtin_bits)[i];
+		uint32_t b = ((const uint32_t*)gdiplus_bits)[i];
+		for (int shift = 0; a != b && shift < 32; shift += 8) {
+			int diff = abs((int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF));
+			if (diff > max_diff)
+				max_diff = diff;
+		}
+	}
+	if (builtin)
+		DeleteObject(builtin);
+	if (gdiplus)
+		DeleteObject(gdiplus);
+
+	fprintf(out, "%s\n    {\"width\": %d, \"height\": %d, \"alpha\": %s, \"ok\": %s, "
+		"\"builtin\": %.6f, \"gdiplus\": %.6f, \"speedup\": %.2f, \"max_diff\": %d}",
+		first_entry ? "" : ",", image->width, image->height,
+		image->alpha ? "true" : "false", ok ? "true" : "false", builtin_seconds,
+		gdiplus_seconds, ok && builtin_seconds > 0 ? gdiplus_seconds / builtin_seconds : 0.0,
+		max_diff);
+	fflush(out);
+	return ok;
+}
+
+// decodes a TIFF whole into memory, as a load in bands does, at each thread
+// count, after a run to get the file into the cache
+static bool _bench_tiff_scaling(const WCHAR* path, const char* layout,
+	bool first_entry, FILE* out)
+{
+	roi_source_t* source = roi_source_open_whole(path);
+	int width = 0, height = 0;
+	if (source)
+		roi_source_get_size(source, &width, &height);
+	uint32_t* pixels = source ? (uint32_t*)malloc((size_t)width * height * 4) : NULL;
+	bool ok = pixels && roi_source_read_rows(source, pixels, width, _ignore_rows, NULL);
+
+	fprintf(out, "%s\n    {\"layout\": \"%s\", \"width\": %d, \"height\": %d, "
+		"\"runs\": [", first_entry ? "" : ",", layout, width, height);
+	double one_thread_seconds = 0;
+	for (size_t i = 0; i < ARRAYSIZE(load_bench_thread_counts); i++) {
+		int num_threads = load_bench_thread_counts[i];
+		parallel_set_num_threads(num_threads);
+		double start = _now();
+		bool read = ok && roi_source_read_rows(source, pixels, width, _ignore_rows, NULL);
+		double seconds = _now() - start;
+		if (i == 0)
+			one_thread_seconds = seconds;
+		fprintf(out, "%s\n        {\"threads\": %d, \"ok\": %s, \"seconds\": %.6f, "
+			"\"megapixels_per_second\": %.1f, \"speedup\": %.2f}", i == 0 ? "" : ",",
+			num_threads, read ? "true" : "false", seconds,
+			read && seconds > 0 ? (double)width * height / seconds / 1e6 : 0.0,
+			read && seconds > 0 ? one_thread_seconds / seconds : 0.0);
+		ok = ok && read;
+	}
+	parallel_set_num_threads(0);
+	fprintf(out, "]}");
+	fflush(out);
+
+	free(pixels);
+	roi_source_close(source);
+	return ok;
+}
+
+bool load_bench_run(HINSTANCE instance, const WCHAR* corpus_dir, FILE* out)
+{
+	WCHAR dir[MAX_PATH];
+	if (corpus_dir) {
+		if (FAILED(StringCchCopyW(dir, MAX_PATH, corpus_dir)))
+			return false;
+	}
+	else {
+		WCHAR temp[MAX_PATH];
+		DWORD length = GetTempPathW(MAX_PATH, temp);
+		if (!length || length >= MAX_PATH ||
+			FAILED(StringCchPrintfW(dir, MAX_PATH, L"%sdev_image_viewer_corpus", temp)))
+			return false;
+	}
+	if (!CreateDirectoryW(dir, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+		return false;
+
+	HDC screen_hdc = GetDC(NULL);
+	HDC hdc = CreateCompatibleDC(screen_hdc);
+	HBITMAP hbitmap = CreateCompatibleBitmap(screen_hdc,
+		LOAD_BENCH_VIEW_WIDTH, LOAD_BENCH_VIEW_HEIGHT);
+	ReleaseDC(NULL, screen_hdc);
+	if (!hdc || !hbitmap) {
+		if (hdc)
+			DeleteDC(hdc);
+		if (hbitmap)
+			DeleteObject(hbitmap);
+		return false;
+	}
+	HGDIOBJ old_bitmap = SelectObject(hdc, hbitmap);
+
+	int thread_counts[2] = { 1, parallel_get_num_threads() };
+	int num_thread_counts = thread_counts[1] > 1 ? 2 : 1;
+
+	bool all_ok = true;
+	bool first = true;
+	fprintf(out, "{\n  \"build\": \"%s %s\",\n  \"decoder\": \"png_decoder\",\n"
+		"  \"viewport\": [%d, %d],\n  \"results\": [",
+		__DATE__, __TIME__, LOAD_BENCH_VIEW_WIDTH, LOAD_BENCH_VIEW_HEIGHT);
+
+	for (int t = 0; t < num_thread_counts; t++) {
+		parallel_set_num_threads(thread_counts[t]);
+		for (size_t i = 0; i < ARRAYSIZE(load_bench_images); i++) {
+			const load_bench_image_t* image = &load_bench_images[i];
+			WCHAR path[MAX_PATH];
+			load_bench_result_t load, reload;
+			ZeroMemory(&load, sizeof(load));
+			ZeroMemory(&reload, sizeof(reload));
+
+			WIN32_FILE_ATTRIBUTE_DATA attributes;
+			ZeroMemory(&attributes, sizeof(attributes));
+			bool have_image = _image_path(dir, image, L"png", path, MAX_PATH) &&
+				_ensure_image(path, image, LOAD_BENCH_PNG) &&
+				GetFileAttributesExW(path, GetFileExInfoStandard, &attributes);
+			if (have_image)
+				_bench_image(instance, path, hdc, &load, &reload);
+			if (!load.ok || !reload.ok)
+				all_ok = false;
+
+			fprintf(out, "%s\n    {\"width\": %d, \"height\": %d, \"alpha\": %s, "
+				"\"file_bytes\": %llu, \"threads\": %d,\n      ",
+				first ? "" : ",", image->width, image->height,
+				image->alpha ? "true" : "false",
+				((unsigned long long)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow,
+				thread_counts[t]);
+			_write_result(out, "load", &load);
+			fprintf(out, ",\n      ");
+			_write_result(out, "reload", &reload);
+			fprintf(out, "}");
+			fflush(out);
+			first = false;
+		}
+	}
+	parallel_set_num_threads(0);
+
+	fprintf(out, "\n  ],\n  \"png_decoder\": [");
+	first = true;
+	for (size_t i = 0; i < ARRAYSIZE(load_bench_images); i++) {
+		const load_bench_image_t* image = &load_bench_images[i];
+		if ((uint64_t)image->width * image->height > LOAD_BENCH_PNG_MAX_PIXELS)
+			continue;
+		// generated for the loads above
+		WCHAR path[MAX_PATH];
+		if (!_image_path(dir, image, L"png", path, MAX_PATH) ||
+			!_ensure_image(path, image, LOAD_BENCH_PNG) ||
+			!_bench_png(path, image, first, out))
+			all_ok = false;
+		first = false;
+	}
+
+	fprintf(out, "\n  ],\n  \"jpeg_reduced\": [");
+	for (size_t i = 0; i < ARRAYSIZE(load_bench_jpegs); i++) {
+		const load_bench_image_t* image = &load_bench_jpegs[i];
+		WCHAR path[MAX_PATH];
+		if (!_image_path(dir, image, L"jpg", path, MAX_PATH) ||
+			!_ensure_image(path, image, LOAD_BENCH_JPEG) ||
+			!_bench_jpeg(instance, path, hdc, image, "4:2:0", i == 0, out))
+			all_ok = false;
+	}
+	for (size_t i = 0; i < ARRAYSIZE(load_bench_jpegs_422); i++) {
+		const load_bench_image_t* image = &load_bench_jpegs_422[i];
+		WCHAR path[MAX_PATH];
+		if (FAILED(StringCchPrintfW(path, MAX_PATH, L"%s\\%dx%d_422.jpg", dir,
+				image->width, image->height)) ||
+			!_ensure_image(path, image, LOAD_BENCH_JPEG_422) ||
+			!_bench_jpeg(instance, path, hdc, image, "4:2:2", false, out))
+			all_ok = false;
+	}
+	fprintf(out, "\n  ],\n  \"progressive\": [");
+	WCHAR path[MAX_PATH];
+	if (!_image_path(dir, &load_bench_ppm, L"ppm", path, MAX_PATH) ||
+		!_ensure_ppm(path, &load_bench_ppm) ||
+		!_bench_bands(instance, path, "ppm", hdc, &load_bench_ppm, true, out))
+		all_ok = false;
+	if (!_image_path(dir, &load_bench_band_jpeg, L"jpg", path, MAX_PATH) ||
+		!_ensure_image(path, &load_bench_band_jpeg, LOAD_BENCH_JPEG) ||
+		!_bench_bands(instance, path, "jpeg", hdc, &load_bench_band_jpeg, false, out))
+		all_ok = false;
+	fprintf(out, "\n  ],\n  \"tiff_scaling\": {\"logical_processors\": %d, \"results\": [",
+		parallel_get_num_threads());
+	for (int tiled = 0; tiled < 2; tiled++) {
+		WCHAR tiff_path[MAX_PATH];
+		if (FAILED(StringCchPrintfW(tiff_path, MAX_PATH, L"%s\\%dx%d_%s.tif", dir,
+				load_bench_tiff.width, load_bench_tiff.height,
+				tiled ? L"tiled_packbits" : L"strips")) ||
+			!_ensure_tiff(tiff_path, &load_bench_tiff, tiled != 0) ||
+			!_bench_tiff_scaling(tiff_path, tiled ? "tiled_packbits" : "strips",
+				!tiled, out))
+			all_ok = false;
+	}
+	fprintf(out, "\n  ]},\n");
+	if (!_bench_probe(dir, out))
+		all_ok = false;
+	fprintf(out, "  \"ok\": %s\n}\n", all_ok ? "true" : "false");
+
+	SelectObject(hdc, old_bitmap);
+	DeleteObject(hbitmap);
+	DeleteDC(hdc);
+	return all_ok;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Times the path from a changed file to new pixels on screen, stage by
+// stage, over a generated corpus of PNGs: from 256x256 up to 32768x32768,
+// opaque and with alpha, some with odd dimensions.  Each image is loaded
+// into a hidden canvas the way canvas_set_image() does, reloaded the way
+// canvas_reload_image() does, and painted into a viewport-sized bitmap
+// after each.  The whole sweep runs once per thread count, and the results
+// are written to out as JSON, with the rate the corpus's headers probe at
+// (see image_probe.h).  The PNGs are decoded built in (see png_file.h) and
+// by GDI+ too, timed against each other, with how far their pixels differ.  Large JPEGs are timed to first image too, and
+// their reduced decodes (see jpeg_file.h) against decoding in full and
+// box filtering down, in time and PSNR, with 4:2:0 and 4:2:2 chroma.  A raw PPM of about 500 MB and a
+// large JPEG are loaded in bands (see band_load.h), timed to when
+// canvas_set_image() returns, to the preview and first rows, and to whole,
+// against the decode the canvas would otherwise wait for.
+//
+// The corpus is generated into corpus_dir, or %TEMP%\dev_image_viewer_corpus
+// if NULL, on first use and reused after, so runs of different builds
+// decode the same files.
+//
+// returns false if any image failed to load.
+bool load_bench_run(HINSTANCE instance, const WCHAR* corpus_dir, FILE* out);
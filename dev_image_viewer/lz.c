@@ -0,0 +1,189 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "lz.h"
+
+// Each sequence is a token byte, literal length extension, literals,
+// 16-bit match offset, and match length extension.  The token holds the
+// literal length in the high 4 bits and match length - 4 in the low 4 bits.
+// A value of 15 in either is followed by extension bytes: 255 means add 255
+// and continue, anything else ends it.  The last sequence has literals only.
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+// no match may start in the last LZ_MATCH_LIMIT bytes, and the final
+// LZ_LAST_LITERALS bytes are always literals.
+#define LZ_MATCH_LIMIT 12
+#define LZ_LAST_LITERALS 5
+
+static uint32_t _read32(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static uint32_t _hash(uint32_t sequence)
+{
+	return (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t* _write_length(uint8_t* op, size_t length)
+{
+	while (length >= 255) {
+		*op++ = 255;
+		length -= 255;
+	}
+	*op++ = (uint8_t)length;
+	return op;
+}
+
+size_t lz_compress_bound(size_t src_size)
+{
+	return src_size + src_size / 255 + 16;
+}
+
+size_t lz_compress(const void* src, size_t src_size, void* dest,
+	size_t dest_capacity)
+{
+	const uint8_t* base = (const uint8_t*)src;
+	const uint8_t* ip = base;
+	const uint8_t* anchor = base;
+	const uint8_t* end = base + src_size;
+	const uint8_t* match_limit = src_size > LZ_MATCH_LIMIT ?
+		end - LZ_MATCH_LIMIT : base;
+	const uint8_t* extend_limit = src_size > LZ_LAST_LITERALS ?
+		end - LZ_LAST_LITERALS : base;
+	uint8_t* op = (uint8_t*)dest;
+	uint8_t* oend = op + dest_capacity;
+
+	// positions of the last occurrence of each hashed 4-byte sequence
+	uint32_t table[1 << LZ_HASH_BITS];
+	memset(table, 0, sizeof(table));
+
+	while (ip < match_limit) {
+		uint32_t sequence = _read32(ip);
+		uint32_t h = _hash(sequence);
+		const uint8_t* ref = base + table[h];
+		table[h] = (uint32_t)(ip - base);
+
+		if (ref >= ip || ip - ref > LZ_MAX_OFFSET || _read32(ref) != sequence) {
+			// skip faster through incompressible data
+			ip += 1 + ((ip - anchor) >> 6);
+			continue;
+		}
+
+		size_t match_length = LZ_MIN_MATCH;
+		while (ip + match_length < extend_limit && ip[match_length] == ref[match_length])
+			match_length++;
+
+		size_t literal_length = ip - anchor;
+		// token + extensions + literals + offset
+		if (op + 1 + literal_length / 255 + 1 + literal_length + 2 +
+			(match_length - LZ_MIN_MATCH) / 255 + 1 > oend)
+			return 0;
+
+		uint8_t* token = op++;
+		size_t match_code = match_length - LZ_MIN_MATCH;
+		*token = (uint8_t)(((literal_length < 15 ? literal_length : 15) << 4) |
+			(match_code < 15 ? match_code : 15));
+		if (literal_length >= 15)
+			op = _write_length(op, literal_length - 15);
+		memcpy(op, anchor, literal_length);
+		op += literal_length;
+
+		uint16_t offset = (uint16_t)(ip - ref);
+		*op++ = (uint8_t)offset;
+		*op++ = (uint8_t)(offset >> 8);
+		if (match_code >= 15)
+			op = _write_length(op, match_code - 15);
+
+		ip += match_length;
+		anchor = ip;
+	}
+
+	// the last literals
+	size_t literal_length = end - anchor;
+	if (op + 1 + literal_length / 255 + 1 + literal_length > oend)
+		return 0;
+	*op++ = (uint8_t)((literal_length < 15 ? literal_length : 15) << 4);
+	if (literal_length >= 15)
+		op = _write_length(op, literal_length - 15);
+	memcpy(op, anchor, literal_length);
+	op += literal_length;
+
+	return op - (uint8_t*)dest;
+}
+
+// returns false if the length runs past the input
+static bool _read_length(const uint8_t** ip, const uint8_t* iend, size_t* length)
+{
+	uint8_t b;
+	do {
+		if (*ip >= iend)
+			return false;
+		b = *(*ip)++;
+		*length += b;
+	} while (b == 255);
+	return true;
+}
+
+bool lz_decompress(const void* src, size_t src_size, void* dest,
+	size_t dest_size)
+{
+	const uint8_t* ip = (const uint8_t*)src;
+	const uint8_t* iend = ip + src_size;
+	uint8_t* op = (uint8_t*)dest;
+	uint8_t* ostart = op;
+	uint8_t* oend = op + dest_size;
+
+	while (ip < iend) {
+		uint8_t token = *ip++;
+
+		size_t literal_length = token >> 4;
+		if (literal_length == 15 && !_read_length(&ip, iend, &literal_length))
+			return false;
+		if ((size_t)(iend - ip) < literal_length || (size_t)(oend - op) < literal_length)
+			return false;
+		memcpy(op, ip, literal_length);
+		ip += literal_length;
+		op += literal_length;
+
+		if (ip == iend)
+			break;	// the last sequence has no match
+
+		if (iend - ip < 2)
+			return false;
+		size_t offset = ip[0] | ((size_t)ip[1] << 8);
+		ip += 2;
+		size_t match_length = token & 15;
+		if (match_length == 15 && !_read_length(&ip, iend, &match_length))
+			return false;
+		match_length += LZ_MIN_MATCH;
+
+		if (!offset || offset > (size_t)(op - ostart) ||
+			(size_t)(oend - op) < match_length)
+			return false;
+
+		const uint8_t* match = op - offset;
+		if (offset >= match_length) {
+			memcpy(op, match, match_length);
+			op += match_length;
+		}
+		else {
+			// overlapping: the output repeats with period offset.  copy it
+			// in doubling chunks, each of which doesn't overlap itself.
+			uint8_t* match_end = op + match_length;
+			while (op < match_end) {
+				size_t chunk = op - match;
+				if (chunk > (size_t)(match_end - op))
+					chunk = match_end - op;
+				memcpy(op, match, chunk);
+				op += chunk;
+			}
+		}
+	}
+
+	return op == oend;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A small, fast LZ77 codec in the style of LZ4, for compressing blocks of
+// pixels in memory.  Blocks are independent; there is no framing, so the
+// caller must remember both the compressed and the original size.
+
+// worst-case compressed size for src_size bytes of input.
+size_t lz_compress_bound(size_t src_size);
+
+// returns the compressed size, or 0 if it would not fit in dest_capacity.
+size_t lz_compress(const void* src, size_t src_size, void* dest,
+	size_t dest_capacity);
+
+// dest_size must be the exact original size.
+// returns false if the compressed data is corrupt.
+bool lz_decompress(const void* src, size_t src_size, void* dest,
+	size_t dest_size);
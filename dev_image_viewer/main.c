@@ -5,14 +5,122 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
 
+#include "content_hash.h"
+#include "disk_cache.h"
 #include "gdiplus_loader.h"
+#include "live_feed.h"
 #include "main_window.h"
 #include "canvas.h"
+#include "load_bench.h"
+#include "pixel_bench.h"
+#include "render.h"
+#include "stats_panel.h"
+#include "thumb_cache.h"
+#include "thumb_grid.h"
+#include "trace.h"
+
+// a change must sit untouched for this long before the file is reloaded,
+// so writers that save in several chunks only cause one decode.
+#define FILE_SETTLE_MS 150
 
 static WCHAR* file_change_path = NULL;
 static HANDLE file_change_handle = INVALID_HANDLE_VALUE;
-static FILETIME file_time = { 0 };
+static file_stamp_t file_stamp = { 0 };
+
+// hash of the contents last loaded, for ignoring touches that don't change
+// the bytes.
+static uint64_t file_hash = 0;
+static bool file_hash_valid = false;
+
+// the hash of the contents at a stamp, taken on the thread pool: the file
+// can be many GB, and a region or band load returns long before it's been
+// read, if it ever is.  taken when the watch starts, or a change reloads,
+// to become the hash of what was loaded, and when a change settles, to
+// compare with it.  shared with the worker, and freed by whichever lets go
+// last.
+typedef struct {
+	WCHAR* path;
+	file_stamp_t stamp;
+	uint64_t hash;
+	// the worker sets this once hash is taken, unless the file changed
+	// while it was
+	volatile LONG valid;
+	// set when the worker is done, either way
+	HANDLE done;
+	volatile LONG refs;
+} file_baseline_t;
+static file_baseline_t* file_baseline = NULL;
+
+static void _release_baseline(file_baseline_t* baseline)
+{
+	if (baseline && !InterlockedDecrement(&baseline->refs)) {
+		CloseHandle(baseline->done);
+		free(baseline->path);
+		free(baseline);
+	}
+}
+
+static VOID CALLBACK _hash_baseline(PTP_CALLBACK_INSTANCE instance, PVOID param)
+{
+	file_baseline_t* baseline = (file_baseline_t*)param;
+	uint64_t hash;
+	file_stamp_t stamp;
+	if (hash_file(baseline->path, &hash, NULL) && get_file_stamp(baseline->path, &stamp) &&
+		file_stamps_equal(&stamp, &baseline->stamp)) {
+		baseline->hash = hash;
+		InterlockedExchange(&baseline->valid, 1);
+	}
+	SetEvent(baseline->done);
+	_release_baseline(baseline);
+}
+
+// hands the hash of the watched file's contents to the thread pool
+static void _start_baseline()
+{
+	file_baseline_t* baseline = (file_baseline_t*)calloc(1, sizeof(file_baseline_t));
+	if (!baseline)
+		return;
+	baseline->path = _wcsdup(file_change_path);
+	baseline->stamp = file_stamp;
+	baseline->done = CreateEventW(NULL, TRUE, FALSE, NULL);
+	baseline->refs = 2;
+	if (!baseline->path || !baseline->done ||
+		!TrySubmitThreadpoolCallback(_hash_baseline, baseline, NULL)) {
+		if (baseline->done)
+			CloseHandle(baseline->done);
+		free(baseline->path);
+		free(baseline);
+		return;
+	}
+	file_baseline = baseline;
+}
+
+// takes the baseline's hash as the last loaded, if it's been taken. one
+// still being taken is of contents that have changed since, so it's
+// dropped either way.
+static void _finish_baseline()
+{
+	if (!file_baseline)
+		return;
+	if (InterlockedCompareExchange(&file_baseline->valid, 0, 0)) {
+		file_hash = file_baseline->hash;
+		file_hash_valid = true;
+	}
+	_release_baseline(file_baseline);
+	file_baseline = NULL;
+}
+
+// a settled change is being hashed by the baseline's worker, to tell
+// whether its bytes differ from those loaded.
+static bool file_checking = false;
+
+// a change was seen, and is waiting for the file to settle.
+static bool file_settling = false;
+static file_stamp_t file_settle_stamp = { 0 };
+static DWORD file_settle_start = 0;
 
 static void cleanup_file_watch()
 {
@@ -24,14 +132,31 @@ static void cleanup_file_watch()
 		FindCloseChangeNotification(file_change_handle);
 		file_change_handle = INVALID_HANDLE_VALUE;
 	}
+	file_settling = false;
+	file_checking = false;
+	file_hash_valid = false;
+	_release_baseline(file_baseline);
+	file_baseline = NULL;
 }
 
-static FILETIME _get_file_time()
+static file_stamp_t _get_file_stamp()
 {
-	WIN32_FILE_ATTRIBUTE_DATA info = { 0 };
-	// ignoring error, assuming info.ftLastWriteTime is still zeros.
-	GetFileAttributesExW(file_change_path, GetFileExInfoStandard, &info);
-	return info.ftLastWriteTime;
+	file_stamp_t stamp;
+	// ignoring error, assuming stamp is zeros.
+	get_file_stamp(file_change_path, &stamp);
+	return stamp;
+}
+
+// returns false if some process still has the file open for writing.
+static bool _probe_file_closed()
+{
+	// no FILE_SHARE_WRITE, so this fails while a writer holds the file.
+	HANDLE file = CreateFileW(file_change_path, GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	CloseHandle(file);
+	return true;
 }
 
 // TODO: this silently ignores errors. the app just won't reload.
@@ -58,36 +183,139 @@ void set_file_watch(const WCHAR* path)
 	file_change_handle = FindFirstChangeNotificationW(
 		dir_path, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE |
 		FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_CREATION |
-		FILE_NOTIFY_CHANGE_FILE_NAME);
+		FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE);
 	free(dir_path);
 	if (file_change_handle == INVALID_HANDLE_VALUE) {
 		cleanup_file_watch();
 		return;
 	}
 
-	file_time = _get_file_time();
+	file_stamp = _get_file_stamp();
+	_start_baseline();
 }
 
 // the file_change_handle has been signaled.
-// returns true if the watched file was changed, false otherwise.
+// starts (or restarts) the settle timer if the watched file was touched.
 // no error return values.
-static bool check_file_watch()
+static void check_file_watch()
 {
 	if (!FindNextChangeNotification(file_change_handle)) {
 		// TODO: indicate error in UI? retry later?
 		cleanup_file_watch();
+		return;
 	}
 
-	FILETIME new_time = _get_file_time();
-	if (new_time.dwHighDateTime != file_time.dwHighDateTime ||
-		new_time.dwLowDateTime != file_time.dwLowDateTime) {
-		file_time = new_time;
-		return true;
+	file_stamp_t new_stamp = _get_file_stamp();
+	if (file_settling) {
+		if (!file_stamps_equal(&new_stamp, &file_settle_stamp)) {
+			file_settle_stamp = new_stamp;
+			file_settle_start = GetTickCount();
+		}
+	}
+	else if (!file_stamps_equal(&new_stamp, &file_stamp)) {
+		file_settling = true;
+		file_settle_stamp = new_stamp;
+		file_settle_start = GetTickCount();
+	}
+}
+
+// milliseconds until settle_file_watch() should be called, or INFINITE.
+static DWORD file_watch_timeout()
+{
+	if (!file_settling)
+		return INFINITE;
+	DWORD elapsed = GetTickCount() - file_settle_start;
+	if (elapsed >= FILE_SETTLE_MS)
+		return 0;
+	return FILE_SETTLE_MS - elapsed;
+}
+
+// called when the settle timeout has expired.
+// returns true if the file has stopped changing and its contents must
+// differ from what was last loaded.  if they only may, they're hashed on
+// the thread pool, and finish_file_check() decides.
+static bool settle_file_watch()
+{
+	if (!file_settling)
+		return false;
+
+	file_stamp_t new_stamp = _get_file_stamp();
+	if (!file_stamps_equal(&new_stamp, &file_settle_stamp)) {
+		// still being written. wait a full window again.
+		file_settle_stamp = new_stamp;
+		file_settle_start = GetTickCount();
+		return false;
+	}
+	if (GetTickCount() - file_settle_start < FILE_SETTLE_MS)
+		return false;
+
+	if (!_probe_file_closed()) {
+		DWORD error = GetLastError();
+		if (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND) {
+			// deleted, maybe mid-way through a save by rename. the
+			// change notification will start again when it comes back.
+			file_settling = false;
+			file_stamp = new_stamp;
+		}
+		else {
+			file_settle_start = GetTickCount();
+		}
+		return false;
 	}
 
+	file_settling = false;
+	bool resized = new_stamp.size != file_stamp.size;
+	file_stamp = new_stamp;
+	if (file_checking) {
+		// of contents that were never loaded
+		file_checking = false;
+		_release_baseline(file_baseline);
+		file_baseline = NULL;
+	}
+	_finish_baseline();
+	_start_baseline();
+	if (resized || !file_baseline) {
+		// other bytes, or can't tell. the reload goes ahead at once, and
+		// the hash being taken is of what it loads.
+		file_hash_valid = false;
+		return true;
+	}
+	file_checking = true;
 	return false;
 }
 
+// signaled when finish_file_check() should be called, or NULL.
+static HANDLE file_check_event()
+{
+	return file_checking ? file_baseline->done : NULL;
+}
+
+// called when the hash of a settled change is done.
+// returns true if its contents differ from what was last loaded, or
+// couldn't be hashed, false otherwise.
+static bool finish_file_check()
+{
+	file_checking = false;
+	bool valid = InterlockedCompareExchange(&file_baseline->valid, 0, 0) != 0;
+	uint64_t new_hash = file_baseline->hash;
+	_release_baseline(file_baseline);
+	file_baseline = NULL;
+	if (!valid) {
+		// changed again while hashed, which settles in turn, or can't
+		// tell, in which case the reload tries, and reports any error.
+		file_hash_valid = false;
+		return !file_settling;
+	}
+	if (file_hash_valid && new_hash == file_hash)
+		return false;	// touched, but the same bytes
+	file_hash = new_hash;
+	file_hash_valid = true;
+	return true;
+}
+
+// frames from another process, with --live
+static live_feed_t* live_feed = NULL;
+
 // the resulting buffer must be freed with LocalFree()
 static WCHAR* _make_path_absolute(const WCHAR* path)
 {
@@ -111,43 +339,126 @@ static WCHAR* _make_path_absolute(const WCHAR* path)
 	return result;
 }
 
+// --render: what the canvas would show of image_path, written to out_path
+// as PNG, or PPM for any other extension. returns the process exit code.
+static int _render_to_file(const WCHAR* image_path, const WCHAR* out_path,
+	const render_options_t* options, const WCHAR* timings_path)
+{
+	render_times_t times;
+	ZeroMemory(&times, sizeof(times));
+	render_level_t levels[RENDER_NUM_MINIFY_LEVELS + 1];
+	ZeroMemory(levels, sizeof(levels));
+
+	uint64_t start = trace_begin();
+	HBITMAP hbitmap = NULL;
+	void* bits = NULL;
+	if (!canvas_read_image(image_path, &hbitmap, &bits,
+		&levels[0].width, &levels[0].height))
+		return 1;
+	levels[0].pixels = (uint32_t*)bits;
+	times.decode_seconds = trace_seconds(trace_begin() - start);
+
+	render_view_t view;
+	uint32_t* frame = NULL;
+	if (!render_run(levels, options, &view, &frame, &times)) {
+		DeleteObject(hbitmap);
+		return 1;
+	}
+
+	start = trace_begin();
+	bool ok = false;
+	const WCHAR* extension = wcsrchr(out_path, L'.');
+	if (extension && !_wcsicmp(extension, L".png")) {
+		ok = canvas_write_png(out_path, frame, view.width, view.height, false);
+	}
+	else {
+		FILE* out = _wfopen(out_path, L"wb");
+		if (out) {
+			ok = render_write_ppm(out, frame, view.width, view.height);
+			if (fclose(out))
+				ok = false;
+		}
+	}
+	times.write_seconds = trace_seconds(trace_begin() - start);
+
+	if (ok && timings_path) {
+		FILE* out = _wfopen(timings_path, L"w");
+		if (out) {
+			render_write_timings(out, levels[0].width, levels[0].height, &view, &times);
+			fclose(out);
+		}
+	}
+
+	free(frame);
+	render_free_levels(levels);
+	DeleteObject(hbitmap);
+	return ok ? 0 : 1;
+}
+
+// stops at WM_QUIT, leaving it in msg
+static void _dispatch_messages(MSG* msg)
+{
+	while (PeekMessageW(msg, NULL, 0, 0, PM_REMOVE)) {
+		if (msg->message == WM_QUIT)
+			break;
+		TranslateMessage(msg);
+		DispatchMessage(msg);
+	}
+}
+
 static int _message_loop(HWND hwnd)
 {
 	MSG msg = { 0 };
 	DWORD wait_result;
 	DWORD num_handles;
+	HANDLE handles[3];
 
 	while (msg.message != WM_QUIT) {
 		num_handles = 0;
 		if (file_change_handle != INVALID_HANDLE_VALUE)
-			num_handles = 1;
+			handles[num_handles++] = file_change_handle;
+		HANDLE check_event = file_check_event();
+		if (check_event)
+			handles[num_handles++] = check_event;
+		if (live_feed)
+			handles[num_handles++] = live_feed_event(live_feed);
 
 		wait_result = MsgWaitForMultipleObjectsEx(num_handles,
-			&file_change_handle, INFINITE, QS_ALLINPUT, 0);
+			handles, file_watch_timeout(), QS_ALLINPUT, 0);
 
 		if (wait_result == WAIT_OBJECT_0 + num_handles) {
 			// one or more messages are in the queue
-			while (PeekMessageW(&msg, NULL, 0, 0, PM_REMOVE)) {
-				if (msg.message == WM_QUIT)
-					break;
-				TranslateMessage(&msg);
-				DispatchMessage(&msg);
-			}
+			_dispatch_messages(&msg);
 		}
 		else if (wait_result >= WAIT_OBJECT_0 &&
 				 wait_result < WAIT_OBJECT_0 + num_handles) {
-			if (wait_result == WAIT_OBJECT_0) {
+			if (handles[wait_result - WAIT_OBJECT_0] == file_change_handle) {
 				// the change notification.
-				if (check_file_watch())
+				check_file_watch();
+			}
+			else if (handles[wait_result - WAIT_OBJECT_0] == check_event) {
+				// a settled change has been hashed
+				if (finish_file_check())
 					main_window_file_changed(hwnd);
 			}
+			else {
+				// a new live frame. a fast producer keeps the event
+				// signaled, so paint and input are handled here too.
+				main_window_live_frame(hwnd, live_feed);
+				_dispatch_messages(&msg);
+			}
+		}
+		else if (wait_result == WAIT_TIMEOUT) {
+			// a change has had time to settle
+			if (settle_file_watch())
+				main_window_file_changed(hwnd);
 		}
 		else if (wait_result == WAIT_FAILED)
 		{
 			DWORD error = GetLastError();
 		}
 		else {
-			// ignoring WAIT_ABANDONED_0...n-1 and WAIT_TIMEOUT
+			// ignoring WAIT_ABANDONED_0...n-1
 		}
 	}
 
@@ -161,9 +472,12 @@ int APIENTRY wWinMain(
 	_In_ int       nCmdShow)
 {
 	// Initialize libraries and window classes
+	trace_init();
 	init_gdiplus_loader();
 	main_window_init_class(hInstance);
 	canvas_init_class(hInstance);
+	stats_panel_init_class(hInstance);
+	thumb_grid_init_class(hInstance);
 
 	// Process command line
 	int argc = 0;
@@ -178,19 +492,118 @@ int APIENTRY wWinMain(
 	// image_path points into argv; don't free.
 	const WCHAR* image_path = NULL;
 
-	if (argc == 1) {
-		// with no parameters, just load empty window.
-	}
-	else if (argc == 2) {
-		image_path = argv[1];
+	// with no image path, just load empty window.
+	bool args_valid = true;
+	const WCHAR* bench_kernels_path = NULL;
+	const WCHAR* bench_load_path = NULL;
+	const WCHAR* corpus_dir = NULL;
+	const WCHAR* trace_path = NULL;
+	const WCHAR* render_path = NULL;
+	const WCHAR* live_name = NULL;
+	const WCHAR* timings_path = NULL;
+	const WCHAR* compare_path = NULL;
+	bool thumb_cache = true;
+	render_options_t render_options;
+	ZeroMemory(&render_options, sizeof(render_options));
+	render_options.viewport_width = 1920;
+	render_options.viewport_height = 1080;
+	render_options.bg_color = 0xFF404040;
+	for (int i = 1; i < argc; i++) {
+		if (!wcscmp(argv[i], L"--bench-kernels") && i + 1 < argc) {
+			bench_kernels_path = argv[++i];
+		}
+		else if (!wcscmp(argv[i], L"--bench-load") && i + 1 < argc) {
+			bench_load_path = argv[++i];
+		}
+		else if (!wcscmp(argv[i], L"--corpus") && i + 1 < argc) {
+			corpus_dir = argv[++i];
+		}
+		else if (!wcscmp(argv[i], L"--compare") && i + 1 < argc) {
+			compare_path = argv[++i];
+		}
+		else if (!wcscmp(argv[i], L"--live") && i + 1 < argc) {
+			live_name = argv[++i];
+		}
+		else if (!wcscmp(argv[i], L"--render") && i + 1 < argc) {
+			render_path = argv[++i];
+		}
+		else if (!wcscmp(argv[i], L"--viewport") && i + 1 < argc) {
+			if (swscanf_s(argv[++i], L"%dx%d", &render_options.viewport_width,
+				&render_options.viewport_height) != 2 ||
+				render_options.viewport_width <= 0 || render_options.viewport_height <= 0 ||
+				render_options.viewport_width > 16384 || render_options.viewport_height > 16384)
+				args_valid = false;
+		}
+		else if (!wcscmp(argv[i], L"--zoom") && i + 1 < argc) {
+			if (swscanf_s(argv[++i], L"%d", &render_options.zoom) != 1)
+				args_valid = false;
+		}
+		else if (!wcscmp(argv[i], L"--pan") && i + 1 < argc) {
+			if (swscanf_s(argv[++i], L"%d,%d", &render_options.pan_x,
+				&render_options.pan_y) != 2)
+				args_valid = false;
+		}
+		else if (!wcscmp(argv[i], L"--timings") && i + 1 < argc) {
+			timings_path = argv[++i];
+		}
+		else if (!wcscmp(argv[i], L"--trace") && i + 1 < argc) {
+			// everything from startup, written out on exit
+			trace_path = argv[++i];
+			trace_set_enabled(true);
+		}
+		else if (!wcscmp(argv[i], L"--no-thumb-cache")) {
+			thumb_cache = false;
+		}
+		else if (!wcscmp(argv[i], L"--disk-cache")) {
+			if (!disk_cache_enable(NULL)) {
+				MessageBoxW(NULL, L"error creating disk cache directory",
+					L"dev_image_viewer", MB_OK | MB_ICONERROR);
+			}
+		}
+		else if (!image_path && argv[i][0] != L'-') {
+			image_path = argv[i];
+		}
+		else {
+			args_valid = false;
+		}
 	}
-	else {
+	if (!args_valid) {
 		MessageBoxW(NULL, L"invalid command line arguments", L"dev_image_viewer",
 			MB_OK | MB_ICONERROR);
 	}
 
+	if (render_path) {
+		// no window. the image is the input, and render_path the output.
+		int exit_code = 2;
+		if (args_valid && image_path)
+			exit_code = _render_to_file(image_path, render_path, &render_options,
+				timings_path);
+		destroy_gdiplus_loader();
+		return exit_code;
+	}
+
+	if (bench_kernels_path || bench_load_path) {
+		// no window. exit code is 1 if a benchmark failed its checks.
+		const WCHAR* out_path = bench_kernels_path ? bench_kernels_path : bench_load_path;
+		FILE* out = _wfopen(out_path, L"w");
+		if (!out)
+			return 2;
+		bool ok = bench_kernels_path ? pixel_bench_run(out) :
+			load_bench_run(hInstance, corpus_dir, out);
+		fclose(out);
+		if (trace_path)
+			trace_write_chrome(trace_path);
+		destroy_gdiplus_loader();
+		return ok ? 0 : 1;
+	}
+
 	// TODO: technically can call LocalFree() on result of CommandLineToArgvW().
 
+	// thumbnails are small enough to keep by default. without somewhere to
+	// keep them they're just made each time.
+	if (thumb_cache)
+		thumb_cache_enable(NULL);
+
 	// Setup window
 	HWND hwnd = CreateWindowW(MAIN_WINDOW_CLASS, L"",
 		WS_OVERLAPPEDWINDOW, CW_USEDEFAULT, 0, CW_USEDEFAULT, 0, NULL,
@@ -209,6 +622,26 @@ int APIENTRY wWinMain(
 		main_window_set_image(hwnd, abs_path);
 
 		LocalFree(abs_path);
+
+		if (compare_path) {
+			abs_path = _make_path_absolute(compare_path);
+			if (abs_path)
+				main_window_set_compare(hwnd, abs_path);
+			LocalFree(abs_path);
+		}
+	}
+	else if (live_name) {
+		// feed names are ASCII
+		char name[LIVE_FEED_MAX_NAME + 1];
+		if (WideCharToMultiByte(CP_ACP, 0, live_name, -1, name, sizeof(name), NULL, NULL))
+			live_feed = live_feed_open(name);
+		if (live_feed) {
+			main_window_set_live(hwnd, live_name);
+		}
+		else {
+			MessageBoxW(NULL, L"no live feed of that name is running",
+				L"dev_image_viewer", MB_OK | MB_ICONERROR);
+		}
 	}
 
 	// Main loop
@@ -218,7 +651,12 @@ int APIENTRY wWinMain(
 	int exit_code = _message_loop(hwnd);
 
 	// Cleanup
+	if (trace_path && !trace_write_chrome(trace_path)) {
+		MessageBoxW(NULL, L"error writing trace", L"dev_image_viewer",
+			MB_OK | MB_ICONERROR);
+	}
 	cleanup_file_watch();
+	live_feed_close(live_feed);
 	destroy_gdiplus_loader();
 
 	return exit_code;
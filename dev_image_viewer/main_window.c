@@ -9,22 +9,39 @@
 #include "Resource.h"
 #include "main_window.h"
 #include "canvas.h"
+#include "flipbook.h"
+#include "image_cache.h"
+#include "image_probe_file.h"
+#include "stats_panel.h"
+#include "thumb_grid.h"
+#include "trace.h"
+#include "yuv_file.h"
 
 #define MAINWINDOW_WNDLONG_PRIVATE 0
 
+// polls the flipbook for the frame due. its clock decides which frame that
+// is, so the timer's coarseness only adds jitter, not drift.
+#define MAINWINDOW_TIMER_PLAYBACK 1
+
 #define MAINWINDOW_TITLE L"Dev Image Viewer"
 
 enum {
 	STATUSBAR_PART_MAIN = 0,
-	STATUSBAR_PART_SIZE = 1,
-	STATUSBAR_PART_COORDS = 2,
-	STATUSBAR_PART_ZOOM = 3,
-	STATUSBAR_NUM_PARTS = 4,
+	STATUSBAR_PART_COMPARE = 1,
+	STATUSBAR_PART_HISTORY = 2,
+	STATUSBAR_PART_TIMING = 3,
+	STATUSBAR_PART_SIZE = 4,
+	STATUSBAR_PART_COORDS = 5,
+	STATUSBAR_PART_ZOOM = 6,
+	STATUSBAR_NUM_PARTS = 7,
 };
 // width of each part.  the first part is ignored, and takes up the remainder.
 static const int status_bar_part_sizes[STATUSBAR_NUM_PARTS] = {
 	-1,
-	120,
+	340,
+	100,
+	220,
+	300,
 	120,
 	80,
 };
@@ -32,16 +49,37 @@ static const int status_bar_part_sizes[STATUSBAR_NUM_PARTS] = {
 typedef struct {
 	HWND canvas;
 	HWND status;
+	HWND stats_panel;	// shown with H
+	bool show_stats;
+	HWND grid;	// thumbnails of the folder, in place of the canvas, with G
+	bool show_grid;
 
 	WCHAR* path;
+	bool live;
+	// path's header, read before it's decoded
+	image_probe_t probe;
+	bool probed;
+
+	// while playing the sequence path is part of, or the frames of path.
+	// an animation stays open while paused, for stepping through.
+	flipbook_t* flipbook;
+	bool playing;
+	int play_index;
+	int play_fps_index;
+	bool play_timed;	// by the file's frame delays, not play_fps_index
+	flipbook_mode_t play_mode;
 } main_window_t;
 
+static const double play_fps_steps[] = { 1, 2, 5, 10, 12, 15, 24, 25, 30, 48, 50, 60, 120 };
+#define PLAY_FPS_DEFAULT_INDEX 6	// 24
+
 main_window_t* _main_window_new_private()
 {
 	main_window_t* priv = (main_window_t*)malloc(sizeof(main_window_t));
 	if (!priv)
 		return NULL;
 	ZeroMemory(priv, sizeof(main_window_t));
+	priv->play_fps_index = PLAY_FPS_DEFAULT_INDEX;
 
 	return priv;
 }
@@ -50,6 +88,7 @@ void _main_window_destroy_private(main_window_t* priv)
 {
 	if (priv->path)
 		free(priv->path);
+	flipbook_close(priv->flipbook);
 
 	free(priv);
 }
@@ -65,16 +104,216 @@ static void _statusbar_set_message(HWND hwnd, const WCHAR* text)
 	SendMessageW(priv->status, SB_SETTEXTW, MAKEWPARAM(STATUSBAR_PART_MAIN, 0), (LPARAM)text);
 }
 
+// tells when an image came from the inactive image cache, and how well
+// it is working.
+static void _statusbar_report_cache(HWND hwnd)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	canvas_cache_info_t info;
+	if (!canvas_get_cache_info(priv->canvas, &info))
+		return;
+	if (info.from_disk_cache) {
+		_statusbar_set_message(hwnd, L"Mapped from disk cache");
+		return;
+	}
+	if (!info.from_cache)
+		return;
+
+	WCHAR text[200];
+	double mb = 1024.0 * 1024.0;
+	double gb_per_sec = info.decompress_seconds > 0 ?
+		info.raw_bytes / info.decompress_seconds / (mb * 1024.0) : 0;
+	if (SUCCEEDED(StringCchPrintfW(text, ARRAYSIZE(text),
+		L"From memory cache: %.1f MB in %.1f ms (%.1f GB/s). %d cached, %.0f MB as %.0f MB (%.1f\xD7)",
+		info.raw_bytes / mb, info.decompress_seconds * 1000.0, gb_per_sec,
+		info.cached_images, info.cached_raw_bytes / mb,
+		info.cached_compressed_bytes / mb,
+		info.cached_compressed_bytes ?
+			(double)info.cached_raw_bytes / info.cached_compressed_bytes : 0.0)))
+		_statusbar_set_message(hwnd, text);
+}
+
+// the last load and paint times, and pixel memory held. only while tracing.
+static void _statusbar_update_timing(HWND hwnd)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	WCHAR text[100] = L"";
+	if (trace_is_enabled()) {
+		trace_last_t load, paint;
+		double load_ms = trace_get_last(TRACE_LOAD, &load) ? load.seconds * 1000.0 : 0;
+		double paint_ms = trace_get_last(TRACE_PAINT, &paint) ? paint.seconds * 1000.0 : 0;
+		StringCchPrintfW(text, ARRAYSIZE(text), L"load %.1f ms, paint %.2f ms, %.0f MB",
+			load_ms, paint_ms, canvas_get_resident_bytes(priv->canvas) / (1024.0 * 1024.0));
+	}
+	SendMessageW(priv->status, SB_SETTEXTW, MAKEWPARAM(STATUSBAR_PART_TIMING, 0), (LPARAM)text);
+}
+
+// turns tracing on, or writes the trace and turns it off
+static void _toggle_trace(HWND hwnd)
+{
+	if (!trace_is_enabled()) {
+		trace_set_enabled(true);
+		if (trace_is_enabled())
+			_statusbar_set_message(hwnd, L"Tracing. Press T again to write the trace.");
+	}
+	else {
+		trace_set_enabled(false);
+		WCHAR temp[MAX_PATH];
+		WCHAR path[MAX_PATH];
+		WCHAR text[MAX_PATH + 50];
+		DWORD length = GetTempPathW(MAX_PATH, temp);
+		if (length && length < MAX_PATH &&
+			SUCCEEDED(StringCchPrintfW(path, MAX_PATH, L"%sdev_image_viewer_trace.json", temp)) &&
+			trace_write_chrome(path) &&
+			SUCCEEDED(StringCchPrintfW(text, ARRAYSIZE(text), L"Trace written to %s", path)))
+			_statusbar_set_message(hwnd, text);
+		else
+			_statusbar_set_message(hwnd, L"Error writing trace");
+	}
+	_statusbar_update_timing(hwnd);
+}
+
+// the image position under the mouse, or at the pos given
+static POINT _image_pos(HWND hwnd, canvas_nm_mousemove_t* nm)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	POINT client_pos;
+	if (nm) {
+		client_pos = nm->pos;
+	}
+	else {
+		GetCursorPos(&client_pos);
+		ScreenToClient(priv->canvas, &client_pos);
+	}
+	return canvas_client_to_image(priv->canvas, &client_pos);
+}
+
+// while comparing: how B differs from A under the mouse, and over all
+static void _statusbar_update_compare(HWND hwnd, canvas_nm_mousemove_t* nm)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	WCHAR text[200] = L"";
+	if (canvas_is_comparing(priv->canvas)) {
+		WCHAR delta[60] = L"";
+		WCHAR stats_text[100];
+		POINT image_pos = _image_pos(hwnd, nm);
+		DWORD a, b;
+		if (canvas_get_compare_pixel(priv->canvas, &image_pos, &a, &b)) {
+			StringCchPrintfW(delta, ARRAYSIZE(delta), L"\x0394 %+d %+d %+d, ",
+				(int)((b >> 16) & 0xFF) - (int)((a >> 16) & 0xFF),
+				(int)((b >> 8) & 0xFF) - (int)((a >> 8) & 0xFF),
+				(int)(b & 0xFF) - (int)(a & 0xFF));
+		}
+		compare_stats_t stats;
+		UINT width = 0, height = 0;
+		canvas_get_image_size(priv->canvas, &width, &height);
+		if (!canvas_get_compare_stats(priv->canvas, &stats))
+			StringCchCopyW(stats_text, ARRAYSIZE(stats_text), L"sizes differ");
+		else if (!stats.num_differing)
+			StringCchCopyW(stats_text, ARRAYSIZE(stats_text), L"identical");
+		else
+			StringCchPrintfW(stats_text, ARRAYSIZE(stats_text), L"PSNR %.2f dB, max %d, %.2f%% differ",
+				stats.psnr, stats.max_error,
+				100.0 * stats.num_differing / ((double)width * height));
+		StringCchPrintfW(text, ARRAYSIZE(text), L"%s%s", delta, stats_text);
+	}
+	SendMessageW(priv->status, SB_SETTEXTW, MAKEWPARAM(STATUSBAR_PART_COMPARE, 0), (LPARAM)text);
+}
+
+// the selection's mean and deviation, in the message part while there is one
+static void _statusbar_update_selection(HWND hwnd)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	RECT rect;
+	if (!canvas_get_selection(priv->canvas, &rect))
+		return;
+	WCHAR text[200];
+	WCHAR scale[20] = L"";
+	canvas_selection_stats_t stats;
+	if (!canvas_get_selection_stats(priv->canvas, &stats)) {
+		_statusbar_set_message(hwnd, L"");
+		return;
+	}
+	// too large for the tables at full size
+	if (stats.level)
+		StringCchPrintfW(scale, ARRAYSIZE(scale), L" at 1/%dX", 1 << stats.level);
+	const region_stats_t* region = &stats.stats;
+	if (SUCCEEDED(StringCchPrintfW(text, ARRAYSIZE(text),
+		L"%d \xD7 %d at %d, %d%s: mean %.2f %.2f %.2f, sd %.2f %.2f %.2f",
+		rect.right - rect.left, rect.bottom - rect.top, rect.left, rect.top, scale,
+		region->mean[0], region->mean[1], region->mean[2],
+		region->stddev[0], region->stddev[1], region->stddev[2])))
+		_statusbar_set_message(hwnd, text);
+}
+
+// asks the canvas only while the panel shows, as it may have to make them
+static void _update_stats_panel(HWND hwnd)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	if (!priv->show_stats)
+		return;
+	image_stats_t* stats = (image_stats_t*)malloc(sizeof(image_stats_t));
+	bool have_stats = stats && canvas_get_stats(priv->canvas, stats);
+	stats_panel_set_stats(priv->stats_panel, have_stats ? stats : NULL);
+	free(stats);
+}
+
+static void _toggle_stats_panel(HWND hwnd)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	priv->show_stats = !priv->show_stats;
+	ShowWindow(priv->stats_panel, priv->show_stats ? SW_SHOW : SW_HIDE);
+	_update_stats_panel(hwnd);
+	RECT client_rect;
+	GetClientRect(hwnd, &client_rect);
+	SendMessageW(hwnd, WM_SIZE, SIZE_RESTORED,
+		MAKELPARAM(client_rect.right, client_rect.bottom));
+}
+
+// the size, and the format if the file was probed
+static void _statusbar_set_size(main_window_t* priv, bool has_size, UINT width,
+	UINT height)
+{
+	WCHAR text[100] = L"";
+	if (has_size) {
+		char format[64] = "";
+		if (priv->probed)
+			image_probe_describe(&priv->probe, format, ARRAYSIZE(format));
+		StringCchPrintfW(text, 100, L"%u \xD7 %u px  %hs", width, height, format);
+	}
+	SendMessageW(priv->status, SB_SETTEXTW, MAKEWPARAM(STATUSBAR_PART_SIZE, 0), (LPARAM)text);
+}
+
 static void _statusbar_update_size(HWND hwnd)
 {
 	main_window_t* priv = _main_window_get_private(hwnd);
 	UINT width = 0, height = 0;
+	if (canvas_get_image_size(priv->canvas, &width, &height))
+		_statusbar_set_size(priv, true, width, height);
+	else if (priv->probed)
+		// the file's header is all that could be read
+		_statusbar_set_size(priv, true, priv->probe.width, priv->probe.height);
+	else
+		_statusbar_set_size(priv, false, 0, 0);
+	// called whenever the image changes, which changes the comparison and
+	// the statistics too
+	_statusbar_update_compare(hwnd, NULL);
+	_update_stats_panel(hwnd);
+	_statusbar_update_selection(hwnd);
+}
+
+static void _statusbar_update_history(HWND hwnd)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	int position = 0, count = 0;
 	WCHAR text[100];
-	if (canvas_get_image_size(priv->canvas, &width, &height) &&
-		SUCCEEDED(StringCchPrintfW(text, 100, L"%u \xD7 %u px", width, height)))
-		SendMessageW(priv->status, SB_SETTEXTW, MAKEWPARAM(STATUSBAR_PART_SIZE, 0), (LPARAM)text);
+	// numbered by version, the newest being count + 1
+	if (canvas_get_history(priv->canvas, &position, &count) &&
+		SUCCEEDED(StringCchPrintfW(text, 100, L"version %d/%d",
+			count + 1 - position, count + 1)))
+		SendMessageW(priv->status, SB_SETTEXTW, MAKEWPARAM(STATUSBAR_PART_HISTORY, 0), (LPARAM)text);
 	else
-		SendMessageW(priv->status, SB_SETTEXTW, MAKEWPARAM(STATUSBAR_PART_SIZE, 0), (LPARAM)L"");
+		SendMessageW(priv->status, SB_SETTEXTW, MAKEWPARAM(STATUSBAR_PART_HISTORY, 0), (LPARAM)L"");
 }
 
 static void _statusbar_update_zoom(HWND hwnd)
@@ -98,15 +337,9 @@ static void _statusbar_update_coords(HWND hwnd, canvas_nm_mousemove_t* nm)
 	main_window_t* priv = _main_window_get_private(hwnd);
 	WCHAR text[100];
 
-	POINT client_pos;
-	if (nm) {
-		client_pos = nm->pos;
-	}
-	else {
-		GetCursorPos(&client_pos);
-		ScreenToClient(priv->canvas, &client_pos);
-	}
-	POINT image_pos = canvas_client_to_image(priv->canvas, &client_pos);
+	POINT image_pos = _image_pos(hwnd, nm);
+	if (canvas_is_comparing(priv->canvas))
+		_statusbar_update_compare(hwnd, nm);
 
 	if (FAILED(StringCchPrintfW(text, 100, L"%d, %d", image_pos.x, image_pos.y)))
 		return;
@@ -278,9 +511,302 @@ static bool _find_prevnext_file(const WCHAR* input_path, bool find_prev, WCHAR**
 	return true;
 }
 
+// the images in path's folder, in the order stepped through, and the index
+// of path among them, or 0. the paths are freed with LocalFree(), and the
+// array with free().
+static bool _list_dir_images(const WCHAR* path, WCHAR*** out_paths, int* out_count,
+	int* out_selected)
+{
+	const WCHAR* filename = _find_file_name(path);
+	*out_paths = NULL;
+	*out_count = 0;
+	*out_selected = 0;
+
+	WCHAR* dir_path = _wcsdup(path);
+	if (!dir_path)
+		return false;
+	WCHAR* glob = NULL;
+	if (FAILED(PathCchRemoveFileSpec(dir_path, wcslen(dir_path))) ||
+		FAILED(PathAllocCombine(dir_path, L"*", PATHCCH_ALLOW_LONG_PATHS, &glob))) {
+		free(dir_path);
+		return false;
+	}
+
+	WIN32_FIND_DATAW ffd;
+	HANDLE hfind = FindFirstFileW(glob, &ffd);
+	LocalFree(glob);
+	if (hfind == INVALID_HANDLE_VALUE) {
+		free(dir_path);
+		return GetLastError() == ERROR_FILE_NOT_FOUND;
+	}
+
+	WCHAR** paths = NULL;
+	int count = 0;
+	int capacity = 0;
+	bool ok = true;
+	do {
+		if (!_filter_dir_entry(&ffd))
+			continue;
+		if (count == capacity) {
+			int new_capacity = max(capacity * 2, 64);
+			WCHAR** new_paths = (WCHAR**)realloc(paths, new_capacity * sizeof(WCHAR*));
+			if (!new_paths) {
+				ok = false;
+				break;
+			}
+			paths = new_paths;
+			capacity = new_capacity;
+		}
+		if (FAILED(PathAllocCombine(dir_path, ffd.cFileName, PATHCCH_ALLOW_LONG_PATHS,
+			&paths[count]))) {
+			ok = false;
+			break;
+		}
+		if (!_wcsicmp(filename, ffd.cFileName))
+			*out_selected = count;
+		count++;
+	} while (FindNextFileW(hfind, &ffd));
+	FindClose(hfind);
+	free(dir_path);
+
+	if (!ok) {
+		for (int i = 0; i < count; i++)
+			LocalFree(paths[i]);
+		free(paths);
+		*out_selected = 0;
+		return false;
+	}
+	*out_paths = paths;
+	*out_count = count;
+	return true;
+}
+
+// leaves priv->path at the frame showing. with reopen, loads it as an
+// image again, for reloading and the image cache.
+static void _stop_playback(HWND hwnd, bool reopen)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	if (!priv->flipbook)
+		return;
+
+	KillTimer(hwnd, MAINWINDOW_TIMER_PLAYBACK);
+	WCHAR* path = _wcsdup(flipbook_get_path(priv->flipbook, priv->play_index));
+	flipbook_close(priv->flipbook);
+	priv->flipbook = NULL;
+	priv->playing = false;
+	if (!path)
+		return;
+
+	if (reopen) {
+		main_window_set_image(hwnd, path);
+		free(path);
+	}
+	else {
+		free(priv->path);
+		priv->path = path;
+	}
+}
+
+static void _statusbar_update_playback(HWND hwnd)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	flipbook_stats_t stats;
+	flipbook_get_stats(priv->flipbook, &stats);
+
+	WCHAR rate[40];
+	if (priv->play_timed)
+		StringCchCopyW(rate, ARRAYSIZE(rate), L"file timing");
+	else
+		StringCchPrintfW(rate, ARRAYSIZE(rate), L"%g fps", play_fps_steps[priv->play_fps_index]);
+	WCHAR text[200];
+	if (SUCCEEDED(StringCchPrintfW(text, ARRAYSIZE(text),
+		L"Playing %d/%d at %s (%.1f), %s, %d ahead, %d decoding, %d dropped",
+		priv->play_index + 1, flipbook_num_frames(priv->flipbook),
+		rate, stats.achieved_fps,
+		priv->play_mode == FLIPBOOK_LOOP ? L"loop" : L"ping-pong",
+		stats.ready, stats.decoding, stats.dropped)))
+		_statusbar_set_message(hwnd, text);
+}
+
+static void _restart_playback(HWND hwnd)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	flipbook_play(priv->flipbook, priv->play_index,
+		priv->play_timed ? 0 : play_fps_steps[priv->play_fps_index], priv->play_mode);
+	_statusbar_update_playback(hwnd);
+}
+
+// opens the flipbook for the image showing, not playing yet
+static bool _open_flipbook(HWND hwnd)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	if (!priv->path || priv->live)
+		return false;
+
+	flipbook_t* flipbook = flipbook_open(priv->path);
+	if (!flipbook || flipbook_num_frames(flipbook) < 2) {
+		flipbook_close(flipbook);
+		_statusbar_set_message(hwnd,
+			L"Not an animation, a multi-page image, a texture array, or part of a numbered image sequence");
+		return false;
+	}
+	int index = flipbook_find(flipbook, priv->path);
+	priv->flipbook = flipbook;
+	priv->play_index = index < 0 ? 0 : index;
+	priv->play_timed = flipbook_delay_ms(flipbook, 0) > 0;
+	return true;
+}
+
+static void _toggle_playback(HWND hwnd)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	if (priv->playing) {
+		// an animation pauses on the frame showing
+		if (flipbook_is_animation(priv->flipbook)) {
+			KillTimer(hwnd, MAINWINDOW_TIMER_PLAYBACK);
+			priv->playing = false;
+			_statusbar_set_message(hwnd, L"Paused. Page Up and Page Down step through the frames.");
+		}
+		else {
+			_stop_playback(hwnd, true);
+		}
+		return;
+	}
+	if (!priv->flipbook && !_open_flipbook(hwnd))
+		return;
+
+	priv->playing = true;
+	SetTimer(hwnd, MAINWINDOW_TIMER_PLAYBACK, USER_TIMER_MINIMUM, NULL);
+	_restart_playback(hwnd);
+}
+
+// shows the frame steps away in an animation or multi-page image, pausing
+// it if playing
+static void _step_frame(HWND hwnd, int steps)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	if (!priv->flipbook) {
+		if (!_open_flipbook(hwnd))
+			return;
+		if (!flipbook_is_animation(priv->flipbook)) {
+			// a sequence steps with the arrow keys, as files
+			_stop_playback(hwnd, false);
+			_statusbar_set_message(hwnd, L"Not an animation, a multi-page image or a texture array");
+			return;
+		}
+	}
+	else if (!flipbook_is_animation(priv->flipbook)) {
+		return;
+	}
+	KillTimer(hwnd, MAINWINDOW_TIMER_PLAYBACK);
+	priv->playing = false;
+
+	int count = flipbook_num_frames(priv->flipbook);
+	int index = ((priv->play_index + steps) % count + count) % count;
+	canvas_frame_t* frame = flipbook_load(priv->flipbook, index);
+	if (!frame) {
+		_statusbar_set_message(hwnd, L"Error decoding frame");
+		return;
+	}
+	priv->play_index = index;
+	canvas_show_frame(priv->canvas, frame);
+	UpdateWindow(priv->canvas);
+
+	WCHAR text[100];
+	WCHAR layer[64];
+	int delay_ms = flipbook_delay_ms(priv->flipbook, index);
+	if (flipbook_describe(priv->flipbook, index, layer, ARRAYSIZE(layer)))
+		StringCchPrintfW(text, ARRAYSIZE(text), L"%s (%d/%d)", layer, index + 1, count);
+	else if (delay_ms)
+		StringCchPrintfW(text, ARRAYSIZE(text), L"Frame %d/%d, %d ms", index + 1, count, delay_ms);
+	else
+		StringCchPrintfW(text, ARRAYSIZE(text), L"Page %d/%d", index + 1, count);
+	_statusbar_set_message(hwnd, text);
+	_statusbar_update_size(hwnd);
+}
+
+static void _show_compare_view(HWND hwnd, canvas_compare_view_t view)
+{
+	static const WCHAR* view_messages[CANVAS_COMPARE_NUM_VIEWS] = {
+		L"Compare: A left, B right. Drag the split with the right mouse button.",
+		L"Compare: A. Tab shows B.",
+		L"Compare: B. Tab shows A.",
+		L"Compare: |A - B|",
+		L"Compare: heatmap of the largest channel difference, white from 64",
+	};
+	main_window_t* priv = _main_window_get_private(hwnd);
+	if (!canvas_is_comparing(priv->canvas))
+		return;
+	canvas_set_compare_view(priv->canvas, view);
+	_statusbar_set_message(hwnd, view_messages[view]);
+}
+
+// changes how a raw YUV file shows: 'Y' cycles through color and the
+// planes, 'M' through the matrices and 'R' through the ranges, each
+// starting from what the name says.
+static void _cycle_yuv(HWND hwnd, WPARAM key)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	if (!priv->path || priv->live || !yuv_file_is_yuv(priv->path))
+		return;
+
+	yuv_settings_t settings;
+	yuv_file_get_settings(&settings);
+	if (key == 'Y')
+		settings.view = (yuv_view_t)((settings.view + 1) % (YUV_VIEW_V + 1));
+	else if (key == 'M')
+		settings.matrix = settings.matrix == YUV_BT2020 ? YUV_FILE_AUTO : settings.matrix + 1;
+	else
+		settings.full_range = settings.full_range == 1 ? YUV_FILE_AUTO : settings.full_range + 1;
+	yuv_file_set_settings(&settings);
+	// images converted with the old settings are stale
+	image_cache_clear();
+
+	bool ok;
+	if (priv->flipbook && flipbook_is_animation(priv->flipbook)) {
+		if (priv->playing) {
+			_restart_playback(hwnd);
+			ok = true;
+		}
+		else {
+			_step_frame(hwnd, 0);
+			return;
+		}
+	}
+	else {
+		ok = canvas_reload_image(priv->canvas);
+	}
+
+	WCHAR text[100] = L"Error reloading image";
+	yuv_file_t* file = yuv_file_open(priv->path);
+	if (ok && file)
+		yuv_file_describe(file, text, ARRAYSIZE(text));
+	yuv_file_close(file);
+	_statusbar_set_message(hwnd, text);
+	_statusbar_update_size(hwnd);
+}
+
+static void _playback_tick(HWND hwnd)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	if (!priv->playing)
+		return;
+
+	int index;
+	canvas_frame_t* frame = flipbook_tick(priv->flipbook, &index);
+	if (frame) {
+		priv->play_index = index;
+		canvas_show_frame(priv->canvas, frame);
+		UpdateWindow(priv->canvas);
+		_statusbar_update_playback(hwnd);
+		_statusbar_update_size(hwnd);
+	}
+}
+
 static void _cycle_image(HWND hwnd, bool find_prev)
 {
 	main_window_t* priv = _main_window_get_private(hwnd);
+	_stop_playback(hwnd, false);
 	if (!priv->path)
 		return;
 
@@ -302,6 +828,60 @@ static void _cycle_image(HWND hwnd, bool find_prev)
 	LocalFree(new_path);
 }
 
+// the grid shows in place of the canvas, filled from the folder each time
+static void _show_grid(HWND hwnd, bool show)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	if (show == priv->show_grid)
+		return;
+	if (show) {
+		if (!priv->path)
+			return;
+		_stop_playback(hwnd, false);
+		WCHAR** paths;
+		int count, selected;
+		if (!_list_dir_images(priv->path, &paths, &count, &selected))
+			return;
+		bool ok = thumb_grid_set_files(priv->grid, (const WCHAR* const*)paths, count, selected);
+		for (int i = 0; i < count; i++)
+			LocalFree(paths[i]);
+		free(paths);
+		if (!ok)
+			return;
+	}
+	else {
+		// nothing decodes while the canvas shows
+		thumb_grid_set_files(priv->grid, NULL, 0, 0);
+	}
+	priv->show_grid = show;
+	ShowWindow(priv->grid, show ? SW_SHOW : SW_HIDE);
+	ShowWindow(priv->canvas, show ? SW_HIDE : SW_SHOW);
+}
+
+static void _open_grid_selection(HWND hwnd)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	const WCHAR* selected = thumb_grid_get_selected(priv->grid);
+	// the grid's copy goes with it
+	WCHAR* path = selected ? _wcsdup(selected) : NULL;
+	if (!path)
+		return;
+	_show_grid(hwnd, false);
+	main_window_set_image(hwnd, path);
+	free(path);
+	UpdateWindow(hwnd);
+}
+
+// while the grid shows it has the keys, but for G, T and Escape
+static bool _forward_grid_key(HWND hwnd, WPARAM key, LPARAM lParam)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	if (!priv->show_grid || key == 'G' || key == 'T' || key == VK_ESCAPE)
+		return false;
+	SendMessageW(priv->grid, WM_KEYDOWN, key, lParam);
+	return true;
+}
+
 static void _main_window_update_title(HWND hwnd)
 {
 	main_window_t* priv = _main_window_get_private(hwnd);
@@ -318,6 +898,20 @@ static void _main_window_update_title(HWND hwnd)
 	}
 }
 
+// NULL on error. must be freed with free().
+static WCHAR* _drag_query_path(HDROP hdrop, UINT index)
+{
+	UINT buf_length = DragQueryFileW(hdrop, index, NULL, 0) + 1;
+	if (buf_length >= 10000)
+		return NULL;
+	WCHAR* path = malloc(sizeof(WCHAR) * buf_length);
+	if (path && !DragQueryFileW(hdrop, index, path, buf_length)) {
+		free(path);
+		path = NULL;
+	}
+	return path;
+}
+
 static LRESULT CALLBACK _wndproc(HWND hwnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
 	switch (message)
@@ -354,10 +948,15 @@ static LRESULT CALLBACK _wndproc(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 				NULL);
 			_update_statusbar_layout(hwnd);
 			_statusbar_update_zoom(hwnd);
+			_statusbar_update_timing(hwnd);
 
 			priv->canvas = CreateWindowW(CANVAS_CLASS_NAME, L"",
 				WS_CHILD | WS_VISIBLE, 0, 0, 100, 100, hwnd, NULL, hInstance,
 				NULL);
+			priv->stats_panel = CreateWindowW(STATS_PANEL_CLASS_NAME, L"",
+				WS_CHILD, 0, 0, 100, 100, hwnd, NULL, hInstance, NULL);
+			priv->grid = CreateWindowW(THUMB_GRID_CLASS_NAME, L"",
+				WS_CHILD | WS_VSCROLL, 0, 0, 100, 100, hwnd, NULL, hInstance, NULL);
 
 			_statusbar_update_size(hwnd);
 			_main_window_update_title(hwnd);
@@ -371,6 +970,13 @@ static LRESULT CALLBACK _wndproc(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 			PostQuitMessage(0);
 			return 0;
 
+		case WM_TIMER:
+			if (wParam == MAINWINDOW_TIMER_PLAYBACK) {
+				_playback_tick(hwnd);
+				return 0;
+			}
+			break;
+
 		case WM_NOTIFY:
 		{
 			main_window_t* priv = _main_window_get_private(hwnd);
@@ -381,6 +987,8 @@ static LRESULT CALLBACK _wndproc(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 						case CANVAS_NM_ZOOM:
 							_statusbar_update_zoom(hwnd);
 							_statusbar_update_coords(hwnd, NULL);
+							// zooming into a reduced decode decodes the rest
+							_update_stats_panel(hwnd);
 							break;
 
 						case CANVAS_NM_MOUSEMOVE:
@@ -388,6 +996,11 @@ static LRESULT CALLBACK _wndproc(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 								(canvas_nm_mousemove_t*)nmhdr);
 							break;
 
+						case CANVAS_NM_SELECTION:
+							_statusbar_set_message(hwnd, L"");
+							_statusbar_update_selection(hwnd);
+							break;
+
 						case CANVAS_NM_PREV:
 							_cycle_image(hwnd, true);
 							break;
@@ -396,8 +1009,20 @@ static LRESULT CALLBACK _wndproc(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 							_cycle_image(hwnd, false);
 							break;
 
+						case CANVAS_NM_PAINTED:
+							_statusbar_update_timing(hwnd);
+							break;
+
+						case CANVAS_NM_LOADED:
+							_update_stats_panel(hwnd);
+							_statusbar_update_timing(hwnd);
+							break;
+
 					}
 				}
+				else if (nmhdr->hwndFrom == priv->grid && nmhdr->code == THUMB_GRID_NM_OPEN) {
+					_open_grid_selection(hwnd);
+				}
 			}
 			return 0;
 		}
@@ -413,13 +1038,24 @@ static LRESULT CALLBACK _wndproc(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 			GetWindowRect(priv->status, &status_rect);
 			_update_statusbar_layout(hwnd);
 
-			SetWindowPos(priv->canvas, NULL, 0, 0, width,
-				height - (status_rect.bottom - status_rect.top), 0);
+			// the panel, when shown, sits between the canvas and the status bar
+			int canvas_height = height - (status_rect.bottom - status_rect.top);
+			if (priv->show_stats) {
+				int panel_height = min(STATS_PANEL_HEIGHT, max(canvas_height, 0));
+				canvas_height -= panel_height;
+				SetWindowPos(priv->stats_panel, NULL, 0, canvas_height, width,
+					panel_height, SWP_NOZORDER);
+			}
+			SetWindowPos(priv->canvas, NULL, 0, 0, width, canvas_height, 0);
+			SetWindowPos(priv->grid, NULL, 0, 0, width, canvas_height, SWP_NOZORDER);
 			return 0;
 		}
 
 		case WM_KEYDOWN:
 		{
+			if (_forward_grid_key(hwnd, wParam, lParam))
+				return 0;
+
 			switch (wParam) {
 				case VK_LEFT:
 					_cycle_image(hwnd, true);
@@ -428,6 +1064,120 @@ static LRESULT CALLBACK _wndproc(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 				case VK_RIGHT:
 					_cycle_image(hwnd, false);
 					return 0;
+
+				case 'T':
+					_toggle_trace(hwnd);
+					return 0;
+
+				// play the animation, or the numbered sequence, from the image
+				// showing
+				case VK_SPACE:
+					_toggle_playback(hwnd);
+					return 0;
+
+				case 'L':
+				{
+					main_window_t* priv = _main_window_get_private(hwnd);
+					priv->play_mode = priv->play_mode == FLIPBOOK_LOOP ?
+						FLIPBOOK_PINGPONG : FLIPBOOK_LOOP;
+					if (priv->playing)
+						_restart_playback(hwnd);
+					return 0;
+				}
+
+				// step through the frames of an animation or pages of an image
+				case VK_PRIOR:
+				case VK_NEXT:
+					_step_frame(hwnd, wParam == VK_PRIOR ? -1 : 1);
+					return 0;
+
+				case VK_OEM_MINUS:
+				case VK_OEM_PLUS:
+				{
+					main_window_t* priv = _main_window_get_private(hwnd);
+					int step = wParam == VK_OEM_PLUS ? 1 : -1;
+					int fps_index = priv->play_fps_index + step;
+					// the first step from an animation's own timing only
+					// leaves it, for the rate last chosen
+					if (priv->play_timed) {
+						priv->play_timed = false;
+						fps_index = priv->play_fps_index;
+					}
+					if (fps_index >= 0 && fps_index < (int)ARRAYSIZE(play_fps_steps)) {
+						priv->play_fps_index = fps_index;
+						if (priv->playing)
+							_restart_playback(hwnd);
+					}
+					return 0;
+				}
+
+				// compare views: C cycles split, difference and heatmap, Tab
+				// flickers between A and B, and Escape stops comparing, once
+				// the grid is closed and any selection is cleared
+				case 'C':
+				{
+					main_window_t* priv = _main_window_get_private(hwnd);
+					canvas_compare_view_t view = canvas_get_compare_view(priv->canvas);
+					_show_compare_view(hwnd, view == CANVAS_COMPARE_SPLIT ? CANVAS_COMPARE_DIFF :
+						view == CANVAS_COMPARE_DIFF ? CANVAS_COMPARE_HEATMAP : CANVAS_COMPARE_SPLIT);
+					return 0;
+				}
+
+				case VK_TAB:
+				{
+					main_window_t* priv = _main_window_get_private(hwnd);
+					_show_compare_view(hwnd, canvas_get_compare_view(priv->canvas) == CANVAS_COMPARE_A ?
+						CANVAS_COMPARE_B : CANVAS_COMPARE_A);
+					return 0;
+				}
+
+				case VK_ESCAPE:
+				{
+					main_window_t* priv = _main_window_get_private(hwnd);
+					RECT selection;
+					if (priv->show_grid)
+						_show_grid(hwnd, false);
+					else if (canvas_get_selection(priv->canvas, &selection))
+						canvas_clear_selection(priv->canvas);
+					else if (canvas_is_comparing(priv->canvas)) {
+						canvas_set_compare(priv->canvas, NULL);
+						_statusbar_set_message(hwnd, L"");
+						_statusbar_update_compare(hwnd, NULL);
+					}
+					return 0;
+				}
+
+				// thumbnails of the images in the folder
+				case 'G':
+					_show_grid(hwnd, !_main_window_get_private(hwnd)->show_grid);
+					return 0;
+
+				// histograms and statistics of the image's channels
+				case 'H':
+					_toggle_stats_panel(hwnd);
+					return 0;
+
+				// how a raw YUV file shows
+				case 'Y':
+				case 'M':
+				case 'R':
+					_cycle_yuv(hwnd, wParam);
+					return 0;
+
+				// step through the history of auto-reloaded versions
+				case VK_OEM_COMMA:
+				case VK_OEM_PERIOD:
+				{
+					main_window_t* priv = _main_window_get_private(hwnd);
+					if (canvas_history_step(priv->canvas, wParam == VK_OEM_COMMA ? 1 : -1)) {
+						_statusbar_update_history(hwnd);
+						_statusbar_update_compare(hwnd, NULL);
+						_update_stats_panel(hwnd);
+						_statusbar_update_selection(hwnd);
+						UpdateWindow(hwnd);
+					}
+					return 0;
+				}
 			}
 
 			break;
@@ -435,23 +1185,23 @@ static LRESULT CALLBACK _wndproc(HWND hwnd, UINT message, WPARAM wParam, LPARAM
 
 		case WM_DROPFILES:
 		{
+			// one file is opened, or compared against with Ctrl held. the
+			// first of two is compared against the second, and the rest
+			// are ignored.
 			HDROP hdrop = (HDROP)wParam;
 			UINT count = DragQueryFileW(hdrop, -1, NULL, 0);
-			if (count >= 1) {  // just load the first and ignore the rest
-				UINT buf_length = DragQueryFileW(hdrop, 0, NULL, 0) + 1;
-				if (buf_length < 10000) {
-					WCHAR* path = malloc(sizeof(WCHAR) * buf_length);
-					if (path) {
-						UINT result = DragQueryFileW(hdrop, 0, path,
-							buf_length);
-						if (result) {
-							main_window_set_image(hwnd, path);
-						}
-						free(path);
-					}
-				}
-
+			WCHAR* path = count >= 1 ? _drag_query_path(hdrop, 0) : NULL;
+			WCHAR* compare_path = count >= 2 ? _drag_query_path(hdrop, 1) : NULL;
+			if (path && count == 1 && GetKeyState(VK_CONTROL) < 0) {
+				main_window_set_compare(hwnd, path);
 			}
+			else if (path) {
+				main_window_set_image(hwnd, path);
+				if (compare_path)
+					main_window_set_compare(hwnd, compare_path);
+			}
+			free(path);
+			free(compare_path);
 			DragFinish(hdrop);
 			return 0;
 		}
@@ -466,12 +1216,22 @@ void main_window_file_changed(HWND hwnd)
 	main_window_t* priv = _main_window_get_private(hwnd);
 	if (!priv)
 		return;
+	// a sequence plays on through changes. an animation starts over with
+	// the new version.
+	if (priv->flipbook) {
+		if (flipbook_is_animation(priv->flipbook))
+			_stop_playback(hwnd, true);
+		return;
+	}
 
+	// the new version may be another size or format
+	priv->probed = priv->path && image_probe_file(priv->path, &priv->probe);
 	if (canvas_reload_image(priv->canvas))
 		_statusbar_set_message(hwnd, L"");
 	else
 		_statusbar_set_message(hwnd, L"Error reloading image");
 	_statusbar_update_size(hwnd);
+	_statusbar_update_history(hwnd);
 }
 
 void main_window_set_image(HWND hwnd, const WCHAR* path)
@@ -480,6 +1240,7 @@ void main_window_set_image(HWND hwnd, const WCHAR* path)
 	if (!priv)
 		return;
 
+	_stop_playback(hwnd, false);
 	if (priv->path) {
 		free(priv->path);
 		priv->path = NULL;
@@ -487,16 +1248,83 @@ void main_window_set_image(HWND hwnd, const WCHAR* path)
 	priv->path = _wcsdup(path);
 	if (!priv->path)
 		return;		// FIXME - abort or clear canvas too.. probably can't recover anyway
+	priv->live = false;
 
+	// the header is read in microseconds, so the size and format show
+	// while the image itself decodes
+	priv->probed = image_probe_file(path, &priv->probe);
+	_statusbar_set_size(priv, priv->probed, priv->probe.width, priv->probe.height);
+	UpdateWindow(priv->status);
 	canvas_set_image(priv->canvas, path);
 	_statusbar_set_message(hwnd, L"");
+	_statusbar_report_cache(hwnd);
 	_statusbar_update_size(hwnd);
 	_statusbar_update_zoom(hwnd);
+	_statusbar_update_history(hwnd);
 	_main_window_update_title(hwnd);
 
 	set_file_watch(path);
 }
 
+void main_window_set_compare(HWND hwnd, const WCHAR* path)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	if (!priv)
+		return;
+
+	WCHAR text[MAX_PATH + 50];
+	if (canvas_set_compare(priv->canvas, path)) {
+		StringCchPrintfW(text, ARRAYSIZE(text),
+			L"Comparing with %s. C changes the view, Tab flickers, Escape stops.",
+			_find_file_name(path));
+	}
+	else {
+		StringCchPrintfW(text, ARRAYSIZE(text), L"Error loading %s to compare with",
+			_find_file_name(path));
+	}
+	_statusbar_set_message(hwnd, text);
+	_statusbar_update_compare(hwnd, NULL);
+}
+
+void main_window_set_live(HWND hwnd, const WCHAR* name)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	if (!priv)
+		return;
+
+	_stop_playback(hwnd, false);
+	if (priv->path) {
+		free(priv->path);
+		priv->path = NULL;
+	}
+	priv->live = true;
+	priv->probed = false;
+
+	WCHAR title[200];
+	HRESULT hr = StringCchPrintfW(title, ARRAYSIZE(title), L"live: %s - %s", name,
+		MAINWINDOW_TITLE);
+	if (SUCCEEDED(hr) || hr == STRSAFE_E_INSUFFICIENT_BUFFER)
+		SetWindowTextW(hwnd, title);
+	_statusbar_set_message(hwnd, L"Waiting for a live frame");
+}
+
+void main_window_live_frame(HWND hwnd, live_feed_t* feed)
+{
+	main_window_t* priv = _main_window_get_private(hwnd);
+	if (!priv || !priv->live)
+		return;
+
+	live_feed_frame_t frame;
+	if (!canvas_show_live_frame(priv->canvas, feed, &frame))
+		return;
+	WCHAR text[100];
+	StringCchPrintfW(text, ARRAYSIZE(text), L"Live frame %u, %.2f ms after publish",
+		frame.frame, frame.latency_seconds * 1000.0);
+	_statusbar_set_message(hwnd, text);
+	_statusbar_update_size(hwnd);
+	_statusbar_update_zoom(hwnd);
+}
+
 ATOM main_window_init_class(HINSTANCE hinstance)
 {
 	WNDCLASSW wndclass;
@@ -1,9 +1,17 @@
 #pragma once
 
+#include "live_feed.h"
+
 #define MAIN_WINDOW_CLASS L"main_window_cls"
 
 void set_file_watch(const WCHAR* path);
 
 void main_window_file_changed(HWND hwnd);
 void main_window_set_image(HWND hwnd, const WCHAR* path);
+// compares the image against path. see canvas_set_compare().
+void main_window_set_compare(HWND hwnd, const WCHAR* path);
+// shows frames from a live feed, until an image is opened
+void main_window_set_live(HWND hwnd, const WCHAR* name);
+// the feed's event has been signaled
+void main_window_live_frame(HWND hwnd, live_feed_t* feed);
 ATOM main_window_init_class(HINSTANCE hInstance);
@@ -0,0 +1,89 @@
+#include "dev_image_viewer.h"
+
+#include "parallel.h"
+
+typedef struct {
+	parallel_fn_t fn;
+	void* ctx;
+	LONG count;
+	volatile LONG next;
+	// threads still working, including the caller
+	volatile LONG remaining;
+	HANDLE done_event;
+} parallel_job_t;
+
+static int num_threads_override = 0;
+
+static void _parallel_run(parallel_job_t* job)
+{
+	for (;;) {
+		LONG index = InterlockedIncrement(&job->next) - 1;
+		if (index >= job->count)
+			break;
+		job->fn(job->ctx, index);
+	}
+}
+
+static void _parallel_finish(parallel_job_t* job)
+{
+	if (InterlockedDecrement(&job->remaining) == 0)
+		SetEvent(job->done_event);
+}
+
+static VOID CALLBACK _parallel_worker(PTP_CALLBACK_INSTANCE instance, PVOID param)
+{
+	parallel_job_t* job = (parallel_job_t*)param;
+	_parallel_run(job);
+	_parallel_finish(job);
+}
+
+int parallel_get_num_threads()
+{
+	if (num_threads_override > 0)
+		return num_threads_override;
+	DWORD count = GetActiveProcessorCount(ALL_PROCESSOR_GROUPS);
+	return count ? (int)count : 1;
+}
+
+void parallel_set_num_threads(int num_threads)
+{
+	num_threads_override = num_threads > 0 ? num_threads : 0;
+}
+
+void parallel_for(int count, parallel_fn_t fn, void* ctx)
+{
+	int num_threads = parallel_get_num_threads();
+	if (num_threads > count)
+		num_threads = count;
+
+	HANDLE done_event = NULL;
+	if (num_threads > 1)
+		done_event = CreateEventW(NULL, TRUE, FALSE, NULL);
+	if (!done_event) {
+		// single threaded, or no event to wait on
+		for (int i = 0; i < count; i++)
+			fn(ctx, i);
+		return;
+	}
+
+	parallel_job_t job;
+	job.fn = fn;
+	job.ctx = ctx;
+	job.count = count;
+	job.next = 0;
+	job.remaining = num_threads;
+	job.done_event = done_event;
+
+	for (int i = 1; i < num_threads; i++) {
+		if (!TrySubmitThreadpoolCallback(_parallel_worker, &job, NULL)) {
+			// the caller picks up the slack
+			_parallel_finish(&job);
+		}
+	}
+
+	_parallel_run(&job);
+	_parallel_finish(&job);
+
+	WaitForSingleObject(done_event, INFINITE);
+	CloseHandle(done_event);
+}
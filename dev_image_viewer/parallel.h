@@ -0,0 +1,14 @@
+#pragma once
+
+// Runs fn(ctx, i) for every i in [0, count), spread over the system thread
+// pool.  The calling thread works too, and the call returns when all are
+// done.  Items are handed out in order, one at a time, so uneven items
+// balance themselves.
+typedef void (*parallel_fn_t)(void* ctx, int index);
+void parallel_for(int count, parallel_fn_t fn, void* ctx);
+
+// the number of threads parallel_for() uses, including the caller.
+// defaults to the number of logical processors.
+int parallel_get_num_threads();
+// 0 restores the default.
+void parallel_set_num_threads(int num_threads);
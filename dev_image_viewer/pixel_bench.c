@@ -0,0 +1,512 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#include "bcn.h"
+#include "pixel_bench.h"
+#include "pixel_kernels.h"
+#include "png_decoder.h"
+#include "yuv.h"
+
+// each timing repeats until both of these are reached
+#define BENCH_MIN_REPS 5
+#define BENCH_MIN_SECONDS 0.05
+// small images are run in batches of about this many pixels per sample,
+// to stay well above the timer resolution.
+#define BENCH_BATCH_PIXELS (64 * 1024)
+
+typedef struct {
+	int width;
+	int height;
+	uint32_t color;
+	uint32_t* src;		// premultiplied, with every kind of alpha
+	uint32_t* baked;	// src baked over color
+	uint8_t* blocks;	// random BCn blocks covering the image, 16 bytes each
+	uint8_t* yuv;		// a random YUV frame of the image's size, in any format
+	// outputs of the reference [0] and the SIMD kernel [1]
+	uint32_t* dest[2];
+	bool differs[2];
+	pixel_diff_stats_t stats[2];
+	pixel_histogram_t histograms[2];
+} bench_case_t;
+
+typedef struct {
+	const char* name;
+	// bytes read plus written, per source pixel
+	int bytes_per_pixel;
+	// largest difference allowed in any channel between the two outputs
+	int tolerance;
+	// sets up dest for kernels that work in place. may be NULL.
+	void (*prepare)(bench_case_t* c, uint32_t* dest);
+	void (*run)(bench_case_t* c, int simd);
+	// output pixels to compare
+	size_t (*output_size)(const bench_case_t* c);
+	// extra checks beyond comparing the outputs. may be NULL.
+	bool (*check)(bench_case_t* c);
+} bench_kernel_t;
+
+typedef struct {
+	double seconds;		// per run
+	double ticks;		// TSC ticks per run
+} bench_timing_t;
+
+static const int bench_sizes[][2] = {
+	// tiny, odd and even
+	{ 1, 1 }, { 3, 5 }, { 64, 64 }, { 65, 63 },
+	// L2 resident
+	{ 256, 256 }, { 257, 255 },
+	// DRAM
+	{ 4096, 4096 }, { 4097, 4095 },
+};
+
+static uint64_t random_state = 0x9E3779B97F4A7C15ull;
+
+static uint32_t _random()
+{
+	// xorshift64*
+	random_state ^= random_state >> 12;
+	random_state ^= random_state << 25;
+	random_state ^= random_state >> 27;
+	return (uint32_t)((random_state * 0x2545F4914F6CDD1Dull) >> 32);
+}
+
+// a premultiplied pixel. a quarter each are transparent and opaque.
+static uint32_t _random_pixel()
+{
+	uint32_t bits = _random();
+	uint32_t a;
+	switch (bits & 3) {
+	case 0: a = 0; break;
+	case 1: a = 255; break;
+	default: a = bits >> 24; break;
+	}
+	uint32_t r = ((bits >> 2) & 0xFF) * a / 255;
+	uint32_t g = ((bits >> 10) & 0xFF) * a / 255;
+	uint32_t b = ((bits >> 18) & 0x3F) * 4 * a / 255;
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+// random bytes, except that the first of each 16 has its lowest set bit
+// spread evenly, so all of BC7's modes show up
+static void _random_blocks(uint8_t* blocks, size_t num_blocks)
+{
+	for (size_t i = 0; i < num_blocks * 16; i++)
+		blocks[i] = (uint8_t)_random();
+	for (size_t i = 0; i < num_blocks; i++) {
+		int mode = _random() % 8;
+		blocks[i * 16] = (uint8_t)((1 << mode) | (blocks[i * 16] << (mode + 1)));
+	}
+}
+
+static size_t _num_blocks(const bench_case_t* c)
+{
+	return (size_t)((c->width + 3) / 4) * ((c->height + 3) / 4);
+}
+
+static yuv_layout_t _yuv_layout(const bench_case_t* c, yuv_format_t format)
+{
+	// both ranges and two matrices, 10-bit with the widest
+	yuv_layout_t layout;
+	layout.format = format;
+	layout.width = c->width;
+	layout.height = c->height;
+	layout.matrix = format == YUV_P010 ? YUV_BT2020 : YUV_BT709;
+	layout.full_range = format == YUV_P010 || format == YUV_YUY2;
+	return layout;
+}
+
+// bytes in the largest frame of any format
+static size_t _yuv_bytes(const bench_case_t* c)
+{
+	size_t bytes = 0;
+	for (int format = YUV_I420; format <= YUV_P010; format++) {
+		yuv_layout_t layout = _yuv_layout(c, (yuv_format_t)format);
+		size_t frame_bytes = yuv_frame_bytes(&layout);
+		if (frame_bytes > bytes)
+			bytes = frame_bytes;
+	}
+	return bytes;
+}
+
+static double _now()
+{
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static size_t _full_size(const bench_case_t* c)
+{
+	return (size_t)c->width * c->height;
+}
+
+static size_t _half_size(const bench_case_t* c)
+{
+	return (size_t)((c->width + 1) / 2) * ((c->height + 1) / 2);
+}
+
+static void _prepare_baked(bench_case_t* c, uint32_t* dest)
+{
+	memcpy(dest, c->baked, _full_size(c) * sizeof(uint32_t));
+}
+
+static void _run_downsize(bench_case_t* c, int simd)
+{
+	(simd ? pixel_downsize_sse2 : pixel_downsize_naive)(
+		c->baked, c->width, c->height,
+		c->dest[simd], (c->width + 1) / 2, (c->height + 1) / 2, c->color);
+}
+
+static void _run_bake(bench_case_t* c, int simd)
+{
+	(simd ? pixel_bake_sse2 : pixel_bake_naive)(
+		c->dest[simd], c->src, _full_size(c), c->color);
+}
+
+// the whole image as one tile, that doesn't differ, so it's all compared
+static void _run_tile_differs(bench_case_t* c, int simd)
+{
+	c->differs[simd] = (simd ? pixel_tile_differs_sse2 : pixel_tile_differs_naive)(
+		c->src, c->baked, c->width, c->width, c->height, c->color);
+}
+
+static bool _check_tile_differs(bench_case_t* c)
+{
+	if (c->differs[0] || c->differs[1])
+		return false;
+	// a difference in the very last pixel must still be found
+	size_t last = _full_size(c) - 1;
+	c->baked[last] ^= 1;
+	_run_tile_differs(c, 0);
+	_run_tile_differs(c, 1);
+	c->baked[last] ^= 1;
+	bool ok = c->differs[0] && c->differs[1];
+	_run_tile_differs(c, 0);
+	_run_tile_differs(c, 1);
+	return ok;
+}
+
+static void _run_xor_tile(bench_case_t* c, int simd)
+{
+	(simd ? pixel_xor_tile_sse2 : pixel_xor_tile_naive)(
+		c->dest[simd], c->width, c->src, c->width, c->width, c->height);
+}
+
+static void _run_delta_row(bench_case_t* c, int simd)
+{
+	for (int y = 0; y < c->height; y++) {
+		size_t offset = (size_t)y * c->width;
+		(simd ? pixel_delta_row_sse2 : pixel_delta_row_naive)(
+			c->dest[simd] + offset, c->baked + offset, c->width);
+	}
+}
+
+static void _prepare_undelta_row(bench_case_t* c, uint32_t* dest)
+{
+	for (int y = 0; y < c->height; y++) {
+		size_t offset = (size_t)y * c->width;
+		pixel_delta_row_naive(dest + offset, c->baked + offset, c->width);
+	}
+}
+
+static void _run_undelta_row(bench_case_t* c, int simd)
+{
+	for (int y = 0; y < c->height; y++) {
+		(simd ? pixel_undelta_row_sse2 : pixel_undelta_row_naive)(
+			c->dest[simd] + (size_t)y * c->width, c->width);
+	}
+}
+
+static bool _check_undelta_row(bench_case_t* c)
+{
+	return !memcmp(c->dest[0], c->baked, _full_size(c) * sizeof(uint32_t));
+}
+
+// the random pixels as rows of filtered bytes, 4 a pixel, or 3 in the
+// first three quarters of each row for 8-bit RGB.  the first row has its
+// own bytes for the row above.
+static void _run_unfilter(bench_case_t* c, int simd, int filter, int bpp)
+{
+	size_t stride = (size_t)c->width * 4;
+	const uint8_t* src = (const uint8_t*)c->src;
+	uint8_t* dest = (uint8_t*)c->dest[simd];
+	for (int y = 0; y < c->height; y++) {
+		const uint8_t* prev = y ? dest + (y - 1) * stride : src;
+		(simd ? png_unfilter_sse2 : png_unfilter_naive)(filter, dest + y * stride,
+			src + y * stride, prev, (size_t)c->width * bpp, bpp);
+	}
+}
+
+static void _run_png_sub(bench_case_t* c, int simd) { _run_unfilter(c, simd, 1, 4); }
+static void _run_png_up(bench_case_t* c, int simd) { _run_unfilter(c, simd, 2, 4); }
+static void _run_png_avg(bench_case_t* c, int simd) { _run_unfilter(c, simd, 3, 4); }
+static void _run_png_paeth(bench_case_t* c, int simd) { _run_unfilter(c, simd, 4, 4); }
+static void _run_png_avg_rgb(bench_case_t* c, int simd) { _run_unfilter(c, simd, 3, 3); }
+static void _run_png_paeth_rgb(bench_case_t* c, int simd) { _run_unfilter(c, simd, 4, 3); }
+
+static void _run_bcn(bench_case_t* c, int simd, bcn_format_t format)
+{
+	(simd ? bcn_decode_sse2 : bcn_decode_naive)(format, c->blocks, c->width,
+		c->height, 0, (c->height + 3) / 4, c->dest[simd], c->width);
+}
+
+static void _run_bc1(bench_case_t* c, int simd) { _run_bcn(c, simd, BCN_BC1); }
+static void _run_bc2(bench_case_t* c, int simd) { _run_bcn(c, simd, BCN_BC2); }
+static void _run_bc3(bench_case_t* c, int simd) { _run_bcn(c, simd, BCN_BC3); }
+static void _run_bc4(bench_case_t* c, int simd) { _run_bcn(c, simd, BCN_BC4); }
+static void _run_bc5(bench_case_t* c, int simd) { _run_bcn(c, simd, BCN_BC5); }
+static void _run_bc6h(bench_case_t* c, int simd) { _run_bcn(c, simd, BCN_BC6H); }
+static void _run_bc7(bench_case_t* c, int simd) { _run_bcn(c, simd, BCN_BC7); }
+
+// src against baked, which differ by every amount
+static void _run_absdiff(bench_case_t* c, int simd)
+{
+	(simd ? pixel_absdiff_sse2 : pixel_absdiff_naive)(c->dest[simd], c->src, c->baked,
+		(int)_full_size(c));
+}
+
+static void _run_heatmap(bench_case_t* c, int simd)
+{
+	(simd ? pixel_heatmap_sse2 : pixel_heatmap_naive)(c->dest[simd], c->src, c->baked,
+		(int)_full_size(c));
+}
+
+static void _run_diff_stats(bench_case_t* c, int simd)
+{
+	memset(&c->stats[simd], 0, sizeof(c->stats[simd]));
+	(simd ? pixel_diff_stats_sse2 : pixel_diff_stats_naive)(c->src, c->baked,
+		(int)_full_size(c), &c->stats[simd]);
+}
+
+static bool _check_diff_stats(bench_case_t* c)
+{
+	return c->stats[0].sum_squares == c->stats[1].sum_squares &&
+		c->stats[0].num_differing == c->stats[1].num_differing &&
+		c->stats[0].max_diff == c->stats[1].max_diff;
+}
+
+static void _run_histogram(bench_case_t* c, int simd)
+{
+	memset(&c->histograms[simd], 0, sizeof(c->histograms[simd]));
+	(simd ? pixel_histogram_sse2 : pixel_histogram_naive)(c->src, (int)_full_size(c),
+		&c->histograms[simd]);
+}
+
+static bool _check_histogram(bench_case_t* c)
+{
+	return !memcmp(&c->histograms[0], &c->histograms[1], sizeof(c->histograms[0]));
+}
+
+static void _run_yuv(bench_case_t* c, int simd, yuv_format_t format)
+{
+	yuv_layout_t layout = _yuv_layout(c, format);
+	(simd ? yuv_convert_sse2 : yuv_convert_naive)(&layout, YUV_VIEW_COLOR, c->yuv,
+		0, c->height, c->dest[simd]);
+}
+
+static void _run_i420(bench_case_t* c, int simd) { _run_yuv(c, simd, YUV_I420); }
+static void _run_nv12(bench_case_t* c, int simd) { _run_yuv(c, simd, YUV_NV12); }
+static void _run_yuy2(bench_case_t* c, int simd) { _run_yuv(c, simd, YUV_YUY2); }
+static void _run_p010(bench_case_t* c, int simd) { _run_yuv(c, simd, YUV_P010); }
+
+static const bench_kernel_t bench_kernels[] = {
+	{ "downsize", 5, 0, NULL, _run_downsize, _half_size, NULL },
+	{ "bake", 8, 0, NULL, _run_bake, _full_size, NULL },
+	{ "tile_differs", 8, 0, NULL, _run_tile_differs, NULL, _check_tile_differs },
+	{ "xor_tile", 12, 0, _prepare_baked, _run_xor_tile, _full_size, NULL },
+	{ "delta_row", 8, 0, NULL, _run_delta_row, _full_size, NULL },
+	{ "undelta_row", 8, 0, _prepare_undelta_row, _run_undelta_row, _full_size,
+		_check_undelta_row },
+	// a row read, the row above read, and a row written
+	{ "png_sub", 8, 0, NULL, _run_png_sub, _full_size, NULL },
+	{ "png_up", 12, 0, NULL, _run_png_up, _full_size, NULL },
+	{ "png_avg", 12, 0, NULL, _run_png_avg, _full_size, NULL },
+	{ "png_paeth", 12, 0, NULL, _run_png_paeth, _full_size, NULL },
+	{ "png_avg_rgb", 9, 0, NULL, _run_png_avg_rgb, _full_size, NULL },
+	{ "png_paeth_rgb", 9, 0, NULL, _run_png_paeth_rgb, _full_size, NULL },
+	// a byte or half of block read per pixel, and 4 written
+	{ "bc1", 5, 0, NULL, _run_bc1, _full_size, NULL },
+	{ "bc2", 5, 0, NULL, _run_bc2, _full_size, NULL },
+	{ "bc3", 5, 0, NULL, _run_bc3, _full_size, NULL },
+	{ "bc4", 5, 0, NULL, _run_bc4, _full_size, NULL },
+	{ "bc5", 5, 0, NULL, _run_bc5, _full_size, NULL },
+	{ "bc6h", 5, 0, NULL, _run_bc6h, _full_size, NULL },
+	{ "bc7", 5, 0, NULL, _run_bc7, _full_size, NULL },
+	{ "absdiff", 12, 0, NULL, _run_absdiff, _full_size, NULL },
+	{ "heatmap", 12, 0, NULL, _run_heatmap, _full_size, NULL },
+	{ "diff_stats", 8, 0, NULL, _run_diff_stats, NULL, _check_diff_stats },
+	{ "histogram", 4, 0, NULL, _run_histogram, NULL, _check_histogram },
+	// 1.5, 2 or 3 bytes of frame read per pixel, and 4 written
+	{ "i420", 6, 0, NULL, _run_i420, _full_size, NULL },
+	{ "nv12", 6, 0, NULL, _run_nv12, _full_size, NULL },
+	{ "yuy2", 6, 0, NULL, _run_yuy2, _full_size, NULL },
+	{ "p010", 7, 0, NULL, _run_p010, _full_size, NULL },
+};
+
+// largest difference in any channel, and how many pixels differ at all
+static void _compare(const uint32_t* a, const uint32_t* b, size_t count,
+	int* max_diff, size_t* mismatches)
+{
+	*max_diff = 0;
+	*mismatches = 0;
+	for (size_t i = 0; i < count; i++) {
+		if (a[i] == b[i])
+			continue;
+		(*mismatches)++;
+		for (int shift = 0; shift < 32; shift += 8) {
+			int diff = abs((int)((a[i] >> shift) & 0xFF) - (int)((b[i] >> shift) & 0xFF));
+			if (diff > *max_diff)
+				*max_diff = diff;
+		}
+	}
+}
+
+static void _time_kernel(bench_case_t* c, const bench_kernel_t* kernel,
+	int simd, bench_timing_t* timing)
+{
+	size_t pixels = _full_size(c);
+	int batch = pixels < BENCH_BATCH_PIXELS ? (int)(BENCH_BATCH_PIXELS / pixels) : 1;
+	double best_seconds = 1e30;
+	uint64_t best_ticks = 0;
+	double start = _now();
+	int reps = 0;
+	do {
+		double t0 = _now();
+		uint64_t ticks0 = __rdtsc();
+		for (int i = 0; i < batch; i++)
+			kernel->run(c, simd);
+		uint64_t ticks1 = __rdtsc();
+		double t1 = _now();
+		if (t1 - t0 < best_seconds) {
+			best_seconds = t1 - t0;
+			best_ticks = ticks1 - ticks0;
+		}
+		reps++;
+	} while (reps < BENCH_MIN_REPS || _now() - start < BENCH_MIN_SECONDS);
+
+	timing->seconds = best_seconds / batch;
+	timing->ticks = (double)best_ticks / batch;
+}
+
+static void _write_timing(FILE* out, const char* name, const bench_timing_t* timing,
+	size_t pixels, int bytes_per_pixel)
+{
+	double seconds = timing->seconds > 0 ? timing->seconds : 1e-12;
+	fprintf(out, "\"%s\": {\"seconds\": %.9g, \"gb_per_s\": %.3f, \"pixels_per_cycle\": %.3f}",
+		name, timing->seconds,
+		(double)pixels * bytes_per_pixel / seconds * 1e-9,
+		timing->ticks > 0 ? pixels / timing->ticks : 0.0);
+}
+
+static bool _bench_case(FILE* out, const bench_kernel_t* kernel, bench_case_t* c,
+	bool first)
+{
+	for (int simd = 0; simd < 2; simd++) {
+		memset(c->dest[simd], 0, _full_size(c) * sizeof(uint32_t));
+		if (kernel->prepare)
+			kernel->prepare(c, c->dest[simd]);
+		kernel->run(c, simd);
+	}
+
+	int max_diff = 0;
+	size_t mismatches = 0;
+	if (kernel->output_size) {
+		_compare(c->dest[0], c->dest[1], kernel->output_size(c),
+			&max_diff, &mismatches);
+	}
+	bool ok = max_diff <= kernel->tolerance;
+	if (kernel->check && !kernel->check(c))
+		ok = false;
+
+	bench_timing_t timings[2];
+	for (int simd = 0; simd < 2; simd++)
+		_time_kernel(c, kernel, simd, &timings[simd]);
+
+	size_t pixels = _full_size(c);
+	fprintf(out, "%s\n    {\"kernel\": \"%s\", \"width\": %d, \"height\": %d, "
+		"\"ok\": %s, \"max_diff\": %d, \"mismatches\": %llu,\n      ",
+		first ? "" : ",", kernel->name, c->width, c->height,
+		ok ? "true" : "false", max_diff, (unsigned long long)mismatches);
+	_write_timing(out, "scalar", &timings[0], pixels, kernel->bytes_per_pixel);
+	fprintf(out, ",\n      ");
+	_write_timing(out, "simd", &timings[1], pixels, kernel->bytes_per_pixel);
+	fprintf(out, ",\n      \"speedup\": %.2f}",
+		timings[1].seconds > 0 ? timings[0].seconds / timings[1].seconds : 0.0);
+	fflush(out);
+	return ok;
+}
+
+bool pixel_bench_run(FILE* out)
+{
+	bool all_ok = true;
+	bool first = true;
+
+	fprintf(out, "{\n  \"build\": \"%s %s\",\n  \"results\": [", __DATE__, __TIME__);
+
+	for (size_t s = 0; s < sizeof(bench_sizes) / sizeof(bench_sizes[0]); s++) {
+		bench_case_t c;
+		memset(&c, 0, sizeof(c));
+		c.width = bench_sizes[s][0];
+		c.height = bench_sizes[s][1];
+		c.color = 0xFF404040;
+		size_t size = _full_size(&c) * sizeof(uint32_t);
+		c.src = (uint32_t*)malloc(size);
+		c.baked = (uint32_t*)malloc(size);
+		c.dest[0] = (uint32_t*)malloc(size);
+		c.dest[1] = (uint32_t*)malloc(size);
+		c.blocks = (uint8_t*)malloc(_num_blocks(&c) * 16);
+		c.yuv = (uint8_t*)malloc(_yuv_bytes(&c));
+		if (c.src && c.baked && c.dest[0] && c.dest[1] && c.blocks && c.yuv) {
+			for (size_t i = 0; i < _full_size(&c); i++)
+				c.src[i] = _random_pixel();
+			_random_blocks(c.blocks, _num_blocks(&c));
+			for (size_t i = 0; i < _yuv_bytes(&c); i++)
+				c.yuv[i] = (uint8_t)_random();
+			pixel_bake_naive(c.baked, c.src, _full_size(&c), c.color);
+
+			for (size_t k = 0; k < sizeof(bench_kernels) / sizeof(bench_kernels[0]); k++) {
+				if (!_bench_case(out, &bench_kernels[k], &c, first))
+					all_ok = false;
+				first = false;
+			}
+		}
+		else {
+			all_ok = false;
+		}
+		free(c.src);
+		free(c.baked);
+		free(c.dest[0]);
+		free(c.dest[1]);
+		free(c.blocks);
+		free(c.yuv);
+	}
+
+	fprintf(out, "\n  ],\n  \"ok\": %s\n}\n", all_ok ? "true" : "false");
+	return all_ok;
+}
+
+#ifdef PIXEL_BENCH_MAIN
+int main(int argc, char** argv)
+{
+	FILE* out = stdout;
+	if (argc > 1) {
+		out = fopen(argv[1], "w");
+		if (!out) {
+			fprintf(stderr, "can't open %s\n", argv[1]);
+			return 2;
+		}
+	}
+	bool ok = pixel_bench_run(out);
+	if (out != stdout)
+		fclose(out);
+	return ok ? 0 : 1;
+}
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Checks each SIMD kernel in pixel_kernels.h, bcn.h, yuv.h and
+// png_decoder.h against its scalar reference, and times both, over a sweep
+// of image sizes: tiny, odd and even, L2 resident, and much larger than the
+// last level cache.  Results are
+// written to out as JSON, one record per kernel and size, so runs of
+// different builds can be compared.
+//
+// Runs from the viewer with --bench-kernels <file>, or standalone with
+/*
+	cc -O2 -DPIXEL_BENCH_MAIN pixel_bench.c pixel_kernels.c bcn.c yuv.c \
+		png_decoder.c inflate.c -o pixel_bench
+*/
+
+// returns false if any kernel disagreed with its reference.
+bool pixel_bench_run(FILE* out);
@@ -0,0 +1,161 @@
+#include "dev_image_viewer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lz.h"
+#include "parallel.h"
+#include "pixel_codec.h"
+#include "pixel_kernels.h"
+#include "trace.h"
+
+// target uncompressed size of a band. small enough to stay in L2 while it
+// is decoded and filtered, big enough to give LZ something to find.
+#define PIXEL_BAND_BYTES (256 * 1024)
+
+typedef struct {
+	uint8_t* data;
+	uint32_t size;
+	bool compressed;	// otherwise stored filtered, but not compressed
+} pixel_band_t;
+
+struct pixel_blob_t {
+	int width;
+	int height;
+	int band_rows;
+	int num_bands;
+	pixel_band_t* bands;
+	size_t bytes;
+};
+
+typedef struct {
+	pixel_blob_t* blob;
+	uint32_t* pixels;
+	volatile LONG failed;
+} pixel_job_t;
+
+static void _compress_band(void* ctx, int index)
+{
+	pixel_job_t* job = (pixel_job_t*)ctx;
+	pixel_blob_t* blob = job->blob;
+	int y0 = index * blob->band_rows;
+	int rows = min(blob->band_rows, blob->height - y0);
+	size_t raw_size = (size_t)rows * blob->width * sizeof(uint32_t);
+	size_t bound = lz_compress_bound(raw_size);
+	uint64_t start = trace_begin();
+
+	uint8_t* filtered = (uint8_t*)malloc(raw_size + bound);
+	if (!filtered) {
+		InterlockedExchange(&job->failed, 1);
+		return;
+	}
+	uint8_t* compressed = filtered + raw_size;
+
+	for (int y = 0; y < rows; y++) {
+		pixel_delta_row_sse2((uint32_t*)filtered + (size_t)y * blob->width,
+			job->pixels + (size_t)(y0 + y) * blob->width, blob->width);
+	}
+
+	pixel_band_t* band = &blob->bands[index];
+	size_t size = lz_compress(filtered, raw_size, compressed, bound);
+	band->compressed = size && size < raw_size;
+	if (!band->compressed)
+		size = raw_size;
+	band->data = (uint8_t*)malloc(size);
+	if (!band->data) {
+		free(filtered);
+		InterlockedExchange(&job->failed, 1);
+		return;
+	}
+	memcpy(band->data, band->compressed ? compressed : filtered, size);
+	band->size = (uint32_t)size;
+	free(filtered);
+	trace_end(TRACE_CODEC_BAND, start, raw_size, raw_size / 4);
+}
+
+static void _decompress_band(void* ctx, int index)
+{
+	pixel_job_t* job = (pixel_job_t*)ctx;
+	const pixel_blob_t* blob = job->blob;
+	int y0 = index * blob->band_rows;
+	int rows = min(blob->band_rows, blob->height - y0);
+	size_t raw_size = (size_t)rows * blob->width * sizeof(uint32_t);
+	uint32_t* dest = job->pixels + (size_t)y0 * blob->width;
+	const pixel_band_t* band = &blob->bands[index];
+	uint64_t start = trace_begin();
+
+	if (band->compressed) {
+		if (!lz_decompress(band->data, band->size, dest, raw_size)) {
+			InterlockedExchange(&job->failed, 1);
+			return;
+		}
+	}
+	else {
+		memcpy(dest, band->data, raw_size);
+	}
+
+	for (int y = 0; y < rows; y++)
+		pixel_undelta_row_sse2(dest + (size_t)y * blob->width, blob->width);
+	trace_end(TRACE_CODEC_BAND, start, raw_size, raw_size / 4);
+}
+
+pixel_blob_t* pixel_blob_compress(const uint32_t* pixels, int width, int height)
+{
+	if (width <= 0 || height <= 0)
+		return NULL;
+
+	pixel_blob_t* blob = (pixel_blob_t*)calloc(1, sizeof(pixel_blob_t));
+	if (!blob)
+		return NULL;
+	blob->width = width;
+	blob->height = height;
+	blob->band_rows = max(1, PIXEL_BAND_BYTES / (width * (int)sizeof(uint32_t)));
+	blob->num_bands = (height + blob->band_rows - 1) / blob->band_rows;
+	blob->bands = (pixel_band_t*)calloc(blob->num_bands, sizeof(pixel_band_t));
+	if (!blob->bands) {
+		free(blob);
+		return NULL;
+	}
+
+	pixel_job_t job;
+	job.blob = blob;
+	job.pixels = (uint32_t*)pixels;
+	job.failed = 0;
+	parallel_for(blob->num_bands, _compress_band, &job);
+	if (job.failed) {
+		pixel_blob_free(blob);
+		return NULL;
+	}
+
+	blob->bytes = sizeof(pixel_blob_t) + blob->num_bands * sizeof(pixel_band_t);
+	for (int i = 0; i < blob->num_bands; i++)
+		blob->bytes += blob->bands[i].size;
+	return blob;
+}
+
+bool pixel_blob_decompress(const pixel_blob_t* blob, uint32_t* pixels)
+{
+	pixel_job_t job;
+	job.blob = (pixel_blob_t*)blob;
+	job.pixels = pixels;
+	job.failed = 0;
+	parallel_for(blob->num_bands, _decompress_band, &job);
+	return !job.failed;
+}
+
+void pixel_blob_free(pixel_blob_t* blob)
+{
+	if (!blob)
+		return;
+	if (blob->bands) {
+		for (int i = 0; i < blob->num_bands; i++)
+			free(blob->bands[i].data);
+		free(blob->bands);
+	}
+	free(blob);
+}
+
+size_t pixel_blob_size(const pixel_blob_t* blob)
+{
+	return blob->bytes;
+}
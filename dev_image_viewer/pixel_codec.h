@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lossless in-memory compression of 32-bit pixel arrays.
+// Rows are delta coded against the pixel to their left, then bands of rows
+// are LZ compressed independently, so bands (de)compress in parallel.
+// Flat and gradient areas, common in render output and masks, become
+// runs of zeros.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct pixel_blob_t pixel_blob_t;
+
+pixel_blob_t* pixel_blob_compress(const uint32_t* pixels, int width, int height);
+// pixels must have room for the original width x height, tightly packed.
+bool pixel_blob_decompress(const pixel_blob_t* blob, uint32_t* pixels);
+void pixel_blob_free(pixel_blob_t* blob);
+
+// compressed bytes held, including bookkeeping
+size_t pixel_blob_size(const pixel_blob_t* blob);
+
+#ifdef __cplusplus
+}
+#endif
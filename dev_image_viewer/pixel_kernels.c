@@ -0,0 +1,565 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#include "pixel_kernels.h"
+
+void pixel_downsize_naive(
+	uint32_t* src_pixels, int src_width, int src_height,
+	uint32_t* dest_pixels, int dest_width, int dest_height,
+	uint32_t bg_color)
+{
+	// this code has vestigial support for non-2X downsizing
+	int scale = 2;
+
+	int back_r = (bg_color >> 16) & 0xFF;
+	int back_g = (bg_color >> 8) & 0xFF;
+	int back_b = bg_color & 0xFF;
+
+	int r, g, b, a;
+	uint32_t src_pixel;
+	int scale_sqr = scale * scale;
+	for (int desty = 0; desty < dest_height; desty++) {
+		for (int destx = 0; destx < dest_width; destx++) {
+			r = g = b = a = 0;
+			for (int srcy = desty * scale; srcy < desty * scale + scale; srcy++) {
+				for (int srcx = destx * scale; srcx < destx * scale + scale; srcx++) {
+					if (srcx < src_width && srcy < src_height) {
+						src_pixel = ((uint32_t*)src_pixels)[srcy * src_width + srcx];
+						r += (src_pixel >> 16) & 0xFF;
+						g += (src_pixel >> 8) & 0xFF;
+						b += src_pixel & 0xFF;
+						a += src_pixel >> 24;
+					}
+				}
+			}
+
+			r /= scale_sqr;
+			g /= scale_sqr;
+			b /= scale_sqr;
+			a /= scale_sqr;
+
+			// bake the background color in. because original bitmap was
+			// already baked, this only happens to right/bottom edges.
+			r += back_r * (255 - a) / 255;
+			g += back_g * (255 - a) / 255;
+			b += back_b * (255 - a) / 255;
+			a = 255;
+
+			((uint32_t*)dest_pixels)[desty * dest_width + destx] =
+				(a << 24) | (r << 16) | (g << 8) | b;
+		}
+	}
+}
+
+// downsizes only the destination pixels inside [x0, x1) x [y0, y1), clipped
+// to the destination.
+void pixel_downsize_sse2_rect(
+	uint32_t* src_pixels, int src_width, int src_height,
+	uint32_t* dest_pixels, int dest_width, int dest_height,
+	uint32_t bg_color,
+	int x0, int y0, int x1, int y1
+)
+{
+	// rounded up tile rects can reach past the destination
+	if (x1 > dest_width)
+		x1 = dest_width;
+	if (y1 > dest_height)
+		y1 = dest_height;
+
+	const __m128i zero = _mm_setzero_si128();
+	__m128i temp = zero;
+
+	// get 1x and 2x the background color, expanded to 16-bit components
+	__m128i bg = _mm_unpacklo_epi8(_mm_loadu_si32(&bg_color), zero);
+	__m128i bg_x2 = _mm_slli_epi16(bg, 1);
+
+	// Main quadrant: 2x2 pixel groups
+	int quad_area_width = src_width / 2;
+	int quad_area_height = src_height / 2;
+	int quad_x1 = x1 < quad_area_width ? x1 : quad_area_width;
+	int quad_y1 = y1 < quad_area_height ? y1 : quad_area_height;
+	for (int dest_y = y0; dest_y < quad_y1; dest_y++) {
+		uint32_t* src_ptr = &src_pixels[dest_y * 2 * src_width + x0 * 2];
+		for (int dest_x = x0; dest_x < quad_x1; dest_x++, src_ptr += 2) {
+			// load top 2 and bottom 2 pixels, extend to 16-bit components
+			__m128i top = _mm_unpacklo_epi8(_mm_loadu_si64(src_ptr), zero);
+			__m128i bottom = _mm_unpacklo_epi8(_mm_loadu_si64(src_ptr + src_width), zero);
+			// add all 4 together
+			__m128i accum = _mm_add_epi16(top, bottom);
+			temp = _mm_castps_si128(
+				_mm_movehl_ps(_mm_castsi128_ps(temp), _mm_castsi128_ps(accum)));
+			accum = _mm_add_epi16(accum, temp);
+			// divide by 4
+			accum = _mm_srli_epi16(accum, 2);
+			// convert back to 8-bit and write destination pixel
+			__m128i result = _mm_packus_epi16(accum, zero);
+			_mm_storeu_si32(&dest_pixels[dest_y * dest_width + dest_x], result);
+		}
+	}
+
+	// Bottom edge, if odd height
+	if ((src_height & 1) && quad_area_height >= y0 && quad_area_height < y1) {
+		int dest_y = quad_area_height;
+		uint32_t* src_ptr = &src_pixels[dest_y * 2 * src_width + x0 * 2];
+		for (int dest_x = x0; dest_x < quad_x1; dest_x++, src_ptr += 2) {
+			// load 2 horiz pixels, extend to 16-bit
+			__m128i accum = _mm_unpacklo_epi8(_mm_loadu_si64(src_ptr), zero);
+			// add together
+			temp = _mm_castps_si128(
+				_mm_movehl_ps(_mm_castsi128_ps(temp), _mm_castsi128_ps(accum)));
+			accum = _mm_add_epi16(accum, temp);
+			// add 2x the background color
+			accum = _mm_add_epi16(accum, bg_x2);
+			// divide by 4
+			accum = _mm_srli_epi16(accum, 2);
+			// convert back to 8-bit and write destination pixel
+			__m128i result = _mm_packus_epi16(accum, zero);
+			_mm_storeu_si32(&dest_pixels[dest_y * dest_width + dest_x], result);
+		}
+	}
+
+	// Right edge, if odd width
+	if ((src_width & 1) && quad_area_width >= x0 && quad_area_width < x1) {
+		int dest_x = quad_area_width;
+		uint32_t* src_ptr = &src_pixels[y0 * 2 * src_width + src_width - 1];
+		for (int dest_y = y0; dest_y < quad_y1; dest_y++, src_ptr += 2 * src_width) {
+			// load upper and lower pixels, extend
+			__m128i top = _mm_unpacklo_epi8(_mm_loadu_si32(src_ptr), zero);
+			__m128i bottom = _mm_unpacklo_epi8(_mm_loadu_si32(src_ptr + src_width), zero);
+			// add together
+			__m128i accum = _mm_add_epi16(top, bottom);
+			// add 2x the background color
+			accum = _mm_add_epi16(accum, bg_x2);
+			// divide by 4
+			accum = _mm_srli_epi16(accum, 2);
+			// convert back to 8-bit and write destination pixel
+			__m128i result = _mm_packus_epi16(accum, zero);
+			_mm_storeu_si32(&dest_pixels[dest_y * dest_width + dest_x], result);
+		}
+	}
+
+	// Bottom right corner pixel, if odd width and height
+	if ((src_width & 1) && (src_height & 1) &&
+		quad_area_width >= x0 && quad_area_width < x1 &&
+		quad_area_height >= y0 && quad_area_height < y1) {
+		int dest_x = quad_area_width;
+		int dest_y = quad_area_height;
+		uint32_t* src_ptr = &src_pixels[dest_y * 2 * src_width + dest_x * 2];
+		// load the bottom right corner pixel
+		__m128i accum = _mm_unpacklo_epi8(_mm_loadu_si32(src_ptr), zero);
+		// add 3x the background color
+		accum = _mm_add_epi16(accum, _mm_add_epi16(bg, bg_x2));
+		// divide by 4
+		accum = _mm_srli_epi16(accum, 2);
+		// convert back to 8-bit and write destination pixel
+		__m128i result = _mm_packus_epi16(accum, zero);
+		_mm_storeu_si32(&dest_pixels[dest_y * dest_width + dest_x], result);
+	}
+}
+
+void pixel_downsize_sse2(
+	uint32_t* src_pixels, int src_width, int src_height,
+	uint32_t* dest_pixels, int dest_width, int dest_height,
+	uint32_t bg_color
+)
+{
+	pixel_downsize_sse2_rect(src_pixels, src_width, src_height,
+		dest_pixels, dest_width, dest_height, bg_color,
+		0, 0, dest_width, dest_height);
+}
+
+void pixel_bake_naive(uint32_t* dest, const uint32_t* src, uint64_t count,
+	uint32_t color)
+{
+	int back_r = (color >> 16) & 0xFF;
+	int back_g = (color >> 8) & 0xFF;
+	int back_b = color & 0xFF;
+	int r, g, b, a;
+	uint32_t pixel;
+	for (uint64_t i = 0; i < count; i++) {
+		pixel = src[i];
+		r = (pixel >> 16) & 0xFF;
+		g = (pixel >> 8) & 0xFF;
+		b = pixel & 0xFF;
+		a = (pixel >> 24);
+		r += back_r * (255 - a) / 255;
+		g += back_g * (255 - a) / 255;
+		b += back_b * (255 - a) / 255;
+		a = 255;
+		dest[i] = (a << 24) | (r << 16) | (g << 8) | b;
+	}
+}
+
+// bakes 2 pixels, already extended to 16-bit components.
+// bg must hold the background color in both halves.
+static __m128i _bake2_sse2(__m128i pixels, __m128i bg)
+{
+	const __m128i twofiftyfive = _mm_set1_epi16(255);
+	const __m128i ones = _mm_set1_epi16(1);
+
+	// duplicate the both alphas into all channels
+	__m128i alphas = _mm_shufflelo_epi16(pixels, 255);
+	alphas = _mm_shufflehi_epi16(alphas, 255);
+	__m128i inv_alphas = _mm_sub_epi16(twofiftyfive, alphas);
+	__m128i bg_times_inv_alpha = _mm_mullo_epi16(inv_alphas, bg);
+	// one way to approximate div by 255.
+	__m128i blend = _mm_srli_epi16(
+		_mm_add_epi16(
+			_mm_add_epi16(bg_times_inv_alpha, ones),
+			_mm_srli_epi16(bg_times_inv_alpha, 8)
+		),
+		8
+	);
+	return _mm_add_epi16(pixels, blend);
+}
+
+// bakes 4 pixels, as 8-bit components.
+static __m128i _bake4_sse2(__m128i pixels, __m128i bg)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i lo = _bake2_sse2(_mm_unpacklo_epi8(pixels, zero), bg);
+	__m128i hi = _bake2_sse2(_mm_unpackhi_epi8(pixels, zero), bg);
+	return _mm_packus_epi16(lo, hi);
+}
+
+static __m128i _expand_bg_sse2(uint32_t color)
+{
+	__m128i bg = _mm_unpacklo_epi8(_mm_loadu_si32(&color), _mm_setzero_si128());
+	// duplicate bg into top 64 bits for processing two pixels at once
+	return _mm_or_si128(bg, _mm_slli_si128(bg, 8));
+}
+
+// every pixel gets the same arithmetic, regardless of its position, so
+// baking a tile gives exactly the bits that baking the whole image would.
+void pixel_bake_sse2(uint32_t* dest, const uint32_t* src, uint64_t count,
+	uint32_t color)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i bg = _expand_bg_sse2(color);
+
+	uint64_t num_quad_pixels = count & ~3;
+	for (uint64_t i = 0; i < num_quad_pixels; i += 4) {
+		__m128i pixels = _mm_loadu_si128((const __m128i*)&src[i]);
+		_mm_storeu_si128((__m128i*)&dest[i], _bake4_sse2(pixels, bg));
+	}
+
+	// remaining 0-3 pixels, one at a time
+	for (uint64_t i = num_quad_pixels; i < count; i++) {
+		__m128i pixel = _mm_unpacklo_epi8(_mm_loadu_si32(&src[i]), zero);
+		_mm_storeu_si32(&dest[i], _mm_packus_epi16(_bake2_sse2(pixel, bg), zero));
+	}
+}
+
+bool pixel_tile_differs_naive(const uint32_t* src, const uint32_t* baked,
+	int stride, int width, int height, uint32_t color)
+{
+	for (int y = 0; y < height; y++) {
+		const uint32_t* src_row = src + (size_t)y * stride;
+		const uint32_t* baked_row = baked + (size_t)y * stride;
+		for (int x = 0; x < width; x++) {
+			uint32_t pixel;
+			pixel_bake_naive(&pixel, &src_row[x], 1, color);
+			if (pixel != baked_row[x])
+				return true;
+		}
+	}
+	return false;
+}
+
+// bakes the tile in registers, rather than into memory
+bool pixel_tile_differs_sse2(const uint32_t* src, const uint32_t* baked,
+	int stride, int width, int height, uint32_t color)
+{
+	const __m128i zero = _mm_setzero_si128();
+	__m128i bg = _expand_bg_sse2(color);
+
+	int quad_width = width & ~3;
+	for (int y = 0; y < height; y++) {
+		const uint32_t* src_row = src + (size_t)y * stride;
+		const uint32_t* baked_row = baked + (size_t)y * stride;
+		for (int x = 0; x < quad_width; x += 4) {
+			__m128i pixels = _bake4_sse2(
+				_mm_loadu_si128((const __m128i*)&src_row[x]), bg);
+			__m128i old = _mm_loadu_si128((const __m128i*)&baked_row[x]);
+			if (_mm_movemask_epi8(_mm_cmpeq_epi32(pixels, old)) != 0xFFFF)
+				return true;
+		}
+		for (int x = quad_width; x < width; x++) {
+			__m128i pixel = _mm_unpacklo_epi8(_mm_loadu_si32(&src_row[x]), zero);
+			pixel = _mm_packus_epi16(_bake2_sse2(pixel, bg), zero);
+			if ((uint32_t)_mm_cvtsi128_si32(pixel) != baked_row[x])
+				return true;
+		}
+	}
+	return false;
+}
+
+void pixel_xor_tile_naive(uint32_t* dest, int dest_stride, const uint32_t* src,
+	int src_stride, int width, int height)
+{
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++)
+			dest[(size_t)y * dest_stride + x] ^= src[(size_t)y * src_stride + x];
+	}
+}
+
+void pixel_xor_tile_sse2(uint32_t* dest, int dest_stride, const uint32_t* src,
+	int src_stride, int width, int height)
+{
+	int quad_width = width & ~3;
+	for (int y = 0; y < height; y++) {
+		uint32_t* row = dest + (size_t)y * dest_stride;
+		const uint32_t* delta_row = src + (size_t)y * src_stride;
+		for (int x = 0; x < quad_width; x += 4) {
+			__m128i pixels = _mm_loadu_si128((const __m128i*)&row[x]);
+			pixels = _mm_xor_si128(pixels, _mm_loadu_si128((const __m128i*)&delta_row[x]));
+			_mm_storeu_si128((__m128i*)&row[x], pixels);
+		}
+		for (int x = quad_width; x < width; x++)
+			row[x] ^= delta_row[x];
+	}
+}
+
+// per-byte a - b and a + b, four channels at once
+static uint32_t _sub_bytes(uint32_t a, uint32_t b)
+{
+	return ((a | 0x80808080) - (b & 0x7F7F7F7F)) ^ ((a ^ ~b) & 0x80808080);
+}
+
+static uint32_t _add_bytes(uint32_t a, uint32_t b)
+{
+	return ((a & 0x7F7F7F7F) + (b & 0x7F7F7F7F)) ^ ((a ^ b) & 0x80808080);
+}
+
+void pixel_delta_row_naive(uint32_t* dest, const uint32_t* src, int width)
+{
+	for (int x = 0; x < width; x++)
+		dest[x] = _sub_bytes(src[x], x ? src[x - 1] : 0);
+}
+
+void pixel_delta_row_sse2(uint32_t* dest, const uint32_t* src, int width)
+{
+	__m128i prev = _mm_setzero_si128();
+	int quad_width = width & ~3;
+	for (int x = 0; x < quad_width; x += 4) {
+		__m128i cur = _mm_loadu_si128((const __m128i*)&src[x]);
+		// the 4 left neighbors: shift in the last pixel of the previous group
+		__m128i left = _mm_or_si128(_mm_slli_si128(cur, 4), _mm_srli_si128(prev, 12));
+		_mm_storeu_si128((__m128i*)&dest[x], _mm_sub_epi8(cur, left));
+		prev = cur;
+	}
+	for (int x = quad_width; x < width; x++)
+		dest[x] = _sub_bytes(src[x], x ? src[x - 1] : 0);
+}
+
+void pixel_undelta_row_naive(uint32_t* pixels, int width)
+{
+	for (int x = 1; x < width; x++)
+		pixels[x] = _add_bytes(pixels[x], pixels[x - 1]);
+}
+
+// a prefix sum per channel
+void pixel_undelta_row_sse2(uint32_t* pixels, int width)
+{
+	__m128i carry = _mm_setzero_si128();	// previous pixel, in all lanes
+	int quad_width = width & ~3;
+	for (int x = 0; x < quad_width; x += 4) {
+		__m128i v = _mm_loadu_si128((const __m128i*)&pixels[x]);
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 4));
+		v = _mm_add_epi8(v, _mm_slli_si128(v, 8));
+		v = _mm_add_epi8(v, carry);
+		_mm_storeu_si128((__m128i*)&pixels[x], v);
+		carry = _mm_shuffle_epi32(v, 0xFF);
+	}
+	for (int x = quad_width; x < width; x++)
+		pixels[x] = _add_bytes(pixels[x], x ? pixels[x - 1] : 0);
+}
+
+static int _channel_diff(uint32_t a, uint32_t b, int shift)
+{
+	return abs((int)((a >> shift) & 0xFF) - (int)((b >> shift) & 0xFF));
+}
+
+void pixel_absdiff_naive(uint32_t* dest, const uint32_t* a, const uint32_t* b, int count)
+{
+	for (int i = 0; i < count; i++) {
+		dest[i] = 0xFF000000 | (_channel_diff(a[i], b[i], 16) << 16) |
+			(_channel_diff(a[i], b[i], 8) << 8) | _channel_diff(a[i], b[i], 0);
+	}
+}
+
+// |a - b| per byte, with alpha cleared
+static __m128i _absdiff_rgb_sse2(const uint32_t* a, const uint32_t* b)
+{
+	__m128i va = _mm_loadu_si128((const __m128i*)a);
+	__m128i vb = _mm_loadu_si128((const __m128i*)b);
+	__m128i diff = _mm_or_si128(_mm_subs_epu8(va, vb), _mm_subs_epu8(vb, va));
+	return _mm_and_si128(diff, _mm_set1_epi32(0x00FFFFFF));
+}
+
+void pixel_absdiff_sse2(uint32_t* dest, const uint32_t* a, const uint32_t* b, int count)
+{
+	__m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	int quad_count = count & ~3;
+	for (int i = 0; i < quad_count; i += 4)
+		_mm_storeu_si128((__m128i*)&dest[i], _mm_or_si128(_absdiff_rgb_sse2(&a[i], &b[i]), alpha));
+	pixel_absdiff_naive(dest + quad_count, a + quad_count, b + quad_count, count - quad_count);
+}
+
+static uint32_t _heat(int diff)
+{
+	int x = diff * 12;
+	int r = x < 255 ? x : 255;
+	int g = x < 255 ? 0 : x < 510 ? x - 255 : 255;
+	int b = x < 510 ? 0 : x < 765 ? x - 510 : 255;
+	return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+void pixel_heatmap_naive(uint32_t* dest, const uint32_t* a, const uint32_t* b, int count)
+{
+	for (int i = 0; i < count; i++) {
+		int diff = _channel_diff(a[i], b[i], 16);
+		int g = _channel_diff(a[i], b[i], 8);
+		int bl = _channel_diff(a[i], b[i], 0);
+		if (g > diff)
+			diff = g;
+		if (bl > diff)
+			diff = bl;
+		dest[i] = _heat(diff);
+	}
+}
+
+void pixel_heatmap_sse2(uint32_t* dest, const uint32_t* a, const uint32_t* b, int count)
+{
+	__m128i max8 = _mm_set1_epi32(255);
+	__m128i max16 = _mm_set1_epi32(510);
+	__m128i alpha = _mm_set1_epi32((int)0xFF000000);
+	int quad_count = count & ~3;
+	for (int i = 0; i < quad_count; i += 4) {
+		// the largest channel in the low byte of each pixel
+		__m128i diff = _absdiff_rgb_sse2(&a[i], &b[i]);
+		diff = _mm_max_epu8(diff, _mm_srli_epi32(diff, 8));
+		diff = _mm_max_epu8(diff, _mm_srli_epi32(diff, 16));
+		diff = _mm_and_si128(diff, _mm_set1_epi32(0xFF));
+		// 16 bits hold x, and the upper halves stay 0
+		__m128i x = _mm_mullo_epi16(diff, _mm_set1_epi32(12));
+		__m128i r = _mm_min_epi16(x, max8);
+		__m128i g = _mm_min_epi16(_mm_subs_epu16(x, max8), max8);
+		__m128i bl = _mm_min_epi16(_mm_subs_epu16(x, max16), max8);
+		__m128i heat = _mm_or_si128(_mm_or_si128(_mm_slli_epi32(r, 16), _mm_slli_epi32(g, 8)),
+			_mm_or_si128(bl, alpha));
+		_mm_storeu_si128((__m128i*)&dest[i], heat);
+	}
+	pixel_heatmap_naive(dest + quad_count, a + quad_count, b + quad_count, count - quad_count);
+}
+
+void pixel_diff_stats_naive(const uint32_t* a, const uint32_t* b, int count,
+	pixel_diff_stats_t* stats)
+{
+	for (int i = 0; i < count; i++) {
+		bool differs = false;
+		for (int shift = 0; shift < 24; shift += 8) {
+			int diff = _channel_diff(a[i], b[i], shift);
+			stats->sum_squares += (uint64_t)(diff * diff);
+			if (diff > stats->max_diff)
+				stats->max_diff = diff;
+			differs = differs || diff;
+		}
+		stats->num_differing += differs;
+	}
+}
+
+// the 32-bit sums are moved to stats before they can overflow: each quad
+// adds at most 2 * 2 * 255 * 255 to a lane
+#define PIXEL_DIFF_STATS_FLUSH 4096
+
+void pixel_diff_stats_sse2(const uint32_t* a, const uint32_t* b, int count,
+	pixel_diff_stats_t* stats)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i max = zero;
+	int quad_count = count & ~3;
+	for (int start = 0; start < quad_count; start += PIXEL_DIFF_STATS_FLUSH * 4) {
+		int end = start + PIXEL_DIFF_STATS_FLUSH * 4;
+		if (end > quad_count)
+			end = quad_count;
+		__m128i sums = zero;
+		__m128i equal = zero;	// counts down, by -1 per equal pixel
+		for (int i = start; i < end; i += 4) {
+			__m128i diff = _absdiff_rgb_sse2(&a[i], &b[i]);
+			max = _mm_max_epu8(max, diff);
+			equal = _mm_add_epi32(equal, _mm_cmpeq_epi32(diff, zero));
+			__m128i lo = _mm_unpacklo_epi8(diff, zero);
+			__m128i hi = _mm_unpackhi_epi8(diff, zero);
+			sums = _mm_add_epi32(sums, _mm_add_epi32(_mm_madd_epi16(lo, lo),
+				_mm_madd_epi16(hi, hi)));
+		}
+		uint32_t lanes[4];
+		int32_t equal_lanes[4];
+		_mm_storeu_si128((__m128i*)lanes, sums);
+		_mm_storeu_si128((__m128i*)equal_lanes, equal);
+		for (int i = 0; i < 4; i++) {
+			stats->sum_squares += lanes[i];
+			stats->num_differing += (uint64_t)(end - start) / 4 + equal_lanes[i];
+		}
+	}
+	max = _mm_max_epu8(max, _mm_srli_epi32(max, 8));
+	max = _mm_max_epu8(max, _mm_srli_epi32(max, 16));
+	max = _mm_max_epu8(max, _mm_srli_si128(max, 8));
+	max = _mm_max_epu8(max, _mm_srli_si128(max, 4));
+	int quad_max = _mm_cvtsi128_si32(max) & 0xFF;
+	if (quad_max > stats->max_diff)
+		stats->max_diff = quad_max;
+	pixel_diff_stats_naive(a + quad_count, b + quad_count, count - quad_count, stats);
+}
+
+void pixel_histogram_naive(const uint32_t* pixels, int count, pixel_histogram_t* histogram)
+{
+	for (int i = 0; i < count; i++) {
+		uint32_t pixel = pixels[i];
+		histogram->counts[0][pixel & 0xFF]++;
+		histogram->counts[1][(pixel >> 8) & 0xFF]++;
+		histogram->counts[2][(pixel >> 16) & 0xFF]++;
+		histogram->counts[3][pixel >> 24]++;
+	}
+}
+
+// counts a pair of pixels, the first into even and the second into odd
+static void _histogram_add_pair(uint32_t (*even)[256], uint32_t (*odd)[256], uint64_t pair)
+{
+	even[0][pair & 0xFF]++;
+	even[1][(pair >> 8) & 0xFF]++;
+	even[2][(pair >> 16) & 0xFF]++;
+	even[3][(pair >> 24) & 0xFF]++;
+	odd[0][(pair >> 32) & 0xFF]++;
+	odd[1][(pair >> 40) & 0xFF]++;
+	odd[2][(pair >> 48) & 0xFF]++;
+	odd[3][pair >> 56]++;
+}
+
+void pixel_histogram_sse2(const uint32_t* pixels, int count, pixel_histogram_t* histogram)
+{
+	// the odd pixels' table. the even ones count into histogram.
+	pixel_histogram_t odd;
+	memset(&odd, 0, sizeof(odd));
+	int quad_count = count & ~3;
+	for (int i = 0; i < quad_count; i += 4) {
+		uint64_t pairs[2];
+		_mm_storeu_si128((__m128i*)pairs, _mm_loadu_si128((const __m128i*)&pixels[i]));
+		_histogram_add_pair(histogram->counts, odd.counts, pairs[0]);
+		_histogram_add_pair(histogram->counts, odd.counts, pairs[1]);
+	}
+	pixel_histogram_naive(pixels + quad_count, count - quad_count, histogram);
+
+	for (int c = 0; c < 4; c++) {
+		for (int v = 0; v < 256; v += 4) {
+			__m128i sum = _mm_add_epi32(_mm_loadu_si128((const __m128i*)&histogram->counts[c][v]),
+				_mm_loadu_si128((const __m128i*)&odd.counts[c][v]));
+			_mm_storeu_si128((__m128i*)&histogram->counts[c][v], sum);
+		}
+	}
+}
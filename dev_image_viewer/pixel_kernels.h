@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// The pixel loops behind the canvas and the pixel codec, on tightly packed
+// 32bpp premultiplied BGRA.  Each SIMD kernel has a scalar reference next
+// to it, which pixel_bench.c checks it against.  Nothing here depends on
+// Windows, so the kernels and the benchmark also build elsewhere.
+
+// 2x box filter.  dest is (src + 1) / 2 in each dimension; the missing
+// pixels past odd edges count as bg_color.
+void pixel_downsize_naive(
+	uint32_t* src_pixels, int src_width, int src_height,
+	uint32_t* dest_pixels, int dest_width, int dest_height,
+	uint32_t bg_color);
+void pixel_downsize_sse2(
+	uint32_t* src_pixels, int src_width, int src_height,
+	uint32_t* dest_pixels, int dest_width, int dest_height,
+	uint32_t bg_color);
+// downsizes only the destination pixels inside [x0, x1) x [y0, y1), clipped
+// to the destination.
+void pixel_downsize_sse2_rect(
+	uint32_t* src_pixels, int src_width, int src_height,
+	uint32_t* dest_pixels, int dest_width, int dest_height,
+	uint32_t bg_color,
+	int x0, int y0, int x1, int y1);
+
+// blends count pixels from src over color into dest, making them opaque.
+// dest and src may be the same array.
+void pixel_bake_naive(uint32_t* dest, const uint32_t* src, uint64_t count,
+	uint32_t color);
+void pixel_bake_sse2(uint32_t* dest, const uint32_t* src, uint64_t count,
+	uint32_t color);
+
+// bakes a rect of unbaked src pixels and compares it against the already
+// baked pixels.  returns true at the first difference.
+bool pixel_tile_differs_naive(const uint32_t* src, const uint32_t* baked,
+	int stride, int width, int height, uint32_t color);
+bool pixel_tile_differs_sse2(const uint32_t* src, const uint32_t* baked,
+	int stride, int width, int height, uint32_t color);
+
+// XORs a rect of src pixels into dest
+void pixel_xor_tile_naive(uint32_t* dest, int dest_stride, const uint32_t* src,
+	int src_stride, int width, int height);
+void pixel_xor_tile_sse2(uint32_t* dest, int dest_stride, const uint32_t* src,
+	int src_stride, int width, int height);
+
+// dest[x] = src[x] - src[x - 1], per channel. the first pixel is as is.
+void pixel_delta_row_naive(uint32_t* dest, const uint32_t* src, int width);
+void pixel_delta_row_sse2(uint32_t* dest, const uint32_t* src, int width);
+// undoes pixel_delta_row_*() in place
+void pixel_undelta_row_naive(uint32_t* pixels, int width);
+void pixel_undelta_row_sse2(uint32_t* pixels, int width);
+
+// what two images differ by, summed over their RGB channels. alpha is left
+// out, since images are compared baked.
+typedef struct {
+	uint64_t sum_squares;	// of the channel differences
+	uint64_t num_differing;	// pixels
+	int max_diff;			// in any channel
+} pixel_diff_stats_t;
+
+// dest is |a - b| per channel, opaque
+void pixel_absdiff_naive(uint32_t* dest, const uint32_t* a, const uint32_t* b, int count);
+void pixel_absdiff_sse2(uint32_t* dest, const uint32_t* a, const uint32_t* b, int count);
+// dest is the largest channel difference times 12 on a black, red, yellow,
+// white ramp, so a difference of 1 shows and 64 or more is white
+void pixel_heatmap_naive(uint32_t* dest, const uint32_t* a, const uint32_t* b, int count);
+void pixel_heatmap_sse2(uint32_t* dest, const uint32_t* a, const uint32_t* b, int count);
+// adds count pixels of a and b to stats
+void pixel_diff_stats_naive(const uint32_t* a, const uint32_t* b, int count,
+	pixel_diff_stats_t* stats);
+void pixel_diff_stats_sse2(const uint32_t* a, const uint32_t* b, int count,
+	pixel_diff_stats_t* stats);
+
+// counts of each value of each channel, in memory order: B, G, R, A
+typedef struct {
+	uint32_t counts[4][256];
+} pixel_histogram_t;
+
+// adds count pixels to histogram.  SSE2 can't scatter the increments, so
+// the SIMD version only loads 4 pixels at a time, and counts alternate
+// pixels into two tables, which keeps runs of equal values from stalling
+// on the same counters.
+void pixel_histogram_naive(const uint32_t* pixels, int count, pixel_histogram_t* histogram);
+void pixel_histogram_sse2(const uint32_t* pixels, int count, pixel_histogram_t* histogram);
@@ -0,0 +1,253 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef PNG_BENCH_LIBPNG
+#include <png.h>
+#endif
+
+#include "png_bench.h"
+#include "png_decoder.h"
+
+// each timing repeats until both of these are reached
+#define BENCH_MIN_REPS 3
+#define BENCH_MIN_SECONDS 0.5
+
+static double _now()
+{
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint8_t* _read_file(const char* path, size_t* out_size)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return NULL;
+	uint8_t* data = NULL;
+	long size = 0;
+	if (!fseek(file, 0, SEEK_END) && (size = ftell(file)) > 0 && !fseek(file, 0, SEEK_SET))
+		data = (uint8_t*)malloc((size_t)size);
+	if (data && fread(data, 1, (size_t)size, file) != (size_t)size) {
+		free(data);
+		data = NULL;
+	}
+	fclose(file);
+	*out_size = (size_t)size;
+	return data;
+}
+
+// the whole image, as the canvas reads it
+static bool _decode(const uint8_t* data, size_t size, uint32_t* dest)
+{
+	png_decoder_t* decoder = png_decoder_open(data, size);
+	if (!decoder)
+		return false;
+	int width, height;
+	png_decoder_get_size(decoder, &width, &height);
+	bool ok = png_decoder_read(decoder, data, dest, width, NULL, NULL);
+	png_decoder_free(decoder);
+	return ok;
+}
+
+#ifdef PNG_BENCH_LIBPNG
+typedef struct {
+	const uint8_t* data;
+	size_t size;
+	size_t pos;
+} _libpng_source_t;
+
+static void _libpng_read(png_structp png, png_bytep out, png_size_t count)
+{
+	_libpng_source_t* source = (_libpng_source_t*)png_get_io_ptr(png);
+	if (count > source->size - source->pos)
+		png_error(png, "truncated");
+	memcpy(out, source->data + source->pos, count);
+	source->pos += count;
+}
+
+// to 8-bit RGBA, with 16 bits rounded to 8 as png_decoder.c rounds them
+static bool _decode_libpng(const uint8_t* data, size_t size, uint8_t* rgba,
+	png_bytep* rows, int height)
+{
+	_libpng_source_t source = { data, size, 0 };
+	png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+	png_infop info = png ? png_create_info_struct(png) : NULL;
+	if (!info) {
+		png_destroy_read_struct(&png, NULL, NULL);
+		return false;
+	}
+	if (setjmp(png_jmpbuf(png))) {
+		png_destroy_read_struct(&png, &info, NULL);
+		return false;
+	}
+	png_set_read_fn(png, &source, _libpng_read);
+	png_read_info(png, info);
+	png_set_expand(png);
+	png_set_scale_16(png);
+	png_set_gray_to_rgb(png);
+	png_set_add_alpha(png, 0xFF, PNG_FILLER_AFTER);
+	png_set_interlace_handling(png);
+	png_read_update_info(png, info);
+	size_t stride = (size_t)png_get_image_width(png, info) * 4;
+	for (int y = 0; y < height; y++)
+		rows[y] = rgba + y * stride;
+	png_read_image(png, rows);
+	png_destroy_read_struct(&png, &info, NULL);
+	return true;
+}
+#endif
+
+// best of the runs, in seconds. a negative time if it failed.
+static double _time(bool (*run)(void* ctx), void* ctx)
+{
+	double best = 1e30;
+	double start = _now();
+	int reps = 0;
+	do {
+		double t0 = _now();
+		if (!run(ctx))
+			return -1;
+		double t1 = _now();
+		if (t1 - t0 < best)
+			best = t1 - t0;
+		reps++;
+	} while (reps < BENCH_MIN_REPS || _now() - start < BENCH_MIN_SECONDS);
+	return best;
+}
+
+typedef struct {
+	const uint8_t* data;
+	size_t size;
+	int height;
+	uint32_t* pixels;
+	uint8_t* rgba;
+	void* rows;
+} _case_t;
+
+static bool _run_decoder(void* ctx)
+{
+	_case_t* c = (_case_t*)ctx;
+	return _decode(c->data, c->size, c->pixels);
+}
+
+#ifdef PNG_BENCH_LIBPNG
+static bool _run_libpng(void* ctx)
+{
+	_case_t* c = (_case_t*)ctx;
+	return _decode_libpng(c->data, c->size, c->rgba, (png_bytep*)c->rows, c->height);
+}
+#endif
+
+static void _write_timing(FILE* out, const char* name, double seconds, size_t pixels,
+	size_t file_size)
+{
+	double s = seconds > 0 ? seconds : 1e-12;
+	fprintf(out, "\"%s\": {\"seconds\": %.6f, \"mpixels_per_s\": %.1f, "
+		"\"compressed_mb_per_s\": %.1f}",
+		name, seconds, pixels / s * 1e-6, file_size / s * 1e-6);
+}
+
+static bool _bench_file(FILE* out, const char* path, bool first)
+{
+	fprintf(out, "%s\n    {\"file\": \"", first ? "" : ",");
+	for (const char* p = path; *p; p++)
+		fprintf(out, *p == '"' || *p == '\\' ? "\\%c" : "%c", *p);
+	fprintf(out, "\"");
+
+	_case_t c;
+	memset(&c, 0, sizeof(c));
+	uint8_t* data = _read_file(path, &c.size);
+	png_decoder_t* decoder = data ? png_decoder_open(data, c.size) : NULL;
+	if (!decoder) {
+		fprintf(out, ", \"ok\": false}");
+		free(data);
+		return false;
+	}
+	int width, height;
+	png_decoder_get_size(decoder, &width, &height);
+	bool interlaced = png_decoder_is_interlaced(decoder);
+	png_decoder_free(decoder);
+	size_t pixels = (size_t)width * height;
+	c.data = data;
+	c.height = height;
+	c.pixels = (uint32_t*)malloc(pixels * sizeof(uint32_t));
+	bool ok = c.pixels != NULL;
+	double seconds = ok ? _time(_run_decoder, &c) : -1;
+	ok = seconds >= 0;
+
+	fprintf(out, ", \"width\": %d, \"height\": %d, \"interlaced\": %s, \"bytes\": %llu,\n      ",
+		width, height, interlaced ? "true" : "false", (unsigned long long)c.size);
+	_write_timing(out, "decoder", seconds, pixels, c.size);
+
+#ifdef PNG_BENCH_LIBPNG
+	// libpng's pixels, premultiplied as the decoder's are, outside the
+	// timing
+	c.rgba = (uint8_t*)malloc(pixels * 4);
+	c.rows = malloc(height * sizeof(png_bytep));
+	double reference = c.rgba && c.rows ? _time(_run_libpng, &c) : -1;
+	int max_diff = 0;
+	size_t mismatches = 0;
+	for (size_t i = 0; ok && reference >= 0 && i < pixels; i++) {
+		const uint8_t* p = c.rgba + i * 4;
+		uint32_t a = p[3];
+		uint32_t rgb[3] = { p[0], p[1], p[2] };
+		for (int j = 0; j < 3 && a != 255; j++)
+			rgb[j] = (rgb[j] * a + 127) / 255;
+		uint32_t expected = (a << 24) | (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+		if (c.pixels[i] == expected)
+			continue;
+		mismatches++;
+		for (int shift = 0; shift < 32; shift += 8) {
+			int diff = abs((int)((c.pixels[i] >> shift) & 0xFF) - (int)((expected >> shift) & 0xFF));
+			if (diff > max_diff)
+				max_diff = diff;
+		}
+	}
+	ok = ok && reference >= 0 && max_diff == 0;
+	fprintf(out, ",\n      ");
+	_write_timing(out, "libpng", reference, pixels, c.size);
+	fprintf(out, ",\n      \"speedup\": %.2f, \"max_diff\": %d, \"mismatches\": %llu",
+		seconds > 0 ? reference / seconds : 0.0, max_diff, (unsigned long long)mismatches);
+	free(c.rgba);
+	free(c.rows);
+#endif
+
+	fprintf(out, ", \"ok\": %s}", ok ? "true" : "false");
+	fflush(out);
+	free(c.pixels);
+	free(data);
+	return ok;
+}
+
+bool png_bench_run(const char* const* paths, int num_paths, FILE* out)
+{
+	bool all_ok = true;
+#ifdef PNG_BENCH_LIBPNG
+	const char* reference = "libpng " PNG_LIBPNG_VER_STRING;
+#else
+	const char* reference = "none";
+#endif
+	fprintf(out, "{\n  \"build\": \"%s %s\",\n  \"reference\": \"%s\",\n  \"results\": [",
+		__DATE__, __TIME__, reference);
+	for (int i = 0; i < num_paths; i++) {
+		if (!_bench_file(out, paths[i], i == 0))
+			all_ok = false;
+	}
+	fprintf(out, "\n  ],\n  \"ok\": %s\n}\n", all_ok ? "true" : "false");
+	return all_ok;
+}
+
+#ifdef PNG_BENCH_MAIN
+int main(int argc, char** argv)
+{
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s file.png...\n", argv[0]);
+		return 2;
+	}
+	return png_bench_run((const char* const*)argv + 1, argc - 1, stdout) ? 0 : 1;
+}
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+// Times png_decoder.h over PNG files, whole files decoded to premultiplied
+// BGRA, and where it's built with libpng, times libpng decoding the same
+// files to RGBA as the reference and checks the two agree.  libpng's
+// time leaves out the swizzle and premultiply it would still need, so it
+// flatters the reference.  Results are written to out as JSON, one record
+// per file.  Against GDI+, see load_bench.h instead.
+//
+// Runs standalone, given the files and writing to stdout, built with
+/*
+	cc -O2 -DPNG_BENCH_MAIN png_bench.c png_decoder.c inflate.c -o png_bench
+*/
+// or with the reference
+/*
+	cc -O2 -DPNG_BENCH_MAIN -DPNG_BENCH_LIBPNG png_bench.c png_decoder.c \
+		inflate.c -lpng -o png_bench
+*/
+
+// returns false if a file didn't decode, or decoded differently.
+bool png_bench_run(const char* const* paths, int num_paths, FILE* out);
@@ -0,0 +1,699 @@
+#include <stdlib.h>
+#include <string.h>
+#include <emmintrin.h>
+
+#include "inflate.h"
+#include "png_decoder.h"
+
+// image data inflated at a time, at least, between taking out the rows
+// it completes
+#define PNG_DECODER_CHUNK (256 * 1024)
+
+enum {
+	PNG_GREY = 0,
+	PNG_RGB = 2,
+	PNG_PALETTE = 3,
+	PNG_GREY_ALPHA = 4,
+	PNG_RGBA = 6,
+};
+
+struct png_decoder_t {
+	// of the file
+	size_t size;
+	int width;
+	int height;
+	int depth;
+	int color_type;
+	int channels;
+	bool interlaced;
+	// premultiplied BGRA, with tRNS's alpha. past the PLTE, opaque black.
+	uint32_t palette[256];
+	// the greyscale or RGB samples tRNS makes transparent
+	bool has_key;
+	uint16_t key[3];
+	// the IDAT chunks, which hold the zlib stream between them
+	size_t first_idat;
+	size_t idat_size;
+	int num_idat;
+};
+
+// where each Adam7 pass's pixels come from: x0, y0, dx, dy
+static const uint8_t adam7[7][4] = {
+	{ 0, 0, 8, 8 }, { 4, 0, 8, 8 }, { 0, 4, 4, 8 }, { 2, 0, 4, 4 },
+	{ 0, 2, 2, 4 }, { 1, 0, 2, 2 }, { 0, 1, 1, 2 },
+};
+
+static const uint8_t png_signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+static uint32_t _be32(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static uint32_t _be16(const uint8_t* p)
+{
+	return ((uint32_t)p[0] << 8) | p[1];
+}
+
+static uint32_t _premultiply(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+{
+	if (a != 255) {
+		r = (r * a + 127) / 255;
+		g = (g * a + 127) / 255;
+		b = (b * a + 127) / 255;
+	}
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+static bool _valid_depth(int color_type, int depth)
+{
+	switch (color_type) {
+	case PNG_GREY:
+		return depth == 1 || depth == 2 || depth == 4 || depth == 8 || depth == 16;
+	case PNG_PALETTE:
+		return depth == 1 || depth == 2 || depth == 4 || depth == 8;
+	case PNG_RGB:
+	case PNG_GREY_ALPHA:
+	case PNG_RGBA:
+		return depth == 8 || depth == 16;
+	default:
+		return false;
+	}
+}
+
+png_decoder_t* png_decoder_open(const uint8_t* data, size_t size)
+{
+	// the signature, and IHDR first
+	if (size < 8 + 25 || memcmp(data, png_signature, 8) || _be32(data + 8) != 13 ||
+		memcmp(data + 12, "IHDR", 4))
+		return NULL;
+	const uint8_t* ihdr = data + 16;
+	uint32_t width = _be32(ihdr);
+	uint32_t height = _be32(ihdr + 4);
+	int depth = ihdr[8];
+	int color_type = ihdr[9];
+	// 8 bytes a pixel, at most, and a row must fit in an int
+	if (!width || !height || width > 0x7FFFFFFF / 8 || height > 0x7FFFFFFF ||
+		!_valid_depth(color_type, depth) || ihdr[10] != 0 || ihdr[11] != 0 ||
+		ihdr[12] > 1)
+		return NULL;
+
+	png_decoder_t* decoder = (png_decoder_t*)calloc(1, sizeof(png_decoder_t));
+	if (!decoder)
+		return NULL;
+	decoder->size = size;
+	decoder->width = (int)width;
+	decoder->height = (int)height;
+	decoder->depth = depth;
+	decoder->color_type = color_type;
+	decoder->interlaced = ihdr[12] == 1;
+	switch (color_type) {
+	case PNG_RGB: decoder->channels = 3; break;
+	case PNG_GREY_ALPHA: decoder->channels = 2; break;
+	case PNG_RGBA: decoder->channels = 4; break;
+	default: decoder->channels = 1; break;
+	}
+	for (int i = 0; i < 256; i++)
+		decoder->palette[i] = 0xFF000000;
+
+	uint8_t rgb[256][3] = { { 0 } };
+	uint8_t alpha[256];
+	memset(alpha, 255, sizeof(alpha));
+	int num_colors = 0;
+	bool ended = false;
+	size_t pos = 8 + 25;
+	while (!ended && size - pos >= 12) {
+		uint32_t length = _be32(data + pos);
+		const uint8_t* type = data + pos + 4;
+		const uint8_t* p = data + pos + 8;
+		if (length > size - pos - 12)
+			break;
+		if (!memcmp(type, "IDAT", 4)) {
+			if (!decoder->num_idat)
+				decoder->first_idat = pos;
+			decoder->idat_size += length;
+			decoder->num_idat++;
+		}
+		else if (!memcmp(type, "PLTE", 4)) {
+			if (length % 3 || length > 768)
+				break;
+			num_colors = (int)length / 3;
+			memcpy(rgb, p, length);
+		}
+		else if (!memcmp(type, "tRNS", 4)) {
+			if (color_type == PNG_PALETTE) {
+				memcpy(alpha, p, length < 256 ? length : 256);
+			}
+			else if (color_type == PNG_GREY && length >= 2) {
+				decoder->has_key = true;
+				decoder->key[0] = (uint16_t)_be16(p);
+			}
+			else if (color_type == PNG_RGB && length >= 6) {
+				decoder->has_key = true;
+				for (int i = 0; i < 3; i++)
+					decoder->key[i] = (uint16_t)_be16(p + i * 2);
+			}
+		}
+		else if (!memcmp(type, "IEND", 4)) {
+			ended = true;
+		}
+		else if (!(type[0] & 0x20)) {
+			// a critical chunk this doesn't know
+			break;
+		}
+		pos += 12 + (size_t)length;
+	}
+	// a file cut off after its image data still shows, as GDI+ shows it
+	if (!decoder->num_idat || (color_type == PNG_PALETTE && !num_colors) ||
+		(!ended && size - pos >= 12)) {
+		free(decoder);
+		return NULL;
+	}
+	for (int i = 0; i < num_colors; i++)
+		decoder->palette[i] = _premultiply(rgb[i][0], rgb[i][1], rgb[i][2], alpha[i]);
+	return decoder;
+}
+
+void png_decoder_free(png_decoder_t* decoder)
+{
+	free(decoder);
+}
+
+void png_decoder_get_size(const png_decoder_t* decoder, int* out_width,
+	int* out_height)
+{
+	*out_width = decoder->width;
+	*out_height = decoder->height;
+}
+
+bool png_decoder_is_interlaced(const png_decoder_t* decoder)
+{
+	return decoder->interlaced;
+}
+
+//
+// unfiltering
+//
+
+static int _paeth(int a, int b, int c)
+{
+	int pa = abs(b - c);
+	int pb = abs(a - c);
+	int pc = abs(a + b - 2 * c);
+	if (pa <= pb && pa <= pc)
+		return a;
+	return pb <= pc ? b : c;
+}
+
+void png_unfilter_naive(int filter, uint8_t* dest, const uint8_t* src,
+	const uint8_t* prev, size_t size, int bpp)
+{
+	size_t i = 0;
+	switch (filter) {
+	case 1:
+		for (; i < (size_t)bpp && i < size; i++)
+			dest[i] = src[i];
+		for (; i < size; i++)
+			dest[i] = (uint8_t)(src[i] + dest[i - bpp]);
+		break;
+	case 2:
+		for (; i < size; i++)
+			dest[i] = (uint8_t)(src[i] + prev[i]);
+		break;
+	case 3:
+		for (; i < (size_t)bpp && i < size; i++)
+			dest[i] = (uint8_t)(src[i] + (prev[i] >> 1));
+		for (; i < size; i++)
+			dest[i] = (uint8_t)(src[i] + ((dest[i - bpp] + prev[i]) >> 1));
+		break;
+	case 4:
+		for (; i < (size_t)bpp && i < size; i++)
+			dest[i] = (uint8_t)(src[i] + prev[i]);
+		for (; i < size; i++)
+			dest[i] = (uint8_t)(src[i] + _paeth(dest[i - bpp], prev[i], prev[i - bpp]));
+		break;
+	default:
+		memmove(dest, src, size);
+		break;
+	}
+}
+
+// a pixel of 3 or 4 bytes, in the low lanes.  3 are put together in a
+// register, as copying them into a word through memory stalls the load of
+// it that follows.
+static __m128i _load_pixel(const uint8_t* p, int bpp)
+{
+	uint32_t value;
+	if (bpp == 4)
+		memcpy(&value, p, 4);
+	else
+		value = p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+	return _mm_cvtsi32_si128((int)value);
+}
+
+static void _store_pixel(uint8_t* p, __m128i pixel, int bpp)
+{
+	uint32_t value = (uint32_t)_mm_cvtsi128_si32(pixel);
+	if (bpp == 4)
+		memcpy(p, &value, 4);
+	else
+		memcpy(p, &value, 3);
+}
+
+static void _sub_sse2(uint8_t* dest, const uint8_t* src, size_t size, int bpp)
+{
+	size_t i = 0;
+	__m128i left = _mm_setzero_si128();
+	if (bpp == 4) {
+		// a prefix sum of the 4 pixels in a vector, plus the last one
+		// before them
+		for (; i + 16 <= size; i += 16) {
+			__m128i x = _mm_loadu_si128((const __m128i*)(src + i));
+			x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+			x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+			x = _mm_add_epi8(x, left);
+			_mm_storeu_si128((__m128i*)(dest + i), x);
+			left = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+	}
+	for (; i + bpp <= size; i += bpp) {
+		left = _mm_add_epi8(_load_pixel(src + i, bpp), left);
+		_store_pixel(dest + i, left, bpp);
+	}
+}
+
+static void _up_sse2(uint8_t* dest, const uint8_t* src, const uint8_t* prev, size_t size)
+{
+	size_t i = 0;
+	for (; i + 16 <= size; i += 16) {
+		__m128i x = _mm_add_epi8(_mm_loadu_si128((const __m128i*)(src + i)),
+			_mm_loadu_si128((const __m128i*)(prev + i)));
+		_mm_storeu_si128((__m128i*)(dest + i), x);
+	}
+	for (; i < size; i++)
+		dest[i] = (uint8_t)(src[i] + prev[i]);
+}
+
+static void _avg_sse2(uint8_t* dest, const uint8_t* src, const uint8_t* prev,
+	size_t size, int bpp)
+{
+	__m128i left = _mm_setzero_si128();
+	__m128i one = _mm_set1_epi8(1);
+	for (size_t i = 0; i + bpp <= size; i += bpp) {
+		__m128i up = _load_pixel(prev + i, bpp);
+		// pavgb rounds up, where the filter rounds down
+		__m128i average = _mm_sub_epi8(_mm_avg_epu8(left, up),
+			_mm_and_si128(_mm_xor_si128(left, up), one));
+		left = _mm_add_epi8(_load_pixel(src + i, bpp), average);
+		_store_pixel(dest + i, left, bpp);
+	}
+}
+
+static __m128i _abs_epi16(__m128i x)
+{
+	return _mm_max_epi16(x, _mm_sub_epi16(_mm_setzero_si128(), x));
+}
+
+static __m128i _select(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+static void _paeth_sse2(uint8_t* dest, const uint8_t* src, const uint8_t* prev,
+	size_t size, int bpp)
+{
+	// in 16-bit lanes, where the predictor's sums fit
+	__m128i zero = _mm_setzero_si128();
+	__m128i a = zero;
+	__m128i c = zero;
+	for (size_t i = 0; i + bpp <= size; i += bpp) {
+		__m128i b = _mm_unpacklo_epi8(_load_pixel(prev + i, bpp), zero);
+		__m128i p = _mm_sub_epi16(b, c);
+		__m128i q = _mm_sub_epi16(a, c);
+		__m128i pa = _abs_epi16(p);
+		__m128i pb = _abs_epi16(q);
+		__m128i pc = _abs_epi16(_mm_add_epi16(p, q));
+		__m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		__m128i nearest = _select(_mm_cmpeq_epi16(pa, smallest), a,
+			_select(_mm_cmpeq_epi16(pb, smallest), b, c));
+		__m128i x = _mm_add_epi8(_load_pixel(src + i, bpp), _mm_packus_epi16(nearest, zero));
+		_store_pixel(dest + i, x, bpp);
+		a = _mm_unpacklo_epi8(x, zero);
+		c = b;
+	}
+}
+
+void png_unfilter_sse2(int filter, uint8_t* dest, const uint8_t* src,
+	const uint8_t* prev, size_t size, int bpp)
+{
+	// the left neighbour is a whole pixel in one register only at these
+	// sizes. the rest are rare.
+	bool pixels = (bpp == 3 || bpp == 4) && size % bpp == 0;
+	switch (filter) {
+	case 1:
+		if (pixels) {
+			_sub_sse2(dest, src, size, bpp);
+			return;
+		}
+		break;
+	case 2:
+		_up_sse2(dest, src, prev, size);
+		return;
+	case 3:
+		if (pixels) {
+			_avg_sse2(dest, src, prev, size, bpp);
+			return;
+		}
+		break;
+	case 4:
+		if (pixels) {
+			_paeth_sse2(dest, src, prev, size, bpp);
+			return;
+		}
+		break;
+	}
+	png_unfilter_naive(filter, dest, src, prev, size, bpp);
+}
+
+//
+// converting rows
+//
+
+// the index'th sample of a row of samples of fewer than 8 bits
+static uint32_t _small_sample(const uint8_t* row, int index, int depth)
+{
+	int bit = index * depth;
+	return (row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1 << depth) - 1);
+}
+
+// 16 bits rounded to 8
+static uint32_t _round16(uint32_t value)
+{
+	return (value * 255 + 32767) / 65535;
+}
+
+// 4 pixels at a time of 8-bit RGBA, swapped to BGRA and premultiplied
+// the way _premultiply() does
+static int _convert_rgba8_sse2(const uint8_t* row, int count, uint32_t* out)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i alpha_lanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+	__m128i alpha_255 = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+	__m128i half = _mm_set1_epi16(128);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128i x = _mm_loadu_si128((const __m128i*)(row + i * 4));
+		__m128i halves[2] = { _mm_unpacklo_epi8(x, zero), _mm_unpackhi_epi8(x, zero) };
+		for (int j = 0; j < 2; j++) {
+			__m128i v = _mm_shufflelo_epi16(halves[j], _MM_SHUFFLE(3, 0, 1, 2));
+			v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(3, 0, 1, 2));
+			// alpha times each colour, and 255 times itself
+			__m128i a = _mm_shufflelo_epi16(v, _MM_SHUFFLE(3, 3, 3, 3));
+			a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+			a = _mm_or_si128(_mm_andnot_si128(alpha_lanes, a), alpha_255);
+			// (t + (t >> 8)) >> 8 of t = x * a + 128 is x * a / 255 rounded
+			__m128i t = _mm_add_epi16(_mm_mullo_epi16(v, a), half);
+			halves[j] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+		}
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(halves[0], halves[1]));
+	}
+	return i;
+}
+
+// count pixels of an unfiltered row into out, step pixels apart
+static void _convert_row(const png_decoder_t* decoder, const uint8_t* row, int count,
+	uint32_t* out, int step)
+{
+	int depth = decoder->depth;
+	int i = 0;
+	switch (decoder->color_type) {
+	case PNG_GREY:
+		for (; i < count; i++) {
+			uint32_t value, grey;
+			if (depth == 16) {
+				value = _be16(row + i * 2);
+				grey = _round16(value);
+			}
+			else if (depth == 8) {
+				value = grey = row[i];
+			}
+			else {
+				value = _small_sample(row, i, depth);
+				grey = value * 255 / ((1 << depth) - 1);
+			}
+			out[i * step] = decoder->has_key && value == decoder->key[0] ? 0 :
+				0xFF000000 | (grey << 16) | (grey << 8) | grey;
+		}
+		break;
+	case PNG_RGB:
+		if (depth == 8 && !decoder->has_key) {
+			for (; i < count; i++, row += 3)
+				out[i * step] = 0xFF000000 | ((uint32_t)row[0] << 16) | (row[1] << 8) | row[2];
+			break;
+		}
+		for (; i < count; i++) {
+			uint32_t rgb[3];
+			for (int j = 0; j < 3; j++)
+				rgb[j] = depth == 16 ? _be16(row + (i * 3 + j) * 2) : row[i * 3 + j];
+			bool key = decoder->has_key && rgb[0] == decoder->key[0] &&
+				rgb[1] == decoder->key[1] && rgb[2] == decoder->key[2];
+			if (depth == 16) {
+				for (int j = 0; j < 3; j++)
+					rgb[j] = _round16(rgb[j]);
+			}
+			out[i * step] = key ? 0 : 0xFF000000 | (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+		}
+		break;
+	case PNG_PALETTE:
+		for (; i < count; i++)
+			out[i * step] = decoder->palette[depth == 8 ? row[i] : _small_sample(row, i, depth)];
+		break;
+	case PNG_GREY_ALPHA:
+		for (; i < count; i++) {
+			uint32_t grey, alpha;
+			if (depth == 16) {
+				grey = _round16(_be16(row + i * 4));
+				alpha = _round16(_be16(row + i * 4 + 2));
+			}
+			else {
+				grey = row[i * 2];
+				alpha = row[i * 2 + 1];
+			}
+			out[i * step] = _premultiply(grey, grey, grey, alpha);
+		}
+		break;
+	case PNG_RGBA:
+		if (depth == 8 && step == 1)
+			i = _convert_rgba8_sse2(row, count, out);
+		for (; i < count; i++) {
+			if (depth == 16) {
+				const uint8_t* p = row + i * 8;
+				out[i * step] = _premultiply(_round16(_be16(p)), _round16(_be16(p + 2)),
+					_round16(_be16(p + 4)), _round16(_be16(p + 6)));
+			}
+			else {
+				const uint8_t* p = row + i * 4;
+				out[i * step] = _premultiply(p[0], p[1], p[2], p[3]);
+			}
+		}
+		break;
+	}
+}
+
+//
+// decoding
+//
+
+typedef struct {
+	// of the pass, in pixels
+	int width;
+	int height;
+	// where its pixels go in dest
+	int x0;
+	int y0;
+	int dx;
+	int dy;
+} _pass_t;
+
+static size_t _row_bytes(const png_decoder_t* decoder, int width)
+{
+	return ((size_t)width * decoder->channels * decoder->depth + 7) / 8;
+}
+
+// the Adam7 pass's size, and where it goes in the image
+static _pass_t _adam7_pass(const png_decoder_t* decoder, int index)
+{
+	const uint8_t* pass = adam7[index];
+	_pass_t result;
+	result.x0 = pass[0];
+	result.y0 = pass[1];
+	result.dx = pass[2];
+	result.dy = pass[3];
+	result.width = decoder->width > result.x0 ?
+		(decoder->width - result.x0 + result.dx - 1) / result.dx : 0;
+	result.height = decoder->height > result.y0 ?
+		(decoder->height - result.y0 + result.dy - 1) / result.dy : 0;
+	return result;
+}
+
+// the zlib stream, with INFLATE_PADDING after it: in place when it's a
+// single IDAT with its CRC and IEND after, else gathered into *out_copy
+static const uint8_t* _stream(const png_decoder_t* decoder, const uint8_t* data,
+	uint8_t** out_copy)
+{
+	*out_copy = NULL;
+	size_t pos = decoder->first_idat;
+	if (decoder->num_idat == 1 &&
+		decoder->size - pos - 8 - decoder->idat_size >= INFLATE_PADDING)
+		return data + pos + 8;
+
+	uint8_t* copy = (uint8_t*)malloc(decoder->idat_size + INFLATE_PADDING);
+	if (!copy)
+		return NULL;
+	size_t copied = 0;
+	for (int i = 0; i < decoder->num_idat; pos += 12 + (size_t)_be32(data + pos)) {
+		uint32_t length = _be32(data + pos);
+		if (!memcmp(data + pos + 4, "IDAT", 4)) {
+			memcpy(copy + copied, data + pos + 8, length);
+			copied += length;
+			i++;
+		}
+	}
+	memset(copy + copied, 0, INFLATE_PADDING);
+	*out_copy = copy;
+	return copy;
+}
+
+// the passes' rows in turn, into dest. dest_height is the rows they fill,
+// which the last pass completes as it goes.
+static bool _decode(const png_decoder_t* decoder, const uint8_t* data,
+	const _pass_t* passes, int num_passes, int dest_height, uint32_t* dest,
+	int stride, png_decoder_rows_fn rows_fn, void* ctx)
+{
+	size_t max_row = 0;
+	for (int i = 0; i < num_passes; i++) {
+		size_t row_bytes = _row_bytes(decoder, passes[i].width);
+		if (row_bytes > max_row)
+			max_row = row_bytes;
+	}
+	int bpp = (decoder->channels * decoder->depth + 7) / 8;
+
+	// inflated into a buffer that keeps the window before what's taken
+	// out, and the row not yet complete
+	size_t out_size = INFLATE_WINDOW + max_row + 1 + PNG_DECODER_CHUNK;
+	uint8_t* out = (uint8_t*)malloc(out_size + INFLATE_SLACK);
+	uint8_t* rows = (uint8_t*)malloc(max_row * 2);
+	inflate_t* inflate = (inflate_t*)malloc(sizeof(inflate_t));
+	uint8_t* copy = NULL;
+	const uint8_t* stream = out && rows && inflate ? _stream(decoder, data, &copy) : NULL;
+	bool ok = stream && inflate_init(inflate, stream, decoder->idat_size);
+
+	uint8_t* row = rows;
+	uint8_t* prev = rows + max_row;
+	int pass = 0;
+	int y = 0;
+	int reported = 0;
+	size_t pos = 0;
+	size_t taken = 0;
+	if (ok)
+		memset(prev, 0, max_row);
+	while (ok) {
+		inflate_result_t result = inflate_run(inflate, out, &pos, out_size);
+		if (result == INFLATE_ERROR) {
+			ok = false;
+			break;
+		}
+
+		// the complete rows
+		for (;;) {
+			// empty passes have no rows at all, not even filter bytes
+			while (pass < num_passes && (!passes[pass].width || y == passes[pass].height)) {
+				pass++;
+				y = 0;
+				memset(prev, 0, max_row);
+			}
+			if (pass == num_passes)
+				break;
+			const _pass_t* p = &passes[pass];
+			size_t row_bytes = _row_bytes(decoder, p->width);
+			if (pos - taken < row_bytes + 1)
+				break;
+			int filter = out[taken];
+			if (filter > 4) {
+				ok = false;
+				break;
+			}
+			png_unfilter_sse2(filter, row, out + taken + 1, prev, row_bytes, bpp);
+			_convert_row(decoder, row, p->width,
+				dest + (size_t)(p->y0 + y * p->dy) * stride + p->x0, p->dx);
+			uint8_t* swap = prev;
+			prev = row;
+			row = swap;
+			taken += row_bytes + 1;
+			y++;
+		}
+		if (!ok)
+			break;
+
+		int done = dest_height;
+		if (pass == num_passes - 1)
+			done = y ? passes[pass].y0 + (y - 1) * passes[pass].dy + 1 : 0;
+		else if (pass < num_passes)
+			done = 0;
+		if (rows_fn && done > reported) {
+			ok = rows_fn(ctx, reported, done);
+			reported = done;
+		}
+		if (!ok || pass == num_passes)
+			break;
+		if (result == INFLATE_DONE) {
+			ok = false;
+			break;
+		}
+
+		// room for the next chunk
+		size_t start = pos > INFLATE_WINDOW ? pos - INFLATE_WINDOW : 0;
+		if (start > taken)
+			start = taken;
+		memmove(out, out + start, pos - start);
+		pos -= start;
+		taken -= start;
+	}
+
+	free(copy);
+	free(inflate);
+	free(rows);
+	free(out);
+	return ok;
+}
+
+bool png_decoder_read(const png_decoder_t* decoder, const uint8_t* data,
+	uint32_t* dest, int stride, png_decoder_rows_fn rows_fn, void* ctx)
+{
+	_pass_t passes[7];
+	int num_passes = 7;
+	if (decoder->interlaced) {
+		for (int i = 0; i < 7; i++)
+			passes[i] = _adam7_pass(decoder, i);
+	}
+	else {
+		passes[0].width = decoder->width;
+		passes[0].height = decoder->height;
+		passes[0].x0 = passes[0].y0 = 0;
+		passes[0].dx = passes[0].dy = 1;
+		num_passes = 1;
+	}
+	return _decode(decoder, data, passes, num_passes, decoder->height, dest, stride,
+		rows_fn, ctx);
+}
+
+bool png_decoder_read_preview(const png_decoder_t* decoder, const uint8_t* data,
+	uint32_t* dest, int stride)
+{
+	if (!decoder->interlaced)
+		return false;
+	// the first pass, as an image of its own
+	_pass_t pass = _adam7_pass(decoder, 0);
+	pass.dx = pass.dy = 1;
+	return _decode(decoder, data, &pass, 1, pass.height, dest, stride, NULL, NULL);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// PNG decoded straight into the caller's pixels, a few rows at a time as
+// the image data inflates (see inflate.h), so nothing image-sized is held
+// but the output.  Every colour type and bit depth is supported, with
+// tRNS; 16-bit samples are rounded to 8.  Colour chunks like gAMA and iCCP
+// are ignored, so pixels show as stored.  Rows are unfiltered with SSE2
+// where that helps: Up for any pixel size, and Sub, Average and Paeth for
+// 3 and 4 bytes a pixel, which are 8-bit RGB and RGBA, the usual
+// screenshots.
+//
+// An interlaced (Adam7) image's first pass is every 8th pixel of every 8th
+// row, which png_decoder_read_preview() reads alone for a preview at 1/8
+// scale.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct png_decoder_t png_decoder_t;
+
+// data is the whole file. NULL if it isn't a PNG that can be decoded.
+// the header and palette are copied out, and the IDAT chunks kept as
+// offsets.
+png_decoder_t* png_decoder_open(const uint8_t* data, size_t size);
+void png_decoder_free(png_decoder_t* decoder);
+
+void png_decoder_get_size(const png_decoder_t* decoder, int* out_width,
+	int* out_height);
+bool png_decoder_is_interlaced(const png_decoder_t* decoder);
+
+// told that rows [y0, y1) of dest are done. false stops the read, which
+// then fails.
+typedef bool (*png_decoder_rows_fn)(void* ctx, int y0, int y1);
+// the whole image into rows of dest stride pixels apart, as premultiplied
+// BGRA, top to bottom, telling rows_fn, which may be NULL, as rows are done.
+// an interlaced image's rows are done only in its last pass, which is half
+// of it.  data is the same bytes the decoder was opened with, at any
+// address.  false if the image data is corrupt or cut short, with dest
+// partly written.
+bool png_decoder_read(const png_decoder_t* decoder, const uint8_t* data,
+	uint32_t* dest, int stride, png_decoder_rows_fn rows_fn, void* ctx);
+// of an interlaced image, the first pass alone: the image at 1/8 scale,
+// rounded up, from its top left pixel of each 8x8.  false otherwise.
+bool png_decoder_read_preview(const png_decoder_t* decoder, const uint8_t* data,
+	uint32_t* dest, int stride);
+
+// reverses filter, 0 to 4, on a row of size bytes, src, into dest, given
+// the row above unfiltered, prev, or zeros for the first.  bpp is the bytes
+// per pixel, rounded up.
+void png_unfilter_naive(int filter, uint8_t* dest, const uint8_t* src,
+	const uint8_t* prev, size_t size, int bpp);
+void png_unfilter_sse2(int filter, uint8_t* dest, const uint8_t* src,
+	const uint8_t* prev, size_t size, int bpp);
+
+#ifdef __cplusplus
+}
+#endif
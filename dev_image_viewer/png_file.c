@@ -0,0 +1,65 @@
+#include "dev_image_viewer.h"
+
+#include "gdiplus_loader.h"
+#include "png_decoder.h"
+#include "png_file.h"
+#include "trace.h"
+
+bool png_file_read(const WCHAR* path, HBITMAP* out_hbitmap, void** out_bits,
+	int* out_width, int* out_height)
+{
+	HANDLE file = CreateFileW(path, GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	HANDLE section = NULL;
+	const uint8_t* data = NULL;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0 &&
+		(uint64_t)size.QuadPart <= (SIZE_T)-1) {
+		section = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (section)
+			data = (const uint8_t*)MapViewOfFile(section, FILE_MAP_READ, 0, 0, 0);
+	}
+	CloseHandle(file);
+
+	png_decoder_t* decoder = data ?
+		png_decoder_open(data, (size_t)size.QuadPart) : NULL;
+	HBITMAP hbitmap = NULL;
+	void* bits = NULL;
+	int width = 0, height = 0;
+	bool ok = decoder != NULL;
+	if (ok) {
+		png_decoder_get_size(decoder, &width, &height);
+		BITMAPV5HEADER bmi;
+		init_bitmap_header(&bmi, width, height);
+		HDC hdc = GetDC(NULL);
+		hbitmap = CreateDIBSection(hdc, (BITMAPINFO*)&bmi, DIB_RGB_COLORS,
+			&bits, NULL, 0);
+		ReleaseDC(NULL, hdc);
+		ok = hbitmap != NULL;
+	}
+	if (ok) {
+		uint64_t start = trace_begin();
+		ok = png_decoder_read(decoder, data, (uint32_t*)bits, width, NULL, NULL);
+		uint64_t num_pixels = (uint64_t)width * height;
+		trace_end(TRACE_DECODE, start, num_pixels * 4, num_pixels);
+	}
+	png_decoder_free(decoder);
+	if (data)
+		UnmapViewOfFile(data);
+	if (section)
+		CloseHandle(section);
+	if (!ok) {
+		if (hbitmap)
+			DeleteObject(hbitmap);
+		return false;
+	}
+
+	*out_hbitmap = hbitmap;
+	*out_bits = bits;
+	*out_width = width;
+	*out_height = height;
+	return true;
+}
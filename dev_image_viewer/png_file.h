@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+
+// PNG files decoded with png_decoder.h straight into a DIB section, with no
+// GDI+ bitmap to lock and copy out of.  canvas_read_image() reads PNGs this
+// way, so the DIB it returns, level 0 of the canvas, is written once.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the image as premultiplied BGRA.  false if the file isn't a PNG
+// png_decoder.h reads, or is corrupt.
+bool png_file_read(const WCHAR* path, HBITMAP* out_hbitmap, void** out_bits,
+	int* out_width, int* out_height);
+
+#ifdef __cplusplus
+}
+#endif
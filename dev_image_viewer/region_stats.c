@@ -0,0 +1,197 @@
+#include "dev_image_viewer.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "region_stats.h"
+#include "parallel.h"
+#include "trace.h"
+
+// rows per parallel_for() item of the row sums
+#define REGION_STATS_ROWS_PER_ITEM 16
+// columns per item of the column sums. each item walks down its band, so
+// the band should be wide enough to read whole cache lines.
+#define REGION_STATS_COLUMNS_PER_ITEM 64
+
+// channels in memory order, B, G, R
+typedef struct {
+	uint64_t sums[3];
+	uint64_t sum_squares[3];
+} region_stats_entry_t;
+
+struct region_stats_table_t {
+	// (width + 1) * (height + 1). the first row and column stay zero.
+	region_stats_entry_t* entries;
+	int width;
+	int height;
+
+	// entries right of stale_x and below stale_y are out of date, none
+	// when stale_x is width
+	int stale_x;
+	int stale_y;
+};
+
+typedef struct {
+	region_stats_table_t* table;
+	const uint32_t* pixels;
+	int x0;
+	int y0;
+} region_stats_job_t;
+
+region_stats_table_t* region_stats_new()
+{
+	return (region_stats_table_t*)calloc(1, sizeof(region_stats_table_t));
+}
+
+void region_stats_free(region_stats_table_t* table)
+{
+	if (!table)
+		return;
+	free(table->entries);
+	free(table);
+}
+
+void region_stats_invalidate(region_stats_table_t* table, const RECT* changed)
+{
+	if (!changed) {
+		table->stale_x = 0;
+		table->stale_y = 0;
+		return;
+	}
+	table->stale_x = max(min(table->stale_x, (int)changed->left), 0);
+	table->stale_y = max(min(table->stale_y, (int)changed->top), 0);
+}
+
+uint64_t region_stats_table_bytes(int width, int height)
+{
+	return ((uint64_t)width + 1) * ((uint64_t)height + 1) * sizeof(region_stats_entry_t);
+}
+
+uint64_t region_stats_get_resident_bytes(const region_stats_table_t* table)
+{
+	return table->entries ? region_stats_table_bytes(table->width, table->height) : 0;
+}
+
+// sums along each row, right of x0. the row sum up to x0 is unchanged, and
+// is taken from the entries there, which are.
+static void _sum_rows(void* ctx, int index)
+{
+	region_stats_job_t* job = (region_stats_job_t*)ctx;
+	region_stats_table_t* table = job->table;
+	int stride = table->width + 1;
+	int y0 = job->y0 + 1 + index * REGION_STATS_ROWS_PER_ITEM;
+	int y1 = min(y0 + REGION_STATS_ROWS_PER_ITEM, table->height + 1);
+	for (int y = y0; y < y1; y++) {
+		region_stats_entry_t* row = table->entries + (size_t)y * stride;
+		const region_stats_entry_t* above = row - stride;
+		const uint32_t* pixels = job->pixels + (size_t)(y - 1) * table->width;
+		uint64_t sums[3], sum_squares[3];
+		for (int c = 0; c < 3; c++) {
+			sums[c] = row[job->x0].sums[c] - above[job->x0].sums[c];
+			sum_squares[c] = row[job->x0].sum_squares[c] - above[job->x0].sum_squares[c];
+		}
+		for (int x = job->x0 + 1; x <= table->width; x++) {
+			uint32_t pixel = pixels[x - 1];
+			for (int c = 0; c < 3; c++) {
+				uint32_t value = (pixel >> (c * 8)) & 0xFF;
+				sums[c] += value;
+				sum_squares[c] += value * value;
+				row[x].sums[c] = sums[c];
+				row[x].sum_squares[c] = sum_squares[c];
+			}
+		}
+	}
+}
+
+// adds each entry below y0 to the one under it, in a band of columns
+static void _sum_columns(void* ctx, int index)
+{
+	region_stats_job_t* job = (region_stats_job_t*)ctx;
+	region_stats_table_t* table = job->table;
+	int stride = table->width + 1;
+	int x0 = job->x0 + 1 + index * REGION_STATS_COLUMNS_PER_ITEM;
+	int x1 = min(x0 + REGION_STATS_COLUMNS_PER_ITEM, table->width + 1);
+	for (int y = job->y0 + 1; y <= table->height; y++) {
+		region_stats_entry_t* row = table->entries + (size_t)y * stride;
+		const region_stats_entry_t* above = row - stride;
+		for (int x = x0; x < x1; x++) {
+			for (int c = 0; c < 3; c++) {
+				row[x].sums[c] += above[x].sums[c];
+				row[x].sum_squares[c] += above[x].sum_squares[c];
+			}
+		}
+	}
+}
+
+static bool _update(region_stats_table_t* table, const uint32_t* pixels,
+	int width, int height)
+{
+	if (!table->entries || table->width != width || table->height != height) {
+		free(table->entries);
+		table->entries = NULL;
+		if (region_stats_table_bytes(width, height) > SIZE_MAX)
+			return false;
+		size_t count = ((size_t)width + 1) * ((size_t)height + 1);
+		table->entries = (region_stats_entry_t*)calloc(count, sizeof(region_stats_entry_t));
+		if (!table->entries)
+			return false;
+		table->width = width;
+		table->height = height;
+		table->stale_x = 0;
+		table->stale_y = 0;
+	}
+	if (table->stale_x >= width || table->stale_y >= height)
+		return true;
+
+	uint64_t start = trace_begin();
+	region_stats_job_t job;
+	job.table = table;
+	job.pixels = pixels;
+	job.x0 = table->stale_x;
+	job.y0 = table->stale_y;
+	int rows = height - job.y0;
+	int columns = width - job.x0;
+	parallel_for((rows + REGION_STATS_ROWS_PER_ITEM - 1) / REGION_STATS_ROWS_PER_ITEM,
+		_sum_rows, &job);
+	parallel_for((columns + REGION_STATS_COLUMNS_PER_ITEM - 1) / REGION_STATS_COLUMNS_PER_ITEM,
+		_sum_columns, &job);
+	uint64_t num_pixels = (uint64_t)rows * columns;
+	trace_end(TRACE_REGION_STATS, start, num_pixels * (4 + sizeof(region_stats_entry_t) * 3),
+		num_pixels);
+
+	table->stale_x = width;
+	table->stale_y = height;
+	return true;
+}
+
+bool region_stats_get(region_stats_table_t* table, const uint32_t* pixels,
+	int width, int height, const RECT* rect, region_stats_t* out_stats)
+{
+	int x0 = max((int)rect->left, 0);
+	int y0 = max((int)rect->top, 0);
+	int x1 = min((int)rect->right, width);
+	int y1 = min((int)rect->bottom, height);
+	if (x1 <= x0 || y1 <= y0 || !_update(table, pixels, width, height))
+		return false;
+
+	int stride = width + 1;
+	const region_stats_entry_t* top_left = table->entries + (size_t)y0 * stride + x0;
+	const region_stats_entry_t* top_right = table->entries + (size_t)y0 * stride + x1;
+	const region_stats_entry_t* bottom_left = table->entries + (size_t)y1 * stride + x0;
+	const region_stats_entry_t* bottom_right = table->entries + (size_t)y1 * stride + x1;
+	uint64_t num_pixels = (uint64_t)(x1 - x0) * (y1 - y0);
+	out_stats->num_pixels = num_pixels;
+	for (int c = 0; c < 3; c++) {
+		// wraps in between, but not in the end
+		uint64_t sum = bottom_right->sums[c] - bottom_left->sums[c] -
+			top_right->sums[c] + top_left->sums[c];
+		uint64_t sum_squares = bottom_right->sum_squares[c] - bottom_left->sum_squares[c] -
+			top_right->sum_squares[c] + top_left->sum_squares[c];
+		double mean = (double)sum / num_pixels;
+		double variance = (double)sum_squares / num_pixels - mean * mean;
+		out_stats->mean[2 - c] = mean;
+		out_stats->stddev[2 - c] = variance > 0 ? sqrt(variance) : 0;
+	}
+	return true;
+}
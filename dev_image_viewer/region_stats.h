@@ -0,0 +1,44 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// The mean and deviation of any rectangle of an image in constant time,
+// from summed-area tables of each color channel and its square.  Entry
+// (x, y) of a table holds the sums over the pixels above and left of it,
+// so a rectangle's sums are four lookups.  The tables are built on the
+// first query, rows then columns spread over parallel_for(), and after a
+// change only the entries below and right of it are built again.  Each
+// table entry is 64-bit, 48 bytes per pixel for all of them.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint64_t num_pixels;
+	double mean[3];		// R, G, B
+	double stddev[3];
+} region_stats_t;
+
+typedef struct region_stats_table_t region_stats_table_t;
+
+region_stats_table_t* region_stats_new();
+void region_stats_free(region_stats_table_t* table);
+// after the pixels in changed did, or all of them when NULL
+void region_stats_invalidate(region_stats_table_t* table, const RECT* changed);
+
+// the statistics of rect, clipped to the image, of which pixels are the
+// top-down 32bpp BGRA rows.  the tables are built or brought up to date
+// first, if needed.  false if rect is empty, or they can't be allocated.
+bool region_stats_get(region_stats_table_t* table, const uint32_t* pixels,
+	int width, int height, const RECT* rect, region_stats_t* out_stats);
+
+// memory the tables would take for an image of the size
+uint64_t region_stats_table_bytes(int width, int height);
+uint64_t region_stats_get_resident_bytes(const region_stats_table_t* table);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,211 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "lz.h"
+#include "reload_history.h"
+
+typedef struct {
+	int tile_index;
+	uint32_t raw_size;
+	uint32_t stored_size;	// equal to raw_size if stored uncompressed
+	uint8_t* data;
+} history_tile_t;
+
+typedef struct {
+	history_tile_t* tiles;
+	int num_tiles;
+	int capacity;
+	size_t bytes;
+} history_entry_t;
+
+struct reload_history_t {
+	history_entry_t* entries;	// ring of max_entries
+	int max_entries;
+	int first;		// ring index of the oldest entry
+	int count;
+	size_t max_bytes;
+	size_t bytes;
+
+	bool recording;
+	history_entry_t pending;
+
+	// scratch space for compressing
+	uint8_t* scratch;
+	size_t scratch_size;
+};
+
+static void _free_entry(history_entry_t* entry)
+{
+	for (int i = 0; i < entry->num_tiles; i++)
+		free(entry->tiles[i].data);
+	free(entry->tiles);
+	memset(entry, 0, sizeof(*entry));
+}
+
+static history_entry_t* _get_entry(const reload_history_t* history, int entry)
+{
+	return &history->entries[(history->first + entry) % history->max_entries];
+}
+
+static void _drop_oldest(reload_history_t* history)
+{
+	history_entry_t* oldest = _get_entry(history, 0);
+	history->bytes -= oldest->bytes;
+	_free_entry(oldest);
+	history->first = (history->first + 1) % history->max_entries;
+	history->count--;
+}
+
+reload_history_t* reload_history_new(int max_entries, size_t max_bytes)
+{
+	reload_history_t* history = (reload_history_t*)calloc(1, sizeof(reload_history_t));
+	if (!history)
+		return NULL;
+	history->entries = (history_entry_t*)calloc(max_entries, sizeof(history_entry_t));
+	if (!history->entries) {
+		free(history);
+		return NULL;
+	}
+	history->max_entries = max_entries;
+	history->max_bytes = max_bytes;
+	return history;
+}
+
+void reload_history_free(reload_history_t* history)
+{
+	if (!history)
+		return;
+	while (history->count)
+		_drop_oldest(history);
+	_free_entry(&history->pending);
+	free(history->entries);
+	free(history->scratch);
+	free(history);
+}
+
+bool reload_history_begin(reload_history_t* history)
+{
+	_free_entry(&history->pending);
+	history->recording = true;
+	return true;
+}
+
+bool reload_history_add_tile(reload_history_t* history, int tile_index,
+	const void* delta, size_t size)
+{
+	if (!history->recording)
+		return false;
+
+	history_entry_t* entry = &history->pending;
+	if (entry->num_tiles == entry->capacity) {
+		int new_capacity = entry->capacity ? entry->capacity * 2 : 16;
+		history_tile_t* tiles = (history_tile_t*)realloc(entry->tiles,
+			new_capacity * sizeof(history_tile_t));
+		if (!tiles)
+			return false;
+		entry->tiles = tiles;
+		entry->capacity = new_capacity;
+	}
+
+	size_t bound = lz_compress_bound(size);
+	if (history->scratch_size < bound) {
+		uint8_t* scratch = (uint8_t*)realloc(history->scratch, bound);
+		if (!scratch)
+			return false;
+		history->scratch = scratch;
+		history->scratch_size = bound;
+	}
+
+	// deltas of small changes are mostly zero, and compress very well.
+	// store anything that doesn't shrink as is.
+	const void* stored = delta;
+	size_t stored_size = lz_compress(delta, size, history->scratch, history->scratch_size);
+	if (stored_size && stored_size < size)
+		stored = history->scratch;
+	else
+		stored_size = size;
+
+	history_tile_t* tile = &entry->tiles[entry->num_tiles];
+	tile->data = (uint8_t*)malloc(stored_size);
+	if (!tile->data)
+		return false;
+	memcpy(tile->data, stored, stored_size);
+	tile->tile_index = tile_index;
+	tile->raw_size = (uint32_t)size;
+	tile->stored_size = (uint32_t)stored_size;
+	entry->num_tiles++;
+	entry->bytes += stored_size + sizeof(history_tile_t);
+	return true;
+}
+
+void reload_history_commit(reload_history_t* history)
+{
+	if (!history->recording)
+		return;
+	history->recording = false;
+	if (!history->pending.num_tiles) {
+		_free_entry(&history->pending);
+		return;
+	}
+
+	if (history->count == history->max_entries)
+		_drop_oldest(history);
+	*_get_entry(history, history->count) = history->pending;
+	history->count++;
+	history->bytes += history->pending.bytes;
+	memset(&history->pending, 0, sizeof(history->pending));
+
+	// stay within the memory budget, but always keep the newest
+	while (history->count > 1 && history->bytes > history->max_bytes)
+		_drop_oldest(history);
+}
+
+int reload_history_count(const reload_history_t* history)
+{
+	return history->count;
+}
+
+size_t reload_history_bytes(const reload_history_t* history)
+{
+	return history->bytes;
+}
+
+int reload_history_tile_count(const reload_history_t* history, int entry)
+{
+	if (entry < 0 || entry >= history->count)
+		return 0;
+	return _get_entry(history, entry)->num_tiles;
+}
+
+static history_tile_t* _get_tile(const reload_history_t* history, int entry,
+	int tile)
+{
+	if (entry < 0 || entry >= history->count)
+		return NULL;
+	history_entry_t* e = _get_entry(history, entry);
+	if (tile < 0 || tile >= e->num_tiles)
+		return NULL;
+	return &e->tiles[tile];
+}
+
+int reload_history_tile_index(const reload_history_t* history, int entry,
+	int tile)
+{
+	history_tile_t* t = _get_tile(history, entry, tile);
+	return t ? t->tile_index : -1;
+}
+
+bool reload_history_get_tile(const reload_history_t* history, int entry,
+	int tile, void* out, size_t out_size)
+{
+	history_tile_t* t = _get_tile(history, entry, tile);
+	if (!t || t->raw_size != out_size)
+		return false;
+
+	if (t->stored_size == t->raw_size) {
+		memcpy(out, t->data, out_size);
+		return true;
+	}
+	return lz_decompress(t->data, t->stored_size, out, out_size);
+}
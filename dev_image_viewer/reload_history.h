@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// A bounded ring of changes between successive reloads of one image.
+// Each entry holds the tiles that changed, as compressed deltas (the XOR
+// of the old and new pixels), so it can be applied to step either way.
+// Entries are numbered from 0 (oldest) to count - 1 (newest).
+typedef struct reload_history_t reload_history_t;
+
+reload_history_t* reload_history_new(int max_entries, size_t max_bytes);
+void reload_history_free(reload_history_t* history);
+
+// start recording a new entry, then add each changed tile, then commit.
+// committing an entry with no tiles discards it.
+bool reload_history_begin(reload_history_t* history);
+bool reload_history_add_tile(reload_history_t* history, int tile_index,
+	const void* delta, size_t size);
+void reload_history_commit(reload_history_t* history);
+
+int reload_history_count(const reload_history_t* history);
+size_t reload_history_bytes(const reload_history_t* history);
+int reload_history_tile_count(const reload_history_t* history, int entry);
+
+// gets the index that was given for a tile of an entry, or -1.
+int reload_history_tile_index(const reload_history_t* history, int entry,
+	int tile);
+
+// decompresses one tile delta of an entry into out, which must be the
+// tile's original size.
+bool reload_history_get_tile(const reload_history_t* history, int entry,
+	int tile, void* out, size_t out_size);
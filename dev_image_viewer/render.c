@@ -0,0 +1,449 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pixel_kernels.h"
+#include "render.h"
+
+static double _now()
+{
+	struct timespec ts;
+	timespec_get(&ts, TIME_UTC);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void render_scaled_size(int width, int height, int zoom, int* out_width,
+	int* out_height)
+{
+	if (zoom >= 0) {
+		*out_width = width << zoom;
+		*out_height = height << zoom;
+		return;
+	}
+	// the minified levels round up, like the downsize does
+	for (int i = 0; i < -zoom; i++) {
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	}
+	*out_width = width;
+	*out_height = height;
+}
+
+void render_view_clamp(render_view_t* view, int image_width, int image_height)
+{
+	int scaled_width, scaled_height;
+	render_scaled_size(image_width, image_height, view->zoom,
+		&scaled_width, &scaled_height);
+
+	if (scaled_width <= view->width) {
+		view->tx = (view->width - scaled_width) / 2;
+	}
+	else {
+		if (view->tx > 0)
+			view->tx = 0;
+		if (view->tx + scaled_width < view->width)
+			view->tx = view->width - scaled_width;
+	}
+
+	if (scaled_height <= view->height) {
+		view->ty = (view->height - scaled_height) / 2;
+	}
+	else {
+		if (view->ty > 0)
+			view->ty = 0;
+		if (view->ty + scaled_height < view->height)
+			view->ty = view->height - scaled_height;
+	}
+}
+
+void render_view_zoom(render_view_t* view, int zoom, int x, int y,
+	int image_width, int image_height)
+{
+	if (zoom > RENDER_MAX_ZOOM)
+		zoom = RENDER_MAX_ZOOM;
+	if (zoom < -RENDER_NUM_MINIFY_LEVELS)
+		zoom = -RENDER_NUM_MINIFY_LEVELS;
+	if (zoom == view->zoom)
+		return;
+
+	// keep the image pixel under x, y where it is
+	double old_scale = pow(2, view->zoom);
+	double new_scale = pow(2, zoom);
+	view->tx = (int)(x - ((double)x - view->tx) / old_scale * new_scale);
+	view->ty = (int)(y - ((double)y - view->ty) / old_scale * new_scale);
+	view->zoom = zoom;
+
+	render_view_clamp(view, image_width, image_height);
+}
+
+static void _bake(render_level_t* level, uint32_t bg_color)
+{
+	uint64_t num_pixels = (uint64_t)level->width * level->height;
+	pixel_bake_sse2(level->pixels, level->pixels, num_pixels, bg_color);
+}
+
+static bool _downsize(render_level_t* levels, uint32_t bg_color)
+{
+	for (int i = 1; i <= RENDER_NUM_MINIFY_LEVELS; i++) {
+		render_level_t* src = &levels[i - 1];
+		render_level_t* dest = &levels[i];
+		dest->width = (src->width + 1) / 2;
+		dest->height = (src->height + 1) / 2;
+		dest->pixels = (uint32_t*)malloc((size_t)dest->width * dest->height * 4);
+		if (!dest->pixels)
+			return false;
+		pixel_downsize_sse2(src->pixels, src->width, src->height,
+			dest->pixels, dest->width, dest->height, bg_color);
+	}
+	return true;
+}
+
+void render_free_levels(render_level_t* levels)
+{
+	for (int i = 1; i <= RENDER_NUM_MINIFY_LEVELS; i++) {
+		free(levels[i].pixels);
+		levels[i].pixels = NULL;
+	}
+}
+
+void render_frame(const render_level_t* levels, const render_view_t* view,
+	uint32_t bg_color, uint32_t* dest)
+{
+	// as the canvas blits: a minified level as is, or level 0 magnified
+	const render_level_t* level = &levels[view->zoom < 0 ? -view->zoom : 0];
+	int shift = view->zoom < 0 ? 0 : view->zoom;
+	int64_t scaled_width = (int64_t)level->width << shift;
+	int64_t scaled_height = (int64_t)level->height << shift;
+
+	// the canvas fills the background with a brush, which is opaque
+	uint32_t bg = 0xFF000000 | (bg_color & 0xFFFFFF);
+
+	int x0 = view->tx < 0 ? 0 : view->tx;
+	int x1 = view->tx + scaled_width < view->width ?
+		(int)(view->tx + scaled_width) : view->width;
+	if (x0 > view->width)
+		x0 = view->width;
+	if (x1 < x0)
+		x1 = x0;
+
+	int prev_src_y = -1;
+	for (int y = 0; y < view->height; y++) {
+		uint32_t* row = dest + (size_t)y * view->width;
+		int64_t image_y = (int64_t)y - view->ty;
+		if (image_y < 0 || image_y >= scaled_height || x0 == x1) {
+			for (int x = 0; x < view->width; x++)
+				row[x] = bg;
+			prev_src_y = -1;
+			continue;
+		}
+
+		// magnified rows repeat
+		int src_y = (int)(image_y >> shift);
+		if (src_y == prev_src_y) {
+			memcpy(row, row - view->width, (size_t)view->width * 4);
+			continue;
+		}
+		prev_src_y = src_y;
+
+		const uint32_t* src = level->pixels + (size_t)src_y * level->width;
+		for (int x = 0; x < x0; x++)
+			row[x] = bg;
+		for (int x = x0; x < x1; x++)
+			row[x] = src[(x - view->tx) >> shift];
+		for (int x = x1; x < view->width; x++)
+			row[x] = bg;
+	}
+}
+
+bool render_run(render_level_t* levels, const render_options_t* options,
+	render_view_t* out_view, uint32_t** out_frame, render_times_t* times)
+{
+	int width = levels[0].width;
+	int height = levels[0].height;
+
+	double start = _now();
+	for (int i = 1; i <= RENDER_NUM_MINIFY_LEVELS; i++)
+		levels[i].pixels = NULL;
+	_bake(&levels[0], options->bg_color);
+	times->bake_seconds = _now() - start;
+
+	start = _now();
+	if (!_downsize(levels, options->bg_color)) {
+		render_free_levels(levels);
+		return false;
+	}
+	times->downsize_seconds = _now() - start;
+
+	// a freshly loaded canvas is at 1X, centered or at the top left
+	render_view_t view;
+	view.width = options->viewport_width;
+	view.height = options->viewport_height;
+	view.zoom = 0;
+	view.tx = 0;
+	view.ty = 0;
+	render_view_clamp(&view, width, height);
+	render_view_zoom(&view, options->zoom, view.width / 2, view.height / 2,
+		width, height);
+	view.tx += options->pan_x;
+	view.ty += options->pan_y;
+	render_view_clamp(&view, width, height);
+
+	uint32_t* frame = (uint32_t*)malloc((size_t)view.width * view.height * 4);
+	if (!frame) {
+		render_free_levels(levels);
+		return false;
+	}
+	start = _now();
+	render_frame(levels, &view, options->bg_color, frame);
+	times->render_seconds = _now() - start;
+
+	*out_view = view;
+	*out_frame = frame;
+	return true;
+}
+
+// the next header token, skipping whitespace and comments
+static bool _read_token(FILE* in, char* token, size_t size)
+{
+	int c = fgetc(in);
+	for (;;) {
+		if (c == '#') {
+			while (c != '\n' && c != EOF)
+				c = fgetc(in);
+		}
+		else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+			c = fgetc(in);
+		}
+		else {
+			break;
+		}
+	}
+	size_t length = 0;
+	while (c != EOF && c != ' ' && c != '\t' && c != '\r' && c != '\n') {
+		if (length + 1 >= size)
+			return false;
+		token[length++] = (char)c;
+		c = fgetc(in);
+	}
+	token[length] = 0;
+	// the single whitespace after the last token is consumed too, so the
+	// pixels start at the current position.
+	return length > 0;
+}
+
+static bool _read_int(FILE* in, int* value)
+{
+	char token[16];
+	if (!_read_token(in, token, sizeof(token)))
+		return false;
+	char* end = NULL;
+	long result = strtol(token, &end, 10);
+	if (*end || result <= 0 || result > 65535 * 4)
+		return false;
+	*value = (int)result;
+	return true;
+}
+
+bool render_read_pnm(FILE* in, uint32_t** out_pixels, int* out_width,
+	int* out_height)
+{
+	char token[32];
+	int width = 0, height = 0, depth = 0, maxval = 0;
+	if (!_read_token(in, token, sizeof(token)))
+		return false;
+
+	if (!strcmp(token, "P5") || !strcmp(token, "P6")) {
+		depth = token[1] == '5' ? 1 : 3;
+		if (!_read_int(in, &width) || !_read_int(in, &height) ||
+			!_read_int(in, &maxval))
+			return false;
+	}
+	else if (!strcmp(token, "P7")) {
+		for (;;) {
+			if (!_read_token(in, token, sizeof(token)))
+				return false;
+			if (!strcmp(token, "ENDHDR"))
+				break;
+			bool ok = true;
+			if (!strcmp(token, "WIDTH"))
+				ok = _read_int(in, &width);
+			else if (!strcmp(token, "HEIGHT"))
+				ok = _read_int(in, &height);
+			else if (!strcmp(token, "DEPTH"))
+				ok = _read_int(in, &depth);
+			else if (!strcmp(token, "MAXVAL"))
+				ok = _read_int(in, &maxval);
+			else if (!strcmp(token, "TUPLTYPE"))
+				ok = _read_token(in, token, sizeof(token));
+			else
+				ok = false;
+			if (!ok)
+				return false;
+		}
+	}
+	else {
+		return false;
+	}
+	if (!width || !height || depth < 1 || depth > 4 || maxval != 255)
+		return false;
+
+	size_t row_size = (size_t)width * depth;
+	uint8_t* row = (uint8_t*)malloc(row_size);
+	uint32_t* pixels = (uint32_t*)malloc((size_t)width * height * 4);
+	if (!row || !pixels) {
+		free(row);
+		free(pixels);
+		return false;
+	}
+
+	for (int y = 0; y < height; y++) {
+		if (fread(row, 1, row_size, in) != row_size) {
+			free(row);
+			free(pixels);
+			return false;
+		}
+		uint32_t* dest = pixels + (size_t)y * width;
+		for (int x = 0; x < width; x++) {
+			const uint8_t* p = row + (size_t)x * depth;
+			uint32_t r, g, b, a = 255;
+			if (depth <= 2) {
+				r = g = b = p[0];
+				if (depth == 2)
+					a = p[1];
+			}
+			else {
+				r = p[0];
+				g = p[1];
+				b = p[2];
+				if (depth == 4)
+					a = p[3];
+			}
+			// premultiplied, as the decoder hands the canvas
+			dest[x] = (a << 24) | ((r * a / 255) << 16) | ((g * a / 255) << 8) |
+				(b * a / 255);
+		}
+	}
+
+	free(row);
+	*out_pixels = pixels;
+	*out_width = width;
+	*out_height = height;
+	return true;
+}
+
+bool render_write_ppm(FILE* out, const uint32_t* pixels, int width,
+	int height)
+{
+	uint8_t* row = (uint8_t*)malloc((size_t)width * 3);
+	if (!row)
+		return false;
+	bool ok = fprintf(out, "P6\n%d %d\n255\n", width, height) > 0;
+	for (int y = 0; ok && y < height; y++) {
+		const uint32_t* src = pixels + (size_t)y * width;
+		for (int x = 0; x < width; x++) {
+			row[x * 3 + 0] = (uint8_t)(src[x] >> 16);
+			row[x * 3 + 1] = (uint8_t)(src[x] >> 8);
+			row[x * 3 + 2] = (uint8_t)src[x];
+		}
+		ok = fwrite(row, 3, width, out) == (size_t)width;
+	}
+	free(row);
+	return ok;
+}
+
+void render_write_timings(FILE* out, int image_width, int image_height,
+	const render_view_t* view, const render_times_t* times)
+{
+	fprintf(out, "{\"image\": [%d, %d], \"viewport\": [%d, %d], \"zoom\": %d, "
+		"\"offset\": [%d, %d], \"decode\": %.6f, \"bake\": %.6f, \"downsize\": %.6f, "
+		"\"render\": %.6f, \"write\": %.6f}\n",
+		image_width, image_height, view->width, view->height, view->zoom,
+		view->tx, view->ty, times->decode_seconds, times->bake_seconds,
+		times->downsize_seconds, times->render_seconds, times->write_seconds);
+}
+
+#ifdef RENDER_MAIN
+int main(int argc, char** argv)
+{
+	render_options_t options;
+	memset(&options, 0, sizeof(options));
+	options.viewport_width = 1920;
+	options.viewport_height = 1080;
+	options.bg_color = 0xFF404040;
+
+	const char* in_path = NULL;
+	const char* out_path = NULL;
+	for (int i = 1; i < argc; i++) {
+		bool ok = true;
+		if (!strcmp(argv[i], "--viewport") && i + 1 < argc)
+			ok = sscanf(argv[++i], "%dx%d", &options.viewport_width,
+				&options.viewport_height) == 2;
+		else if (!strcmp(argv[i], "--zoom") && i + 1 < argc)
+			ok = sscanf(argv[++i], "%d", &options.zoom) == 1;
+		else if (!strcmp(argv[i], "--pan") && i + 1 < argc)
+			ok = sscanf(argv[++i], "%d,%d", &options.pan_x, &options.pan_y) == 2;
+		else if (!in_path && argv[i][0] != '-')
+			in_path = argv[i];
+		else if (!out_path && argv[i][0] != '-')
+			out_path = argv[i];
+		else
+			ok = false;
+		if (!ok) {
+			fprintf(stderr, "bad argument %s\n", argv[i]);
+			return 2;
+		}
+	}
+	if (!in_path || !out_path || options.viewport_width <= 0 ||
+		options.viewport_height <= 0 || options.viewport_width > 16384 ||
+		options.viewport_height > 16384) {
+		fprintf(stderr, "usage: render in.ppm out.ppm [--viewport WxH] "
+			"[--zoom N] [--pan X,Y]\n");
+		return 2;
+	}
+
+	render_times_t times;
+	memset(&times, 0, sizeof(times));
+	render_level_t levels[RENDER_NUM_MINIFY_LEVELS + 1];
+	memset(levels, 0, sizeof(levels));
+
+	double start = _now();
+	FILE* in = fopen(in_path, "rb");
+	bool ok = in && render_read_pnm(in, &levels[0].pixels, &levels[0].width,
+		&levels[0].height);
+	if (in)
+		fclose(in);
+	if (!ok) {
+		fprintf(stderr, "can't read %s\n", in_path);
+		return 1;
+	}
+	times.decode_seconds = _now() - start;
+
+	render_view_t view;
+	uint32_t* frame = NULL;
+	if (!render_run(levels, &options, &view, &frame, &times)) {
+		fprintf(stderr, "out of memory\n");
+		free(levels[0].pixels);
+		return 1;
+	}
+
+	start = _now();
+	FILE* out = fopen(out_path, "wb");
+	ok = out && render_write_ppm(out, frame, view.width, view.height);
+	if (out && fclose(out))
+		ok = false;
+	times.write_seconds = _now() - start;
+	if (ok)
+		render_write_timings(stdout, levels[0].width, levels[0].height, &view, &times);
+	else
+		fprintf(stderr, "can't write %s\n", out_path);
+
+	free(frame);
+	render_free_levels(levels);
+	free(levels[0].pixels);
+	return ok ? 0 : 1;
+}
+#endif
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// What the canvas shows, without a window: the minified levels, the zoom
+// and pan of a viewport, and the nearest neighbor scaling of a level into
+// it.  The canvas uses the same view math, so a frame rendered here is
+// pixel for pixel what it paints.  Nothing here depends on Windows; a
+// standalone renderer of PNM files builds with
+//   cc -O2 -DRENDER_MAIN render.c pixel_kernels.c -lm -o render
+//
+//   render in.ppm out.ppm [--viewport WxH] [--zoom N] [--pan X,Y]
+//
+// and writes its stage timings to stdout as JSON.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RENDER_NUM_MINIFY_LEVELS 5
+#define RENDER_MAX_ZOOM 5
+
+// tightly packed 32bpp premultiplied BGRA
+typedef struct {
+	uint32_t* pixels;
+	int width;
+	int height;
+} render_level_t;
+
+// zoom is a power of 2; negative shows minified level -zoom.  tx, ty is
+// where the top left of the image lands in the viewport.
+typedef struct {
+	int width;
+	int height;
+	int zoom;
+	int tx;
+	int ty;
+} render_view_t;
+
+typedef struct {
+	int viewport_width;
+	int viewport_height;
+	// applied like the mouse: zoomed about the middle of the viewport,
+	// then dragged by pan
+	int zoom;
+	int pan_x;
+	int pan_y;
+	uint32_t bg_color;
+} render_options_t;
+
+typedef struct {
+	double decode_seconds;
+	double bake_seconds;
+	double downsize_seconds;
+	double render_seconds;
+	double write_seconds;
+} render_times_t;
+
+// size of the image as shown at a zoom
+void render_scaled_size(int width, int height, int zoom, int* out_width,
+	int* out_height);
+// centers an image smaller than the viewport, and keeps a larger one
+// covering it
+void render_view_clamp(render_view_t* view, int image_width, int image_height);
+// zooms about x, y in the viewport, as the mouse wheel does
+void render_view_zoom(render_view_t* view, int zoom, int x, int y,
+	int image_width, int image_height);
+
+// dest is view->width * view->height pixels
+void render_frame(const render_level_t* levels, const render_view_t* view,
+	uint32_t bg_color, uint32_t* dest);
+
+// bakes levels[0] over bg_color in place, allocates the minified levels
+// below it, sets up the view as a newly loaded canvas would and applies the
+// options to it, and renders the frame.  the frame must be freed with
+// free().  fills the bake, downsize and render times.  levels[0] stays the
+// caller's.
+bool render_run(render_level_t* levels, const render_options_t* options,
+	render_view_t* out_view, uint32_t** out_frame, render_times_t* times);
+// frees the minified levels only
+void render_free_levels(render_level_t* levels);
+
+// binary PGM, PPM, or PAM (with alpha, not premultiplied), 8 bits per
+// channel.  pixels must be freed with free().
+bool render_read_pnm(FILE* in, uint32_t** out_pixels, int* out_width,
+	int* out_height);
+// binary PPM. alpha is dropped.
+bool render_write_ppm(FILE* out, const uint32_t* pixels, int width,
+	int height);
+
+void render_write_timings(FILE* out, int image_width, int image_height,
+	const render_view_t* view, const render_times_t* times);
+
+#ifdef __cplusplus
+}
+#endif
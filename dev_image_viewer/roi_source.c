@@ -0,0 +1,521 @@
+#include "dev_image_viewer.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "image_probe_file.h"
+#include "jpeg_decoder.h"
+#include "parallel.h"
+#include "png_decoder.h"
+#include "roi_source.h"
+#include "tiff_decoder.h"
+#include "yuv_file.h"
+
+// rows read at a time by roi_source_read_rows(), at least. small enough to
+// spread a large image over many threads, and a multiple of any JPEG's MCU
+// height.
+#define ROI_SOURCE_BAND_HEIGHT 64
+
+typedef enum {
+	ROI_SOURCE_JPEG,
+	ROI_SOURCE_TIFF,
+	ROI_SOURCE_PNM,
+	ROI_SOURCE_YUV,
+	ROI_SOURCE_PNG,
+} roi_source_kind_t;
+
+struct roi_source_t {
+	HANDLE file;
+	uint64_t size;
+	roi_source_kind_t kind;
+	int width;
+	int height;
+
+	jpeg_decoder_t* jpeg;
+	tiff_decoder_t* tiff;
+	png_decoder_t* png;
+
+	// where the PNM's pixels start, and how they're stored
+	size_t pnm_offset;
+	int pnm_depth;
+	int pnm_maxval;
+	int pnm_sample_bytes;
+
+	// with the settings' matrix and range
+	yuv_layout_t yuv;
+};
+
+// the whole file, as it was opened. NULL if it's changed size since.
+static const uint8_t* _map(const roi_source_t* source, HANDLE* out_section)
+{
+	*out_section = CreateFileMappingW(source->file, NULL, PAGE_READONLY,
+		(DWORD)(source->size >> 32), (DWORD)source->size, NULL);
+	if (!*out_section)
+		return NULL;
+	const uint8_t* data = (const uint8_t*)MapViewOfFile(*out_section, FILE_MAP_READ,
+		0, 0, (SIZE_T)source->size);
+	if (!data) {
+		CloseHandle(*out_section);
+		return NULL;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(source->file, &size) || (uint64_t)size.QuadPart != source->size) {
+		UnmapViewOfFile(data);
+		CloseHandle(*out_section);
+		return NULL;
+	}
+	return data;
+}
+
+static void _unmap(const uint8_t* data, HANDLE section)
+{
+	UnmapViewOfFile(data);
+	CloseHandle(section);
+}
+
+// the next token of a PNM header, past whitespace and comments
+static bool _pnm_token(const uint8_t* data, size_t size, size_t* pos, char* token,
+	size_t token_size)
+{
+	size_t p = *pos;
+	for (;;) {
+		if (p < size && data[p] == '#') {
+			while (p < size && data[p] != '\n')
+				p++;
+		}
+		else if (p < size && (data[p] == ' ' || data[p] == '\t' || data[p] == '\r' ||
+			data[p] == '\n')) {
+			p++;
+		}
+		else {
+			break;
+		}
+	}
+	size_t length = 0;
+	while (p < size && data[p] != ' ' && data[p] != '\t' && data[p] != '\r' &&
+		data[p] != '\n' && data[p] != '#') {
+		if (length + 1 >= token_size)
+			return false;
+		token[length++] = (char)data[p++];
+	}
+	token[length] = 0;
+	// the single whitespace after the last token is part of the header
+	*pos = p + 1;
+	return length > 0;
+}
+
+static bool _pnm_int(const uint8_t* data, size_t size, size_t* pos, int* value)
+{
+	char token[16];
+	if (!_pnm_token(data, size, pos, token, sizeof(token)))
+		return false;
+	char* end = NULL;
+	long result = strtol(token, &end, 10);
+	if (*end || result <= 0 || result > INT_MAX / 8)
+		return false;
+	*value = (int)result;
+	return true;
+}
+
+// binary PGM, PPM and PAM, of any maxval
+static bool _open_pnm(roi_source_t* source, const uint8_t* data)
+{
+	size_t size = (size_t)source->size;
+	size_t pos = 0;
+	char token[32];
+	int depth = 0, maxval = 0;
+	if (!_pnm_token(data, size, &pos, token, sizeof(token)))
+		return false;
+	if (!strcmp(token, "P5") || !strcmp(token, "P6")) {
+		depth = token[1] == '5' ? 1 : 3;
+		if (!_pnm_int(data, size, &pos, &source->width) ||
+			!_pnm_int(data, size, &pos, &source->height) ||
+			!_pnm_int(data, size, &pos, &maxval))
+			return false;
+	}
+	else if (!strcmp(token, "P7")) {
+		for (;;) {
+			if (!_pnm_token(data, size, &pos, token, sizeof(token)))
+				return false;
+			if (!strcmp(token, "ENDHDR"))
+				break;
+			bool ok = true;
+			if (!strcmp(token, "WIDTH"))
+				ok = _pnm_int(data, size, &pos, &source->width);
+			else if (!strcmp(token, "HEIGHT"))
+				ok = _pnm_int(data, size, &pos, &source->height);
+			else if (!strcmp(token, "DEPTH"))
+				ok = _pnm_int(data, size, &pos, &depth);
+			else if (!strcmp(token, "MAXVAL"))
+				ok = _pnm_int(data, size, &pos, &maxval);
+			else if (!strcmp(token, "TUPLTYPE"))
+				ok = _pnm_token(data, size, &pos, token, sizeof(token));
+			else
+				ok = false;
+			if (!ok)
+				return false;
+		}
+	}
+	else {
+		return false;
+	}
+	if (!source->width || !source->height || depth < 1 || depth > 4 ||
+		maxval < 1 || maxval > 65535)
+		return false;
+
+	source->pnm_offset = pos;
+	source->pnm_depth = depth;
+	source->pnm_maxval = maxval;
+	source->pnm_sample_bytes = maxval > 255 ? 2 : 1;
+	uint64_t pixels_size = (uint64_t)source->width * source->height * depth *
+		source->pnm_sample_bytes;
+	return pos <= size && pixels_size <= size - pos;
+}
+
+static uint32_t _pnm_sample(const roi_source_t* source, const uint8_t* p, int index)
+{
+	uint32_t value = source->pnm_sample_bytes == 1 ? p[index] :
+		((uint32_t)p[index * 2] << 8) | p[index * 2 + 1];
+	if (source->pnm_maxval != 255)
+		value = (value * 255 + source->pnm_maxval / 2) / source->pnm_maxval;
+	return value > 255 ? 255 : value;
+}
+
+static void _pnm_row(const roi_source_t* source, const uint8_t* data, int y, int x0,
+	int step, int count, uint32_t* dest)
+{
+	size_t pixel_bytes = (size_t)source->pnm_depth * source->pnm_sample_bytes;
+	const uint8_t* row = data + source->pnm_offset +
+		(size_t)y * source->width * pixel_bytes;
+	for (int i = 0; i < count; i++) {
+		const uint8_t* p = row + (size_t)(x0 + i * step) * pixel_bytes;
+		uint32_t r, g, b, a = 255;
+		if (source->pnm_depth <= 2) {
+			r = g = b = _pnm_sample(source, p, 0);
+			if (source->pnm_depth == 2)
+				a = _pnm_sample(source, p, 1);
+		}
+		else {
+			r = _pnm_sample(source, p, 0);
+			g = _pnm_sample(source, p, 1);
+			b = _pnm_sample(source, p, 2);
+			if (source->pnm_depth == 4)
+				a = _pnm_sample(source, p, 3);
+		}
+		if (a != 255) {
+			r = (r * a + 127) / 255;
+			g = (g * a + 127) / 255;
+			b = (b * a + 127) / 255;
+		}
+		dest[i] = (a << 24) | (r << 16) | (g << 8) | b;
+	}
+}
+
+// the first frame, as the settings show it. only the colour view is read
+// by region.
+static bool _open_yuv(roi_source_t* source, const WCHAR* path)
+{
+	yuv_settings_t settings;
+	yuv_file_get_settings(&settings);
+	if (settings.view != YUV_VIEW_COLOR || !yuv_file_get_layout(path, &source->yuv))
+		return false;
+	if (settings.matrix != YUV_FILE_AUTO)
+		source->yuv.matrix = (yuv_matrix_t)settings.matrix;
+	if (settings.full_range != YUV_FILE_AUTO)
+		source->yuv.full_range = settings.full_range != 0;
+	source->width = source->yuv.width;
+	source->height = source->yuv.height;
+	return yuv_frame_bytes(&source->yuv) <= source->size;
+}
+
+// whole is true for reading the image whole, top to bottom
+static roi_source_t* _open(const WCHAR* path, bool whole)
+{
+	image_probe_t probe;
+	if (!image_probe_file(path, &probe))
+		return NULL;
+	roi_source_kind_t kind;
+	switch (probe.format) {
+	case IMAGE_PROBE_JPEG:
+		// each scan of a progressive file refines the whole image
+		if (probe.interlaced && !whole)
+			return NULL;
+		kind = ROI_SOURCE_JPEG;
+		break;
+	case IMAGE_PROBE_TIFF: kind = ROI_SOURCE_TIFF; break;
+	case IMAGE_PROBE_PNM: kind = ROI_SOURCE_PNM; break;
+	case IMAGE_PROBE_YUV: kind = ROI_SOURCE_YUV; break;
+	case IMAGE_PROBE_PNG:
+		// the rows inflate as one stream, so only whole
+		if (!whole)
+			return NULL;
+		kind = ROI_SOURCE_PNG;
+		break;
+	default: return NULL;
+	}
+
+	roi_source_t* source = (roi_source_t*)calloc(1, sizeof(roi_source_t));
+	if (!source)
+		return NULL;
+	source->kind = kind;
+	source->file = CreateFileW(path, GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	LARGE_INTEGER size;
+	if (source->file == INVALID_HANDLE_VALUE || !GetFileSizeEx(source->file, &size) ||
+		size.QuadPart == 0 || (uint64_t)size.QuadPart > (SIZE_T)-1) {
+		if (source->file != INVALID_HANDLE_VALUE)
+			CloseHandle(source->file);
+		free(source);
+		return NULL;
+	}
+	source->size = (uint64_t)size.QuadPart;
+
+	HANDLE section;
+	const uint8_t* data = _map(source, &section);
+	bool ok = data != NULL;
+	if (ok) {
+		switch (kind) {
+		case ROI_SOURCE_JPEG:
+			// without restart markers, every rectangle would decode all
+			// that comes before it
+			source->jpeg = jpeg_decoder_open(data, (size_t)source->size);
+			ok = source->jpeg && (whole || jpeg_decoder_has_restarts(source->jpeg));
+			if (ok)
+				jpeg_decoder_get_size(source->jpeg, &source->width, &source->height);
+			break;
+		case ROI_SOURCE_TIFF:
+			source->tiff = tiff_decoder_open(data, (size_t)source->size);
+			ok = source->tiff != NULL;
+			if (ok)
+				tiff_decoder_get_size(source->tiff, &source->width, &source->height);
+			break;
+		case ROI_SOURCE_PNM:
+			ok = _open_pnm(source, data);
+			break;
+		case ROI_SOURCE_YUV:
+			ok = _open_yuv(source, path);
+			break;
+		case ROI_SOURCE_PNG:
+			source->png = png_decoder_open(data, (size_t)source->size);
+			ok = source->png != NULL;
+			if (ok)
+				png_decoder_get_size(source->png, &source->width, &source->height);
+			break;
+		}
+		_unmap(data, section);
+	}
+	if (!ok) {
+		roi_source_close(source);
+		return NULL;
+	}
+	return source;
+}
+
+roi_source_t* roi_source_open(const WCHAR* path)
+{
+	return _open(path, false);
+}
+
+roi_source_t* roi_source_open_whole(const WCHAR* path)
+{
+	return _open(path, true);
+}
+
+void roi_source_close(roi_source_t* source)
+{
+	if (!source)
+		return;
+	jpeg_decoder_free(source->jpeg);
+	tiff_decoder_free(source->tiff);
+	png_decoder_free(source->png);
+	CloseHandle(source->file);
+	free(source);
+}
+
+void roi_source_get_size(const roi_source_t* source, int* out_width,
+	int* out_height)
+{
+	*out_width = source->width;
+	*out_height = source->height;
+}
+
+// as roi_source_read(), from the file mapped at data
+static bool _read(const roi_source_t* source, const uint8_t* data, const RECT* rect,
+	int step, uint32_t* dest, int stride)
+{
+	bool ok = true;
+	int count = (rect->right - rect->left + step - 1) / step;
+	switch (source->kind) {
+	case ROI_SOURCE_JPEG: {
+		// stepping by a power of two from a multiple of it reads the
+		// reduced image instead, up to 1/8, which averages rather than
+		// skips and transforms less
+		int shift = 0;
+		while (shift < 3 && step % (2 << shift) == 0 && rect->left % (2 << shift) == 0 &&
+			rect->top % (2 << shift) == 0)
+			shift++;
+		int round = (1 << shift) - 1;
+		ok = jpeg_decoder_read_reduced(source->jpeg, data, shift, rect->left >> shift,
+			rect->top >> shift, (rect->right + round) >> shift,
+			(rect->bottom + round) >> shift, step >> shift, dest, stride);
+		break;
+	}
+	case ROI_SOURCE_TIFF:
+		ok = tiff_decoder_read(source->tiff, data, rect->left, rect->top,
+			rect->right, rect->bottom, step, dest, stride);
+		break;
+	case ROI_SOURCE_PNM:
+		for (int y = rect->top, row = 0; y < rect->bottom; y += step, row++)
+			_pnm_row(source, data, y, rect->left, step, count, dest + (size_t)row * stride);
+		break;
+	case ROI_SOURCE_YUV:
+		for (int y = rect->top, row = 0; y < rect->bottom; y += step, row++) {
+			yuv_convert_samples(&source->yuv, data, rect->left, y, step, count,
+				dest + (size_t)row * stride);
+		}
+		break;
+	case ROI_SOURCE_PNG:
+		// never opened for regions
+		ok = false;
+		break;
+	}
+	return ok;
+}
+
+bool roi_source_read(const roi_source_t* source, const RECT* rect, int step,
+	uint32_t* dest, int stride)
+{
+	if (rect->left < 0 || rect->top < 0 || rect->right > source->width ||
+		rect->bottom > source->height || rect->left >= rect->right ||
+		rect->top >= rect->bottom || step < 1)
+		return false;
+	HANDLE section;
+	const uint8_t* data = _map(source, &section);
+	if (!data)
+		return false;
+	bool ok = _read(source, data, rect, step, dest, stride);
+	_unmap(data, section);
+	return ok;
+}
+
+bool roi_source_reads_in_parallel(const roi_source_t* source)
+{
+	if (source->kind == ROI_SOURCE_PNG)
+		return false;
+	return source->kind != ROI_SOURCE_JPEG || jpeg_decoder_has_restarts(source->jpeg);
+}
+
+typedef struct {
+	const roi_source_t* source;
+	const uint8_t* data;
+	uint32_t* dest;
+	int stride;
+	int band_height;
+	roi_source_rows_fn rows_fn;
+	void* ctx;
+	// once set, the bands not started yet are skipped
+	volatile LONG failed;
+} _bands_t;
+
+static void _read_band(void* ctx, int index)
+{
+	_bands_t* bands = (_bands_t*)ctx;
+	if (bands->failed)
+		return;
+	const roi_source_t* source = bands->source;
+	int y = index * bands->band_height;
+	RECT rect = { 0, y, source->width, min(y + bands->band_height, source->height) };
+	if (!_read(source, bands->data, &rect, 1, bands->dest + (size_t)y * bands->stride,
+			bands->stride) ||
+		!bands->rows_fn(bands->ctx, rect.top, rect.bottom))
+		InterlockedExchange(&bands->failed, 1);
+}
+
+bool roi_source_read_rows(const roi_source_t* source, uint32_t* dest, int stride,
+	roi_source_rows_fn rows_fn, void* ctx)
+{
+	if (source->kind == ROI_SOURCE_JPEG && jpeg_decoder_is_progressive(source->jpeg))
+		return false;
+	HANDLE section;
+	const uint8_t* data = _map(source, &section);
+	if (!data)
+		return false;
+
+	bool ok;
+	if (source->kind == ROI_SOURCE_PNG) {
+		// each row is unfiltered from the one above, and inflated after
+		// everything before it
+		ok = png_decoder_read(source->png, data, dest, stride, rows_fn, ctx);
+	}
+	else if (!roi_source_reads_in_parallel(source)) {
+		// each row of MCUs is reached through the ones before it
+		ok = jpeg_decoder_read_rows(source->jpeg, data, dest, stride, rows_fn, ctx);
+	}
+	else {
+		// strips, tiles and restart intervals decode on their own, in
+		// bands that decode none of them twice
+		_bands_t bands;
+		ZeroMemory(&bands, sizeof(bands));
+		int granularity = source->kind == ROI_SOURCE_TIFF ?
+			tiff_decoder_get_band_height(source->tiff) :
+			jpeg_decoder_get_band_height(source->jpeg);
+		bands.source = source;
+		bands.data = data;
+		bands.dest = dest;
+		bands.stride = stride;
+		bands.band_height = (ROI_SOURCE_BAND_HEIGHT + granularity - 1) / granularity *
+			granularity;
+		bands.rows_fn = rows_fn;
+		bands.ctx = ctx;
+		parallel_for((source->height + bands.band_height - 1) / bands.band_height,
+			_read_band, &bands);
+		ok = !bands.failed;
+	}
+	_unmap(data, section);
+	return ok;
+}
+
+bool roi_source_read_preview(const roi_source_t* source, uint32_t* dest, int stride)
+{
+	int step = 1 << ROI_SOURCE_PREVIEW_SHIFT;
+	RECT rect = { 0, 0, source->width, source->height };
+	switch (source->kind) {
+	case ROI_SOURCE_JPEG: {
+		// only a progressive file's DC comes cheap
+		if (!jpeg_decoder_is_progressive(source->jpeg))
+			return false;
+		HANDLE section;
+		const uint8_t* data = _map(source, &section);
+		if (!data)
+			return false;
+		int width, height;
+		jpeg_decoder_get_reduced_size(source->jpeg, ROI_SOURCE_PREVIEW_SHIFT, &width,
+			&height);
+		bool ok = jpeg_decoder_read_reduced(source->jpeg, data, ROI_SOURCE_PREVIEW_SHIFT,
+			0, 0, width, height, 1, dest, stride);
+		_unmap(data, section);
+		return ok;
+	}
+	case ROI_SOURCE_PNG: {
+		// an interlaced file's first pass comes first in the stream
+		if (!png_decoder_is_interlaced(source->png))
+			return false;
+		HANDLE section;
+		const uint8_t* data = _map(source, &section);
+		if (!data)
+			return false;
+		bool ok = png_decoder_read_preview(source->png, data, dest, stride);
+		_unmap(data, section);
+		return ok;
+	}
+	case ROI_SOURCE_TIFF:
+		// compressed strips and tiles decode whole for any pixel of them
+		if (tiff_decoder_get_band_height(source->tiff) != 1)
+			return false;
+		return roi_source_read(source, &rect, step, dest, stride);
+	default:
+		return roi_source_read(source, &rect, step, dest, stride);
+	}
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Images too large to decode whole, read a rectangle at a time straight
+// from the file: JPEG with restart markers (see jpeg_decoder.h), TIFF (see
+// tiff_decoder.h), binary PGM, PPM and PAM, and the colour view of raw YUV
+// (see yuv_file.h).  The canvas shows these through roi_view.h, so only
+// what's on screen is ever decoded.  The file is mapped only for each read,
+// never in between, so it can be rewritten or replaced while it shows.
+//
+// Large images that fit in memory are read whole the same way, a band of
+// rows at a time, so the canvas can show each band as it's done.  The
+// bands decode in parallel where the format splits into parts that decode
+// on their own: TIFF strips and tiles, JPEG restart intervals, and the rows
+// of PNM and raw YUV.  PNG (see png_decoder.h) is only read whole, on one
+// thread, a few rows at a time as it inflates.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// the scale of roi_source_read_preview(), as 1 / 2^shift
+#define ROI_SOURCE_PREVIEW_SHIFT 3
+
+typedef struct roi_source_t roi_source_t;
+
+// NULL if the file isn't in one of the formats, or can't be read by region
+roi_source_t* roi_source_open(const WCHAR* path);
+// for reading whole with roi_source_read_rows(), so JPEG needn't have
+// restart markers, a progressive JPEG opens for its preview alone, and PNG
+// opens at all
+roi_source_t* roi_source_open_whole(const WCHAR* path);
+void roi_source_close(roi_source_t* source);
+
+void roi_source_get_size(const roi_source_t* source, int* out_width,
+	int* out_height);
+
+// the pixels at left + i * step, top + j * step inside rect, into rows of
+// dest stride pixels apart, as premultiplied BGRA.  JPEG gives the averages
+// of the blocks there instead, of the largest power of two up to 8 that step
+// and the rect's corner are multiples of.  false if the file has changed
+// size since it was opened.  safe to call from several threads at once.
+bool roi_source_read(const roi_source_t* source, const RECT* rect, int step,
+	uint32_t* dest, int stride);
+
+// told that rows [y0, y1) of dest are done. false stops the read, which
+// then fails.
+typedef bool (*roi_source_rows_fn)(void* ctx, int y0, int y1);
+// whether roi_source_read_rows() spreads over threads: all but PNG and a
+// JPEG without restart markers
+bool roi_source_reads_in_parallel(const roi_source_t* source);
+// the whole image into rows of dest stride pixels apart, telling rows_fn
+// after each band.  bands are handed out top to bottom, but finish in any
+// order, and rows_fn may be called from several threads at once.  false
+// for a progressive JPEG.
+bool roi_source_read_rows(const roi_source_t* source, uint32_t* dest, int stride,
+	roi_source_rows_fn rows_fn, void* ctx);
+// the image at 1 / 2^ROI_SOURCE_PREVIEW_SHIFT scale, rounded up, where that
+// costs much less than the whole: the first scan of a progressive JPEG, the
+// first pass of an interlaced PNG, and every 8th pixel of uncompressed TIFF,
+// PNM and raw YUV.  false otherwise.
+bool roi_source_read_preview(const roi_source_t* source, uint32_t* dest, int stride);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,460 @@
+#include "dev_image_viewer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gdiplus_loader.h"
+#include "parallel.h"
+#include "pixel_kernels.h"
+#include "roi_view.h"
+
+#define ROI_VIEW_NUM_LEVELS (RENDER_NUM_MINIFY_LEVELS + 1)
+
+// tiles decoded past the visible ones, on each side, so a short pan finds
+// them ready
+#define ROI_VIEW_MARGIN 1
+
+typedef enum {
+	ROI_VIEW_EMPTY,
+	ROI_VIEW_DECODING,
+	ROI_VIEW_READY,
+	ROI_VIEW_FAILED,
+} roi_view_state_t;
+
+typedef struct {
+	roi_view_t* view;
+	roi_view_state_t state;
+	// in tiles of its level
+	int level;
+	int x;
+	int y;
+	// of its pixels, the ones that are image. less than the slot at the
+	// right and bottom edges.
+	int width;
+	int height;
+	// the paint that last showed or wanted it
+	uint64_t used;
+	// ROI_VIEW_TILE_SIZE square, made on first use and kept for reuse
+	HBITMAP hbitmap;
+	void* bits;		// owned by hbitmap. do not free.
+} roi_view_tile_t;
+
+typedef struct {
+	int x;
+	int y;
+	int distance;
+} roi_view_want_t;
+
+struct roi_view_t {
+	roi_source_t* source;
+	int widths[ROI_VIEW_NUM_LEVELS];
+	int heights[ROI_VIEW_NUM_LEVELS];
+	uint32_t bg_color;
+	HWND hwnd;
+	UINT message;
+	roi_view_tile_t* tiles;
+	int num_tiles;
+	// the most tiles decoded for one paint, half the slots, so the
+	// other half can hold what was shown before
+	int max_wanted;
+
+	TP_CALLBACK_ENVIRON callback_environ;
+	PTP_CLEANUP_GROUP cleanup_group;
+	int num_workers;
+
+	// guards the tiles' states, what's wanted, and the count of decodes
+	// queued or running, shared with the workers.  tiles are drawn with
+	// it held, so none is reused mid-paint.
+	SRWLOCK lock;
+	int level;
+	RECT wanted;	// in tiles of level
+	roi_view_want_t* order;	// of wanted, nearest the middle first
+	int order_capacity;
+	int num_wanted;
+	uint64_t paint;
+	int decoding;
+	bool closing;
+};
+
+roi_view_t* roi_view_open(roi_source_t* source, uint32_t bg_color, HWND hwnd,
+	UINT message)
+{
+	roi_view_t* view = (roi_view_t*)calloc(1, sizeof(roi_view_t));
+	if (!view) {
+		roi_source_close(source);
+		return NULL;
+	}
+	view->source = source;
+
+	// enough for a window across every screen, misaligned with the tiles
+	int tiles_x = (GetSystemMetrics(SM_CXVIRTUALSCREEN) + ROI_VIEW_TILE_SIZE - 1) /
+		ROI_VIEW_TILE_SIZE + 1 + ROI_VIEW_MARGIN * 2;
+	int tiles_y = (GetSystemMetrics(SM_CYVIRTUALSCREEN) + ROI_VIEW_TILE_SIZE - 1) /
+		ROI_VIEW_TILE_SIZE + 1 + ROI_VIEW_MARGIN * 2;
+	view->max_wanted = tiles_x * tiles_y;
+	view->num_tiles = view->max_wanted * 2;
+	view->tiles = (roi_view_tile_t*)calloc(view->num_tiles, sizeof(roi_view_tile_t));
+	if (view->tiles)
+		view->cleanup_group = CreateThreadpoolCleanupGroup();
+	if (!view->cleanup_group) {
+		free(view->tiles);
+		free(view);
+		roi_source_close(source);
+		return NULL;
+	}
+	for (int i = 0; i < view->num_tiles; i++)
+		view->tiles[i].view = view;
+
+	roi_source_get_size(source, &view->widths[0], &view->heights[0]);
+	for (int i = 1; i < ROI_VIEW_NUM_LEVELS; i++) {
+		view->widths[i] = (view->widths[i - 1] + 1) / 2;
+		view->heights[i] = (view->heights[i - 1] + 1) / 2;
+	}
+	view->bg_color = bg_color;
+	view->hwnd = hwnd;
+	view->message = message;
+	InitializeThreadpoolEnvironment(&view->callback_environ);
+	SetThreadpoolCallbackCleanupGroup(&view->callback_environ,
+		view->cleanup_group, NULL);
+	InitializeSRWLock(&view->lock);
+	view->num_workers = parallel_get_num_threads();
+	return view;
+}
+
+void roi_view_close(roi_view_t* view)
+{
+	if (!view)
+		return;
+	// cancels decodes not started, and waits for the rest, which queue
+	// no more
+	AcquireSRWLockExclusive(&view->lock);
+	view->closing = true;
+	ReleaseSRWLockExclusive(&view->lock);
+	CloseThreadpoolCleanupGroupMembers(view->cleanup_group, TRUE, NULL);
+	CloseThreadpoolCleanupGroup(view->cleanup_group);
+	DestroyThreadpoolEnvironment(&view->callback_environ);
+	for (int i = 0; i < view->num_tiles; i++) {
+		if (view->tiles[i].hbitmap)
+			DeleteObject(view->tiles[i].hbitmap);
+	}
+	free(view->tiles);
+	free(view->order);
+	roi_source_close(view->source);
+	free(view);
+}
+
+void roi_view_get_size(const roi_view_t* view, int* out_width, int* out_height)
+{
+	*out_width = view->widths[0];
+	*out_height = view->heights[0];
+}
+
+static bool _is_wanted(const roi_view_t* view, const roi_view_tile_t* tile)
+{
+	return tile->level == view->level &&
+		tile->x >= view->wanted.left && tile->x < view->wanted.right &&
+		tile->y >= view->wanted.top && tile->y < view->wanted.bottom;
+}
+
+// the slot holding a tile, in any state but empty
+static roi_view_tile_t* _find(roi_view_t* view, int level, int x, int y)
+{
+	for (int i = 0; i < view->num_tiles; i++) {
+		roi_view_tile_t* tile = &view->tiles[i];
+		if (tile->state != ROI_VIEW_EMPTY && tile->level == level &&
+			tile->x == x && tile->y == y)
+			return tile;
+	}
+	return NULL;
+}
+
+// an empty slot, or else the one shown longest ago that isn't wanted now
+static roi_view_tile_t* _reuse(roi_view_t* view)
+{
+	roi_view_tile_t* oldest = NULL;
+	for (int i = 0; i < view->num_tiles; i++) {
+		roi_view_tile_t* tile = &view->tiles[i];
+		if (tile->state == ROI_VIEW_EMPTY)
+			return tile;
+		if (tile->state != ROI_VIEW_DECODING && tile->used < view->paint &&
+			(!oldest || tile->used < oldest->used))
+			oldest = tile;
+	}
+	return oldest;
+}
+
+// reads a tile into its slot, baked, as the canvas's levels are
+static bool _build(roi_view_t* view, roi_view_tile_t* tile)
+{
+	if (!tile->hbitmap) {
+		BITMAPV5HEADER bmi;
+		init_bitmap_header(&bmi, ROI_VIEW_TILE_SIZE, ROI_VIEW_TILE_SIZE);
+		HDC hdc = GetDC(NULL);
+		tile->hbitmap = CreateDIBSection(hdc, (BITMAPINFO*)&bmi, DIB_RGB_COLORS,
+			&tile->bits, NULL, 0);
+		ReleaseDC(NULL, hdc);
+		if (!tile->hbitmap || !tile->bits) {
+			if (tile->hbitmap)
+				DeleteObject(tile->hbitmap);
+			tile->hbitmap = NULL;
+			tile->bits = NULL;
+			return false;
+		}
+	}
+
+	// the level 0 pixels under the tile
+	int level = tile->level;
+	RECT rect;
+	rect.left = (tile->x * ROI_VIEW_TILE_SIZE) << level;
+	rect.top = (tile->y * ROI_VIEW_TILE_SIZE) << level;
+	rect.right = min((tile->x * ROI_VIEW_TILE_SIZE + tile->width) << level, view->widths[0]);
+	rect.bottom = min((tile->y * ROI_VIEW_TILE_SIZE + tile->height) << level, view->heights[0]);
+	uint32_t* bits = (uint32_t*)tile->bits;
+
+	if (level == 0) {
+		if (!roi_source_read(view->source, &rect, 1, bits, ROI_VIEW_TILE_SIZE))
+			return false;
+		for (int row = 0; row < tile->height; row++) {
+			uint32_t* p = bits + (size_t)row * ROI_VIEW_TILE_SIZE;
+			pixel_bake_sse2(p, p, tile->width, view->bg_color);
+		}
+		return true;
+	}
+
+	// a sample of the level above, halved. its size rounds up to twice
+	// the tile's, as the levels' sizes do.
+	int step = 1 << (level - 1);
+	int sample_width = (rect.right - rect.left + step - 1) / step;
+	int sample_height = (rect.bottom - rect.top + step - 1) / step;
+	size_t sample_count = (size_t)sample_width * sample_height;
+	uint32_t* samples = (uint32_t*)malloc(
+		(sample_count + (size_t)tile->width * tile->height) * sizeof(uint32_t));
+	if (!samples)
+		return false;
+	uint32_t* halved = samples + sample_count;
+	bool ok = roi_source_read(view->source, &rect, step, samples, sample_width);
+	if (ok) {
+		pixel_bake_sse2(samples, samples, sample_count, view->bg_color);
+		pixel_downsize_sse2(samples, sample_width, sample_height,
+			halved, tile->width, tile->height, view->bg_color);
+		for (int row = 0; row < tile->height; row++) {
+			memcpy(bits + (size_t)row * ROI_VIEW_TILE_SIZE,
+				halved + (size_t)row * tile->width, tile->width * sizeof(uint32_t));
+		}
+	}
+	free(samples);
+	return ok;
+}
+
+static void _top_up(roi_view_t* view);
+
+static VOID CALLBACK _decode(PTP_CALLBACK_INSTANCE instance, PVOID param)
+{
+	roi_view_tile_t* tile = (roi_view_tile_t*)param;
+	roi_view_t* view = tile->view;
+
+	// panned or zoomed away while waiting its turn
+	AcquireSRWLockExclusive(&view->lock);
+	bool skip = view->closing || !_is_wanted(view, tile);
+	if (skip)
+		tile->state = ROI_VIEW_EMPTY;
+	ReleaseSRWLockExclusive(&view->lock);
+
+	// the slot isn't drawn or reused while decoding
+	bool ok = !skip && _build(view, tile);
+
+	AcquireSRWLockExclusive(&view->lock);
+	view->decoding--;
+	if (!skip) {
+		tile->state = ok ? ROI_VIEW_READY : ROI_VIEW_FAILED;
+		tile->used = view->paint;
+	}
+	_top_up(view);
+	ReleaseSRWLockExclusive(&view->lock);
+	if (ok)
+		PostMessageW(view->hwnd, view->message, 0, 0);
+}
+
+// submits the decode of a wanted tile, if it isn't there already and
+// there's a worker and a slot for it.  false once there are no more.
+static bool _submit(roi_view_t* view, int x, int y)
+{
+	if (_find(view, view->level, x, y))
+		return true;
+	if (view->decoding >= view->num_workers)
+		return false;
+	roi_view_tile_t* tile = _reuse(view);
+	if (!tile)
+		return false;
+	tile->state = ROI_VIEW_DECODING;
+	tile->level = view->level;
+	tile->x = x;
+	tile->y = y;
+	tile->width = min(ROI_VIEW_TILE_SIZE, view->widths[view->level] - x * ROI_VIEW_TILE_SIZE);
+	tile->height = min(ROI_VIEW_TILE_SIZE, view->heights[view->level] - y * ROI_VIEW_TILE_SIZE);
+	if (!TrySubmitThreadpoolCallback(_decode, tile, &view->callback_environ)) {
+		tile->state = ROI_VIEW_EMPTY;
+		return false;
+	}
+	view->decoding++;
+	return true;
+}
+
+// queues decodes of the wanted tiles, nearest the middle first
+static void _top_up(roi_view_t* view)
+{
+	if (view->closing)
+		return;
+	for (int i = 0; i < view->num_wanted; i++) {
+		if (!_submit(view, view->order[i].x, view->order[i].y))
+			return;
+	}
+}
+
+static int _compare_want(const void* a, const void* b)
+{
+	return ((const roi_view_want_t*)a)->distance - ((const roi_view_want_t*)b)->distance;
+}
+
+// the tiles around visible, at level, become the ones wanted
+static void _want(roi_view_t* view, int level, const RECT* visible)
+{
+	int tiles_x = (view->widths[level] + ROI_VIEW_TILE_SIZE - 1) / ROI_VIEW_TILE_SIZE;
+	int tiles_y = (view->heights[level] + ROI_VIEW_TILE_SIZE - 1) / ROI_VIEW_TILE_SIZE;
+	view->level = level;
+	view->num_wanted = 0;
+	if (IsRectEmpty(visible)) {
+		SetRectEmpty(&view->wanted);
+		return;
+	}
+	view->wanted.left = max(visible->left - ROI_VIEW_MARGIN, 0);
+	view->wanted.top = max(visible->top - ROI_VIEW_MARGIN, 0);
+	view->wanted.right = min(visible->right + ROI_VIEW_MARGIN, tiles_x);
+	view->wanted.bottom = min(visible->bottom + ROI_VIEW_MARGIN, tiles_y);
+
+	int count = (view->wanted.right - view->wanted.left) *
+		(view->wanted.bottom - view->wanted.top);
+	if (count > view->order_capacity) {
+		roi_view_want_t* order = (roi_view_want_t*)realloc(view->order,
+			count * sizeof(roi_view_want_t));
+		if (!order)
+			return;
+		view->order = order;
+		view->order_capacity = count;
+	}
+	// doubled, so the middle of an even span is whole
+	int middle_x = visible->left + visible->right;
+	int middle_y = visible->top + visible->bottom;
+	int n = 0;
+	for (int y = view->wanted.top; y < view->wanted.bottom; y++) {
+		for (int x = view->wanted.left; x < view->wanted.right; x++) {
+			int dx = x * 2 + 1 - middle_x;
+			int dy = y * 2 + 1 - middle_y;
+			view->order[n].x = x;
+			view->order[n].y = y;
+			view->order[n].distance = dx * dx + dy * dy;
+			n++;
+		}
+	}
+	qsort(view->order, n, sizeof(roi_view_want_t), _compare_want);
+	view->num_wanted = min(n, view->max_wanted);
+
+	// wanted tiles already there aren't reused for the others
+	for (int i = 0; i < view->num_wanted; i++) {
+		roi_view_tile_t* tile = _find(view, level, view->order[i].x, view->order[i].y);
+		if (tile)
+			tile->used = view->paint;
+	}
+}
+
+// draws a tile of a level at or above the one the zoom chooses, clipped to
+// the image, and excludes it from the clip.  returns the pixels drawn.
+static uint64_t _draw_tile(roi_view_t* view, HDC hdc, HDC bitmap_hdc,
+	const roi_view_tile_t* tile, const render_view_t* render_view, int level, int zoom)
+{
+	int shift = tile->level - level + zoom;
+	RECT dest;
+	dest.left = ((tile->x * ROI_VIEW_TILE_SIZE) << shift) + render_view->tx;
+	dest.top = ((tile->y * ROI_VIEW_TILE_SIZE) << shift) + render_view->ty;
+	int dest_width = tile->width << shift;
+	int dest_height = tile->height << shift;
+
+	// a coarser tile's last pixels can reach past the image's edge
+	RECT clip;
+	clip.left = max(dest.left, 0);
+	clip.top = max(dest.top, 0);
+	clip.right = min(min(dest.left + dest_width,
+		render_view->tx + (view->widths[level] << zoom)), render_view->width);
+	clip.bottom = min(min(dest.top + dest_height,
+		render_view->ty + (view->heights[level] << zoom)), render_view->height);
+	if (clip.left >= clip.right || clip.top >= clip.bottom)
+		return 0;
+
+	SelectObject(bitmap_hdc, tile->hbitmap);
+	int saved = SaveDC(hdc);
+	IntersectClipRect(hdc, clip.left, clip.top, clip.right, clip.bottom);
+	StretchBlt(hdc, dest.left, dest.top, dest_width, dest_height,
+		bitmap_hdc, 0, 0, tile->width, tile->height, SRCCOPY);
+	RestoreDC(hdc, saved);
+	ExcludeClipRect(hdc, clip.left, clip.top, clip.right, clip.bottom);
+	return (uint64_t)(clip.right - clip.left) * (clip.bottom - clip.top);
+}
+
+uint64_t roi_view_draw(roi_view_t* view, HDC hdc, const render_view_t* render_view)
+{
+	int level = render_view->zoom < 0 ? -render_view->zoom : 0;
+	int zoom = render_view->zoom < 0 ? 0 : render_view->zoom;
+	int width = view->widths[level];
+	int height = view->heights[level];
+
+	// the level's pixels showing, as the canvas works them out
+	RECT src;
+	src.left = render_view->tx >= 0 ? 0 : (-render_view->tx) >> zoom;
+	src.top = render_view->ty >= 0 ? 0 : (-render_view->ty) >> zoom;
+	src.right = min(((render_view->width - render_view->tx) >> zoom) + 1, width);
+	src.bottom = min(((render_view->height - render_view->ty) >> zoom) + 1, height);
+	RECT visible = { 0, 0, 0, 0 };
+	if (src.left < src.right && src.top < src.bottom) {
+		visible.left = src.left / ROI_VIEW_TILE_SIZE;
+		visible.top = src.top / ROI_VIEW_TILE_SIZE;
+		visible.right = (src.right - 1) / ROI_VIEW_TILE_SIZE + 1;
+		visible.bottom = (src.bottom - 1) / ROI_VIEW_TILE_SIZE + 1;
+	}
+
+	AcquireSRWLockExclusive(&view->lock);
+	view->paint++;
+	_want(view, level, &visible);
+
+	// the level's own tiles, then coarser ones under the gaps
+	uint64_t num_pixels = 0;
+	HDC bitmap_hdc = CreateCompatibleDC(hdc);
+	for (int i = level; i < ROI_VIEW_NUM_LEVELS && !IsRectEmpty(&visible); i++) {
+		int shift = i - level;
+		for (int y = visible.top >> shift; y <= (visible.bottom - 1) >> shift; y++) {
+			for (int x = visible.left >> shift; x <= (visible.right - 1) >> shift; x++) {
+				roi_view_tile_t* tile = _find(view, i, x, y);
+				if (!tile || tile->state != ROI_VIEW_READY)
+					continue;
+				tile->used = view->paint;
+				num_pixels += _draw_tile(view, hdc, bitmap_hdc, tile, render_view,
+					level, zoom);
+			}
+		}
+	}
+	DeleteDC(bitmap_hdc);
+	_top_up(view);
+	ReleaseSRWLockExclusive(&view->lock);
+	return num_pixels;
+}
+
+uint64_t roi_view_resident_bytes(roi_view_t* view)
+{
+	uint64_t bytes = 0;
+	AcquireSRWLockShared(&view->lock);
+	for (int i = 0; i < view->num_tiles; i++) {
+		if (view->tiles[i].hbitmap)
+			bytes += (uint64_t)ROI_VIEW_TILE_SIZE * ROI_VIEW_TILE_SIZE * 4;
+	}
+	ReleaseSRWLockShared(&view->lock);
+	return bytes;
+}
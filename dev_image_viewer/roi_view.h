@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "render.h"
+#include "roi_source.h"
+
+// Shows an image too large to decode whole, from a roi_source_t, in square
+// tiles of the level the zoom chooses, decoded on the system thread pool
+// as they come into view, nearest the middle of the window first.  Tiles
+// live in a fixed set of slots sized from the screen, the least recently
+// shown reused first, so memory depends on the screen, not the image.  A
+// tile not decoded yet shows a coarser one scaled up, where there is one.
+//
+// Minified tiles are made by reading every 2^(level - 1)th pixel, or for
+// JPEG the reduced image that averages them, and halving that with the
+// same box filter as the canvas's levels, so they are close to, not
+// exactly, what the full image's levels would be.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define ROI_VIEW_TILE_SIZE 256
+
+typedef struct roi_view_t roi_view_t;
+
+// takes the source, which is closed with the view.  each tile decoded posts
+// message to hwnd.
+roi_view_t* roi_view_open(roi_source_t* source, uint32_t bg_color, HWND hwnd,
+	UINT message);
+// waits for decodes in flight
+void roi_view_close(roi_view_t* view);
+
+void roi_view_get_size(const roi_view_t* view, int* out_width, int* out_height);
+
+// draws the tiles decoded for the view, as the canvas would draw its level,
+// excludes what they cover from the clip, and queues the decodes of the
+// rest.  returns the pixels drawn.
+uint64_t roi_view_draw(roi_view_t* view, HDC hdc, const render_view_t* render_view);
+
+// of the tile slots allocated so far
+uint64_t roi_view_resident_bytes(roi_view_t* view);
+
+#ifdef __cplusplus
+}
+#endif
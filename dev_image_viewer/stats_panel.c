@@ -0,0 +1,224 @@
+#include "dev_image_viewer.h"
+
+#include <math.h>
+#include <strsafe.h>
+
+#include "stats_panel.h"
+
+#define STATS_PANEL_WNDLONG_PRIVATE 0
+
+// width of the text beside the histograms
+#define STATS_PANEL_TEXT_WIDTH 330
+#define STATS_PANEL_MARGIN 6
+
+typedef struct {
+	image_stats_t stats;
+	bool have_stats;
+	HFONT hfont;
+} stats_panel_t;
+
+// drawn in this order, alpha underneath
+static const int draw_order[IMAGE_STATS_NUM_CHANNELS] = {
+	IMAGE_STATS_A, IMAGE_STATS_B, IMAGE_STATS_G, IMAGE_STATS_R,
+};
+static const COLORREF channel_colors[IMAGE_STATS_NUM_CHANNELS] = {
+	RGB(255, 80, 80), RGB(80, 220, 80), RGB(90, 140, 255), RGB(150, 150, 150),
+};
+static const WCHAR* const channel_names[IMAGE_STATS_NUM_CHANNELS] = {
+	L"R", L"G", L"B", L"A",
+};
+
+static stats_panel_t* _stats_panel_get_private(HWND hwnd)
+{
+	return (stats_panel_t*)GetWindowLongPtr(hwnd, STATS_PANEL_WNDLONG_PRIVATE);
+}
+
+// each channel's histogram as a polyline, on a log scale shared by all four
+// so their heights compare
+static void _draw_histograms(stats_panel_t* priv, HDC hdc, const RECT* rect)
+{
+	int width = rect->right - rect->left;
+	int height = rect->bottom - rect->top;
+	if (width < 2 || height < 2)
+		return;
+	HBRUSH frame_brush = CreateSolidBrush(RGB(90, 90, 90));
+	RECT frame = *rect;
+	InflateRect(&frame, 1, 1);
+	FrameRect(hdc, &frame, frame_brush);
+	DeleteObject(frame_brush);
+
+	uint64_t max_count = 0;
+	for (int c = 0; c < IMAGE_STATS_NUM_CHANNELS; c++) {
+		for (int v = 0; v < 256; v++)
+			max_count = max(max_count, priv->stats.histogram[c][v]);
+	}
+	if (!max_count)
+		return;
+	double scale = (height - 1) / log1p((double)max_count);
+
+	POINT points[256];
+	for (int i = 0; i < IMAGE_STATS_NUM_CHANNELS; i++) {
+		int c = draw_order[i];
+		for (int v = 0; v < 256; v++) {
+			points[v].x = rect->left + v * (width - 1) / 255;
+			points[v].y = rect->bottom - 1 -
+				(int)(log1p((double)priv->stats.histogram[c][v]) * scale + 0.5);
+		}
+		HPEN pen = CreatePen(PS_SOLID, 1, channel_colors[c]);
+		HGDIOBJ old_pen = SelectObject(hdc, pen);
+		Polyline(hdc, points, 256);
+		SelectObject(hdc, old_pen);
+		DeleteObject(pen);
+	}
+}
+
+static void _draw_text(stats_panel_t* priv, HDC hdc, const RECT* rect)
+{
+	const image_stats_t* stats = &priv->stats;
+	WCHAR text[100];
+	TEXTMETRICW metrics;
+	GetTextMetricsW(hdc, &metrics);
+	int line_height = metrics.tmHeight;
+	int y = rect->top;
+
+	SetTextColor(hdc, RGB(220, 220, 220));
+	if (SUCCEEDED(StringCchPrintfW(text, ARRAYSIZE(text), L"%llu px%s",
+		stats->num_pixels, stats->baked ? L", over the background" : L"")))
+		TextOutW(hdc, rect->left, y, text, (int)wcslen(text));
+	y += line_height;
+	for (int c = 0; c < IMAGE_STATS_NUM_CHANNELS; c++) {
+		SetTextColor(hdc, channel_colors[c]);
+		if (SUCCEEDED(StringCchPrintfW(text, ARRAYSIZE(text),
+			L"%s  min %3d  max %3d  mean %6.2f  sd %6.2f", channel_names[c],
+			stats->min[c], stats->max[c], stats->mean[c], stats->stddev[c])))
+			TextOutW(hdc, rect->left, y, text, (int)wcslen(text));
+		y += line_height;
+	}
+	// 8-bit channels can't hold them
+	SetTextColor(hdc, RGB(220, 220, 220));
+	StringCchCopyW(text, ARRAYSIZE(text), L"NaN 0  Inf 0");
+	TextOutW(hdc, rect->left, y, text, (int)wcslen(text));
+}
+
+static void _stats_panel_paint(HWND hwnd, HDC hdc)
+{
+	stats_panel_t* priv = _stats_panel_get_private(hwnd);
+	RECT client_rect;
+	GetClientRect(hwnd, &client_rect);
+
+	// drawn off screen, so the lines don't flicker over the background
+	HDC mem_dc = CreateCompatibleDC(hdc);
+	HBITMAP mem_bitmap = CreateCompatibleBitmap(hdc, client_rect.right, client_rect.bottom);
+	if (!mem_dc || !mem_bitmap) {
+		if (mem_bitmap)
+			DeleteObject(mem_bitmap);
+		if (mem_dc)
+			DeleteDC(mem_dc);
+		return;
+	}
+	HGDIOBJ old_bitmap = SelectObject(mem_dc, mem_bitmap);
+
+	HBRUSH bg_brush = CreateSolidBrush(RGB(32, 32, 32));
+	FillRect(mem_dc, &client_rect, bg_brush);
+	DeleteObject(bg_brush);
+
+	if (priv->have_stats) {
+		RECT text_rect = client_rect;
+		InflateRect(&text_rect, -STATS_PANEL_MARGIN, -STATS_PANEL_MARGIN);
+		RECT histogram_rect = text_rect;
+		histogram_rect.right -= STATS_PANEL_TEXT_WIDTH;
+		text_rect.left = histogram_rect.right + STATS_PANEL_MARGIN * 2;
+		_draw_histograms(priv, mem_dc, &histogram_rect);
+
+		SetBkMode(mem_dc, TRANSPARENT);
+		HGDIOBJ old_font = NULL;
+		if (priv->hfont)
+			old_font = SelectObject(mem_dc, priv->hfont);
+		_draw_text(priv, mem_dc, &text_rect);
+		if (old_font)
+			SelectObject(mem_dc, old_font);
+	}
+
+	BitBlt(hdc, 0, 0, client_rect.right, client_rect.bottom, mem_dc, 0, 0, SRCCOPY);
+	SelectObject(mem_dc, old_bitmap);
+	DeleteObject(mem_bitmap);
+	DeleteDC(mem_dc);
+}
+
+static LRESULT CALLBACK _stats_panel_wndproc(HWND hwnd, UINT message,
+	WPARAM wParam, LPARAM lParam)
+{
+	switch (message) {
+		case WM_NCCREATE:
+		{
+			stats_panel_t* priv = (stats_panel_t*)calloc(1, sizeof(stats_panel_t));
+			if (!priv)
+				return FALSE;
+			SetWindowLongPtrW(hwnd, STATS_PANEL_WNDLONG_PRIVATE, (LONG_PTR)priv);
+
+			// fixed width, so the columns line up
+			NONCLIENTMETRICSW metrics;
+			metrics.cbSize = sizeof(metrics);
+			if (SystemParametersInfoW(SPI_GETNONCLIENTMETRICS, 0, &metrics, 0)) {
+				LOGFONTW font = metrics.lfMessageFont;
+				font.lfPitchAndFamily = FIXED_PITCH | FF_MODERN;
+				StringCchCopyW(font.lfFaceName, ARRAYSIZE(font.lfFaceName), L"Consolas");
+				priv->hfont = CreateFontIndirectW(&font);
+			}
+			return TRUE;
+		}
+
+		case WM_NCDESTROY:
+		{
+			stats_panel_t* priv = _stats_panel_get_private(hwnd);
+			if (priv) {
+				if (priv->hfont)
+					DeleteObject(priv->hfont);
+				free(priv);
+			}
+			return 0;
+		}
+
+		case WM_PAINT:
+		{
+			PAINTSTRUCT ps;
+			HDC hdc = BeginPaint(hwnd, &ps);
+			_stats_panel_paint(hwnd, hdc);
+			EndPaint(hwnd, &ps);
+		}
+		return 0;
+
+		case WM_ERASEBKGND:
+			return 1;
+	}
+	return DefWindowProcW(hwnd, message, wParam, lParam);
+}
+
+void stats_panel_set_stats(HWND hwnd, const image_stats_t* stats)
+{
+	stats_panel_t* priv = _stats_panel_get_private(hwnd);
+	if (!priv)
+		return;
+	priv->have_stats = stats != NULL;
+	if (stats)
+		priv->stats = *stats;
+	InvalidateRect(hwnd, NULL, FALSE);
+}
+
+ATOM stats_panel_init_class(HINSTANCE hinstance)
+{
+	WNDCLASSW wndclass;
+
+	wndclass.style = CS_HREDRAW | CS_VREDRAW;
+	wndclass.lpfnWndProc = _stats_panel_wndproc;
+	wndclass.cbClsExtra = 0;
+	wndclass.cbWndExtra = sizeof(void*);
+	wndclass.hInstance = hinstance;
+	wndclass.hIcon = NULL;
+	wndclass.hCursor = LoadCursor(NULL, IDC_ARROW);
+	wndclass.hbrBackground = NULL;
+	wndclass.lpszMenuName = NULL;
+	wndclass.lpszClassName = STATS_PANEL_CLASS_NAME;
+
+	return RegisterClassW(&wndclass);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "image_stats.h"
+
+#define STATS_PANEL_CLASS_NAME L"stats_panel"
+
+// height the main window gives the panel, when shown
+#define STATS_PANEL_HEIGHT 150
+
+// Shows the histograms of an image's channels on a log scale, with the
+// min, max, mean and deviation of each beside them.
+
+ATOM stats_panel_init_class(HINSTANCE inst);
+
+// copies stats. NULL clears the panel.
+void stats_panel_set_stats(HWND hwnd, const image_stats_t* stats);
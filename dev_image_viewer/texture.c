@@ -0,0 +1,469 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "texture.h"
+
+// sanity limits, so a corrupt header can't overflow the size arithmetic
+#define TEXTURE_MAX_SIZE 65536
+#define TEXTURE_MAX_LAYERS 65536
+
+// DDS header fields
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDPF_ALPHAPIXELS 0x1
+#define DDPF_FOURCC 0x4
+#define DDPF_RGB 0x40
+#define DDSCAPS2_CUBEMAP 0x200
+#define DDSCAPS2_VOLUME 0x200000
+#define DDS_DIMENSION_TEXTURE3D 4
+#define DDS_MISC_TEXTURECUBE 0x4
+
+#define FOURCC(a, b, c, d) \
+	((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+static const uint8_t ktx1_signature[12] = {
+	0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+static const uint8_t ktx2_signature[12] = {
+	0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+
+struct texture_t {
+	uint8_t* data;
+	size_t size;
+	texture_info_t info;
+	// where each image starts, by [level * num_layers + layer]
+	const uint8_t** images;
+	// only the header is there, for texture_probe()
+	bool header_only;
+};
+
+static uint32_t _u32(const uint8_t* p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint64_t _u64(const uint8_t* p)
+{
+	uint64_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static bool _is_bcn(texture_format_t format)
+{
+	return format >= TEXTURE_BC1 && format <= TEXTURE_BC7;
+}
+
+static size_t _image_bytes(texture_format_t format, int width, int height)
+{
+	if (_is_bcn(format)) {
+		return (size_t)((width + 3) / 4) * ((height + 3) / 4) *
+			bcn_block_bytes((bcn_format_t)format);
+	}
+	return (size_t)width * height * 4;
+}
+
+//
+// formats
+//
+
+static texture_format_t _dds_fourcc_format(uint32_t fourcc)
+{
+	switch (fourcc) {
+	case FOURCC('D', 'X', 'T', '1'): return TEXTURE_BC1;
+	case FOURCC('D', 'X', 'T', '3'): return TEXTURE_BC2;
+	case FOURCC('D', 'X', 'T', '5'): return TEXTURE_BC3;
+	case FOURCC('A', 'T', 'I', '1'):
+	case FOURCC('B', 'C', '4', 'U'): return TEXTURE_BC4;
+	case FOURCC('A', 'T', 'I', '2'):
+	case FOURCC('B', 'C', '5', 'U'): return TEXTURE_BC5;
+	}
+	return 0;
+}
+
+// typeless formats are shown as UNORM, and sRGB ones as they're stored
+static texture_format_t _dxgi_format(uint32_t dxgi)
+{
+	switch (dxgi) {
+	case 70: case 71: case 72: return TEXTURE_BC1;
+	case 73: case 74: case 75: return TEXTURE_BC2;
+	case 76: case 77: case 78: return TEXTURE_BC3;
+	case 79: case 80: return TEXTURE_BC4;
+	case 82: case 83: return TEXTURE_BC5;
+	case 94: case 95: return TEXTURE_BC6H;
+	case 96: return TEXTURE_BC6H_SIGNED;
+	case 97: case 98: case 99: return TEXTURE_BC7;
+	case 27: case 28: case 29: return TEXTURE_RGBA8;
+	case 87: case 90: case 91: return TEXTURE_BGRA8;
+	case 88: case 92: case 93: return TEXTURE_BGRX8;
+	}
+	return 0;
+}
+
+static texture_format_t _dds_mask_format(const uint8_t* pixel_format)
+{
+	uint32_t flags = _u32(pixel_format + 4);
+	uint32_t bit_count = _u32(pixel_format + 12);
+	uint32_t r = _u32(pixel_format + 16);
+	uint32_t g = _u32(pixel_format + 20);
+	uint32_t b = _u32(pixel_format + 24);
+	uint32_t a = _u32(pixel_format + 28);
+	if (bit_count != 32 || g != 0x0000FF00)
+		return 0;
+	bool alpha = (flags & DDPF_ALPHAPIXELS) && a == 0xFF000000;
+	if (r == 0x00FF0000 && b == 0x000000FF)
+		return alpha ? TEXTURE_BGRA8 : TEXTURE_BGRX8;
+	if (r == 0x000000FF && b == 0x00FF0000)
+		return alpha ? TEXTURE_RGBA8 : TEXTURE_RGBX8;
+	return 0;
+}
+
+static texture_format_t _gl_format(uint32_t gl_type, uint32_t gl_format,
+	uint32_t gl_internal_format)
+{
+	if (gl_type == 0x1401) {	// GL_UNSIGNED_BYTE
+		if (gl_format == 0x1908)	// GL_RGBA
+			return TEXTURE_RGBA8;
+		if (gl_format == 0x80E1)	// GL_BGRA
+			return TEXTURE_BGRA8;
+		return 0;
+	}
+	switch (gl_internal_format) {
+	case 0x83F0: case 0x83F1: case 0x8C4C: case 0x8C4D: return TEXTURE_BC1;
+	case 0x83F2: case 0x8C4E: return TEXTURE_BC2;
+	case 0x83F3: case 0x8C4F: return TEXTURE_BC3;
+	case 0x8DBB: return TEXTURE_BC4;
+	case 0x8DBD: return TEXTURE_BC5;
+	case 0x8E8C: case 0x8E8D: return TEXTURE_BC7;
+	case 0x8E8E: return TEXTURE_BC6H_SIGNED;
+	case 0x8E8F: return TEXTURE_BC6H;
+	}
+	return 0;
+}
+
+static texture_format_t _vk_format(uint32_t vk_format)
+{
+	switch (vk_format) {
+	case 131: case 132: case 133: case 134: return TEXTURE_BC1;
+	case 135: case 136: return TEXTURE_BC2;
+	case 137: case 138: return TEXTURE_BC3;
+	case 139: return TEXTURE_BC4;
+	case 141: return TEXTURE_BC5;
+	case 143: return TEXTURE_BC6H;
+	case 144: return TEXTURE_BC6H_SIGNED;
+	case 145: case 146: return TEXTURE_BC7;
+	case 37: case 43: return TEXTURE_RGBA8;
+	case 44: case 50: return TEXTURE_BGRA8;
+	}
+	return 0;
+}
+
+const char* texture_format_name(texture_format_t format)
+{
+	switch (format) {
+	case TEXTURE_BC1: return "BC1";
+	case TEXTURE_BC2: return "BC2";
+	case TEXTURE_BC3: return "BC3";
+	case TEXTURE_BC4: return "BC4";
+	case TEXTURE_BC5: return "BC5";
+	case TEXTURE_BC6H: return "BC6H";
+	case TEXTURE_BC6H_SIGNED: return "BC6H signed";
+	case TEXTURE_BC7: return "BC7";
+	case TEXTURE_RGBA8: return "RGBA8";
+	case TEXTURE_RGBX8: return "RGBX8";
+	case TEXTURE_BGRA8: return "BGRA8";
+	case TEXTURE_BGRX8: return "BGRX8";
+	}
+	return "unknown";
+}
+
+//
+// containers
+//
+
+// checks the header's numbers and allocates the image index. levels past
+// 1x1 are ignored.
+static bool _init_info(texture_t* texture, texture_format_t format,
+	uint32_t width, uint32_t height, uint32_t num_levels, uint32_t num_layers,
+	uint32_t num_faces)
+{
+	if (!format || !width || !height || width > TEXTURE_MAX_SIZE ||
+		height > TEXTURE_MAX_SIZE || !num_layers || num_layers > TEXTURE_MAX_LAYERS)
+		return false;
+	int max_levels = 1;
+	while ((width | height) >> max_levels)
+		max_levels++;
+	if (!num_levels || num_levels > (uint32_t)max_levels)
+		num_levels = num_levels ? max_levels : 1;
+
+	texture_info_t* info = &texture->info;
+	info->format = format;
+	info->width = (int)width;
+	info->height = (int)height;
+	info->num_levels = (int)num_levels;
+	info->num_layers = (int)(num_layers * num_faces);
+	info->num_faces = (int)num_faces;
+	if (texture->header_only)
+		return true;
+	texture->images = (const uint8_t**)calloc((size_t)info->num_levels * info->num_layers,
+		sizeof(const uint8_t*));
+	return texture->images != NULL;
+}
+
+// records where an image starts, if all of it is in the file
+static bool _set_image(texture_t* texture, int level, int layer, uint64_t offset)
+{
+	if (texture->header_only)
+		return true;
+	int width, height;
+	texture_level_size(texture, level, &width, &height);
+	size_t bytes = _image_bytes(texture->info.format, width, height);
+	if (offset > texture->size || bytes > texture->size - offset)
+		return false;
+	texture->images[(size_t)level * texture->info.num_layers + layer] =
+		texture->data + offset;
+	return true;
+}
+
+static size_t _level_bytes(texture_t* texture, int level)
+{
+	int width, height;
+	texture_level_size(texture, level, &width, &height);
+	return _image_bytes(texture->info.format, width, height);
+}
+
+// each layer has its whole mip chain before the next
+static bool _parse_dds(texture_t* texture)
+{
+	const uint8_t* p = texture->data;
+	if (texture->size < 128 || _u32(p + 4) != 124)
+		return false;
+	uint32_t flags = _u32(p + 8);
+	uint32_t height = _u32(p + 12);
+	uint32_t width = _u32(p + 16);
+	uint32_t num_levels = (flags & DDSD_MIPMAPCOUNT) ? _u32(p + 28) : 1;
+	const uint8_t* pixel_format = p + 76;
+	uint32_t pixel_flags = _u32(pixel_format + 4);
+	uint32_t caps2 = _u32(p + 112);
+	if (caps2 & DDSCAPS2_VOLUME)
+		return false;
+
+	uint64_t offset = 128;
+	uint32_t num_arrays = 1;
+	uint32_t num_faces = (caps2 & DDSCAPS2_CUBEMAP) ? 6 : 1;
+	texture_format_t format = 0;
+	if ((pixel_flags & DDPF_FOURCC) && _u32(pixel_format + 8) == FOURCC('D', 'X', '1', '0')) {
+		if (texture->size < 148 || _u32(p + 132) == DDS_DIMENSION_TEXTURE3D)
+			return false;
+		format = _dxgi_format(_u32(p + 128));
+		num_faces = (_u32(p + 136) & DDS_MISC_TEXTURECUBE) ? 6 : 1;
+		num_arrays = _u32(p + 140) ? _u32(p + 140) : 1;
+		offset = 148;
+	}
+	else if (pixel_flags & DDPF_FOURCC) {
+		format = _dds_fourcc_format(_u32(pixel_format + 8));
+	}
+	else if (pixel_flags & DDPF_RGB) {
+		format = _dds_mask_format(pixel_format);
+	}
+	if (!_init_info(texture, format, width, height, num_levels, num_arrays, num_faces))
+		return false;
+
+	const texture_info_t* info = &texture->info;
+	for (int layer = 0; layer < info->num_layers; layer++) {
+		for (int level = 0; level < info->num_levels; level++) {
+			if (!_set_image(texture, level, layer, offset))
+				return false;
+			offset += _level_bytes(texture, level);
+		}
+	}
+	return true;
+}
+
+// each level has all its layers before the next. none of the supported
+// formats need the padding KTX puts between images.
+static bool _parse_ktx1(texture_t* texture)
+{
+	const uint8_t* p = texture->data;
+	if (texture->size < 64 || _u32(p + 12) != 0x04030201 || _u32(p + 44) > 1)
+		return false;
+	texture_format_t format = _gl_format(_u32(p + 16), _u32(p + 24), _u32(p + 28));
+	uint32_t width = _u32(p + 36);
+	uint32_t height = _u32(p + 40) ? _u32(p + 40) : 1;
+	uint32_t num_arrays = _u32(p + 48) ? _u32(p + 48) : 1;
+	uint32_t num_faces = _u32(p + 52) == 6 ? 6 : 1;
+	if (!_init_info(texture, format, width, height, _u32(p + 56), num_arrays, num_faces))
+		return false;
+
+	const texture_info_t* info = &texture->info;
+	uint64_t offset = 64 + (uint64_t)_u32(p + 60);
+	for (int level = 0; level < info->num_levels; level++) {
+		// each level starts with its size, which is implied by the format
+		offset += 4;
+		size_t bytes = _level_bytes(texture, level);
+		for (int layer = 0; layer < info->num_layers; layer++) {
+			if (!_set_image(texture, level, layer, offset))
+				return false;
+			offset += bytes;
+		}
+	}
+	return true;
+}
+
+// levels are found through an index, and have their layers in order
+static bool _parse_ktx2(texture_t* texture)
+{
+	const uint8_t* p = texture->data;
+	if (texture->size < 80 || _u32(p + 28) > 1 || _u32(p + 44) != 0)
+		return false;
+	texture_format_t format = _vk_format(_u32(p + 12));
+	uint32_t width = _u32(p + 20);
+	uint32_t height = _u32(p + 24) ? _u32(p + 24) : 1;
+	uint32_t num_arrays = _u32(p + 32) ? _u32(p + 32) : 1;
+	uint32_t num_faces = _u32(p + 36) == 6 ? 6 : 1;
+	if (!_init_info(texture, format, width, height, _u32(p + 40), num_arrays, num_faces))
+		return false;
+
+	const texture_info_t* info = &texture->info;
+	if (texture->size < 80 + (size_t)24 * info->num_levels)
+		return false;
+	for (int level = 0; level < info->num_levels; level++) {
+		uint64_t offset = _u64(p + 80 + 24 * level);
+		size_t bytes = _level_bytes(texture, level);
+		for (int layer = 0; layer < info->num_layers; layer++) {
+			if (!_set_image(texture, level, layer, offset))
+				return false;
+			offset += bytes;
+		}
+	}
+	return true;
+}
+
+static bool _parse(texture_t* texture)
+{
+	if (!memcmp(texture->data, "DDS ", 4))
+		return _parse_dds(texture);
+	if (!memcmp(texture->data, ktx1_signature, 12))
+		return _parse_ktx1(texture);
+	return _parse_ktx2(texture);
+}
+
+bool texture_is_texture(const void* header, size_t size)
+{
+	if (size < 12)
+		return false;
+	return !memcmp(header, "DDS ", 4) ||
+		!memcmp(header, ktx1_signature, 12) ||
+		!memcmp(header, ktx2_signature, 12);
+}
+
+texture_t* texture_parse(void* data, size_t size)
+{
+	texture_t* texture = NULL;
+	if (texture_is_texture(data, size))
+		texture = (texture_t*)calloc(1, sizeof(texture_t));
+	if (!texture) {
+		free(data);
+		return NULL;
+	}
+	texture->data = (uint8_t*)data;
+	texture->size = size;
+	if (!_parse(texture)) {
+		texture_free(texture);
+		return NULL;
+	}
+	return texture;
+}
+
+bool texture_probe(const void* header, size_t size, texture_info_t* out_info)
+{
+	// parsed as a texture without its images, which is only read
+	texture_t texture;
+	memset(&texture, 0, sizeof(texture));
+	texture.data = (uint8_t*)header;
+	texture.size = size;
+	texture.header_only = true;
+	if (!texture_is_texture(header, size) || !_parse(&texture))
+		return false;
+	*out_info = texture.info;
+	return true;
+}
+
+void texture_free(texture_t* texture)
+{
+	if (!texture)
+		return;
+	free(texture->images);
+	free(texture->data);
+	free(texture);
+}
+
+const texture_info_t* texture_get_info(const texture_t* texture)
+{
+	return &texture->info;
+}
+
+void texture_level_size(const texture_t* texture, int level, int* out_width,
+	int* out_height)
+{
+	int width = texture->info.width >> level;
+	int height = texture->info.height >> level;
+	*out_width = width ? width : 1;
+	*out_height = height ? height : 1;
+}
+
+int texture_level_bands(const texture_t* texture, int level)
+{
+	int width, height;
+	texture_level_size(texture, level, &width, &height);
+	return (height + 3) / 4;
+}
+
+static uint32_t _premultiply(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+{
+	r = r * a + 128;
+	g = g * a + 128;
+	b = b * a + 128;
+	r = (r + (r >> 8)) >> 8;
+	g = (g + (g >> 8)) >> 8;
+	b = (b + (b >> 8)) >> 8;
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+void texture_decode_bands(const texture_t* texture, int layer, int level,
+	int band0, int band1, uint32_t* dest)
+{
+	texture_format_t format = texture->info.format;
+	const uint8_t* image = texture->images[(size_t)level * texture->info.num_layers + layer];
+	int width, height;
+	texture_level_size(texture, level, &width, &height);
+	if (_is_bcn(format)) {
+		bcn_decode_sse2((bcn_format_t)format, image, width, height, band0, band1,
+			dest, width);
+		return;
+	}
+
+	int y1 = 4 * band1 < height ? 4 * band1 : height;
+	for (int y = 4 * band0; y < y1; y++) {
+		const uint8_t* p = image + (size_t)y * width * 4;
+		uint32_t* out = dest + (size_t)y * width;
+		for (int x = 0; x < width; x++, p += 4) {
+			switch (format) {
+			case TEXTURE_RGBA8:
+				out[x] = _premultiply(p[0], p[1], p[2], p[3]);
+				break;
+			case TEXTURE_RGBX8:
+				out[x] = _premultiply(p[0], p[1], p[2], 255);
+				break;
+			case TEXTURE_BGRA8:
+				out[x] = _premultiply(p[2], p[1], p[0], p[3]);
+				break;
+			default:
+				out[x] = _premultiply(p[2], p[1], p[0], 255);
+				break;
+			}
+		}
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bcn.h"
+
+// GPU texture files, which GDI+ can't read: DDS, KTX and KTX2, holding BC1
+// to BC7 blocks or plain 8-bit RGBA, with their mip chains, array layers
+// and cube faces.  Parsing only indexes the images in the file; decoding
+// is done a band of 4 rows at a time, so the caller can spread the bands
+// over threads.  Volume textures, supercompressed KTX2 and SNORM formats
+// aren't supported.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	TEXTURE_BC1 = BCN_BC1,
+	TEXTURE_BC2 = BCN_BC2,
+	TEXTURE_BC3 = BCN_BC3,
+	TEXTURE_BC4 = BCN_BC4,
+	TEXTURE_BC5 = BCN_BC5,
+	TEXTURE_BC6H = BCN_BC6H,
+	TEXTURE_BC6H_SIGNED = BCN_BC6H_SIGNED,
+	TEXTURE_BC7 = BCN_BC7,
+	TEXTURE_RGBA8 = 16,
+	TEXTURE_RGBX8,
+	TEXTURE_BGRA8,
+	TEXTURE_BGRX8,
+} texture_format_t;
+
+typedef struct texture_t texture_t;
+
+typedef struct {
+	texture_format_t format;
+	int width;
+	int height;
+	int num_levels;
+	// array elements times faces. a cubemap array's faces are together,
+	// in the order +X, -X, +Y, -Y, +Z, -Z.
+	int num_layers;
+	int num_faces;		// 1, or 6 for cubemaps
+} texture_info_t;
+
+// whether the first bytes of a file are a texture's signature. needs 12.
+bool texture_is_texture(const void* header, size_t size);
+// takes ownership of data, which must be from malloc(), and frees it on
+// failure. NULL if the file is corrupt or its format isn't supported.
+texture_t* texture_parse(void* data, size_t size);
+// the info from the header alone, which is in the first 4 KB
+bool texture_probe(const void* header, size_t size, texture_info_t* out_info);
+void texture_free(texture_t* texture);
+
+const texture_info_t* texture_get_info(const texture_t* texture);
+// "BC7", "RGBA8" and so on
+const char* texture_format_name(texture_format_t format);
+// each level halves, rounding down, to at least 1
+void texture_level_size(const texture_t* texture, int level, int* out_width,
+	int* out_height);
+// rows of 4 pixels, the last one maybe partial
+int texture_level_bands(const texture_t* texture, int level);
+
+// decodes bands [band0, band1) of an image into dest, which is the whole
+// level, top-down 32bpp premultiplied BGRA.  safe to call from several
+// threads at once.
+void texture_decode_bands(const texture_t* texture, int layer, int level,
+	int band0, int band1, uint32_t* dest);
+
+#ifdef __cplusplus
+}
+#endif
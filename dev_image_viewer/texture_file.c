@@ -0,0 +1,98 @@
+#include "dev_image_viewer.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gdiplus_loader.h"
+#include "parallel.h"
+#include "texture_file.h"
+#include "trace.h"
+
+// bands of 4 rows per parallel_for() item
+#define TEXTURE_FILE_BANDS_PER_ITEM 16
+
+typedef struct {
+	const texture_t* texture;
+	int layer;
+	int level;
+	int num_bands;
+	uint32_t* pixels;
+} texture_job_t;
+
+texture_t* texture_file_open(const WCHAR* path)
+{
+	HANDLE file = CreateFileW(path, GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	uint8_t header[12];
+	DWORD bytes_read = 0;
+	LARGE_INTEGER size;
+	void* data = NULL;
+	bool ok = ReadFile(file, header, sizeof(header), &bytes_read, NULL) &&
+		texture_is_texture(header, bytes_read) &&
+		GetFileSizeEx(file, &size) && size.QuadPart < MAXDWORD &&
+		(data = malloc((size_t)size.QuadPart)) != NULL;
+	if (ok) {
+		memcpy(data, header, sizeof(header));
+		DWORD rest = (DWORD)size.QuadPart - sizeof(header);
+		ok = ReadFile(file, (uint8_t*)data + sizeof(header), rest, &bytes_read, NULL) &&
+			bytes_read == rest;
+	}
+	CloseHandle(file);
+	if (!ok) {
+		free(data);
+		return NULL;
+	}
+	return texture_parse(data, (size_t)size.QuadPart);
+}
+
+static void _decode_item(void* ctx, int index)
+{
+	texture_job_t* job = (texture_job_t*)ctx;
+	int band0 = index * TEXTURE_FILE_BANDS_PER_ITEM;
+	int band1 = min(band0 + TEXTURE_FILE_BANDS_PER_ITEM, job->num_bands);
+	texture_decode_bands(job->texture, job->layer, job->level, band0, band1,
+		job->pixels);
+}
+
+bool texture_file_read(const texture_t* texture, int layer, int level,
+	HBITMAP* out_hbitmap, void** out_bits, int* out_width, int* out_height)
+{
+	const texture_info_t* info = texture_get_info(texture);
+	if (layer < 0 || layer >= info->num_layers || level < 0 || level >= info->num_levels)
+		return false;
+
+	int width, height;
+	texture_level_size(texture, level, &width, &height);
+	BITMAPV5HEADER bmi;
+	init_bitmap_header(&bmi, width, height);
+
+	HDC hdc = GetDC(NULL);
+	void* bits = NULL;
+	HBITMAP hbitmap = CreateDIBSection(hdc, (BITMAPINFO*)&bmi, DIB_RGB_COLORS,
+		&bits, NULL, 0);
+	ReleaseDC(NULL, hdc);
+	if (!hbitmap)
+		return false;
+
+	uint64_t start = trace_begin();
+	texture_job_t job;
+	job.texture = texture;
+	job.layer = layer;
+	job.level = level;
+	job.num_bands = texture_level_bands(texture, level);
+	job.pixels = (uint32_t*)bits;
+	parallel_for((job.num_bands + TEXTURE_FILE_BANDS_PER_ITEM - 1) / TEXTURE_FILE_BANDS_PER_ITEM,
+		_decode_item, &job);
+	uint64_t num_pixels = (uint64_t)width * height;
+	trace_end(TRACE_DECODE, start, num_pixels * 4, num_pixels);
+
+	*out_hbitmap = hbitmap;
+	*out_bits = bits;
+	*out_width = width;
+	*out_height = height;
+	return true;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+
+#include "texture.h"
+
+// Reads DDS and KTX files (see texture.h) into DIB sections for the
+// canvas.  A level is decoded a few bands per item over parallel_for(),
+// since blocks decode independently.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// NULL if the file isn't a texture, or one that can't be read. only the
+// signature is read from files that aren't.
+texture_t* texture_file_open(const WCHAR* path);
+
+// an image of the texture as canvas_read_image() returns one: a new
+// top-down 32bpp premultiplied DIB section.  safe on any thread.
+bool texture_file_read(const texture_t* texture, int layer, int level,
+	HBITMAP* out_hbitmap, void** out_bits, int* out_width, int* out_height);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,672 @@
+#include "dev_image_viewer.h"
+
+#include <stdlib.h>
+#include <strsafe.h>
+
+#include "cache_dir.h"
+#include "thumb_cache.h"
+
+#define THUMB_CACHE_MAGIC 0x48545644	// "DVTH"
+#define THUMB_CACHE_RECORD_MAGIC 0x52545644	// "DVTR"
+#define THUMB_CACHE_VERSION 1
+
+// slots in a new file's table, which doubles when three quarters full
+#define THUMB_CACHE_MIN_SLOTS 4096
+// the table follows the header. records follow the table, from the next
+// page, at this alignment, which their offsets are stored in units of.
+#define THUMB_CACHE_TABLE_OFFSET 64
+#define THUMB_CACHE_PAGE 4096
+#define THUMB_CACHE_ALIGN 16
+// the file grows by at least this much, or doubles
+#define THUMB_CACHE_MIN_GROWTH (4 * 1024 * 1024)
+
+// at the start of the file, shared by every viewer mapping it. only
+// written with the mutex held.
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t table_size;	// slots, a power of two
+	volatile LONG superseded;	// replaced by a compacted file, to reopen
+	volatile LONG64 end;	// where the next record goes
+	volatile LONG64 capacity;	// of the file
+	volatile LONG64 dead_bytes;	// in records since replaced
+	volatile LONG num_records;	// slots in use
+	uint32_t reserved;
+} thumb_cache_header_t;
+
+// followed by the pixels, top-down 32bpp
+typedef struct {
+	uint32_t magic;
+	uint32_t size;	// with the pixels, aligned
+	uint64_t key;
+	uint64_t file_size;
+	FILETIME write_time;
+	uint64_t checksum;	// of the pixels, seeded with key
+	int32_t width;
+	int32_t height;
+	int32_t image_width;
+	int32_t image_height;
+	uint32_t reduced;
+	uint32_t reserved;
+} thumb_cache_record_t;
+
+// a mapping of a cache file. views are only added, as the file grows or
+// is replaced, and all freed on close, so a reader holding one is never
+// left with it unmapped.
+typedef struct thumb_cache_view_t {
+	HANDLE file;	// closed with the view that opened it
+	bool owns_file;
+	HANDLE section;
+	BYTE* base;
+	uint64_t size;
+	uint32_t generation;	// of the file's name
+	struct thumb_cache_view_t* older;
+} thumb_cache_view_t;
+
+struct thumb_cache_t {
+	// names the folder's files, with a generation each compaction moves on
+	uint64_t dir_hash;
+	// across processes, for writes to the file
+	HANDLE mutex;
+	// only to map the file again, never to read it
+	SRWLOCK remap_lock;
+	thumb_cache_view_t* volatile view;
+	// with the mutex held. the table fills past three quarters instead of
+	// retrying on every store.
+	bool compact_failed;
+};
+
+// empty while the cache is off
+static WCHAR cache_dir[MAX_PATH] = L"";
+
+static uint64_t _align_up(uint64_t value, uint64_t align)
+{
+	return (value + align - 1) & ~(align - 1);
+}
+
+static uint64_t _records_start(uint32_t table_size)
+{
+	return _align_up(THUMB_CACHE_TABLE_OFFSET + (uint64_t)table_size * sizeof(LONG64),
+		THUMB_CACHE_PAGE);
+}
+
+// a thumbnail of another size or background is another entry
+static uint64_t _key(const WCHAR* path, int max_size, uint32_t bg_color)
+{
+	return cache_dir_path_hash(path, ((uint64_t)max_size << 32) | bg_color);
+}
+
+// the top half of the key, beside the record's offset, so most probes
+// don't touch the records
+static LONG64 _slot(uint64_t key, uint64_t offset)
+{
+	return (LONG64)((key & 0xFFFFFFFF00000000ULL) | (offset / THUMB_CACHE_ALIGN));
+}
+
+static uint64_t _slot_offset(LONG64 slot)
+{
+	return ((uint64_t)slot & 0xFFFFFFFF) * THUMB_CACHE_ALIGN;
+}
+
+static bool _slot_matches(LONG64 slot, uint64_t key)
+{
+	return ((uint64_t)slot >> 32) == (key >> 32);
+}
+
+static thumb_cache_header_t* _header(const thumb_cache_view_t* view)
+{
+	return (thumb_cache_header_t*)view->base;
+}
+
+static volatile LONG64* _table(const thumb_cache_view_t* view)
+{
+	return (volatile LONG64*)(view->base + THUMB_CACHE_TABLE_OFFSET);
+}
+
+static bool _write_at(HANDLE file, uint64_t offset, const void* data, DWORD size)
+{
+	LARGE_INTEGER position;
+	position.QuadPart = (LONGLONG)offset;
+	DWORD written = 0;
+	return SetFilePointerEx(file, position, NULL, FILE_BEGIN) &&
+		WriteFile(file, data, size, &written, NULL) && written == size;
+}
+
+static void _lock(thumb_cache_t* cache)
+{
+	// abandoned by a viewer that crashed mid-write, which at worst left a
+	// record no slot points to
+	WaitForSingleObject(cache->mutex, INFINITE);
+}
+
+static void _unlock(thumb_cache_t* cache)
+{
+	ReleaseMutex(cache->mutex);
+}
+
+bool thumb_cache_enable(const WCHAR* dir)
+{
+	WCHAR path[MAX_PATH];
+	if (!cache_dir_create(dir, L"thumbs", path))
+		return false;
+	StringCchCopyW(cache_dir, MAX_PATH, path);
+	return true;
+}
+
+bool thumb_cache_enabled()
+{
+	return cache_dir[0] != 0;
+}
+
+static bool _file_path(const thumb_cache_t* cache, uint32_t generation, WCHAR* out)
+{
+	return SUCCEEDED(StringCchPrintfW(out, MAX_PATH, L"%s\\%016llx.%08x.thc",
+		cache_dir, (unsigned long long)cache->dir_hash, generation));
+}
+
+// the newest generation of the folder's file, or false if there's none.
+// deletes those before delete_below, unless a viewer still maps them.
+static bool _scan_generations(const thumb_cache_t* cache, uint32_t delete_below,
+	uint32_t* out_newest)
+{
+	WCHAR pattern[MAX_PATH];
+	if (FAILED(StringCchPrintfW(pattern, MAX_PATH, L"%s\\%016llx.*.thc",
+		cache_dir, (unsigned long long)cache->dir_hash)))
+		return false;
+	WIN32_FIND_DATAW find_data;
+	HANDLE find = FindFirstFileW(pattern, &find_data);
+	if (find == INVALID_HANDLE_VALUE)
+		return false;
+	bool found = false;
+	do {
+		// the hash, a dot, 8 hex digits, then ".thc"
+		const WCHAR* name = find_data.cFileName;
+		if (wcslen(name) != 29 || name[16] != L'.')
+			continue;
+		WCHAR* end = NULL;
+		uint32_t generation = (uint32_t)wcstoul(name + 17, &end, 16);
+		if (end != name + 25 || _wcsicmp(end, L".thc"))
+			continue;
+		if (generation < delete_below) {
+			WCHAR path[MAX_PATH];
+			if (_file_path(cache, generation, path))
+				DeleteFileW(path);
+			continue;
+		}
+		if (!found || generation > *out_newest)
+			*out_newest = generation;
+		found = true;
+	} while (FindNextFileW(find, &find_data));
+	FindClose(find);
+	return found;
+}
+
+static bool _header_valid(const thumb_cache_header_t* header, uint64_t file_size)
+{
+	return header->magic == THUMB_CACHE_MAGIC &&
+		header->version == THUMB_CACHE_VERSION &&
+		header->table_size >= THUMB_CACHE_MIN_SLOTS &&
+		!(header->table_size & (header->table_size - 1)) &&
+		!header->superseded &&
+		(uint64_t)header->end >= _records_start(header->table_size) &&
+		header->end <= header->capacity &&
+		(uint64_t)header->capacity <= file_size &&
+		(uint64_t)header->capacity / THUMB_CACHE_ALIGN <= 0xFFFFFFFF;
+}
+
+// maps the file at size, growing it if it's smaller
+static thumb_cache_view_t* _map(HANDLE file, bool owns_file, uint64_t size)
+{
+	thumb_cache_view_t* view = (thumb_cache_view_t*)calloc(1, sizeof(thumb_cache_view_t));
+	if (!view)
+		return NULL;
+	view->section = CreateFileMappingW(file, NULL, PAGE_READWRITE,
+		(DWORD)(size >> 32), (DWORD)size, NULL);
+	if (view->section)
+		view->base = (BYTE*)MapViewOfFile(view->section, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+	if (!view->base) {
+		if (view->section)
+			CloseHandle(view->section);
+		free(view);
+		return NULL;
+	}
+	view->file = file;
+	view->owns_file = owns_file;
+	view->size = size;
+	return view;
+}
+
+static void _free_views(thumb_cache_view_t* view)
+{
+	while (view) {
+		thumb_cache_view_t* older = view->older;
+		UnmapViewOfFile(view->base);
+		CloseHandle(view->section);
+		if (view->owns_file)
+			CloseHandle(view->file);
+		free(view);
+		view = older;
+	}
+}
+
+// with remap_lock held. a larger view of a replaced file goes behind the
+// newest.
+static void _add_view(thumb_cache_t* cache, thumb_cache_view_t* view, bool newest)
+{
+	if (!newest) {
+		view->older = cache->view->older;
+		cache->view->older = view;
+		return;
+	}
+	view->older = cache->view;
+	InterlockedExchangePointer((PVOID volatile*)&cache->view, view);
+}
+
+// opens the newest generation of the folder's file. with create, and the
+// mutex held, starts it afresh if it isn't a valid cache.
+static thumb_cache_view_t* _open_file(thumb_cache_t* cache, bool create)
+{
+	uint32_t generation = 0;
+	_scan_generations(cache, 0, &generation);
+	WCHAR path[MAX_PATH];
+	if (!_file_path(cache, generation, path))
+		return NULL;
+	HANDLE file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		create ? OPEN_ALWAYS : OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	thumb_cache_header_t header;
+	DWORD bytes_read = 0;
+	LARGE_INTEGER file_size;
+	if (!ReadFile(file, &header, sizeof(header), &bytes_read, NULL) ||
+		bytes_read != sizeof(header) ||
+		!GetFileSizeEx(file, &file_size) ||
+		!_header_valid(&header, (uint64_t)file_size.QuadPart)) {
+		if (!create) {
+			CloseHandle(file);
+			return NULL;
+		}
+		// new, or damaged. the table must start empty.
+		ZeroMemory(&header, sizeof(header));
+		header.magic = THUMB_CACHE_MAGIC;
+		header.version = THUMB_CACHE_VERSION;
+		header.table_size = THUMB_CACHE_MIN_SLOTS;
+		header.end = _records_start(THUMB_CACHE_MIN_SLOTS);
+		header.capacity = header.end + THUMB_CACHE_MIN_GROWTH;
+		void* zeros = calloc(THUMB_CACHE_MIN_SLOTS, sizeof(LONG64));
+		bool ok = zeros &&
+			_write_at(file, THUMB_CACHE_TABLE_OFFSET, zeros, THUMB_CACHE_MIN_SLOTS * sizeof(LONG64)) &&
+			_write_at(file, 0, &header, sizeof(header));
+		free(zeros);
+		if (!ok) {
+			CloseHandle(file);
+			return NULL;
+		}
+		cache_dir_trim(cache_dir, L"thc", THUMB_CACHE_MAX_BYTES);
+	}
+
+	// the write time orders the files for cache_dir_trim()
+	FILETIME now;
+	GetSystemTimeAsFileTime(&now);
+	SetFileTime(file, NULL, NULL, &now);
+
+	thumb_cache_view_t* view = _map(file, true, (uint64_t)header.capacity);
+	if (!view)
+		CloseHandle(file);
+	else
+		view->generation = generation;
+	return view;
+}
+
+// writes the live records to the next generation's file, with a table of
+// table_size slots.  the old file stays mapped by every viewer, so it
+// can't be replaced; they see it marked superseded, and reopen, and it's
+// deleted once none maps it.  with the mutex held.
+static bool _compact(thumb_cache_t* cache, uint32_t table_size)
+{
+	thumb_cache_view_t* view = cache->view;
+	thumb_cache_header_t* header = _header(view);
+	const volatile LONG64* old_table = _table(view);
+	uint64_t records_start = _records_start(table_size);
+
+	uint32_t generation = view->generation;
+	_scan_generations(cache, 0, &generation);
+	WCHAR path[MAX_PATH];
+	WCHAR temp_path[MAX_PATH];
+	if (!_file_path(cache, generation + 1, path) ||
+		!GetTempFileNameW(cache_dir, L"thc", 0, temp_path))
+		return false;
+	LONG64* table = (LONG64*)calloc(table_size, sizeof(LONG64));
+	HANDLE file = CreateFileW(temp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	bool ok = table && file != INVALID_HANDLE_VALUE;
+
+	uint64_t end = records_start;
+	LONG num_records = 0;
+	for (uint32_t i = 0; ok && i < header->table_size; i++) {
+		LONG64 slot = old_table[i];
+		if (!slot)
+			continue;
+		const thumb_cache_record_t* record =
+			(const thumb_cache_record_t*)(view->base + _slot_offset(slot));
+		if (record->magic != THUMB_CACHE_RECORD_MAGIC ||
+			record->size < sizeof(thumb_cache_record_t) ||
+			_slot_offset(slot) + record->size > (uint64_t)header->end)
+			continue;
+		ok = _write_at(file, end, record, record->size);
+		uint32_t mask = table_size - 1;
+		uint32_t index = (uint32_t)record->key & mask;
+		while (table[index])
+			index = (index + 1) & mask;
+		table[index] = _slot(record->key, end);
+		end += record->size;
+		num_records++;
+	}
+
+	thumb_cache_header_t new_header;
+	ZeroMemory(&new_header, sizeof(new_header));
+	new_header.magic = THUMB_CACHE_MAGIC;
+	new_header.version = THUMB_CACHE_VERSION;
+	new_header.table_size = table_size;
+	new_header.end = end;
+	new_header.capacity = end + THUMB_CACHE_MIN_GROWTH;
+	new_header.num_records = num_records;
+	LARGE_INTEGER capacity;
+	capacity.QuadPart = new_header.capacity;
+	ok = ok && new_header.capacity / THUMB_CACHE_ALIGN <= 0xFFFFFFFF &&
+		_write_at(file, THUMB_CACHE_TABLE_OFFSET, table, table_size * sizeof(LONG64)) &&
+		_write_at(file, 0, &new_header, sizeof(new_header)) &&
+		SetFilePointerEx(file, capacity, NULL, FILE_BEGIN) && SetEndOfFile(file);
+	free(table);
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	// written aside and renamed, so a crash never leaves a half file
+	// under a real name
+	if (ok)
+		ok = MoveFileExW(temp_path, path, MOVEFILE_REPLACE_EXISTING) != 0;
+	if (!ok) {
+		DeleteFileW(temp_path);
+		return false;
+	}
+	InterlockedExchange(&header->superseded, 1);
+	return true;
+}
+
+// the newest view, remapped if another viewer grew or replaced the file
+static thumb_cache_view_t* _latest(thumb_cache_t* cache)
+{
+	thumb_cache_view_t* view = cache->view;
+	if (!_header(view)->superseded && view->size >= (uint64_t)_header(view)->capacity)
+		return view;
+
+	AcquireSRWLockExclusive(&cache->remap_lock);
+	view = cache->view;
+	thumb_cache_view_t* newer = NULL;
+	if (_header(view)->superseded)
+		newer = _open_file(cache, false);
+	else if (view->size < (uint64_t)_header(view)->capacity)
+		newer = _map(view->file, false, (uint64_t)_header(view)->capacity);
+	if (newer) {
+		_add_view(cache, newer, true);
+		view = newer;
+	}
+	ReleaseSRWLockExclusive(&cache->remap_lock);
+	return view;
+}
+
+// a view of the same file as view, of at least size bytes, or NULL. a
+// replaced file stays mapped, so its records can still be read.
+static thumb_cache_view_t* _at_least(thumb_cache_t* cache, thumb_cache_view_t* view,
+	uint64_t size)
+{
+	if (view->size >= size)
+		return view;
+	AcquireSRWLockExclusive(&cache->remap_lock);
+	thumb_cache_view_t* found = NULL;
+	for (thumb_cache_view_t* other = cache->view; other && !found; other = other->older) {
+		if (other->file == view->file && other->size >= size)
+			found = other;
+	}
+	uint64_t capacity = (uint64_t)_header(view)->capacity;
+	if (!found && capacity >= size) {
+		found = _map(view->file, false, capacity);
+		if (found)
+			_add_view(cache, found, view->file == cache->view->file);
+	}
+	ReleaseSRWLockExclusive(&cache->remap_lock);
+	return found;
+}
+
+thumb_cache_t* thumb_cache_open(const WCHAR* dir_path)
+{
+	if (!thumb_cache_enabled())
+		return NULL;
+	thumb_cache_t* cache = (thumb_cache_t*)calloc(1, sizeof(thumb_cache_t));
+	if (!cache)
+		return NULL;
+	cache->dir_hash = cache_dir_path_hash(dir_path, 0);
+	WCHAR mutex_name[64];
+	if (FAILED(StringCchPrintfW(mutex_name, ARRAYSIZE(mutex_name),
+		L"Local\\dev_image_viewer_thumbs_%016llx", (unsigned long long)cache->dir_hash))) {
+		free(cache);
+		return NULL;
+	}
+	cache->mutex = CreateMutexW(NULL, FALSE, mutex_name);
+	if (!cache->mutex) {
+		free(cache);
+		return NULL;
+	}
+	InitializeSRWLock(&cache->remap_lock);
+
+	_lock(cache);
+	cache->view = _open_file(cache, true);
+	if (cache->view) {
+		thumb_cache_header_t* header = _header(cache->view);
+		uint64_t used = header->end - _records_start(header->table_size);
+		if ((uint64_t)header->dead_bytes * 2 > used &&
+			header->dead_bytes > THUMB_CACHE_MIN_GROWTH &&
+			_compact(cache, header->table_size)) {
+			// nothing has read the old file through this cache yet
+			thumb_cache_view_t* compacted = _open_file(cache, false);
+			if (compacted) {
+				_free_views(cache->view);
+				cache->view = compacted;
+			}
+		}
+		uint32_t newest;
+		_scan_generations(cache, cache->view->generation, &newest);
+	}
+	_unlock(cache);
+
+	if (!cache->view) {
+		CloseHandle(cache->mutex);
+		free(cache);
+		return NULL;
+	}
+	return cache;
+}
+
+void thumb_cache_close(thumb_cache_t* cache)
+{
+	if (!cache)
+		return;
+	uint32_t generation = cache->view->generation;
+	_free_views(cache->view);
+	// older files this viewer kept mapped may be free to go now
+	uint32_t newest;
+	_scan_generations(cache, generation, &newest);
+	CloseHandle(cache->mutex);
+	free(cache);
+}
+
+// the record of key, or NULL. *view may move to a larger mapping.
+static const thumb_cache_record_t* _find(thumb_cache_t* cache,
+	thumb_cache_view_t** view, uint64_t key, volatile LONG64** out_slot)
+{
+	uint32_t table_size = _header(*view)->table_size;
+	uint32_t mask = table_size - 1;
+	uint32_t index = (uint32_t)key & mask;
+	for (uint32_t probes = 0; probes < table_size; probes++, index = (index + 1) & mask) {
+		volatile LONG64* slot_ptr = &_table(*view)[index];
+		LONG64 slot = *slot_ptr;
+		if (!slot)
+			return NULL;
+		if (!_slot_matches(slot, key))
+			continue;
+
+		// records are complete before their slot is written, but may be
+		// past the end of this mapping
+		uint64_t offset = _slot_offset(slot);
+		thumb_cache_view_t* grown = _at_least(cache, *view, offset + sizeof(thumb_cache_record_t));
+		if (!grown)
+			return NULL;
+		const thumb_cache_record_t* record = (const thumb_cache_record_t*)(grown->base + offset);
+		if (record->magic != THUMB_CACHE_RECORD_MAGIC)
+			return NULL;
+		grown = _at_least(cache, grown, offset + record->size);
+		if (!grown)
+			return NULL;
+		*view = grown;
+		record = (const thumb_cache_record_t*)(grown->base + offset);
+		if (record->key != key)
+			continue;
+		if (out_slot)
+			*out_slot = &_table(grown)[index];
+		return record;
+	}
+	return NULL;
+}
+
+bool thumb_cache_lookup(thumb_cache_t* cache, const WCHAR* path,
+	const file_stamp_t* stamp, int max_size, uint32_t bg_color,
+	thumbnail_t* out_thumbnail)
+{
+	ZeroMemory(out_thumbnail, sizeof(*out_thumbnail));
+	uint64_t key = _key(path, max_size, bg_color);
+	thumb_cache_view_t* view = _latest(cache);
+	const thumb_cache_record_t* record = _find(cache, &view, key, NULL);
+	if (!record)
+		return false;
+
+	// copied out before checking, as a writer may still be replacing it
+	thumb_cache_record_t fields = *record;
+	file_stamp_t record_stamp;
+	record_stamp.write_time = fields.write_time;
+	record_stamp.size = fields.file_size;
+	uint64_t num_bytes = (uint64_t)fields.width * fields.height * 4;
+	if (!file_stamps_equal(&record_stamp, stamp) ||
+		fields.width <= 0 || fields.height <= 0 ||
+		fields.width > max_size || fields.height > max_size ||
+		sizeof(thumb_cache_record_t) + num_bytes > fields.size)
+		return false;
+	uint32_t* pixels = (uint32_t*)malloc(num_bytes);
+	if (!pixels)
+		return false;
+	CopyMemory(pixels, record + 1, num_bytes);
+	// a crash may have written the slot's page, but not all the record's
+	if (hash64(pixels, num_bytes, key) != fields.checksum) {
+		free(pixels);
+		return false;
+	}
+	out_thumbnail->pixels = pixels;
+	out_thumbnail->width = fields.width;
+	out_thumbnail->height = fields.height;
+	out_thumbnail->image_width = fields.image_width;
+	out_thumbnail->image_height = fields.image_height;
+	out_thumbnail->reduced = fields.reduced != 0;
+	return true;
+}
+
+// room for size bytes more, growing the file. with the mutex held.
+static thumb_cache_view_t* _reserve(thumb_cache_t* cache, uint64_t size)
+{
+	thumb_cache_view_t* view = _latest(cache);
+	thumb_cache_header_t* header = _header(view);
+	uint64_t end = (uint64_t)header->end + size;
+	if (end <= (uint64_t)header->capacity)
+		return view;
+
+	uint64_t capacity = max(end, (uint64_t)header->capacity * 2);
+	capacity = max(capacity, end + THUMB_CACHE_MIN_GROWTH);
+	if (capacity > THUMB_CACHE_MAX_BYTES || capacity / THUMB_CACHE_ALIGN > 0xFFFFFFFF)
+		return NULL;
+	AcquireSRWLockExclusive(&cache->remap_lock);
+	// mapping it larger grows the file
+	thumb_cache_view_t* grown = _map(view->file, false, capacity);
+	if (grown) {
+		InterlockedExchange64(&_header(grown)->capacity, (LONG64)capacity);
+		_add_view(cache, grown, true);
+	}
+	ReleaseSRWLockExclusive(&cache->remap_lock);
+	return grown;
+}
+
+bool thumb_cache_store(thumb_cache_t* cache, const WCHAR* path,
+	const file_stamp_t* stamp, int max_size, uint32_t bg_color,
+	const thumbnail_t* thumbnail)
+{
+	uint64_t key = _key(path, max_size, bg_color);
+	uint64_t num_bytes = (uint64_t)thumbnail->width * thumbnail->height * 4;
+	uint64_t record_size = _align_up(sizeof(thumb_cache_record_t) + num_bytes, THUMB_CACHE_ALIGN);
+	if (record_size > THUMB_CACHE_MIN_GROWTH)
+		return false;
+
+	_lock(cache);
+	thumb_cache_view_t* view = _latest(cache);
+	thumb_cache_header_t* header = _header(view);
+	// the table is kept under three quarters full, so probes stay short.
+	// if it can't be doubled, it fills further, as long as a probe still
+	// reaches an empty slot.
+	uint64_t num_records = (uint64_t)header->num_records + 1;
+	if (num_records * 4 > (uint64_t)header->table_size * 3 && !cache->compact_failed &&
+		!_compact(cache, header->table_size * 2))
+		cache->compact_failed = true;
+	if (num_records >= header->table_size)
+		view = NULL;
+	if (view)
+		view = _reserve(cache, record_size);
+	if (!view) {
+		_unlock(cache);
+		return false;
+	}
+	header = _header(view);
+
+	uint64_t offset = (uint64_t)header->end;
+	thumb_cache_record_t* record = (thumb_cache_record_t*)(view->base + offset);
+	ZeroMemory(record, sizeof(*record));
+	record->magic = THUMB_CACHE_RECORD_MAGIC;
+	record->size = (uint32_t)record_size;
+	record->key = key;
+	record->file_size = stamp->size;
+	record->write_time = stamp->write_time;
+	record->checksum = hash64(thumbnail->pixels, num_bytes, key);
+	record->width = thumbnail->width;
+	record->height = thumbnail->height;
+	record->image_width = thumbnail->image_width;
+	record->image_height = thumbnail->image_height;
+	record->reduced = thumbnail->reduced;
+	CopyMemory(record + 1, thumbnail->pixels, num_bytes);
+
+	// published with one write, after the record. a replaced record is
+	// left for the next compaction.
+	volatile LONG64* slot = NULL;
+	const thumb_cache_record_t* old_record = _find(cache, &view, key, &slot);
+	if (old_record) {
+		InterlockedAdd64(&header->dead_bytes, old_record->size);
+	}
+	else {
+		uint32_t mask = header->table_size - 1;
+		uint32_t index = (uint32_t)key & mask;
+		while (_table(view)[index])
+			index = (index + 1) & mask;
+		slot = &_table(view)[index];
+		InterlockedIncrement(&header->num_records);
+	}
+	InterlockedExchange64(slot, _slot(key, offset));
+	InterlockedExchange64(&header->end, (LONG64)(offset + record_size));
+	_unlock(cache);
+	return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "content_hash.h"
+#include "thumbnail.h"
+
+// A persistent cache of thumbnails, so a folder's grid fills at once when
+// it's opened again.  Each folder gets one file in the cache directory,
+// mapped by every viewer that has it open.  Thumbnails are appended as
+// records, keyed by the file's path, size and write time, and found
+// through an open-addressed table at the start of the file whose slots
+// are published with a single 64-bit write, so lookups take no locks.
+// Writers, across processes, take a named mutex.  A newer thumbnail
+// replaces the slot and leaves the old record dead; once half the file
+// is dead, or the table fills, it is compacted into the folder's next
+// file.  The old one is marked for the other viewers to reopen, and
+// deleted once none of them maps it.
+// The least recently used files are deleted to stay within
+// THUMB_CACHE_MAX_BYTES.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define THUMB_CACHE_MAX_BYTES (2ULL * 1024 * 1024 * 1024)
+
+typedef struct thumb_cache_t thumb_cache_t;
+
+// turns the cache on, in dir, or in %LOCALAPPDATA%\dev_image_viewer\thumbs
+// if dir is NULL.  the cache is off until this succeeds.
+bool thumb_cache_enable(const WCHAR* dir);
+bool thumb_cache_enabled();
+
+// the cache of the folder dir_path, created if there isn't one.  safe to
+// use from any thread.
+thumb_cache_t* thumb_cache_open(const WCHAR* dir_path);
+void thumb_cache_close(thumb_cache_t* cache);
+
+// true if the cache holds this version of the file's thumbnail, made with
+// the same max_size and bg_color.  out_thumbnail is as from
+// thumbnail_read().
+bool thumb_cache_lookup(thumb_cache_t* cache, const WCHAR* path,
+	const file_stamp_t* stamp, int max_size, uint32_t bg_color,
+	thumbnail_t* out_thumbnail);
+bool thumb_cache_store(thumb_cache_t* cache, const WCHAR* path,
+	const file_stamp_t* stamp, int max_size, uint32_t bg_color,
+	const thumbnail_t* thumbnail);
+
+#ifdef __cplusplus
+}
+#endif
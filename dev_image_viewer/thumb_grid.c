@@ -0,0 +1,483 @@
+#include "dev_image_viewer.h"
+
+#include <limits.h>
+#include <stdlib.h>
+
+#include "gdiplus_loader.h"
+#include "thumb_grid.h"
+#include "thumb_loader.h"
+
+#define THUMB_GRID_WNDLONG_PRIVATE 0
+
+// posted by the loader, with the index of the thumbnail made
+#define THUMB_GRID_WM_THUMBNAIL (WM_APP + 1)
+
+// same as the canvas, so thumbnails look like the image opened
+#define THUMB_GRID_BG_COLOR 0xFF404040
+
+#define THUMB_GRID_PADDING 8
+#define THUMB_GRID_TEXT_HEIGHT 20
+#define THUMB_GRID_CELL_WIDTH (THUMB_GRID_THUMBNAIL_SIZE + THUMB_GRID_PADDING * 2)
+#define THUMB_GRID_CELL_HEIGHT (THUMB_GRID_THUMBNAIL_SIZE + THUMB_GRID_PADDING * 2 + THUMB_GRID_TEXT_HEIGHT)
+
+typedef struct {
+	thumb_loader_t* loader;
+	int selected;
+	int scroll_y;
+	int wheel_accum;
+	HFONT hfont;
+} thumb_grid_t;
+
+static thumb_grid_t* _thumb_grid_get_private(HWND hwnd)
+{
+	return (thumb_grid_t*)GetWindowLongPtr(hwnd, THUMB_GRID_WNDLONG_PRIVATE);
+}
+
+static int _count(thumb_grid_t* priv)
+{
+	return priv->loader ? thumb_loader_count(priv->loader) : 0;
+}
+
+static int _columns(HWND hwnd)
+{
+	RECT client_rect;
+	GetClientRect(hwnd, &client_rect);
+	return max((int)(client_rect.right / THUMB_GRID_CELL_WIDTH), 1);
+}
+
+static int _content_height(HWND hwnd, thumb_grid_t* priv)
+{
+	int columns = _columns(hwnd);
+	return (_count(priv) + columns - 1) / columns * THUMB_GRID_CELL_HEIGHT;
+}
+
+// the cell of index in client coords, with the columns centered
+static void _cell_rect(HWND hwnd, thumb_grid_t* priv, int index, RECT* out_rect)
+{
+	RECT client_rect;
+	GetClientRect(hwnd, &client_rect);
+	int columns = _columns(hwnd);
+	int left = max((int)(client_rect.right - columns * THUMB_GRID_CELL_WIDTH) / 2, 0);
+	out_rect->left = left + index % columns * THUMB_GRID_CELL_WIDTH;
+	out_rect->top = index / columns * THUMB_GRID_CELL_HEIGHT - priv->scroll_y;
+	out_rect->right = out_rect->left + THUMB_GRID_CELL_WIDTH;
+	out_rect->bottom = out_rect->top + THUMB_GRID_CELL_HEIGHT;
+}
+
+static int _hit_test(HWND hwnd, thumb_grid_t* priv, int x, int y)
+{
+	RECT client_rect;
+	GetClientRect(hwnd, &client_rect);
+	int columns = _columns(hwnd);
+	int left = max((int)(client_rect.right - columns * THUMB_GRID_CELL_WIDTH) / 2, 0);
+	if (x < left || x >= left + columns * THUMB_GRID_CELL_WIDTH || y + priv->scroll_y < 0)
+		return -1;
+	int index = (y + priv->scroll_y) / THUMB_GRID_CELL_HEIGHT * columns +
+		(x - left) / THUMB_GRID_CELL_WIDTH;
+	return index < _count(priv) ? index : -1;
+}
+
+// tells the loader which rows show, and sets up the scroll bar to match
+static void _update_scroll(HWND hwnd, thumb_grid_t* priv)
+{
+	RECT client_rect;
+	GetClientRect(hwnd, &client_rect);
+	int content_height = _content_height(hwnd, priv);
+	int max_scroll = max(content_height - (int)client_rect.bottom, 0);
+	priv->scroll_y = max(min(priv->scroll_y, max_scroll), 0);
+
+	SCROLLINFO info;
+	info.cbSize = sizeof(info);
+	info.fMask = SIF_RANGE | SIF_PAGE | SIF_POS;
+	info.nMin = 0;
+	info.nMax = max(content_height - 1, 0);
+	info.nPage = client_rect.bottom;
+	info.nPos = priv->scroll_y;
+	SetScrollInfo(hwnd, SB_VERT, &info, TRUE);
+
+	if (priv->loader) {
+		int columns = _columns(hwnd);
+		int first_row = priv->scroll_y / THUMB_GRID_CELL_HEIGHT;
+		int last_row = (priv->scroll_y + client_rect.bottom + THUMB_GRID_CELL_HEIGHT - 1) /
+			THUMB_GRID_CELL_HEIGHT;
+		thumb_loader_set_visible(priv->loader, first_row * columns, last_row * columns);
+	}
+}
+
+static void _scroll_to(HWND hwnd, thumb_grid_t* priv, int scroll_y)
+{
+	int old_scroll_y = priv->scroll_y;
+	priv->scroll_y = scroll_y;
+	_update_scroll(hwnd, priv);
+	if (priv->scroll_y != old_scroll_y)
+		InvalidateRect(hwnd, NULL, FALSE);
+}
+
+static void _scroll_into_view(HWND hwnd, thumb_grid_t* priv, int index)
+{
+	RECT client_rect;
+	GetClientRect(hwnd, &client_rect);
+	int top = index / _columns(hwnd) * THUMB_GRID_CELL_HEIGHT;
+	if (top < priv->scroll_y)
+		_scroll_to(hwnd, priv, top);
+	else if (top + THUMB_GRID_CELL_HEIGHT > priv->scroll_y + client_rect.bottom)
+		_scroll_to(hwnd, priv, top + THUMB_GRID_CELL_HEIGHT - client_rect.bottom);
+}
+
+static void _send_notify(HWND hwnd, UINT code)
+{
+	HWND parent = GetParent(hwnd);
+	if (parent) {
+		NMHDR nmhdr;
+		nmhdr.hwndFrom = hwnd;
+		nmhdr.code = code;
+		nmhdr.idFrom = GetWindowLong(hwnd, GWL_ID);
+		SendMessage(parent, WM_NOTIFY, nmhdr.idFrom, (LPARAM)&nmhdr);
+	}
+}
+
+static void _select(HWND hwnd, thumb_grid_t* priv, int index)
+{
+	int count = _count(priv);
+	if (!count)
+		return;
+	index = max(min(index, count - 1), 0);
+	if (index == priv->selected)
+		return;
+	RECT rect;
+	_cell_rect(hwnd, priv, priv->selected, &rect);
+	InvalidateRect(hwnd, &rect, FALSE);
+	priv->selected = index;
+	_cell_rect(hwnd, priv, priv->selected, &rect);
+	InvalidateRect(hwnd, &rect, FALSE);
+	_scroll_into_view(hwnd, priv, index);
+}
+
+static void _paint_cell(HWND hwnd, thumb_grid_t* priv, HDC hdc, int index)
+{
+	RECT cell;
+	_cell_rect(hwnd, priv, index, &cell);
+	if (index == priv->selected) {
+		HBRUSH select_brush = CreateSolidBrush(RGB(60, 90, 140));
+		FillRect(hdc, &cell, select_brush);
+		DeleteObject(select_brush);
+	}
+
+	RECT box;
+	box.left = cell.left + THUMB_GRID_PADDING;
+	box.top = cell.top + THUMB_GRID_PADDING;
+	box.right = box.left + THUMB_GRID_THUMBNAIL_SIZE;
+	box.bottom = box.top + THUMB_GRID_THUMBNAIL_SIZE;
+	bool failed;
+	const thumbnail_t* thumbnail = thumb_loader_get(priv->loader, index, &failed);
+	if (thumbnail) {
+		BITMAPV5HEADER bmi;
+		init_bitmap_header(&bmi, thumbnail->width, thumbnail->height);
+		SetDIBitsToDevice(hdc,
+			box.left + (THUMB_GRID_THUMBNAIL_SIZE - thumbnail->width) / 2,
+			box.top + (THUMB_GRID_THUMBNAIL_SIZE - thumbnail->height) / 2,
+			thumbnail->width, thumbnail->height, 0, 0, 0, thumbnail->height,
+			thumbnail->pixels, (BITMAPINFO*)&bmi, DIB_RGB_COLORS);
+	}
+	else {
+		// an outline until it's made, crossed out if it can't be
+		HBRUSH frame_brush = CreateSolidBrush(failed ? RGB(140, 60, 60) : RGB(70, 70, 70));
+		FrameRect(hdc, &box, frame_brush);
+		DeleteObject(frame_brush);
+		if (failed) {
+			HPEN pen = CreatePen(PS_SOLID, 1, RGB(140, 60, 60));
+			HGDIOBJ old_pen = SelectObject(hdc, pen);
+			MoveToEx(hdc, box.left, box.top, NULL);
+			LineTo(hdc, box.right, box.bottom);
+			MoveToEx(hdc, box.right - 1, box.top, NULL);
+			LineTo(hdc, box.left - 1, box.bottom);
+			SelectObject(hdc, old_pen);
+			DeleteObject(pen);
+		}
+	}
+
+	const WCHAR* path = thumb_loader_get_path(priv->loader, index);
+	const WCHAR* name = wcsrchr(path, L'\\');
+	name = name ? name + 1 : path;
+	RECT text_rect;
+	text_rect.left = cell.left + 2;
+	text_rect.top = box.bottom + THUMB_GRID_PADDING / 2;
+	text_rect.right = cell.right - 2;
+	text_rect.bottom = cell.bottom;
+	DrawTextW(hdc, name, -1, &text_rect,
+		DT_CENTER | DT_SINGLELINE | DT_END_ELLIPSIS | DT_NOPREFIX);
+}
+
+static void _thumb_grid_paint(HWND hwnd, HDC hdc, const RECT* paint_rect)
+{
+	thumb_grid_t* priv = _thumb_grid_get_private(hwnd);
+	RECT client_rect;
+	GetClientRect(hwnd, &client_rect);
+
+	// drawn off screen, so scrolling doesn't flicker
+	HDC mem_dc = CreateCompatibleDC(hdc);
+	HBITMAP mem_bitmap = CreateCompatibleBitmap(hdc, client_rect.right, client_rect.bottom);
+	if (!mem_dc || !mem_bitmap) {
+		if (mem_bitmap)
+			DeleteObject(mem_bitmap);
+		if (mem_dc)
+			DeleteDC(mem_dc);
+		return;
+	}
+	HGDIOBJ old_bitmap = SelectObject(mem_dc, mem_bitmap);
+
+	HBRUSH bg_brush = CreateSolidBrush(RGB(32, 32, 32));
+	FillRect(mem_dc, &client_rect, bg_brush);
+	DeleteObject(bg_brush);
+
+	int count = _count(priv);
+	if (count) {
+		SetBkMode(mem_dc, TRANSPARENT);
+		SetTextColor(mem_dc, RGB(220, 220, 220));
+		HGDIOBJ old_font = NULL;
+		if (priv->hfont)
+			old_font = SelectObject(mem_dc, priv->hfont);
+		int columns = _columns(hwnd);
+		int first_row = max(paint_rect->top + priv->scroll_y, 0) / THUMB_GRID_CELL_HEIGHT;
+		int last_row = (paint_rect->bottom + priv->scroll_y + THUMB_GRID_CELL_HEIGHT - 1) /
+			THUMB_GRID_CELL_HEIGHT;
+		int last = min(last_row * columns, count);
+		for (int i = first_row * columns; i < last; i++)
+			_paint_cell(hwnd, priv, mem_dc, i);
+		if (old_font)
+			SelectObject(mem_dc, old_font);
+	}
+
+	BitBlt(hdc, paint_rect->left, paint_rect->top,
+		paint_rect->right - paint_rect->left, paint_rect->bottom - paint_rect->top,
+		mem_dc, paint_rect->left, paint_rect->top, SRCCOPY);
+	SelectObject(mem_dc, old_bitmap);
+	DeleteObject(mem_bitmap);
+	DeleteDC(mem_dc);
+}
+
+static bool _on_key(HWND hwnd, thumb_grid_t* priv, WPARAM key)
+{
+	RECT client_rect;
+	GetClientRect(hwnd, &client_rect);
+	int columns = _columns(hwnd);
+	int page = max((int)(client_rect.bottom / THUMB_GRID_CELL_HEIGHT), 1) * columns;
+	switch (key) {
+		case VK_LEFT:
+			_select(hwnd, priv, priv->selected - 1);
+			return true;
+		case VK_RIGHT:
+			_select(hwnd, priv, priv->selected + 1);
+			return true;
+		case VK_UP:
+			_select(hwnd, priv, priv->selected - columns);
+			return true;
+		case VK_DOWN:
+			_select(hwnd, priv, priv->selected + columns);
+			return true;
+		case VK_PRIOR:
+			_select(hwnd, priv, priv->selected - page);
+			return true;
+		case VK_NEXT:
+			_select(hwnd, priv, priv->selected + page);
+			return true;
+		case VK_HOME:
+			_select(hwnd, priv, 0);
+			return true;
+		case VK_END:
+			_select(hwnd, priv, _count(priv) - 1);
+			return true;
+		case VK_RETURN:
+			if (_count(priv))
+				_send_notify(hwnd, THUMB_GRID_NM_OPEN);
+			return true;
+	}
+	return false;
+}
+
+static LRESULT CALLBACK _thumb_grid_wndproc(HWND hwnd, UINT message,
+	WPARAM wParam, LPARAM lParam)
+{
+	switch (message) {
+		case WM_NCCREATE:
+		{
+			thumb_grid_t* priv = (thumb_grid_t*)calloc(1, sizeof(thumb_grid_t));
+			if (!priv)
+				return FALSE;
+			SetWindowLongPtrW(hwnd, THUMB_GRID_WNDLONG_PRIVATE, (LONG_PTR)priv);
+			NONCLIENTMETRICSW metrics;
+			metrics.cbSize = sizeof(metrics);
+			if (SystemParametersInfoW(SPI_GETNONCLIENTMETRICS, 0, &metrics, 0))
+				priv->hfont = CreateFontIndirectW(&metrics.lfMessageFont);
+		}
+		break;
+
+		case WM_NCDESTROY:
+		{
+			thumb_grid_t* priv = _thumb_grid_get_private(hwnd);
+			if (priv) {
+				thumb_loader_close(priv->loader);
+				if (priv->hfont)
+					DeleteObject(priv->hfont);
+				free(priv);
+			}
+			return 0;
+		}
+
+		case WM_PAINT:
+		{
+			PAINTSTRUCT ps;
+			HDC hdc = BeginPaint(hwnd, &ps);
+			_thumb_grid_paint(hwnd, hdc, &ps.rcPaint);
+			EndPaint(hwnd, &ps);
+		}
+		return 0;
+
+		case WM_ERASEBKGND:
+			return 1;
+
+		case WM_SIZE:
+		{
+			thumb_grid_t* priv = _thumb_grid_get_private(hwnd);
+			_update_scroll(hwnd, priv);
+			if (_count(priv))
+				_scroll_into_view(hwnd, priv, priv->selected);
+		}
+		return 0;
+
+		case THUMB_GRID_WM_THUMBNAIL:
+		{
+			thumb_grid_t* priv = _thumb_grid_get_private(hwnd);
+			if (priv->loader && (int)wParam < _count(priv)) {
+				RECT rect;
+				_cell_rect(hwnd, priv, (int)wParam, &rect);
+				InvalidateRect(hwnd, &rect, FALSE);
+			}
+		}
+		return 0;
+
+		case WM_VSCROLL:
+		{
+			thumb_grid_t* priv = _thumb_grid_get_private(hwnd);
+			RECT client_rect;
+			GetClientRect(hwnd, &client_rect);
+			SCROLLINFO info;
+			info.cbSize = sizeof(info);
+			info.fMask = SIF_TRACKPOS;
+			GetScrollInfo(hwnd, SB_VERT, &info);
+			int scroll_y = priv->scroll_y;
+			switch (LOWORD(wParam)) {
+				case SB_LINEUP:
+					scroll_y -= THUMB_GRID_CELL_HEIGHT / 4;
+					break;
+				case SB_LINEDOWN:
+					scroll_y += THUMB_GRID_CELL_HEIGHT / 4;
+					break;
+				case SB_PAGEUP:
+					scroll_y -= client_rect.bottom;
+					break;
+				case SB_PAGEDOWN:
+					scroll_y += client_rect.bottom;
+					break;
+				case SB_THUMBTRACK:
+				case SB_THUMBPOSITION:
+					scroll_y = info.nTrackPos;
+					break;
+				case SB_TOP:
+					scroll_y = 0;
+					break;
+				case SB_BOTTOM:
+					scroll_y = INT_MAX;
+					break;
+			}
+			_scroll_to(hwnd, priv, scroll_y);
+		}
+		return 0;
+
+		case WM_MOUSEWHEEL:
+		{
+			thumb_grid_t* priv = _thumb_grid_get_private(hwnd);
+			priv->wheel_accum += (SHORT)HIWORD(wParam);
+			// a notch scrolls half a row, finer wheels in proportion
+			int delta = priv->wheel_accum * (THUMB_GRID_CELL_HEIGHT / 2) / WHEEL_DELTA;
+			priv->wheel_accum -= delta * WHEEL_DELTA / (THUMB_GRID_CELL_HEIGHT / 2);
+			_scroll_to(hwnd, priv, priv->scroll_y - delta);
+		}
+		return 0;
+
+		case WM_LBUTTONDOWN:
+		case WM_LBUTTONDBLCLK:
+		{
+			thumb_grid_t* priv = _thumb_grid_get_private(hwnd);
+			int index = _hit_test(hwnd, priv, (SHORT)LOWORD(lParam), (SHORT)HIWORD(lParam));
+			if (index < 0)
+				return 0;
+			_select(hwnd, priv, index);
+			if (message == WM_LBUTTONDBLCLK)
+				_send_notify(hwnd, THUMB_GRID_NM_OPEN);
+		}
+		return 0;
+
+		// forwarded by the main window, which keeps the focus
+		case WM_KEYDOWN:
+			if (_on_key(hwnd, _thumb_grid_get_private(hwnd), wParam))
+				return 0;
+			break;
+	}
+	return DefWindowProcW(hwnd, message, wParam, lParam);
+}
+
+bool thumb_grid_set_files(HWND hwnd, const WCHAR* const* paths, int count, int selected)
+{
+	thumb_grid_t* priv = _thumb_grid_get_private(hwnd);
+	thumb_loader_t* loader = NULL;
+	if (count) {
+		loader = thumb_loader_open(paths, count, THUMB_GRID_THUMBNAIL_SIZE,
+			THUMB_GRID_BG_COLOR, hwnd, THUMB_GRID_WM_THUMBNAIL);
+		if (!loader)
+			return false;
+	}
+	// thumbnails of the old loader still posted are for indices that are
+	// just repainted
+	thumb_loader_close(priv->loader);
+	priv->loader = loader;
+	priv->selected = max(min(selected, count - 1), 0);
+	priv->scroll_y = 0;
+	priv->wheel_accum = 0;
+	_update_scroll(hwnd, priv);
+	if (count) {
+		RECT client_rect;
+		GetClientRect(hwnd, &client_rect);
+		// selected in the middle, if it's further down than the first page
+		int top = priv->selected / _columns(hwnd) * THUMB_GRID_CELL_HEIGHT;
+		_scroll_to(hwnd, priv, top - (client_rect.bottom - THUMB_GRID_CELL_HEIGHT) / 2);
+	}
+	InvalidateRect(hwnd, NULL, FALSE);
+	return true;
+}
+
+const WCHAR* thumb_grid_get_selected(HWND hwnd)
+{
+	thumb_grid_t* priv = _thumb_grid_get_private(hwnd);
+	if (!priv->loader)
+		return NULL;
+	return thumb_loader_get_path(priv->loader, priv->selected);
+}
+
+ATOM thumb_grid_init_class(HINSTANCE hinstance)
+{
+	WNDCLASSW wndclass;
+
+	wndclass.style = CS_HREDRAW | CS_VREDRAW | CS_DBLCLKS;
+	wndclass.lpfnWndProc = _thumb_grid_wndproc;
+	wndclass.cbClsExtra = 0;
+	wndclass.cbWndExtra = sizeof(void*);
+	wndclass.hInstance = hinstance;
+	wndclass.hIcon = NULL;
+	wndclass.hCursor = LoadCursor(NULL, IDC_ARROW);
+	wndclass.hbrBackground = NULL;
+	wndclass.lpszMenuName = NULL;
+	wndclass.lpszClassName = THUMB_GRID_CLASS_NAME;
+
+	return RegisterClassW(&wndclass);
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+
+// A contact sheet of the images in a folder, with their names.  The
+// thumbnails stream in from a thumb_loader_t as they are made, so the grid
+// scrolls at display rate whatever is still decoding.  The arrow keys,
+// Page Up, Page Down, Home and End move the selection, and Enter or a
+// double click opens it.  The parent forwards the keys, as WM_KEYDOWN.
+
+#define THUMB_GRID_CLASS_NAME L"thumb_grid"
+
+// WM_NOTIFY message codes
+#define THUMB_GRID_NM_OPEN	1	// see thumb_grid_get_selected()
+
+// thumbnails fit in a square this size
+#define THUMB_GRID_THUMBNAIL_SIZE 128
+
+ATOM thumb_grid_init_class(HINSTANCE inst);
+
+// shows thumbnails of the files, with selected scrolled into view. paths
+// are copied.
+bool thumb_grid_set_files(HWND hwnd, const WCHAR* const* paths, int count, int selected);
+// the path of the file selected, or NULL
+const WCHAR* thumb_grid_get_selected(HWND hwnd);
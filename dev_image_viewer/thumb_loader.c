@@ -0,0 +1,283 @@
+#include "dev_image_viewer.h"
+
+#include <PathCch.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parallel.h"
+#include "thumb_cache.h"
+#include "thumb_loader.h"
+
+typedef enum {
+	THUMB_LOADER_EMPTY,
+	THUMB_LOADER_DECODING,
+	THUMB_LOADER_READY,
+	THUMB_LOADER_FAILED,
+} thumb_loader_state_t;
+
+typedef struct {
+	thumb_loader_t* loader;
+	WCHAR* path;
+	thumb_loader_state_t state;
+	thumbnail_t thumbnail;
+} thumb_loader_item_t;
+
+struct thumb_loader_t {
+	thumb_loader_item_t* items;
+	int count;
+	int max_size;
+	uint32_t bg_color;
+	HWND hwnd;
+	UINT message;
+	// of the first file's folder, or NULL
+	thumb_cache_t* cache;
+
+	TP_CALLBACK_ENVIRON callback_environ;
+	PTP_CLEANUP_GROUP cleanup_group;
+	int num_workers;
+
+	// guards the items' states, the range and the count of decodes queued
+	// or running, shared with the workers.
+	// only the thread calling thumb_loader_set_visible() frees thumbnails.
+	SRWLOCK lock;
+	int first;
+	int last;
+	int decoding;
+	bool closing;
+};
+
+static void _free_items(thumb_loader_t* loader)
+{
+	for (int i = 0; i < loader->count; i++) {
+		free(loader->items[i].path);
+		thumbnail_free(&loader->items[i].thumbnail);
+	}
+	free(loader->items);
+}
+
+thumb_loader_t* thumb_loader_open(const WCHAR* const* paths, int count, int max_size,
+	uint32_t bg_color, HWND hwnd, UINT message)
+{
+	thumb_loader_t* loader = (thumb_loader_t*)calloc(1, sizeof(thumb_loader_t));
+	if (!loader)
+		return NULL;
+	loader->items = (thumb_loader_item_t*)calloc(count ? count : 1, sizeof(thumb_loader_item_t));
+	bool ok = loader->items != NULL;
+	for (int i = 0; ok && i < count; i++) {
+		loader->items[i].loader = loader;
+		loader->items[i].path = _wcsdup(paths[i]);
+		ok = loader->items[i].path != NULL;
+		loader->count = i + 1;
+	}
+	if (ok) {
+		loader->cleanup_group = CreateThreadpoolCleanupGroup();
+		ok = loader->cleanup_group != NULL;
+	}
+	if (!ok) {
+		if (loader->items)
+			_free_items(loader);
+		free(loader);
+		return NULL;
+	}
+
+	loader->max_size = max_size;
+	loader->bg_color = bg_color;
+	loader->hwnd = hwnd;
+	loader->message = message;
+	InitializeThreadpoolEnvironment(&loader->callback_environ);
+	SetThreadpoolCallbackCleanupGroup(&loader->callback_environ,
+		loader->cleanup_group, NULL);
+	InitializeSRWLock(&loader->lock);
+	loader->num_workers = parallel_get_num_threads();
+
+	WCHAR* dir_path = count ? _wcsdup(paths[0]) : NULL;
+	if (dir_path && SUCCEEDED(PathCchRemoveFileSpec(dir_path, wcslen(dir_path))))
+		loader->cache = thumb_cache_open(dir_path);
+	free(dir_path);
+	return loader;
+}
+
+void thumb_loader_close(thumb_loader_t* loader)
+{
+	if (!loader)
+		return;
+	// cancels decodes not started, and waits for the rest, which queue
+	// no more
+	AcquireSRWLockExclusive(&loader->lock);
+	loader->closing = true;
+	ReleaseSRWLockExclusive(&loader->lock);
+	CloseThreadpoolCleanupGroupMembers(loader->cleanup_group, TRUE, NULL);
+	CloseThreadpoolCleanupGroup(loader->cleanup_group);
+	DestroyThreadpoolEnvironment(&loader->callback_environ);
+	thumb_cache_close(loader->cache);
+	_free_items(loader);
+	free(loader);
+}
+
+int thumb_loader_count(const thumb_loader_t* loader)
+{
+	return loader->count;
+}
+
+const WCHAR* thumb_loader_get_path(const thumb_loader_t* loader, int index)
+{
+	if (index < 0 || index >= loader->count)
+		return NULL;
+	return loader->items[index].path;
+}
+
+// within ranges of the range showing, on either side
+static bool _near(const thumb_loader_t* loader, int index, int ranges)
+{
+	int span = max(loader->last - loader->first, 1) * ranges;
+	return index >= loader->first - span && index < loader->last + span;
+}
+
+static void _top_up(thumb_loader_t* loader);
+
+static VOID CALLBACK _decode(PTP_CALLBACK_INSTANCE instance, PVOID param)
+{
+	thumb_loader_item_t* item = (thumb_loader_item_t*)param;
+	thumb_loader_t* loader = item->loader;
+	int index = (int)(item - loader->items);
+
+	// scrolled away while waiting its turn
+	AcquireSRWLockExclusive(&loader->lock);
+	bool skip = loader->closing || !_near(loader, index, 1);
+	if (skip)
+		item->state = THUMB_LOADER_EMPTY;
+	ReleaseSRWLockExclusive(&loader->lock);
+
+	// the path doesn't change while decoding. the cache is keyed by the
+	// file's size and write time, so an edited file is made again.
+	thumbnail_t thumbnail;
+	file_stamp_t stamp;
+	bool have_stamp = !skip && loader->cache && get_file_stamp(item->path, &stamp);
+	bool ok = have_stamp && thumb_cache_lookup(loader->cache, item->path, &stamp,
+		loader->max_size, loader->bg_color, &thumbnail);
+	if (!skip && !ok) {
+		ok = thumbnail_read(item->path, loader->max_size, loader->bg_color, &thumbnail);
+		if (ok && have_stamp)
+			thumb_cache_store(loader->cache, item->path, &stamp, loader->max_size,
+				loader->bg_color, &thumbnail);
+	}
+
+	bool keep = false;
+	AcquireSRWLockExclusive(&loader->lock);
+	loader->decoding--;
+	if (!skip) {
+		keep = _near(loader, index, THUMB_LOADER_KEEP_RANGES);
+		item->state = !keep ? THUMB_LOADER_EMPTY :
+			ok ? THUMB_LOADER_READY : THUMB_LOADER_FAILED;
+		if (keep && ok)
+			item->thumbnail = thumbnail;
+	}
+	_top_up(loader);
+	ReleaseSRWLockExclusive(&loader->lock);
+	if (ok && !keep)
+		thumbnail_free(&thumbnail);
+	if (keep)
+		PostMessageW(loader->hwnd, loader->message, (WPARAM)index, 0);
+}
+
+// submits the decode of index, if it's wanted and there's a worker for it.
+// false once there are no more workers.
+static bool _submit(thumb_loader_t* loader, int index)
+{
+	if (index < 0 || index >= loader->count)
+		return true;
+	thumb_loader_item_t* item = &loader->items[index];
+	if (item->state != THUMB_LOADER_EMPTY)
+		return true;
+	if (loader->decoding >= loader->num_workers)
+		return false;
+	item->state = THUMB_LOADER_DECODING;
+	if (!TrySubmitThreadpoolCallback(_decode, item, &loader->callback_environ)) {
+		item->state = THUMB_LOADER_EMPTY;
+		return false;
+	}
+	loader->decoding++;
+	return true;
+}
+
+// queues decodes of the range showing, then outwards from it
+static void _top_up(thumb_loader_t* loader)
+{
+	if (loader->closing)
+		return;
+	for (int i = loader->first; i < loader->last; i++) {
+		if (!_submit(loader, i))
+			return;
+	}
+	int span = max(loader->last - loader->first, 1);
+	for (int i = 0; i < span; i++) {
+		if (!_submit(loader, loader->last + i) ||
+			!_submit(loader, loader->first - 1 - i))
+			return;
+	}
+}
+
+void thumb_loader_set_visible(thumb_loader_t* loader, int first, int last)
+{
+	first = max(min(first, loader->count), 0);
+	last = max(min(last, loader->count), first);
+
+	AcquireSRWLockExclusive(&loader->lock);
+	loader->first = first;
+	loader->last = last;
+	// pixels are freed after the lock, with the states already empty
+	thumbnail_t* discard = NULL;
+	int num_discard = 0;
+	for (int i = 0; i < loader->count; i++) {
+		thumb_loader_item_t* item = &loader->items[i];
+		if (item->state != THUMB_LOADER_READY || _near(loader, i, THUMB_LOADER_KEEP_RANGES))
+			continue;
+		if (!discard)
+			discard = (thumbnail_t*)malloc(loader->count * sizeof(thumbnail_t));
+		if (!discard)
+			break;
+		discard[num_discard++] = item->thumbnail;
+		ZeroMemory(&item->thumbnail, sizeof(item->thumbnail));
+		item->state = THUMB_LOADER_EMPTY;
+	}
+	_top_up(loader);
+	ReleaseSRWLockExclusive(&loader->lock);
+
+	for (int i = 0; i < num_discard; i++)
+		thumbnail_free(&discard[i]);
+	free(discard);
+}
+
+const thumbnail_t* thumb_loader_get(thumb_loader_t* loader, int index, bool* out_failed)
+{
+	*out_failed = false;
+	if (index < 0 || index >= loader->count)
+		return NULL;
+	AcquireSRWLockShared(&loader->lock);
+	thumb_loader_state_t state = loader->items[index].state;
+	ReleaseSRWLockShared(&loader->lock);
+	*out_failed = state == THUMB_LOADER_FAILED;
+	return state == THUMB_LOADER_READY ? &loader->items[index].thumbnail : NULL;
+}
+
+void thumb_loader_get_stats(thumb_loader_t* loader, thumb_loader_stats_t* stats)
+{
+	ZeroMemory(stats, sizeof(*stats));
+	AcquireSRWLockShared(&loader->lock);
+	for (int i = 0; i < loader->count; i++) {
+		switch (loader->items[i].state) {
+			case THUMB_LOADER_READY:
+				stats->ready++;
+				break;
+			case THUMB_LOADER_DECODING:
+				stats->decoding++;
+				break;
+			case THUMB_LOADER_FAILED:
+				stats->failed++;
+				break;
+			default:
+				break;
+		}
+	}
+	ReleaseSRWLockShared(&loader->lock);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+
+#include "thumbnail.h"
+
+// Makes the thumbnails of a list of files on the system thread pool, for
+// the thumbnail grid.  The range showing is decoded first, then as many
+// again either side, nearest first.  No more decodes are queued than there
+// are workers, so after a scroll the new range is next, and a decode for
+// a thumbnail scrolled away is skipped if it hasn't started.  Thumbnails
+// scrolled far away are freed, so a folder of any size takes about the
+// same memory.  With the thumbnail cache on, thumbnails made before are
+// read from it, and new ones are added.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// thumbnails further than this many ranges from the one showing are freed
+#define THUMB_LOADER_KEEP_RANGES 4
+
+typedef struct thumb_loader_t thumb_loader_t;
+
+typedef struct {
+	int ready;
+	int decoding;
+	int failed;
+} thumb_loader_stats_t;
+
+// paths are copied.  each thumbnail made, or failed, posts message to hwnd
+// with its index as wParam.
+thumb_loader_t* thumb_loader_open(const WCHAR* const* paths, int count, int max_size,
+	uint32_t bg_color, HWND hwnd, UINT message);
+// waits for decodes in flight
+void thumb_loader_close(thumb_loader_t* loader);
+
+int thumb_loader_count(const thumb_loader_t* loader);
+const WCHAR* thumb_loader_get_path(const thumb_loader_t* loader, int index);
+
+// the range of indices showing, [first, last)
+void thumb_loader_set_visible(thumb_loader_t* loader, int first, int last);
+// NULL until made. out_failed tells when it couldn't be.  stays valid until
+// the next thumb_loader_set_visible() or thumb_loader_close(), which must
+// be called from the same thread as this.
+const thumbnail_t* thumb_loader_get(thumb_loader_t* loader, int index, bool* out_failed);
+void thumb_loader_get_stats(thumb_loader_t* loader, thumb_loader_stats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
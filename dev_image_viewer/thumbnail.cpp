@@ -0,0 +1,283 @@
+#include "dev_image_viewer.h"
+
+#include <gdiplus.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gdiplus_loader.h"
+#include "pixel_kernels.h"
+#include "texture_file.h"
+#include "thumbnail.h"
+#include "trace.h"
+#include "yuv_file.h"
+
+// how far an embedded thumbnail's aspect ratio may be from the image's, in
+// parts per thousand. EXIF thumbnails of photos in another shape than 4:3
+// are often letterboxed, which would show as bars.
+#define THUMBNAIL_MAX_ASPECT_ERROR 20
+
+static void _fit(int width, int height, int max_size, int* out_width, int* out_height)
+{
+	if (width <= max_size && height <= max_size) {
+		*out_width = width;
+		*out_height = height;
+	}
+	else if (width >= height) {
+		*out_width = max_size;
+		*out_height = max((int)((int64_t)height * max_size / width), 1);
+	}
+	else {
+		*out_width = max((int)((int64_t)width * max_size / height), 1);
+		*out_height = max_size;
+	}
+}
+
+// averages the source pixels each dest pixel covers, rounded out to whole
+// pixels. dest is no larger than src in either dimension.
+static void _resample(const uint32_t* src, int src_width, int src_height,
+	uint32_t* dest, int dest_width, int dest_height)
+{
+	for (int y = 0; y < dest_height; y++) {
+		int sy0 = (int)((int64_t)y * src_height / dest_height);
+		int sy1 = max((int)((int64_t)(y + 1) * src_height / dest_height), sy0 + 1);
+		for (int x = 0; x < dest_width; x++) {
+			int sx0 = (int)((int64_t)x * src_width / dest_width);
+			int sx1 = max((int)((int64_t)(x + 1) * src_width / dest_width), sx0 + 1);
+			uint32_t sums[4] = { 0, 0, 0, 0 };
+			for (int sy = sy0; sy < sy1; sy++) {
+				const uint32_t* row = src + (size_t)sy * src_width;
+				for (int sx = sx0; sx < sx1; sx++) {
+					for (int c = 0; c < 4; c++)
+						sums[c] += (row[sx] >> (c * 8)) & 0xFF;
+				}
+			}
+			uint32_t count = (uint32_t)((sy1 - sy0) * (sx1 - sx0));
+			uint32_t pixel = 0;
+			for (int c = 0; c < 4; c++)
+				pixel |= ((sums[c] + count / 2) / count) << (c * 8);
+			dest[(size_t)y * dest_width + x] = pixel;
+		}
+	}
+}
+
+// bakes and reduces pixels to fit max_size, into out_thumbnail->pixels
+static bool _finish(const uint32_t* pixels, int width, int height, int max_size,
+	uint32_t bg_color, thumbnail_t* out_thumbnail)
+{
+	uint32_t* level = (uint32_t*)malloc((size_t)width * height * sizeof(uint32_t));
+	if (!level)
+		return false;
+	pixel_bake_sse2(level, pixels, (uint64_t)width * height, bg_color);
+
+	// halves until within 2x of the size, which the resample finishes
+	while (width > max_size * 2 || height > max_size * 2) {
+		int half_width = (width + 1) / 2;
+		int half_height = (height + 1) / 2;
+		uint32_t* half = (uint32_t*)malloc((size_t)half_width * half_height * sizeof(uint32_t));
+		if (!half) {
+			free(level);
+			return false;
+		}
+		pixel_downsize_sse2(level, width, height, half, half_width, half_height, bg_color);
+		free(level);
+		level = half;
+		width = half_width;
+		height = half_height;
+	}
+
+	int thumb_width, thumb_height;
+	_fit(width, height, max_size, &thumb_width, &thumb_height);
+	if (thumb_width == width && thumb_height == height) {
+		out_thumbnail->pixels = level;
+	}
+	else {
+		out_thumbnail->pixels = (uint32_t*)malloc((size_t)thumb_width * thumb_height * sizeof(uint32_t));
+		if (out_thumbnail->pixels)
+			_resample(level, width, height, out_thumbnail->pixels, thumb_width, thumb_height);
+		free(level);
+		if (!out_thumbnail->pixels)
+			return false;
+	}
+	out_thumbnail->width = thumb_width;
+	out_thumbnail->height = thumb_height;
+	return true;
+}
+
+// the smallest mip still at least max_size across
+static bool _read_texture(texture_t* texture, int max_size, uint32_t bg_color,
+	thumbnail_t* out_thumbnail)
+{
+	int num_levels = texture_get_info(texture)->num_levels;
+	int level = 0;
+	int width, height;
+	texture_level_size(texture, 0, &out_thumbnail->image_width, &out_thumbnail->image_height);
+	for (int i = 1; i < num_levels; i++) {
+		texture_level_size(texture, i, &width, &height);
+		if (max(width, height) < max_size)
+			break;
+		level = i;
+	}
+
+	HBITMAP hbitmap;
+	void* bits;
+	if (!texture_file_read(texture, 0, level, &hbitmap, &bits, &width, &height))
+		return false;
+	bool ok = _finish((const uint32_t*)bits, width, height, max_size, bg_color, out_thumbnail);
+	DeleteObject(hbitmap);
+	out_thumbnail->reduced = level > 0;
+	return ok;
+}
+
+// the embedded thumbnail, decoded from its own JPEG stream. GDI+ reads the
+// stream for as long as the bitmap lives, so it's released after.
+static Gdiplus::Bitmap* _open_embedded(Gdiplus::Bitmap* bitmap, IStream** out_stream)
+{
+	UINT size = bitmap->GetPropertyItemSize(PropertyTagThumbnailData);
+	Gdiplus::PropertyItem* item = size ? (Gdiplus::PropertyItem*)malloc(size) : NULL;
+	HGLOBAL hglobal = NULL;
+	void* data = NULL;
+	bool ok = item && bitmap->GetPropertyItem(PropertyTagThumbnailData, size, item) == Gdiplus::Ok &&
+		item->length && (hglobal = GlobalAlloc(GMEM_MOVEABLE, item->length)) != NULL &&
+		(data = GlobalLock(hglobal)) != NULL;
+	if (ok) {
+		memcpy(data, item->value, item->length);
+		GlobalUnlock(hglobal);
+	}
+	free(item);
+
+	IStream* stream = NULL;
+	if (!ok || FAILED(CreateStreamOnHGlobal(hglobal, TRUE, &stream))) {
+		if (hglobal)
+			GlobalFree(hglobal);
+		return NULL;
+	}
+	Gdiplus::Bitmap* embedded = new Gdiplus::Bitmap(stream);
+	if (!embedded || embedded->GetLastStatus() != Gdiplus::Ok) {
+		delete embedded;
+		stream->Release();
+		return NULL;
+	}
+	*out_stream = stream;
+	return embedded;
+}
+
+// draws the embedded thumbnail, if there is one large enough and the same
+// shape as the image
+static bool _read_embedded(Gdiplus::Bitmap* bitmap, int max_size, uint32_t bg_color,
+	thumbnail_t* out_thumbnail)
+{
+	int image_width = out_thumbnail->image_width;
+	int image_height = out_thumbnail->image_height;
+	int thumb_width, thumb_height;
+	_fit(image_width, image_height, max_size, &thumb_width, &thumb_height);
+	IStream* stream = NULL;
+	Gdiplus::Bitmap* embedded = _open_embedded(bitmap, &stream);
+	if (!embedded)
+		return false;
+	int embedded_width = embedded->GetWidth();
+	int embedded_height = embedded->GetHeight();
+	int64_t aspect = embedded_width && embedded_height ?
+		(int64_t)image_width * embedded_height * 1000 / ((int64_t)image_height * embedded_width) : 0;
+	uint32_t* pixels = NULL;
+	bool ok = embedded_width >= thumb_width && embedded_height >= thumb_height &&
+		aspect >= 1000 - THUMBNAIL_MAX_ASPECT_ERROR && aspect <= 1000 + THUMBNAIL_MAX_ASPECT_ERROR &&
+		(pixels = (uint32_t*)calloc((size_t)thumb_width * thumb_height, sizeof(uint32_t))) != NULL;
+	if (ok) {
+		Gdiplus::Bitmap target(thumb_width, thumb_height, thumb_width * 4,
+			PixelFormat32bppPARGB, (BYTE*)pixels);
+		Gdiplus::Graphics graphics(&target);
+		ok = graphics.DrawImage(embedded, 0, 0, thumb_width, thumb_height) == Gdiplus::Ok;
+	}
+	delete embedded;
+	stream->Release();
+	if (!ok) {
+		free(pixels);
+		return false;
+	}
+	pixel_bake_sse2(pixels, pixels, (uint64_t)thumb_width * thumb_height, bg_color);
+	out_thumbnail->pixels = pixels;
+	out_thumbnail->width = thumb_width;
+	out_thumbnail->height = thumb_height;
+	out_thumbnail->reduced = true;
+	return true;
+}
+
+static bool _read_gdiplus(const WCHAR* path, int max_size, uint32_t bg_color,
+	thumbnail_t* out_thumbnail)
+{
+	Gdiplus::Bitmap bitmap(path);
+	if (bitmap.GetLastStatus() != Gdiplus::Ok)
+		return false;
+	int width = bitmap.GetWidth();
+	int height = bitmap.GetHeight();
+	out_thumbnail->image_width = width;
+	out_thumbnail->image_height = height;
+	if (!width || !height)
+		return false;
+	if (_read_embedded(&bitmap, max_size, bg_color, out_thumbnail))
+		return true;
+
+	// straight into a buffer of ours, rather than GDI+'s and then a copy
+	uint32_t* pixels = (uint32_t*)malloc((size_t)width * height * sizeof(uint32_t));
+	if (!pixels)
+		return false;
+	Gdiplus::BitmapData data;
+	data.Width = width;
+	data.Height = height;
+	data.Stride = width * 4;
+	data.PixelFormat = PixelFormat32bppPARGB;
+	data.Scan0 = pixels;
+	data.Reserved = 0;
+	Gdiplus::Rect rect(0, 0, width, height);
+	bool ok = bitmap.LockBits(&rect,
+		Gdiplus::ImageLockModeRead | Gdiplus::ImageLockModeUserInputBuf,
+		PixelFormat32bppPARGB, &data) == Gdiplus::Ok;
+	if (ok) {
+		bitmap.UnlockBits(&data);
+		ok = _finish(pixels, width, height, max_size, bg_color, out_thumbnail);
+	}
+	free(pixels);
+	return ok;
+}
+
+bool thumbnail_read(const WCHAR* path, int max_size, uint32_t bg_color,
+	thumbnail_t* out_thumbnail)
+{
+	ZeroMemory(out_thumbnail, sizeof(*out_thumbnail));
+	uint64_t start = trace_begin();
+	bool ok;
+	texture_t* texture = texture_file_open(path);
+	if (texture) {
+		ok = _read_texture(texture, max_size, bg_color, out_thumbnail);
+		texture_free(texture);
+	}
+	else if (yuv_file_is_yuv(path)) {
+		// raw frames have no smaller version to read
+		HBITMAP hbitmap;
+		void* bits;
+		int width, height;
+		ok = canvas_read_image(path, &hbitmap, &bits, &width, &height);
+		if (ok) {
+			out_thumbnail->image_width = width;
+			out_thumbnail->image_height = height;
+			ok = _finish((const uint32_t*)bits, width, height, max_size, bg_color, out_thumbnail);
+			DeleteObject(hbitmap);
+		}
+	}
+	else {
+		ok = _read_gdiplus(path, max_size, bg_color, out_thumbnail);
+	}
+	if (!ok) {
+		thumbnail_free(out_thumbnail);
+		return false;
+	}
+	uint64_t num_pixels = (uint64_t)out_thumbnail->width * out_thumbnail->height;
+	trace_end(TRACE_THUMBNAIL, start, num_pixels * 4, num_pixels);
+	return true;
+}
+
+void thumbnail_free(thumbnail_t* thumbnail)
+{
+	free(thumbnail->pixels);
+	ZeroMemory(thumbnail, sizeof(*thumbnail));
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Small images of files for the thumbnail grid, read at reduced resolution
+// where the format allows: a JPEG's embedded EXIF thumbnail, when it is at
+// least as large as asked for, or the smallest mip of a texture that is.
+// Anything else is decoded in full, then halved with the canvas's box
+// filter, and resampled down to fit for the last step.  Safe on any
+// thread.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+	uint32_t* pixels;	// top-down 32bpp, baked over bg_color. free().
+	int width;
+	int height;
+	// of the full image
+	int image_width;
+	int image_height;
+	// from an embedded thumbnail or a mip, not the full image
+	bool reduced;
+} thumbnail_t;
+
+// fits the thumbnail within max_size x max_size, keeping the aspect ratio
+bool thumbnail_read(const WCHAR* path, int max_size, uint32_t bg_color,
+	thumbnail_t* out_thumbnail);
+void thumbnail_free(thumbnail_t* thumbnail);
+
+#ifdef __cplusplus
+}
+#endif
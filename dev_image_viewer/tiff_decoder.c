@@ -0,0 +1,381 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "tiff_decoder.h"
+
+#define TIFF_IMAGE_WIDTH 256
+#define TIFF_IMAGE_LENGTH 257
+#define TIFF_BITS_PER_SAMPLE 258
+#define TIFF_COMPRESSION 259
+#define TIFF_PHOTOMETRIC 262
+#define TIFF_STRIP_OFFSETS 273
+#define TIFF_SAMPLES_PER_PIXEL 277
+#define TIFF_ROWS_PER_STRIP 278
+#define TIFF_STRIP_BYTE_COUNTS 279
+#define TIFF_PLANAR_CONFIGURATION 284
+#define TIFF_PREDICTOR 317
+#define TIFF_TILE_WIDTH 322
+#define TIFF_TILE_LENGTH 323
+#define TIFF_TILE_OFFSETS 324
+#define TIFF_TILE_BYTE_COUNTS 325
+#define TIFF_EXTRA_SAMPLES 338
+#define TIFF_SAMPLE_FORMAT 339
+
+#define TIFF_COMPRESSION_NONE 1
+#define TIFF_COMPRESSION_PACKBITS 32773
+#define TIFF_PHOTOMETRIC_WHITE_IS_ZERO 0
+#define TIFF_PHOTOMETRIC_RGB 2
+#define TIFF_ALPHA_ASSOCIATED 1
+#define TIFF_ALPHA_UNASSOCIATED 2
+
+// sanity limit, so a corrupt header can't overflow the size arithmetic
+#define TIFF_MAX_SIZE 1000000
+
+// an array of values in the file
+typedef struct {
+	uint64_t offset;
+	int bytes;	// each
+	uint64_t count;
+} _array_t;
+
+struct tiff_decoder_t {
+	// of the file
+	size_t size;
+	bool big_endian;
+	bool big_tiff;
+
+	int width;
+	int height;
+	int samples;
+	int bytes_per_sample;
+	bool grey;
+	bool white_is_zero;
+	int alpha;	// 0, or TIFF_ALPHA_ASSOCIATED or TIFF_ALPHA_UNASSOCIATED
+	int compression;
+
+	// strips are chunks as wide as the image
+	int chunk_width;
+	int chunk_height;
+	int chunks_x;
+	int chunks_y;
+	_array_t offsets;
+	_array_t byte_counts;
+};
+
+static uint64_t _uint(const tiff_decoder_t* decoder, const uint8_t* p, int bytes)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; i++) {
+		int shift = decoder->big_endian ? (bytes - 1 - i) * 8 : i * 8;
+		value |= (uint64_t)p[i] << shift;
+	}
+	return value;
+}
+
+// the values of an IFD entry, which are in it if they fit
+static bool _entry_array(const tiff_decoder_t* decoder, const uint8_t* data,
+	const uint8_t* entry, _array_t* out_array)
+{
+	switch (_uint(decoder, entry + 2, 2)) {
+	case 1: out_array->bytes = 1; break;	// BYTE
+	case 3: out_array->bytes = 2; break;	// SHORT
+	case 4: out_array->bytes = 4; break;	// LONG
+	case 16: out_array->bytes = 8; break;	// LONG8
+	default: return false;
+	}
+	int inline_size = decoder->big_tiff ? 8 : 4;
+	out_array->count = _uint(decoder, entry + 4, inline_size);
+	const uint8_t* value = entry + 4 + inline_size;
+	if (out_array->count == 0 || out_array->count > decoder->size)
+		return false;
+	uint64_t bytes = out_array->count * out_array->bytes;
+	if (bytes <= (uint64_t)inline_size) {
+		out_array->offset = value - data;
+		return true;
+	}
+	uint64_t offset = _uint(decoder, value, inline_size);
+	if (offset > decoder->size || bytes > decoder->size - offset)
+		return false;
+	out_array->offset = offset;
+	return true;
+}
+
+static uint64_t _array_get(const tiff_decoder_t* decoder, const uint8_t* data,
+	const _array_t* array, uint64_t index)
+{
+	return _uint(decoder, data + array->offset + index * array->bytes, array->bytes);
+}
+
+static bool _parse_ifd(tiff_decoder_t* decoder, const uint8_t* data)
+{
+	uint64_t ifd;
+	if (decoder->big_tiff) {
+		if (decoder->size < 16 || _uint(decoder, data + 4, 2) != 8)
+			return false;
+		ifd = _uint(decoder, data + 8, 8);
+	}
+	else {
+		ifd = _uint(decoder, data + 4, 4);
+	}
+	int count_size = decoder->big_tiff ? 8 : 2;
+	int entry_size = decoder->big_tiff ? 20 : 12;
+	if (ifd > decoder->size || (uint64_t)count_size > decoder->size - ifd)
+		return false;
+	uint64_t num_entries = _uint(decoder, data + ifd, count_size);
+	if (num_entries > (decoder->size - ifd - count_size) / entry_size)
+		return false;
+
+	uint64_t bits = 1, samples = 1, photometric = 1, extra = 0;
+	uint64_t planar = 1, predictor = 1, sample_format = 1, compression = 1;
+	uint64_t rows_per_strip = 0, tile_width = 0, tile_height = 0;
+	uint64_t width = 0, height = 0;
+	_array_t strip_offsets = { 0 }, strip_counts = { 0 };
+	_array_t tile_offsets = { 0 }, tile_counts = { 0 };
+	for (uint64_t i = 0; i < num_entries; i++) {
+		const uint8_t* entry = data + ifd + count_size + i * entry_size;
+		_array_t array;
+		if (!_entry_array(decoder, data, entry, &array))
+			continue;
+		uint64_t value = _array_get(decoder, data, &array, 0);
+		switch (_uint(decoder, entry, 2)) {
+		case TIFF_IMAGE_WIDTH: width = value; break;
+		case TIFF_IMAGE_LENGTH: height = value; break;
+		case TIFF_BITS_PER_SAMPLE: bits = value; break;
+		case TIFF_COMPRESSION: compression = value; break;
+		case TIFF_PHOTOMETRIC: photometric = value; break;
+		case TIFF_STRIP_OFFSETS: strip_offsets = array; break;
+		case TIFF_SAMPLES_PER_PIXEL: samples = value; break;
+		case TIFF_ROWS_PER_STRIP: rows_per_strip = value; break;
+		case TIFF_STRIP_BYTE_COUNTS: strip_counts = array; break;
+		case TIFF_PLANAR_CONFIGURATION: planar = value; break;
+		case TIFF_PREDICTOR: predictor = value; break;
+		case TIFF_TILE_WIDTH: tile_width = value; break;
+		case TIFF_TILE_LENGTH: tile_height = value; break;
+		case TIFF_TILE_OFFSETS: tile_offsets = array; break;
+		case TIFF_TILE_BYTE_COUNTS: tile_counts = array; break;
+		case TIFF_EXTRA_SAMPLES: extra = value; break;
+		case TIFF_SAMPLE_FORMAT: sample_format = value; break;
+		}
+	}
+
+	if (width == 0 || height == 0 || width > TIFF_MAX_SIZE || height > TIFF_MAX_SIZE ||
+		(bits != 8 && bits != 16) || planar != 1 || predictor != 1 || sample_format != 1 ||
+		(compression != TIFF_COMPRESSION_NONE && compression != TIFF_COMPRESSION_PACKBITS))
+		return false;
+	decoder->width = (int)width;
+	decoder->height = (int)height;
+	decoder->bytes_per_sample = (int)bits / 8;
+	decoder->compression = (int)compression;
+	decoder->grey = photometric != TIFF_PHOTOMETRIC_RGB;
+	decoder->white_is_zero = photometric == TIFF_PHOTOMETRIC_WHITE_IS_ZERO;
+	if (photometric > TIFF_PHOTOMETRIC_RGB)
+		return false;
+	int colors = decoder->grey ? 1 : 3;
+	if (samples < (uint64_t)colors || samples > 8)
+		return false;
+	decoder->samples = (int)samples;
+	if (samples > (uint64_t)colors &&
+		(extra == TIFF_ALPHA_ASSOCIATED || extra == TIFF_ALPHA_UNASSOCIATED))
+		decoder->alpha = (int)extra;
+
+	if (tile_width && tile_height && tile_offsets.count && tile_counts.count) {
+		if (tile_width > TIFF_MAX_SIZE || tile_height > TIFF_MAX_SIZE)
+			return false;
+		decoder->chunk_width = (int)tile_width;
+		decoder->chunk_height = (int)tile_height;
+		decoder->offsets = tile_offsets;
+		decoder->byte_counts = tile_counts;
+	}
+	else if (strip_offsets.count && strip_counts.count) {
+		decoder->chunk_width = decoder->width;
+		decoder->chunk_height = rows_per_strip && rows_per_strip < height ?
+			(int)rows_per_strip : decoder->height;
+		decoder->offsets = strip_offsets;
+		decoder->byte_counts = strip_counts;
+	}
+	else {
+		return false;
+	}
+	decoder->chunks_x = (decoder->width + decoder->chunk_width - 1) / decoder->chunk_width;
+	decoder->chunks_y = (decoder->height + decoder->chunk_height - 1) / decoder->chunk_height;
+	uint64_t num_chunks = (uint64_t)decoder->chunks_x * decoder->chunks_y;
+	return decoder->offsets.count >= num_chunks && decoder->byte_counts.count >= num_chunks;
+}
+
+tiff_decoder_t* tiff_decoder_open(const uint8_t* data, size_t size)
+{
+	if (size < 8)
+		return NULL;
+	bool big_endian = !memcmp(data, "MM", 2);
+	if (!big_endian && memcmp(data, "II", 2))
+		return NULL;
+	tiff_decoder_t* decoder = (tiff_decoder_t*)calloc(1, sizeof(tiff_decoder_t));
+	if (!decoder)
+		return NULL;
+	decoder->size = size;
+	decoder->big_endian = big_endian;
+	uint64_t version = _uint(decoder, data + 2, 2);
+	decoder->big_tiff = version == 43;
+	if ((version != 42 && version != 43) || !_parse_ifd(decoder, data)) {
+		free(decoder);
+		return NULL;
+	}
+	return decoder;
+}
+
+void tiff_decoder_free(tiff_decoder_t* decoder)
+{
+	free(decoder);
+}
+
+void tiff_decoder_get_size(const tiff_decoder_t* decoder, int* out_width,
+	int* out_height)
+{
+	*out_width = decoder->width;
+	*out_height = decoder->height;
+}
+
+// the bytes of a strip or tile, as stored
+static bool _chunk(const tiff_decoder_t* decoder, const uint8_t* data, int index,
+	const uint8_t** out_data, size_t* out_size)
+{
+	uint64_t offset = _array_get(decoder, data, &decoder->offsets, index);
+	uint64_t size = _array_get(decoder, data, &decoder->byte_counts, index);
+	if (offset > decoder->size)
+		return false;
+	if (size > decoder->size - offset)
+		size = decoder->size - offset;
+	*out_data = data + offset;
+	*out_size = (size_t)size;
+	return true;
+}
+
+// returns the bytes unpacked
+static size_t _unpack_bits(const uint8_t* src, size_t size, uint8_t* dest,
+	size_t capacity)
+{
+	size_t i = 0;
+	size_t n = 0;
+	while (i < size && n < capacity) {
+		int header = (int8_t)src[i++];
+		if (header >= 0) {
+			// a run of literal bytes
+			size_t count = (size_t)header + 1;
+			if (count > size - i)
+				count = size - i;
+			if (count > capacity - n)
+				count = capacity - n;
+			memcpy(dest + n, src + i, count);
+			i += (size_t)header + 1;
+			n += count;
+		}
+		else if (header != -128) {
+			// one byte repeated
+			if (i >= size)
+				break;
+			size_t count = (size_t)(1 - header);
+			if (count > capacity - n)
+				count = capacity - n;
+			memset(dest + n, src[i++], count);
+			n += count;
+		}
+	}
+	return n;
+}
+
+static uint32_t _pixel(const tiff_decoder_t* decoder, const uint8_t* p)
+{
+	// 16-bit samples keep their top 8 bits
+	int high = decoder->bytes_per_sample == 2 && !decoder->big_endian ? 1 : 0;
+	int step = decoder->bytes_per_sample;
+	uint32_t r, g, b, a = 255;
+	int colors = decoder->grey ? 1 : 3;
+	if (decoder->grey) {
+		r = p[high];
+		if (decoder->white_is_zero)
+			r = 255 - r;
+		g = r;
+		b = r;
+	}
+	else {
+		r = p[high];
+		g = p[step + high];
+		b = p[step * 2 + high];
+	}
+	if (decoder->alpha) {
+		a = p[step * colors + high];
+		if (decoder->alpha == TIFF_ALPHA_UNASSOCIATED) {
+			r = (r * a + 127) / 255;
+			g = (g * a + 127) / 255;
+			b = (b * a + 127) / 255;
+		}
+	}
+	return (a << 24) | (r << 16) | (g << 8) | b;
+}
+
+// the first of x0 + i * step at or past from
+static int _first_sample(int from, int x0, int step)
+{
+	return from <= x0 ? x0 : x0 + (from - x0 + step - 1) / step * step;
+}
+
+int tiff_decoder_get_band_height(const tiff_decoder_t* decoder)
+{
+	return decoder->compression == TIFF_COMPRESSION_NONE ? 1 : decoder->chunk_height;
+}
+
+bool tiff_decoder_read(const tiff_decoder_t* decoder, const uint8_t* data,
+	int x0, int y0, int x1, int y1, int step, uint32_t* dest, int stride)
+{
+	if (x0 < 0 || y0 < 0 || x1 > decoder->width || y1 > decoder->height ||
+		x0 >= x1 || y0 >= y1 || step < 1)
+		return false;
+	int pixel_bytes = decoder->samples * decoder->bytes_per_sample;
+	size_t row_bytes = (size_t)decoder->chunk_width * pixel_bytes;
+	size_t chunk_bytes = row_bytes * decoder->chunk_height;
+	uint8_t* unpacked = NULL;
+	if (decoder->compression == TIFF_COMPRESSION_PACKBITS) {
+		unpacked = (uint8_t*)malloc(chunk_bytes);
+		if (!unpacked)
+			return false;
+	}
+
+	bool ok = true;
+	int chunk_y1 = (y1 - 1) / decoder->chunk_height + 1;
+	int chunk_x1 = (x1 - 1) / decoder->chunk_width + 1;
+	for (int chunk_y = y0 / decoder->chunk_height; ok && chunk_y < chunk_y1; chunk_y++) {
+		int top = chunk_y * decoder->chunk_height;
+		int bottom = top + decoder->chunk_height < y1 ? top + decoder->chunk_height : y1;
+		int first_y = _first_sample(top, y0, step);
+		if (first_y >= bottom)
+			continue;
+		for (int chunk_x = x0 / decoder->chunk_width; ok && chunk_x < chunk_x1; chunk_x++) {
+			int left = chunk_x * decoder->chunk_width;
+			int right = left + decoder->chunk_width < x1 ? left + decoder->chunk_width : x1;
+			int first_x = _first_sample(left, x0, step);
+			if (first_x >= right)
+				continue;
+			const uint8_t* chunk;
+			size_t chunk_size;
+			ok = _chunk(decoder, data, chunk_y * decoder->chunks_x + chunk_x, &chunk, &chunk_size);
+			if (ok && unpacked) {
+				chunk_size = _unpack_bits(chunk, chunk_size, unpacked, chunk_bytes);
+				chunk = unpacked;
+			}
+			for (int y = first_y; ok && y < bottom; y += step) {
+				const uint8_t* row = chunk + (size_t)(y - top) * row_bytes;
+				size_t row_offset = (size_t)(y - top) * row_bytes;
+				uint32_t* out = dest + (size_t)((y - y0) / step) * stride +
+					(first_x - x0) / step;
+				for (int x = first_x; x < right; x += step) {
+					size_t at = (size_t)(x - left) * pixel_bytes;
+					// short strips leave the rest transparent
+					*out++ = row_offset + at + pixel_bytes <= chunk_size ?
+						_pixel(decoder, row + at) : 0;
+				}
+			}
+		}
+	}
+	free(unpacked);
+	return ok;
+}
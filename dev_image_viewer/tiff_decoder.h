@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// TIFF and BigTIFF, decoded a rectangle at a time, for images too large
+// to decode whole.  Strips and tiles are found through the first IFD's
+// offsets, so a rectangle costs only the ones it crosses.  Uncompressed
+// and PackBits files of 8 or 16 bits per sample, in greyscale or RGB,
+// with or without alpha, interleaved, are supported.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct tiff_decoder_t tiff_decoder_t;
+
+// data is the whole file. NULL if it isn't a TIFF that can be decoded.
+// the first IFD is parsed here, and its arrays are kept as offsets.
+tiff_decoder_t* tiff_decoder_open(const uint8_t* data, size_t size);
+void tiff_decoder_free(tiff_decoder_t* decoder);
+
+void tiff_decoder_get_size(const tiff_decoder_t* decoder, int* out_width,
+	int* out_height);
+
+// the fewest rows that read together decode nothing twice: a strip or row
+// of tiles when compressed, else a single row
+int tiff_decoder_get_band_height(const tiff_decoder_t* decoder);
+
+// the pixels at x0 + i * step, y0 + j * step inside [x0, x1) x [y0, y1),
+// into rows of dest stride pixels apart, as premultiplied BGRA.  data is
+// the same bytes the decoder was opened with, at any address.  safe to call
+// from several threads at once.
+bool tiff_decoder_read(const tiff_decoder_t* decoder, const uint8_t* data,
+	int x0, int y0, int x1, int y1, int step, uint32_t* dest, int stride);
+
+#ifdef __cplusplus
+}
+#endif
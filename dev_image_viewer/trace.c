@@ -0,0 +1,155 @@
+#include "dev_image_viewer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <intrin.h>
+
+#include "trace.h"
+
+// must be a power of 2. the oldest events are overwritten.
+#define TRACE_MAX_EVENTS (64 * 1024)
+
+typedef struct {
+	uint64_t start;
+	uint64_t end;
+	uint64_t bytes;
+	uint64_t pixels;
+	DWORD thread_id;
+	int stage;
+} trace_event_t;
+
+static const char* const trace_stage_names[TRACE_NUM_STAGES] = {
+	"load",
+	"decode",
+	"copy",
+	"bake",
+	"downsize",
+	"update",
+	"paint",
+	"cache_compress",
+	"cache_decompress",
+	"codec_band",
+	"disk_store",
+	"disk_map",
+	"diff",
+	"stats",
+	"region_stats",
+	"thumbnail",
+};
+
+static volatile LONG trace_enabled = 0;
+static trace_event_t* trace_events = NULL;
+static volatile LONG64 trace_next_event = 0;
+
+// written by whichever thread ends a scope, read by the UI thread. a torn
+// read only shows one odd number.
+static trace_last_t trace_last[TRACE_NUM_STAGES];
+static bool trace_have_last[TRACE_NUM_STAGES];
+
+// for converting ticks, calibrated against QueryPerformanceCounter() over
+// the time since trace_init()
+static uint64_t trace_start_ticks = 0;
+static LARGE_INTEGER trace_start_counter;
+
+void trace_init()
+{
+	QueryPerformanceCounter(&trace_start_counter);
+	trace_start_ticks = __rdtsc();
+}
+
+static double _ticks_per_second()
+{
+	LARGE_INTEGER freq, counter;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&counter);
+	uint64_t ticks = __rdtsc();
+	double seconds = (double)(counter.QuadPart - trace_start_counter.QuadPart) / freq.QuadPart;
+	if (seconds <= 0 || ticks <= trace_start_ticks)
+		return 1e9;	// just started. a guess, rather than a divide by 0.
+	return (ticks - trace_start_ticks) / seconds;
+}
+
+void trace_set_enabled(bool enabled)
+{
+	if (enabled && !trace_events) {
+		trace_events = (trace_event_t*)calloc(TRACE_MAX_EVENTS, sizeof(trace_event_t));
+		if (!trace_events)
+			return;
+	}
+	InterlockedExchange(&trace_enabled, enabled ? 1 : 0);
+}
+
+bool trace_is_enabled()
+{
+	return trace_enabled != 0;
+}
+
+uint64_t trace_begin()
+{
+	return __rdtsc();
+}
+
+uint64_t trace_end(trace_stage_t stage, uint64_t start, uint64_t bytes,
+	uint64_t pixels)
+{
+	uint64_t end = __rdtsc();
+	uint64_t ticks = end - start;
+
+	trace_last[stage].seconds = trace_seconds(ticks);
+	trace_last[stage].bytes = bytes;
+	trace_last[stage].pixels = pixels;
+	trace_have_last[stage] = true;
+
+	if (trace_enabled) {
+		LONG64 index = InterlockedIncrement64(&trace_next_event) - 1;
+		trace_event_t* event = &trace_events[index & (TRACE_MAX_EVENTS - 1)];
+		event->start = start;
+		event->end = end;
+		event->bytes = bytes;
+		event->pixels = pixels;
+		event->thread_id = GetCurrentThreadId();
+		event->stage = stage;
+	}
+	return ticks;
+}
+
+double trace_seconds(uint64_t ticks)
+{
+	return ticks / _ticks_per_second();
+}
+
+bool trace_get_last(trace_stage_t stage, trace_last_t* last)
+{
+	if (stage < 0 || stage >= TRACE_NUM_STAGES || !trace_have_last[stage])
+		return false;
+	*last = trace_last[stage];
+	return true;
+}
+
+bool trace_write_chrome(const WCHAR* path)
+{
+	FILE* out = _wfopen(path, L"w");
+	if (!out)
+		return false;
+
+	double us_per_tick = 1e6 / _ticks_per_second();
+	DWORD pid = GetCurrentProcessId();
+	fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+
+	LONG64 next = trace_next_event;
+	LONG64 first = next > TRACE_MAX_EVENTS ? next - TRACE_MAX_EVENTS : 0;
+	for (LONG64 i = first; trace_events && i < next; i++) {
+		const trace_event_t* event = &trace_events[i & (TRACE_MAX_EVENTS - 1)];
+		fprintf(out, "%s\n{\"name\": \"%s\", \"cat\": \"stage\", \"ph\": \"X\", "
+			"\"ts\": %.3f, \"dur\": %.3f, \"pid\": %lu, \"tid\": %lu, "
+			"\"args\": {\"bytes\": %llu, \"pixels\": %llu}}",
+			i == first ? "" : ",", trace_stage_names[event->stage],
+			(double)(int64_t)(event->start - trace_start_ticks) * us_per_tick,
+			(double)(event->end - event->start) * us_per_tick,
+			(unsigned long)pid, (unsigned long)event->thread_id,
+			(unsigned long long)event->bytes, (unsigned long long)event->pixels);
+	}
+
+	fprintf(out, "\n]}\n");
+	return fclose(out) == 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Timing of the stages of loading and showing an image, from the TSC.
+// Scopes are always measured, and the last of each stage is kept for the
+// status bar readout.  While tracing is on, every scope is also recorded
+// into a ring of events, which can be written out in the Chrome trace
+// event format, for chrome://tracing or ui.perfetto.dev.
+//
+//   uint64_t start = trace_begin();
+//   ...
+//   trace_end(TRACE_BAKE, start, bytes, pixels);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	TRACE_LOAD,			// a whole load or reload
+	TRACE_DECODE,		// GDI+ decode into its own bitmap
+	TRACE_COPY,			// from the GDI+ bitmap into the level 0 DIB
+	TRACE_BAKE,
+	TRACE_DOWNSIZE,
+	TRACE_UPDATE,		// incremental reload: compare, bake, downsize tiles
+	TRACE_PAINT,
+	TRACE_CACHE_COMPRESS,
+	TRACE_CACHE_DECOMPRESS,
+	TRACE_CODEC_BAND,	// one band of the pixel codec, on a worker
+	TRACE_DISK_STORE,
+	TRACE_DISK_MAP,
+	TRACE_DIFF,			// compare tiles or statistics, see compare.h
+	TRACE_STATS,		// histograms, see image_stats.h
+	TRACE_REGION_STATS,	// summed-area tables, see region_stats.h
+	TRACE_THUMBNAIL,	// one, on a worker. see thumbnail.h
+	TRACE_NUM_STAGES,
+} trace_stage_t;
+
+typedef struct {
+	double seconds;
+	uint64_t bytes;
+	uint64_t pixels;
+} trace_last_t;
+
+// call once, before any scope
+void trace_init();
+
+void trace_set_enabled(bool enabled);
+bool trace_is_enabled();
+
+uint64_t trace_begin();
+// returns the ticks since start
+uint64_t trace_end(trace_stage_t stage, uint64_t start, uint64_t bytes,
+	uint64_t pixels);
+double trace_seconds(uint64_t ticks);
+
+// the last scope of a stage to end. false if there hasn't been one.
+bool trace_get_last(trace_stage_t stage, trace_last_t* last);
+
+// writes the recorded events, oldest first, and keeps them
+bool trace_write_chrome(const WCHAR* path);
+
+#ifdef __cplusplus
+}
+#endif
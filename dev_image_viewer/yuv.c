@@ -0,0 +1,371 @@
+#include <string.h>
+#include <emmintrin.h>
+
+#include "yuv.h"
+
+// fractional bits of the conversion coefficients
+#define YUV_SHIFT 13
+
+// where the samples of a frame are. steps and strides are in bytes.
+typedef struct {
+	const uint8_t* y;
+	const uint8_t* u;
+	const uint8_t* v;
+	int y_step;
+	int c_step;
+	size_t y_stride;
+	size_t c_stride;
+	int c_row_shift;	// 1 when chroma rows are shared by two rows
+	bool wide;			// 16-bit samples, with 10 bits at the top
+} yuv_planes_t;
+
+// with samples less their offsets: R = cy y + crv v, G = cy y - cgu u -
+// cgv v, B = cy y + cbu u, all shifted down by YUV_SHIFT
+typedef struct {
+	int y_offset;
+	int c_offset;
+	int cy;
+	int crv;
+	int cbu;
+	int cgu;
+	int cgv;
+} yuv_coeffs_t;
+
+static void _planes(const yuv_layout_t* layout, const uint8_t* frame,
+	yuv_planes_t* planes)
+{
+	int width = layout->width;
+	int height = layout->height;
+	int c_width = (width + 1) / 2;
+	int c_height = (height + 1) / 2;
+	size_t luma_bytes = (size_t)width * height;
+	planes->c_row_shift = 1;
+	planes->wide = false;
+	planes->y = frame;
+	switch (layout->format) {
+	case YUV_I420:
+		planes->u = frame + luma_bytes;
+		planes->v = planes->u + (size_t)c_width * c_height;
+		planes->y_step = 1;
+		planes->c_step = 1;
+		planes->y_stride = width;
+		planes->c_stride = c_width;
+		break;
+	case YUV_NV12:
+		planes->u = frame + luma_bytes;
+		planes->v = planes->u + 1;
+		planes->y_step = 1;
+		planes->c_step = 2;
+		planes->y_stride = width;
+		planes->c_stride = (size_t)c_width * 2;
+		break;
+	case YUV_YUY2:
+		planes->u = frame + 1;
+		planes->v = frame + 3;
+		planes->y_step = 2;
+		planes->c_step = 4;
+		planes->y_stride = (size_t)c_width * 4;
+		planes->c_stride = planes->y_stride;
+		planes->c_row_shift = 0;
+		break;
+	default:
+		planes->u = frame + luma_bytes * 2;
+		planes->v = planes->u + 2;
+		planes->y_step = 2;
+		planes->c_step = 4;
+		planes->y_stride = (size_t)width * 2;
+		planes->c_stride = (size_t)c_width * 4;
+		planes->wide = true;
+		break;
+	}
+}
+
+static void _coeffs(const yuv_layout_t* layout, yuv_coeffs_t* coeffs)
+{
+	double kr, kb;
+	switch (layout->matrix) {
+	case YUV_BT709: kr = 0.2126; kb = 0.0722; break;
+	case YUV_BT2020: kr = 0.2627; kb = 0.0593; break;
+	default: kr = 0.299; kb = 0.114; break;
+	}
+	double kg = 1.0 - kr - kb;
+
+	// samples are 10 bits for P010, once shifted down
+	int scale = layout->format == YUV_P010 ? 4 : 1;
+	double y_gain, c_gain;
+	if (layout->full_range) {
+		coeffs->y_offset = 0;
+		y_gain = 255.0 / (255 * scale + scale - 1);
+		c_gain = y_gain;
+	}
+	else {
+		coeffs->y_offset = 16 * scale;
+		y_gain = 255.0 / (219 * scale);
+		c_gain = 255.0 / (224 * scale);
+	}
+	coeffs->c_offset = 128 * scale;
+
+	double one = 1 << YUV_SHIFT;
+	coeffs->cy = (int)(y_gain * one + 0.5);
+	coeffs->crv = (int)(2 * (1 - kr) * c_gain * one + 0.5);
+	coeffs->cbu = (int)(2 * (1 - kb) * c_gain * one + 0.5);
+	coeffs->cgu = (int)(2 * kb * (1 - kb) / kg * c_gain * one + 0.5);
+	coeffs->cgv = (int)(2 * kr * (1 - kr) / kg * c_gain * one + 0.5);
+}
+
+size_t yuv_frame_bytes(const yuv_layout_t* layout)
+{
+	size_t width = layout->width;
+	size_t height = layout->height;
+	size_t chroma = ((width + 1) / 2) * ((height + 1) / 2) * 2;
+	switch (layout->format) {
+	case YUV_I420:
+	case YUV_NV12:
+		return width * height + chroma;
+	case YUV_YUY2:
+		return (width + 1) / 2 * 4 * height;
+	default:
+		return (width * height + chroma) * 2;
+	}
+}
+
+void yuv_view_size(const yuv_layout_t* layout, yuv_view_t view, int* out_width,
+	int* out_height)
+{
+	if (view == YUV_VIEW_COLOR || view == YUV_VIEW_Y) {
+		*out_width = layout->width;
+		*out_height = layout->height;
+		return;
+	}
+	*out_width = (layout->width + 1) / 2;
+	*out_height = layout->format == YUV_YUY2 ? layout->height : (layout->height + 1) / 2;
+}
+
+const char* yuv_format_name(yuv_format_t format)
+{
+	switch (format) {
+	case YUV_I420: return "I420";
+	case YUV_NV12: return "NV12";
+	case YUV_YUY2: return "YUY2";
+	case YUV_P010: return "P010";
+	}
+	return "unknown";
+}
+
+const char* yuv_matrix_name(yuv_matrix_t matrix)
+{
+	switch (matrix) {
+	case YUV_BT601: return "BT.601";
+	case YUV_BT709: return "BT.709";
+	case YUV_BT2020: return "BT.2020";
+	}
+	return "unknown";
+}
+
+static int _sample(const uint8_t* p, bool wide)
+{
+	return wide ? (p[0] | (p[1] << 8)) >> 6 : p[0];
+}
+
+static uint32_t _clamp(int value)
+{
+	return value < 0 ? 0 : value > 255 ? 255 : (uint32_t)value;
+}
+
+static uint32_t _yuv_pixel(const yuv_coeffs_t* k, int y, int u, int v)
+{
+	const int round = 1 << (YUV_SHIFT - 1);
+	y -= k->y_offset;
+	u -= k->c_offset;
+	v -= k->c_offset;
+	uint32_t r = _clamp((k->cy * y + k->crv * v + round) >> YUV_SHIFT);
+	uint32_t g = _clamp((k->cy * y - k->cgu * u - k->cgv * v + round) >> YUV_SHIFT);
+	uint32_t b = _clamp((k->cy * y + k->cbu * u + round) >> YUV_SHIFT);
+	return 0xFF000000 | (r << 16) | (g << 8) | b;
+}
+
+// converts pixels [x0, width) of a row
+static void _color_row_naive(const yuv_planes_t* planes, const yuv_coeffs_t* k,
+	int row, int x0, int width, uint32_t* dest)
+{
+	const uint8_t* y_row = planes->y + row * planes->y_stride;
+	size_t c_offset = (size_t)(row >> planes->c_row_shift) * planes->c_stride;
+	const uint8_t* u_row = planes->u + c_offset;
+	const uint8_t* v_row = planes->v + c_offset;
+	for (int x = x0; x < width; x++) {
+		int c = (x >> 1) * planes->c_step;
+		dest[x] = _yuv_pixel(k,
+			_sample(y_row + (size_t)x * planes->y_step, planes->wide),
+			_sample(u_row + c, planes->wide),
+			_sample(v_row + c, planes->wide));
+	}
+}
+
+// a plane as grey, 8 bits from the top of its samples
+static void _plane_rows(const yuv_layout_t* layout, const yuv_planes_t* planes,
+	yuv_view_t view, int y0, int y1, uint32_t* dest)
+{
+	int width, height;
+	yuv_view_size(layout, view, &width, &height);
+	const uint8_t* base = view == YUV_VIEW_Y ? planes->y :
+		view == YUV_VIEW_U ? planes->u : planes->v;
+	int step = view == YUV_VIEW_Y ? planes->y_step : planes->c_step;
+	size_t stride = view == YUV_VIEW_Y ? planes->y_stride : planes->c_stride;
+	int shift = planes->wide ? 2 : 0;
+	for (int y = y0; y < y1; y++) {
+		const uint8_t* row = base + y * stride;
+		uint32_t* out = dest + (size_t)y * width;
+		for (int x = 0; x < width; x++) {
+			uint32_t grey = _sample(row + (size_t)x * step, planes->wide) >> shift;
+			out[x] = 0xFF000000 | (grey * 0x010101);
+		}
+	}
+}
+
+void yuv_convert_naive(const yuv_layout_t* layout, yuv_view_t view,
+	const uint8_t* frame, int y0, int y1, uint32_t* dest)
+{
+	yuv_planes_t planes;
+	_planes(layout, frame, &planes);
+	if (view != YUV_VIEW_COLOR) {
+		_plane_rows(layout, &planes, view, y0, y1, dest);
+		return;
+	}
+	yuv_coeffs_t coeffs;
+	_coeffs(layout, &coeffs);
+	for (int y = y0; y < y1; y++) {
+		_color_row_naive(&planes, &coeffs, y, 0, layout->width,
+			dest + (size_t)y * layout->width);
+	}
+}
+
+void yuv_convert_samples(const yuv_layout_t* layout, const uint8_t* frame,
+	int x0, int y, int step, int count, uint32_t* dest)
+{
+	yuv_planes_t planes;
+	_planes(layout, frame, &planes);
+	yuv_coeffs_t coeffs;
+	_coeffs(layout, &coeffs);
+	const uint8_t* y_row = planes.y + (size_t)y * planes.y_stride;
+	size_t c_offset = (size_t)(y >> planes.c_row_shift) * planes.c_stride;
+	const uint8_t* u_row = planes.u + c_offset;
+	const uint8_t* v_row = planes.v + c_offset;
+	for (int i = 0, x = x0; i < count; i++, x += step) {
+		int c = (x >> 1) * planes.c_step;
+		dest[i] = _yuv_pixel(&coeffs,
+			_sample(y_row + (size_t)x * planes.y_step, planes.wide),
+			_sample(u_row + c, planes.wide),
+			_sample(v_row + c, planes.wide));
+	}
+}
+
+// from 8 interleaved U and V samples, 4 of each, in 16-bit lanes, the U
+// and V for each of 8 pixels
+static void _split_uv_sse2(__m128i uv, __m128i* u, __m128i* v)
+{
+	__m128i low = _mm_set1_epi32(0xFFFF);
+	__m128i us = _mm_and_si128(uv, low);
+	__m128i vs = _mm_srli_epi32(uv, 16);
+	*u = _mm_or_si128(us, _mm_slli_epi32(us, 16));
+	*v = _mm_or_si128(vs, _mm_slli_epi32(vs, 16));
+}
+
+// the matrix for 8 pixels, with y, u and v in 16-bit lanes
+static void _yuv8_sse2(const yuv_coeffs_t* k, __m128i y, __m128i u, __m128i v,
+	uint32_t* dest)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi32(1 << (YUV_SHIFT - 1));
+	// coefficient pairs, for _mm_madd_epi16() of interleaved samples
+	const __m128i k_r = _mm_set1_epi32((int)(((uint32_t)k->crv << 16) | k->cy));
+	const __m128i k_b = _mm_set1_epi32((int)(((uint32_t)k->cbu << 16) | k->cy));
+	const __m128i k_gu = _mm_set1_epi32((int)(((uint32_t)-k->cgu << 16) | k->cy));
+	const __m128i k_gv = _mm_set1_epi32((int)((uint32_t)-k->cgv << 16));
+	y = _mm_sub_epi16(y, _mm_set1_epi16((short)k->y_offset));
+	u = _mm_sub_epi16(u, _mm_set1_epi16((short)k->c_offset));
+	v = _mm_sub_epi16(v, _mm_set1_epi16((short)k->c_offset));
+
+	__m128i yv[2] = { _mm_unpacklo_epi16(y, v), _mm_unpackhi_epi16(y, v) };
+	__m128i yu[2] = { _mm_unpacklo_epi16(y, u), _mm_unpackhi_epi16(y, u) };
+	__m128i r[2], g[2], b[2];
+	for (int i = 0; i < 2; i++) {
+		r[i] = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yv[i], k_r), round), YUV_SHIFT);
+		b[i] = _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(yu[i], k_b), round), YUV_SHIFT);
+		g[i] = _mm_add_epi32(_mm_madd_epi16(yu[i], k_gu), _mm_madd_epi16(yv[i], k_gv));
+		g[i] = _mm_srai_epi32(_mm_add_epi32(g[i], round), YUV_SHIFT);
+	}
+	__m128i r8 = _mm_packus_epi16(_mm_packs_epi32(r[0], r[1]), zero);
+	__m128i g8 = _mm_packus_epi16(_mm_packs_epi32(g[0], g[1]), zero);
+	__m128i b8 = _mm_packus_epi16(_mm_packs_epi32(b[0], b[1]), zero);
+	__m128i bg = _mm_unpacklo_epi8(b8, g8);
+	__m128i ra = _mm_unpacklo_epi8(r8, _mm_set1_epi8((char)0xFF));
+	_mm_storeu_si128((__m128i*)dest, _mm_unpacklo_epi16(bg, ra));
+	_mm_storeu_si128((__m128i*)(dest + 4), _mm_unpackhi_epi16(bg, ra));
+}
+
+static __m128i _load_4(const uint8_t* p)
+{
+	int value;
+	memcpy(&value, p, sizeof(value));
+	return _mm_cvtsi32_si128(value);
+}
+
+// 8 pixels at a time, then the rest with the scalar code
+static void _color_row_sse2(const yuv_layout_t* layout, const yuv_planes_t* planes,
+	const yuv_coeffs_t* k, int row, uint32_t* dest)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+	const uint8_t* y_row = planes->y + row * planes->y_stride;
+	size_t c_offset = (size_t)(row >> planes->c_row_shift) * planes->c_stride;
+	const uint8_t* u_row = planes->u + c_offset;
+	const uint8_t* v_row = planes->v + c_offset;
+	int width = layout->width;
+	int x = 0;
+	for (; x + 8 <= width; x += 8) {
+		__m128i y, u, v;
+		switch (layout->format) {
+		case YUV_I420:
+			y = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(y_row + x)), zero);
+			u = _mm_unpacklo_epi8(_load_4(u_row + x / 2), zero);
+			v = _mm_unpacklo_epi8(_load_4(v_row + x / 2), zero);
+			u = _mm_unpacklo_epi16(u, u);
+			v = _mm_unpacklo_epi16(v, v);
+			break;
+		case YUV_NV12:
+			y = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(y_row + x)), zero);
+			_split_uv_sse2(_mm_unpacklo_epi8(
+				_mm_loadl_epi64((const __m128i*)(u_row + x)), zero), &u, &v);
+			break;
+		case YUV_YUY2:
+		{
+			__m128i packed = _mm_loadu_si128((const __m128i*)(y_row + 2 * x));
+			y = _mm_and_si128(packed, low_bytes);
+			_split_uv_sse2(_mm_srli_epi16(packed, 8), &u, &v);
+			break;
+		}
+		default:
+			y = _mm_srli_epi16(_mm_loadu_si128((const __m128i*)(y_row + 2 * x)), 6);
+			_split_uv_sse2(_mm_srli_epi16(
+				_mm_loadu_si128((const __m128i*)(u_row + 2 * x)), 6), &u, &v);
+			break;
+		}
+		_yuv8_sse2(k, y, u, v, dest + x);
+	}
+	_color_row_naive(planes, k, row, x, width, dest);
+}
+
+void yuv_convert_sse2(const yuv_layout_t* layout, yuv_view_t view,
+	const uint8_t* frame, int y0, int y1, uint32_t* dest)
+{
+	yuv_planes_t planes;
+	_planes(layout, frame, &planes);
+	if (view != YUV_VIEW_COLOR) {
+		_plane_rows(layout, &planes, view, y0, y1, dest);
+		return;
+	}
+	yuv_coeffs_t coeffs;
+	_coeffs(layout, &coeffs);
+	for (int y = y0; y < y1; y++)
+		_color_row_sse2(layout, &planes, &coeffs, y, dest + (size_t)y * layout->width);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Raw YUV frames, as video pipelines dump them: planar I420, semi-planar
+// NV12 and its 10-bit form P010, and packed YUY2, all with 4:2:0 or 4:2:2
+// chroma.  Frames convert to the canvas's 32bpp BGRA, opaque, with the
+// BT.601, BT.709 or BT.2020 matrix in limited or full range, or show one
+// plane as grey at its own size.  Chroma is upsampled by repeating it.
+//
+// The conversion is 13-bit fixed point, so the SSE2 version, 8 pixels at
+// a time, matches the scalar reference exactly; pixel_bench.c checks that.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+	YUV_I420 = 1,	// Y plane, then U, then V, both half size
+	YUV_NV12,		// Y plane, then U and V interleaved, half size
+	YUV_YUY2,		// Y0 U Y1 V, half width chroma on every row
+	YUV_P010,		// NV12 with 16-bit samples, 10 bits at the top
+} yuv_format_t;
+
+typedef enum {
+	YUV_BT601,
+	YUV_BT709,
+	YUV_BT2020,
+} yuv_matrix_t;
+
+typedef enum {
+	YUV_VIEW_COLOR,
+	YUV_VIEW_Y,
+	YUV_VIEW_U,
+	YUV_VIEW_V,
+} yuv_view_t;
+
+typedef struct {
+	yuv_format_t format;
+	int width;
+	int height;
+	yuv_matrix_t matrix;
+	bool full_range;
+} yuv_layout_t;
+
+size_t yuv_frame_bytes(const yuv_layout_t* layout);
+// the size of the image a view shows. chroma planes are smaller.
+void yuv_view_size(const yuv_layout_t* layout, yuv_view_t view, int* out_width,
+	int* out_height);
+// "NV12" and so on
+const char* yuv_format_name(yuv_format_t format);
+// "BT.709" and so on
+const char* yuv_matrix_name(yuv_matrix_t matrix);
+
+// converts rows [y0, y1) of a view of frame into dest, which is the whole
+// view, top-down 32bpp BGRA.
+void yuv_convert_naive(const yuv_layout_t* layout, yuv_view_t view,
+	const uint8_t* frame, int y0, int y1, uint32_t* dest);
+void yuv_convert_sse2(const yuv_layout_t* layout, yuv_view_t view,
+	const uint8_t* frame, int y0, int y1, uint32_t* dest);
+
+// converts count pixels of row y of the color view, at x0 + i * step, for
+// reading a region of a frame too large to convert whole
+void yuv_convert_samples(const yuv_layout_t* layout, const uint8_t* frame,
+	int x0, int y, int step, int count, uint32_t* dest);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,274 @@
+#include "dev_image_viewer.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <strsafe.h>
+#include <wchar.h>
+#include <wctype.h>
+
+#include "gdiplus_loader.h"
+#include "parallel.h"
+#include "trace.h"
+#include "yuv_file.h"
+
+// rows per parallel_for() item
+#define YUV_FILE_ROWS_PER_ITEM 64
+
+struct yuv_file_t {
+	HANDLE file;
+	// matrix and range as the name says, or their defaults
+	yuv_layout_t layout;
+	size_t frame_bytes;
+	int num_frames;
+};
+
+typedef struct {
+	const yuv_layout_t* layout;
+	yuv_view_t view;
+	const uint8_t* frame;
+	int height;
+	uint32_t* pixels;
+} yuv_job_t;
+
+static yuv_settings_t yuv_settings = { YUV_FILE_AUTO, YUV_FILE_AUTO, YUV_VIEW_COLOR };
+
+void yuv_file_get_settings(yuv_settings_t* settings)
+{
+	*settings = yuv_settings;
+}
+
+void yuv_file_set_settings(const yuv_settings_t* settings)
+{
+	yuv_settings = *settings;
+}
+
+static bool _token_is(const WCHAR* token, size_t length, const WCHAR* word)
+{
+	return wcslen(word) == length && !wcsncmp(token, word, length);
+}
+
+// reads what a word of the name says into the layout. a matrix goes in
+// named_matrix, since the default depends on the rest.
+static void _parse_token(const WCHAR* token, size_t length, yuv_layout_t* layout,
+	int* named_matrix)
+{
+	int width, height;
+	WCHAR tail;
+	WCHAR word[32];
+	if (length >= ARRAYSIZE(word))
+		return;
+	wcsncpy_s(word, ARRAYSIZE(word), token, length);
+	if (swscanf_s(word, L"%dx%d%c", &width, &height, &tail, 1) == 2) {
+		layout->width = width;
+		layout->height = height;
+	}
+	else if (_token_is(token, length, L"nv12"))
+		layout->format = YUV_NV12;
+	else if (_token_is(token, length, L"i420") || _token_is(token, length, L"iyuv") ||
+		_token_is(token, length, L"yuv420p"))
+		layout->format = YUV_I420;
+	else if (_token_is(token, length, L"yuy2") || _token_is(token, length, L"yuyv"))
+		layout->format = YUV_YUY2;
+	else if (_token_is(token, length, L"p010"))
+		layout->format = YUV_P010;
+	else if (_token_is(token, length, L"bt601") || _token_is(token, length, L"601"))
+		*named_matrix = YUV_BT601;
+	else if (_token_is(token, length, L"bt709") || _token_is(token, length, L"709"))
+		*named_matrix = YUV_BT709;
+	else if (_token_is(token, length, L"bt2020") || _token_is(token, length, L"2020"))
+		*named_matrix = YUV_BT2020;
+	else if (_token_is(token, length, L"full") || _token_is(token, length, L"pc"))
+		layout->full_range = true;
+	else if (_token_is(token, length, L"limited") || _token_is(token, length, L"tv"))
+		layout->full_range = false;
+}
+
+static bool _parse_name(const WCHAR* path, yuv_layout_t* layout)
+{
+	const WCHAR* name = path;
+	for (const WCHAR* p = path; *p; p++) {
+		if (*p == L'\\' || *p == L'/')
+			name = p + 1;
+	}
+	WCHAR lower[MAX_PATH];
+	if (FAILED(StringCchCopyW(lower, ARRAYSIZE(lower), name)))
+		return false;
+	_wcslwr_s(lower, ARRAYSIZE(lower));
+	WCHAR* ext = wcsrchr(lower, L'.');
+	if (!ext)
+		return false;
+	ext++;
+	if (wcscmp(ext, L"yuv") && wcscmp(ext, L"nv12") && wcscmp(ext, L"i420") &&
+		wcscmp(ext, L"iyuv") && wcscmp(ext, L"yuy2") && wcscmp(ext, L"yuyv") &&
+		wcscmp(ext, L"p010"))
+		return false;
+
+	ZeroMemory(layout, sizeof(*layout));
+	layout->format = YUV_I420;
+	int named_matrix = YUV_FILE_AUTO;
+	// the extension is a word too, so a format there counts
+	const WCHAR* token = lower;
+	for (const WCHAR* p = lower;; p++) {
+		if (!iswalnum(*p)) {
+			if (p > token)
+				_parse_token(token, p - token, layout, &named_matrix);
+			token = p + 1;
+		}
+		if (!*p)
+			break;
+	}
+	if (layout->width <= 0 || layout->height <= 0 ||
+		layout->width > 65536 || layout->height > 65536)
+		return false;
+	if (named_matrix != YUV_FILE_AUTO)
+		layout->matrix = (yuv_matrix_t)named_matrix;
+	else if (layout->format == YUV_P010)
+		layout->matrix = YUV_BT2020;
+	else
+		layout->matrix = layout->height >= 720 ? YUV_BT709 : YUV_BT601;
+	return true;
+}
+
+// the layout with the settings' overrides
+static yuv_layout_t _layout(const yuv_file_t* file, const yuv_settings_t* settings)
+{
+	yuv_layout_t layout = file->layout;
+	if (settings->matrix != YUV_FILE_AUTO)
+		layout.matrix = (yuv_matrix_t)settings->matrix;
+	if (settings->full_range != YUV_FILE_AUTO)
+		layout.full_range = settings->full_range != 0;
+	return layout;
+}
+
+bool yuv_file_is_yuv(const WCHAR* path)
+{
+	yuv_layout_t layout;
+	return _parse_name(path, &layout);
+}
+
+bool yuv_file_get_layout(const WCHAR* path, yuv_layout_t* out_layout)
+{
+	return _parse_name(path, out_layout);
+}
+
+yuv_file_t* yuv_file_open(const WCHAR* path)
+{
+	yuv_layout_t layout;
+	if (!_parse_name(path, &layout))
+		return NULL;
+
+	HANDLE handle = CreateFileW(path, GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (handle == INVALID_HANDLE_VALUE)
+		return NULL;
+	LARGE_INTEGER size;
+	size_t frame_bytes = yuv_frame_bytes(&layout);
+	yuv_file_t* file = NULL;
+	if (GetFileSizeEx(handle, &size) && (uint64_t)size.QuadPart >= frame_bytes &&
+		frame_bytes < MAXDWORD)
+		file = (yuv_file_t*)calloc(1, sizeof(yuv_file_t));
+	if (!file) {
+		CloseHandle(handle);
+		return NULL;
+	}
+	file->file = handle;
+	file->layout = layout;
+	file->frame_bytes = frame_bytes;
+	// a partial frame at the end is left out
+	uint64_t num_frames = (uint64_t)size.QuadPart / frame_bytes;
+	file->num_frames = num_frames > INT_MAX ? INT_MAX : (int)num_frames;
+	return file;
+}
+
+void yuv_file_close(yuv_file_t* file)
+{
+	if (!file)
+		return;
+	CloseHandle(file->file);
+	free(file);
+}
+
+int yuv_file_num_frames(const yuv_file_t* file)
+{
+	return file->num_frames;
+}
+
+void yuv_file_describe(const yuv_file_t* file, WCHAR* text, size_t text_count)
+{
+	static const WCHAR* view_names[] = { L"", L", Y plane", L", U plane", L", V plane" };
+	yuv_settings_t settings;
+	yuv_file_get_settings(&settings);
+	yuv_layout_t layout = _layout(file, &settings);
+	StringCchPrintfW(text, text_count, L"%S %dx%d, %S %s%s",
+		yuv_format_name(layout.format), layout.width, layout.height,
+		yuv_matrix_name(layout.matrix), layout.full_range ? L"full" : L"limited",
+		view_names[settings.view]);
+}
+
+static void _convert_item(void* ctx, int index)
+{
+	yuv_job_t* job = (yuv_job_t*)ctx;
+	int y0 = index * YUV_FILE_ROWS_PER_ITEM;
+	int y1 = min(y0 + YUV_FILE_ROWS_PER_ITEM, job->height);
+	yuv_convert_sse2(job->layout, job->view, job->frame, y0, y1, job->pixels);
+}
+
+bool yuv_file_read(yuv_file_t* file, int index, HBITMAP* out_hbitmap,
+	void** out_bits, int* out_width, int* out_height)
+{
+	if (index < 0 || index >= file->num_frames)
+		return false;
+	yuv_settings_t settings;
+	yuv_file_get_settings(&settings);
+	yuv_layout_t layout = _layout(file, &settings);
+
+	// reads at an offset, so threads don't share a file position
+	uint64_t start = trace_begin();
+	uint8_t* frame = (uint8_t*)malloc(file->frame_bytes);
+	if (!frame)
+		return false;
+	OVERLAPPED overlapped;
+	ZeroMemory(&overlapped, sizeof(overlapped));
+	uint64_t offset = (uint64_t)index * file->frame_bytes;
+	overlapped.Offset = (DWORD)offset;
+	overlapped.OffsetHigh = (DWORD)(offset >> 32);
+	DWORD bytes_read = 0;
+	if (!ReadFile(file->file, frame, (DWORD)file->frame_bytes, &bytes_read, &overlapped) ||
+		bytes_read != file->frame_bytes) {
+		free(frame);
+		return false;
+	}
+
+	int width, height;
+	yuv_view_size(&layout, settings.view, &width, &height);
+	BITMAPV5HEADER bmi;
+	init_bitmap_header(&bmi, width, height);
+	HDC hdc = GetDC(NULL);
+	void* bits = NULL;
+	HBITMAP hbitmap = CreateDIBSection(hdc, (BITMAPINFO*)&bmi, DIB_RGB_COLORS,
+		&bits, NULL, 0);
+	ReleaseDC(NULL, hdc);
+	if (!hbitmap) {
+		free(frame);
+		return false;
+	}
+
+	yuv_job_t job;
+	job.layout = &layout;
+	job.view = settings.view;
+	job.frame = frame;
+	job.height = height;
+	job.pixels = (uint32_t*)bits;
+	parallel_for((height + YUV_FILE_ROWS_PER_ITEM - 1) / YUV_FILE_ROWS_PER_ITEM,
+		_convert_item, &job);
+	free(frame);
+	uint64_t num_pixels = (uint64_t)width * height;
+	trace_end(TRACE_DECODE, start, file->frame_bytes + num_pixels * 4, num_pixels);
+
+	*out_hbitmap = hbitmap;
+	*out_bits = bits;
+	*out_width = width;
+	*out_height = height;
+	return true;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <Windows.h>
+#include <stdbool.h>
+
+#include "yuv.h"
+
+// Raw YUV files (see yuv.h), which have no header, so the layout comes
+// from the name: the size as WxH, and the format, matrix and range as
+// words in it or the extension, as in clip_1920x1080_bt709.nv12 or
+// dump_3840x2160_p010_full.yuv.  A plain .yuv is I420, and the matrix
+// defaults to BT.2020 for P010, BT.709 from 720 rows up, and BT.601 below,
+// in limited range.  A file holding several frames plays like an
+// animation.  Frames are read on demand and converted straight into the
+// level 0 DIB section, in bands over parallel_for().
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define YUV_FILE_AUTO -1
+
+// how every YUV file shows, chosen from the keyboard
+typedef struct {
+	int matrix;		// a yuv_matrix_t, or YUV_FILE_AUTO for what the name says
+	int full_range;	// 0 or 1, or YUV_FILE_AUTO
+	yuv_view_t view;
+} yuv_settings_t;
+
+void yuv_file_get_settings(yuv_settings_t* settings);
+void yuv_file_set_settings(const yuv_settings_t* settings);
+
+typedef struct yuv_file_t yuv_file_t;
+
+// whether the name is of a YUV file with its size in it
+bool yuv_file_is_yuv(const WCHAR* path);
+// the layout the name gives, without reading the file
+bool yuv_file_get_layout(const WCHAR* path, yuv_layout_t* out_layout);
+// NULL if the name isn't, or the file is smaller than one frame
+yuv_file_t* yuv_file_open(const WCHAR* path);
+void yuv_file_close(yuv_file_t* file);
+
+int yuv_file_num_frames(const yuv_file_t* file);
+// as the settings show it, e.g. "NV12 1920x1080, BT.709 limited, Y plane"
+void yuv_file_describe(const yuv_file_t* file, WCHAR* text, size_t text_count);
+
+// a frame as canvas_read_image() returns an image: a new top-down 32bpp
+// premultiplied DIB section.  safe on any thread.
+bool yuv_file_read(yuv_file_t* file, int index, HBITMAP* out_hbitmap,
+	void** out_bits, int* out_width, int* out_height);
+
+#ifdef __cplusplus
+}
+#endif